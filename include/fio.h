@@ -39,6 +39,10 @@ int freadFloatEx(float *pf, FILE *fp) ;
 int freadIntEx(int *pi, FILE *fp) ;
 int freadShortEx(short *ps, FILE *fp) ;
 
+/* read n values with one fread, return the number read */
+size_t freadFloatArray(float *v, size_t n, FILE *fp) ;
+size_t freadIntArray(int *v, size_t n, FILE *fp) ;
+
 int   fwriteDouble(double d, FILE *fp) ;
 int   fwriteFloat(float f, FILE *fp) ;
 int   fwriteShort(short s, FILE *fp) ;
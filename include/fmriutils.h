@@ -64,6 +64,8 @@ typedef struct
   MRI *pcc[100];     // partial correlation coeff
   MRI *ypmf[100];    // partial model fit for each contrast
   MRI *FrameMask;    // Exclude a frame at a voxel if 0
+
+  int SimOnly;       // Only compute gamma, F, p, sig, z (for simulations)
 }
 MRIGLM;
 /*---------------------------------------------------------*/
@@ -90,6 +92,7 @@ int MRIfromSymMatrix(MRI *mri, int c, int r, int s, MATRIX *M);
 MRI *MRInormWeights(MRI *w, int sqrtFlag, int invFlag, MRI *mask, MRI *wn);
 
 int MRIglmFitAndTest(MRIGLM *mriglm);
+int MRIglmBatchable(MRIGLM *mriglm);
 int MRIglmFit(MRIGLM *glmmri);
 int MRIglmTest(MRIGLM *mriglm);
 int MRIglmLoadVox(MRIGLM *mriglm, int c, int r, int s, int LoadBeta, GLMMAT *glm);
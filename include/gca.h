@@ -222,6 +222,12 @@ typedef struct
   int          total_training ;
   int          max_label ;
   COLOR_TABLE  *ct ;
+  // storage backing a GCA loaded from a flat (.gcf) file. The node and
+  // prior arrays point into these blocks instead of owning their memory.
+  void         *flat_map ;       // mmapped file contents
+  size_t        flat_map_size ;
+  void         *flat_heap ;      // GC1D structs and gibbs pointer tables
+  size_t        flat_heap_size ;
 }
 GAUSSIAN_CLASSIFIER_ARRAY, GCA ;
 
@@ -277,6 +283,9 @@ int  GCAtrain(GCA *gca, MRI *mri_inputs, MRI *mri_labels, TRANSFORM *transform,
 int  GCAtrainCovariances(GCA *gca, MRI *mri_inputs, MRI *mri_labels, TRANSFORM *transform) ;
 int  GCAwrite(GCA *gca,const char *fname) ;
 GCA  *GCAread(const char *fname) ;
+int  GCAwriteFlat(GCA *gca, const char *fname) ;
+GCA  *GCAreadFlat(const char *fname) ;
+int  GCAisFlatFile(const char *fname) ;
 int  GCAcompleteMeanTraining(GCA *gca) ;
 int  GCAcompleteCovarianceTraining(GCA *gca) ;
 MRI  *GCAlabel(MRI *mri_src, GCA *gca, MRI *mri_dst, TRANSFORM *transform) ;
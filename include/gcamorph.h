@@ -87,58 +87,66 @@
 
 typedef struct
 {
-  // gcamorph uses these fields in its hottest function so put them together to reduce cache misses
+  // gcamorph uses these fields in its hottest function so put them together to reduce cache misses.
+  // The energy and gradient loops stride over every node, so the fields only a few passes
+  // use are kept in GCA_MORPH_NODE_COLD instead.
   char   invalid;       /* if invalid = 1, then don't use this structure */
   int    label ;
+  int    status ;       /* ignore likelihood term */
+  float  log_p ;         /* current log probability of this sample */
   double x ;          //  updated original src voxel position
   double y ;
   double z ;
   double origx ;      //  mri original src voxel position (using lta)
   double origy ;
   double origz ;
-  //
-  double saved_origx ;      //  mri original src voxel position (using lta)
-  double saved_origy ;
-  double saved_origz ;
-  double xs ;         //  not saved
-  double ys ;
-  double zs ;
-  double xs2 ;         //  more tmp storage
-  double ys2 ;
-  double zs2 ;
-  int    xn ;         /* node coordinates */
-  int    yn ;         //  prior voxel position
-  int    zn ;
-  int    n ;          /* index in gcan structure */
-  float  prior ;
   GC1D   *gc ;
-  float  log_p ;         /* current log probability of this sample */
   float  dx, dy, dz;     /* current gradient */
   float  odx, ody, odz ; /* previous gradient */
-  float  jx, jy, jz ;    /* jacobian gradient */
   float  area ;
   float  area1 ;      // right handed coordinate system
   float  area2 ;      // left-handed coordinate system
   float  orig_area ;
   float  orig_area1 ;
   float  orig_area2 ;
-  int    status ;       /* ignore likelihood term */
+  float  prior ;
   float  label_dist ;   /* for computing label dist */
+  int    xn ;         /* node coordinates */
+  int    yn ;         //  prior voxel position
+  int    zn ;
+  int    n ;          /* index in gcan structure */
+  double xs ;         //  not saved
+  double ys ;
+  double zs ;
+}
+GCA_MORPH_NODE, GMN ;
+
+// The rest of a node, allocated by GCAMallocColdNodes only when a pass that uses it runs
+typedef struct
+{
+  double saved_origx ;      //  mri original src voxel position (using lta)
+  double saved_origy ;
+  double saved_origz ;
+  double xs2 ;         //  more tmp storage
+  double ys2 ;
+  double zs2 ;
+  double sum_ci_vi_ui ;
+  double sum_ci_vi ;
   float  last_se ;
   float  predicted_val ; /* weighted average of all class 
                             means in a ball around this node */
-  double sum_ci_vi_ui ;
-  double sum_ci_vi ;
   float  target_dist ;   /* target distance to move towards for 
                             label matching with distance xform */
 }
-GCA_MORPH_NODE, GMN ;
+GCA_MORPH_NODE_COLD, GMNC ;
 
 struct GCA_MORPH
 {
   int  width, height ,depth ;
   GCA  *gca ;          // using a separate GCA data (not saved)
-  GMN  ***nodes ;
+  GMN  ***nodes ;      // nodes[x][y] points into node_store
+  GMN  *node_store ;   // all the nodes, z fastest - see GCAMnodeIndex
+  GMNC *cold_nodes ;   // NULL until GCAMallocColdNodes, indexed like node_store
   int  neg ;
   double exp_k ;
   int  spacing ; // poor choice to make this an int
@@ -157,6 +165,18 @@ struct GCA_MORPH
 
 typedef GCA_MORPH GCAM;
 
+// node_store[GCAMnodeIndex(gcam,x,y,z)] is gcam->nodes[x][y][z]
+static inline int GCAMnodeIndex(GCA_MORPH const *gcam, int x, int y, int z)
+{
+  return (x * gcam->height + y) * gcam->depth + z;
+}
+
+// the cold fields of a node of gcam.  GCAMallocColdNodes must have been called.
+static inline GMNC *GCAMcoldNode(GCA_MORPH const *gcam, GMN const *gcamn)
+{
+  return &gcam->cold_nodes[gcamn - gcam->node_store];
+}
+
 typedef struct
 {
   GCAM   *gcam ;
@@ -304,6 +324,7 @@ GCA_MORPH *GCAMconcat3(LTA *lta1, GCAM *gcam, LTA *lta2, GCAM *out) ;
 GCA_MORPH *GCAMchangeVolGeom(GCA_MORPH *gcam, MRI *mri_src, MRI *mri_dst) ;
 GCA_MORPH *GCAMdownsample2(GCA_MORPH *gcam) ;
 GCA_MORPH *GCAMalloc( const int width, const int height, const int depth );
+int       GCAMallocColdNodes(GCA_MORPH *gcam) ;
 
 int       GCAMinit(GCA_MORPH *gcam, MRI *mri_image, GCA *gca, 
                    TRANSFORM *transform, int relabel) ;
@@ -1079,6 +1079,10 @@ MRI   *MRImin(MRI *mri1, MRI *mri2, MRI *mri_min);
 MRI   *MRIminmax(MRI *mri_src, MRI *mri_dst, MRI *mri_dir, int wsize) ;
 MRI   *MRIgaussian1d(float sigma, int max_len) ;
 MRI   *MRIconvolveGaussian(MRI *mri_src, MRI *mri_dst, MRI *mri_gaussian) ;
+// sigma in voxels; MRIgaussianSmoothNI() uses the recursive filter from
+// MRI_GAUSSIAN_IIR_MIN_SIGMA up and its smoothing matrices below it
+#define MRI_GAUSSIAN_IIR_MIN_SIGMA 3.0
+MRI   *MRIconvolveGaussianRecursive(MRI *mri_src, MRI *mri_dst, float sigma) ;
 MRI   *MRIgaussianSmooth(MRI *src, double std, int norm, MRI *targ);
 MRI   *MRImaskedGaussianSmooth(MRI *src, MRI *binmask, double std, MRI *targ);
 MRI   *MRIconvolveGaussianMeanAndStdByte(MRI *mri_src, MRI *mri_dst,
@@ -1831,6 +1835,11 @@ float MRIvoxelsInLabelWithPartialVolumeEffects( const MRI *mri,
 						int label,
 						MRI *mri_mixing_coef,
 						MRI *mri_nbr_labels );
+int MRIvoxelsInLabelsWithPartialVolumeEffects( const MRI *mri,
+						const MRI *mri_vals,
+						const int nlabels,
+						const int *labels,
+						float *volumes );
 MRI   *MRImakeDensityMap(MRI *mri, MRI *mri_vals, int label, MRI *mri_dst,
                          float orig_res) ;
 int MRIfillBox(MRI *mri, MRI_REGION *box, float fillval) ;
@@ -1846,6 +1855,9 @@ MATRIX *GetSurfaceRASToVoxelMatrix(VOL_GEOM *mri);
 // functions read/write MRI_MGH_FILE
 MRI *mghRead(const char *fname, int read_volume=TRUE, int frame=-1);
 int mghWrite(MRI *mri, const char *fname, int frame=-1, int intent=MGZ_INTENT_UNKNOWN);
+// # of threads mgz voxels are compressed and decompressed with, 0 for all.
+// Defaults to $FS_MGZIO_NTHREADS, or 1 (a single gzip stream) when not set.
+void mghSetIOThreads(int nthreads);
 
 /* Zero-padding for 3d analyze (ie, spm) format */
 #ifdef _MRIIO_SRC
@@ -131,6 +131,10 @@ int MRIsegStats(MRI *seg, int segid, MRI *mri,int frame,
 int MRIsegStatsRobust(MRI *seg, int segid, MRI *mri,int frame,
 		      float *min, float *max, float *range,
 		      float *mean, float *std, float Pct);
+int MRIsegStatsMulti(MRI *seg, int nsegs, const int *segids, MRI *mri, int frame,
+		     int UseRobust, float Pct, int *nvoxels,
+		     float *min, float *max, float *range,
+		     float *mean, float *std, double **favg);
 
 MRI *MRImask_with_T2_and_aparc_aseg(MRI *mri_src, MRI *mri_dst, MRI *mri_T2, MRI *mri_aparc_aseg, float T2_thresh, int mm_from_exterior) ;
 int *MRIsegmentationList(MRI *seg, int *pListLength);
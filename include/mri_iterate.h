@@ -0,0 +1,219 @@
+#pragma once
+/**
+ * @brief typed access to the voxels of an MRI, with the type dispatch done once
+ *
+ * MRIgetVoxVal and MRIsetVoxVal check the bounds, the complex type, ischunked
+ * and switch on mri->type for every voxel, which keeps the c/r/s loops that
+ * call them from vectorizing.  The functions here hoist that work out of the
+ * inner loop:
+ *
+ *   MRIrow<T>(mri,r,s,f)           typed pointer to the width voxels of a row
+ *   MRIforEachRow<T>/Voxel<T>      call a functor for every row/voxel of a frame
+ *   MRIdispatchType(type,visitor)  calls visitor((T*)nullptr) for the C type of type
+ *   MRIgetRowVals/MRIsetRowVals    copy a row to/from a float or double buffer,
+ *                                  with exactly the conversions of MRIgetVoxVal
+ *                                  and MRIsetVoxVal, for code that does not
+ *                                  want to be written per type
+ *   MRIvoxelReader                 MRIgetVoxVal for gathers, dispatched once
+ *
+ * Rows are always contiguous (the slices[][] row pointers are set up whether
+ * or not the volume is chunked), so they work for every MRI.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <limits>
+
+#include "mri.h"
+#include "error.h"
+
+
+// The C type stored for each MRI type, and the range MRIsetVoxVal clips to
+//
+template <class T> struct MRItypeTraits;
+
+template <> struct MRItypeTraits<unsigned char>  { enum { type = MRI_UCHAR, isInteger = 1 }; };
+template <> struct MRItypeTraits<short>          { enum { type = MRI_SHORT, isInteger = 1 }; };
+template <> struct MRItypeTraits<unsigned short> { enum { type = MRI_USHRT, isInteger = 1 }; };
+template <> struct MRItypeTraits<int>            { enum { type = MRI_INT,   isInteger = 1 }; };
+template <> struct MRItypeTraits<long>           { enum { type = MRI_LONG,  isInteger = 1 }; };
+template <> struct MRItypeTraits<float>          { enum { type = MRI_FLOAT, isInteger = 0 }; };
+
+
+// Calls visitor((T*)nullptr) with T the C type of the voxels of an MRI type.
+// MRI_RGB is stored as int.  MRI_FLOAT_COMPLEX is not dispatched, because its
+// voxels are pairs - check for it before calling this.
+//
+template <class Visitor>
+inline void MRIdispatchType(int type, Visitor & visitor)
+{
+  switch (type) {
+  case MRI_UCHAR: visitor((unsigned char *)nullptr);  break;
+  case MRI_SHORT: visitor((short *)nullptr);          break;
+  case MRI_USHRT: visitor((unsigned short *)nullptr); break;
+  case MRI_RGB:
+  case MRI_INT:   visitor((int *)nullptr);            break;
+  case MRI_LONG:  visitor((long *)nullptr);           break;
+  case MRI_FLOAT: visitor((float *)nullptr);          break;
+  default:
+    ErrorExit(ERROR_UNSUPPORTED, "MRIdispatchType: unsupported type %d", type);
+  }
+}
+
+
+// The voxels c = 0..width-1 of row r, slice s, frame f
+//
+template <class T>
+inline T * MRIrow(MRI * mri, int r, int s, int f)
+{
+  return (T *)mri->slices[s + f * mri->depth][r];
+}
+
+template <class T>
+inline T const * MRIrow(MRI const * mri, int r, int s, int f)
+{
+  return (T const *)mri->slices[s + f * mri->depth][r];
+}
+
+
+// op(T* row, int r, int s) for every row of frame f, slices outermost
+//
+template <class T, class Op>
+inline void MRIforEachRow(MRI * mri, int f, Op & op)
+{
+  for (int s = 0; s < mri->depth; s++)
+    for (int r = 0; r < mri->height; r++) op(MRIrow<T>(mri, r, s, f), r, s);
+}
+
+// op(T& voxel, int c, int r, int s) for every voxel of frame f, columns innermost
+//
+template <class T, class Op>
+inline void MRIforEachVoxel(MRI * mri, int f, Op & op)
+{
+  int const width = mri->width;
+  for (int s = 0; s < mri->depth; s++)
+    for (int r = 0; r < mri->height; r++) {
+      T * const row = MRIrow<T>(mri, r, s, f);
+      for (int c = 0; c < width; c++) op(row[c], c, r, s);
+    }
+}
+
+
+// nint() from utils.cpp, inline so the loops that use it can vectorize
+//
+inline int MRIroundToInt(double v) { return (v < 0 ? ((int)(v - 0.5)) : ((int)(v + 0.5))); }
+
+
+template <class T, class D>
+inline void MRIgetRowValsTyped(T const * src, int width, D * dst)
+{
+  for (int c = 0; c < width; c++) dst[c] = (D)(float)src[c];
+}
+
+template <class T, class S>
+inline void MRIsetRowValsTyped(T * dst, int width, S const * src)
+{
+  if (!MRItypeTraits<T>::isInteger) {
+    for (int c = 0; c < width; c++) dst[c] = (T)(float)src[c];
+    return;
+  }
+  float const lo = (float)std::numeric_limits<T>::min();
+  float const hi = (float)std::numeric_limits<T>::max();
+  for (int c = 0; c < width; c++) {
+    float v = (float)src[c];
+    if (v < lo) v = lo;
+    if (v > hi) v = hi;
+    dst[c] = (T)MRIroundToInt(v);
+  }
+}
+
+
+// dst[c] = MRIgetVoxVal(mri,c,r,s,f) for c = 0..width-1
+//
+template <class D>
+inline void MRIgetRowVals(MRI const * mri, int r, int s, int f, D * dst)
+{
+  int const width = mri->width;
+  switch (mri->type) {
+  case MRI_UCHAR: MRIgetRowValsTyped(MRIrow<unsigned char> (mri, r, s, f), width, dst); break;
+  case MRI_SHORT: MRIgetRowValsTyped(MRIrow<short>         (mri, r, s, f), width, dst); break;
+  case MRI_USHRT: MRIgetRowValsTyped(MRIrow<unsigned short>(mri, r, s, f), width, dst); break;
+  case MRI_RGB:
+  case MRI_INT:   MRIgetRowValsTyped(MRIrow<int>           (mri, r, s, f), width, dst); break;
+  case MRI_LONG:  MRIgetRowValsTyped(MRIrow<long>          (mri, r, s, f), width, dst); break;
+  case MRI_FLOAT: MRIgetRowValsTyped(MRIrow<float>         (mri, r, s, f), width, dst); break;
+  case MRI_FLOAT_COMPLEX: {
+    float const * row = MRIrow<float>(mri, r, s, f);
+    for (int c = 0; c < width; c++) dst[c] = (D)row[2 * c];    // the real part, as MRIgetVoxVal does
+  } break;
+  default:
+    ErrorExit(ERROR_UNSUPPORTED, "MRIgetRowVals: unsupported type %d", mri->type);
+  }
+}
+
+// MRIsetVoxVal(mri,c,r,s,f,src[c]) for c = 0..width-1, including the clipping and rounding
+//
+template <class S>
+inline void MRIsetRowVals(MRI * mri, int r, int s, int f, S const * src)
+{
+  int const width = mri->width;
+  switch (mri->type) {
+  case MRI_UCHAR: MRIsetRowValsTyped(MRIrow<unsigned char> (mri, r, s, f), width, src); break;
+  case MRI_SHORT: MRIsetRowValsTyped(MRIrow<short>         (mri, r, s, f), width, src); break;
+  case MRI_USHRT: MRIsetRowValsTyped(MRIrow<unsigned short>(mri, r, s, f), width, src); break;
+  case MRI_RGB:
+  case MRI_INT:   MRIsetRowValsTyped(MRIrow<int>           (mri, r, s, f), width, src); break;
+  case MRI_LONG:  MRIsetRowValsTyped(MRIrow<long>          (mri, r, s, f), width, src); break;
+  case MRI_FLOAT: MRIsetRowValsTyped(MRIrow<float>         (mri, r, s, f), width, src); break;
+  case MRI_FLOAT_COMPLEX: {
+    float * row = MRIrow<float>(mri, r, s, f);
+    for (int c = 0; c < width; c++) row[2 * c] = (float)src[c];
+  } break;
+  default:
+    ErrorExit(ERROR_UNSUPPORTED, "MRIsetRowVals: unsupported type %d", mri->type);
+  }
+}
+
+
+// MRIgetVoxVal for in-bounds voxels, with the type switch done when constructed.
+// For gathers (eg nearest neighbor sampling) where rows do not help.
+//
+class MRIvoxelReader
+{
+public:
+  explicit MRIvoxelReader(MRI const * mri) : mri(mri), get(nullptr)
+  {
+    switch (mri->type) {
+    case MRI_UCHAR: get = &getTyped<unsigned char>;  break;
+    case MRI_SHORT: get = &getTyped<short>;          break;
+    case MRI_USHRT: get = &getTyped<unsigned short>; break;
+    case MRI_RGB:
+    case MRI_INT:   get = &getTyped<int>;            break;
+    case MRI_LONG:  get = &getTyped<long>;           break;
+    case MRI_FLOAT: get = &getTyped<float>;          break;
+    case MRI_FLOAT_COMPLEX: get = &getComplexReal;   break;
+    default:
+      ErrorExit(ERROR_UNSUPPORTED, "MRIvoxelReader: unsupported type %d", mri->type);
+    }
+  }
+
+  float operator()(int c, int r, int s, int f) const { return get(mri, c, r, s, f); }
+
+private:
+  MRI const * mri;
+  float (*get)(MRI const * mri, int c, int r, int s, int f);
+
+  template <class T>
+  static float getTyped(MRI const * mri, int c, int r, int s, int f) { return (float)MRIrow<T>(mri, r, s, f)[c]; }
+  static float getComplexReal(MRI const * mri, int c, int r, int s, int f) { return MRIrow<float>(mri, r, s, f)[2 * c]; }
+};
@@ -0,0 +1,62 @@
+#pragma once
+/*
+ *
+ */
+/*
+ * surfaces Author: Bruce Fischl, extracted from mrisurf.c by Bevin Brett
+ *
+ * $ Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+#include "mrisurf_metricProperties.h"
+
+// Structure-of-arrays copy of the few per-vertex properties the smoothness
+// terms of the deformation loops read.  The VERTEX struct carries dozens of
+// coordinate sets, so a loop that only needs xyz of a vertex and its 1-ring
+// misses cache on every neighbor.  Here those values are packed densely and
+// the 1-ring is stored CSR style, so the neighbor gathers stay in cache.
+//
+// Like MRIS_MP this is a snapshot: load it after the positions and normals
+// have been computed, and unload it if the positions are changed in it.
+//
+struct MRIS_SoA {
+  int     nvertices;
+  int     capacity;             // # of vertices allocated
+  int     nbr_capacity;         // # of neighbor entries allocated
+  int     topology_loaded;      // nbr_start/nbrs are valid for this surface
+  MRIS const * topology_src;    // the surface the neighbor table was built from
+  char   *ripflag;
+  char   *border;
+  char   *neg;
+  float  *x,  *y,  *z;
+  float  *nx, *ny, *nz;
+  float  *dx, *dy, *dz;
+  int    *nbr_start;            // nvertices+1 entries, 1-ring of vno is nbrs[nbr_start[vno]..nbr_start[vno+1]-1]
+  int    *nbrs;
+  // sum over the unripped 1-ring of (neighbor - vertex), and the number summed.
+  // This is the umbrella operator shared by the spring, normal spring and
+  // tangential spring terms.
+  float  *sx, *sy, *sz;
+  int    *sn;
+};
+
+void MRISSoA_ctr(MRIS_SoA* soa);
+void MRISSoA_dtr(MRIS_SoA* soa);
+
+void MRISSoA_load  (MRIS_SoA* soa, MRIS* mris, bool loadDxyz = false);     // MRIS -> SoA
+void MRISSoA_unload(MRIS* mris, MRIS_SoA const * soa, bool unloadXYZ, bool unloadDxyz); // SoA -> MRIS
+void MRISSoA_invalidateTopology(MRIS_SoA* soa);
+
+void MRISSoA_computeNeighborSums(MRIS_SoA* soa);
+
+// Load the SoA and compute the neighbor sums when any of the smoothness terms
+// served by it will be computed this iteration
+bool MRISSoA_prepareSmoothnessTerms(MRIS_SoA* soa, MRIS* mris, INTEGRATION_PARMS const * parms);
@@ -269,6 +269,15 @@ typedef struct MRIS_MP MRIS_MP;
 typedef struct MRISPV MRISPV;
 
 
+// MRIS_SoA is a dense copy of just the xyz, normals and 1-ring needed by the
+// smoothness terms of the deformation loops.  It is loaded from, and can be
+// unloaded back into, an MRIS each iteration.
+//
+// It is defined in mrisurf_SoA.h
+//
+typedef struct MRIS_SoA MRIS_SoA;
+
+
 // The SSE calculation uses some large subsystems, such as MHT, that are coded
 // using the MRIS.  Ideally we would use C++, a class derivation hierachy, and 
 // virtual functions or C++ templates to implement these functions on top of both 
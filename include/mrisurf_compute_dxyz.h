@@ -21,6 +21,7 @@
 //  and using either the MRIS or another representation of the Surface Face Vertex information
 //
 #include "mrisurf_metricProperties.h"
+#include "mrisurf_SoA.h"
 
 void mrisDxyzSetLocationMoveLen(double newval);
 int mrisComputeAngleAreaTerms(MRIS *mris, INTEGRATION_PARMS *parms);
@@ -52,6 +53,7 @@ int mrisComputeRepulsiveRatioTerm(MRIS *mris, double l_repulse, MHT *mht_v);
 int mrisComputeRepulsiveTerm(MRIS *mris, double l_repulse, MHT *mht_v, MHT *mht_f);
 int mrisComputeShrinkwrapTerm(MRIS *mris, MRI *mri_brain, double l_shrinkwrap);
 int mrisComputeSphereTerm(MRIS *mris, double l_sphere, float radius, int    explode_flag);
+int mrisComputeSpringTerm(MRIS *mris, double l_spring);
 int mrisComputeSurfaceNormalIntersectionTerm(MRIS *mris, MHT *mht, double l_norm, double max_dist);
 int mrisComputeSurfaceRepulsionTerm(MRIS *mris, double l_repulse, MHT *mht);
 int mrisComputeTargetLocationTerm(MRIS *mris, double l_location, INTEGRATION_PARMS *parms);
@@ -70,3 +72,9 @@ void vertexComputeNormalSpringTerm(MRIS* mris, int vno, float* dx, float* dy, fl
 // tangential spring
 void mrisComputeTangentialSpringTerm(MRIS *mris, double l_spring);
 void vertexComputeTangentialSpringTerm(MRIS* mris, int vno, float* dx, float* dy, float* dz, double l_spring = 1.0);
+
+// the spring terms computed from an MRIS_SoA prepared by MRISSoA_prepareSmoothnessTerms,
+// falling back to the MRIS versions above when soaOrNull is NULL
+int  mrisComputeSpringTerm          (MRIS *mris, MRIS_SoA const * soaOrNull, double l_spring);
+void mrisComputeNormalSpringTerm    (MRIS *mris, MRIS_SoA const * soaOrNull, double l_spring);
+void mrisComputeTangentialSpringTerm(MRIS *mris, MRIS_SoA const * soaOrNull, double l_spring);
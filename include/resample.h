@@ -105,6 +105,35 @@ MRI *vol2surf_linear(MRI *SrcVol,
 MRI *MRISapplyRegBCI(MRIS *reg1, MRIS *reg2, MRI *in); // barycentric interp
 MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs,
 		  int ReverseMapFlag, int DoJac, int UseHash);
+
+/* The mapping applied by MRISapplyReg() as a sparse operator in CSR
+   form, so it can be computed once per registration and applied to any
+   number of inputs. Target vertex t is
+     (sum_{k=rowptr[t]}^{rowptr[t+1]-1} src[col[k]]/div[k]) / rowdiv[t]
+   (rowdiv is only applied when > 1), which is the arithmetic of
+   MRISapplyReg(), so results are identical. */
+typedef struct
+{
+  int nsrc, ntrg;                /* vertices in the first source and last target surfaces */
+  int ReverseMapFlag, DoJac;     /* flags the operator was built with */
+  int UseHash;                   /* built with hash tables (can pick other vertices on ties) */
+  int nnz;                       /* number of entries */
+  int *rowptr;                   /* ntrg+1 */
+  int *col;                      /* source vertex of each entry */
+  float *div;                    /* divisor of each entry */
+  float *rowdiv;                 /* divisor of each target vertex */
+  unsigned long long signature;  /* MRISregOpSignature() of the surfaces */
+} MRIS_REG_OP;
+
+MRIS_REG_OP *MRISapplyRegOp(MRI_SURFACE **SurfReg, int nsurfs,
+			    int ReverseMapFlag, int DoJac, int UseHash);
+MRI *MRISregOpApply(MRIS_REG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals);
+unsigned long long MRISregOpSignature(MRI_SURFACE **SurfReg, int nsurfs);
+int MRISregOpMatches(MRIS_REG_OP *op, MRI_SURFACE **SurfReg, int nsurfs,
+		     int ReverseMapFlag, int DoJac, int UseHash);
+int MRISregOpWrite(MRIS_REG_OP *op, const char *fname);
+MRIS_REG_OP *MRISregOpRead(const char *fname);
+void MRISregOpFree(MRIS_REG_OP **pop);
 MRI *surf2surf_nnfr(MRI *SrcSurfVals, MRI_SURFACE *SrcSurfReg,
                     MRI_SURFACE *TrgSurfReg, MRI **SrcHits,
                     MRI **SrcDist, MRI **TrgHits, MRI **TrgDist,
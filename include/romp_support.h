@@ -158,6 +158,60 @@ void ROMP_pflb_end(
     ROMP_pflb_stack_struct  * pflb_stack);
 
 
+// Runtime profiling of the annotated loops, for builds without ROMP_SUPPORT_ENABLED.
+//
+// Off unless the environment variable FS_ROMP_PROFILE names a file.  Then every
+// ROMP_PF_begin/ROMP_PF_end site counts its calls and wall time, and the
+// ROMP_PFLB_begin/ROMP_PFLB_end in its body time how busy each thread was, which
+// gives the thread imbalance.  The profile is written to the file at exit, as csv
+// if the name ends in .csv and json otherwise.  A %p in the name is replaced by the pid.
+//
+// When off, the cost is a test of a global per loop and of a local per loop body.
+//
+typedef struct ROMP_profile_site {
+    const char*   file;
+    const char*   func;
+    unsigned int  line;
+    int           registered;
+    struct ROMP_profile_site* next;     // list of the sites that have run with profiling on
+    long          calls;
+    long          parallelCalls;        // calls where more than one thread ran the body
+    long          wallNs;
+    long          maxWallNs;
+    long          busyNs;               // summed over the calls and the threads
+    long          imbalanceNs;          // summed over the calls, of max - mean per thread busy time
+    int           maxThreads;
+} ROMP_profile_site;
+
+typedef struct ROMP_profile_thread {
+    long beginNs;
+    long busyNs;
+    char pad[64 - 2*sizeof(long)];      // one cache line per thread
+} ROMP_profile_thread;
+
+typedef struct ROMP_profile_frame {
+    ROMP_profile_thread* threads;       // NULL when not profiling
+    int  nthreads;
+    long beginNs;
+} ROMP_profile_frame;
+
+extern int ROMP_profiling;
+
+void ROMP_profile_begin_slow(ROMP_profile_frame* frame);
+void ROMP_profile_end_slow  (ROMP_profile_site* site, ROMP_profile_frame* frame);
+void ROMP_profile_pflb_begin(ROMP_profile_frame* frame);
+void ROMP_profile_pflb_end  (ROMP_profile_frame* frame);
+
+static inline void ROMP_profile_begin(ROMP_profile_frame* frame) {
+    frame->threads = NULL;
+    if (ROMP_profiling) ROMP_profile_begin_slow(frame);
+}
+
+static inline void ROMP_profile_end(ROMP_profile_site* site, ROMP_profile_frame* frame) {
+    if (frame->threads) ROMP_profile_end_slow(site, frame);
+}
+
+
 // The conditionalized macros that either do or don't add the variables and calls based on the above
 //
 #if !defined(ROMP_SUPPORT_ENABLED)
@@ -171,15 +225,23 @@ void ROMP_pflb_end(
 	// end of macro
 
     #define ROMP_PF_begin \
-	{
+	{ \
+	static ROMP_profile_site ROMP_profile_site_local = { __FILE__, __func__, __LINE__, 0, NULL, 0, 0, 0, 0, 0, 0, 0 }; \
+	ROMP_profile_frame ROMP_profile_frame_local; \
+	ROMP_profile_begin(&ROMP_profile_frame_local);
 
     #define ROMP_PF_end \
+	ROMP_profile_end(&ROMP_profile_site_local, &ROMP_profile_frame_local); \
 	}
 
-    #define ROMP_PFLB_begin
-    #define ROMP_PFLB_end
+    #define ROMP_PFLB_begin \
+	{ if (ROMP_profile_frame_local.threads) ROMP_profile_pflb_begin(&ROMP_profile_frame_local); }
+
+    #define ROMP_PFLB_end \
+	{ if (ROMP_profile_frame_local.threads) ROMP_profile_pflb_end(&ROMP_profile_frame_local); }
+
     #define ROMP_PFLB_continue \
-	{ continue; }
+	{ ROMP_PFLB_end continue; }
 	
 #else
 
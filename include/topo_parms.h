@@ -53,6 +53,7 @@ typedef struct
   int intersect; /* do final surface self-intersect ? */
   int optimal_mapping; /* type of mapping */
   float fitness; /* fitness of the retessellated patch */
+  long  seed;    /* seeds the random streams of the genetic search */
 
   /* intensity information */
   float white_mean,white_sigma,white_mean_ll;
@@ -175,6 +175,7 @@ double round(double x);
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <float.h>
+#include <vector>
 
 #include "macros.h"
 #include "utils.h"
@@ -184,6 +185,7 @@ double round(double x);
 #include "diag.h"
 #include "mri.h"
 #include "mri2.h"
+#include "mri_iterate.h"
 #include "fio.h"
 #include "version.h"
 #include "label.h"
@@ -454,68 +456,73 @@ int main(int argc, char *argv[]) {
   if(!replace_only){
     // Binarize
     for(frame = fstart; frame <= fend; frame++){
-      // Do openmp for columns because often nframes = 1
+      // Do openmp for slices because often nframes = 1. Each thread
+      // works a row at a time so the inner loop runs over contiguous voxels.
+      int s;
       #ifdef HAVE_OPENMP
       //printf("Starting parallel %d\n",omp_get_num_threads());
       #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+ : nhits)
       #endif
-      for (c=0; c < InVol->width; c++) {
-        int r,s;
-        double mergeval = BinValNot, maskval, val;
-	for (r=0; r < InVol->height; r++) {
-	  for (s=0; s < InVol->depth; s++) {
-	    if(MergeVol) mergeval = MRIgetVoxVal(MergeVol,c,r,s,frame);
-	    
+      for (s=0; s < InVol->depth; s++) {
+        int const width = InVol->width;
+        std::vector<float> inrow(width), maskrow(width), mergerow(width, BinValNot), outrow(width);
+        for (int r=0; r < InVol->height; r++) {
+          MRIgetRowVals(InVol,r,s,frame,&inrow[0]);
+          if(MaskVol)  MRIgetRowVals(MaskVol,r,s,0,&maskrow[0]);
+          if(MergeVol) MRIgetRowVals(MergeVol,r,s,frame,&mergerow[0]);
+
+          bool const rowOnEdge = (ZeroRowEdges &&   (r == 0 || r == InVol->height-1)) ||
+                                 (ZeroSliceEdges && (s == 0 || s == InVol->depth-1));
+
+          for (int c=0; c < width; c++) {
 	    // Skip if on the edge
-	    if( (ZeroColEdges &&   (c == 0 || c == InVol->width-1))  ||
-		(ZeroRowEdges &&   (r == 0 || r == InVol->height-1)) ||
-		(ZeroSliceEdges && (s == 0 || s == InVol->depth-1)) ){
-	      MRIsetVoxVal(OutVol,c,r,s,frame-fstart,mergeval);
+	    if(rowOnEdge || (ZeroColEdges && (c == 0 || c == width-1))){
+	      outrow[c] = mergerow[c];
 	      continue;
 	    }
 	    
 	    // Skip if not in the mask
-	    if(MaskVol) {
-	      maskval = MRIgetVoxVal(MaskVol,c,r,s,0);
-	      if(maskval < MaskThresh){
-		MRIsetVoxVal(OutVol,c,r,s,frame-fstart,mergeval);
-		continue;
-	      }
+	    if(MaskVol && maskrow[c] < MaskThresh){
+	      outrow[c] = mergerow[c];
+	      continue;
 	    }
 	    
 	    // Get the value at this voxel
-	    val = MRIgetVoxVal(InVol,c,r,s,frame);
+	    double val = inrow[c];
 	    
 	    if(DoMatch){
 	      // Check for a match
               int Matched = 0;
-	      for(n=0; n < nMatch; n++){
+	      for(int n=0; n < nMatch; n++){
 		if(fabs(val - MatchValues[n]) < 2*FLT_MIN){
-		  MRIsetVoxVal(OutVol,c,r,s,frame-fstart,BinVal);
 		  Matched = 1;
-		  nhits ++;
 		  break;
 		}
 	      }
-	      if(!Matched) MRIsetVoxVal(OutVol,c,r,s,frame-fstart,mergeval);
+	      if(Matched){
+		outrow[c] = BinVal;
+		nhits ++;
+	      }
+	      else outrow[c] = mergerow[c];
 	    }
 	    else{
 	      // Determine whether it is in range
 	      if((MinThreshSet && (val < MinThresh)) ||
 		 (MaxThreshSet && (val > MaxThresh))){
 		// It is NOT in the Range
-		MRIsetVoxVal(OutVol,c,r,s,frame-fstart,mergeval);
+		outrow[c] = mergerow[c];
 	      }
 	      else {
 		// It is in the Range
-		MRIsetVoxVal(OutVol,c,r,s,frame-fstart,BinVal);
+		outrow[c] = BinVal;
 		nhits ++;
 	      }
 	    }
 	    
-	  } // slice
+	  } // col
+          MRIsetRowVals(OutVol,r,s,frame-fstart,&outrow[0]);
 	} // row
-      } // col
+      } // slice
     } // frame
   } // if(!replace_only)
 
@@ -644,17 +651,16 @@ int main(int argc, char *argv[]) {
     #ifdef HAVE_OPENMP
     #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+ : nhits)
     #endif
-    for (c=0; c < OutVol->width; c++) {
-      double val;
-      int r,s;
-      for (r=0; r < OutVol->height; r++) {
-	for (s=0; s < OutVol->depth; s++) {
-	  // Get the value at this voxel
-	  val = MRIgetVoxVal(OutVol,c,r,s,0);
+    for (int s=0; s < OutVol->depth; s++) {
+      std::vector<float> outrow(OutVol->width);
+      for (int r=0; r < OutVol->height; r++) {
+        MRIgetRowVals(OutVol,r,s,0,&outrow[0]);
+        for (int c=0; c < OutVol->width; c++) {
+	  double val = outrow[c];
 	  if(fabs(val-BinVal) < .00001) nhits ++;
-	} // slice
+	} // col
       } // row
-    } // col
+    } // slice
     if(noverbose == 0)  printf("Found %d voxels in final mask\n",nhits);
   }
 
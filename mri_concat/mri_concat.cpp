@@ -33,6 +33,7 @@
 #include <ctype.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <vector>
 #include "macros.h"
 #include "mrisurf.h"
 #include "mrisutils.h"
@@ -40,6 +41,7 @@
 #include "diag.h"
 #include "mri.h"
 #include "mri2.h"
+#include "mri_iterate.h"
 #include "fio.h"
 #include "fmriutils.h"
 #include "cma.h"
@@ -352,14 +354,16 @@ int main(int argc, char **argv)
       }
       MRIneg(mritmp,mritmp);
     }
+    std::vector<double> row(nc);
     for(f=0; f < mritmp->nframes; f++) {
-      for(c=0; c < nc; c++)      {
+      for(s=0; s < ns; s++)      {
         for(r=0; r < nr; r++)        {
-          for(s=0; s < ns; s++)          {
-            v = MRIgetVoxVal(mritmp,c,r,s,f);
-	    if(FrameWeight != NULL) v *= FrameWeight->rptr[fout+1][1];
-            MRIsetVoxVal(mriout,c,r,s,fout,v);
+          MRIgetRowVals(mritmp,r,s,f,&row[0]);
+	  if(FrameWeight != NULL) {
+            double const w = FrameWeight->rptr[fout+1][1];
+            for(c=0; c < nc; c++) row[c] *= w;
           }
+          MRIsetRowVals(mriout,r,s,fout,&row[0]);
         }
       }
       fout++;
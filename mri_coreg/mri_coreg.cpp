@@ -133,6 +133,37 @@ int WriteDoubleMatrix(const char *fname, const char *fmt, double **M, int rows,
 int PrintDoubleMatrix(FILE *fp, const char *fmt, double **M, int rows, int cols);
 double *SumVectorDoubleMatrix(double **M, int rows, int cols, int dim, double *sumvect, int *nv);
 
+// Number of partial joint histograms a cost evaluation sums. Fixed so the
+// result does not depend on the number of threads.
+#define COREG_NCHUNKS 32
+
+/*!
+  \brief The reference side of the joint histogram at one separation.
+  The coordinate dither of the reference sample points and the
+  histogram row (rounded reference intensity) of each sample do not
+  depend on the transform, so they are packed once per separation in
+  the order COREGhistChunk() visits the samples.
+ */
+typedef struct {
+  int sep;
+  int nc, nr, ns;       // number of samples along col, row, slice
+  float *cdither;       // sep*dither, 3 per sample, NULL if not dithering
+  unsigned char *ivg;   // histogram row of each sample
+} COREG_REFSAMP;
+
+/*!
+  \brief Everything one cost evaluation writes, allocated on first use
+  and then reused, so that evaluations do not allocate and several can
+  run at once, each with its own.
+ */
+typedef struct {
+  MATRIX *M,*V2V;
+  double *HH;           // COREG_NCHUNKS partial histograms, 256*256 each
+  double **H0, **H1, **H;
+  int H1rows,H1cols,Hrows,Hcols;
+  long nhits;
+} COREG_EVAL;
+
 typedef struct {
   MRI *ref, *mov, *refmask, *movmask;
   int seplist[10],nsep,sep,sepmin;
@@ -145,8 +176,11 @@ typedef struct {
   double params[12]; // params to be optimized, may be < 12
   int nparams; // number of params to be optimized, may be < 12
   double mparams[12]; // params to create the matrix, always=12
-  double H01d[256*256];
-  double **H0;
+  COREG_REFSAMP refsamp;
+  COREG_EVAL *evals; // one per thread
+  int nevals;
+  double *g1, *g2; // histogram smoothing kernels
+  int ng1, ng2;
   double cost;
   int nCostEvaluations;
   double tLastEval;
@@ -177,7 +211,12 @@ float MRIgetPercentile(MRI *mri, double Pct, int frame);
 int COREGfwhm(MRI *mri, double sep, double fwhm[3]);
 int COREGpreproc(COREG *coreg);
 LTA *LTAcreate(MRI *src, MRI *dst, MATRIX *T, int type);
-int COREGhist(COREG *coreg);
+int COREGrefSamples(COREG *coreg);
+int COREGcostSetup(COREG *coreg);
+long COREGhistChunk(COREG *coreg, const double *V2V, int chunk, double *H);
+long COREGhist(COREG *coreg, COREG_EVAL *ev, int parallel);
+double COREGcostEval(COREG *coreg, const double *params, COREG_EVAL *ev, int parallel);
+int COREGlogCost(COREG *coreg, const double *params, double cost);
 long COREGvolIndex(int ncols, int nrows, int nslices, int c, int r, int s);
 double COREGsamp(unsigned char *f, const double c, const double r, const double s, 
 		  const int ncols, const int nrows, const int nslices);
@@ -186,6 +225,7 @@ int COREGprint(FILE *fp, COREG *coreg);
 MRI *MRIconformNoScale(MRI *mri, MRI *mric);
 int COREGoptBruteForce(COREG *coreg, double lim0, int niters, int n1d);
 double *COREGoptSchema2MatrixPar(COREG *coreg, double *par);
+double *COREGoptPar2MatrixPar(COREG *coreg, const double *params, double *par);
 int COREGmatrixPar2OptSchema(COREG *coreg, double *par);
 
 COREG *coreg;
@@ -1203,148 +1243,206 @@ double COREGsamp(unsigned char *f, const double c, const double r, const double
 
 
 /*!
-  \fn int COREGhist(COREG *coreg)
-  \brief Compute joint histogram. Somewhat based on spm_hist2.c
+  \fn int COREGrefSamples(COREG *coreg)
+  \brief Pack the reference side of the joint histogram for coreg->sep
+  (see COREG_REFSAMP). Does nothing if it is already packed for this
+  separation, so each separation of the schedule is packed once.
  */
-int COREGhist(COREG *coreg)
+int COREGrefSamples(COREG *coreg)
 {
-  int const nchunks = 32;
+  COREG_REFSAMP *rs = &coreg->refsamp;
+  int const sep = coreg->sep;
+
+  if(rs->ivg && rs->sep == sep) return(0);
+
+  free(rs->cdither); rs->cdither = NULL;
+  free(rs->ivg);
+  rs->sep = sep;
+  rs->nc = (coreg->ref->width  + sep - 1) / sep;
+  rs->nr = (coreg->ref->height + sep - 1) / sep;
+  rs->ns = (coreg->ref->depth  + sep - 1) / sep;
+  long const nsamples = (long)rs->nc*rs->nr*rs->ns;
+  if(coreg->DoCoordDither) rs->cdither = (float *) malloc(3*nsamples*sizeof(float));
+  rs->ivg = (unsigned char *) malloc(nsamples*sizeof(unsigned char));
+
+  int ic;
+  ROMP_PF_begin
+  #ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+  #endif
+  for(ic=0; ic < rs->nc; ic++){
+    ROMP_PFLB_begin
+    int const cref = ic*sep;
+    int ir;
+    for(ir=0; ir < rs->nr; ir++){
+      int const rref = ir*sep;
+      int is;
+      for(is=0; is < rs->ns; is++){
+        int const sref = is*sep;
+        long const n = ((long)ic*rs->nr + ir)*rs->ns + is;
+        double dcref = cref, drref = rref, dsref = sref;
+
+        if(coreg->DoCoordDither){
+          // dither is uniform(0,1), scale by separation to sample entire vol
+          float * const d = &rs->cdither[3*n];
+          d[0] = sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,0);
+          d[1] = sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,1);
+          d[2] = sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,2);
+          dcref += d[0];
+          drref += d[1];
+          dsref += d[2];
+          if(dcref > coreg->ref->width-1)  dcref = coreg->ref->width-1;
+          if(drref > coreg->ref->height-1) drref = coreg->ref->height-1;
+          if(dsref > coreg->ref->depth-1)  dsref = coreg->ref->depth-1;
+        }
+
+        double vg = COREGsamp(coreg->g, dcref, drref, dsref, coreg->ref->width,coreg->ref->height,coreg->ref->depth);
+        rs->ivg[n] = floor(vg+0.5);
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
 
+  return(0);
+}
+
+/*!
+  \fn long COREGhistChunk(COREG *coreg, const double *V2V, int chunk, double *H)
+  \brief Add the samples of one chunk of reference columns to the 256*256
+  histogram H, which must be zeroed. V2V is the packed (column major)
+  vox2vox matrix. Returns the number of samples that hit the mov.
+ */
+long COREGhistChunk(COREG *coreg, const double *V2V, int chunk, double *H)
+{
+  COREG_REFSAMP const *rs = &coreg->refsamp;
+  int const sep = coreg->sep;
+  int const chunkSize = (rs->nc + COREG_NCHUNKS - 1) / COREG_NCHUNKS;
+  int const icBegin = chunk*chunkSize;
+  int const icEnd   = MIN((chunk+1)*chunkSize, rs->nc);
+  int const zonly = (coreg->optschema == 2 || coreg->optschema == 4 || coreg->optschema == 5);
+  long nhits = 0;
+
+  int ic;
+  for(ic=icBegin; ic < icEnd; ic++){
+    int ir;
+    for(ir=0; ir < rs->nr; ir++){
+      long n = ((long)ic*rs->nr + ir)*rs->ns;
+      int is;
+      for(is=0; is < rs->ns; is++, n++){
+
+        double dcref = ic*sep, drref = ir*sep, dsref = is*sep;
+
+        if(rs->cdither){
+          float const * const d = &rs->cdither[3*n];
+          dcref += d[0];
+          drref += d[1];
+          dsref += d[2];
+          if(dcref > coreg->ref->width-1)  dcref = coreg->ref->width-1;
+          if(drref > coreg->ref->height-1) drref = coreg->ref->height-1;
+          if(dsref > coreg->ref->depth-1)  dsref = coreg->ref->depth-1;
+        }
+
+        double dcmov  = V2V[0]*dcref + V2V[4]*drref + V2V[ 8]*dsref +  V2V[12];
+        double drmov  = V2V[1]*dcref + V2V[5]*drref + V2V[ 9]*dsref +  V2V[13];
+
+        int oob = 0;
+        if(dcmov < 0 || dcmov > coreg->mov->width-1)  oob = 1;
+        if(drmov < 0 || drmov > coreg->mov->height-1) oob = 1;
+
+        double dsmov = 0;
+        if(!zonly){
+          dsmov  = V2V[2]*dcref + V2V[6]*drref + V2V[10]*dsref +  V2V[14];
+          if(dsmov < 0 || dsmov > coreg->mov->depth-1)  oob = 1;
+        }
+
+        double vf;
+        if(!oob) {
+          vf = COREGsamp(coreg->f, dcmov, drmov, dsmov, coreg->mov->width,coreg->mov->height,coreg->mov->depth);
+          nhits ++;
+        } else {
+          if(coreg->MovOOBFlag) vf = 0;
+          else continue;
+        }
+
+        int const ivf = floor(vf);
+        int const ivg = rs->ivg[n];
+        H[ivf+ivg*256] += (1-(vf-ivf));
+        if(ivf<255) H[ivf+1+ivg*256] += (vf-ivf);
+      }
+    }
+  }
+  return(nhits);
+}
+
+/*!
+  \fn long COREGhist(COREG *coreg, COREG_EVAL *ev, int parallel)
+  \brief Compute the joint histogram for ev->V2V into ev->H0. Somewhat
+  based on spm_hist2.c. The chunks are summed in a fixed order, so the
+  result is the same however many threads run them; parallel=0 runs
+  them in this thread (for evaluations that already run concurrently).
+ */
+long COREGhist(COREG *coreg, COREG_EVAL *ev, int parallel)
+{
   // Pack vox2voxl matrix into an array for speed
   //
   double V2V[16];
 
-  V2V[0] = coreg->V2V->rptr[1][1];
-  V2V[1] = coreg->V2V->rptr[2][1];
-  V2V[2] = coreg->V2V->rptr[3][1];
+  V2V[0] = ev->V2V->rptr[1][1];
+  V2V[1] = ev->V2V->rptr[2][1];
+  V2V[2] = ev->V2V->rptr[3][1];
   V2V[3] = 0;
-  V2V[4] = coreg->V2V->rptr[1][2];
-  V2V[5] = coreg->V2V->rptr[2][2];
-  V2V[6] = coreg->V2V->rptr[3][2];
+  V2V[4] = ev->V2V->rptr[1][2];
+  V2V[5] = ev->V2V->rptr[2][2];
+  V2V[6] = ev->V2V->rptr[3][2];
   V2V[7] = 0;
-  V2V[8]  = coreg->V2V->rptr[1][3];
-  V2V[9]  = coreg->V2V->rptr[2][3];
-  V2V[10] = coreg->V2V->rptr[3][3];
+  V2V[8]  = ev->V2V->rptr[1][3];
+  V2V[9]  = ev->V2V->rptr[2][3];
+  V2V[10] = ev->V2V->rptr[3][3];
   V2V[11] = 0;
-  V2V[12] = coreg->V2V->rptr[1][4];
-  V2V[13] = coreg->V2V->rptr[2][4];
-  V2V[14] = coreg->V2V->rptr[3][4];
+  V2V[12] = ev->V2V->rptr[1][4];
+  V2V[13] = ev->V2V->rptr[2][4];
+  V2V[14] = ev->V2V->rptr[3][4];
   V2V[15] = 0;
 
-  double **HH  = (double **)calloc(sizeof(double*),nchunks);
-  { int n;
-    for(n=0; n < nchunks; n++) 
-      HH[n] = (double *)calloc(sizeof(double),256*256);
-  }
-  
-  long nhits = 0;
+  if(!ev->HH) ev->HH = (double *) malloc(COREG_NCHUNKS*256*256*sizeof(double));
+  if(!ev->H0) ev->H0 = AllocDoubleMatrix(256,256);
 
-  // Calculate the number of iterations the original loop did
-  // Do in chunks in parallel to get deterministic results independent of the number of threads used
-  //
-  int const niters    = (coreg->ref->width + coreg->sep - 1) / coreg->sep;
-  int const chunkSize = (niters            + nchunks    - 1) / nchunks;
-  
+  long nhits = 0;
   int chunk;
-  ROMP_PF_begin
-  #ifdef HAVE_OPENMP
-  #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+:nhits)
-  #endif
-  for (chunk = 0; chunk < nchunks; chunk++) {
-    ROMP_PFLB_begin
-    
-    int const crefBegin = (chunk+0)*chunkSize*coreg->sep;
-    int       crefEnd   = (chunk+1)*chunkSize*coreg->sep;
-    if (crefEnd > coreg->ref->width) crefEnd = coreg->ref->width;
-    
-    int cref;
-    for(cref=crefBegin; cref < crefEnd; cref += coreg->sep){
-  
-      double * const H = HH[chunk];
-
-      int rref,sref;
-      for(rref=0; rref < coreg->ref->height; rref += coreg->sep){
-	for(sref=0; sref < coreg->ref->depth; sref += coreg->sep){
-
-          double dcref = cref, drref = rref, dsref = sref;
-
-	  if(coreg->DoCoordDither){
-	    // dither is uniform(0,1), scale by separation to sample entire vol
-	    dcref += coreg->sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,0);
-	    drref += coreg->sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,1);
-	    dsref += coreg->sep*MRIgetVoxVal(coreg->cdither,cref,rref,sref,2);
-	    if(dcref > coreg->ref->width-1)  dcref = coreg->ref->width-1;
-	    if(drref > coreg->ref->height-1) drref = coreg->ref->height-1;
-	    if(dsref > coreg->ref->depth-1)  dsref = coreg->ref->depth-1;
-	  }
-
-	  double dcmov  = V2V[0]*dcref + V2V[4]*drref + V2V[ 8]*dsref +  V2V[12];
-	  double drmov  = V2V[1]*dcref + V2V[5]*drref + V2V[ 9]*dsref +  V2V[13];
-
-	  int oob = 0;
-	  if(dcmov < 0 || dcmov > coreg->mov->width-1)  oob = 1;
-	  if(drmov < 0 || drmov > coreg->mov->height-1) oob = 1;
-
-          double dsmov = 0;
-	  if(coreg->optschema != 2 && coreg->optschema != 4 && coreg->optschema != 5){
-            // not z-only
-	    dsmov  = V2V[2]*dcref + V2V[6]*drref + V2V[10]*dsref +  V2V[14];
-	    if(dsmov < 0 || dsmov > coreg->mov->depth-1)  oob = 1;
-	  }
-
-          double vf;
-	  if(!oob) {
-	    vf = COREGsamp(coreg->f, dcmov, drmov, dsmov, coreg->mov->width,coreg->mov->height,coreg->mov->depth);
-	    nhits ++;
-	  } else {
-	    if(coreg->MovOOBFlag) vf = 0;
-	    else continue;
-	  }
-
-
-	  double vg = COREGsamp(coreg->g, dcref, drref, dsref, coreg->ref->width,coreg->ref->height,coreg->ref->depth);
-
-	  int const ivf = floor(vf);
-	  int const ivg = floor(vg+0.5);
-	  H[ivf+ivg*256] += (1-(vf-ivf));
-	  if(ivf<255) H[ivf+1+ivg*256] += (vf-ivf);
-	}
-      }
+  if(parallel){
+    ROMP_PF_begin
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) reduction(+:nhits)
+    #endif
+    for (chunk = 0; chunk < COREG_NCHUNKS; chunk++) {
+      ROMP_PFLB_begin
+      double * const H = &ev->HH[(long)chunk*256*256];
+      memset(H, 0, 256*256*sizeof(double));
+      nhits += COREGhistChunk(coreg, V2V, chunk, H);
+      ROMP_PFLB_end
     }
-    ROMP_PFLB_end
+    ROMP_PF_end
   }
-  ROMP_PF_end
-
-  // Collect the chunks
-  { int k;
-    for(k=0; k < 256*256; k++){
-      coreg->H01d[k] = 0;
-      int n;
-      for(n=0; n < nchunks; n++) coreg->H01d[k] += HH[n][k];
+  else {
+    for (chunk = 0; chunk < COREG_NCHUNKS; chunk++) {
+      double * const H = &ev->HH[(long)chunk*256*256];
+      memset(H, 0, 256*256*sizeof(double));
+      nhits += COREGhistChunk(coreg, V2V, chunk, H);
     }
   }
-  
-  { int n;
-    for(n=0; n < nchunks; n++) free(HH[n]);
-    free(HH); HH=NULL;
-  }
-  
-  // Repackage Histogram into a 2D array
-  if(!coreg->H0) coreg->H0 = AllocDoubleMatrix(256,256);
-  
-  int n = 0;
-  int c;
-  for(c=0; c < 256; c++){
-    int r;
-    for(r=0; r < 256; r++){
-      coreg->H0[r][c] = coreg->H01d[n];
-      n++;
-    }
+
+  // Collect the chunks into a 2D array, H0[ivf][ivg]
+  int k;
+  for(k=0; k < 256*256; k++){
+    double sum = 0;
+    int n;
+    for(n=0; n < COREG_NCHUNKS; n++) sum += ev->HH[(long)n*256*256 + k];
+    ev->H0[k%256][k/256] = sum;
   }
 
   // This is good for computing whether and how much the mov and ref overlap
-  coreg->nhits   = nhits;
-  coreg->pcthits = pow(coreg->sep,3)*(double) 100.0*nhits/coreg->nvoxref;
+  ev->nhits = nhits;
 
   return(nhits);
 }
@@ -1661,41 +1759,50 @@ double NMICost(double **H, int cols, int rows)
  */
 double *COREGoptSchema2MatrixPar(COREG *coreg, double *par)
 {
-  int n;
-
   if(par == NULL) par = (double *) calloc(12,sizeof(double));
+  return(COREGoptPar2MatrixPar(coreg, coreg->params, par));
+}
+
+/*!
+  \fn double *COREGoptPar2MatrixPar(COREG *coreg, const double *params, double *par)
+  \brief As COREGoptSchema2MatrixPar() for the optimized parameters params
+  instead of coreg->params. par must be allocated.
+ */
+double *COREGoptPar2MatrixPar(COREG *coreg, const double *params, double *par)
+{
+  int n;
 
   switch(coreg->optschema){
   case 1: 
     // schema 1 is that the number of params = dof and that
     // the order is given by xyz shift, xyz rot, xyz scale, then shear
-    for(n=0; n<coreg->nparams;n++) par[n] = coreg->params[n];
+    for(n=0; n<coreg->nparams;n++) par[n] = params[n];
     break;
   case 2: 
     // schema 2 is for a 2D image (3dof: x and z trans with rot about y)
-    par[0] = coreg->params[0]; // x trans
-    par[2] = coreg->params[1]; // z trans
-    par[4] = coreg->params[2]; // rotation about y
+    par[0] = params[0]; // x trans
+    par[2] = params[1]; // z trans
+    par[4] = params[2]; // rotation about y
     break;
   case 3: 
     // schema 3 is 7 dof (xyz shift, xyz rot, and z scale)
-    for(n=0; n < 6; n++) par[n] = coreg->params[n];
-    par[8] = coreg->params[6];
+    for(n=0; n < 6; n++) par[n] = params[n];
+    par[8] = params[6];
     break;
   case 4: 
     // schema 4 is for a 2D image (3dof: x and y trans with rot about z)
-    par[0] = coreg->params[0]; // x trans
-    par[1] = coreg->params[1]; // y trans
-    par[5] = coreg->params[2]; // rotation about z
+    par[0] = params[0]; // x trans
+    par[1] = params[1]; // y trans
+    par[5] = params[2]; // rotation about z
     break;
   case 5: 
     // schema 5 is for a 2D image (6dof: x and y trans/scale + xyschear with rot about z)
-    par[0] = coreg->params[0]; // x trans
-    par[1] = coreg->params[1]; // y trans
-    par[5] = coreg->params[2]; // z rot 
-    par[6] = coreg->params[3]; // x scale
-    par[7] = coreg->params[4]; // y scale
-    par[9]  = coreg->params[5]; // xy shear
+    par[0] = params[0]; // x trans
+    par[1] = params[1]; // y trans
+    par[5] = params[2]; // z rot 
+    par[6] = params[3]; // x scale
+    par[7] = params[4]; // y scale
+    par[9]  = params[5]; // xy shear
     break;
   }
   return(par);
@@ -1746,12 +1853,69 @@ int COREGmatrixPar2OptSchema(COREG *coreg, double *par)
   return(0);
 }
 
-double COREGcost(COREG *coreg)
+/*!
+  \fn int COREGcostSetup(COREG *coreg)
+  \brief Prepare what the cost evaluations share and only read: the
+  reference samples for coreg->sep, the histogram smoothing kernels and
+  one evaluation workspace per thread. Call outside of parallel regions
+  before evaluating the cost; cheap when nothing has changed.
+ */
+int COREGcostSetup(COREG *coreg)
 {
-  double **H1,**H;
-  double *g1, *g2, sum, std1, std2;
-  int r,c,n,lim1,lim2,ng1,ng2;
-  int H1rows,H1cols,Hrows,Hcols;
+  int n;
+  double sum, std;
+
+  COREGrefSamples(coreg);
+
+  if(coreg->evals == NULL){
+#ifdef HAVE_OPENMP
+    coreg->nevals = omp_get_max_threads();
+#else
+    coreg->nevals = 1;
+#endif
+    coreg->evals = (COREG_EVAL *) calloc(coreg->nevals,sizeof(COREG_EVAL));
+  }
+
+  if(coreg->g1 == NULL){
+    // filter for the column vectors
+    std = coreg->histfwhm[0]/sqrt(log(256.0));
+    int const lim1 = ceil(2*coreg->histfwhm[0]);
+    coreg->ng1 = 2*lim1+1;
+    coreg->g1 = (double *) calloc(coreg->ng1,sizeof(double));
+    sum = 0;
+    for(n=-lim1; n <= lim1; n++){
+      coreg->g1[n+lim1] = exp(-(n*n)/(2*(std*std)))/(std*sqrt(2*M_PI));
+      sum += coreg->g1[n+lim1];
+    }
+    for(n=0; n < coreg->ng1; n++) coreg->g1[n] /= sum;
+
+    // filter for the row vectors
+    std = coreg->histfwhm[1]/sqrt(log(256.0));
+    int const lim2 = ceil(2*coreg->histfwhm[1]);
+    coreg->ng2 = 2*lim2+1;
+    coreg->g2 = (double *) calloc(coreg->ng2,sizeof(double));
+    sum = 0;
+    for(n=-lim2; n <= lim2; n++){
+      coreg->g2[n+lim2] = exp(-(n*n)/(2*(std*std)))/(std*sqrt(2*M_PI));
+      sum += coreg->g2[n+lim2];
+    }
+    for(n=0; n < coreg->ng2; n++) coreg->g2[n] /= sum;
+  }
+
+  return(0);
+}
+
+/*!
+  \fn double COREGcostEval(COREG *coreg, const double *params, COREG_EVAL *ev, int parallel)
+  \brief Compute the cost of the optimization parameters params (as in
+  coreg->params) using the workspace ev. Only reads coreg, so several
+  evaluations can run at once with different workspaces (parallel=0).
+  COREGcostSetup() must have been called.
+ */
+double COREGcostEval(COREG *coreg, const double *params, COREG_EVAL *ev, int parallel)
+{
+  double mparams[12], sum;
+  int r,c;
 
   /* Copy the params being optimized into the matrix param vector
   (mparams). This will be used below to create the matarix.  mparams
@@ -1759,72 +1923,67 @@ double COREGcost(COREG *coreg)
   eg, if a non-rigid matrix is passed as input but you are only
   optimizing the rigid components, the non-rigid components will still
   be part of the matrix.  */
-  COREGoptSchema2MatrixPar(coreg, coreg->mparams);
+  memcpy(mparams, coreg->mparams, sizeof(mparams));
+  COREGoptPar2MatrixPar(coreg, params, mparams);
 
   // RefRAS-to-MovRAS
-  coreg->M = TranformAffineParams2Matrix(coreg->mparams, coreg->M);
+  ev->M = TranformAffineParams2Matrix(mparams, ev->M);
 
   // AnatVox-to-FuncVox
-  coreg->V2V = MRIgetVoxelToVoxelXformBase(coreg->ref,coreg->mov,coreg->M,coreg->V2V,0);
+  ev->V2V = MRIgetVoxelToVoxelXformBase(coreg->ref,coreg->mov,ev->M,ev->V2V,0);
 
   // Compute joint histogram
-  COREGhist(coreg);
-
-  //printf("M  %20.18f %20.18f %20.18f \n",coreg->M->rptr[1][1],coreg->V2V->rptr[1][1],coreg->H0[0][0]);
-
-  // filter for the column vectors
-  std1 = coreg->histfwhm[0]/sqrt(log(256.0));
-  lim1 = ceil(2*coreg->histfwhm[0]);
-  ng1 = 2*lim1+1;
-  g1 = (double *) calloc(ng1,sizeof(double));
-  sum = 0;
-  for(n=-lim1; n <= lim1; n++){
-    g1[n+lim1] = exp(-(n*n)/(2*(std1*std1)))/(std1*sqrt(2*M_PI));
-    sum += g1[n+lim1]; 
-  }
-  for(n=0; n < ng1; n++) {
-    g1[n] /= sum;
-    //printf("%3d  %lf\n",n,g1[n]);
-  }
-
-  // filter for the row vectors
-  std2 = coreg->histfwhm[1]/sqrt(log(256.0));
-  lim2 = ceil(2*coreg->histfwhm[1]);
-  ng2 = 2*lim2+1;
-  g2 = (double *) calloc(2*lim2+1,sizeof(double));
-  sum = 0;
-  for(n=-lim2; n <= lim2; n++){
-    g2[n+lim2] = exp(-(n*n)/(2*(std2*std2)))/(std2*sqrt(2*M_PI));
-    sum += g2[n+lim2]; 
-  }
-  for(n=0; n < ng2; n++) g2[n] /= sum;
+  COREGhist(coreg, ev, parallel);
 
   // Apply filters
-  H1 = conv1dmat(coreg->H0, 256, 256, g2, ng2, 2, NULL,&H1rows,&H1cols);
-  H  = conv1dmat(H1, H1rows, H1cols, g1, ng1, 1, NULL,&Hrows,&Hcols);
+  ev->H1 = conv1dmat(ev->H0, 256, 256, coreg->g2, coreg->ng2, 2, ev->H1,&ev->H1rows,&ev->H1cols);
+  ev->H  = conv1dmat(ev->H1, ev->H1rows, ev->H1cols, coreg->g1, coreg->ng1, 1, ev->H,&ev->Hrows,&ev->Hcols);
+  double ** const H = ev->H;
 
-  for(c=0; c < Hcols; c++) for(r=0; r < Hrows; r++) H[r][c] += FLT_EPSILON;
+  for(c=0; c < ev->Hcols; c++) for(r=0; r < ev->Hrows; r++) H[r][c] += FLT_EPSILON;
 
   sum = 0;
-  for(c=0; c < Hcols; c++) for(r=0; r < Hrows; r++) sum += H[r][c];
-  for(c=0; c < Hcols; c++) for(r=0; r < Hrows; r++) H[r][c] /= sum;
-
-  coreg->cost = NMICost(H, Hcols, Hrows);
+  for(c=0; c < ev->Hcols; c++) for(r=0; r < ev->Hrows; r++) sum += H[r][c];
+  for(c=0; c < ev->Hcols; c++) for(r=0; r < ev->Hrows; r++) H[r][c] /= sum;
 
-  FreeDoubleMatrix(H1,H1rows,H1cols); H1=NULL;
-  FreeDoubleMatrix(H,Hrows,Hcols);    H=NULL;
-  free(g1); g1=NULL;
-  free(g2); g2=NULL;
+  return(NMICost(H, ev->Hcols, ev->Hrows));
+}
 
+/*!
+  \fn int COREGlogCost(COREG *coreg, const double *params, double cost)
+  \brief Count a cost evaluation and write it to the cost log, if any
+ */
+int COREGlogCost(COREG *coreg, const double *params, double cost)
+{
+  int n;
   if(coreg->fplogcost){
     FILE *fp;
     fp = coreg->fplogcost;
     fprintf(fp,"%2d %4d  ",coreg->sep,coreg->nCostEvaluations);
-    for(n=0; n<coreg->nparams; n++) fprintf(fp,"%7.5f ",coreg->params[n]);
-    fprintf(fp,"  %9.7f\n",coreg->cost);
+    for(n=0; n<coreg->nparams; n++) fprintf(fp,"%7.5f ",params[n]);
+    fprintf(fp,"  %9.7f\n",cost);
     fflush(fp);
   }
   coreg->nCostEvaluations++;
+  return(0);
+}
+
+double COREGcost(COREG *coreg)
+{
+  COREG_EVAL *ev;
+
+  COREGcostSetup(coreg);
+  ev = &coreg->evals[0];
+
+  COREGoptSchema2MatrixPar(coreg, coreg->mparams);
+  coreg->cost = COREGcostEval(coreg, coreg->params, ev, 1);
+
+  coreg->M   = MatrixCopy(ev->M, coreg->M);
+  coreg->V2V = MatrixCopy(ev->V2V, coreg->V2V);
+  coreg->nhits   = ev->nhits;
+  coreg->pcthits = pow(coreg->sep,3)*(double) 100.0*ev->nhits/coreg->nvoxref;
+
+  COREGlogCost(coreg, coreg->params, coreg->cost);
 
   return(coreg->cost);
 }
@@ -2088,9 +2247,14 @@ int COREGoptBruteForce(COREG *coreg, double lim0, int niters, int n1d)
   double lim;
   FILE *fp;
   int dof,BakMovOOBFlag;
+  int k,np;
+  double *plist, *costlist;
 
   printf("COREGoptBruteForce() %g %d %d\n",lim0,niters,n1d);
 
+  plist    = (double *) calloc(n1d+2,sizeof(double));
+  costlist = (double *) calloc(n1d+2,sizeof(double));
+
   dof = 6;
   if(coreg->nparams < 6) dof = coreg->nparams;
 
@@ -2109,11 +2273,36 @@ int COREGoptBruteForce(COREG *coreg, double lim0, int niters, int n1d)
       pdelta = (pmax-pmin)/n1d;
       popt = coreg->params[nthp];
       if(coreg->debug) printf("iter=%d n1d=%d pno=%d nom=%g min=%g max=%g delta=%g\n",iter,n1d,nthp,popt,pmin,pmax,pdelta);
+      // The points of a 1D search are independent, so evaluate them
+      // all at once, one per thread, then go through them in order
+      np = 0;
+      for(p=pmin; p<=pmax && np < n1d+2; p+=pdelta) plist[np++] = p;
+      COREGcostSetup(coreg);
+      ROMP_PF_begin
+      #ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
+      #endif
+      for(k=0; k < np; k++){
+        ROMP_PFLB_begin
+        int tid = 0;
+        #ifdef HAVE_OPENMP
+        tid = omp_get_thread_num();
+        #endif
+        double par[12];
+        memcpy(par, coreg->params, sizeof(par));
+        par[nthp] = plist[k];
+        costlist[k] = COREGcostEval(coreg, par, &coreg->evals[tid], 0);
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
+
       nth1d = 0;
       newmin = 0;
-      for(p=pmin; p<=pmax; p+=pdelta){
+      for(k=0; k < np; k++){
+	p = plist[k];
 	coreg->params[nthp] = p;
-	curcost = COREGcost(coreg);
+	curcost = costlist[k];
+	COREGlogCost(coreg, coreg->params, curcost);
 	if(mincost > curcost){
 	  mincost = curcost;
 	  popt = p;
@@ -2143,6 +2332,8 @@ int COREGoptBruteForce(COREG *coreg, double lim0, int niters, int n1d)
   if(BakMovOOBFlag == 0) printf("Turning  MovOOB back off after brute force search\n");
   coreg->MovOOBFlag = BakMovOOBFlag;
 
+  free(plist);
+  free(costlist);
   return(0);
 }
 
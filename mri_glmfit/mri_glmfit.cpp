@@ -552,9 +552,12 @@ double round(double x);
 #include "image.h"
 #include "stats.h"
 #include "evschutils.h"
+#include "romp_support.h"
 
 int MRISmaskByLabel(MRI *y, MRIS *surf, LABEL *lb, int invflag);
 int RandPermMatrixAndPVR(MATRIX *X, MRI **pvrs, int npvrs);
+int SimPermuteDesign(MRIGLM *mriglm);
+MRIGLM *SimAllocWorker(MRIGLM *mriglm);
 
 static int  parse_commandline(int argc, char **argv);
 static void check_options(void);
@@ -659,6 +662,8 @@ int nClusters;
 char *subject=NULL, *hemi=NULL, *simbase=NULL;
 MRI_SURFACE *surf=NULL;
 int nsim,nthsim;
+int SimNWorkers = 1;
+MRIGLM **simglm = NULL;
 double csize;
 MRI *fwhmmap = NULL;
 
@@ -1776,6 +1781,21 @@ int main(int argc, char **argv) {
       }
     }
 
+    // Permutations of a design that is the same at all voxels can be fit
+    // several at a time, one per thread, each with its own glm that only
+    // computes what the CSD needs. The permutations are still drawn
+    // serially in simulation order, and the CSDs are still updated in
+    // order, so the output does not depend on the number of threads.
+    SimNWorkers = 1;
+    if(!strcmp(csd->simtype,"perm") && VarFWHM <= 0 && !PermNonStatCor &&
+       MRIglmBatchable(mriglm) && omp_get_max_threads() > 1){
+      SimNWorkers = omp_get_max_threads();
+      if(SimNWorkers > nsim) SimNWorkers = nsim;
+      printf("Running %d permutations at a time\n",SimNWorkers);
+      simglm = (MRIGLM **) calloc(sizeof(MRIGLM *),SimNWorkers);
+      for(n=0; n < SimNWorkers; n++) simglm[n] = SimAllocWorker(mriglm);
+    }
+
     printf("\n\nStarting simulation sim over %d trials\n",nsim);
     mytimer.reset() ;
     for (nthsim=0; nthsim < nsim; nthsim++) {
@@ -1783,6 +1803,30 @@ int main(int argc, char **argv) {
       if(debug) printf("%d/%d t=%g ---------------------------------\n",
              nthsim+1,nsim,msecFitTime/(1000*60.0));
 
+      // sglm holds the stats for this iteration
+      MRIGLM *sglm = mriglm;
+      if(SimNWorkers > 1){
+	int nthworker = nthsim % SimNWorkers;
+	if(nthworker == 0){
+	  int nthbatch, nbatch = MIN(SimNWorkers, nsim-nthsim);
+	  for(nthbatch=0; nthbatch < nbatch; nthbatch++){
+	    SimPermuteDesign(mriglm);
+	    MatrixCopy(mriglm->Xg,simglm[nthbatch]->Xg);
+	  }
+	  ROMP_PF_begin
+	  #ifdef HAVE_OPENMP
+	  #pragma omp parallel for if_ROMP(shown_reproducible)
+	  #endif
+	  for(nthbatch=0; nthbatch < nbatch; nthbatch++){
+	    ROMP_PFLB_begin
+	    MRIglmFitAndTest(simglm[nthbatch]);
+	    ROMP_PFLB_end
+	  }
+	  ROMP_PF_end
+	}
+	sglm = simglm[nthworker];
+      }
+
       if (!strcmp(csd->simtype,"mc-full")) {
 	if(! UseUniform)
 	  MRIrandn(mriglm->y->width,mriglm->y->height,mriglm->y->depth,
@@ -1794,20 +1838,10 @@ int main(int argc, char **argv) {
         if(FWHM > 0)
           SmoothSurfOrVol(surf, mriglm->y, mriglm->mask, SmoothLevel);
       }
-      if (!strcmp(csd->simtype,"perm")) {
-        if (!OneSamplePerm) RandPermMatrixAndPVR(mriglm->Xg,mriglm->pvr,mriglm->npvr);
-        else {
-          for (n=0; n < mriglm->y->nframes; n++) {
-            if (drand48() > 0.5) m = +1;
-            else                 m = -1;
-            mriglm->Xg->rptr[n+1][1] = m;
-          }
-          //MatrixPrint(stdout,mriglm->Xg);
-        }
-      }
+      if (!strcmp(csd->simtype,"perm") && SimNWorkers == 1) SimPermuteDesign(mriglm);
 
       // Variance smoothing
-      if (!strcmp(csd->simtype,"mc-full") || !strcmp(csd->simtype,"perm")) {
+      if (SimNWorkers == 1 && (!strcmp(csd->simtype,"mc-full") || !strcmp(csd->simtype,"perm"))) {
         // If variance smoothing, then need to test and fit separately
         if (VarFWHM > 0) {
           if(!DoSim) printf("Starting fit\n");
@@ -1829,11 +1863,11 @@ int main(int argc, char **argv) {
 	    // MRISsmoothMRI(surf, fwhmmap, SmthLevel, mriglm->mask, fwhmmap)
 	  }
         }
-	if(simcontrastdir){
-	  for (n=0; n < mriglm->glm->ncontrasts; n++) {
-	    sprintf(tmpstr,"%s/%s.z.%05d.%s",simcontrastdir,mriglm->glm->Cname[n],nthsim,format);
-	    MRIwrite(mriglm->z[n],tmpstr);
-	  }
+      }
+      if(simcontrastdir && (!strcmp(csd->simtype,"mc-full") || !strcmp(csd->simtype,"perm"))){
+	for (n=0; n < mriglm->glm->ncontrasts; n++) {
+	  sprintf(tmpstr,"%s/%s.z.%05d.%s",simcontrastdir,mriglm->glm->Cname[n],nthsim,format);
+	  MRIwrite(sglm->z[n],tmpstr);
 	}
       }
 
@@ -1857,13 +1891,13 @@ int main(int argc, char **argv) {
 	    else threshadj = csd->thresh - log10(2.0); // one-sided test
 
 	    if (!strcmp(csd->simtype,"mc-full") || !strcmp(csd->simtype,"perm")) {
-	      sig = MRIlog10(mriglm->p[n],NULL,sig,1);
+	      sig = MRIlog10(sglm->p[n],NULL,sig,1);
 	      // If test is not ABS then apply the sign
-	      if(csd->threshsign != 0) MRIsetSign(sig,mriglm->gamma[n],0);
+	      if(csd->threshsign != 0) MRIsetSign(sig,sglm->gamma[n],0);
 	      sigmax = MRIframeMax(sig,0,mriglm->mask,csd->threshsign,
 				   &cmax,&rmax,&smax);
 	      // Get Fmax at sig max 
-	      Fmax = MRIgetVoxVal(mriglm->F[n],cmax,rmax,smax,0);
+	      Fmax = MRIgetVoxVal(sglm->F[n],cmax,rmax,smax,0);
 	      if(csd->threshsign != 0) Fmax = Fmax*SIGN(sigmax);
 	    } 
 	    else {
@@ -4382,6 +4416,55 @@ int MRIloganize(MATRIX **X, MRI **Ct, MRI **intCt, const MATRIX *t, const double
   return(0);
 }
 
+/*!
+  \fn int SimPermuteDesign(MRIGLM *mriglm)
+  \brief Draws the design for the next permutation iteration, either
+  by permuting the rows of Xg (and PVRs) or, for a one-sample test,
+  by randomly flipping the sign of each row.
+ */
+int SimPermuteDesign(MRIGLM *mriglm)
+{
+  int n, m;
+  if (!OneSamplePerm) return(RandPermMatrixAndPVR(mriglm->Xg,mriglm->pvr,mriglm->npvr));
+  for (n=0; n < mriglm->y->nframes; n++) {
+    if (drand48() > 0.5) m = +1;
+    else                 m = -1;
+    mriglm->Xg->rptr[n+1][1] = m;
+  }
+  //MatrixPrint(stdout,mriglm->Xg);
+  return(0);
+}
+
+/*!
+  \fn MRIGLM *SimAllocWorker(MRIGLM *mriglm)
+  \brief Allocates an MRIGLM that shares the data, mask, and contrasts
+  of mriglm but has its own design and GLM workspace so that it can be
+  fit concurrently with others. Only the outputs that the simulation
+  needs (gamma, F, p, sig, z) are computed (SimOnly).
+ */
+MRIGLM *SimAllocWorker(MRIGLM *mriglm)
+{
+  int n;
+  MRIGLM *sglm;
+
+  sglm = (MRIGLM *) calloc(sizeof(MRIGLM),1);
+  sglm->glm = GLMalloc();
+  sglm->y = mriglm->y;
+  sglm->mask = mriglm->mask;
+  sglm->Xg = MatrixCopy(mriglm->Xg,NULL);
+  sglm->SimOnly = 1;
+  sglm->glm->ReScaleX = mriglm->glm->ReScaleX;
+  sglm->glm->AllowZeroDOF = mriglm->glm->AllowZeroDOF;
+  sglm->glm->ncontrasts = mriglm->glm->ncontrasts;
+  for (n=0; n < mriglm->glm->ncontrasts; n++) {
+    sglm->glm->C[n] = MatrixCopy(mriglm->glm->C[n],NULL);
+    sglm->glm->Cname[n] = mriglm->glm->Cname[n];
+    sglm->glm->UseGamma0[n] = mriglm->glm->UseGamma0[n];
+    if (mriglm->glm->gamma0[n]) sglm->glm->gamma0[n] = MatrixCopy(mriglm->glm->gamma0[n],NULL);
+  }
+  return(sglm);
+}
+
 /*!
   \fn int RandPermMatrixAndPVR(MATRIX *X, MRI **pvrs, int npvrs)
   \brief Permutes both the design matrix and any PVRs
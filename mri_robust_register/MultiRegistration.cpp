@@ -37,12 +37,17 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <unistd.h>
 #include <vnl/vnl_inverse.h>
 #include <vnl/vnl_matrix.h>
 #include <vnl/vnl_matrix_fixed.h>
 #include <vnl/algo/vnl_svd.h>
 #include <vnl/algo/vnl_determinant.h>
 
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
 #include "error.h"
 #include "macros.h"
 #include "mri.h"
@@ -373,6 +378,7 @@ void MultiRegistration::initRegistration(RegRobust & R)
   R.setCost(Registration::ROB);
   R.setSaturation(sat);
   R.setDoublePrec(doubleprec);
+  R.setStreamIRLS(streamirls);
   //R.setDebug(debug);
 
   if (subsamplesize > 0)
@@ -391,6 +397,72 @@ void MultiRegistration::initRegistration(RegRobust & R)
 //   R.setTarget(P.mri_mean,P.fixvoxel,P.keeptype);
 }
 
+/*!
+ \brief Estimates the memory (Mb) of one registration of a timepoint to the template
+ 
+ Uses the sizes RegistrationStep reports for A and b at the highest resolution
+ (no subsampling) plus the resampled inputs, their pyramids and the step images.
+ */
+double MultiRegistration::estimateRegistrationMem()
+{
+  assert(mri_mean);
+  double n = (double) mri_mean->width * mri_mean->height * mri_mean->depth;
+  int pnum = rigid ? 6 : 12;
+  if (transonly)
+    pnum = 3;
+  if (iscale)
+    pnum++;
+  if (iscaleonly)
+    pnum = 1;
+  double tsize = doubleprec ? sizeof(double) : sizeof(float);
+  double amu = n * (pnum + 1) * tsize;
+  double bmu = n * tsize;
+  double regmu = streamirls ? 32.0 * n + 4 * bmu : 5 * amu + 7 * bmu;
+  double imgmu = (2 * 2 * 8.0 / 7.0 + 6) * n * sizeof(float);
+  return (regmu + imgmu) / (1024.0 * 1024.0);
+}
+
+/*!
+ \brief Number of timepoints that are registered at the same time (threads, limited by memory)
+ \param nin  number of timepoints
+ Without --maxmem the limit is half of the physical memory that is currently free.
+ */
+int MultiRegistration::getConcurrentRegistrations(int nin)
+{
+  int nthreads = 1;
+#ifdef HAVE_OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  if (nthreads > nin)
+    nthreads = nin;
+  if (nthreads < 2)
+    return 1;
+
+  double mem = maxmem;
+  if (mem <= 0)
+  {
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || pagesize <= 0)
+      return 1;
+    mem = 0.5 * (double) pages * (double) pagesize / (1024.0 * 1024.0);
+  }
+  double mu = estimateRegistrationMem();
+  int nmem = (int) (mem / mu);
+  if (nmem < 1)
+  {
+    nmem = 1;
+    if (maxmem > 0)
+      cout << "   -- WARNING: one registration needs ~" << mu << "Mb, more than --maxmem "
+          << maxmem << "Mb" << endl;
+  }
+  if (nmem < nthreads)
+    nthreads = nmem;
+  cout << "   registering up to " << nthreads << " timepoints at a time (~" << mu
+      << "Mb each, " << (maxmem > 0 ? "--maxmem " : "free memory / 2: ") << mem << "Mb)" << endl;
+  return nthreads;
+}
+
 /*!
  \fn void mapAndAverageMov(int itdebug)
  \brief  maps movables to template using lta's, adjusts intensities (if iscale) and creates average (mean,median)
@@ -596,13 +668,26 @@ bool MultiRegistration::computeTemplate(int itmax, double eps, int iterate,
       cout << "  noxformits = " << noxformits[itcount - 1] << endl;
 
     // register all inputs to mean
+    // (the timepoints only share the read-only template, each registration
+    //  works on its own copies, so they run concurrently)
+    // (with nconc registrations at a time, each one gets an equal share of the
+    //  threads for its own loops, which needs a second active OpenMP level)
     vector<double> dists(nin, 1000); // should be larger than maxchange!
+    int nconc = getConcurrentRegistrations(nin);
 #ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(static,1)
+    int nthreadsinner = omp_get_max_threads() / nconc;
+    if (nthreadsinner < 1)
+      nthreadsinner = 1;
+    int maxlevels = omp_get_max_active_levels();
+    if (nconc > 1 && maxlevels < 2)
+      omp_set_max_active_levels(2);
+#pragma omp parallel for if(nconc > 1) schedule(dynamic,1) num_threads(nconc) reduction(max:maxchange)
 #endif
     for (int i = 0; i < nin; i++)
     {
 #ifdef HAVE_OPENMP
+      if (nconc > 1)
+        omp_set_num_threads(nthreadsinner);
 #pragma omp critical
 #endif  
       cout << endl << "Working on TP " << i + 1 << endl << endl;
@@ -653,16 +738,19 @@ bool MultiRegistration::computeTemplate(int itmax, double eps, int iterate,
       if (satit)
         R.findSaturation();
 
+      if (nomulti || iscaleonly)
+      {
 #ifdef HAVE_OPENMP
 #pragma omp critical
 #endif 
-      if (nomulti || iscaleonly)
-      {
         cout << " - running high-res registration on TP " << i + 1 << "..." << endl;
         R.computeIterativeRegistration(iterate, epsit); 
       }
       else
       {
+#ifdef HAVE_OPENMP
+#pragma omp critical
+#endif 
         cout << " - running multi-resolutional registration on TP " << i + 1 << "..." << endl;
         R.computeMultiresRegistration(maxres, iterate, epsit);
       }
@@ -838,6 +926,9 @@ bool MultiRegistration::computeTemplate(int itmax, double eps, int iterate,
       }
 
     } // for loop end (all timepoints)
+#ifdef HAVE_OPENMP
+    omp_set_max_active_levels(maxlevels);
+#endif
 
     // if we did not have initial transforms
     // allow for more iterations on different resolutions
@@ -1998,10 +2089,34 @@ MRI* MultiRegistration::averageSet(const std::vector<MRI *>& set, MRI* mean,
   {
     // mean
     cout << "    using mean" << endl;
-    for (unsigned int i = 0; i < set.size(); i++)
+    // same running average as calling MRIaverage(set[i], i, mean) for each i
+    // (also rounded to the type of mean after each step), but voxelwise over
+    // all timepoints and in parallel over slices
+    int x, y, z, f, i;
+    if (!mean)
+    {
+      mean = MRIalloc(set[0]->width, set[0]->height, set[0]->depth, set[0]->type);
+      MRIcopyHeader(set[0], mean);
+    }
+    for (i = 0; i < (int) set.size(); i++)
+      if (!MRIcheckSize(set[i], mean, 0, 0, 0))
+        ErrorExit(ERROR_BADPARM, "averageSet: incompatible volume dimensions");
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(y,x,f,i) shared(set,mean) schedule(guided)
+#endif
+    for (z = 0; z < set[0]->depth; z++)
     {
-      mean = MRIaverage(set[i], i, mean);
+      for (f = 0; f < mean->nframes; f++)
+        for (y = 0; y < set[0]->height; y++)
+          for (x = 0; x < set[0]->width; x++)
+            for (i = 0; i < (int) set.size(); i++)
+            {
+              double src = MRIgetVoxVal(set[i], x, y, z, f);
+              double dst = i ? MRIgetVoxVal(mean, x, y, z, f) : 0.0;
+              MRIsetVoxVal(mean, x, y, z, f, (dst * i + src) / (double) (i + 1));
+            }
     }
+    mean->dof += set.size();
   }
   else if (method == 1)
   {
@@ -50,6 +50,7 @@ public:
           satit(false), debug(0), iscale(false), iscaleonly(false),
           nomulti(false), subsamplesize(-1), highit(-1), fixvoxel(false),
           keeptype(false), average(1), doubleprec(false), backupweights(false),
+          streamirls(false), maxmem(0.0),
 	sampletype(SAMPLE_CUBIC_BSPLINE), crascenter(false), resthresh(0.01), frobnormthresh(0.0001), mri_mean(NULL)
   {
   }
@@ -59,6 +60,7 @@ public:
           satit(false), debug(0), iscale(false), iscaleonly(false),
           nomulti(false), subsamplesize(-1), highit(-1), fixvoxel(false),
           keeptype(false), average(1), doubleprec(false), backupweights(false),
+          streamirls(false), maxmem(0.0),
           sampletype(SAMPLE_CUBIC_BSPLINE), crascenter(false), resthresh(0.01), frobnormthresh(0.0001), mri_mean(NULL)
   {
     loadMovables(mov);
@@ -92,6 +94,8 @@ public:
     std::cout << " Average:       " << average << std::endl;
     std::cout << " DoublePrec:    " << doubleprec << std::endl;
     std::cout << " BackupWeights: " << backupweights << std::endl;
+    std::cout << " StreamIRLS:    " << streamirls << std::endl;
+    std::cout << " MaxMem:        " << maxmem << std::endl;
     std::cout << " SampleType:    " << sampletype<< std::endl;
     std::cout << " CRASCenter:    " << crascenter<< std::endl;
     std::cout << " Resthresh:     " << resthresh << std::endl;
@@ -241,6 +245,18 @@ public:
     backupweights = b;
   }
 
+  //! Robust regression without storing A (less memory per registration)
+  void setStreamIRLS(bool b)
+  {
+    streamirls = b;
+  }
+
+  //! Memory (Mb) for the concurrent registrations in computeTemplate (0: half of the free memory)
+  void setMaxMem(double mb)
+  {
+    maxmem = mb;
+  }
+
   //! Specify voxel threshold, default is 0.001
   void setResthresh(float thresh)
   {
@@ -300,6 +316,8 @@ private:
   void normalizeIntensities(void);
 
   void initRegistration(RegRobust & R);
+  double estimateRegistrationMem();
+  int getConcurrentRegistrations(int nin);
 
   vnl_matrix_fixed<double, 3, 3> getAverageCosines();
   MRI * createTemplateGeo();
@@ -328,6 +346,8 @@ private:
   int average;
   bool doubleprec;
   bool backupweights;
+  bool streamirls;
+  double maxmem;
   int sampletype;
   bool crascenter;
   float resthresh;
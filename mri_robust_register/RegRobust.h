@@ -44,7 +44,7 @@ class RegRobust: public Registration
   template<class T> friend class RegistrationStep;
 public:
   RegRobust() :
-      Registration(), sat(-1), wlimit(0.16), mri_weights(NULL), mri_hweights(
+      Registration(), sat(-1), wlimit(0.16), streamirls(false), mri_weights(NULL), mri_hweights(
           NULL), mri_indexing(NULL)
   {
   }
@@ -78,6 +78,12 @@ public:
     wlimit = d;
   }
 
+  //! Specify if the robust regression streams the rows of A instead of storing A
+  void setStreamIRLS(bool b)
+  {
+    streamirls = b;
+  }
+
   //! Get Name of Registration class
   virtual std::string getClassName() {return "RegRobust";}
   
@@ -96,6 +102,7 @@ private:
   // PRIVATE DATA
   double sat;
   double wlimit;
+  bool streamirls;
   MRI * mri_weights;
   MRI * mri_hweights;
   MRI * mri_indexing;
@@ -29,8 +29,10 @@
 #include <utility>
 #include <vector>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <string>
+#include <sys/resource.h>
 #include <vnl/vnl_vector.h>
 #include <vnl/vnl_matrix.h>
 #include <vnl/vnl_matrix_fixed.h>
@@ -41,6 +43,114 @@
 #include "Transformation.h"
 #include "RegRobust.h"
 
+/** \class RegistrationRows
+ * \brief The rows of A and b of a registration step for the streamed robust
+ * regression (Regression::getRobustEstWStream).
+ * Only the voxel position and the derivatives are stored per row (32 bytes),
+ * the row of A is expanded through the transformation model when it is used.
+ */
+template<class T>
+class RegistrationRows
+{
+public:
+  RegistrationRows(const Transformation * t, bool is) :
+      trans(t), iscale(is)
+  {
+  }
+
+  long size() const
+  {
+    return b.size();
+  }
+
+  unsigned int cols() const
+  {
+    return trans->getDOF() + (iscale ? 1 : 0);
+  }
+
+  //! Stores row i of A in a, returns b[i] (the same values constructAb stores)
+  T getRow(long i, T * a) const
+  {
+    const float * f = &fxyzt[4 * i];
+    getGradient(&xyz[3 * i], f, a);
+    if (iscale)
+      a[trans->getDOF()] = f[3];
+    return b[i];
+  }
+
+  //! Returns b[i] without expanding the row
+  T getB(long i) const
+  {
+    return b[i];
+  }
+
+  static double getRowBytes()
+  {
+    return 3 * sizeof(unsigned int) + 5 * sizeof(float);
+  }
+
+  //! Free the rows
+  void clear()
+  {
+    std::vector<unsigned int>().swap(xyz);
+    std::vector<float>().swap(fxyzt);
+    std::vector<float>().swap(b);
+  }
+
+  void reserve(long n)
+  {
+    xyz.reserve(3 * n);
+    fxyzt.reserve(4 * n);
+    b.reserve(n);
+  }
+
+  void push_back(unsigned int x, float fx, unsigned int y, float fy,
+      unsigned int z, float fz, float ft, float bval)
+  {
+    xyz.push_back(x);
+    xyz.push_back(y);
+    xyz.push_back(z);
+    fxyzt.push_back(fx);
+    fxyzt.push_back(fy);
+    fxyzt.push_back(fz);
+    fxyzt.push_back(ft);
+    b.push_back(bval);
+  }
+
+  bool is_finite() const
+  {
+    for (size_t i = 0; i < fxyzt.size(); i++)
+      if (!std::isfinite(fxyzt[i]))
+        return false;
+    for (size_t i = 0; i < b.size(); i++)
+      if (!std::isfinite(b[i]))
+        return false;
+    return true;
+  }
+
+private:
+  //! the gradient is written straight into a double row, through a small buffer into a float one
+  void getGradient(const unsigned int * p, const float * f, double * a) const
+  {
+    trans->getGradient(p[0], f[0], p[1], f[1], p[2], f[2], a);
+  }
+  void getGradient(const unsigned int * p, const float * f, float * a) const
+  {
+    double grad[12]; // the most parameters of any Transformation (3d affine)
+    unsigned int dof = trans->getDOF();
+    assert(dof <= 12);
+    trans->getGradient(p[0], f[0], p[1], f[1], p[2], f[2], grad);
+    for (unsigned int pno = 0; pno < dof; pno++)
+      a[pno] = grad[pno];
+  }
+
+  const Transformation * trans;
+  bool iscale;
+  std::vector<unsigned int> xyz;
+  std::vector<float> fxyzt;
+  std::vector<float> b;
+};
+
 template<class T>
 class RegistrationStep
 {
@@ -50,8 +160,8 @@ public:
   RegistrationStep(const RegRobust & R) :
       sat(R.sat), iscale(R.iscale), transonly(R.transonly), rigid(R.rigid), isoscale(
           R.isoscale), trans(R.trans), costfun(R.costfun), rtype(1), subsamplesize(
-          R.subsamplesize), debug(R.debug), verbose(R.verbose), floatsvd(false), iscalefinal(
-          R.iscalefinal), mri_weights(NULL), mri_indexing(NULL)
+          R.subsamplesize), debug(R.debug), verbose(R.verbose), floatsvd(false), streamirls(
+          R.streamirls), iscalefinal(R.iscalefinal), mri_weights(NULL), mri_indexing(NULL)
   {
   }
 
@@ -105,6 +215,8 @@ public:
   // only public because of resampling testing in Registration.cpp
   // should be made protected at some point.
   void constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T> &A, vnl_vector<T> &b);
+  //! Construct the rows of A and b without storing A (for the streamed regression)
+  void constructRows(MRI *mriS, MRI *mriT, RegistrationRows<T> &rows);
 
   // called from computeRegistrationStepW
   // and externally from RegPowell (not anymore, now use transformation model)
@@ -114,6 +226,8 @@ public:
 protected:
 
   vnl_matrix<T> constructR(const vnl_vector<T> & p);
+  void constructAbOrRows(MRI *mriS, MRI *mriT, vnl_matrix<T> *A, vnl_vector<T> *b,
+      RegistrationRows<T> *rows);
 
 private:
 // in:
@@ -130,6 +244,7 @@ private:
   int debug;
   int verbose;
   bool floatsvd; // should be removed
+  bool streamirls; // robust regression without storing A
   double iscalefinal; // from the last step, used in constructAB
 
 // out:
@@ -166,6 +281,10 @@ std::pair<vnl_matrix_fixed<double, 4, 4>, double> RegistrationStep<T>::computeRe
   vnl_matrix<T> A;
   vnl_vector<T> b;
 
+  // the streamed regression only replaces the robust estimate
+  RegistrationRows<T> rows(trans, iscale);
+  bool stream = streamirls && costfun == Registration::ROB && !(rigid && rtype == 2);
+
   if (rigid && rtype == 2)
   {
     if (verbose > 1)
@@ -193,6 +312,10 @@ std::pair<vnl_matrix_fixed<double, 4, 4>, double> RegistrationStep<T>::computeRe
     }
     A = A * R.transpose();
   }
+  else if (stream)
+  {
+    constructRows(mriS, mriT, rows);
+  }
   else
   {
     //std::cout << "Rtype  " << rtype << std::endl;
@@ -202,7 +325,7 @@ std::pair<vnl_matrix_fixed<double, 4, 4>, double> RegistrationStep<T>::computeRe
 
   if (verbose > 1)
     std::cout << "   - checking A and b for nan ..." << std::flush;
-  if (!A.is_finite() || !b.is_finite())
+  if (stream ? !rows.is_finite() : (!A.is_finite() || !b.is_finite()))
   {
     std::cerr << " A or b constain NAN or infinity values!!" << std::endl;
     exit(1);
@@ -220,7 +343,15 @@ std::pair<vnl_matrix_fixed<double, 4, 4>, double> RegistrationStep<T>::computeRe
     if (verbose > 1)
       std::cout << "   - compute robust estimate ( sat " << sat << " )..."
           << std::flush;
-    if (sat < 0)
+    if (stream)
+    {
+      if (sat < 0)
+        pvec = R.getRobustEstWStream(rows, w);
+      else
+        pvec = R.getRobustEstWStream(rows, w, sat);
+      rows.clear();
+    }
+    else if (sat < 0)
       pvec = R.getRobustEstW(w);
     else
       pvec = R.getRobustEstW(w, sat);
@@ -342,6 +473,14 @@ std::pair<vnl_matrix_fixed<double, 4, 4>, double> RegistrationStep<T>::computeRe
 //  zeroweights = R.getLastZeroWeightPercent();
   zeroweights = R.getLastWeightPercent(); // does not need pointers A and B to be valid
 
+  if (verbose > 1)
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << "   - peak memory so far: " << usage.ru_maxrss / 1024.0 << "Mb ("
+        << (stream ? "streamed IRLS" : "A and b") << ")" << std::endl;
+  }
+
 //  R.plotPartialSat(name);
 
 //   if (mriS->depth ==1 || mriT->depth ==1)
@@ -368,6 +507,25 @@ template<class T>
 void RegistrationStep<T>::constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T>& A,
     vnl_vector<T>&b)
 {
+  constructAbOrRows(mriS, mriT, &A, &b, NULL);
+}
+
+/** Constructs the rows of A and b for the streamed robust regression,
+   with the same indexing (mri_indexing) as constructAb.
+ */
+template<class T>
+void RegistrationStep<T>::constructRows(MRI *mriS, MRI *mriT,
+    RegistrationRows<T>& rows)
+{
+  constructAbOrRows(mriS, mriT, NULL, NULL, &rows);
+}
+
+/** Constructs either A and b, or the compact rows (if rows is not NULL)
+ */
+template<class T>
+void RegistrationStep<T>::constructAbOrRows(MRI *mriS, MRI *mriT, vnl_matrix<T>* A,
+    vnl_vector<T>* b, RegistrationRows<T>* rows)
+{
 
   if (verbose > 1)
     std::cout << "   - constructAb: " << std::endl;
@@ -633,19 +791,9 @@ void RegistrationStep<T>::constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T>& A,
   //cout << " pnum: " << pnum << "  counti: " << counti<<  endl;
   double amu = ((double) counti * (pnum + 1)) * sizeof(T) / (1024.0 * 1024.0); // +1 =  rowpointer vector
   double bmu = (double) counti * sizeof(T) / (1024.0 * 1024.0);
-  if (verbose > 1)
+  if (verbose > 1 && !rows)
     std::cout << "     -- allocating " << amu + bmu << "Mb mem for A and b ... "
         << std::flush;
-  bool OK = A.set_size(counti, pnum);
-  OK = OK && b.set_size(counti);
-  if (!OK)
-  {
-    std::cout << std::endl;
-    ErrorExit(ERROR_NO_MEMORY,
-        "Registration::constructAB could not allocate memory for A and b");
-  }
-  if (verbose > 1)
-    std::cout << " done! " << std::endl;
   double maxmu = 5 * amu + 7 * bmu;
   string fstr = "";
   if (floatsvd)
@@ -653,9 +801,40 @@ void RegistrationStep<T>::constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T>& A,
     maxmu = amu + 3 * bmu + 2 * (amu + bmu);
     fstr = "-float";
   }
-  if (verbose > 1)
-    std::cout << "         (MAX usage in SVD" << fstr << " will be > " << maxmu
-        << "Mb mem + 6 MRI) " << std::endl;
+  if (rows)
+  {
+    // the streamed solver keeps the compact rows, the residuals, two weights
+    // vectors and one scratch vector
+    double rmu = rows->getRowBytes() * (double) counti / (1024.0 * 1024.0);
+    if (verbose > 1)
+      std::cout << "     -- allocating " << rmu << "Mb mem for streamed rows (instead of "
+          << amu + bmu << "Mb for A and b) ... " << std::flush;
+    rows->clear();
+    rows->reserve(counti);
+    if (verbose > 1)
+    {
+      std::cout << " done! " << std::endl;
+      std::cout << "         (MAX usage in streamed IRLS will be > " << rmu + 4 * bmu
+          << "Mb mem + 6 MRI, SVD" << fstr << " would be > " << maxmu << "Mb) " << std::endl;
+    }
+    maxmu = rmu + 4 * bmu;
+  }
+  else
+  {
+    bool OK = A->set_size(counti, pnum);
+    OK = OK && b->set_size(counti);
+    if (!OK)
+    {
+      std::cout << std::endl;
+      ErrorExit(ERROR_NO_MEMORY,
+          "Registration::constructAB could not allocate memory for A and b");
+    }
+    if (verbose > 1)
+      std::cout << " done! " << std::endl;
+    if (verbose > 1)
+      std::cout << "         (MAX usage in SVD" << fstr << " will be > " << maxmu
+          << "Mb mem + 6 MRI) " << std::endl;
+  }
   if (maxmu > 3800)
   {
     std::cout << "     -- WARNING: mem usage large: " << maxmu
@@ -752,12 +931,20 @@ void RegistrationStep<T>::constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T>& A,
           //cout << "x: " << x << " y: " << y << " z: " << z << " count: "<< count << std::endl;
           //cout << " " << count << " mrifx: " << MRIFvox(mri_fx, x, y, z) << " mrifx int: " << (int)MRIvox(mri_fx,x,y,z) <<endl;
 
+          if (rows)
+          {
+            // the row is expanded through the transformation model when used
+            rows->push_back(x, fxval, y, fyval, z, fzval, ftval, MRIFseq_vox(SmT, x, y, z, f));
+            count++;
+            continue;
+          }
+
           // new: now use transformation model to get the gradient vector
           vnl_vector < double > grad = trans->getGradient(x,fxval,y,fyval,z,fzval);
           int dof = grad.size();
           for (int pno = 0; pno < dof; pno++)
           {
-            A[count][pno] = grad[pno];
+            (*A)[count][pno] = grad[pno];
           }
 
 //         if (transonly)
@@ -880,10 +1067,10 @@ void RegistrationStep<T>::constructAb(MRI *mriS, MRI *mriT, vnl_matrix<T>& A,
           // intensity model: R(s,IS,IT) = exp(-0.5 s) IT - exp(0.5 s) IS
           //                  R'  = -0.5 ( exp(-0.5 s) IT + exp(0.5 s) IS)
           //   ft = 0.5 ( exp(-0.5s) IT + exp(0.5s) IS)  (average of intensity adjusted images)
-          if (iscale) A[count][dof] = ftval;
+          if (iscale) (*A)[count][dof] = ftval;
 
           // A p = b = IS - IT
-          b[count] = MRIFseq_vox(SmT, x, y, z, f);
+          (*b)[count] = MRIFseq_vox(SmT, x, y, z, f);
 
           count++;// start with 0 above
 
@@ -38,10 +38,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "error.h"
 
 using namespace std;
 
+/** Median of t (reordered), the same value as RobustGaussian::median.
+ */
+template<class T>
+static T selectMedian(std::vector<T> & t)
+{
+  size_t n = t.size();
+  size_t k = n / 2;
+  std::nth_element(t.begin(), t.begin() + k, t.end());
+  T q2 = t[k];
+  if (n % 2 == 1)
+    return q2;
+  // the largest of the lower half is the other middle element
+  T q = *std::max_element(t.begin(), t.begin() + k);
+  return 0.5 * (q + q2);
+}
+
 template<class T>
 vnl_vector<T> Regression<T>::getRobustEst(double sat, double sig)
 {
@@ -356,6 +373,274 @@ vnl_vector<T> Regression<T>::getRobustEstWAB(vnl_vector<T>& wfinal, double sat,
 }
 
 
+/** Same as getRobustEstWAB, but A and b are never stored.
+ The rows are produced on the fly by a row source with
+   long size() const            number of rows
+   unsigned int cols() const    number of parameters
+   T getRow(long i, T* a) const stores row i of A into a[0..cols()-1] and returns b[i]
+   T getB(long i) const         returns b[i] only
+ which must be safe to call from several threads.
+ Each iteration accumulates the weighted normal equations A^T W A and A^T W b
+ in one parallel pass and solves that small system, then computes the residuals
+ in a second pass. Memory is the residuals, the current and the last weights
+ and one scratch vector for the median selection (4 values per row), instead
+ of A, the weighted copy wA and its QR decomposition.
+ Solving the normal equations squares the condition number, so the
+ parameters can differ from the QR solution in the last digits.
+ */
+template<class T>
+template<class Rows>
+vnl_vector<T> Regression<T>::getRobustEstWStream(const Rows & rows,
+    vnl_vector<T>& wfinal, double sat, double sig)
+{
+  if (verbose > 1)
+    cout << "  Regression<T>::getRobustEstWStream( " << sat << " , " << sig
+        << " ) " << endl;
+
+  // constants
+  int MAXIT = 20;
+  double EPS = 2e-12;
+
+  // variables
+  std::vector<T> err(MAXIT + 1);
+  err[0] = numeric_limits<T>::infinity();
+  err[1] = 1e20;
+  double sigma;
+
+  long arows = rows.size(); // large (voxels)
+  int acols = rows.cols(); // small (parameters)
+
+  // init residuals (based on zero p, so r := b )
+  vnl_vector<T> r(arows);
+  for (long rr = 0; rr < arows; rr++)
+    r[rr] = rows.getB(rr);
+
+  vnl_vector<T> * p = new vnl_vector<T>(acols);
+  vnl_vector<T> * w = new vnl_vector<T>(arows);
+  vnl_vector<T> *lastp = new vnl_vector<T>(acols);
+  vnl_vector<T> *lastw = new vnl_vector<T>(arows);
+  vnl_vector<T> *vtmp = NULL;
+  std::vector<T> scratch(arows);
+
+  int count = 0;
+  int incr = 0;
+  // iteration until we increase the error, we reach maxit or we have no error
+  do
+  {
+    count++; //first = 1
+
+    if (count > 1)
+    {
+      // swap pointers instead of copying
+      vtmp = lastp;
+      lastp = p;
+      p = vtmp;
+      vtmp = lastw;
+      lastw = w;
+      w = vtmp;
+    }
+
+    // normalize r and compute weights (or rather w = sqrt of weights)
+    sigma = getSigmaMADSelect(r, scratch);
+    if (sigma < EPS) // e.g. if images are identical
+    {
+      cout << "  Sigma too small: " << sigma << " (identical images?)" << endl;
+      w->fill(1.0);
+    }
+    else
+    {
+      r *= (1.0 / sigma);
+      getSqrtTukeyDiaWeights(r, *w, sat);
+    }
+
+    // weighted least squares, then new residuals and total error
+    // err = sum (w r^2) / sum (w)
+    *p = getWeightedLSEstStream(rows, *w);
+    err[count] = getResidualsStream(rows, *p, *w, r);
+    if (err[count - 1] <= err[count])
+      incr++;
+  } while (incr < 1 && count < MAXIT && err[count] > EPS);
+
+  vnl_vector<T> pfinal;
+  if (err[count] > err[count - 1])
+  {
+    // take previous values (since actual values made the error to increase)
+    pfinal = *lastp;
+    wfinal = *lastw;
+    if (verbose > 1)
+      cout << "     Step: " << count - 2 << " ERR: " << err[count - 1] << endl;
+    lasterror = err[count - 1];
+  }
+  else
+  {
+    pfinal = *p;
+    wfinal = *w;
+    if (verbose > 1)
+      cout << "     Step: " << count - 1 << " ERR: " << err[count] << endl;
+    lasterror = err[count];
+  }
+  delete (p);
+  delete (w);
+  delete (lastw);
+  delete (lastp);
+
+  // compute statistics on weights:
+  double dd = 0.0;
+  double ddcount = 0;
+  int zcount = 0;
+  T val;
+  for (long i = 0; i < arows; i++)
+  {
+    val = wfinal[i];
+    if (fabs(rows.getB(i)) > 0.00001)
+    {
+      dd += val;
+      ddcount++;
+      if (val < 0.1)
+        zcount++;
+    }
+  }
+  dd /= ddcount;
+  if (verbose > 1)
+    cout << "          weights average: " << dd << "  zero: "
+        << (double) zcount / ddcount << flush;
+  lastweight = dd;
+  lastzero = (double) zcount / ddcount;
+
+  return pfinal;
+}
+
+/** The rows are split into a fixed number of blocks (independent of the
+ number of threads), whose partial sums are added in order, so the
+ streamed solver gives the same result on any number of threads.
+ */
+static inline long getStreamBlockSize(long n)
+{
+  long bs = (n + 255) / 256;
+  if (bs < 4096)
+    bs = 4096;
+  return bs;
+}
+
+/** Solves \f$ [A^T W A] p = A^T W b\f$ (with \f$ W = diag(w_i^2) \f$ ) by
+ accumulating the small normal equations over the streamed rows in double
+ and solving them with SVD.
+ \param w vector representing a diagnoal matrix with the sqrt of the weights as elements
+ */
+template<class T>
+template<class Rows>
+vnl_vector<T> Regression<T>::getWeightedLSEstStream(const Rows & rows,
+    const vnl_vector<T> & w)
+{
+  long const n = rows.size();
+  int const m = rows.cols();
+  assert((long)w.size() == n);
+
+  long const bs = getStreamBlockSize(n);
+  int const nblocks = (n + bs - 1) / bs;
+  int const stride = m * m + m;   // A^T W A, then A^T W b
+  std::vector<double> partial((size_t)nblocks * stride, 0.0);
+
+  int block;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+  for (block = 0; block < nblocks; block++)
+  {
+    double * ata = &partial[(size_t)block * stride];
+    double * atb = ata + m * m;
+    std::vector<T> a(m);
+    long const end = std::min(n, (block + 1) * bs);
+    for (long rr = block * bs; rr < end; rr++)
+    {
+      double const wi = (double) w[rr] * w[rr];
+      if (wi == 0.0)
+        continue;
+      double const bi = rows.getRow(rr, &a[0]);
+      for (int j = 0; j < m; j++)
+      {
+        double const waj = wi * a[j];
+        atb[j] += waj * bi;
+        for (int k = 0; k <= j; k++)
+          ata[j * m + k] += waj * a[k];
+      }
+    }
+  }
+
+  vnl_matrix<double> AtWA(m, m, 0.0);
+  vnl_vector<double> AtWb(m, 0.0);
+  for (block = 0; block < nblocks; block++)
+  {
+    double const * ata = &partial[(size_t)block * stride];
+    double const * atb = ata + m * m;
+    for (int j = 0; j < m; j++)
+    {
+      AtWb[j] += atb[j];
+      for (int k = 0; k <= j; k++)
+        AtWA(j, k) += ata[j * m + k];
+    }
+  }
+  for (int j = 0; j < m; j++)
+    for (int k = 0; k < j; k++)
+      AtWA(k, j) = AtWA(j, k);
+
+  vnl_svd<double> svd(AtWA);
+  vnl_vector<double> pd = svd.solve(AtWb);
+
+  vnl_vector<T> p(m);
+  for (int j = 0; j < m; j++)
+    p[j] = (T) pd[j];
+  return p;
+}
+
+/** Computes the residuals r = b - A p over the streamed rows and
+ returns the error sum (w r^2) / sum (w) with w the squared sqrtweights.
+ */
+template<class T>
+template<class Rows>
+T Regression<T>::getResidualsStream(const Rows & rows, const vnl_vector<T> & p,
+    const vnl_vector<T> & w, vnl_vector<T> & r)
+{
+  long const n = rows.size();
+  int const m = rows.cols();
+
+  long const bs = getStreamBlockSize(n);
+  int const nblocks = (n + bs - 1) / bs;
+  std::vector<T> blockswr(nblocks, 0), blocksw(nblocks, 0);
+
+  int block;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+  for (block = 0; block < nblocks; block++)
+  {
+    std::vector<T> a(m);
+    T swr = 0, sw = 0;
+    long const end = std::min(n, (block + 1) * bs);
+    for (long rr = block * bs; rr < end; rr++)
+    {
+      T ri = rows.getRow(rr, &a[0]);
+      for (int j = 0; j < m; j++)
+        ri -= a[j] * p[j];
+      r[rr] = ri;
+      T t1 = w[rr];
+      t1 *= t1; // remember w is the sqrt of the weights
+      sw += t1;
+      swr += t1 * ri * ri;
+    }
+    blockswr[block] = swr;
+    blocksw[block] = sw;
+  }
+
+  T swr = 0, sw = 0;
+  for (block = 0; block < nblocks; block++)
+  {
+    swr += blockswr[block];
+    sw += blocksw[block];
+  }
+  return swr / sw;
+}
+
 /** Solving \f$ p = [A^T W A]^{-1} A^T W b\f$     (with \f$ W = diag(w_i^2) \f$ )
  done by computing \f$ M := \sqrt{W} A\f$ and  \f$ v := \sqrt{W} b\f$
  then we have \f$ p = [ M^T M ]^{-1} M^T v  \f$
@@ -707,6 +992,23 @@ T Regression<T>::getSigmaMAD(const vnl_vector<T>& v, T d)
   return qs;
 }
 
+/** Robust estimate for sigma as getSigmaMAD, with the two medians found by
+ selection (std::nth_element) in one scratch vector that the caller keeps
+ between the iterations, instead of two temporary copies.
+ */
+template<class T>
+T Regression<T>::getSigmaMADSelect(const vnl_vector<T>& v,
+    std::vector<T> & t, T d)
+{
+  unsigned int n = v.size();
+  t.resize(n);
+  std::copy(v.begin(), v.end(), t.begin());
+  T medi = selectMedian(t);
+  for (unsigned int r = 0; r < n; r++)
+    t[r] = fabs(v[r] - medi);
+  return d * selectMedian(t);
+}
+
 /**
  \param fname is the filename without ending
  */
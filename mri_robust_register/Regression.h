@@ -34,6 +34,7 @@
 #define SATr 4.685  // this is suggested for gaussian noise
 #include <utility>
 #include <string>
+#include <vector>
 #include <cassert>
 #include <vnl/vnl_vector.h>
 #include <vnl/vnl_matrix.h>
@@ -56,10 +57,18 @@ public:
       A(NULL), b(&bp), lasterror(-1), lastweight(-1), lastzero(-1), verbose(1), floatsvd(false)
   {}
 
+  //! Constructor for the streamed solver (A and b are passed as a row source)
+  Regression() :
+      A(NULL), b(NULL), lasterror(-1), lastweight(-1), lastzero(-1), verbose(1), floatsvd(false)
+  {}
+
   //! Robust solver
   vnl_vector<T> getRobustEst(double sat = SATr, double sig=1.4826);
   //! Robust solver (returning also the sqrtweights)
   vnl_vector<T> getRobustEstW(vnl_vector<T>&w, double sat=SATr, double sig=1.4826);
+  //! Robust solver that never stores A (returning also the sqrtweights)
+  template<class Rows>
+  vnl_vector<T> getRobustEstWStream(const Rows & rows, vnl_vector<T>&w, double sat=SATr, double sig=1.4826);
 
   //! Least Squares
   vnl_vector<T> getLSEst();
@@ -107,6 +116,13 @@ protected:
   double getRobustEstWB(vnl_vector<T>&w, double sat = SATr, double sig = 1.4826);
 
   T getSigmaMAD(const vnl_vector<T>& r, T d = 1.4826);
+  T getSigmaMADSelect(const vnl_vector<T>& r, std::vector<T> & scratch, T d = 1.4826);
+
+  template<class Rows>
+  vnl_vector<T> getWeightedLSEstStream(const Rows & rows, const vnl_vector<T> & sqrtweights);
+  template<class Rows>
+  T getResidualsStream(const Rows & rows, const vnl_vector<T> & p, const vnl_vector<T> & sqrtweights,
+      vnl_vector<T> & r);
   T VectorMedian(const vnl_vector<T>& v);
 
   void getSqrtTukeyDiaWeights(const vnl_vector<T>& r, vnl_vector<T> &w, double sat = SATr);
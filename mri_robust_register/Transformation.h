@@ -56,9 +56,18 @@ public:
   //! Get steps for Powell
   virtual vnl_vector<double> getSteps() const =0;
   //! Get the gradient ( grad Image * grad Transform )
-  virtual vnl_vector<double> getGradient(const unsigned int& x, const float& fx,
+  vnl_vector<double> getGradient(const unsigned int& x, const float& fx,
       const unsigned int& y, const float& fy, const unsigned int& z,
-      const float& fz) const =0;
+      const float& fz) const
+  {
+    vnl_vector<double> ret(getDOF());
+    getGradient(x, fx, y, fy, z, fz, ret.data_block());
+    return ret;
+  }
+  //! Store the gradient in grad[0..getDOF()-1] (for per voxel use, does not allocate)
+  virtual void getGradient(const unsigned int& x, const float& fx,
+      const unsigned int& y, const float& fy, const unsigned int& z,
+      const float& fz, double * grad) const =0;
 
   //! Set the parameters from double std vector
   void setParameters(const std::vector<double> &p)
@@ -168,18 +177,16 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
-  {
-    vnl_vector<double> ret(6);
-    ret[0] = (double) x * fx;
-    ret[1] = (double) y * fx;
-    ret[2] = fx;
-    ret[3] = (double) x * fy;
-    ret[4] = (double) y * fy;
-    ret[5] = fy;
-    return ret;
+      const unsigned int& z, const float& fz, double * grad) const
+  {
+    grad[0] = (double) x * fx;
+    grad[1] = (double) y * fx;
+    grad[2] = fx;
+    grad[3] = (double) x * fy;
+    grad[4] = (double) y * fy;
+    grad[5] = fy;
   }
 
 };
@@ -280,21 +287,19 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << "Gradient for affine 2d (second type) not implemented!"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(6);
-    ret[0] = fx;
-    ret[1] = fx;
-    ret[2] = (-y * fx) + (x * fy); // or negative rotation?
-    ret[3] = x * fx;
-    ret[4] = y * fy;
-    ret[5] = y * fx;
-    return ret;
+    grad[0] = fx;
+    grad[1] = fx;
+    grad[2] = (-y * fx) + (x * fy); // or negative rotation?
+    grad[3] = x * fx;
+    grad[4] = y * fy;
+    grad[5] = y * fx;
   }
 
 };
@@ -359,16 +364,14 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
-    vnl_vector<double> ret(4);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fx * x + fy * y;
-    ret[3] = -fx * y + fy * x;
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fx * x + fy * y;
+    grad[3] = -fx * y + fy * x;
   }
 
 };
@@ -450,19 +453,17 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << "Gradient for isoscale 2d (second type) not implemented!"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(4);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = (-y * fx) + (x * fy); // or negative rotation?
-    ret[3] = fx * x + fy * y;
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = (-y * fx) + (x * fy); // or negative rotation?
+    grad[3] = fx * x + fy * y;
   }
 
 };
@@ -539,15 +540,13 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
-    vnl_vector<double> ret(3);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = (fy * x - fx * y);
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = (fy * x - fx * y);
   }
 
 };
@@ -634,18 +633,16 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << "Gradient for rigid 2d (second type) not implemented!"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(3);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = (y * fx) - (x * fy); // negative rotation compared to other 2d rigid
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = (y * fx) - (x * fy); // negative rotation compared to other 2d rigid
   }
 
 };
@@ -703,14 +700,12 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
-    vnl_vector<double> ret(2);
-    ret[0] = fx;
-    ret[1] = fy;
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
   }
 
 };
@@ -782,24 +777,22 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
-  {
-    vnl_vector<double> ret(12);
-    ret[0] = fx * x;
-    ret[1] = fx * y;
-    ret[2] = fx * z;
-    ret[3] = fx;
-    ret[4] = fy * x;
-    ret[5] = fy * y;
-    ret[6] = fy * z;
-    ret[7] = fy;
-    ret[8] = fz * x;
-    ret[9] = fz * y;
-    ret[10] = fz * z;
-    ret[11] = fz;
-    return ret;
+      const unsigned int& z, const float& fz, double * grad) const
+  {
+    grad[0] = fx * x;
+    grad[1] = fx * y;
+    grad[2] = fx * z;
+    grad[3] = fx;
+    grad[4] = fy * x;
+    grad[5] = fy * y;
+    grad[6] = fy * z;
+    grad[7] = fy;
+    grad[8] = fz * x;
+    grad[9] = fz * y;
+    grad[10] = fz * z;
+    grad[11] = fz;
   }
 
 };
@@ -902,27 +895,25 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << " Affine in 3D (type 2): gradient not implemented!"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(12);
-    ret[0] = fx * x;
-    ret[1] = fx * y;
-    ret[2] = fx * z;
-    ret[3] = fx;
-    ret[4] = fy * x;
-    ret[5] = fy * y;
-    ret[6] = fy * z;
-    ret[7] = fy;
-    ret[8] = fz * x;
-    ret[9] = fz * y;
-    ret[10] = fz * z;
-    ret[11] = fz;
-    return ret;
+    grad[0] = fx * x;
+    grad[1] = fx * y;
+    grad[2] = fx * z;
+    grad[3] = fx;
+    grad[4] = fy * x;
+    grad[5] = fy * y;
+    grad[6] = fy * z;
+    grad[7] = fy;
+    grad[8] = fz * x;
+    grad[9] = fz * y;
+    grad[10] = fz * z;
+    grad[11] = fz;
   }
 
 };
@@ -1012,22 +1003,20 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << " Isoscale in 3D not implemented yet, use ridig or affine"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(7);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fz;
-    ret[3] = (fz * y - fy * z);
-    ret[4] = (fx * z - fz * x);
-    ret[5] = (fy * x - fx * y);
-    ret[6] = (fx * x + fy * y);
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fz;
+    grad[3] = (fz * y - fy * z);
+    grad[4] = (fx * z - fz * x);
+    grad[5] = (fy * x - fx * y);
+    grad[6] = (fx * x + fy * y);
   }
 
 };
@@ -1114,22 +1103,20 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << " Isoscale in 3D (type 2): gradient not implemented!"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(7);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fz;
-    ret[3] = (fz * y - fy * z);
-    ret[4] = (fx * z - fz * x);
-    ret[5] = (fy * x - fx * y);
-    ret[6] = (fx * x + fy * y);
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fz;
+    grad[3] = (fz * y - fy * z);
+    grad[4] = (fx * z - fz * x);
+    grad[5] = (fy * x - fx * y);
+    grad[6] = (fx * x + fy * y);
   }
 
 };
@@ -1206,18 +1193,16 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
-  {
-    vnl_vector<double> ret(6);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fz;
-    ret[3] = (fz * y - fy * z);
-    ret[4] = (fx * z - fz * x);
-    ret[5] = (fy * x - fx * y);
-    return ret;
+      const unsigned int& z, const float& fz, double * grad) const
+  {
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fz;
+    grad[3] = (fz * y - fy * z);
+    grad[4] = (fx * z - fz * x);
+    grad[5] = (fy * x - fx * y);
   }
 
 };
@@ -1294,21 +1279,19 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
     std::cerr << "ERROR rigid in 3D (type 2): gradient not implemented !"
         << std::endl;
     exit(1);
-    vnl_vector<double> ret(6);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fz;
-    ret[3] = (fz * y - fy * z);
-    ret[4] = (fx * z - fz * x);
-    ret[5] = (fy * x - fx * y);
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fz;
+    grad[3] = (fz * y - fy * z);
+    grad[4] = (fx * z - fz * x);
+    grad[5] = (fy * x - fx * y);
   }
 
 };
@@ -1368,15 +1351,13 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
-    vnl_vector<double> ret(3);
-    ret[0] = fx;
-    ret[1] = fy;
-    ret[2] = fz;
-    return ret;
+    grad[0] = fx;
+    grad[1] = fy;
+    grad[2] = fz;
   }
 
 };
@@ -1424,12 +1405,10 @@ public:
     return ret;
   }
 
-  inline virtual vnl_vector<double> getGradient(const unsigned int& x,
+  inline virtual void getGradient(const unsigned int& x,
       const float& fx, const unsigned int& y, const float& fy,
-      const unsigned int& z, const float& fz) const
+      const unsigned int& z, const float& fz, double * grad) const
   {
-    vnl_vector<double> ret;
-    return ret;
   }
 
 };
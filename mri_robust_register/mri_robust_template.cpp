@@ -124,6 +124,8 @@ struct Parameters
   float  resthresh;
   double frobnormthresh;
   bool AllowDiffVoxSize;
+  bool streamirls;
+  double maxmem;
 };
 
 // Initializations:
@@ -131,7 +133,7 @@ static struct Parameters P =
 { vector<string>(0), vector<string>(0), "", vector<string>(0), vector<string>(0), vector<string>(
     0), vector<string>(0), false, false, false, false, false, false, false, false, false,
     5, -1.0, SAT, vector<string>(0), 0, 1, -1, false, false, SSAMPLE, false, false, "", false,
-  true, vector<string>(0), vector<string>(0), SAMPLE_CUBIC_BSPLINE, -1, 0 , false, 5, 0.01, 0.01, 0.0001,false};
+  true, vector<string>(0), vector<string>(0), SAMPLE_CUBIC_BSPLINE, -1, 0 , false, 5, 0.01, 0.01, 0.0001,false, false, 0.0};
 
 static void printUsage(void);
 static bool parseCommandLine(int argc, char *argv[], Parameters & P);
@@ -221,6 +223,8 @@ int main(int argc, char *argv[])
     MR.setKeepType(!P.floattype);
     MR.setAverage(P.average);
     MR.setDoublePrec(P.doubleprec);
+    MR.setStreamIRLS(P.streamirls);
+    MR.setMaxMem(P.maxmem);
     MR.setSubsamplesize(P.subsamplesize);
     MR.setHighit(P.highit);
     if (P.nweights.size() > 0)
@@ -686,6 +690,21 @@ static int parseNextCommand(int argc, char *argv[], Parameters & P)
         << "--doubleprec: Will perform algorithm with double precision (higher mem usage)!"
         << endl;
   }
+  else if (!strcmp(option, "STREAMIRLS"))
+  {
+    P.streamirls = true;
+    nargs = 0;
+    cout
+        << "--streamirls: Will compute robust estimates without storing A (lower mem usage)!"
+        << endl;
+  }
+  else if (!strcmp(option, "MAXMEM"))
+  {
+    P.maxmem = atof(argv[1]);
+    nargs = 1;
+    cout << "--maxmem: Will limit concurrent registrations to " << P.maxmem << " Mb"
+        << endl;
+  }
   else if (!strcmp(option, "WEIGHTS"))
   {
     nargs = 0;
@@ -827,7 +846,6 @@ static int parseNextCommand(int argc, char *argv[], Parameters & P)
   {
     nargs = 1;
 #ifdef _OPENMP
-    // Does not speed things up much
     omp_set_num_threads(atoi(argv[1]));
 #endif
   }
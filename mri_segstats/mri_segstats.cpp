@@ -57,6 +57,7 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <errno.h>
+#include <vector>
 
 #include "macros.h"
 #include "mrisurf.h"
@@ -66,6 +67,7 @@
 #include "diag.h"
 #include "mri.h"
 #include "mri2.h"
+#include "mri_iterate.h"
 #include "version.h"
 #include "cma.h"
 #include "gca.h"
@@ -91,7 +93,6 @@ static void dump_options(FILE *fp);
 static int  singledash(char *flag);
 
 
-int MRIsegCount(MRI *seg, int id, int frame);
 STATSUMENTRY *LoadStatSumFile(char *fname, int *nsegid);
 int DumpStatSumTable(STATSUMENTRY *StatSumTable, int nsegid);
 int CountEdits(char *subject, char *outfile);
@@ -821,6 +822,18 @@ int main(int argc, char **argv)
 
   DoContinue=0;nx=0;skip=0;n0=0;vol=0;nhits=0;c=0;min=0.0;max=0.0;range=0.0;mean=0.0;std=0.0;snr=0.0;
 
+  // Count, partial volume and stats of all the segmentations in one pass
+  std::vector<int> segids(nsegid), seghits(nsegid);
+  std::vector<float> segpvvol(nsegid), segmin(nsegid), segmax(nsegid), segrange(nsegid), segmean(nsegid), segstd(nsegid);
+  if (!dontrun)
+  {
+    for (n=0; n < nsegid; n++) segids[n] = StatSumTable[n].id;
+    MRIsegStatsMulti(seg, nsegid, &segids[0], (InVolFile != NULL) ? invol : NULL, frame, UseRobust, RobustPct,
+                     &seghits[0], &segmin[0], &segmax[0], &segrange[0], &segmean[0], &segstd[0], NULL);
+    if (!mris && pvvol != NULL)
+      MRIvoxelsInLabelsWithPartialVolumeEffects(seg, pvvol, nsegid, &segids[0], &segpvvol[0]);
+  }
+
   ROMP_PF_begin
 #ifdef HAVE_OPENMP
   #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(DoContinue,nx,skip,n0,vol,nhits,c,min,max,range,mean,std,snr)  schedule(guided)
@@ -863,13 +876,13 @@ int main(int argc, char **argv)
       {
         if (pvvol == NULL)
         {
-          nhits = MRIsegCount(seg, StatSumTable[n].id, 0);
+          nhits = seghits[n];
           vol = nhits*voxelvolume;
         }
         else
         {
-          vol = MRIvoxelsInLabelWithPartialVolumeEffects(seg, pvvol, StatSumTable[n].id, NULL, NULL);
-          nhits = MRIsegCount(seg, StatSumTable[n].id, 0);
+          vol = segpvvol[n];
+          nhits = seghits[n];
 //          nhits = nint(vol/voxelvolume);
         }
       }  // if (!mris)
@@ -906,13 +919,11 @@ int main(int argc, char **argv)
     {
       if (nhits > 0)
       {
-        if(UseRobust == 0)
-          MRIsegStats(seg, StatSumTable[n].id, invol, frame,
-            &min, &max, &range, &mean, &std);
-        else
-          MRIsegStatsRobust(seg, StatSumTable[n].id, invol, frame,
-            &min, &max, &range, &mean, &std, RobustPct);
-
+        min   = segmin[n];
+        max   = segmax[n];
+        range = segrange[n];
+        mean  = segmean[n];
+        std   = segstd[n];
         snr = mean/std;
       }
       else
@@ -1422,13 +1433,17 @@ int main(int argc, char **argv)
     for (n=0; n < nsegid; n++)
       favg[n] = (double *) calloc(sizeof(double),invol->nframes);
     favgmn = (double *) calloc(sizeof(double *),nsegid);
+    std::vector<int> segnvox(nsegid);
+    for (n=0; n < nsegid; n++) segids[n] = StatSumTable[n].id;
+    MRIsegStatsMulti(seg, nsegid, &segids[0], invol, 0, 0, 0, &segnvox[0],
+                     NULL, NULL, NULL, NULL, NULL, favg);
     for (n=0; n < nsegid; n++) {
       if(debug){
 	printf("%3d",n);
 	if (n%20 == 19) printf("\n");
 	fflush(stdout);
       }
-      nvox = MRIsegFrameAvg(seg, StatSumTable[n].id, invol, favg[n]);
+      nvox = segnvox[n];
       favgmn[n] = 0.0;
       for(f=0; f < invol->nframes; f++) {
 	if(DoFrameSum) favg[n][f] *= nvox; // Undo spatial average
@@ -2265,30 +2280,6 @@ static int singledash(char *flag)
   return(0);
 }
 
-/* ----------------------------------------------------------
-   MRIsegCount() - returns the number of times the given
-   segmentation id appears in the volume.
-   --------------------------------------------------------- */
-int MRIsegCount(MRI *seg, int id, int frame)
-{
-  int nhits, v, c,r,s;
-  nhits = 0;
-  for (c=0; c < seg->width; c++)
-  {
-    for (r=0; r < seg->height; r++)
-    {
-      for (s=0; s < seg->depth; s++)
-      {
-        v = (int) MRIgetVoxVal(seg,c,r,s,frame);
-        if (v == id)
-        {
-          nhits ++;
-        }
-      }
-    }
-  }
-  return(nhits);
-}
 /*------------------------------------------------------------*/
 STATSUMENTRY *LoadStatSumFile(char *fname, int *nsegid)
 {
@@ -148,6 +148,18 @@ OPTIONS
     target vertex. If a target vertex has multiple source vertices, then the
     source values are averaged together. It does not seem to make much difference.
 
+  --reg-op file
+  --reg-op-cache
+
+    The mapping between the source and target registration surfaces is
+    computed once as a sparse resampling operator. With --reg-op, the
+    operator is read from file if it exists and was made from the same
+    registration surfaces, mapmethod and --jac setting; otherwise it is
+    computed and saved to file. --reg-op-cache does the same with a file
+    kept next to the source surfreg, named after the target subject, hemi,
+    surfreg and mapmethod. Results are identical to computing the mapping
+    from scratch. This speeds up mapping many inputs to the same target.
+
   --fwhm-src fwhmsrc
   --fwhm-trg fwhmtrg (can also use --fwhm)
 
@@ -367,6 +379,7 @@ static void print_version(void) ;
 static void argnerr(char *option, int n);
 static void dump_options(FILE *fp);
 static int  singledash(char *flag);
+static int  RegOpCachePath(char *path);
 int GetNVtxsFromWFile(const char *wfile);
 int GetICOOrderFromValFile(const char *filename, const char *fmt);
 int GetNVtxsFromValFile(const char *filename, const char *fmt);
@@ -451,6 +464,8 @@ char tmpstr[2000];
 int ReverseMapFlag = 0;
 int cavtx = 0; /* command-line vertex -- for debugging */
 int jac = 0;
+char *RegOpFile = NULL; // resampling operator to load or save
+int RegOpCache = 0;     // keep the resampling operator next to the source reg
 
 MRI *sphdist;
 
@@ -1042,7 +1057,33 @@ int main(int argc, char **argv)
       MRIS *SurfRegList[2];
       SurfRegList[0] = SrcSurfReg;
       SurfRegList[1] = TrgSurfReg;
-      TrgVals = MRISapplyReg(SrcVals, SurfRegList, 2, ReverseMapFlag,jac,UseHash);
+      // Build the source-to-target resampling operator, or reuse one
+      // saved by a previous run with the same registration surfaces
+      MRIS_REG_OP *RegOp = NULL;
+      char RegOpPath[4000];
+      RegOpPath[0] = '\0';
+      if(RegOpFile) strcpy(RegOpPath,RegOpFile);
+      else if(RegOpCache && RegOpCachePath(RegOpPath) != 0) RegOpPath[0] = '\0';
+      if(RegOpPath[0] != '\0'){
+	RegOp = MRISregOpRead(RegOpPath);
+	if(RegOp && !MRISregOpMatches(RegOp,SurfRegList,2,ReverseMapFlag,jac,UseHash)){
+	  printf("Resampling operator %s does not match these surfaces, rebuilding\n",RegOpPath);
+	  MRISregOpFree(&RegOp);
+	}
+	if(RegOp) printf("Read resampling operator %s\n",RegOpPath);
+      }
+      if(RegOp == NULL){
+	RegOp = MRISapplyRegOp(SurfRegList, 2, ReverseMapFlag,jac,UseHash);
+	if(RegOp == NULL) exit(1);
+	if(RegOpPath[0] != '\0'){
+	  printf("Saving resampling operator to %s\n",RegOpPath);
+	  if(MRISregOpWrite(RegOp,RegOpPath) != 0)
+	    printf("WARNING: could not save resampling operator %s\n",RegOpPath);
+	}
+      }
+      TrgVals = MRISregOpApply(RegOp, SrcVals, NULL);
+      MRISregOpFree(&RegOp);
+      if(TrgVals == NULL) exit(1);
     }
 
   } else {
@@ -1309,6 +1350,14 @@ static int parse_commandline(int argc, char **argv)
       SynthOnes = 1;
     } else if (!strcasecmp(option, "--jac")) {
       jac = 1;
+    } else if (!strcasecmp(option, "--reg-op")) {
+      if (nargc < 1) {
+        argnerr(option,1);
+      }
+      RegOpFile = pargv[0];
+      nargsused = 1;
+    } else if (!strcasecmp(option, "--reg-op-cache")) {
+      RegOpCache = 1;
     } else if (!strcasecmp(option, "--norm-var")) {
       DoNormVar = 1;
     } else if (!strcasecmp(option, "--split")) {
@@ -1874,6 +1923,8 @@ static void print_usage(void)
   printf("   --srcsurfreg source surface registration (sphere.reg)  \n");
   printf("   --trgsurfreg target surface registration (sphere.reg)  \n");
   printf("   --mapmethod  nnfr or nnf\n");
+  printf("   --reg-op file : load (or build and save) the resampling operator\n");
+  printf("   --reg-op-cache : keep the resampling operator next to the source surfreg\n");
   printf("   --frame      save only nth frame (with --trg_type paint)\n");
   printf("   --fwhm-src fwhmsrc: smooth the source to fwhmsrc\n");
   printf("   --fwhm-trg fwhmtrg: smooth the target to fwhmtrg\n");
@@ -2036,6 +2087,18 @@ printf("    'holes'). If nnfr is chosen, then each hole is assigned to the close
 printf("    target vertex. If a target vertex has multiple source vertices, then the\n");
 printf("    source values are averaged together. It does not seem to make much difference.\n");
 printf("\n");
+printf("  --reg-op file\n");
+printf("  --reg-op-cache\n");
+printf("\n");
+printf("    The mapping between the source and target registration surfaces is\n");
+printf("    computed once as a sparse resampling operator. With --reg-op, the\n");
+printf("    operator is read from file if it exists and was made from the same\n");
+printf("    registration surfaces, mapmethod and --jac setting; otherwise it is\n");
+printf("    computed and saved to file. --reg-op-cache does the same with a file\n");
+printf("    kept next to the source surfreg, named after the target subject, hemi,\n");
+printf("    surfreg and mapmethod. Results are identical to computing the mapping\n");
+printf("    from scratch. This speeds up mapping many inputs to the same target.\n");
+printf("\n");
 printf("  --fwhm-src fwhmsrc\n");
 printf("  --fwhm-trg fwhmtrg (can also use --fwhm)\n");
 printf("\n");
@@ -2217,6 +2280,8 @@ static void dump_options(FILE *fp)
   fprintf(fp,"label-trg  = %s\n",LabelFile);
   fprintf(fp,"OKToRevFaceOrder  = %d\n",OKToRevFaceOrder);
   fprintf(fp,"UseDualHemi = %d\n",UseDualHemi);
+  if(RegOpFile) fprintf(fp,"reg-op     = %s\n",RegOpFile);
+  fprintf(fp,"reg-op-cache = %d\n",RegOpCache);
 
   return;
 }
@@ -2237,6 +2302,34 @@ static void argnerr(char *option, int n)
   exit(-1);
 }
 /* --------------------------------------------- */
+/* Name of the cached resampling operator, kept in the surf dir of the
+   source subject (or of the target subject when the source is ico) */
+static int RegOpCachePath(char *path)
+{
+  const char *subject;
+  char srcname[1000], trgname[1000];
+  if(strcmp(srcsubject,"ico")) {
+    subject = srcsubject;
+    if(UseDualHemi) sprintf(srcname,"%s.%s.%s",srchemi,trghemi,srcsurfregfile);
+    else            sprintf(srcname,"%s.%s",srchemi,srcsurfregfile);
+  }
+  else if(strcmp(trgsubject,"ico")) {
+    subject = trgsubject;
+    sprintf(srcname,"%s.ico%d",trghemi,SrcIcoOrder);
+  }
+  else {
+    printf("WARNING: no subject dir to cache the resampling operator in\n");
+    return(1);
+  }
+  if(strcmp(trgsubject,"ico"))
+    sprintf(trgname,"%s.%s.%s",trgsubject,trghemi,trgsurfregfile);
+  else
+    sprintf(trgname,"ico%d",TrgIcoOrder);
+  sprintf(path,"%s/%s/surf/%s.%s.%s%s%s.regop",SUBJECTS_DIR,subject,srcname,
+          trgname,mapmethod,jac ? ".jac" : "", UseHash ? "" : ".nohash");
+  return(0);
+}
+/* --------------------------------------------- */
 static void check_options(void)
 {
   if (srcsubject == NULL) {
@@ -241,13 +241,21 @@ int main(int argc, char *argv[]) {
   }
   else LabelSurf = SurfReg[nsurfs-1];
 
-  // Apply registration to source
-  TrgVal = MRISapplyReg(SrcVal, SurfReg, nsurfs, ReverseMapFlag, DoJac, UseHash);
+  // Apply registration to source. The mapping is computed once and
+  // applied to both the values and the label stats.
+  if(SrcVal->width != SurfReg[0]->nvertices) {
+    printf("ERROR: source has %d vertices, registration has %d\n",SrcVal->width,SurfReg[0]->nvertices);
+    exit(1);
+  }
+  MRIS_REG_OP *RegOp = MRISapplyRegOp(SurfReg, nsurfs, ReverseMapFlag, DoJac, UseHash);
+  if(RegOp == NULL) exit(1);
+  TrgVal = MRISregOpApply(RegOp, SrcVal, NULL);
   if(TrgVal == NULL) exit(1);
   if(SrcLabelStat) {
-    TrgLabelStat = MRISapplyReg(SrcLabelStat, SurfReg, nsurfs, ReverseMapFlag, DoJac, UseHash);
+    TrgLabelStat = MRISregOpApply(RegOp, SrcLabelStat, NULL);
     if(TrgLabelStat == NULL) exit(1);
   }
+  MRISregOpFree(&RegOp);
 
   // Save output
   if(AnnotFile){
@@ -94,8 +94,10 @@ EDB;
 
 #define MAXEDB  100
 
-static int stackPtr = -1;
-static EDB EDBStack[MAXEDB];
+/* The stack is per thread so that DICOM files can be parsed
+   concurrently without CTN_USE_THREADS, eg, by LoadSiemensSeriesInfo() */
+static __thread int stackPtr = -1;
+static __thread EDB EDBStack[MAXEDB];
 static void (*ErrorCallback) (CONDITION, const char*) = NULL;
 static void dumpstack(FILE * fp);
 
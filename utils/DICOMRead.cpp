@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/timeb.h>
 #include <sys/types.h>
@@ -34,6 +35,10 @@ void *malloc(size_t size);
 
 #include <math.h>
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "mri.h"
 
 #include "diag.h"
@@ -43,6 +48,7 @@ void *malloc(size_t size);
 #include "macros.h"  // DEGREES
 #include "mosaic.h"
 #include "mri_identify.h"
+#include "romp_support.h"
 
 #include "dcm2niix_fswrapper.h"
 
@@ -53,6 +59,41 @@ void *malloc(size_t size);
 #undef _DICOMRead_SRC
 
 static int DCMPrintCond(CONDITION cond);
+
+/* The Siemens ASCII header of one file, read once so that any number
+   of tags can be looked up without reopening the file. ExLines are the
+   lines of all the ASCCONV blocks as SiemensAsciiTagEx() sees them,
+   Lines are the lines of the first block as SiemensAsciiTag() sees them. */
+typedef struct
+{
+  std::vector<std::string> ExLines;
+  std::vector<std::string> Lines;
+} SDCM_ASCII_HEADER;
+
+static DCM_ELEMENT *GetElementFromObject(DCM_OBJECT **object, long grpid, long elid);
+static DCM_OBJECT *sdcmOpenObject(const char *fname);
+static int sdcmIsSiemensObject(DCM_OBJECT **object, const char *dcmfile);
+static int sdcmLoadAsciiHeader(const char *dcmfile, SDCM_ASCII_HEADER *ascii);
+static char *sdcmAsciiHeaderTag(const SDCM_ASCII_HEADER *ascii, const char *TagString, int Ex);
+static int dcmGetVolResFromObject(
+    DCM_OBJECT **object, float *ColRes, float *RowRes, float *SliceRes, long *pSliceResElTag1);
+static int dcmGetNRowsFromObject(DCM_OBJECT **object, const char *dcmfile);
+static int dcmGetNColsFromObject(DCM_OBJECT **object);
+static int dcmImageDirCosFromObject(
+    DCM_OBJECT **object, float *Vcx, float *Vcy, float *Vcz, float *Vrx, float *Vry, float *Vrz);
+static int dcmImagePositionFromObject(DCM_OBJECT **object, float *x, float *y, float *z);
+static int sdcmSliceDirCosFromAscii(
+    const SDCM_ASCII_HEADER *ascii, float *Vsx, float *Vsy, float *Vsz, int *pSliceDirCosPresent);
+static int sdcmIsMosaicFromObject(DCM_OBJECT **object,
+                                  const SDCM_ASCII_HEADER *ascii,
+                                  const char *dcmfile,
+                                  int *pNcols,
+                                  int *pNrows,
+                                  int *pNslices,
+                                  int *pNframes,
+                                  long *pSliceResElTag1);
+static int sdcmReadFileInfo(
+    const char *dcmfile, SDCMFILEINFO **psdcmfi, int *pSeriesNo, int *pSliceDirCosPresent, long *pSliceResElTag1);
 void *ReadDICOMImage2(int nfiles, DICOMInfo **aDicomInfo, int startIndex);
 
 static BOOL IsTagPresent[NUMBEROFTAGS];
@@ -1164,6 +1205,31 @@ MATRIX *sdcmAutoAlignMatrix(const char *dcmfile)
 DCM_ELEMENT *GetElementFromFile(const char *dicomfile, long grpid, long elid)
 {
   DCM_OBJECT *object = 0;
+  DCM_ELEMENT *element;
+
+  object = GetObjectFromFile(dicomfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+
+  element = GetElementFromObject(&object, grpid, elid);
+  DCM_CloseObject(&object);
+  if (element == NULL) {
+    return (NULL);
+  }
+
+  COND_PopCondition(1); /********************************/
+
+  return (element);
+}
+/*---------------------------------------------------------------
+  GetElementFromObject() - same as GetElementFromFile() but gets
+  the element from an object that is already open, so that any
+  number of elements can be read with a single parse of the file.
+  Returns NULL upon failure.
+  ---------------------------------------------------------------*/
+static DCM_ELEMENT *GetElementFromObject(DCM_OBJECT **object, long grpid, long elid)
+{
   CONDITION cond;
   DCM_ELEMENT *element;
   DCM_TAG tag;
@@ -1172,33 +1238,87 @@ DCM_ELEMENT *GetElementFromFile(const char *dicomfile, long grpid, long elid)
 
   element = (DCM_ELEMENT *)calloc(1, sizeof(DCM_ELEMENT));
 
-  object = GetObjectFromFile(dicomfile, 0);
-  if (object == NULL) {
-    exit(1);
-  }
-
   tag = DCM_MAKETAG(grpid, elid);
-  cond = DCM_GetElement(&object, tag, element);
+  cond = DCM_GetElement(object, tag, element);
   if (cond != DCM_NORMAL) {
-    DCM_CloseObject(&object);
     free(element);
     return (NULL);
   }
   AllocElementData(element);
-  cond = DCM_GetElementValue(&object, element, &rtnLength, &Ctx);
+  cond = DCM_GetElementValue(object, element, &rtnLength, &Ctx);
   /* Does Ctx have to be freed? */
   if (cond != DCM_NORMAL) {
-    DCM_CloseObject(&object);
     FreeElementData(element);
     free(element);
     return (NULL);
   }
-  DCM_CloseObject(&object);
-
-  COND_PopCondition(1); /********************************/
 
   return (element);
 }
+/*---------------------------------------------------------------
+  sdcmOpenObject() - opens a file as a DICOM object trying the same
+  formats as IsDICOM() and GetObjectFromFile(), but opens the file
+  only once. Returns NULL (without printing anything) if the file
+  is not a DICOM file. Unlike IsDICOM(), it keeps no static state,
+  so it can be called from several threads at once.
+  ---------------------------------------------------------------*/
+static DCM_OBJECT *sdcmOpenObject(const char *fname)
+{
+  static const unsigned long formats[4] = {
+      DCM_PART10FILE, DCM_ORDERLITTLEENDIAN, DCM_ORDERBIGENDIAN, DCM_FORMATCONVERSION};
+  DCM_OBJECT *object = 0;
+  CONDITION cond = DCM_NORMAL;
+  FILE *fp;
+  int n;
+
+  fp = fopen(fname, "r");
+  if (fp == NULL) {
+    return (NULL);
+  }
+  fclose(fp);
+  if (fio_IsDirectory(fname)) {
+    return (NULL);
+  }
+
+  COND_PopCondition(1);
+  for (n = 0; n < 4; n++) {
+    cond = DCM_OpenFile(fname, formats[n] | DCM_ACCEPTVRMISMATCH, &object);
+    if (cond == DCM_NORMAL) {
+      break;
+    }
+    DCM_CloseObject(&object);
+  }
+  COND_PopCondition(1);
+  if (cond != DCM_NORMAL) {
+    return (NULL);
+  }
+
+  return (object);
+}
+/*---------------------------------------------------------------
+  sdcmIsSiemensObject() - same as IsSiemensDICOM() for an object
+  that is already open.
+  ---------------------------------------------------------------*/
+static int sdcmIsSiemensObject(DCM_OBJECT **object, const char *dcmfile)
+{
+  DCM_ELEMENT *e;
+  int IsSiemens;
+
+  e = GetElementFromObject(object, 0x8, 0x70);
+  if (e == NULL) {
+    printf(
+        "WARNING: searching dicom file %s for "
+        "Manufacturer tag 0x8, 0x70\n",
+        dcmfile);
+    printf("WARNING: the result could be a mess.\n");
+    return (0);
+  }
+  IsSiemens = (strcmp(e->d.string, "SIEMENS") == 0 || strcmp(e->d.string, "SIEMENS ") == 0);
+  FreeElementData(e);
+  free(e);
+
+  return (IsSiemens);
+}
 /*---------------------------------------------------------------
   GetObjectFromFile() - gets an object from a DICOM file. Returns
   a pointer to the object (or NULL upon failure).
@@ -1810,6 +1930,153 @@ char *SiemensAsciiTag(const char *dcmfile, const char *TagString, int flag)
 
   return (VariableValue);
 }
+/*-----------------------------------------------------------------
+  sdcmLoadAsciiHeader() - reads the Siemens ASCII header of a file
+  into ascii so that tags can be looked up with sdcmAsciiHeaderTag()
+  without opening the file again. The file is read in-process:
+  ExLines are the runs of at least 4 printable characters that the
+  unix strings command would print, cut into lines the same way that
+  SiemensAsciiTagEx() reads them back, and kept only within ASCCONV
+  blocks. Lines are the lines that SiemensAsciiTag() reads from the
+  first block. Unlike those two functions, this keeps no static state
+  and does not fork, so it can be called from several threads.
+  Returns 1 if the file could not be opened (ascii is then empty).
+  -----------------------------------------------------------------*/
+static int sdcmLoadAsciiHeader(const char *dcmfile, SDCM_ASCII_HEADER *ascii)
+{
+  const char *BeginStr = "### ASCCONV BEGIN";
+  const char *EndStr = "### ASCCONV END ###";
+  std::vector<char> buf;
+  char chunk[65536];
+  size_t nbuf, n, i, j, k;
+  int startOfAscii;
+  FILE *fp;
+
+  ascii->ExLines.clear();
+  ascii->Lines.clear();
+
+  fp = fopen(dcmfile, "r");
+  if (fp == NULL) {
+    printf("ERROR: could not open dicom file %s\n", dcmfile);
+    return (1);
+  }
+  while ((n = fread(chunk, sizeof(char), sizeof(chunk), fp)) > 0) {
+    buf.insert(buf.end(), chunk, chunk + n);
+  }
+  fclose(fp);
+  nbuf = buf.size();
+
+  /* Runs of printable characters as printed by strings, read back
+     with fgets() into a 1024 char buffer */
+  startOfAscii = 0;
+  for (i = 0; i < nbuf; i = j) {
+    for (j = i; j < nbuf && (buf[j] == '\t' || (buf[j] >= 32 && buf[j] <= 126)); j++)
+      ;
+    if (j == i) {
+      j++;
+      continue;
+    }
+    if (j - i < 4) {
+      continue;
+    }
+    std::string run(&buf[i], j - i);
+    run += '\n';
+    for (k = 0; k < run.size();) {
+      std::string line = run.substr(k, 1023);
+      k += line.size();
+      if (line[line.size() - 1] == '\n') {
+        line.erase(line.size() - 1);
+      }
+      if (strncmp(line.c_str(), BeginStr, 17) == 0) {
+        startOfAscii = 1;
+      }
+      else if (strncmp(line.c_str(), EndStr, 19) == 0) {
+        startOfAscii = 0;
+      }
+      if (startOfAscii) {
+        ascii->ExLines.push_back(line);
+      }
+    }
+  }
+
+  /* The lines of the first block as read with fgets() into a 4000
+     char buffer, starting at the first match of the BeginStr */
+  for (i = 0; i + 17 <= nbuf; i++) {
+    if (memcmp(&buf[i], BeginStr, 17) == 0) {
+      break;
+    }
+  }
+  if (i + 17 > nbuf) {
+    return (0);
+  }
+  while (i < nbuf) {
+    for (j = i; j < nbuf && j - i < 3999;) {
+      if (buf[j++] == '\n') {
+        break;
+      }
+    }
+    std::string line(&buf[i], j - i);
+    i = j;
+    if (strncmp(line.c_str(), EndStr, 19) == 0) {
+      break;
+    }
+    ascii->Lines.push_back(line);
+  }
+
+  return (0);
+}
+/*-----------------------------------------------------------------
+  sdcmAsciiHeaderTag() - looks up TagString in an ASCII header read
+  with sdcmLoadAsciiHeader(). If Ex=1, the result is the same as
+  that of SiemensAsciiTagEx(), otherwise it is the same as that of
+  SiemensAsciiTag(). Returns NULL if there is no match.
+  -----------------------------------------------------------------*/
+static char *sdcmAsciiHeaderTag(const SDCM_ASCII_HEADER *ascii, const char *TagString, int Ex)
+{
+  char VariableName[4000], tmpstr2[4000];
+  char *VariableValue = NULL;
+  unsigned int i;
+
+#ifdef Darwin
+  Ex = 0;
+#endif
+  if (getenv("USE_SIEMENSASCIITAG")) {
+    Ex = 0;
+  }
+
+  if (Ex) {
+    /* The last match in any of the blocks */
+    for (i = 0; i < ascii->ExLines.size(); i++) {
+      VariableName[0] = 0;
+      sscanf(ascii->ExLines[i].c_str(), "%s %*s %*s", VariableName);
+      if (VariableName[0] && (strcmp(VariableName, TagString) == 0)) {
+        tmpstr2[0] = 0;
+        sscanf(ascii->ExLines[i].c_str(), "%*s %*s %s", tmpstr2);
+        if (VariableValue) {
+          free(VariableValue);
+        }
+        VariableValue = (char *)calloc(strlen(tmpstr2) + 17, sizeof(char));
+        memmove(VariableValue, tmpstr2, strlen(tmpstr2));
+      }
+    }
+    return (VariableValue);
+  }
+
+  /* The first match in the first block */
+  for (i = 0; i < ascii->Lines.size(); i++) {
+    VariableName[0] = 0;
+    sscanf(ascii->Lines[i].c_str(), "%s %*s %*s", VariableName);
+    if (strcmp(VariableName, TagString) == 0) {
+      tmpstr2[0] = 0;
+      sscanf(ascii->Lines[i].c_str(), "%*s %*s %s", tmpstr2);
+      VariableValue = (char *)calloc(strlen(tmpstr2) + 1, sizeof(char));
+      memmove(VariableValue, tmpstr2, strlen(tmpstr2));
+      break;
+    }
+  }
+
+  return (VariableValue);
+}
 /*-----------------------------------------------------------------------
   dcmGetVolRes - Gets the volume resolution (mm) from a DICOM File. The
   column and row resolution is obtained from tag (28,30). This tag is stored
@@ -1819,6 +2086,27 @@ char *SiemensAsciiTag(const char *dcmfile, const char *TagString, int flag)
   Author: Douglas N. Greve, 9/6/2001
   -----------------------------------------------------------------------*/
 int dcmGetVolRes(const char *dcmfile, float *ColRes, float *RowRes, float *SliceRes)
+{
+  DCM_OBJECT *object;
+  int err;
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  err = dcmGetVolResFromObject(&object, ColRes, RowRes, SliceRes, &SliceResElTag1);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (err);
+}
+/*-----------------------------------------------------------------------
+  dcmGetVolResFromObject - same as dcmGetVolRes() for an object that is
+  already open. If AutoSliceResElTag is set, the tag that is determined
+  from the object is put in *pSliceResElTag1 instead of the global.
+  -----------------------------------------------------------------------*/
+static int dcmGetVolResFromObject(
+    DCM_OBJECT **object, float *ColRes, float *RowRes, float *SliceRes, long *pSliceResElTag1)
 {
   DCM_ELEMENT *e;
   char *s;
@@ -1828,7 +2116,7 @@ int dcmGetVolRes(const char *dcmfile, float *ColRes, float *RowRes, float *Slice
 
   /* Load the Pixel Spacing - this is a string of the form:
      ColRes\RowRes   */
-  e = GetElementFromFile(dcmfile, 0x28, 0x30);
+  e = GetElementFromObject(object, 0x28, 0x30);
   if (e == NULL) {
     return (1);
   }
@@ -1847,6 +2135,8 @@ int dcmGetVolRes(const char *dcmfile, float *ColRes, float *RowRes, float *Slice
     }
   }
   if (slash_not_found) {
+    FreeElementData(e);
+    free(e);
     return (1);
   }
 
@@ -1855,54 +2145,41 @@ int dcmGetVolRes(const char *dcmfile, float *ColRes, float *RowRes, float *Slice
   FreeElementData(e);
   free(e);
 
-  /*E* // Load the Spacing Between Slices
-    e = GetElementFromFile(dcmfile, 0x18, 0x88);
-    if(e == NULL){
-    // If 18,88 does not exist, load the slice thickness
-    e = GetElementFromFile(dcmfile, 0x18, 0x50);
-    if(e == NULL) return(1);
-    }
-    sscanf(e->d.string,"%f",SliceRes);
-    FreeElementData(e); free(e);
-  */
-
   if (AutoSliceResElTag) {
     printf("Automatically determining SliceResElTag\n");
-    e = GetElementFromFile(dcmfile, 0x18, 0x23);
+    e = GetElementFromObject(object, 0x18, 0x23);
     if (e != NULL) {
       if (strcmp(e->d.string, "3D") == 0)
-        SliceResElTag1 = 0x50;
+        *pSliceResElTag1 = 0x50;
       else
-        SliceResElTag1 = 0x88;
+        *pSliceResElTag1 = 0x88;
+      FreeElementData(e);
+      free(e);
     }
     else
       printf("Tag 18,23 is null, cannot automatically determine SliceResElTag\n");
-    printf("SliceResElTag order is %lx then %lx\n", SliceResElTag1, SliceResElTag2);
+    printf("SliceResElTag order is %lx then %lx\n", *pSliceResElTag1, SliceResElTag2);
   }
   /* By default, the slice resolution is determined from 18,88. If
      that does not exist, then 18,50 is used. For siemens mag res
      angiogram (MRAs), 18,50 must be used first */
-  e = GetElementFromFile(dcmfile, 0x18, SliceResElTag1);
+  e = GetElementFromObject(object, 0x18, *pSliceResElTag1);
   if (e == NULL)
     tag_not_found = 1;
   else {
     sscanf(e->d.string, "%f", SliceRes);
-    if (*SliceRes == 0) {
-      tag_not_found = 1;  // tag found but was zero
-      FreeElementData(e);
-      free(e);
-    }
+    if (*SliceRes == 0) tag_not_found = 1;  // tag found but was zero
+    FreeElementData(e);
+    free(e);
   }
   if (tag_not_found) {  // so either no tag or tag was zero
-    e = GetElementFromFile(dcmfile, 0x18, SliceResElTag2);
+    e = GetElementFromObject(object, 0x18, SliceResElTag2);
     if (e == NULL) return (1);  // no tag
     sscanf(e->d.string, "%f", SliceRes);
     FreeElementData(e);
     free(e);
     if (*SliceRes == 0) return (1);  // tag exists but zero
   }
-  // fprintf(stderr, "SliceRes=%f\n",*SliceRes);
-  // FreeElementData(e); free(e);
 
   return (0);
 }
@@ -1936,11 +2213,26 @@ int dcmGetSeriesNo(const char *dcmfile)
   Author: Douglas N. Greve, 9/6/2001
   -----------------------------------------------------------------------*/
 int dcmGetNRows(const char *dcmfile)
+{
+  DCM_OBJECT *object;
+  int NRows;
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  NRows = dcmGetNRowsFromObject(&object, dcmfile);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (NRows);
+}
+static int dcmGetNRowsFromObject(DCM_OBJECT **object, const char *dcmfile)
 {
   DCM_ELEMENT *e;
   int NRows;
 
-  e = GetElementFromFile(dcmfile, 0x28, 0x10);
+  e = GetElementFromObject(object, 0x28, 0x10);
   if (e == NULL) {
     return (-1);
   }
@@ -1964,11 +2256,26 @@ int dcmGetNRows(const char *dcmfile)
   Author: Douglas N. Greve, 9/6/2001
   -----------------------------------------------------------------------*/
 int dcmGetNCols(const char *dcmfile)
+{
+  DCM_OBJECT *object;
+  int NCols;
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  NCols = dcmGetNColsFromObject(&object);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (NCols);
+}
+static int dcmGetNColsFromObject(DCM_OBJECT **object)
 {
   DCM_ELEMENT *e;
   int NCols;
 
-  e = GetElementFromFile(dcmfile, 0x28, 0x11);
+  e = GetElementFromObject(object, 0x28, 0x11);
   if (e == NULL) {
     return (-1);
   }
@@ -1990,6 +2297,22 @@ int dcmGetNCols(const char *dcmfile)
   Author: Douglas N. Greve, 9/10/2001
   -----------------------------------------------------------------------*/
 int dcmImageDirCos(const char *dcmfile, float *Vcx, float *Vcy, float *Vcz, float *Vrx, float *Vry, float *Vrz)
+{
+  DCM_OBJECT *object;
+  int err;
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  err = dcmImageDirCosFromObject(&object, Vcx, Vcy, Vcz, Vrx, Vry, Vrz);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (err);
+}
+static int dcmImageDirCosFromObject(
+    DCM_OBJECT **object, float *Vcx, float *Vcy, float *Vcz, float *Vrx, float *Vry, float *Vrz)
 {
   DCM_ELEMENT *e;
   char *s;
@@ -1999,7 +2322,7 @@ int dcmImageDirCos(const char *dcmfile, float *Vcx, float *Vcy, float *Vcz, floa
 
   /* Load the direction cosines - this is a string of the form:
      Vcx\Vcy\Vcz\Vrx\Vry\Vrz */
-  e = GetElementFromFile(dcmfile, 0x20, 0x37);
+  e = GetElementFromObject(object, 0x20, 0x37);
   if (e == NULL) {
     return (1);
   }
@@ -2015,6 +2338,8 @@ int dcmImageDirCos(const char *dcmfile, float *Vcx, float *Vcy, float *Vcz, floa
   }
 
   if (nbs != 5) {
+    FreeElementData(e);
+    free(e);
     return (1);
   }
 
@@ -2035,15 +2360,6 @@ int dcmImageDirCos(const char *dcmfile, float *Vcx, float *Vcy, float *Vcz, floa
   FreeElementData(e);
   free(e);
 
-  // Not sure why I had this here to begin with.
-  // This tag should indicate HFS (for example).
-  // 0020 0020 CS REL Patient Orientation
-  // e = GetElementFromFile(dcmfile, 0x20, 0x20);
-  // if (e==NULL) return (1);
-  // s = e->d.string;
-  // FreeElementData(e);
-  // free(e);
-
   return (0);
 }
 /*-----------------------------------------------------------------------
@@ -2054,6 +2370,21 @@ int dcmImageDirCos(const char *dcmfile, float *Vcx, float *Vcy, float *Vcz, floa
   Author: Douglas N. Greve, 9/10/2001
   -----------------------------------------------------------------------*/
 int dcmImagePosition(const char *dcmfile, float *x, float *y, float *z)
+{
+  DCM_OBJECT *object;
+  int err;
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  err = dcmImagePositionFromObject(&object, x, y, z);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (err);
+}
+static int dcmImagePositionFromObject(DCM_OBJECT **object, float *x, float *y, float *z)
 {
   DCM_ELEMENT *e;
   char *s;
@@ -2062,7 +2393,7 @@ int dcmImagePosition(const char *dcmfile, float *x, float *y, float *z)
 
   /* Load the Image Position: this is a string of the form:
      x\y\z  */
-  e = GetElementFromFile(dcmfile, 0x20, 0x32);
+  e = GetElementFromObject(object, 0x20, 0x32);
   if (e == NULL) {
     return (1);
   }
@@ -2078,6 +2409,8 @@ int dcmImagePosition(const char *dcmfile, float *x, float *y, float *z)
   }
 
   if (nbs != 2) {
+    FreeElementData(e);
+    free(e);
     return (1);
   }
 
@@ -2109,33 +2442,46 @@ int dcmImagePosition(const char *dcmfile, float *x, float *y, float *z)
   -----------------------------------------------------------------------*/
 int sdcmSliceDirCos(const char *dcmfile, float *Vsx, float *Vsy, float *Vsz)
 {
-  char *tmpstr;
-  float rms;
+  SDCM_ASCII_HEADER ascii;
 
   if (!IsSiemensDICOM(dcmfile)) {
     return (1);
   }
 
-  tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].sNormal.dSag", 0);
+  sdcmLoadAsciiHeader(dcmfile, &ascii);
+  return (sdcmSliceDirCosFromAscii(&ascii, Vsx, Vsy, Vsz, &sliceDirCosPresent));
+}
+/*-----------------------------------------------------------------------
+  sdcmSliceDirCosFromAscii - same as sdcmSliceDirCos() for an ASCII
+  header that has already been read. The presence of the dir cos is
+  put in *pSliceDirCosPresent instead of the static sliceDirCosPresent.
+  -----------------------------------------------------------------------*/
+static int sdcmSliceDirCosFromAscii(
+    const SDCM_ASCII_HEADER *ascii, float *Vsx, float *Vsy, float *Vsz, int *pSliceDirCosPresent)
+{
+  char *tmpstr;
+  float rms;
+
+  tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.asSlice[0].sNormal.dSag", 1);
   if (tmpstr != NULL) {
     sscanf(tmpstr, "%f", Vsx);
     free(tmpstr);
   }
 
-  tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].sNormal.dCor", 0);
+  tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.asSlice[0].sNormal.dCor", 1);
   if (tmpstr != NULL) {
     sscanf(tmpstr, "%f", Vsy);
     free(tmpstr);
   }
 
-  tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].sNormal.dTra", 0);
+  tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.asSlice[0].sNormal.dTra", 1);
   if (tmpstr != NULL) {
     sscanf(tmpstr, "%f", Vsz);
     free(tmpstr);
   }
 
   if (*Vsx == 0 && *Vsy == 0 && *Vsz == 0) {
-    sliceDirCosPresent = 0;
+    *pSliceDirCosPresent = 0;
     return (1);
   }
 
@@ -2150,7 +2496,7 @@ int sdcmSliceDirCos(const char *dcmfile, float *Vsx, float *Vsy, float *Vsz)
   (*Vsy) /= rms;
   (*Vsz) /= rms;
 
-  sliceDirCosPresent = 1;
+  *pSliceDirCosPresent = 1;
 
   return (0);
 }
@@ -2169,6 +2515,38 @@ int sdcmSliceDirCos(const char *dcmfile, float *Vsx, float *Vsy, float *Vsz)
   Author: Douglas N. Greve, 9/6/2001
   -----------------------------------------------------------------------*/
 int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, int *pNframes)
+{
+  DCM_OBJECT *object;
+  SDCM_ASCII_HEADER ascii;
+  int IsMosaic;
+
+  if (!IsSiemensDICOM(dcmfile)) {
+    return (0);
+  }
+
+  object = GetObjectFromFile(dcmfile, 0);
+  if (object == NULL) {
+    exit(1);
+  }
+  sdcmLoadAsciiHeader(dcmfile, &ascii);
+  IsMosaic = sdcmIsMosaicFromObject(&object, &ascii, dcmfile, pNcols, pNrows, pNslices, pNframes, &SliceResElTag1);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (IsMosaic);
+}
+/*-----------------------------------------------------------------------
+  sdcmIsMosaicFromObject() - same as sdcmIsMosaic() for a Siemens object
+  that is already open and its ASCII header.
+  -----------------------------------------------------------------------*/
+static int sdcmIsMosaicFromObject(DCM_OBJECT **object,
+                                  const SDCM_ASCII_HEADER *ascii,
+                                  const char *dcmfile,
+                                  int *pNcols,
+                                  int *pNrows,
+                                  int *pNslices,
+                                  int *pNframes,
+                                  long *pSliceResElTag1)
 {
   DCM_ELEMENT *e;
   char *PhEncDir;
@@ -2180,10 +2558,6 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
   int err, IsMosaic;
   char *tmpstr;
 
-  if (!IsSiemensDICOM(dcmfile)) {
-    return (0);
-  }
-
   tmpstr = getenv("SDCM_ISMOSAIC_OVERRIDE");
   if (tmpstr != NULL) {
     sscanf(tmpstr, "%d", &IsMosaic);
@@ -2195,7 +2569,7 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
 
   /* Get the phase encode direction: should be COL or ROW */
   /* COL means that each row is a different phase encode (??)*/
-  e = GetElementFromFile(dcmfile, 0x18, 0x1312);
+  e = GetElementFromObject(object, 0x18, 0x1312);
   if (e == NULL) {
     return (0);
   }
@@ -2203,12 +2577,12 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
   FreeElementData(e);
   free(e);
 
-  Nrows = dcmGetNRows(dcmfile);
+  Nrows = dcmGetNRowsFromObject(object, dcmfile);
   if (Nrows == -1) {
     return (0);
   }
 
-  Ncols = dcmGetNCols(dcmfile);
+  Ncols = dcmGetNColsFromObject(object);
   if (Ncols == -1) {
     return (0);
   }
@@ -2217,7 +2591,7 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
    * NumberOfImagesInMosaic field first, which represents the number of slices
    * in the run. Note that mosaics are always square, i.e. filled with empty
    * slices at the end. */
-  e = GetElementFromFile(dcmfile, 0x19, 0x100a);
+  e = GetElementFromObject(object, 0x19, 0x100a);
   NimagesMosaic = 0;
   if (e != NULL) {
     IsMosaic = 1;
@@ -2225,23 +2599,25 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
     NmosaicSideLen = ceil(sqrt(NimagesMosaic));
     NrowsExp = Nrows / NmosaicSideLen;
     NcolsExp = Ncols / NmosaicSideLen;
+    FreeElementData(e);
+    free(e);
   }
   else {
-    tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].dPhaseFOV", 0);
+    tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.asSlice[0].dPhaseFOV", 1);
     if (tmpstr == NULL) {
       return (0);
     }
     sscanf(tmpstr, "%f", &PhEncFOV);
     free(tmpstr);
 
-    tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].dReadoutFOV", 0);
+    tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.asSlice[0].dReadoutFOV", 1);
     if (tmpstr == NULL) {
       return (0);
     }
     sscanf(tmpstr, "%f", &ReadOutFOV);
     free(tmpstr);
 
-    err = dcmGetVolRes(dcmfile, &ColRes, &RowRes, &SliceRes);
+    err = dcmGetVolResFromObject(object, &ColRes, &RowRes, &SliceRes, pSliceResElTag1);
     if (err) {
       return (-1);
     }
@@ -2286,7 +2662,7 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
         *pNslices = NimagesMosaic;
       }
       else if (tmpstr == NULL) {
-        tmpstr = SiemensAsciiTagEx(dcmfile, "sSliceArray.lSize", 0);
+        tmpstr = sdcmAsciiHeaderTag(ascii, "sSliceArray.lSize", 1);
         if (tmpstr == NULL) {
           return (0);
         }
@@ -2299,7 +2675,7 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
       }
     }
     if (pNframes != NULL) {
-      tmpstr = SiemensAsciiTagEx(dcmfile, "lRepetitions", 0);
+      tmpstr = sdcmAsciiHeaderTag(ascii, "lRepetitions", 1);
       if (tmpstr == NULL) {
         return (0);
       }
@@ -2319,8 +2695,30 @@ int sdcmIsMosaic(const char *dcmfile, int *pNcols, int *pNrows, int *pNslices, i
   pixel data are not loaded.
   ----------------------------------------------------------------*/
 SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
+{
+  SDCMFILEINFO *sdcmfi;
+  int SeriesNo;
+
+  sdcmReadFileInfo(dcmfile, &sdcmfi, &SeriesNo, &sliceDirCosPresent, &SliceResElTag1);
+  return (sdcmfi);
+}
+/*----------------------------------------------------------------
+  sdcmReadFileInfo() - does the work of GetSDCMFileInfo(), parsing
+  the file only once: the DICOM object is opened once and the ASCII
+  header is read once, and everything is taken from those. It keeps
+  no static state, so several files can be read at once, and instead
+  of setting the static sliceDirCosPresent and the global
+  SliceResElTag1 it puts their values for this file into
+  *pSliceDirCosPresent and *pSliceResElTag1. The series number as
+  dcmGetSeriesNo() would return it is put into *pSeriesNo.
+  Returns 0 if ok, 1 if the file is not a Siemens DICOM file, and
+  2 if the info could not be read. *psdcmfi is NULL unless ok.
+  ----------------------------------------------------------------*/
+static int sdcmReadFileInfo(
+    const char *dcmfile, SDCMFILEINFO **psdcmfi, int *pSeriesNo, int *pSliceDirCosPresent, long *pSliceResElTag1)
 {
   DCM_OBJECT *object = 0;
+  SDCM_ASCII_HEADER ascii;
   SDCMFILEINFO *sdcmfi;
   CONDITION cond;
   DCM_TAG tag;
@@ -2333,20 +2731,21 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   double xr, xa, xs, yr, ya, ys, zr, za, zs;
   int DoDWI;
 
-  if (!IsSiemensDICOM(dcmfile)) {
-    return (NULL);
-  }
-
-  sdcmfi = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
+  *psdcmfi = NULL;
+  *pSeriesNo = -1;
 
-  fflush(stdout);
-  fflush(stderr);
-  object = GetObjectFromFile(dcmfile, 0);
-  fflush(stdout);
-  fflush(stderr);
+  object = sdcmOpenObject(dcmfile);
   if (object == NULL) {
-    exit(1);
+    return (1);
+  }
+  if (!sdcmIsSiemensObject(&object, dcmfile)) {
+    DCM_CloseObject(&object);
+    COND_PopCondition(1);
+    return (1);
   }
+  sdcmLoadAsciiHeader(dcmfile, &ascii);
+
+  sdcmfi = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
 
   l = strlen(dcmfile);
   sdcmfi->FileName = (char *)calloc(l + 1, sizeof(char));
@@ -2389,6 +2788,13 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     sdcmfi->ProtocolName = strcpyalloc("PROTOCOL_UNKOWN");
   }
 
+  e = GetElementFromObject(&object, 0x20, 0x11);
+  if (e != NULL) {
+    sscanf(e->d.string, "%d", pSeriesNo);
+    FreeElementData(e);
+    free(e);
+  }
+
   tag = DCM_MAKETAG(0x20, 0x11);
   cond = GetUSFromString(&object, tag, &ustmp);
   if (cond != DCM_NORMAL) {
@@ -2471,9 +2877,12 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   else
     sdcmfi->InversionTime = -1;
 
-  e = GetElementFromFile(dcmfile, 0x28, 0x107);
-  if (e)
+  e = GetElementFromObject(&object, 0x28, 0x107);
+  if (e) {
     sdcmfi->LargestValue = (float)*(e->d.us);
+    FreeElementData(e);
+    free(e);
+  }
   else
     sdcmfi->LargestValue = 0;
 
@@ -2489,15 +2898,15 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   cond = GetDoubleFromString(&object, tag, &dtmp);
   sdcmfi->RepetitionTime = (float)dtmp;
 
-  strtmp = SiemensAsciiTagEx(dcmfile, "lRepetitions", 0);
+  strtmp = sdcmAsciiHeaderTag(&ascii, "lRepetitions", 1);
   if (strtmp != NULL) {
     // This can cause problems with DTI scans if lRepetitions is actually set
     sscanf(strtmp, "%d", &(sdcmfi->lRepetitions));
     free(strtmp);
   }
   else {
-    strtmp = SiemensAsciiTag(dcmfile, "sDiffusion.lDiffDirections", 0);
-    strtmp2 = SiemensAsciiTag(dcmfile, "sWiPMemBlock.alFree[8]", 0);
+    strtmp = sdcmAsciiHeaderTag(&ascii, "sDiffusion.lDiffDirections", 0);
+    strtmp2 = sdcmAsciiHeaderTag(&ascii, "sWiPMemBlock.alFree[8]", 0);
     if (strtmp != NULL && strtmp2 != NULL) {
       sscanf(strtmp, "%d", &nDiffDirections);
       sscanf(strtmp, "%d", &nB0);
@@ -2520,7 +2929,7 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   sdcmfi->NFrames = sdcmfi->lRepetitions + 1;
   /* This is not the last word on NFrames. See sdfiAssignRunNo().*/
 
-  strtmp = SiemensAsciiTagEx(dcmfile, "sSliceArray.lSize", 0);
+  strtmp = sdcmAsciiHeaderTag(&ascii, "sSliceArray.lSize", 1);
   if (strtmp != NULL) {
     sscanf(strtmp, "%d", &(sdcmfi->SliceArraylSize));
     free(strtmp);
@@ -2529,7 +2938,7 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     sdcmfi->SliceArraylSize = 0;
   }
 
-  strtmp = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].dPhaseFOV", 0);
+  strtmp = sdcmAsciiHeaderTag(&ascii, "sSliceArray.asSlice[0].dPhaseFOV", 1);
   if (strtmp != NULL) {
     sscanf(strtmp, "%f", &(sdcmfi->PhEncFOV));
     free(strtmp);
@@ -2538,7 +2947,7 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     sdcmfi->PhEncFOV = 0;
   }
 
-  strtmp = SiemensAsciiTagEx(dcmfile, "sSliceArray.asSlice[0].dReadoutFOV", 0);
+  strtmp = sdcmAsciiHeaderTag(&ascii, "sSliceArray.asSlice[0].dReadoutFOV", 1);
   if (strtmp != NULL) {
     sscanf(strtmp, "%f", &(sdcmfi->ReadoutFOV));
     free(strtmp);
@@ -2547,34 +2956,34 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     sdcmfi->ReadoutFOV = 0;
   }
 
-  sdcmfi->NImageRows = dcmGetNRows(dcmfile);
+  sdcmfi->NImageRows = dcmGetNRowsFromObject(&object, dcmfile);
   if (sdcmfi->NImageRows < 0) {
     printf("WARNING: Could not determine number of image rows in %s\n", sdcmfi->FileName);
     sdcmfi->ErrorFlag = 1;
   }
-  sdcmfi->NImageCols = dcmGetNCols(dcmfile);
+  sdcmfi->NImageCols = dcmGetNColsFromObject(&object);
   if (sdcmfi->NImageCols < 0) {
     printf("WARNING: Could not determine number of image cols in %s\n", sdcmfi->FileName);
     sdcmfi->ErrorFlag = 1;
   }
 
-  dcmImagePosition(dcmfile, &(sdcmfi->ImgPos[0]), &(sdcmfi->ImgPos[1]), &(sdcmfi->ImgPos[2]));
+  dcmImagePositionFromObject(&object, &(sdcmfi->ImgPos[0]), &(sdcmfi->ImgPos[1]), &(sdcmfi->ImgPos[2]));
 
-  dcmImageDirCos(dcmfile,
-                 &(sdcmfi->Vc[0]),
-                 &(sdcmfi->Vc[1]),
-                 &(sdcmfi->Vc[2]),
-                 &(sdcmfi->Vr[0]),
-                 &(sdcmfi->Vr[1]),
-                 &(sdcmfi->Vr[2]));
+  dcmImageDirCosFromObject(&object,
+                           &(sdcmfi->Vc[0]),
+                           &(sdcmfi->Vc[1]),
+                           &(sdcmfi->Vc[2]),
+                           &(sdcmfi->Vr[0]),
+                           &(sdcmfi->Vr[1]),
+                           &(sdcmfi->Vr[2]));
 
   /* The following may return 1 (Vs[i] = 0 for all i) when there is no
      ASCII header (anonymization?). This is a show-stopper for mosaics.
      For non-mosaics, it is recoverable because we can sort the files
      and compute the slice dir cos from the image position.*/
-  retval = sdcmSliceDirCos(dcmfile, &(sdcmfi->Vs[0]), &(sdcmfi->Vs[1]), &(sdcmfi->Vs[2]));
+  retval = sdcmSliceDirCosFromAscii(&ascii, &(sdcmfi->Vs[0]), &(sdcmfi->Vs[1]), &(sdcmfi->Vs[2]), pSliceDirCosPresent);
 
-  sdcmfi->IsMosaic = sdcmIsMosaic(dcmfile, NULL, NULL, NULL, NULL);
+  sdcmfi->IsMosaic = sdcmIsMosaicFromObject(&object, &ascii, dcmfile, NULL, NULL, NULL, NULL, pSliceResElTag1);
 
   /* If could not get sliceDirCos, then we calculate an initial value.
      This might not be used at all. If it is used, then it is only
@@ -2609,10 +3018,17 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     /* Confirm sign by two files later  */
   }
 
-  dcmGetVolRes(dcmfile, &(sdcmfi->VolRes[0]), &(sdcmfi->VolRes[1]), &(sdcmfi->VolRes[2]));
+  dcmGetVolResFromObject(&object, &(sdcmfi->VolRes[0]), &(sdcmfi->VolRes[1]), &(sdcmfi->VolRes[2]), pSliceResElTag1);
 
   if (sdcmfi->IsMosaic) {
-    sdcmIsMosaic(dcmfile, &(sdcmfi->VolDim[0]), &(sdcmfi->VolDim[1]), &(sdcmfi->VolDim[2]), &(sdcmfi->NFrames));
+    sdcmIsMosaicFromObject(&object,
+                           &ascii,
+                           dcmfile,
+                           &(sdcmfi->VolDim[0]),
+                           &(sdcmfi->VolDim[1]),
+                           &(sdcmfi->VolDim[2]),
+                           &(sdcmfi->NFrames),
+                           pSliceResElTag1);
   }
   else {
     sdcmfi->VolDim[0] = sdcmfi->NImageCols;
@@ -2634,7 +3050,10 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
       printf("ERROR: GetSDCMFileInfo(): dcmGetDWIParams() %d\n", err);
       printf("DICOM File: %s\n", dcmfile);
       printf("break %s:%d\n", __FILE__, __LINE__);
-      return (NULL);
+      FreeSDCMFileInfo(&sdcmfi);
+      DCM_CloseObject(&object);
+      COND_PopCondition(1);
+      return (2);
     }
     if (Gdiag_no > 0)
       printf("GetSDCMFileInfo(): DWI: %s %d %lf %lf %lf %lf\n", dcmfile, err, bval, xbvec, ybvec, zbvec);
@@ -2650,15 +3069,13 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
     sdcmfi->bvecz = 0;
   }
 
-  // cleanup Ascii storage
-  SiemensAsciiTagEx(dcmfile, (char *)0, 1);
-
   cond = DCM_CloseObject(&object);
 
   /* Clear the condition stack to prevent overflow */
   COND_PopCondition(1);
 
-  return (sdcmfi);
+  *psdcmfi = sdcmfi;
+  return (0);
 }
 /*----------------------------------------------------------*/
 int DumpSDCMFileInfo(FILE *fp, SDCMFILEINFO *sdcmfi)
@@ -3058,46 +3475,606 @@ SDCMFILEINFO **ScanSiemensDCMDir(const char *PathName, int *NSDCMFiles)
 
   return (sdcmfi_list);
 }
+/*--------------------------------------------------------------------
+  Siemens DICOM series index. If the environment variable FS_SDCM_INDEX
+  is set (and is not 0), LoadSiemensSeriesInfo() and ScanSiemensSeries()
+  save what they get from each file to the file .fs_sdcm_index in the
+  directory of the series. Later calls take the info of every file
+  whose size and modification time have not changed from the index
+  instead of parsing the file again. The index is ignored when it was
+  made with other settings of the variables that change the info (eg,
+  FS_LOAD_DWI or SliceResElTag1).
+  *------------------------------------------------------------------*/
+#define SDCM_INDEX_FILE ".fs_sdcm_index"
+#define SDCM_INDEX_VERSION 1
+
+#define SDCM_INDEX_NOT_SIEMENS 0  // not a Siemens DICOM file
+#define SDCM_INDEX_SERIESNO 1     // only SeriesNo is valid
+#define SDCM_INDEX_FILEINFO 2     // everything is valid
+
+typedef struct
+{
+  long long size, mtime;
+  int kind;
+  int SeriesNo;            // as returned by dcmGetSeriesNo()
+  int SliceDirCosPresent;  // as set by GetSDCMFileInfo()
+  long SliceResElTag1;     // as set by GetSDCMFileInfo()
+  SDCMFILEINFO info;       // FileName is not kept
+} SDCM_INDEX_ENTRY;
+
+typedef std::map<std::string, SDCM_INDEX_ENTRY> SDCM_INDEX;
+
+static int sdcmIndexEnabled(void)
+{
+  const char *pc = getenv("FS_SDCM_INDEX");
+  return (pc != NULL && strcmp(pc, "0") != 0);
+}
+
+/* The settings that the entries of an index depend on */
+static std::string sdcmIndexSettings(void)
+{
+  const char *envvars[] = {"FS_LOAD_DWI",
+                           "FS_NO_SLICE_SCALE_FACTOR",
+                           "SDCM_ISMOSAIC_OVERRIDE",
+                           "NROWS_OVERRIDE",
+                           "NCOLS_OVERRIDE",
+                           "NSLICES_OVERRIDE",
+                           "USE_SIEMENSASCIITAG",
+                           "FS_dcmGetDWIParamsSiemens_VoxelSpace",
+                           "FS_ALLOW_DWI_SIEMENS_ALT"};
+  std::string settings;
+  char tmpstr[100];
+  const char *pc;
+  unsigned int n;
+
+  for (n = 0; n < sizeof(envvars) / sizeof(envvars[0]); n++) {
+    pc = getenv(envvars[n]);
+    settings += envvars[n];
+    settings += pc ? "=" : "";
+    settings += pc ? pc : "";
+    settings += ";";
+  }
+  sprintf(tmpstr, "SliceResElTag=%lx,%lx,%d", SliceResElTag1, SliceResElTag2, AutoSliceResElTag);
+  settings += tmpstr;
+
+  return (settings);
+}
+
+/* Pointers to all the members of the info that are kept in the index */
+static void sdcmIndexFields(SDCMFILEINFO *p,
+                            std::vector<char **> &strs,
+                            std::vector<int *> &ints,
+                            std::vector<float *> &floats,
+                            std::vector<double *> &doubles)
+{
+  int k;
+
+  char **s[] = {&p->PatientName,
+                &p->StudyDate,
+                &p->StudyTime,
+                &p->SeriesTime,
+                &p->AcquisitionTime,
+                &p->PulseSequence,
+                &p->ProtocolName,
+                &p->PhEncDir,
+                &p->NumarisVer,
+                &p->ScannerModel,
+                &p->TransferSyntaxUID};
+  int *i[] = {&p->EchoNo,
+              &p->SeriesNo,
+              &p->ImageNo,
+              &p->NImageRows,
+              &p->NImageCols,
+              &p->lRepetitions,
+              &p->SliceArraylSize,
+              &p->RunNo,
+              &p->IsMosaic,
+              &p->NFrames,
+              &p->nthDirection,
+              &p->UseSliceScaleFactor,
+              &p->ErrorFlag};
+  float *f[] = {&p->FlipAngle,
+                &p->EchoTime,
+                &p->RepetitionTime,
+                &p->InversionTime,
+                &p->FieldStrength,
+                &p->PhEncFOV,
+                &p->ReadoutFOV,
+                &p->LargestValue};
+  double *d[] = {&p->bValue,
+                 &p->SliceScaleFactor,
+                 &p->bval,
+                 &p->bvecx,
+                 &p->bvecy,
+                 &p->bvecz,
+                 &p->RescaleIntercept,
+                 &p->RescaleSlope};
+
+  strs.assign(s, s + sizeof(s) / sizeof(s[0]));
+  ints.assign(i, i + sizeof(i) / sizeof(i[0]));
+  floats.assign(f, f + sizeof(f) / sizeof(f[0]));
+  doubles.assign(d, d + sizeof(d) / sizeof(d[0]));
+  for (k = 0; k < 3; k++) {
+    ints.push_back(&p->VolDim[k]);
+    floats.push_back(&p->ImgPos[k]);
+    floats.push_back(&p->Vc[k]);
+    floats.push_back(&p->Vr[k]);
+    floats.push_back(&p->Vs[k]);
+    floats.push_back(&p->VolRes[k]);
+    floats.push_back(&p->VolCenter[k]);
+  }
+}
+
+/* Copies src, including the strings. FileName is set to FileName. */
+static SDCMFILEINFO *sdcmCopyFileInfo(const SDCMFILEINFO *src, const char *FileName)
+{
+  std::vector<char **> strs;
+  std::vector<int *> ints;
+  std::vector<float *> floats;
+  std::vector<double *> doubles;
+  SDCMFILEINFO *dst;
+  unsigned int n;
+
+  dst = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
+  *dst = *src;
+  dst->FileName = FileName ? strcpyalloc(FileName) : NULL;
+  sdcmIndexFields(dst, strs, ints, floats, doubles);
+  for (n = 0; n < strs.size(); n++) {
+    if (*strs[n] != NULL) {
+      *strs[n] = strcpyalloc(*strs[n]);
+    }
+  }
+
+  return (dst);
+}
+
+static void sdcmIndexEntryFree(SDCM_INDEX_ENTRY *entry)
+{
+  std::vector<char **> strs;
+  std::vector<int *> ints;
+  std::vector<float *> floats;
+  std::vector<double *> doubles;
+  unsigned int n;
+
+  if (entry->kind != SDCM_INDEX_FILEINFO) {
+    return;
+  }
+  sdcmIndexFields(&entry->info, strs, ints, floats, doubles);
+  for (n = 0; n < strs.size(); n++) {
+    if (*strs[n] != NULL) {
+      free(*strs[n]);
+    }
+    *strs[n] = NULL;
+  }
+  entry->kind = SDCM_INDEX_NOT_SIEMENS;
+}
+
+static void sdcmIndexFree(SDCM_INDEX &index)
+{
+  SDCM_INDEX::iterator it;
+
+  for (it = index.begin(); it != index.end(); ++it) {
+    sdcmIndexEntryFree(&it->second);
+  }
+  index.clear();
+}
+
+/* Strings are stored as length:chars so that they can hold spaces */
+static void sdcmIndexWriteString(FILE *fp, const char *s)
+{
+  if (s == NULL) {
+    s = "";
+  }
+  fprintf(fp, " %d:%s", (int)strlen(s), s);
+}
+
+static char *sdcmIndexReadString(FILE *fp)
+{
+  char *s;
+  int len;
+
+  if (fscanf(fp, " %d:", &len) != 1 || len < 0) {
+    return (NULL);
+  }
+  s = (char *)calloc(len + 1, sizeof(char));
+  if ((int)fread(s, sizeof(char), len, fp) != len) {
+    free(s);
+    return (NULL);
+  }
+
+  return (s);
+}
+
+static int sdcmFileStat(const char *fname, long long *size, long long *mtime)
+{
+  struct stat st;
+
+  if (stat(fname, &st) != 0) {
+    return (1);
+  }
+  *size = (long long)st.st_size;
+#ifdef Darwin
+  *mtime = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  *mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+
+  return (0);
+}
+
+/* The key of a file in the index of dir, or "" if it is not in dir */
+static std::string sdcmIndexKey(const char *dir, const char *fname)
+{
+  std::string key;
+  char *fdir, *fbase;
+
+  fdir = fio_dirname(fname);
+  fbase = fio_basename(fname, NULL);
+  if (strcmp(fdir, dir) == 0) {
+    key = fbase;
+  }
+  free(fdir);
+  free(fbase);
+
+  return (key);
+}
+
+/*--------------------------------------------------------------------
+  sdcmIndexLoad() - loads the index of dir. The index is left empty if
+  there is none, if it cannot be parsed, or if it was made with other
+  settings.
+  *------------------------------------------------------------------*/
+static void sdcmIndexLoad(const char *dir, SDCM_INDEX &index)
+{
+  std::vector<char **> strs;
+  std::vector<int *> ints;
+  std::vector<float *> floats;
+  std::vector<double *> doubles;
+  std::string fname = std::string(dir) + "/" + SDCM_INDEX_FILE;
+  SDCM_INDEX_ENTRY entry;
+  char *name, *settings;
+  int version, ok, nread;
+  unsigned int n;
+  FILE *fp;
+
+  index.clear();
+  fp = fopen(fname.c_str(), "r");
+  if (fp == NULL) {
+    return;
+  }
+
+  if (fscanf(fp, "fs_sdcm_index %d", &version) != 1 || version != SDCM_INDEX_VERSION) {
+    fclose(fp);
+    return;
+  }
+  settings = sdcmIndexReadString(fp);
+  if (settings == NULL || sdcmIndexSettings() != settings) {
+    printf("INFO: ignoring %s, it was made with other settings\n", fname.c_str());
+    free(settings);
+    fclose(fp);
+    return;
+  }
+  free(settings);
+
+  ok = 1;
+  while (ok && (name = sdcmIndexReadString(fp)) != NULL) {
+    memset(&entry, 0, sizeof(entry));
+    nread = fscanf(fp,
+                   "%lld %lld %d %d %d %ld",
+                   &entry.size,
+                   &entry.mtime,
+                   &entry.kind,
+                   &entry.SeriesNo,
+                   &entry.SliceDirCosPresent,
+                   &entry.SliceResElTag1);
+    ok = (nread == 6);
+    if (ok && entry.kind == SDCM_INDEX_FILEINFO) {
+      sdcmIndexFields(&entry.info, strs, ints, floats, doubles);
+      for (n = 0; ok && n < strs.size(); n++) {
+        *strs[n] = sdcmIndexReadString(fp);
+        ok = (*strs[n] != NULL);
+      }
+      for (n = 0; ok && n < ints.size(); n++) {
+        ok = (fscanf(fp, "%d", ints[n]) == 1);
+      }
+      for (n = 0; ok && n < floats.size(); n++) {
+        ok = (fscanf(fp, "%f", floats[n]) == 1);
+      }
+      for (n = 0; ok && n < doubles.size(); n++) {
+        ok = (fscanf(fp, "%lf", doubles[n]) == 1);
+      }
+    }
+    if (ok) {
+      sdcmIndexEntryFree(&index[name]);
+      index[name] = entry;
+    }
+    else {
+      sdcmIndexEntryFree(&entry);
+    }
+    free(name);
+  }
+  fclose(fp);
+
+  if (!ok) {
+    printf("INFO: ignoring %s, it could not be parsed\n", fname.c_str());
+    sdcmIndexFree(index);
+  }
+}
+
+/*--------------------------------------------------------------------
+  sdcmIndexSave() - saves the index of dir. It is written to a temporary
+  file that is then renamed, so a concurrent reader never sees half an
+  index. Nothing is done if the directory cannot be written.
+  *------------------------------------------------------------------*/
+static void sdcmIndexSave(const char *dir, SDCM_INDEX &index)
+{
+  std::vector<char **> strs;
+  std::vector<int *> ints;
+  std::vector<float *> floats;
+  std::vector<double *> doubles;
+  std::string fname = std::string(dir) + "/" + SDCM_INDEX_FILE;
+  char tmpfname[5000];
+  SDCM_INDEX::iterator it;
+  unsigned int n;
+  FILE *fp;
+
+  sprintf(tmpfname, "%s.%d", fname.c_str(), (int)getpid());
+  fp = fopen(tmpfname, "w");
+  if (fp == NULL) {
+    printf("INFO: cannot write %s, not saving the index\n", tmpfname);
+    return;
+  }
+
+  fprintf(fp, "fs_sdcm_index %d", SDCM_INDEX_VERSION);
+  sdcmIndexWriteString(fp, sdcmIndexSettings().c_str());
+  fprintf(fp, "\n");
+  for (it = index.begin(); it != index.end(); ++it) {
+    SDCM_INDEX_ENTRY &entry = it->second;
+    sdcmIndexWriteString(fp, it->first.c_str());
+    fprintf(fp,
+            " %lld %lld %d %d %d %ld",
+            entry.size,
+            entry.mtime,
+            entry.kind,
+            entry.SeriesNo,
+            entry.SliceDirCosPresent,
+            entry.SliceResElTag1);
+    if (entry.kind == SDCM_INDEX_FILEINFO) {
+      sdcmIndexFields(&entry.info, strs, ints, floats, doubles);
+      for (n = 0; n < strs.size(); n++) {
+        sdcmIndexWriteString(fp, *strs[n]);
+      }
+      for (n = 0; n < ints.size(); n++) {
+        fprintf(fp, " %d", *ints[n]);
+      }
+      for (n = 0; n < floats.size(); n++) {
+        fprintf(fp, " %.9g", *floats[n]);
+      }
+      for (n = 0; n < doubles.size(); n++) {
+        fprintf(fp, " %.17g", *doubles[n]);
+      }
+    }
+    fprintf(fp, "\n");
+  }
+
+  if (fclose(fp) != 0 || rename(tmpfname, fname.c_str()) != 0) {
+    printf("INFO: could not save %s\n", fname.c_str());
+    unlink(tmpfname);
+  }
+}
+
+/*--------------------------------------------------------------------
+  sdcmIndexLookup() - returns the entry of fname if it has at least the
+  given kind of info (not-Siemens entries always do) and the file has
+  not changed since it was indexed. Otherwise returns NULL. Does not
+  change the index, so it can be called from several threads.
+  *------------------------------------------------------------------*/
+static const SDCM_INDEX_ENTRY *sdcmIndexLookup(const SDCM_INDEX &index, const char *dir, const char *fname, int kind)
+{
+  SDCM_INDEX::const_iterator it;
+  long long size, mtime;
+
+  if (index.empty()) {
+    return (NULL);
+  }
+  it = index.find(sdcmIndexKey(dir, fname));
+  if (it == index.end()) {
+    return (NULL);
+  }
+  if (it->second.kind != SDCM_INDEX_NOT_SIEMENS && it->second.kind < kind) {
+    return (NULL);
+  }
+  if (sdcmFileStat(fname, &size, &mtime) || size != it->second.size || mtime != it->second.mtime) {
+    return (NULL);
+  }
+
+  return (&it->second);
+}
+
+/*--------------------------------------------------------------------
+  sdcmIndexAdd() - adds (or replaces) the entry of fname. info is copied
+  and may be NULL. Returns 1 if the entry was added.
+  *------------------------------------------------------------------*/
+static int sdcmIndexAdd(SDCM_INDEX &index,
+                        const char *dir,
+                        const char *fname,
+                        int kind,
+                        int SeriesNo,
+                        int SliceDirCosPresent,
+                        long SliceResElTag1,
+                        const SDCMFILEINFO *info)
+{
+  SDCM_INDEX_ENTRY entry;
+  SDCMFILEINFO *copy;
+  std::string key;
+
+  key = sdcmIndexKey(dir, fname);
+  if (key.empty()) {
+    return (0);
+  }
+  memset(&entry, 0, sizeof(entry));
+  if (sdcmFileStat(fname, &entry.size, &entry.mtime)) {
+    return (0);
+  }
+  entry.kind = kind;
+  entry.SeriesNo = SeriesNo;
+  entry.SliceDirCosPresent = SliceDirCosPresent;
+  entry.SliceResElTag1 = SliceResElTag1;
+  if (kind == SDCM_INDEX_FILEINFO) {
+    copy = sdcmCopyFileInfo(info, NULL);
+    entry.info = *copy;
+    free(copy);
+  }
+
+  sdcmIndexEntryFree(&index[key]);
+  index[key] = entry;
+
+  return (1);
+}
+/*--------------------------------------------------------------------
+  sdcmReadSeriesNo() - same as IsSiemensDICOM() followed by
+  dcmGetSeriesNo() but parses the file only once and can be called from
+  several threads. Returns -2 if the file is not a Siemens DICOM file.
+  *------------------------------------------------------------------*/
+static int sdcmReadSeriesNo(const char *dcmfile)
+{
+  DCM_OBJECT *object;
+  DCM_ELEMENT *e;
+  int SeriesNo;
+
+  object = sdcmOpenObject(dcmfile);
+  if (object == NULL) {
+    return (-2);
+  }
+  SeriesNo = -2;
+  if (sdcmIsSiemensObject(&object, dcmfile)) {
+    SeriesNo = -1;
+    e = GetElementFromObject(&object, 0x20, 0x11);
+    if (e != NULL) {
+      sscanf(e->d.string, "%d", &SeriesNo);
+      FreeElementData(e);
+      free(e);
+    }
+  }
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+
+  return (SeriesNo);
+}
 /*--------------------------------------------------------------------
   LoadSiemensSeriesInfo() - loads header info from each of the nList
   files listed in SeriesList. This list is obtained from either
   ReadSiemensSeries() or ScanSiemensSeries().
+
+  Each file is parsed only once, and the files are parsed in parallel.
+  The list that is returned is in the same order as SeriesList, and
+  sliceDirCosPresent and SliceResElTag1 are left as they would have
+  been had the files been read one after the other. See also
+  FS_SDCM_INDEX above.
   Author: Douglas Greve.
   Date: 09/10/2001
   *------------------------------------------------------------------*/
 SDCMFILEINFO **LoadSiemensSeriesInfo(char **SeriesList, int nList)
 {
   SDCMFILEINFO **sdfi_list;
-  int n;
+  SDCM_INDEX index;
+  char *IndexDir = NULL;
+  int n, nDone, UseIndex, IndexChanged, kind;
+  std::vector<int> status(nList, 0), FromIndex(nList, 0), SeriesNo(nList, -1), SliceDirCos(nList, -1);
+  std::vector<long> SliceResTag(nList, SliceResElTag1);
 
   // printf("LoadSiemensSeriesInfo()\n");
 
   sdfi_list = (SDCMFILEINFO **)calloc(nList, sizeof(SDCMFILEINFO *));
 
+  UseIndex = (nList > 0 && sdcmIndexEnabled());
+  if (UseIndex) {
+    IndexDir = fio_dirname(SeriesList[0]);
+    sdcmIndexLoad(IndexDir, index);
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  nDone = 0;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
   for (n = 0; n < nList; n++) {
-    fflush(stdout);
-    fflush(stderr);
+    ROMP_PFLB_begin
+    const SDCM_INDEX_ENTRY *entry = NULL;
+    if (UseIndex) {
+      entry = sdcmIndexLookup(index, IndexDir, SeriesList[n], SDCM_INDEX_FILEINFO);
+    }
+    if (entry != NULL) {
+      FromIndex[n] = 1;
+      if (entry->kind == SDCM_INDEX_NOT_SIEMENS) {
+        status[n] = 1;
+      }
+      else {
+        sdfi_list[n] = sdcmCopyFileInfo(&entry->info, SeriesList[n]);
+        SeriesNo[n] = entry->SeriesNo;
+        SliceDirCos[n] = entry->SliceDirCosPresent;
+        SliceResTag[n] = entry->SliceResElTag1;
+      }
+    }
+    else {
+      status[n] = sdcmReadFileInfo(SeriesList[n], &sdfi_list[n], &SeriesNo[n], &SliceDirCos[n], &SliceResTag[n]);
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp critical(LoadSiemensSeriesInfo)
+#endif
+    exec_progress_callback(nDone++, nList, 0, 1);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
 
-    // printf("%3d %s ---------------\n",n,SeriesList[n]);
-    if (!IsSiemensDICOM(SeriesList[n])) {
-      fprintf(stderr, "ERROR: %s is not a Siemens DICOM File\n", SeriesList[n]);
-      fflush(stderr);
-      free(sdfi_list);
-      return (NULL);
+  if (UseIndex) {
+    IndexChanged = 0;
+    for (n = 0; n < nList; n++) {
+      if (FromIndex[n] || status[n] == 2) {
+        continue;
+      }
+      kind = (status[n] == 0) ? SDCM_INDEX_FILEINFO : SDCM_INDEX_NOT_SIEMENS;
+      IndexChanged |= sdcmIndexAdd(
+          index, IndexDir, SeriesList[n], kind, SeriesNo[n], SliceDirCos[n], SliceResTag[n], sdfi_list[n]);
     }
+    if (IndexChanged) {
+      sdcmIndexSave(IndexDir, index);
+    }
+    sdcmIndexFree(index);
+    free(IndexDir);
+  }
 
-    // printf("Getting file info %s ---------------\n",SeriesList[n]);
-    fflush(stdout);
-    fflush(stderr);
-    sdfi_list[n] = GetSDCMFileInfo(SeriesList[n]);
-    if (sdfi_list[n] == NULL) {
+  /* Report the first failure in list order, as the serial loop did */
+  for (n = 0; n < nList; n++) {
+    if (status[n] == 0) {
+      continue;
+    }
+    if (status[n] == 1) {
+      fprintf(stderr, "ERROR: %s is not a Siemens DICOM File\n", SeriesList[n]);
+    }
+    else {
       fprintf(stderr, "ERROR: reading %s \n", SeriesList[n]);
-      fflush(stderr);
-      free(sdfi_list);
-      return (NULL);
     }
-    exec_progress_callback(n, nList, 0, 1);
+    fflush(stderr);
+    for (n = 0; n < nList; n++) {
+      if (sdfi_list[n] != NULL) {
+        FreeSDCMFileInfo(&sdfi_list[n]);
+      }
+    }
+    free(sdfi_list);
+    return (NULL);
+  }
+
+  /* Each file sets these when it is read, so the last one wins */
+  for (n = 0; n < nList; n++) {
+    if (SliceDirCos[n] >= 0) {
+      sliceDirCosPresent = SliceDirCos[n];
+    }
+    SliceResElTag1 = SliceResTag[n];
   }
+
   fprintf(stderr, "\n");
   fflush(stdout);
   fflush(stderr);
@@ -3198,18 +4175,21 @@ char **ReadSiemensSeries(const char *ListFile, int *nList, const char *dcmfile)
   the same Series Number as the given Siemens DICOM file. Returns a
   list of file names (including dcmfile), including the path. The
   resulting list is of the same form produced by ReadSiemensSeries();
+  The files are tested in parallel, each one parsed only once. See
+  also FS_SDCM_INDEX above.
 
   Author: Douglas Greve.
   Date: 09/25/2001
   *------------------------------------------------------------------*/
 char **ScanSiemensSeries(const char *dcmfile, int *nList)
 {
-  int SeriesNo, SeriesNoTest;
+  int SeriesNo;
   char *PathName;
-  int NFiles, i;
+  int NFiles, i, nDone, UseIndex, IndexChanged, kind;
   struct dirent **NameList;
   char **SeriesList;
   char tmpstr[1000];
+  SDCM_INDEX index;
 
   if (!IsSiemensDICOM(dcmfile)) {
     fprintf(stderr,
@@ -3242,27 +4222,68 @@ char **ScanSiemensSeries(const char *dcmfile, int *nList)
   fprintf(stderr, "INFO: Scanning for Series Number %d\n", SeriesNo);
   fflush(stderr);
 
+  UseIndex = sdcmIndexEnabled();
+  if (UseIndex) {
+    sdcmIndexLoad(PathName, index);
+  }
+
+  /* Series number of each file, -2 if it is not a Siemens DICOM file */
+  std::vector<int> SeriesNoList(NFiles, -2), FromIndex(NFiles, 0);
+  nDone = 0;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 16)
+#endif
+  for (i = 0; i < NFiles; i++) {
+    ROMP_PFLB_begin
+    char fname[1000];
+    const SDCM_INDEX_ENTRY *entry = NULL;
+    sprintf(fname, "%s/%s", PathName, NameList[i]->d_name);
+    if (UseIndex) {
+      entry = sdcmIndexLookup(index, PathName, fname, SDCM_INDEX_SERIESNO);
+    }
+    if (entry != NULL) {
+      FromIndex[i] = 1;
+      SeriesNoList[i] = (entry->kind == SDCM_INDEX_NOT_SIEMENS) ? -2 : entry->SeriesNo;
+    }
+    else {
+      SeriesNoList[i] = sdcmReadSeriesNo(fname);
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp critical(ScanSiemensSeries)
+#endif
+    exec_progress_callback(nDone++, NFiles, 0, 1);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
   /* Alloc enough memory for everyone */
   SeriesList = (char **)calloc(NFiles, sizeof(char *));
   (*nList) = 0;
+  IndexChanged = 0;
   for (i = 0; i < NFiles; i++) {
     sprintf(tmpstr, "%s/%s", PathName, NameList[i]->d_name);
-    // printf("Testing %s ----------------------------------\n",tmpstr);
-    IsSiemensDICOM(tmpstr);
-    if (IsSiemensDICOM(tmpstr)) {
-      SeriesNoTest = dcmGetSeriesNo(tmpstr);
-      if (SeriesNoTest == SeriesNo) {
-        SeriesList[*nList] = (char *)calloc(strlen(tmpstr) + 1 + 8, sizeof(char));
-        memmove(SeriesList[*nList], tmpstr, strlen(tmpstr));
-        // printf("%3d  %s\n",*nList,SeriesList[*nList]);
-        (*nList)++;
-      }
+    if (UseIndex && !FromIndex[i] && !fio_IsDirectory(tmpstr)) {
+      kind = (SeriesNoList[i] == -2) ? SDCM_INDEX_NOT_SIEMENS : SDCM_INDEX_SERIESNO;
+      IndexChanged |= sdcmIndexAdd(index, PathName, tmpstr, kind, SeriesNoList[i], -1, SliceResElTag1, NULL);
+    }
+    if (SeriesNoList[i] == SeriesNo) {
+      SeriesList[*nList] = (char *)calloc(strlen(tmpstr) + 1 + 8, sizeof(char));
+      memmove(SeriesList[*nList], tmpstr, strlen(tmpstr));
+      // printf("%3d  %s\n",*nList,SeriesList[*nList]);
+      (*nList)++;
     }
-    exec_progress_callback(i, NFiles, 0, 1);
   }
   fprintf(stderr, "INFO: found %d files in series\n", *nList);
   fflush(stderr);
 
+  if (UseIndex) {
+    if (IndexChanged) {
+      sdcmIndexSave(PathName, index);
+    }
+    sdcmIndexFree(index);
+  }
+
   // free memory
   while (NFiles--) {
     free(NameList[NFiles]);
@@ -302,6 +302,45 @@ float freadFloat(FILE *fp)
   memcpy(&f, &buf, sizeof(float));
   return (f);
 }
+/*----------------------------------------------------------------
+  freadFloatArray(), freadIntArray() - bulk versions of freadFloat()
+  and freadInt(). Read n big-endian values into v with a single fread()
+  and swap them to host order in one pass over the buffer, rather than
+  one fread() and swap per value. Values that could not be read are set
+  to 0. Return the number of values read.
+  ----------------------------------------------------------------*/
+static void fioSwapBuf4(void *v, size_t n)
+{
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  unsigned int *u = (unsigned int *)v;
+  for (size_t i = 0; i < n; i++) {
+    unsigned int const x = u[i];
+    u[i] = (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+  }
+#endif
+}
+
+size_t freadFloatArray(float *v, size_t n, FILE *fp)
+{
+  size_t const nread = fread(v, sizeof(float), n, fp);
+  if (nread != n) {
+    ErrorPrintf(ERROR_BADFILE, "freadFloatArray: fread failed, read %zu of %zu", nread, n);
+    memset(v + nread, 0, (n - nread) * sizeof(float));
+  }
+  fioSwapBuf4(v, nread);
+  return (nread);
+}
+
+size_t freadIntArray(int *v, size_t n, FILE *fp)
+{
+  size_t const nread = fread(v, sizeof(int), n, fp);
+  if (nread != n) {
+    ErrorPrintf(ERROR_BADFILE, "freadIntArray: fread failed, read %zu of %zu", nread, n);
+    memset(v + nread, 0, (n - nread) * sizeof(int));
+  }
+  fioSwapBuf4(v, nread);
+  return (nread);
+}
 /*----------------------------------------*/
 int fwriteFloat(float f, FILE *fp)
 {
@@ -24,6 +24,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <vector>
+
 double round(double x);
 #include "MRIio_old.h"
 #include "diag.h"
@@ -33,6 +35,7 @@ double round(double x);
 #include "matrix.h"
 #include "mri.h"
 #include "mri2.h"
+#include "mri_iterate.h"
 #include "numerics.h"
 #include "pdf.h"
 #include "randomfields.h"
@@ -120,8 +123,7 @@ and resets DOFAdjust=1.
 MRI *fMRIcovariance(MRI *fmri, int Lag, float DOFAdjust, MRI *mask, MRI *covar)
 {
   int RemoveMean = 0;
-  int DOF, DOFLag, c, r, s, f;
-  double sumv1v2, val1, val2, valmean;
+  int DOF, DOFLag, s;
   MRI *mean = NULL;
 
   if (DOFAdjust < 0) {
@@ -153,27 +155,44 @@ MRI *fMRIcovariance(MRI *fmri, int Lag, float DOFAdjust, MRI *mask, MRI *covar)
 
   if (RemoveMean) mean = MRIframeMean(fmri, NULL);
 
-  valmean = 0;
-  for (c = 0; c < fmri->width; c++) {
-    for (r = 0; r < fmri->height; r++) {
-      for (s = 0; s < fmri->depth; s++) {
-        if (mask) {
-          if (MRIgetVoxVal(mask, c, r, s, 0) < 0.5) {
-            MRIFseq_vox(covar, c, r, s, 0) = 0;
-            continue;
-          }
+  // A row at a time, accumulating all the voxels of the row frame by frame,
+  // so the inner loop runs over contiguous voxels. Each voxel still sums its
+  // frames in order, so the result is the same as voxel by voxel.
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (s = 0; s < fmri->depth; s++) {
+    ROMP_PFLB_begin
+    int const width = fmri->width;
+    std::vector<float> maskrow(width), meanrow(width, 0.0f), row1(width), row2(width);
+    std::vector<double> sumv1v2(width);
+    for (int r = 0; r < fmri->height; r++) {
+      float *covarrow = MRIrow<float>(covar, r, s, 0);
+      int c, f, nmask = width;
+      if (mask) {
+        MRIgetRowVals(mask, r, s, 0, &maskrow[0]);
+        for (nmask = 0, c = 0; c < width; c++) nmask += (maskrow[c] >= 0.5);
+        if (nmask == 0) {
+          for (c = 0; c < width; c++) covarrow[c] = 0;
+          continue;
         }
-        if (RemoveMean) valmean = MRIgetVoxVal(mean, c, r, s, 0);
-        sumv1v2 = 0;
-        for (f = 0; f < fmri->nframes - Lag; f++) {
-          val1 = MRIgetVoxVal(fmri, c, r, s, f);
-          val2 = MRIgetVoxVal(fmri, c, r, s, f + Lag);
-          sumv1v2 += ((val1 - valmean) * (val2 - valmean));
+      }
+      if (RemoveMean) MRIgetRowVals(mean, r, s, 0, &meanrow[0]);
+      for (c = 0; c < width; c++) sumv1v2[c] = 0;
+      for (f = 0; f < fmri->nframes - Lag; f++) {
+        MRIgetRowVals(fmri, r, s, f, &row1[0]);
+        MRIgetRowVals(fmri, r, s, f + Lag, &row2[0]);
+        for (c = 0; c < width; c++) {
+          double const valmean = meanrow[c];
+          sumv1v2[c] += ((row1[c] - valmean) * (row2[c] - valmean));
         }
-        MRIFseq_vox(covar, c, r, s, 0) = sumv1v2 / DOFLag;
       }
+      for (c = 0; c < width; c++) covarrow[c] = (mask && maskrow[c] < 0.5) ? 0 : sumv1v2[c] / DOFLag;
     }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
   if (mean) MRIfree(&mean);
 
@@ -889,6 +908,319 @@ MRI *MRInormWeights(MRI *w, int sqrtFlag, int invFlag, MRI *mask, MRI *wn)
   return (wn);
 }
 
+/*---------------------------------------------------------------------
+  MRIglmBatchable() - returns 1 if MRIglmFitAndTest() can use the
+  batched engine, ie, the design matrix is the same at every voxel
+  (no per-voxel or global weights, per-voxel regressors, or frame
+  mask) and neither fixed-effects nor partial correlation coefficients
+  are needed.
+  Does not depend on pervoxflag, so it can be called before fitting.
+  Setting the FS_GLM_NOBATCH env var forces the voxel-by-voxel path
+  (except when SimOnly is set, which needs the batched engine).
+  --------------------------------------------------------------------*/
+int MRIglmBatchable(MRIGLM *mriglm)
+{
+  int n;
+  GLMMAT *glm = mriglm->glm;
+
+  if (mriglm->w != NULL || mriglm->wg != NULL) return (0);
+  if (mriglm->npvr != 0 || mriglm->FrameMask != NULL) return (0);
+  if (mriglm->yffxvar != NULL) return (0);
+  if (!mriglm->SimOnly && getenv("FS_GLM_NOBATCH") != NULL) return (0);
+  for (n = 0; n < glm->ncontrasts; n++)
+    if (glm->Dt[n] != NULL) return (0);
+  return (1);
+}
+
+/*---------------------------------------------------------------------
+  MRIglmFitAndTestBatch() - batched, multi-threaded version of the
+  voxel loop in MRIglmFitAndTest() for designs that do not vary across
+  voxels. inv(X'*X), C*inv(X'*X)*C' and its inverse are computed once,
+  then the masked voxels are processed in blocks of MRIGLM_BATCH_SIZE
+  with each block fit and tested as dense matrix-matrix products
+  (X'*Y, beta, yhat, gamma). Blocks are spread across threads, each
+  with its own scratch space. The arithmetic mirrors GLMfit() and
+  GLMtest() element for element (same float storage, same double
+  accumulation order), so the output is identical to the per-voxel
+  path. Assumes the output volumes have already been allocated. If
+  mriglm->SimOnly is set, only gamma, F, p, sig, and z are written.
+  --------------------------------------------------------------------*/
+#define MRIGLM_BATCH_SIZE 128
+static int MRIglmFitAndTestBatch(MRIGLM *mriglm)
+{
+  GLMMAT *glm = mriglm->glm;
+  int nc, nr, ns, nf, nreg, ncon, n, nblocks, maxJ;
+  long nmask, nvoxtot;
+  int c, r, s;
+  int *vc, *vr, *vs;
+  MATRIX *iCiXtXCt[GLMMAT_NCONTRASTS_MAX];
+  RFS *rfs;
+  double Xcond = 0;
+
+  nc = mriglm->y->width;
+  nr = mriglm->y->height;
+  ns = mriglm->y->depth;
+  nf = mriglm->y->nframes;
+  nvoxtot = (long)nc * nr * ns;
+  nreg = glm->X->cols;
+  ncon = glm->ncontrasts;
+
+  // Make sure the design-dependent matrices reflect the current X
+  GLMxMatrices(glm);
+  if (mriglm->condsave) Xcond = MatrixConditionNumber(glm->XtX);
+
+  // Get the list of voxels in the mask, in memory order
+  vc = (int *)calloc(nvoxtot, sizeof(int));
+  vr = (int *)calloc(nvoxtot, sizeof(int));
+  vs = (int *)calloc(nvoxtot, sizeof(int));
+  nmask = 0;
+  for (s = 0; s < ns; s++) {
+    for (r = 0; r < nr; r++) {
+      for (c = 0; c < nc; c++) {
+        if (mriglm->mask != NULL) {
+          int m = MRIgetVoxVal(mriglm->mask, c, r, s, 0);  // int as in the voxel loop
+          if (m < 0.5) continue;
+        }
+        if (mriglm->condsave) MRIsetVoxVal(mriglm->cond, c, r, s, 0, Xcond);
+        vc[nmask] = c;
+        vr[nmask] = r;
+        vs[nmask] = s;
+        nmask++;
+      }
+    }
+  }
+
+  if (glm->ill_cond_flag) {
+    // Same X everywhere, so every voxel in the mask is ill-conditioned
+    mriglm->n_ill_cond = nmask;
+    free(vc);
+    free(vr);
+    free(vs);
+    return (0);
+  }
+
+  // inv(C*inv(X'*X)*C') does not depend on the data. NULL if singular.
+  maxJ = 1;
+  for (n = 0; n < ncon; n++) {
+    iCiXtXCt[n] = MatrixInverse(glm->CiXtXCt[n], NULL);
+    if (glm->C[n]->rows > maxJ) maxJ = glm->C[n]->rows;
+  }
+  rfs = RFspecInit(0, NULL);
+  rfs->name = strcpyalloc("z");
+
+  nblocks = (nmask + MRIGLM_BATCH_SIZE - 1) / MRIGLM_BATCH_SIZE;
+  if (Gdiag_no > 0) printf("MRIglmFitAndTestBatch(): %ld voxels in %d blocks\n", nmask, nblocks);
+  int nblocksdone = 0, pctdone = 0;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel if_ROMP(shown_reproducible)
+#endif
+  {
+    const int B = MRIGLM_BATCH_SIZE;
+    int nthblock, nthcon, nb, v, f, k, j, jj, J;
+    double *acc, *rvarb, dtmp, Fval, p, z, sig;
+    float *Y, *Xty, *beta, *yhat, *gamma, *gtig;
+    MATRIX *mpmf = NULL, *ypmf = NULL;
+
+    // Per-thread scratch
+    acc = (double *)calloc(B, sizeof(double));
+    rvarb = (double *)calloc(B, sizeof(double));
+    Y = (float *)calloc((size_t)nf * B, sizeof(float));
+    yhat = (float *)calloc((size_t)nf * B, sizeof(float));
+    Xty = (float *)calloc((size_t)nreg * B, sizeof(float));
+    beta = (float *)calloc((size_t)nreg * B, sizeof(float));
+    gamma = (float *)calloc((size_t)maxJ * B, sizeof(float));
+    gtig = (float *)calloc(maxJ, sizeof(float));
+
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (nthblock = 0; nthblock < nblocks; nthblock++) {
+      long v0 = (long)nthblock * B;
+      nb = B;
+      if (v0 + nb > nmask) nb = nmask - v0;
+
+      // Load the data for this block, Y is nf-by-nb
+      for (v = 0; v < nb; v++)
+        for (f = 0; f < nf; f++) Y[f * B + v] = MRIgetVoxVal(mriglm->y, vc[v0 + v], vr[v0 + v], vs[v0 + v], f);
+
+      // Xty = X'*Y
+      for (k = 0; k < nreg; k++) {
+        const float *Xtrow = &glm->Xt->rptr[k + 1][1];
+        for (v = 0; v < nb; v++) acc[v] = 0.0;
+        for (f = 0; f < nf; f++) {
+          const double a = Xtrow[f];
+          const float *Yf = &Y[f * B];
+          for (v = 0; v < nb; v++) acc[v] += a * Yf[v];
+        }
+        for (v = 0; v < nb; v++) Xty[k * B + v] = acc[v];
+      }
+
+      // beta = inv(X'*X)*X'*Y
+      for (k = 0; k < nreg; k++) {
+        const float *iXtXrow = &glm->iXtX->rptr[k + 1][1];
+        for (v = 0; v < nb; v++) acc[v] = 0.0;
+        for (j = 0; j < nreg; j++) {
+          const double a = iXtXrow[j];
+          const float *Xtyj = &Xty[j * B];
+          for (v = 0; v < nb; v++) acc[v] += a * Xtyj[v];
+        }
+        for (v = 0; v < nb; v++) beta[k * B + v] = acc[v];
+      }
+
+      // yhat = X*beta, eres = Y - yhat
+      for (f = 0; f < nf; f++) {
+        const float *Xrow = &glm->X->rptr[f + 1][1];
+        for (v = 0; v < nb; v++) acc[v] = 0.0;
+        for (k = 0; k < nreg; k++) {
+          const double a = Xrow[k];
+          const float *betak = &beta[k * B];
+          for (v = 0; v < nb; v++) acc[v] += a * betak[v];
+        }
+        for (v = 0; v < nb; v++) yhat[f * B + v] = acc[v];
+      }
+
+      for (v = 0; v < nb; v++) {
+        int vc0 = vc[v0 + v], vr0 = vr[v0 + v], vs0 = vs[v0 + v];
+        double rvar = 0;
+        for (f = 0; f < nf; f++) {
+          float e = Y[f * B + v] - yhat[f * B + v];
+          float e2 = e * e;
+          rvar += e2;
+          if (mriglm->SimOnly) continue;
+          MRIsetVoxVal(mriglm->eres, vc0, vr0, vs0, f, e);
+          if (mriglm->yhatsave) MRIsetVoxVal(mriglm->yhat, vc0, vr0, vs0, f, yhat[f * B + v]);
+        }
+        rvar /= glm->dof;
+        if (rvar < FLT_MIN) rvar = FLT_MIN;
+        rvarb[v] = rvar;
+        if (mriglm->SimOnly) continue;
+        MRIsetVoxVal(mriglm->rvar, vc0, vr0, vs0, 0, rvar);
+        for (k = 0; k < nreg; k++) MRIsetVoxVal(mriglm->beta, vc0, vr0, vs0, k, beta[k * B + v]);
+      }
+
+      // Test each contrast
+      for (nthcon = 0; nthcon < ncon; nthcon++) {
+        const MATRIX *C = glm->C[nthcon];
+        J = C->rows;
+
+        // gamma = C*beta, J-by-nb
+        for (j = 0; j < J; j++) {
+          const float *Crow = &C->rptr[j + 1][1];
+          for (v = 0; v < nb; v++) {
+            double val = 0.0;
+            for (k = 0; k < nreg; k++) val += (double)Crow[k] * beta[k * B + v];
+            gamma[j * B + v] = val;
+          }
+          if (glm->UseGamma0[nthcon])
+            for (v = 0; v < nb; v++) gamma[j * B + v] -= glm->gamma0[nthcon]->rptr[j + 1][1];
+        }
+
+        for (v = 0; v < nb; v++) {
+          int vc0 = vc[v0 + v], vr0 = vr[v0 + v], vs0 = vs[v0 + v];
+          double rvar = rvarb[v];
+
+          // Error trap for when rvar==0
+          if (rvar < 2 * FLT_MIN)
+            dtmp = 1e10 * J;
+          else
+            dtmp = rvar * J;
+
+          for (j = 0; j < J; j++) MRIsetVoxVal(mriglm->gamma[nthcon], vc0, vr0, vs0, j, gamma[j * B + v]);
+          if (J == 1 && !mriglm->SimOnly) {
+            float gCVM = glm->CiXtXCt[nthcon]->rptr[1][1] * (float)dtmp;
+            MRIsetVoxVal(mriglm->gammaVar[nthcon], vc0, vr0, vs0, 0, gCVM);
+          }
+
+          Fval = 0;
+          p = 1;
+          z = 0;
+          if (iCiXtXCt[nthcon] != NULL && rvar > FLT_MIN) {
+            // F = gamma' * inv(gCVM) * gamma
+            const float s1 = 1.0 / dtmp;
+            float F;
+            for (jj = 0; jj < J; jj++) {
+              double val = 0.0;
+              for (j = 0; j < J; j++) {
+                float ig = iCiXtXCt[nthcon]->rptr[j + 1][jj + 1] * s1;
+                val += (double)gamma[j * B + v] * ig;
+              }
+              gtig[jj] = val;
+            }
+            {
+              double val = 0.0;
+              for (j = 0; j < J; j++) val += (double)gtig[j] * gamma[j * B + v];
+              F = val;
+            }
+            if (F >= 0) {
+              Fval = F;
+              p = sc_cdf_fdist_Q(Fval, J, glm->dof);
+              z = RFp2StatVal(rfs, p / 2.0);
+            }
+            if (J == 1 && gamma[v] < 0) z *= -1;
+          }
+          MRIsetVoxVal(mriglm->F[nthcon], vc0, vr0, vs0, 0, Fval);
+          MRIsetVoxVal(mriglm->z[nthcon], vc0, vr0, vs0, 0, z);
+          MRIsetVoxVal(mriglm->p[nthcon], vc0, vr0, vs0, 0, p);
+          if (J == 1 && glm->DoPCC && !mriglm->SimOnly) MRIsetVoxVal(mriglm->pcc[nthcon], vc0, vr0, vs0, 0, 0);
+          if (p == 0)
+            MRIsetVoxVal(mriglm->sig[nthcon], vc0, vr0, vs0, 0, 10e10);
+          else {
+            sig = -log10(p);
+            if (J == 1) sig *= SIGN(gamma[v]);
+            MRIsetVoxVal(mriglm->sig[nthcon], vc0, vr0, vs0, 0, sig);
+          }
+          if (glm->ypmfflag[nthcon] && !mriglm->SimOnly) {
+            // Rare, so just use the matrix routines
+            if (mpmf == NULL) mpmf = MatrixAlloc(nreg, 1, MATRIX_REAL);
+            for (k = 0; k < nreg; k++) mpmf->rptr[k + 1][1] = beta[k * B + v];
+            ypmf = MatrixMultiplyD(glm->Mpmf[nthcon], mpmf, ypmf);
+            MRIfromMatrix(mriglm->ypmf[nthcon], vc0, vr0, vs0, ypmf, NULL);
+          }
+        }
+      }
+
+      // Progress in steps of 10%, as in the voxel loop
+      if (Gdiag_no > 0) {
+#ifdef HAVE_OPENMP
+        #pragma omp critical
+#endif
+        {
+          nblocksdone++;
+          while (pctdone + 10 <= (100L * nblocksdone) / nblocks) {
+            pctdone += 10;
+            printf("%2d%% ", pctdone);
+            fflush(stdout);
+          }
+        }
+      }
+    }
+
+    free(acc);
+    free(rvarb);
+    free(Y);
+    free(yhat);
+    free(Xty);
+    free(beta);
+    free(gamma);
+    free(gtig);
+    if (mpmf) MatrixFree(&mpmf);
+    if (ypmf) MatrixFree(&ypmf);
+  }
+  ROMP_PF_end
+
+  RFspecFree(&rfs);
+
+  for (n = 0; n < ncon; n++)
+    if (iCiXtXCt[n]) MatrixFree(&iCiXtXCt[n]);
+  free(vc);
+  free(vr);
+  free(vs);
+  mriglm->n_ill_cond = 0;
+  return (0);
+}
+
 /*---------------------------------------------------------------------
   MRIglmFitAndTest() - fits and tests glm on a voxel-by-voxel basis.
   There are also two other related functions, MRIglmFit() and
@@ -897,11 +1229,13 @@ MRI *MRInormWeights(MRI *w, int sqrtFlag, int invFlag, MRI *mask, MRI *wn)
   MRIglmFitAndTest() fits and tests a voxel before moving on to the
   next voxel. MRIglmFitAndTest() will be computationally more
   efficient.  So why have MRIglmFit() and MRIglmTest()? So that the
-  variance can be smoothed between the two if desired.
+  variance can be smoothed between the two if desired. When the design
+  is the same at all voxels, the work is passed to the batched,
+  multi-threaded MRIglmFitAndTestBatch() (see MRIglmBatchable()).
   --------------------------------------------------------------------*/
 int MRIglmFitAndTest(MRIGLM *mriglm)
 {
-  int c, nc, nr, ns, nf, n;
+  int c, nc, nr, ns, nf, n, batchable;
   long nvoxtot;
   //int c, r, s, n, nc, nr, ns, nf, pctdone;
   //float m, Xcond;
@@ -917,6 +1251,11 @@ int MRIglmFitAndTest(MRIGLM *mriglm)
 
   mriglm->pervoxflag = 0;
   if (mriglm->w != NULL || mriglm->npvr != 0 || mriglm->FrameMask != NULL) mriglm->pervoxflag = 1;
+  batchable = MRIglmBatchable(mriglm);
+  if (mriglm->SimOnly && !batchable) {
+    printf("ERROR: MRIglmFitAndTest(): SimOnly requires a design that is the same at all voxels\n");
+    return (1);
+  }
 
   if (mriglm->FrameMask == NULL) {
     GLMallocX(glm, nf, mriglm->nregtot);
@@ -933,7 +1272,7 @@ int MRIglmFitAndTest(MRIGLM *mriglm)
   else  mriglm->XgLoaded = 0;  // Make sure reset for sim with pvr
 
   // If beta has not been allocated, assume that no one has been alloced
-  if (mriglm->beta == NULL) {
+  if (mriglm->beta == NULL && !mriglm->SimOnly) {
     mriglm->beta = MRIallocSequence(nc, nr, ns, MRI_FLOAT, mriglm->nregtot);
     MRIcopyHeader(mriglm->y, mriglm->beta);
     mriglm->eres = MRIallocSequence(nc, nr, ns, MRI_FLOAT, nf);
@@ -975,13 +1314,32 @@ int MRIglmFitAndTest(MRIGLM *mriglm)
     }
   }
 
+  // SimOnly: just the outputs needed to build a cluster simulation
+  if (mriglm->SimOnly && mriglm->F[0] == NULL) {
+    for (n = 0; n < glm->ncontrasts; n++) {
+      mriglm->gamma[n] = MRIallocSequence(nc, nr, ns, MRI_FLOAT, glm->C[n]->rows);
+      MRIcopyHeader(mriglm->y, mriglm->gamma[n]);
+      mriglm->F[n] = MRIallocSequence(nc, nr, ns, MRI_FLOAT, 1);
+      MRIcopyHeader(mriglm->y, mriglm->F[n]);
+      mriglm->p[n] = MRIallocSequence(nc, nr, ns, MRI_FLOAT, 1);
+      MRIcopyHeader(mriglm->y, mriglm->p[n]);
+      mriglm->sig[n] = MRIallocSequence(nc, nr, ns, MRI_FLOAT, 1);
+      MRIcopyHeader(mriglm->y, mriglm->sig[n]);
+      mriglm->z[n] = MRIallocSequence(nc, nr, ns, MRI_FLOAT, 1);
+      MRIcopyHeader(mriglm->y, mriglm->z[n]);
+    }
+  }
+
   //--------------------------------------------
   //pctdone = 0;
   //nthvox = 0;
   mriglm->n_ill_cond = 0;
   long n_ill_cond = 0;
 
+  if (batchable) return (MRIglmFitAndTestBatch(mriglm));
+
   // Parallel does not work yet because need separate glm for each thread
+  // (the batched engine above handles the fixed-design case in parallel)
   //#ifdef HAVE_OPENMP
   //#pragma omp parallel for if_ROMP(assume_reproducible) reduction(+ : n_ill_cond)
   //#endif
@@ -1100,7 +1458,7 @@ int MRIglmFit(MRIGLM *mriglm)
   else  mriglm->XgLoaded = 0;  // Make sure reset for sim with pvr
 
   // If beta has not been allocated, assume that no one has been alloced
-  if (mriglm->beta == NULL) {
+  if (mriglm->beta == NULL && !mriglm->SimOnly) {
     mriglm->beta = MRIallocSequence(nc, nr, ns, MRI_FLOAT, mriglm->nregtot);
     MRIcopyHeader(mriglm->y, mriglm->beta);
     mriglm->eres = MRIallocSequence(nc, nr, ns, MRI_FLOAT, nf);
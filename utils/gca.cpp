@@ -31,6 +31,11 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "faster_variants.h"
 #include "romp_support.h"
@@ -162,6 +167,8 @@ static int GCAupdateNode(GCA *gca, MRI *mri, int xn, int yn, int zn, float *vals
 static int GCAupdateNodeCovariance(GCA *gca, MRI *mri, int xn, int yn, int zn, float *vals, int label);
 static int GCAupdatePrior(GCA *gca, MRI *mri, int xn, int yn, int zn, int label);
 static int GCAupdateNodeGibbsPriors(GCA *gca, MRI *mri, int xn, int yn, int zn, int x, int y, int z, int label);
+static void gcaFreeData(void *ptr);
+static void gcaFreeFlat(GCA *gca);
 static int different_nbr_max_labels(GCA *gca, int x, int y, int z, int wsize, int label);
 static int gcaRegionStats(GCA *gca,
                           int x0,
@@ -1623,8 +1630,8 @@ int GCAfree(GCA **pgca)
   for (x = 0; x < gca->prior_width; x++) {
     for (y = 0; y < gca->prior_height; y++) {
       for (z = 0; z < gca->prior_depth; z++) {
-        free(gca->priors[x][y][z].labels);
-        free(gca->priors[x][y][z].priors);
+        gcaFreeData(gca->priors[x][y][z].labels);
+        gcaFreeData(gca->priors[x][y][z].priors);
       }
       free(gca->priors[x][y]);
     }
@@ -1633,6 +1640,7 @@ int GCAfree(GCA **pgca)
 
   free(gca->priors);
   GCAcleanup(gca);
+  gcaFreeFlat(gca);
 
   free(gca);
 
@@ -1642,7 +1650,7 @@ int GCAfree(GCA **pgca)
 int GCANfree(GCA_NODE *gcan, int ninputs)
 {
   if (gcan->nlabels) {
-    free(gcan->labels);
+    gcaFreeData(gcan->labels);
     free_gcs(gcan->gcs, gcan->nlabels, ninputs);
   }
   return (NO_ERROR);
@@ -1651,8 +1659,8 @@ int GCANfree(GCA_NODE *gcan, int ninputs)
 int GCAPfree(GCA_PRIOR *gcap)
 {
   if (gcap->nlabels) {
-    free(gcap->labels);
-    free(gcap->priors);
+    gcaFreeData(gcap->labels);
+    gcaFreeData(gcap->priors);
   }
   return (NO_ERROR);
 }
@@ -2067,6 +2075,202 @@ int GCAtrain(GCA *gca, MRI *mri_inputs, MRI *mri_labels, TRANSFORM *transform, G
   return (NO_ERROR);
 }
 
+/*
+  compute the training count of each classifier from the node
+  totals and the priors (these are not stored in the file)
+*/
+static void gcaComputeNtraining(GCA *gca)
+{
+  int x, y, z, n;
+  GCA_NODE *gcan;
+  GCA_PRIOR *gcap;
+  GC1D *gc;
+
+  for (x = 0; x < gca->node_width; x++) {
+    for (y = 0; y < gca->node_height; y++) {
+      for (z = 0; z < gca->node_depth; z++) {
+        int xp, yp, zp;
+
+        if (x == Ggca_x && y == Ggca_y && z == Ggca_z) {
+          DiagBreak();
+        }
+        gcan = &gca->nodes[x][y][z];
+        if (gcaNodeToPrior(gca, x, y, z, &xp, &yp, &zp) == NO_ERROR) {
+          gcap = &gca->priors[xp][yp][zp];
+          if (gcap == NULL) {
+            continue;
+          }
+          for (n = 0; n < gcan->nlabels; n++) {
+            gc = &gcan->gcs[n];
+            gc->ntraining = gcan->total_training * getPrior(gcap, gcan->labels[n]);
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+  read the tagged section at the end of a GCA file (type, MR parameters,
+  colortable and direction cosines). Shared by GCAread() and GCAreadFlat().
+*/
+static int gcaReadTags(GCA *gca, znzFile file, const char *fname)
+{
+  int tag;
+
+  while (znzreadIntEx(&tag, file)) {
+    int n, nparms;
+
+    if (tag == FILE_TAG) /* beginning of tagged section */
+    {
+      while (znzreadIntEx(&tag, file)) {
+        /* all tags are format:
+           <int: tag> <int: num> <parm> <parm> .... */
+        switch (tag) {
+          case TAG_GCA_COLORTABLE:
+            /* We have a color table, read it with CTABreadFromBinary. If it
+               fails, it will print its own error message. */
+            fprintf(stdout, "reading colortable from GCA file...\n");
+            gca->ct = znzCTABreadFromBinary(file);
+            if (NULL != gca->ct)
+              fprintf(stdout, "colortable with %d entries read (originally %s)\n", gca->ct->nentries, gca->ct->fname);
+            break;
+          case TAG_GCA_TYPE:
+            znzreadInt(file); /* skip num=1 */
+            gca->type = znzreadInt(file);
+            if (DIAG_VERBOSE_ON) switch (gca->type) {
+                case GCA_NORMAL:
+                  printf("setting gca type = Normal gca type\n");
+                  break;
+                case GCA_PARAM:
+                  printf("setting gca type = T1/PD gca type\n");
+                  break;
+                case GCA_FLASH:
+                  printf("setting gca type = FLASH gca type\n");
+                  break;
+                default:
+                  printf("setting gca type = Unknown\n");
+                  gca->type = GCA_UNKNOWN;
+                  break;
+              }
+            break;
+          case TAG_PARAMETERS:
+            nparms = znzreadInt(file);
+            /* how many MR parameters are stored */
+            printf("reading %d MR parameters out of GCA header...\n", nparms);
+            for (n = 0; n < gca->ninputs; n++) {
+              gca->TRs[n] = znzreadFloat(file);
+              gca->FAs[n] = znzreadFloat(file);
+              gca->TEs[n] = znzreadFloat(file);
+              printf(
+                  "input %d: TR=%2.1f msec, FA=%2.1f deg, "
+                  "TE=%2.1f msec\n",
+                  n,
+                  gca->TRs[n],
+                  DEGREES(gca->FAs[n]),
+                  gca->TEs[n]);
+            }
+            break;
+          case TAG_GCA_DIRCOS:
+            gca->x_r = znzreadFloat(file);
+            gca->x_a = znzreadFloat(file);
+            gca->x_s = znzreadFloat(file);
+            gca->y_r = znzreadFloat(file);
+            gca->y_a = znzreadFloat(file);
+            gca->y_s = znzreadFloat(file);
+            gca->z_r = znzreadFloat(file);
+            gca->z_a = znzreadFloat(file);
+            gca->z_s = znzreadFloat(file);
+            gca->c_r = znzreadFloat(file);
+            gca->c_a = znzreadFloat(file);
+            gca->c_s = znzreadFloat(file);
+            gca->width = znzreadInt(file);
+            gca->height = znzreadInt(file);
+            gca->depth = znzreadInt(file);
+            gca->xsize = znzreadFloat(file);
+            gca->ysize = znzreadFloat(file);
+            gca->zsize = znzreadFloat(file);
+
+            if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) {
+              printf("Direction cosines read:\n");
+              printf(" x_r = % .4f, y_r = % .4f, z_r = % .4f\n", gca->x_r, gca->y_r, gca->z_r);
+              printf(" x_a = % .4f, y_a = % .4f, z_a = % .4f\n", gca->x_a, gca->y_a, gca->z_a);
+              printf(" x_s = % .4f, y_s = % .4f, z_s = % .4f\n", gca->x_s, gca->y_s, gca->z_s);
+              printf(" c_r = % .4f, c_a = % .4f, c_s = % .4f\n", gca->c_r, gca->c_a, gca->c_s);
+            }
+            break;
+          default:
+            ErrorPrintf(ERROR_BADFILE, "GCAread(%s): unknown tag %x\n", fname, tag);
+            break;
+        }
+      }
+    }
+  }
+
+  return (NO_ERROR);
+}
+
+/*
+  write the tagged section at the end of a GCA file. Shared by
+  GCAwrite() and GCAwriteFlat().
+*/
+static int gcaWriteTags(GCA *gca, znzFile file)
+{
+  // if (gca->type == GCA_FLASH || gca->type == GCA_PARAM)
+  // always write gca->type
+  {
+    int n;
+
+    znzwriteInt(FILE_TAG, file); /* beginning of tagged section */
+
+    /* all tags are format: <int: tag> <int: num> <parm> <parm> .... */
+    znzwriteInt(TAG_GCA_TYPE, file);
+    znzwriteInt(1, file);
+    znzwriteInt(gca->type, file);
+
+    if (gca->type == GCA_FLASH) {
+      znzwriteInt(TAG_PARAMETERS, file);
+      znzwriteInt(3, file); /* currently only storing 3 parameters */
+      for (n = 0; n < gca->ninputs; n++) {
+        znzwriteFloat(gca->TRs[n], file);
+        znzwriteFloat(gca->FAs[n], file);
+        znzwriteFloat(gca->TEs[n], file);
+      }
+    }
+  }
+
+  if (gca->ct) {
+    if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) {
+      printf("writing colortable into GCA file...\n");
+    }
+    znzwriteInt(TAG_GCA_COLORTABLE, file);
+    znzCTABwriteIntoBinary(gca->ct, file);
+  }
+
+  // write direction cosine information
+  znzwriteInt(TAG_GCA_DIRCOS, file);
+  znzwriteFloat(gca->x_r, file);
+  znzwriteFloat(gca->x_a, file);
+  znzwriteFloat(gca->x_s, file);
+  znzwriteFloat(gca->y_r, file);
+  znzwriteFloat(gca->y_a, file);
+  znzwriteFloat(gca->y_s, file);
+  znzwriteFloat(gca->z_r, file);
+  znzwriteFloat(gca->z_a, file);
+  znzwriteFloat(gca->z_s, file);
+  znzwriteFloat(gca->c_r, file);
+  znzwriteFloat(gca->c_a, file);
+  znzwriteFloat(gca->c_s, file);
+  znzwriteInt(gca->width, file);
+  znzwriteInt(gca->height, file);
+  znzwriteInt(gca->depth, file);
+  znzwriteFloat(gca->xsize, file);
+  znzwriteFloat(gca->ysize, file);
+  znzwriteFloat(gca->zsize, file);
+
+  return (NO_ERROR);
+}
+
 int GCAwrite(GCA *gca, const char *fname)
 {
   znzFile file;
@@ -2076,6 +2280,9 @@ int GCAwrite(GCA *gca, const char *fname)
   GC1D *gc;
   int gzipped = 0;
 
+  if (strstr(fname, ".gcf")) {
+    return (GCAwriteFlat(gca, fname));
+  }
   if (strstr(fname, ".gcz")) {
     gzipped = 1;
   }
@@ -2158,57 +2365,7 @@ int GCAwrite(GCA *gca, const char *fname)
     }
   }
 
-  // if (gca->type == GCA_FLASH || gca->type == GCA_PARAM)
-  // always write gca->type
-  {
-    int n;
-
-    znzwriteInt(FILE_TAG, file); /* beginning of tagged section */
-
-    /* all tags are format: <int: tag> <int: num> <parm> <parm> .... */
-    znzwriteInt(TAG_GCA_TYPE, file);
-    znzwriteInt(1, file);
-    znzwriteInt(gca->type, file);
-
-    if (gca->type == GCA_FLASH) {
-      znzwriteInt(TAG_PARAMETERS, file);
-      znzwriteInt(3, file); /* currently only storing 3 parameters */
-      for (n = 0; n < gca->ninputs; n++) {
-        znzwriteFloat(gca->TRs[n], file);
-        znzwriteFloat(gca->FAs[n], file);
-        znzwriteFloat(gca->TEs[n], file);
-      }
-    }
-  }
-
-  if (gca->ct) {
-    if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) {
-      printf("writing colortable into GCA file...\n");
-    }
-    znzwriteInt(TAG_GCA_COLORTABLE, file);
-    znzCTABwriteIntoBinary(gca->ct, file);
-  }
-
-  // write direction cosine information
-  znzwriteInt(TAG_GCA_DIRCOS, file);
-  znzwriteFloat(gca->x_r, file);
-  znzwriteFloat(gca->x_a, file);
-  znzwriteFloat(gca->x_s, file);
-  znzwriteFloat(gca->y_r, file);
-  znzwriteFloat(gca->y_a, file);
-  znzwriteFloat(gca->y_s, file);
-  znzwriteFloat(gca->z_r, file);
-  znzwriteFloat(gca->z_a, file);
-  znzwriteFloat(gca->z_s, file);
-  znzwriteFloat(gca->c_r, file);
-  znzwriteFloat(gca->c_a, file);
-  znzwriteFloat(gca->c_s, file);
-  znzwriteInt(gca->width, file);
-  znzwriteInt(gca->height, file);
-  znzwriteInt(gca->depth, file);
-  znzwriteFloat(gca->xsize, file);
-  znzwriteFloat(gca->ysize, file);
-  znzwriteFloat(gca->zsize, file);
+  gcaWriteTags(gca, file);
 
   znzclose(file);
 
@@ -2226,13 +2383,15 @@ GCA *GCAread(const char *fname)
   float version, node_spacing, prior_spacing;
   int node_width, node_height, node_depth, ninputs, flags;
   // int prior_width, prior_height, prior_depth;
-  int tag;
   int gzipped = 0;
   int tempZNZ;
 
   if (strstr(fname, ".gcz")) {
     gzipped = 1;
   }
+  else if (GCAisFlatFile(fname)) {
+    return (GCAreadFlat(fname));
+  }
 
   file = znzopen(fname, "rb", gzipped);
   if (znz_isnull(file)) {
@@ -2535,122 +2694,664 @@ GCA *GCAread(const char *fname)
     }
   }
 
-  for (x = 0; x < gca->node_width; x++) {
-    for (y = 0; y < gca->node_height; y++) {
-      for (z = 0; z < gca->node_depth; z++) {
-        int xp, yp, zp;
+  gcaComputeNtraining(gca);
+  gcaReadTags(gca, file, fname);
 
-        if (x == Ggca_x && y == Ggca_y && z == Ggca_z) {
-          DiagBreak();
-        }
-        gcan = &gca->nodes[x][y][z];
-        if (gcaNodeToPrior(gca, x, y, z, &xp, &yp, &zp) == NO_ERROR) {
-          gcap = &gca->priors[xp][yp][zp];
-          if (gcap == NULL) {
-            continue;
-          }
-          for (n = 0; n < gcan->nlabels; n++) {
-            gc = &gcan->gcs[n];
-            gc->ntraining = gcan->total_training * getPrior(gcap, gcan->labels[n]);
-          }
-        }
+  GCAsetup(gca);
+
+  znzclose(file);
+
+  return (gca);
+}
+
+/*
+  Flat GCA format (.gcf). The atlas is stored as one header followed by
+  contiguous per-node and per-prior arrays plus offset tables, all in
+  native byte order and 8-byte aligned, so the file can be mmapped and
+  used in place. Many processes reading the same atlas share the page
+  cache (the mapping is private, so in-place edits are copy-on-write).
+  The usual tagged section (type, colortable, direction cosines) follows
+  the arrays and is read with the standard znz routines.
+*/
+#define GCA_FLAT_MAGIC "GCAFLAT"
+#define GCA_FLAT_VERSION 1
+#define GCA_FLAT_BYTE_ORDER 0x01020304
+#define GCA_FLAT_ALIGN(n) (((n) + 7) & ~((long long)7))
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int byte_order;
+  float prior_spacing;
+  float node_spacing;
+  int prior_width, prior_height, prior_depth;
+  int node_width, node_height, node_depth;
+  int ninputs;
+  int flags;
+  int max_label;
+  int pad;
+  long long nnodes;       // node_width*node_height*node_depth
+  long long nnode_labels; // total # of classifiers over all nodes
+  long long ngibbs;       // total # of gibbs nbr labels over all classifiers
+  long long npriors;      // prior_width*prior_height*prior_depth
+  long long nprior_labels;
+  // byte offsets of each section from the start of the file
+  long long node_nlabels_offset;   // int[nnodes]
+  long long node_training_offset;  // int[nnodes]
+  long long node_index_offset;     // long long[nnodes], first classifier of each node
+  long long node_labels_offset;    // unsigned short[nnode_labels]
+  long long means_offset;          // float[nnode_labels*ninputs]
+  long long covars_offset;         // float[nnode_labels*ncovars]
+  long long gibbs_nlabels_offset;  // short[nnode_labels*GIBBS_NEIGHBORS]
+  long long gibbs_index_offset;    // long long[nnode_labels*GIBBS_NEIGHBORS]
+  long long gibbs_labels_offset;   // unsigned short[ngibbs]
+  long long gibbs_priors_offset;   // float[ngibbs]
+  long long prior_nlabels_offset;  // int[npriors]
+  long long prior_training_offset; // int[npriors]
+  long long prior_index_offset;    // long long[npriors]
+  long long prior_labels_offset;   // unsigned short[nprior_labels]
+  long long prior_priors_offset;   // float[nprior_labels]
+  long long tags_offset;
+} GCA_FLAT_HEADER;
+
+/*
+  registry of the memory blocks owned by flat GCAs. Pointers into these
+  blocks must never be passed to free(), so every free of node/prior
+  storage in this file goes through gcaFreeData(). GCAs are read and
+  freed from more than one thread, so the registry is locked.
+*/
+#define MAX_GCA_FLAT_BLOCKS 64
+static char *gca_flat_block_start[MAX_GCA_FLAT_BLOCKS];
+static char *gca_flat_block_end[MAX_GCA_FLAT_BLOCKS];
+static int gca_flat_nblocks = 0;
+#ifdef HAVE_OPENMP
+static volatile bool gca_flat_lock_inited = false;
+static omp_lock_t gca_flat_lock;
+#endif
+
+static void gcaFlatLock()
+{
+#ifdef HAVE_OPENMP
+  if (!gca_flat_lock_inited) {
+    #pragma omp critical
+    if (!gca_flat_lock_inited) {
+      omp_init_lock(&gca_flat_lock);
+      gca_flat_lock_inited = true;
+    }
+  }
+  omp_set_lock(&gca_flat_lock);
+#endif
+}
+
+static void gcaFlatUnlock()
+{
+#ifdef HAVE_OPENMP
+  omp_unset_lock(&gca_flat_lock);
+#endif
+}
+
+static int gcaFlatRegister(void *ptr, size_t size)
+{
+  int n;
+
+  gcaFlatLock();
+  for (n = 0; n < MAX_GCA_FLAT_BLOCKS; n++)
+    if (gca_flat_block_start[n] == NULL) {
+      gca_flat_block_start[n] = (char *)ptr;
+      gca_flat_block_end[n] = (char *)ptr + size;
+      if (n >= gca_flat_nblocks) {
+        gca_flat_nblocks = n + 1;
       }
+      gcaFlatUnlock();
+      return (NO_ERROR);
     }
+  gcaFlatUnlock();
+  ErrorReturn(ERROR_NOMEMORY, (ERROR_NOMEMORY, "gcaFlatRegister: too many flat GCAs (max %d)", MAX_GCA_FLAT_BLOCKS));
+}
+
+static void gcaFlatUnregister(void *ptr)
+{
+  int n;
+
+  gcaFlatLock();
+  for (n = 0; n < gca_flat_nblocks; n++)
+    if (gca_flat_block_start[n] == (char *)ptr) {
+      gca_flat_block_start[n] = gca_flat_block_end[n] = NULL;
+    }
+  while (gca_flat_nblocks > 0 && gca_flat_block_start[gca_flat_nblocks - 1] == NULL) {
+    gca_flat_nblocks--;
   }
+  gcaFlatUnlock();
+}
 
-  while (znzreadIntEx(&tag, file)) {
-    int n, nparms;
+static void gcaFreeData(void *ptr)
+{
+  int n, owned = 0;
 
-    if (tag == FILE_TAG) /* beginning of tagged section */
-    {
-      while (znzreadIntEx(&tag, file)) {
-        /* all tags are format:
-           <int: tag> <int: num> <parm> <parm> .... */
-        switch (tag) {
-          case TAG_GCA_COLORTABLE:
-            /* We have a color table, read it with CTABreadFromBinary. If it
-               fails, it will print its own error message. */
-            fprintf(stdout, "reading colortable from GCA file...\n");
-            gca->ct = znzCTABreadFromBinary(file);
-            if (NULL != gca->ct)
-              fprintf(stdout, "colortable with %d entries read (originally %s)\n", gca->ct->nentries, gca->ct->fname);
-            break;
-          case TAG_GCA_TYPE:
-            znzreadInt(file); /* skip num=1 */
-            gca->type = znzreadInt(file);
-            if (DIAG_VERBOSE_ON) switch (gca->type) {
-                case GCA_NORMAL:
-                  printf("setting gca type = Normal gca type\n");
-                  break;
-                case GCA_PARAM:
-                  printf("setting gca type = T1/PD gca type\n");
-                  break;
-                case GCA_FLASH:
-                  printf("setting gca type = FLASH gca type\n");
-                  break;
-                default:
-                  printf("setting gca type = Unknown\n");
-                  gca->type = GCA_UNKNOWN;
-                  break;
-              }
-            break;
-          case TAG_PARAMETERS:
-            nparms = znzreadInt(file);
-            /* how many MR parameters are stored */
-            printf("reading %d MR parameters out of GCA header...\n", nparms);
-            for (n = 0; n < gca->ninputs; n++) {
-              gca->TRs[n] = znzreadFloat(file);
-              gca->FAs[n] = znzreadFloat(file);
-              gca->TEs[n] = znzreadFloat(file);
-              printf(
-                  "input %d: TR=%2.1f msec, FA=%2.1f deg, "
-                  "TE=%2.1f msec\n",
-                  n,
-                  gca->TRs[n],
-                  DEGREES(gca->FAs[n]),
-                  gca->TEs[n]);
-            }
-            break;
-          case TAG_GCA_DIRCOS:
-            gca->x_r = znzreadFloat(file);
-            gca->x_a = znzreadFloat(file);
-            gca->x_s = znzreadFloat(file);
-            gca->y_r = znzreadFloat(file);
-            gca->y_a = znzreadFloat(file);
-            gca->y_s = znzreadFloat(file);
-            gca->z_r = znzreadFloat(file);
-            gca->z_a = znzreadFloat(file);
-            gca->z_s = znzreadFloat(file);
-            gca->c_r = znzreadFloat(file);
-            gca->c_a = znzreadFloat(file);
-            gca->c_s = znzreadFloat(file);
-            gca->width = znzreadInt(file);
-            gca->height = znzreadInt(file);
-            gca->depth = znzreadInt(file);
-            gca->xsize = znzreadFloat(file);
-            gca->ysize = znzreadFloat(file);
-            gca->zsize = znzreadFloat(file);
+  if (ptr == NULL) {
+    return;
+  }
+  gcaFlatLock();
+  for (n = 0; n < gca_flat_nblocks && !owned; n++)
+    if ((char *)ptr >= gca_flat_block_start[n] && (char *)ptr < gca_flat_block_end[n]) {
+      owned = 1; /* owned by a flat GCA */
+    }
+  gcaFlatUnlock();
+  if (!owned) {
+    free(ptr);
+  }
+}
 
-            if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) {
-              printf("Direction cosines read:\n");
-              printf(" x_r = % .4f, y_r = % .4f, z_r = % .4f\n", gca->x_r, gca->y_r, gca->z_r);
-              printf(" x_a = % .4f, y_a = % .4f, z_a = % .4f\n", gca->x_a, gca->y_a, gca->z_a);
-              printf(" x_s = % .4f, y_s = % .4f, z_s = % .4f\n", gca->x_s, gca->y_s, gca->z_s);
-              printf(" c_r = % .4f, c_a = % .4f, c_s = % .4f\n", gca->c_r, gca->c_a, gca->c_s);
+static void gcaFreeFlat(GCA *gca)
+{
+  if (gca->flat_map) {
+    gcaFlatUnregister(gca->flat_map);
+    munmap(gca->flat_map, gca->flat_map_size);
+    gca->flat_map = NULL;
+  }
+  if (gca->flat_heap) {
+    gcaFlatUnregister(gca->flat_heap);
+    free(gca->flat_heap);
+    gca->flat_heap = NULL;
+  }
+}
+
+int GCAisFlatFile(const char *fname)
+{
+  FILE *fp;
+  char magic[8];
+  int flat = 0;
+
+  fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    return (0);
+  }
+  if (fread(magic, sizeof(magic), 1, fp) == 1 && !memcmp(magic, GCA_FLAT_MAGIC, sizeof(magic))) {
+    flat = 1;
+  }
+  fclose(fp);
+  return (flat);
+}
+
+/* write nbytes of buf followed by zero padding to the next 8-byte boundary */
+static int gcaFlatWriteSection(znzFile file, const void *buf, long long nbytes)
+{
+  char zeros[8] = {0};
+  long long npad = GCA_FLAT_ALIGN(nbytes) - nbytes;
+
+  if (nbytes > 0 && znzwrite((void *)buf, 1, nbytes, file) != (size_t)nbytes) {
+    return (ERROR_BADFILE);
+  }
+  if (npad > 0 && znzwrite(zeros, 1, npad, file) != (size_t)npad) {
+    return (ERROR_BADFILE);
+  }
+  return (NO_ERROR);
+}
+
+int GCAwriteFlat(GCA *gca, const char *fname)
+{
+  znzFile file;
+  GCA_FLAT_HEADER hdr;
+  GCA_NODE *gcan;
+  GCA_PRIOR *gcap;
+  GC1D *gc;
+  int x, y, z, n, i, r, ncovars, *node_nlabels, *node_training, *prior_nlabels, *prior_training;
+  long long nnode, nlab, ngibbs, nprior, nplab, offset, *node_index, *gibbs_index, *prior_index;
+  unsigned short *node_labels, *gibbs_labels, *prior_labels;
+  float *means, *covars, *gibbs_priors, *prior_priors;
+  short *gibbs_nlabels;
+  int mrf = !(gca->flags & GCA_NO_MRF), error = NO_ERROR;
+
+  file = znzopen(fname, "wb", 0);
+  if (znz_isnull(file)) {
+    errno = 0;
+    ErrorReturn(ERROR_BADPARM, (ERROR_BADPARM, "GCAwriteFlat(%s): could not open file", fname));
+  }
+
+  ncovars = (gca->ninputs * (gca->ninputs + 1)) / 2;
+
+  memset(&hdr, 0, sizeof(hdr));
+  strcpy(hdr.magic, GCA_FLAT_MAGIC);
+  hdr.version = GCA_FLAT_VERSION;
+  hdr.byte_order = GCA_FLAT_BYTE_ORDER;
+  hdr.prior_spacing = gca->prior_spacing;
+  hdr.node_spacing = gca->node_spacing;
+  hdr.prior_width = gca->prior_width;
+  hdr.prior_height = gca->prior_height;
+  hdr.prior_depth = gca->prior_depth;
+  hdr.node_width = gca->node_width;
+  hdr.node_height = gca->node_height;
+  hdr.node_depth = gca->node_depth;
+  hdr.ninputs = gca->ninputs;
+  hdr.flags = gca->flags;
+  hdr.max_label = gca->max_label;
+
+  /* count everything first so that the offset tables can be laid out */
+  hdr.nnodes = (long long)gca->node_width * gca->node_height * gca->node_depth;
+  hdr.npriors = (long long)gca->prior_width * gca->prior_height * gca->prior_depth;
+  for (x = 0; x < gca->node_width; x++)
+    for (y = 0; y < gca->node_height; y++)
+      for (z = 0; z < gca->node_depth; z++) {
+        gcan = &gca->nodes[x][y][z];
+        hdr.nnode_labels += gcan->nlabels;
+        if (mrf)
+          for (n = 0; n < gcan->nlabels; n++)
+            for (i = 0; i < GIBBS_NEIGHBORS; i++) {
+              hdr.ngibbs += gcan->gcs[n].nlabels[i];
+            }
+      }
+  for (x = 0; x < gca->prior_width; x++)
+    for (y = 0; y < gca->prior_height; y++)
+      for (z = 0; z < gca->prior_depth; z++) {
+        hdr.nprior_labels += gca->priors[x][y][z].nlabels;
+      }
+  if (!mrf) {
+    hdr.ngibbs = 0;
+  }
+
+  offset = GCA_FLAT_ALIGN((long long)sizeof(hdr));
+  hdr.node_nlabels_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnodes * (long long)sizeof(int));
+  hdr.node_training_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnodes * (long long)sizeof(int));
+  hdr.node_index_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnodes * (long long)sizeof(long long));
+  hdr.node_labels_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnode_labels * (long long)sizeof(unsigned short));
+  hdr.means_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnode_labels * gca->ninputs * (long long)sizeof(float));
+  hdr.covars_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nnode_labels * ncovars * (long long)sizeof(float));
+  hdr.gibbs_nlabels_offset = offset;
+  offset += GCA_FLAT_ALIGN(mrf * hdr.nnode_labels * GIBBS_NEIGHBORS * (long long)sizeof(short));
+  hdr.gibbs_index_offset = offset;
+  offset += GCA_FLAT_ALIGN(mrf * hdr.nnode_labels * GIBBS_NEIGHBORS * (long long)sizeof(long long));
+  hdr.gibbs_labels_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.ngibbs * (long long)sizeof(unsigned short));
+  hdr.gibbs_priors_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.ngibbs * (long long)sizeof(float));
+  hdr.prior_nlabels_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.npriors * (long long)sizeof(int));
+  hdr.prior_training_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.npriors * (long long)sizeof(int));
+  hdr.prior_index_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.npriors * (long long)sizeof(long long));
+  hdr.prior_labels_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nprior_labels * (long long)sizeof(unsigned short));
+  hdr.prior_priors_offset = offset;
+  offset += GCA_FLAT_ALIGN(hdr.nprior_labels * (long long)sizeof(float));
+  hdr.tags_offset = offset;
+
+  node_nlabels = (int *)calloc(hdr.nnodes + 1, sizeof(int));
+  node_training = (int *)calloc(hdr.nnodes + 1, sizeof(int));
+  node_index = (long long *)calloc(hdr.nnodes + 1, sizeof(long long));
+  node_labels = (unsigned short *)calloc(hdr.nnode_labels + 1, sizeof(unsigned short));
+  means = (float *)calloc(hdr.nnode_labels * gca->ninputs + 1, sizeof(float));
+  covars = (float *)calloc(hdr.nnode_labels * ncovars + 1, sizeof(float));
+  gibbs_nlabels = (short *)calloc(mrf * hdr.nnode_labels * GIBBS_NEIGHBORS + 1, sizeof(short));
+  gibbs_index = (long long *)calloc(mrf * hdr.nnode_labels * GIBBS_NEIGHBORS + 1, sizeof(long long));
+  gibbs_labels = (unsigned short *)calloc(hdr.ngibbs + 1, sizeof(unsigned short));
+  gibbs_priors = (float *)calloc(hdr.ngibbs + 1, sizeof(float));
+  prior_nlabels = (int *)calloc(hdr.npriors + 1, sizeof(int));
+  prior_training = (int *)calloc(hdr.npriors + 1, sizeof(int));
+  prior_index = (long long *)calloc(hdr.npriors + 1, sizeof(long long));
+  prior_labels = (unsigned short *)calloc(hdr.nprior_labels + 1, sizeof(unsigned short));
+  prior_priors = (float *)calloc(hdr.nprior_labels + 1, sizeof(float));
+  if (!node_nlabels || !node_training || !node_index || !node_labels || !means || !covars || !gibbs_nlabels ||
+      !gibbs_index || !gibbs_labels || !gibbs_priors || !prior_nlabels || !prior_training || !prior_index ||
+      !prior_labels || !prior_priors)
+    ErrorExit(ERROR_NOMEMORY, "GCAwriteFlat(%s): could not allocate flat arrays", fname);
+
+  /* nodes are stored in the same x/y/z order that GCAwrite uses */
+  nnode = nlab = ngibbs = 0;
+  for (x = 0; x < gca->node_width; x++)
+    for (y = 0; y < gca->node_height; y++)
+      for (z = 0; z < gca->node_depth; z++, nnode++) {
+        gcan = &gca->nodes[x][y][z];
+        node_nlabels[nnode] = gcan->nlabels;
+        node_training[nnode] = gcan->total_training;
+        node_index[nnode] = nlab;
+        for (n = 0; n < gcan->nlabels; n++, nlab++) {
+          gc = &gcan->gcs[n];
+          node_labels[nlab] = gcan->labels[n];
+          for (r = 0; r < gca->ninputs; r++) {
+            means[nlab * gca->ninputs + r] = gc->means[r];
+          }
+          for (r = 0; r < ncovars; r++) {
+            covars[nlab * ncovars + r] = gc->covars[r];
+          }
+          if (!mrf) {
+            continue;
+          }
+          for (i = 0; i < GIBBS_NEIGHBORS; i++) {
+            gibbs_nlabels[nlab * GIBBS_NEIGHBORS + i] = gc->nlabels[i];
+            gibbs_index[nlab * GIBBS_NEIGHBORS + i] = ngibbs;
+            for (r = 0; r < gc->nlabels[i]; r++, ngibbs++) {
+              gibbs_labels[ngibbs] = gc->labels[i][r];
+              gibbs_priors[ngibbs] = gc->label_priors[i][r];
             }
-            break;
-          default:
-            ErrorPrintf(ERROR_BADFILE, "GCAread(%s): unknown tag %x\n", fname, tag);
-            break;
+          }
         }
       }
+
+  nprior = nplab = 0;
+  for (x = 0; x < gca->prior_width; x++)
+    for (y = 0; y < gca->prior_height; y++)
+      for (z = 0; z < gca->prior_depth; z++, nprior++) {
+        gcap = &gca->priors[x][y][z];
+        prior_nlabels[nprior] = gcap->nlabels;
+        prior_training[nprior] = gcap->total_training;
+        prior_index[nprior] = nplab;
+        for (n = 0; n < gcap->nlabels; n++, nplab++) {
+          prior_labels[nplab] = gcap->labels[n];
+          prior_priors[nplab] = gcap->priors[n];
+        }
+      }
+
+  if (!error) error = gcaFlatWriteSection(file, &hdr, sizeof(hdr));
+  if (!error) error = gcaFlatWriteSection(file, node_nlabels, hdr.nnodes * sizeof(int));
+  if (!error) error = gcaFlatWriteSection(file, node_training, hdr.nnodes * sizeof(int));
+  if (!error) error = gcaFlatWriteSection(file, node_index, hdr.nnodes * sizeof(long long));
+  if (!error) error = gcaFlatWriteSection(file, node_labels, hdr.nnode_labels * sizeof(unsigned short));
+  if (!error) error = gcaFlatWriteSection(file, means, hdr.nnode_labels * gca->ninputs * sizeof(float));
+  if (!error) error = gcaFlatWriteSection(file, covars, hdr.nnode_labels * ncovars * sizeof(float));
+  if (!error) error = gcaFlatWriteSection(file, gibbs_nlabels, mrf * hdr.nnode_labels * GIBBS_NEIGHBORS * sizeof(short));
+  if (!error) error = gcaFlatWriteSection(file, gibbs_index, mrf * hdr.nnode_labels * GIBBS_NEIGHBORS * sizeof(long long));
+  if (!error) error = gcaFlatWriteSection(file, gibbs_labels, hdr.ngibbs * sizeof(unsigned short));
+  if (!error) error = gcaFlatWriteSection(file, gibbs_priors, hdr.ngibbs * sizeof(float));
+  if (!error) error = gcaFlatWriteSection(file, prior_nlabels, hdr.npriors * sizeof(int));
+  if (!error) error = gcaFlatWriteSection(file, prior_training, hdr.npriors * sizeof(int));
+  if (!error) error = gcaFlatWriteSection(file, prior_index, hdr.npriors * sizeof(long long));
+  if (!error) error = gcaFlatWriteSection(file, prior_labels, hdr.nprior_labels * sizeof(unsigned short));
+  if (!error) error = gcaFlatWriteSection(file, prior_priors, hdr.nprior_labels * sizeof(float));
+  if (!error) gcaWriteTags(gca, file);
+
+  znzclose(file);
+
+  free(node_nlabels);
+  free(node_training);
+  free(node_index);
+  free(node_labels);
+  free(means);
+  free(covars);
+  free(gibbs_nlabels);
+  free(gibbs_index);
+  free(gibbs_labels);
+  free(gibbs_priors);
+  free(prior_nlabels);
+  free(prior_training);
+  free(prior_index);
+  free(prior_labels);
+  free(prior_priors);
+
+  if (error) {
+    ErrorReturn(error, (error, "GCAwriteFlat(%s): write failed", fname));
+  }
+  return (NO_ERROR);
+}
+
+/*
+  returns 1 if a section of count elements of the given size lies between
+  the header and the tagged section of a flat GCA
+*/
+static int gcaFlatSectionOK(const GCA_FLAT_HEADER *hdr, long long offset, long long count, long long size)
+{
+  if (offset < (long long)sizeof(GCA_FLAT_HEADER) || offset % 8 || count < 0 || count > hdr->tags_offset) {
+    return (0);
+  }
+  return (offset + count * size <= hdr->tags_offset);
+}
+
+/*
+  checks the header of a mapped flat GCA of size bytes and every index it
+  holds, so that no node, classifier, gibbs table or prior can point
+  outside the mapping. Returns 1 if the file can be used.
+*/
+static int gcaFlatValid(const char *base, long long size)
+{
+  const GCA_FLAT_HEADER *hdr = (const GCA_FLAT_HEADER *)base;
+  long long n, nlab, ncovars, ngibbs;
+  int mrf;
+
+  if (hdr->tags_offset < (long long)sizeof(GCA_FLAT_HEADER) || hdr->tags_offset > size) {
+    return (0);
+  }
+  if (hdr->ninputs < 1 || hdr->ninputs > MAX_GCA_INPUTS || hdr->node_width < 1 || hdr->node_height < 1 ||
+      hdr->node_depth < 1 || hdr->prior_width < 1 || hdr->prior_height < 1 || hdr->prior_depth < 1) {
+    return (0);
+  }
+  if (hdr->nnodes != (long long)hdr->node_width * hdr->node_height * hdr->node_depth ||
+      hdr->npriors != (long long)hdr->prior_width * hdr->prior_height * hdr->prior_depth) {
+    return (0);
+  }
+  mrf = !(hdr->flags & GCA_NO_MRF);
+  ncovars = (hdr->ninputs * (hdr->ninputs + 1)) / 2;
+  nlab = hdr->nnode_labels;
+  if (nlab < 0 || nlab > size) {
+    return (0);
+  }
+  ngibbs = mrf * nlab * GIBBS_NEIGHBORS;
+  if (!gcaFlatSectionOK(hdr, hdr->node_nlabels_offset, hdr->nnodes, sizeof(int)) ||
+      !gcaFlatSectionOK(hdr, hdr->node_training_offset, hdr->nnodes, sizeof(int)) ||
+      !gcaFlatSectionOK(hdr, hdr->node_index_offset, hdr->nnodes, sizeof(long long)) ||
+      !gcaFlatSectionOK(hdr, hdr->node_labels_offset, nlab, sizeof(unsigned short)) ||
+      !gcaFlatSectionOK(hdr, hdr->means_offset, nlab, hdr->ninputs * (long long)sizeof(float)) ||
+      !gcaFlatSectionOK(hdr, hdr->covars_offset, nlab, ncovars * (long long)sizeof(float)) ||
+      !gcaFlatSectionOK(hdr, hdr->gibbs_nlabels_offset, ngibbs, sizeof(short)) ||
+      !gcaFlatSectionOK(hdr, hdr->gibbs_index_offset, ngibbs, sizeof(long long)) ||
+      !gcaFlatSectionOK(hdr, hdr->gibbs_labels_offset, hdr->ngibbs, sizeof(unsigned short)) ||
+      !gcaFlatSectionOK(hdr, hdr->gibbs_priors_offset, hdr->ngibbs, sizeof(float)) ||
+      !gcaFlatSectionOK(hdr, hdr->prior_nlabels_offset, hdr->npriors, sizeof(int)) ||
+      !gcaFlatSectionOK(hdr, hdr->prior_training_offset, hdr->npriors, sizeof(int)) ||
+      !gcaFlatSectionOK(hdr, hdr->prior_index_offset, hdr->npriors, sizeof(long long)) ||
+      !gcaFlatSectionOK(hdr, hdr->prior_labels_offset, hdr->nprior_labels, sizeof(unsigned short)) ||
+      !gcaFlatSectionOK(hdr, hdr->prior_priors_offset, hdr->nprior_labels, sizeof(float))) {
+    return (0);
+  }
+
+  const int *node_nlabels = (const int *)(base + hdr->node_nlabels_offset);
+  const long long *node_index = (const long long *)(base + hdr->node_index_offset);
+  for (n = 0; n < hdr->nnodes; n++)
+    if (node_nlabels[n] < 0 ||
+        (node_nlabels[n] > 0 && (node_index[n] < 0 || node_index[n] > nlab - node_nlabels[n]))) {
+      return (0);
     }
+  const short *gibbs_nlabels = (const short *)(base + hdr->gibbs_nlabels_offset);
+  const long long *gibbs_index = (const long long *)(base + hdr->gibbs_index_offset);
+  for (n = 0; n < ngibbs; n++)
+    if (gibbs_nlabels[n] < 0 || gibbs_index[n] < 0 || gibbs_index[n] > hdr->ngibbs - gibbs_nlabels[n]) {
+      return (0);
+    }
+  const int *prior_nlabels = (const int *)(base + hdr->prior_nlabels_offset);
+  const long long *prior_index = (const long long *)(base + hdr->prior_index_offset);
+  for (n = 0; n < hdr->npriors; n++)
+    if (prior_nlabels[n] < 0 ||
+        (prior_nlabels[n] > 0 && (prior_index[n] < 0 || prior_index[n] > hdr->nprior_labels - prior_nlabels[n]))) {
+      return (0);
+    }
+  return (1);
+}
+
+/*
+  load a flat GCA by mapping the file and pointing the node and prior
+  arrays into the mapping. Only the GC1D structs and the gibbs pointer
+  tables are allocated, in a single heap block.
+*/
+GCA *GCAreadFlat(const char *fname)
+{
+  int fd, x, y, z, n, i, ncovars, mrf, *node_nlabels, *node_training, *prior_nlabels, *prior_training;
+  struct stat st;
+  char *base, *heap;
+  size_t heap_size;
+  GCA_FLAT_HEADER *hdr;
+  GCA *gca;
+  GCA_NODE *gcan;
+  GCA_PRIOR *gcap;
+  GC1D *gc, *gcs;
+  long long nnode, nprior, k, *node_index, *gibbs_index, *prior_index;
+  unsigned short *node_labels, *gibbs_labels, *prior_labels, **gibbs_label_ptrs;
+  float *means, *covars, *gibbs_priors, *prior_priors, **gibbs_prior_ptrs;
+  short *gibbs_nlabels;
+  znzFile file;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    ErrorReturn(NULL, (ERROR_BADPARM, "GCAreadFlat(%s): could not open file", fname));
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(GCA_FLAT_HEADER)) {
+    close(fd);
+    ErrorReturn(NULL, (ERROR_BADFILE, "GCAreadFlat(%s): file too short", fname));
+  }
+  base = (char *)mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == (char *)MAP_FAILED) {
+    ErrorReturn(NULL, (ERROR_BADFILE, "GCAreadFlat(%s): could not map file", fname));
+  }
+
+  hdr = (GCA_FLAT_HEADER *)base;
+  if (memcmp(hdr->magic, GCA_FLAT_MAGIC, sizeof(hdr->magic)) || hdr->version != GCA_FLAT_VERSION ||
+      hdr->byte_order != GCA_FLAT_BYTE_ORDER) {
+    munmap(base, st.st_size);
+    ErrorReturn(NULL,
+                (ERROR_BADFILE,
+                 "GCAreadFlat(%s): not a version %d flat GCA for this byte order",
+                 fname,
+                 GCA_FLAT_VERSION));
+  }
+  if (!gcaFlatValid(base, st.st_size)) {
+    munmap(base, st.st_size);
+    ErrorReturn(NULL, (ERROR_BADFILE, "GCAreadFlat(%s): truncated or corrupt file", fname));
+  }
+
+  gca = gcaAllocMax(hdr->ninputs,
+                    hdr->prior_spacing,
+                    hdr->node_spacing,
+                    hdr->node_spacing * hdr->node_width,
+                    hdr->node_spacing * hdr->node_height,
+                    hdr->node_spacing * hdr->node_depth,
+                    0,
+                    hdr->flags);
+  if (!gca) {
+    munmap(base, st.st_size);
+    ErrorReturn(NULL, (Gerror, NULL));
+  }
+  if (gca->node_width != hdr->node_width || gca->node_height != hdr->node_height ||
+      gca->node_depth != hdr->node_depth || gca->prior_width != hdr->prior_width ||
+      gca->prior_height != hdr->prior_height || gca->prior_depth != hdr->prior_depth) {
+    munmap(base, st.st_size);
+    GCAfree(&gca);
+    ErrorReturn(NULL, (ERROR_BADFILE, "GCAreadFlat(%s): inconsistent node/prior dimensions", fname));
+  }
+  gca->max_label = hdr->max_label;
+  if (gcaFlatRegister(base, st.st_size) != NO_ERROR) {
+    munmap(base, st.st_size);
+    GCAfree(&gca);
+    return (NULL);
+  }
+  gca->flat_map = base;
+  gca->flat_map_size = st.st_size;
+
+  mrf = !(gca->flags & GCA_NO_MRF);
+  ncovars = (gca->ninputs * (gca->ninputs + 1)) / 2;
+  node_nlabels = (int *)(base + hdr->node_nlabels_offset);
+  node_training = (int *)(base + hdr->node_training_offset);
+  node_index = (long long *)(base + hdr->node_index_offset);
+  node_labels = (unsigned short *)(base + hdr->node_labels_offset);
+  means = (float *)(base + hdr->means_offset);
+  covars = (float *)(base + hdr->covars_offset);
+  gibbs_nlabels = (short *)(base + hdr->gibbs_nlabels_offset);
+  gibbs_index = (long long *)(base + hdr->gibbs_index_offset);
+  gibbs_labels = (unsigned short *)(base + hdr->gibbs_labels_offset);
+  gibbs_priors = (float *)(base + hdr->gibbs_priors_offset);
+  prior_nlabels = (int *)(base + hdr->prior_nlabels_offset);
+  prior_training = (int *)(base + hdr->prior_training_offset);
+  prior_index = (long long *)(base + hdr->prior_index_offset);
+  prior_labels = (unsigned short *)(base + hdr->prior_labels_offset);
+  prior_priors = (float *)(base + hdr->prior_priors_offset);
+
+  /* the only per-classifier allocation: GC1D structs and gibbs pointer tables */
+  heap_size = hdr->nnode_labels * sizeof(GC1D);
+  if (mrf) {
+    heap_size += hdr->nnode_labels * GIBBS_NEIGHBORS * (sizeof(unsigned short *) + sizeof(float *));
+  }
+  heap = (char *)calloc(heap_size + 1, 1);
+  if (!heap) {
+    ErrorExit(ERROR_NOMEMORY, "GCAreadFlat(%s): could not allocate %d classifiers", fname, (int)hdr->nnode_labels);
+  }
+  if (gcaFlatRegister(heap, heap_size + 1) != NO_ERROR) {
+    free(heap);
+    GCAfree(&gca); /* unmaps the file */
+    return (NULL);
   }
+  gca->flat_heap = heap;
+  gca->flat_heap_size = heap_size + 1;
+  gcs = (GC1D *)heap;
+  gibbs_label_ptrs = (unsigned short **)(heap + hdr->nnode_labels * sizeof(GC1D));
+  gibbs_prior_ptrs = (float **)(gibbs_label_ptrs + hdr->nnode_labels * GIBBS_NEIGHBORS);
 
-  GCAsetup(gca);
+  nnode = 0;
+  for (x = 0; x < gca->node_width; x++)
+    for (y = 0; y < gca->node_height; y++)
+      for (z = 0; z < gca->node_depth; z++, nnode++) {
+        gcan = &gca->nodes[x][y][z];
+        gcan->nlabels = gcan->max_labels = node_nlabels[nnode];
+        gcan->total_training = node_training[nnode];
+        if (gcan->nlabels == 0) {
+          gcan->labels = 0;
+          gcan->gcs = 0;
+          continue;
+        }
+        k = node_index[nnode];
+        gcan->labels = node_labels + k;
+        gcan->gcs = gcs + k;
+        for (n = 0; n < gcan->nlabels; n++, k++) {
+          gc = &gcan->gcs[n];
+          gc->means = means + k * gca->ninputs;
+          gc->covars = covars + k * ncovars;
+          if (!mrf) {
+            continue;
+          }
+          gc->nlabels = gibbs_nlabels + k * GIBBS_NEIGHBORS;
+          gc->labels = gibbs_label_ptrs + k * GIBBS_NEIGHBORS;
+          gc->label_priors = gibbs_prior_ptrs + k * GIBBS_NEIGHBORS;
+          for (i = 0; i < GIBBS_NEIGHBORS; i++) {
+            gc->labels[i] = gibbs_labels + gibbs_index[k * GIBBS_NEIGHBORS + i];
+            gc->label_priors[i] = gibbs_priors + gibbs_index[k * GIBBS_NEIGHBORS + i];
+          }
+        }
+      }
+
+  nprior = 0;
+  for (x = 0; x < gca->prior_width; x++)
+    for (y = 0; y < gca->prior_height; y++)
+      for (z = 0; z < gca->prior_depth; z++, nprior++) {
+        gcap = &gca->priors[x][y][z];
+        gcap->nlabels = gcap->max_labels = prior_nlabels[nprior];
+        gcap->total_training = prior_training[nprior];
+        if (gcap->nlabels == 0) {
+          gcap->labels = 0;
+          gcap->priors = 0;
+          continue;
+        }
+        gcap->labels = prior_labels + prior_index[nprior];
+        gcap->priors = prior_priors + prior_index[nprior];
+      }
 
+  gcaComputeNtraining(gca);
+
+  /* the tagged section is small and stored in the usual big-endian form */
+  file = znzopen(fname, "rb", 0);
+  if (znz_isnull(file)) {
+    GCAfree(&gca);
+    ErrorReturn(NULL, (ERROR_BADPARM, "GCAreadFlat(%s): could not reopen file", fname));
+  }
+  znzseek(file, hdr->tags_offset, SEEK_SET);
+  gcaReadTags(gca, file, fname);
   znzclose(file);
 
+  GCAsetup(gca);
+
   return (gca);
 }
 
@@ -2702,8 +3403,8 @@ static int GCAupdatePrior(GCA *gca, MRI *mri, int xn, int yn, int zn, int label)
       memmove(gcap->labels, old_labels, old_max_labels * sizeof(unsigned short));
 
       /* free the old ones */
-      free(old_priors);
-      free(old_labels);
+      gcaFreeData(old_priors);
+      gcaFreeData(old_labels);
     }
     // add one
     gcap->nlabels++;
@@ -2850,8 +3551,8 @@ static int GCAupdateNode(GCA *gca, MRI *mri, int xn, int yn, int zn, float *vals
       memmove(gcan->labels, old_labels, old_max_labels * sizeof(unsigned short));
 
       /* free the old ones */
-      free(old_gcs);
-      free(old_labels);
+      gcaFreeData(old_gcs);
+      gcaFreeData(old_labels);
     }
     gcan->nlabels++;
   }
@@ -3139,12 +3840,247 @@ int GCAcompleteCovarianceTraining(GCA *gca)
   return (NO_ERROR);
 }
 
+/*
+  Lookup tables for labeling a volume with a fixed GCA.
+
+  Every voxel maps to a prior and the node containing it, and for each label
+  of the prior the node's classifier is found with a linear search, after which
+  GCAmahDist inverts the classifier's covariance matrix again.  The table holds,
+  for every prior, the index of each of its labels in the node's classifier
+  list, and for multi-input atlases the inverse covariance and determinant of
+  every classifier.  The densities are computed with the same arithmetic as
+  GCAcomputeConditionalLogDensity and GCAcomputeConditionalDensity, so the
+  labels do not change.
+
+  The table is built from the current means and covariances, so it is only
+  valid until the GCA is modified.
+*/
+typedef struct
+{
+  int ninputs;
+  int *prior_offsets;  // per prior, the first entry in gc_index
+  short *gc_index;     // per prior label, index into the node's gcs or -1
+  int *node_offsets;   // per node, the first classifier entry (ninputs > 1 only)
+  float *inv_covars;   // ninputs x ninputs per classifier
+  double *dets;        // covariance_determinant per classifier
+  char *invertible;    // 0 if GCAmahDist would fail for this classifier
+} GCA_LABEL_TABLE;
+
+#define GCA_PRIOR_INDEX(gca, xp, yp, zp) ((((xp) * (gca)->prior_height) + (yp)) * (gca)->prior_depth + (zp))
+#define GCA_NODE_INDEX(gca, xn, yn, zn) ((((xn) * (gca)->node_height) + (yn)) * (gca)->node_depth + (zn))
+
+static GCA_LABEL_TABLE *gcaLabelTableAlloc(GCA *gca)
+{
+  GCA_LABEL_TABLE *glt;
+  int xp, xn, ninputs, nentries, nnodes, npriors;
+
+  ninputs = gca->ninputs;
+  glt = (GCA_LABEL_TABLE *)calloc(1, sizeof(GCA_LABEL_TABLE));
+  if (!glt) {
+    ErrorExit(ERROR_NOMEMORY, "gcaLabelTableAlloc: could not allocate table");
+  }
+  glt->ninputs = ninputs;
+
+  // prior label -> node classifier
+  npriors = gca->prior_width * gca->prior_height * gca->prior_depth;
+  glt->prior_offsets = (int *)calloc(npriors + 1, sizeof(int));
+  if (!glt->prior_offsets) {
+    ErrorExit(ERROR_NOMEMORY, "gcaLabelTableAlloc: could not allocate %d prior offsets", npriors);
+  }
+  for (nentries = 0, xp = 0; xp < gca->prior_width; xp++) {
+    int yp, zp;
+    for (yp = 0; yp < gca->prior_height; yp++)
+      for (zp = 0; zp < gca->prior_depth; zp++) {
+        glt->prior_offsets[GCA_PRIOR_INDEX(gca, xp, yp, zp)] = nentries;
+        nentries += gca->priors[xp][yp][zp].nlabels;
+      }
+  }
+  glt->prior_offsets[npriors] = nentries;
+  glt->gc_index = (short *)calloc(nentries + 1, sizeof(short));
+  if (!glt->gc_index) {
+    ErrorExit(ERROR_NOMEMORY, "gcaLabelTableAlloc: could not allocate %d prior labels", nentries);
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (xp = 0; xp < gca->prior_width; xp++) {
+    ROMP_PFLB_begin
+    int yp, zp, xn, yn, zn, n, i;
+    for (yp = 0; yp < gca->prior_height; yp++)
+      for (zp = 0; zp < gca->prior_depth; zp++) {
+        GCA_PRIOR *gcap = &gca->priors[xp][yp][zp];
+        GCA_NODE *gcan;
+        short *gc_index = glt->gc_index + glt->prior_offsets[GCA_PRIOR_INDEX(gca, xp, yp, zp)];
+
+        GCApriorToNode(gca, xp, yp, zp, &xn, &yn, &zn);
+        gcan = &gca->nodes[xn][yn][zn];
+        for (n = 0; n < gcap->nlabels; n++) {
+          gc_index[n] = -1;
+          for (i = 0; i < gcan->nlabels; i++)
+            if (gcan->labels[i] == gcap->labels[n]) {
+              gc_index[n] = i;
+              break;
+            }
+        }
+      }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  if (ninputs == 1) {
+    return (glt);  // nothing to invert
+  }
+
+  // inverse covariances and determinants, as GCAmahDist computes them
+  nnodes = gca->node_width * gca->node_height * gca->node_depth;
+  glt->node_offsets = (int *)calloc(nnodes + 1, sizeof(int));
+  if (!glt->node_offsets) {
+    ErrorExit(ERROR_NOMEMORY, "gcaLabelTableAlloc: could not allocate %d node offsets", nnodes);
+  }
+  for (nentries = 0, xn = 0; xn < gca->node_width; xn++) {
+    int yn, zn;
+    for (yn = 0; yn < gca->node_height; yn++)
+      for (zn = 0; zn < gca->node_depth; zn++) {
+        glt->node_offsets[GCA_NODE_INDEX(gca, xn, yn, zn)] = nentries;
+        nentries += gca->nodes[xn][yn][zn].nlabels;
+      }
+  }
+  glt->node_offsets[nnodes] = nentries;
+  glt->inv_covars = (float *)calloc((size_t)nentries * ninputs * ninputs + 1, sizeof(float));
+  glt->dets = (double *)calloc(nentries + 1, sizeof(double));
+  glt->invertible = (char *)calloc(nentries + 1, sizeof(char));
+  if (!glt->inv_covars || !glt->dets || !glt->invertible) {
+    ErrorExit(ERROR_NOMEMORY, "gcaLabelTableAlloc: could not allocate %d classifiers", nentries);
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (xn = 0; xn < gca->node_width; xn++) {
+    ROMP_PFLB_begin
+    int yn, zn, n, r, c;
+    MATRIX *m_cov = NULL, *m_cov_inv = NULL;
+    for (yn = 0; yn < gca->node_height; yn++)
+      for (zn = 0; zn < gca->node_depth; zn++) {
+        GCA_NODE *gcan = &gca->nodes[xn][yn][zn];
+        int const first = glt->node_offsets[GCA_NODE_INDEX(gca, xn, yn, zn)];
+        for (n = 0; n < gcan->nlabels; n++) {
+          GC1D *gc = &gcan->gcs[n];
+          float *inv = glt->inv_covars + (size_t)(first + n) * ninputs * ninputs;
+
+          glt->dets[first + n] = covariance_determinant(gc, ninputs);
+          m_cov = load_covariance_matrix(gc, m_cov, ninputs);
+          // MatrixInverse returns NULL without freeing m_cov_inv when it fails
+          if (m_cov_inv == NULL) m_cov_inv = MatrixAlloc(ninputs, ninputs, MATRIX_REAL);
+          if (!MatrixInverse(m_cov, m_cov_inv)) {
+            continue;  // GCAmahDist will report it if this classifier is ever used
+          }
+          MatrixSVDInverse(m_cov, m_cov_inv);
+          for (r = 1; r <= ninputs; r++)
+            for (c = 1; c <= ninputs; c++) *inv++ = *MATRIX_RELT(m_cov_inv, r, c);
+          glt->invertible[first + n] = 1;
+        }
+      }
+    MatrixFree(&m_cov);
+    MatrixFree(&m_cov_inv);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return (glt);
+}
+
+static void gcaLabelTableFree(GCA_LABEL_TABLE **pglt)
+{
+  GCA_LABEL_TABLE *glt = *pglt;
+
+  if (!glt) {
+    return;
+  }
+  *pglt = NULL;
+  free(glt->prior_offsets);
+  free(glt->gc_index);
+  free(glt->node_offsets);
+  free(glt->inv_covars);
+  free(glt->dets);
+  free(glt->invertible);
+  free(glt);
+}
+
+// the node classifier index of each label of prior (xp, yp, zp)
+static const short *gcaLabelTablePriorGCs(const GCA_LABEL_TABLE *glt, const GCA *gca, int xp, int yp, int zp)
+{
+  return (glt->gc_index + glt->prior_offsets[GCA_PRIOR_INDEX(gca, xp, yp, zp)]);
+}
+
+// GCAmahDist and covariance_determinant for classifier n of node (xn, yn, zn)
+static double gcaLabelTableMahDist(
+    const GCA_LABEL_TABLE *glt, const GCA *gca, int xn, int yn, int zn, int n, const float *vals, double *pdet)
+{
+  GC1D const *gc = &gca->nodes[xn][yn][zn].gcs[n];
+  int const ninputs = glt->ninputs;
+  int entry, r, i;
+  float d[MAX_GCA_INPUTS], t[MAX_GCA_INPUTS], dsq;
+
+  if (ninputs == 1) {
+    *pdet = gc->covars[0];
+    return (GCAmahDist(gc, vals, ninputs));
+  }
+
+  entry = glt->node_offsets[GCA_NODE_INDEX(gca, xn, yn, zn)] + n;
+  *pdet = glt->dets[entry];
+  if (!glt->invertible[entry]) {
+    return (GCAmahDist(gc, vals, ninputs));  // exits with the usual message
+  }
+
+  // same operations, in the same order, as MatrixMultiply and VectorDot in GCAmahDist
+  const float *inv = glt->inv_covars + (size_t)entry * ninputs * ninputs;
+  for (i = 0; i < ninputs; i++) {
+    d[i] = gc->means[i] - vals[i];
+  }
+  for (r = 0; r < ninputs; r++, inv += ninputs) {
+    float val = 0.0;
+    for (i = 0; i < ninputs; i++) {
+      val += inv[i] * d[i];
+    }
+    t[r] = val;
+  }
+  for (dsq = 0.0f, i = 0; i < ninputs; i++) {
+    dsq += d[i] * t[i];
+  }
+  return (dsq);
+}
+
+// gcaComputeLogDensity for classifier n of node (xn, yn, zn)
+static double gcaLabelTableLogDensity(
+    const GCA_LABEL_TABLE *glt, const GCA *gca, int xn, int yn, int zn, int n, float *vals, float prior)
+{
+  double log_p, det, dsq;
+
+  dsq = gcaLabelTableMahDist(glt, gca, xn, yn, zn, n, vals, &det);
+  log_p = -log(sqrt(det)) - .5 * dsq;
+  log_p += log(prior);
+  return (log_p);
+}
+
+// GCAcomputeConditionalDensity for classifier n of node (xn, yn, zn)
+static double gcaLabelTableDensity(
+    const GCA_LABEL_TABLE *glt, const GCA *gca, int xn, int yn, int zn, int n, float *vals)
+{
+  double p, det, dist;
+
+  dist = gcaLabelTableMahDist(glt, gca, xn, yn, zn, n, vals, &det);
+  p = (1.0 / (pow(2 * M_PI, glt->ninputs / 2.0) * sqrt(det))) * exp(-0.5 * dist);
+  return (p);
+}
+
 MRI *GCAlabel(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *transform)
 {
   int x, width, height, depth, num_pv, use_partial_volume_stuff;
-#if INTERP_PRIOR
-  float prior;
-#endif
+  GCA_LABEL_TABLE *glt;
 
   use_partial_volume_stuff = (getenv("USE_PARTIAL_VOLUME_STUFF") != NULL);
   if (use_partial_volume_stuff) {
@@ -3168,17 +4104,25 @@ MRI *GCAlabel(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *transform)
   height = mri_inputs->height;
   depth = mri_inputs->depth;
   num_pv = 0;
-  // if 0
-  // ifdef HAVE_OPENMP
-  // pragma omp parallel for if_ROMP(experimental) reduction(+: num_pv)
-  // endif
+  glt = gcaLabelTableAlloc(gca);
+
+  // each x slab is independent, the partial volume code is not thread safe
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP2(!use_partial_volume_stuff, assume_reproducible) reduction(+: num_pv) schedule(dynamic, 1)
+#endif
   for (x = 0; x < width; x++) {
-    int y, z, n, label, xn, yn, zn;
+    ROMP_PFLB_begin
+    int y, z, n, label, xn, yn, zn, xp, yp, zp;
     // int max_n;
     float vals[MAX_GCA_INPUTS], max_p, p;
     GCA_NODE *gcan;
     GCA_PRIOR *gcap;
     GC1D *gc;
+    const short *gc_index;
+#if INTERP_PRIOR
+    float prior;
+#endif
     // GC1D *max_gc;
 
     for (y = 0; y < height; y++) {
@@ -3191,34 +4135,48 @@ MRI *GCAlabel(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *transform)
           DiagBreak();
         }
 
-        if (!GCAsourceVoxelToNode(gca, mri_inputs, transform, x, y, z, &xn, &yn, &zn)) {
+        // same as GCAsourceVoxelToNode and getGCAP, sampling the transform once
+        if (GCAsourceVoxelToPrior(gca, mri_inputs, transform, x, y, z, &xp, &yp, &zp) != NO_ERROR) {
+          continue;
+        }
+        GCApriorToNode(gca, xp, yp, zp, &xn, &yn, &zn);
+        {
           load_vals(mri_inputs, x, y, z, vals, gca->ninputs);
 
           gcan = &gca->nodes[xn][yn][zn];
-          gcap = getGCAP(gca, mri_inputs, transform, x, y, z);
-          if (gcap == NULL) {
-            continue;
-          }
+          gcap = &gca->priors[xp][yp][zp];
+          gc_index = gcaLabelTablePriorGCs(glt, gca, xp, yp, zp);
           label = 0;
           // max_n = -1;
           // max_gc = NULL;
           max_p = 2 * GIBBS_NEIGHBORS * BIG_AND_NEGATIVE;
           // going through gcap labels
           for (n = 0; n < gcap->nlabels; n++) {
-            gc = GCAfindGC(gca, xn, yn, zn, gcap->labels[n]);
-            if (gc == NULL) {
-              gc = GCAfindClosestValidGC(gca, xn, yn, zn, gcap->labels[n], 0);
-            }
-            if (gc == NULL) {
-              MRIsetVoxVal(mri_dst, x, y, z, 0, 0);  // unknown
-              continue;
-            }
 #if INTERP_PRIOR
             prior = gcaComputePrior(gca, mri_inputs, transform, x, y, z, gcap->labels[n]);
-            p = gcaComputeLogDensity(gc, vals, gca->ninputs, prior, gcap->labels[n]);
+#endif
+            if (gc_index[n] >= 0) {
+#if INTERP_PRIOR
+              p = gcaLabelTableLogDensity(glt, gca, xn, yn, zn, gc_index[n], vals, prior);
+#else
+              p = gcaLabelTableLogDensity(glt, gca, xn, yn, zn, gc_index[n], vals, gcap->priors[n]);
+#endif
+            }
+            else {
+#ifdef HAVE_OPENMP
+              #pragma omp critical(GCAfindClosestValidGC)
+#endif
+              gc = GCAfindClosestValidGC(gca, xn, yn, zn, gcap->labels[n], 0);
+              if (gc == NULL) {
+                MRIsetVoxVal(mri_dst, x, y, z, 0, 0);  // unknown
+                continue;
+              }
+#if INTERP_PRIOR
+              p = gcaComputeLogDensity(gc, vals, gca->ninputs, prior, gcap->labels[n]);
 #else
-            p = gcaComputeLogDensity(gc, vals, gca->ninputs, gcap->priors[n], gcap->labels[n]);
+              p = gcaComputeLogDensity(gc, vals, gca->ninputs, gcap->priors[n], gcap->labels[n]);
 #endif
+            }
             // look for largest p
             if (p > max_p) {
               max_p = p;
@@ -3305,19 +4263,20 @@ MRI *GCAlabel(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *transform)
           // set the value
           MRIsetVoxVal(mri_dst, x, y, z, 0, label);
         }
-        else {
-          MRIsetVoxVal(mri_dst, x, y, z, 0, 0);  // unknown
-        }
       }  // z loop
     }    // y loop
+    ROMP_PFLB_end
   }      // x loop
+  ROMP_PF_end
 
+  gcaLabelTableFree(&glt);
   return (mri_dst);
 }
 
 MRI *GCAlabelProbabilities(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *transform)
 {
   int x, width, height, depth;
+  GCA_LABEL_TABLE *glt;
 
   width = mri_inputs->width;
   height = mri_inputs->height;
@@ -3334,11 +4293,14 @@ MRI *GCAlabelProbabilities(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *t
      voxel (and hence the classifier) to which it maps. Then update the
      classifiers statistics based on this voxel's intensity and label.
   */
-  //#ifdef HAVE_OPENMP
-  //#pragma omp parallel for if_ROMP(experimental)
-  //#endif
+  glt = gcaLabelTableAlloc(gca);
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
   for (x = 0; x < width; x++) {
-    int y, z, xn, yn, zn, n;
+    ROMP_PFLB_begin
+    int y, z, xn, yn, zn, xp, yp, zp, n;
     // int label;
     GCA_NODE *gcan;
     GCA_PRIOR *gcap;
@@ -3351,10 +4313,15 @@ MRI *GCAlabelProbabilities(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *t
         ///////////////////////////////////////
 
         load_vals(mri_inputs, x, y, z, vals, gca->ninputs);
-        if (!GCAsourceVoxelToNode(gca, mri_inputs, transform, x, y, z, &xn, &yn, &zn)) {
+        // same as GCAsourceVoxelToNode and getGCAP, sampling the transform once
+        if (GCAsourceVoxelToPrior(gca, mri_inputs, transform, x, y, z, &xp, &yp, &zp) != NO_ERROR) {
+          continue;
+        }
+        GCApriorToNode(gca, xp, yp, zp, &xn, &yn, &zn);
+        {
           gcan = &gca->nodes[xn][yn][zn];
-          gcap = getGCAP(gca, mri_inputs, transform, x, y, z);
-          if (gcap == NULL || gcap->nlabels <= 0) {
+          gcap = &gca->priors[xp][yp][zp];
+          if (gcap->nlabels <= 0) {
             continue;
           }
           // label = 0;
@@ -3363,8 +4330,9 @@ MRI *GCAlabelProbabilities(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *t
           for (total_p = 0.0, n = 0; n < gcan->nlabels; n++) {
             // gc = &gcan->gcs[n];
 
-            /* compute 1-d Mahalanobis distance */
-            p = GCAcomputePosteriorDensity(gcap, gcan, n, -1, vals, gca->ninputs, xn, yn, zn, gca);
+            /* as GCAcomputePosteriorDensity(gcap, gcan, n, -1, ...) */
+            p = gcaLabelTableDensity(glt, gca, xn, yn, zn, n, vals);
+            p *= getPrior(gcap, gcan->labels[n]);
             if (p > max_p) {
               max_p = p;
               // label = gcan->labels[n];
@@ -3377,13 +4345,13 @@ MRI *GCAlabelProbabilities(MRI *mri_inputs, GCA *gca, MRI *mri_dst, TRANSFORM *t
           }
           MRIsetVoxVal(mri_dst, x, y, z, 0, (BUFTYPE)max_p);
         }
-        else {
-          MRIsetVoxVal(mri_dst, x, y, z, 0, 255);  // 0;
-        }
       }
     }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
+  gcaLabelTableFree(&glt);
   return (mri_dst);
 }
 
@@ -6024,8 +6992,8 @@ static int GCAupdateNodeGibbsPriors(GCA *gca, MRI *mri, int xn, int yn, int zn,
         memmove(gc->labels[i], old_labels, gc->nlabels[i] * sizeof(unsigned short));
 
         /* free the old ones */
-        free(old_label_priors);
-        free(old_labels);
+        gcaFreeData(old_label_priors);
+        gcaFreeData(old_labels);
       }
       gc->labels[i][gc->nlabels[i]++] = nbr_label;
     }
@@ -12638,28 +13606,28 @@ int free_gcs(GC1D *gcs, int nlabels, int ninputs)
 
   for (i = 0; i < nlabels; i++) {
     if (gcs[i].means) {
-      free(gcs[i].means);
+      gcaFreeData(gcs[i].means);
     }
     if (gcs[i].covars) {
-      free(gcs[i].covars);
+      gcaFreeData(gcs[i].covars);
     }
     if (gcs[i].nlabels) /* gibbs stuff allocated */
     {
       for (j = 0; j < GIBBS_NEIGHBORHOOD; j++) {
         if (gcs[i].labels[j]) {
-          free(gcs[i].labels[j]);
+          gcaFreeData(gcs[i].labels[j]);
         }
         if (gcs[i].label_priors[j]) {
-          free(gcs[i].label_priors[j]);
+          gcaFreeData(gcs[i].label_priors[j]);
         }
       }
-      free(gcs[i].nlabels);
-      free(gcs[i].labels);
-      free(gcs[i].label_priors);
+      gcaFreeData(gcs[i].nlabels);
+      gcaFreeData(gcs[i].labels);
+      gcaFreeData(gcs[i].label_priors);
     }
   }
 
-  free(gcs);
+  gcaFreeData(gcs);
   return (NO_ERROR);
 }
 
@@ -12713,14 +13681,14 @@ int GCAfreeGibbs(GCA *gca)
         for (n = 0; n < gcan->nlabels; n++) {
           gc = &gcan->gcs[n];
           for (i = 0; i < GIBBS_NEIGHBORS; i++) {
-            free(gc->label_priors[i]);
-            free(gc->labels[i]);
+            gcaFreeData(gc->label_priors[i]);
+            gcaFreeData(gc->labels[i]);
             gc->label_priors[i] = NULL;
             gc->labels[i] = NULL;
           }
-          free(gc->nlabels);
-          free(gc->labels);
-          free(gc->label_priors);
+          gcaFreeData(gc->nlabels);
+          gcaFreeData(gc->labels);
+          gcaFreeData(gc->label_priors);
           gc->nlabels = NULL;
           gc->labels = NULL;
           gc->label_priors = NULL;
@@ -12847,8 +13815,8 @@ static void load_vals_xyzInt(const MRI *mri_inputs, int x, int y, int z, float *
 
 double GCAmahDist(const GC1D *gc, const float *vals, const int ninputs)
 {
-  static VECTOR *v_means = NULL, *v_vals = NULL;
-  static MATRIX *m_cov = NULL, *m_cov_inv;
+  static VECTOR *v_means_per_thread[_MAX_FS_THREADS], *v_vals_per_thread[_MAX_FS_THREADS];
+  static MATRIX *m_cov_per_thread[_MAX_FS_THREADS], *m_cov_inv_per_thread[_MAX_FS_THREADS];
   int i;
   double dsq;
 
@@ -12858,6 +13826,14 @@ double GCAmahDist(const GC1D *gc, const float *vals, const int ninputs)
     dsq = v * v / gc->covars[0];
     return (dsq);
   }
+#ifdef HAVE_OPENMP
+  int const tid = omp_get_thread_num();
+#else
+  int const tid = 0;
+#endif
+  VECTOR *&v_means = v_means_per_thread[tid], *&v_vals = v_vals_per_thread[tid];
+  MATRIX *&m_cov = m_cov_per_thread[tid], *&m_cov_inv = m_cov_inv_per_thread[tid];
+
   // printf("In GCAMahDist...ninputs = %d\n", ninputs);
   if (v_vals && ninputs != v_vals->rows) {
     VectorFree(&v_vals);
@@ -12882,11 +13858,12 @@ double GCAmahDist(const GC1D *gc, const float *vals, const int ninputs)
 
   VectorSubtract(v_means, v_vals, v_vals); /* v_vals now has mean removed */
   // MatrixPrint(stdout,v_vals); //lz
-  m_cov_inv = MatrixInverse(m_cov, m_cov_inv);
-  // MatrixPrint(stdout,m_cov_inv); //lz
-  if (!m_cov_inv) {
+  // keep this thread's m_cov_inv if the inverse fails, MatrixInverse does not free it
+  if (m_cov_inv == NULL) m_cov_inv = MatrixAlloc(ninputs, ninputs, MATRIX_REAL);
+  if (!MatrixInverse(m_cov, m_cov_inv)) {
     ErrorExit(ERROR_BADPARM, "singular covariance matrix!");
   }
+  // MatrixPrint(stdout,m_cov_inv); //lz
   MatrixSVDInverse(m_cov, m_cov_inv);
 
   MatrixMultiply(m_cov_inv, v_vals, v_means);
@@ -18501,8 +19478,8 @@ GCA *GCAcompactify(GCA *gca)
             memmove(gcap->labels, old_labels, n * sizeof(unsigned short));
 
             /* free the old ones */
-            free(old_priors);
-            free(old_labels);
+            gcaFreeData(old_priors);
+            gcaFreeData(old_labels);
             gcap->max_labels = gcap->nlabels;
 
             byteSaved += (sizeof(float) + sizeof(unsigned short)) * (nmax - n);
@@ -18545,8 +19522,8 @@ GCA *GCAcompactify(GCA *gca)
             memmove(gcan->labels, old_labels, n * sizeof(unsigned short));
 
             /* free the old ones */
-            free(old_gcs);
-            free(old_labels);
+            gcaFreeData(old_gcs);
+            gcaFreeData(old_labels);
             gcan->max_labels = n;
             byteSaved += (sizeof(float) + sizeof(unsigned short)) * (nmax - n);
           }
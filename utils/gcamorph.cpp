@@ -1330,9 +1330,11 @@ GCA_MORPH *GCAMalloc(const int width, const int height, const int depth)
   gcam->spacing = 1; // may be changed by the user later; must be an int
   gcam->type = GCAM_VOX;
 
+  // one block for all the nodes, so the loops over them stream through memory
+  gcam->node_store = (GCA_MORPH_NODE *)calloc((size_t)width * height * depth, sizeof(GCA_MORPH_NODE));
   gcam->nodes = (GCA_MORPH_NODE ***)calloc(width, sizeof(GCA_MORPH_NODE **));
-  if (!gcam->nodes) {
-    ErrorExit(ERROR_NOMEMORY, "GCAMalloc: could not allocate nodes");
+  if (!gcam->node_store || !gcam->nodes) {
+    ErrorExit(ERROR_NOMEMORY, "GCAMalloc: could not allocate %dx%dx%d nodes", width, height, depth);
   }
 
   for (x = 0; x < gcam->width; x++) {
@@ -1341,29 +1343,8 @@ GCA_MORPH *GCAMalloc(const int width, const int height, const int depth)
       ErrorExit(ERROR_NOMEMORY, "GCAMalloc: could not allocate %dth **", x);
     }
 
-#define ELECTRIC_FENCE 0
-#if ELECTRIC_FENCE
-    {
-      GCA_MORPH_NODE *buf;
-
-      buf = (GCA_MORPH_NODE *)calloc(gcam->depth * gcam->height, sizeof(GCA_MORPH_NODE));
-      if (buf == NULL)
-        ErrorExit(ERROR_NO_MEMORY,
-                  "GCAMalloc(%d, %d, %d): could not allocate "
-                  "%d bytes for %dth bslice\n",
-                  height,
-                  width,
-                  depth,
-                  (gcam->depth * gcam->height * sizeof(GCA_MORPH_NODE)),
-                  x);
-      for (y = 0; y < gcam->height; y++) {
-        gcam->nodes[x][y] = buf + (y * gcam->depth);
-      }
-    }
-#else
     for (y = 0; y < gcam->height; y++) {
-      gcam->nodes[x][y] = (GCA_MORPH_NODE *)calloc(gcam->depth, sizeof(GCA_MORPH_NODE));
-      if (!gcam->nodes[x][y]) ErrorExit(ERROR_NOMEMORY, "GCAMalloc: could not allocate %d,%dth *", x, y);
+      gcam->nodes[x][y] = &gcam->node_store[GCAMnodeIndex(gcam, x, y, 0)];
       for (z = 0; z < gcam->depth; z++) {
         gcam->nodes[x][y][z].origx = x;
         gcam->nodes[x][y][z].origy = y;
@@ -1373,7 +1354,6 @@ GCA_MORPH *GCAMalloc(const int width, const int height, const int depth)
         gcam->nodes[x][y][z].z = z;
       }
     }
-#endif
   }
   initVolGeom(&gcam->image);
   initVolGeom(&gcam->atlas);
@@ -1711,11 +1691,29 @@ int GCAMfreeContents(GCA_MORPH *gcam)
           free_gcs(gcamn->gc, 1, gcam->ninputs);
         }
       }
-      free(gcam->nodes[x][y]);
     }
     free(gcam->nodes[x]);
   }
   free(gcam->nodes);
+  free(gcam->node_store);
+  free(gcam->cold_nodes);
+  gcam->nodes = NULL;
+  gcam->node_store = NULL;
+  gcam->cold_nodes = NULL;
+  return (NO_ERROR);
+}
+
+/*
+  Allocate the cold fields of the nodes (GCA_MORPH_NODE_COLD), zeroed, if they
+  haven't been yet.  Call it before a loop that uses GCAMcoldNode, not in it.
+*/
+int GCAMallocColdNodes(GCA_MORPH *gcam)
+{
+  if (gcam->cold_nodes) return (NO_ERROR);
+  gcam->cold_nodes =
+      (GCA_MORPH_NODE_COLD *)calloc((size_t)gcam->width * gcam->height * gcam->depth, sizeof(GCA_MORPH_NODE_COLD));
+  if (!gcam->cold_nodes)
+    ErrorExit(ERROR_NOMEMORY, "GCAMallocColdNodes: could not allocate %dx%dx%d nodes", gcam->width, gcam->height, gcam->depth);
   return (NO_ERROR);
 }
 
@@ -3043,6 +3041,7 @@ int gcamVolumeChangeTermAtNode(
   // double area, orig_area
   double del_v_scale, uk, image_val, error;
 
+  // the cold nodes were allocated by gcamAreaIntensityTerm before its node loop
   del_v_scale = 0;
 
   width = gcam->width;
@@ -3152,7 +3151,7 @@ int gcamVolumeChangeTermAtNode(
     //
     if (gcamn->invalid == GCAM_POSITION_INVALID || gcamni->invalid == GCAM_POSITION_INVALID ||
         gcamnj->invalid == GCAM_POSITION_INVALID || gcamnk->invalid == GCAM_POSITION_INVALID || gcamn->gc == NULL ||
-        DZERO(gcamn->sum_ci_vi_ui)) {
+        DZERO(GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui)) {
       continue;
     }
 
@@ -3165,9 +3164,9 @@ int gcamVolumeChangeTermAtNode(
   well, otherwise it dominates the gradient.
 */
     del_v_scale =
-        (uk * (gcamn->sum_ci_vi - gcamn->area) - gcamn->sum_ci_vi_ui) / (gcamn->sum_ci_vi_ui * gcamn->sum_ci_vi_ui);
+        (uk * (GCAMcoldNode(gcam, gcamn)->sum_ci_vi - gcamn->area) - GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui) / (GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui * GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui);
     MRIsampleVolumeFrameType(mri, gcamn->x, gcamn->y, gcamn->z, 0, SAMPLE_TRILINEAR, &image_val);
-    error = image_val - gcamn->predicted_val;
+    error = image_val - GCAMcoldNode(gcam, gcamn)->predicted_val;
     del_v_scale *= error;
 
     /* compute cross products and area delta */
@@ -5919,9 +5918,9 @@ int gcamLimitGradientMagnitude(GCA_MORPH *gcam, GCA_MORPH_PARMS *parms, MRI *mri
         }
 
         // dt*length of gradient
-        dx = (gcamn->dx + gcamn->jx);
-        dy = (gcamn->dy + gcamn->jy);
-        dz = (gcamn->dz + gcamn->jz);
+        dx = gcamn->dx;
+        dy = gcamn->dy;
+        dz = gcamn->dz;
         norm = sqrt(dx * dx + dy * dy + dz * dz);
         // get max norm and its position
         if (norm > max_norm) {
@@ -5977,7 +5976,7 @@ int gcamLimitGradientMagnitude(GCA_MORPH *gcam, GCA_MORPH_PARMS *parms, MRI *mri
         if (frame >= 0)
           MRIsampleVolumeFrameType(parms->mri_dist_map, gcamn->x, gcamn->y, gcamn->z, frame, SAMPLE_TRILINEAR, &dist);
 
-        printf("dist:target = %2.2f:%2.2f ", dist, gcamn->target_dist);
+        printf("dist:target = %2.2f:%2.2f ", dist, gcam->cold_nodes ? GCAMcoldNode(gcam, gcamn)->target_dist : 0.0f);
       }
       else {
         printf("vals(means) = ");
@@ -6031,7 +6030,7 @@ int gcamSmoothnessTerm(GCA_MORPH *gcam, const MRI *mri, const double l_smoothnes
         if (x == Gx && y == Gy && z == Gz) {
           DiagBreak();
         }
-        gcamn = &gcam->nodes[x][y][z];
+        gcamn = &gcam->node_store[GCAMnodeIndex(gcam, x, y, z)];
 
         if (gcamn->invalid == GCAM_POSITION_INVALID) {
           continue;
@@ -6064,7 +6063,7 @@ int gcamSmoothnessTerm(GCA_MORPH *gcam, const MRI *mri, const double l_smoothnes
               zn = MAX(0, zn);
               zn = MIN(depth - 1, zn);
 
-              gcamn_nbr = &gcam->nodes[xn][yn][zn];
+              gcamn_nbr = &gcam->node_store[GCAMnodeIndex(gcam, xn, yn, zn)];
 
               if (gcamn_nbr->invalid == GCAM_POSITION_INVALID) {
                 continue;
@@ -7492,6 +7491,139 @@ MRI *GCAMbuildVolume(GCA_MORPH *gcam, MRI *mri)
   return (mri);
 }
 
+// The position in the image gcam node (x,y,z) is splatted to by GCAMinvert,
+// clamped as GCAMinvert and MRIinterpolateIntoVolume clamp it.
+// Returns 0 if the node contributes nothing.
+static int gcamInvertSplatPosition(
+    GCA_MORPH const *gcam, MRI const *mri, int x, int y, int z, double *pxf, double *pyf, double *pzf)
+{
+  GCA_MORPH_NODE const *gcamn = &gcam->nodes[x][y][z];
+  if (gcamn->invalid == GCAM_POSITION_INVALID) return (0);
+
+  double xf = gcamn->x, yf = gcamn->y, zf = gcamn->z;
+  if (xf < 0) xf = 0;
+  if (yf < 0) yf = 0;
+  if (zf < 0) zf = 0;
+  if (xf >= mri->width) xf = mri->width - 1;
+  if (yf >= mri->height) yf = mri->height - 1;
+  if (zf >= mri->depth) zf = mri->depth - 1;
+  if (MRIindexNotInVolume(mri, xf, yf, zf) == 1) return (0);
+
+  *pxf = xf;
+  *pyf = yf;
+  *pzf = zf;
+  return (1);
+}
+
+/*
+  The forward half of GCAMinvert: trilinearly splat the gcam coordinates of
+  every valid node into mri_xind/yind/zind at its image position, and a 1 into
+  mri_counts.  Each contribution is computed with exactly the arithmetic of
+  MRIinterpolateIntoVolume.
+
+  Many nodes land on the same voxels, so the nodes can't simply be split among
+  the threads.  Instead they are bucketed by the image slice zm their splat
+  starts in.  A splat only touches slices zm and zm+1, so all the even buckets
+  can be done in parallel, and then all the odd ones.  Each bucket keeps the
+  nodes in the serial order and is done by one thread, so the result does not
+  depend on the number of threads.  It can differ from the serial splat in the
+  last bit, because a voxel gets the contributions of bucket zm-1 after those
+  of bucket zm when zm is even.
+*/
+static void gcamInvertScatter(GCA_MORPH *gcam, MRI *mri_xind, MRI *mri_yind, MRI *mri_zind, MRI *mri_counts)
+{
+  int const width = mri_xind->width, height = mri_xind->height, depth = mri_xind->depth;
+  int const nnodes = gcam->width * gcam->height * gcam->depth;
+
+  // bucket of every node, or -1
+  int *node_slice = (int *)malloc(nnodes * sizeof(int));
+  int *bucket_start = (int *)calloc(depth + 1, sizeof(int));
+  if (!node_slice || !bucket_start)
+    ErrorExit(ERROR_NOMEMORY, "gcamInvertScatter: could not allocate %d node buckets", nnodes);
+
+  int z;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (z = 0; z < gcam->depth; z++) {
+    ROMP_PFLB_begin
+    int x, y;
+    double xf, yf, zf;
+    for (y = 0; y < gcam->height; y++)
+      for (x = 0; x < gcam->width; x++) {
+        int const node = (z * gcam->height + y) * gcam->width + x;
+        node_slice[node] = gcamInvertSplatPosition(gcam, mri_counts, x, y, z, &xf, &yf, &zf) ? (int)zf : -1;
+      }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // counting sort of the nodes by bucket, keeping them in node order
+  int node;
+  for (node = 0; node < nnodes; node++)
+    if (node_slice[node] >= 0) bucket_start[node_slice[node] + 1]++;
+  for (z = 0; z < depth; z++) bucket_start[z + 1] += bucket_start[z];
+
+  int *bucket_nodes = (int *)malloc((bucket_start[depth] + 1) * sizeof(int));
+  int *bucket_fill = (int *)malloc(depth * sizeof(int));
+  if (!bucket_nodes || !bucket_fill)
+    ErrorExit(ERROR_NOMEMORY, "gcamInvertScatter: could not allocate %d node buckets", nnodes);
+  memcpy(bucket_fill, bucket_start, depth * sizeof(int));
+  for (node = 0; node < nnodes; node++)
+    if (node_slice[node] >= 0) bucket_nodes[bucket_fill[node_slice[node]]++] = node;
+  free(bucket_fill);
+  free(node_slice);
+
+  int parity;
+  for (parity = 0; parity < 2; parity++) {
+    int const nbuckets = (depth - parity + 1) / 2;
+    int b;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic, 1)
+#endif
+    for (b = 0; b < nbuckets; b++) {
+      ROMP_PFLB_begin
+      int const zm = 2 * b + parity;
+      int const zp = MIN(depth - 1, zm + 1);
+      int i;
+      for (i = bucket_start[zm]; i < bucket_start[zm + 1]; i++) {
+        int const node = bucket_nodes[i];
+        int const x = node % gcam->width;
+        int const y = (node / gcam->width) % gcam->height;
+        int const z = node / (gcam->width * gcam->height);
+        double xf, yf, zf;
+        gcamInvertSplatPosition(gcam, mri_counts, x, y, z, &xf, &yf, &zf);
+
+        int const xm = MAX((int)xf, 0), xp = MIN(width - 1, xm + 1);
+        int const ym = MAX((int)yf, 0), yp = MIN(height - 1, ym + 1);
+        double const xmd = xf - (float)xm, ymd = yf - (float)ym, zmd = zf - (float)zm;
+        double const xpd = (1.0f - xmd), ypd = (1.0f - ymd), zpd = (1.0f - zmd);
+
+        // the weights in the order MRIinterpolateIntoVolume multiplies them
+        int const    cx[8] = {xm, xm, xm, xm, xp, xp, xp, xp};
+        int const    cy[8] = {ym, ym, yp, yp, ym, ym, yp, yp};
+        int const    cz[8] = {zm, zp, zm, zp, zm, zp, zm, zp};
+        double const w[8] = {xpd * ypd * zpd, xpd * ypd * zmd, xpd * ymd * zpd, xpd * ymd * zmd,
+                             xmd * ypd * zpd, xmd * ypd * zmd, xmd * ymd * zpd, xmd * ymd * zmd};
+        int k;
+        for (k = 0; k < 8; k++) {
+          MRIFvox(mri_xind,   cx[k], cy[k], cz[k]) += w[k] * (double)x;
+          MRIFvox(mri_yind,   cx[k], cy[k], cz[k]) += w[k] * (double)y;
+          MRIFvox(mri_zind,   cx[k], cy[k], cz[k]) += w[k] * (double)z;
+          MRIFvox(mri_counts, cx[k], cy[k], cz[k]) += w[k] * 1.0;
+        }
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+  }
+
+  free(bucket_nodes);
+  free(bucket_start);
+}
+
 // To be clear, this does not invert the gcam. Rather, it populates
 // mri_{x,y,z}ind MRI structs in the gcam which is used to apply the
 // inverse. mri can be (and maybe should be) NULL or just not passed
@@ -7500,11 +7632,8 @@ MRI *GCAMbuildVolume(GCA_MORPH *gcam, MRI *mri)
 // gcam->image anyway. Not sure why mri was ever put in there.
 int GCAMinvert(GCA_MORPH *gcam, MRI *mri)
 {
-  int x, y, z, width, height, depth;
+  int z, width, height, depth;
   MRI *mri_ctrl, *mri_counts;
-  GCA_MORPH_NODE *gcamn;
-  double xf, yf, zf;
-  float num;
   int freemri = 0;
   if(mri == NULL){
     VOL_GEOM *vg = &(gcam->image);
@@ -7542,48 +7671,7 @@ int GCAMinvert(GCA_MORPH *gcam, MRI *mri)
 
   // going through gcam volume (x,y,z)
   // gcam volume points could be mapped to many points in xind, yind, and zind
-  for (z = 0; z < gcam->depth; z++) {
-    for (y = 0; y < gcam->height; y++) {
-      for (x = 0; x < gcam->width; x++) {
-        if (x == Gx && y == Gy && z == Gz) {
-          DiagBreak();
-        }
-
-        // find nodes
-        gcamn = &gcam->nodes[x][y][z];
-
-        if(gcamn->invalid == GCAM_POSITION_INVALID) continue;
-
-        // get the source volume position
-        xf = gcamn->x;
-        yf = gcamn->y;
-        zf = gcamn->z;
-        // make them within the range of index /////////////////////////////
-        if (xf < 0) xf = 0;
-        if (yf < 0) yf = 0;
-        if (zf < 0) zf = 0;
-        if (xf >= width) xf = width - 1;
-        if (yf >= height) yf = height - 1;
-        if (zf >= depth) zf = depth - 1;
-        // xv = nint(xf);
-        // yv = nint(yf);
-        // zv = nint(zf);
-        ////////////////////////////////////////////////////////////////////
-        // cache position
-        // xind[xv][yv][zv] += x
-
-        if (abs(xf - Gx) < 1 && abs(yf - Gy) < 1 && abs(zf - Gz) < 1) {
-          DiagBreak();
-        }
-        MRIinterpolateIntoVolume(gcam->mri_xind, (double)xf, (double)yf, (double)zf, (double)x);
-        // src -> gcam volume position
-        MRIinterpolateIntoVolume(gcam->mri_yind, (double)xf, (double)yf, (double)zf, (double)y);
-        MRIinterpolateIntoVolume(gcam->mri_zind, (double)xf, (double)yf, (double)zf, (double)z);
-        // mark counts (how many went in)
-        MRIinterpolateIntoVolume(mri_counts, (double)xf, (double)yf, (double)zf, (double)1.0);
-      }
-    }
-  }
+  gcamInvertScatter(gcam, gcam->mri_xind, gcam->mri_yind, gcam->mri_zind, mri_counts);
 
   if (DIAG_VERBOSE_ON && Gdiag & DIAG_WRITE) {
     MRIwrite(gcam->mri_xind, "xi.mgz");
@@ -7591,24 +7679,33 @@ int GCAMinvert(GCA_MORPH *gcam, MRI *mri)
   }
 
   // xind, yind, zind is of size (width, height, depth)
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
   for (z = 0; z < depth; z++) {
+    ROMP_PFLB_begin
+    int x, y;
+    float num;
     for (y = 0; y < height; y++) {
       for (x = 0; x < width; x++) {
         if (x == Gx && y == Gy && z == Gz) {
           DiagBreak();
         }
         // get count
-        num = MRIgetVoxVal(mri_counts, x, y, z, 0);
+        num = MRIFvox(mri_counts, x, y, z);
         if(num == 0) continue; /* nothing there */
         // give average gcam position for this points
         MRIFvox(gcam->mri_xind, x, y, z) = MRIFvox(gcam->mri_xind, x, y, z) / (float)num;
         MRIFvox(gcam->mri_yind, x, y, z) = MRIFvox(gcam->mri_yind, x, y, z) / (float)num;
         MRIFvox(gcam->mri_zind, x, y, z) = MRIFvox(gcam->mri_zind, x, y, z) / (float)num;
         MRIvox(mri_ctrl, x, y, z) = CONTROL_MARKED;
-        if(num < .1) MRIsetVoxVal(mri_ctrl, x, y, z, 0, 0);
+        if(num < .1) MRIvox(mri_ctrl, x, y, z) = 0;
       }
     }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
   MRIfree(&mri_counts);
 
@@ -9366,7 +9463,9 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
 {
   int x, y, z;
   GCA_MORPH_NODE *gcamn;
+  GCA_MORPH_NODE_COLD *gcamnc;
 
+  GCAMallocColdNodes(gcam);
   for (x = 0; x < gcam->width; x++)
     for (y = 0; y < gcam->height; y++)
       for (z = 0; z < gcam->depth; z++) {
@@ -9374,6 +9473,7 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
           DiagBreak();
         }
         gcamn = &gcam->nodes[x][y][z];
+        gcamnc = GCAMcoldNode(gcam, gcamn);
 
         switch (from) {
           default:
@@ -9383,9 +9483,9 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
               default:
                 ErrorReturn(ERROR_BADPARM, (ERROR_BADPARM, "GCAMcopyNodePositions: unsupported to %d", to));
               case SAVED_ORIGINAL_POSITIONS:
-                gcamn->saved_origx = gcamn->origx;
-                gcamn->saved_origy = gcamn->origy;
-                gcamn->saved_origz = gcamn->origz;
+                gcamnc->saved_origx = gcamn->origx;
+                gcamnc->saved_origy = gcamn->origy;
+                gcamnc->saved_origz = gcamn->origz;
                 break;
               case SAVED_POSITIONS:
                 gcamn->xs = gcamn->origx;
@@ -9405,19 +9505,19 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
               default:
                 ErrorReturn(ERROR_BADPARM, (ERROR_BADPARM, "GCAMcopyNodePositions: unsupported to %d", to));
               case SAVED_POSITIONS:
-                gcamn->xs = gcamn->saved_origx;
-                gcamn->ys = gcamn->saved_origy;
-                gcamn->zs = gcamn->saved_origz;
+                gcamn->xs = gcamnc->saved_origx;
+                gcamn->ys = gcamnc->saved_origy;
+                gcamn->zs = gcamnc->saved_origz;
                 break;
               case CURRENT_POSITIONS:
-                gcamn->x = gcamn->saved_origx;
-                gcamn->y = gcamn->saved_origy;
-                gcamn->z = gcamn->saved_origz;
+                gcamn->x = gcamnc->saved_origx;
+                gcamn->y = gcamnc->saved_origy;
+                gcamn->z = gcamnc->saved_origz;
                 break;
               case ORIGINAL_POSITIONS:
-                gcamn->origx = gcamn->saved_origx;
-                gcamn->origy = gcamn->saved_origy;
-                gcamn->origz = gcamn->saved_origz;
+                gcamn->origx = gcamnc->saved_origx;
+                gcamn->origy = gcamnc->saved_origy;
+                gcamn->origz = gcamnc->saved_origz;
                 break;
             }
             break;
@@ -9437,9 +9537,9 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
                 gcamn->z = gcamn->zs;
                 break;
               case SAVED_ORIGINAL_POSITIONS:
-                gcamn->saved_origx = gcamn->xs;
-                gcamn->saved_origy = gcamn->ys;
-                gcamn->saved_origz = gcamn->zs;
+                gcamnc->saved_origx = gcamn->xs;
+                gcamnc->saved_origy = gcamn->ys;
+                gcamnc->saved_origz = gcamn->zs;
                 break;
             }
             break;
@@ -9449,19 +9549,19 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
               default:
                 ErrorReturn(ERROR_BADPARM, (ERROR_BADPARM, "GCAMcopyNodePositions: unsupported to %d", to));
               case ORIGINAL_POSITIONS:
-                gcamn->origx = gcamn->xs2;
-                gcamn->origy = gcamn->ys2;
-                gcamn->origz = gcamn->zs2;
+                gcamn->origx = gcamnc->xs2;
+                gcamn->origy = gcamnc->ys2;
+                gcamn->origz = gcamnc->zs2;
                 break;
               case CURRENT_POSITIONS:
-                gcamn->x = gcamn->xs2;
-                gcamn->y = gcamn->ys2;
-                gcamn->z = gcamn->zs2;
+                gcamn->x = gcamnc->xs2;
+                gcamn->y = gcamnc->ys2;
+                gcamn->z = gcamnc->zs2;
                 break;
               case SAVED_ORIGINAL_POSITIONS:
-                gcamn->saved_origx = gcamn->xs2;
-                gcamn->saved_origy = gcamn->ys2;
-                gcamn->saved_origz = gcamn->zs2;
+                gcamnc->saved_origx = gcamnc->xs2;
+                gcamnc->saved_origy = gcamnc->ys2;
+                gcamnc->saved_origz = gcamnc->zs2;
                 break;
             }
             break;
@@ -9481,14 +9581,14 @@ int GCAMcopyNodePositions(GCA_MORPH *gcam, int from, int to)
                 gcamn->zs = gcamn->z;
                 break;
               case SAVED2_POSITIONS:
-                gcamn->xs2 = gcamn->x;
-                gcamn->ys2 = gcamn->y;
-                gcamn->zs2 = gcamn->z;
+                gcamnc->xs2 = gcamn->x;
+                gcamnc->ys2 = gcamn->y;
+                gcamnc->zs2 = gcamn->z;
                 break;
               case SAVED_ORIGINAL_POSITIONS:
-                gcamn->saved_origx = gcamn->x;
-                gcamn->saved_origy = gcamn->y;
-                gcamn->saved_origz = gcamn->z;
+                gcamnc->saved_origx = gcamn->x;
+                gcamnc->saved_origy = gcamn->y;
+                gcamnc->saved_origz = gcamn->z;
                 break;
             }
 
@@ -10076,6 +10176,7 @@ double gcamAreaIntensityEnergy(GCA_MORPH *gcam, MRI *mri, NODE_LOOKUP_TABLE *nlt
   GCA_MORPH_NODE *gcamn, *gcamn_nbr;
   NODE_BUCKET *nb;
 
+  GCAMallocColdNodes(gcam);
   sse = 0.0;
   max_increase = 0.0;
   // zmax = ymax = xmax = 0;
@@ -10101,7 +10202,7 @@ double gcamAreaIntensityEnergy(GCA_MORPH *gcam, MRI *mri, NODE_LOOKUP_TABLE *nlt
         sum_uv = sum_v = 0.0;
         // debug = 0; /* for diagnostics */
 
-        gcamn->sum_ci_vi_ui = gcamn->sum_ci_vi = 0;
+        GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui = GCAMcoldNode(gcam, gcamn)->sum_ci_vi = 0;
         for (nbrs = 0, xk = -AINT_NBHD_SIZE; xk <= AINT_NBHD_SIZE; xk++) {
           xi = xn + xk + NLT_PAD;
           if (xi < 0 || xi >= nlt->width) {
@@ -10137,8 +10238,8 @@ double gcamAreaIntensityEnergy(GCA_MORPH *gcam, MRI *mri, NODE_LOOKUP_TABLE *nlt
                   val = gcamn_nbr->gc->means[0];
                   sum_v += c * gcamn_nbr->area;
                   sum_uv += c * gcamn_nbr->area * val;
-                  gcamn->sum_ci_vi += gcamn_nbr->area;
-                  gcamn->sum_ci_vi_ui += gcamn_nbr->area * val;
+                  GCAMcoldNode(gcam, gcamn)->sum_ci_vi += gcamn_nbr->area;
+                  GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui += gcamn_nbr->area * val;
                 }
               }
             }
@@ -10176,14 +10277,14 @@ double gcamAreaIntensityEnergy(GCA_MORPH *gcam, MRI *mri, NODE_LOOKUP_TABLE *nlt
         if (fabs(error) > 1 && (y < 30 && y > 31)) {
           DiagBreak();
         }
-        if (error * error - gcamn->last_se > max_increase) {
-          max_increase = error * error - gcamn->last_se;
+        if (error * error - GCAMcoldNode(gcam, gcamn)->last_se > max_increase) {
+          max_increase = error * error - GCAMcoldNode(gcam, gcamn)->last_se;
           // xmax = x;
           // ymax = y;
           // zmax = z;
           DiagBreak();
         }
-        gcamn->last_se = error * error;
+        GCAMcoldNode(gcam, gcamn)->last_se = error * error;
         sse += (error * error);
         if (!finitep(sse)) {
           DiagBreak();
@@ -10200,6 +10301,7 @@ double gcamBinaryEnergy(GCA_MORPH *gcam, MRI *mri)
   double val;
   GCA_MORPH_NODE *gcamn;
 
+  GCAMallocColdNodes(gcam);
   sse = 0.0;
   Galigned = 0;
   for (x = 0; x < gcam->width; x++)
@@ -10236,10 +10338,10 @@ double gcamBinaryEnergy(GCA_MORPH *gcam, MRI *mri)
                  gcamn->label,
                  val);
 
-        if (error * error > gcamn->last_se) {
+        if (error * error > GCAMcoldNode(gcam, gcamn)->last_se) {
           DiagBreak();
         }
-        gcamn->last_se = error * error;
+        GCAMcoldNode(gcam, gcamn)->last_se = error * error;
       }
 
   return (sse * BIN_SCALE);
@@ -10260,6 +10362,7 @@ int gcamAreaIntensityTerm(
     return (NO_ERROR);
   }
 
+  GCAMallocColdNodes(gcam);
   mri_kernel = MRIgaussian1d(sigma, -1);
   wsize = MAX(MIN((2 * nint(4 * sigma) / 2) + 1, 7), 21);
   if ((Gdiag & DIAG_SHOW) && DIAG_VERBOSE_ON) {
@@ -10336,11 +10439,11 @@ int gcamAreaIntensityTerm(
           error = image_val;
           DiagBreak();
         }
-        gcamn->sum_ci_vi = sum_cv;
-        gcamn->sum_ci_vi_ui = sum_cuv;
+        GCAMcoldNode(gcam, gcamn)->sum_ci_vi = sum_cv;
+        GCAMcoldNode(gcam, gcamn)->sum_ci_vi_ui = sum_cuv;
 
         predicted_val = sum_cuv / sum_cv;
-        gcamn->predicted_val = predicted_val;
+        GCAMcoldNode(gcam, gcamn)->predicted_val = predicted_val;
       }
 
   for (x = 0; x < gcam->width; x++)
@@ -10363,9 +10466,9 @@ int gcamAreaIntensityTerm(
           one that pushes the node towards the image location with the predicted intensity
           one that squeezes or expands the node if it is brighter than the predicted val.
         */
-        error = image_val - gcamn->predicted_val;
+        error = image_val - GCAMcoldNode(gcam, gcamn)->predicted_val;
         gcamComputeMostLikelyDirection(
-            gcam, mri, gcamn->x, gcamn->y, gcamn->z, gcamn->predicted_val, mri_kernel, mri_nbhd, &Ix, &Iy, &Iz);
+            gcam, mri, gcamn->x, gcamn->y, gcamn->z, GCAMcoldNode(gcam, gcamn)->predicted_val, mri_kernel, mri_nbhd, &Ix, &Iy, &Iz);
 
         norm = sqrt(Ix * Ix + Iy * Iy + Iz * Iz);
         if (!FZERO(norm)) /* don't worry about magnitude of gradient */
@@ -10419,7 +10522,7 @@ int gcamAreaIntensityTerm(
                  gcamn->gc->means[0],
                  gcamn->area);
           printf("            partial volume intensity = %2.1f (error = %2.1f), gradI(%2.3f, %2.3f, %2.3f)\n",
-                 gcamn->predicted_val,
+                 GCAMcoldNode(gcam, gcamn)->predicted_val,
                  error,
                  dxI,
                  dyI,
@@ -13674,6 +13777,7 @@ int gcamDistanceTransformTerm(GCA_MORPH *gcam, MRI *mri_source, MRI *mri, double
   if (DZERO(l_dtrans)) {
     return (NO_ERROR);
   }
+  GCAMallocColdNodes(gcam);
   for (x = 0; x < gcam->width; x++)
     for (y = 0; y < gcam->height; y++)
       for (z = 0; z < gcam->depth; z++) {
@@ -13692,7 +13796,7 @@ int gcamDistanceTransformTerm(GCA_MORPH *gcam, MRI *mri_source, MRI *mri, double
         {
           MRIsampleVolumeGradientFrame(mri, gcamn->x, gcamn->y, gcamn->z, &dx, &dy, &dz, frame);
           MRIsampleVolumeFrameType(mri, gcamn->x, gcamn->y, gcamn->z, frame, SAMPLE_TRILINEAR, &dist);
-          error = (dist - gcamn->target_dist);
+          error = (dist - GCAMcoldNode(gcam, gcamn)->target_dist);
           if (x == Gx && y == Gy && z == Gz)
             printf("l_dtrans: node(%d,%d,%d, %s) -> (%2.1f,%2.1f,%2.1f), dist=%2.2f, T=%2.2f, D=(%2.1f,%2.1f,%2.1f)\n",
                    x,
@@ -13703,7 +13807,7 @@ int gcamDistanceTransformTerm(GCA_MORPH *gcam, MRI *mri_source, MRI *mri, double
                    gcamn->y,
                    gcamn->z,
                    dist,
-                   gcamn->target_dist,
+                   GCAMcoldNode(gcam, gcamn)->target_dist,
                    -error * dx,
                    -error * dy,
                    -error * dz);
@@ -13753,6 +13857,7 @@ double gcamDistanceTransformEnergy(GCA_MORPH *gcam, MRI *mri_source, MRI *mri, G
   GCA_MORPH_NODE *gcamn;
   double dist;
 
+  GCAMallocColdNodes(gcam);
   for (x = 0; x < gcam->width; x++)
     for (y = 0; y < gcam->height; y++)
       for (z = 0; z < gcam->depth; z++) {
@@ -13779,10 +13884,10 @@ double gcamDistanceTransformEnergy(GCA_MORPH *gcam, MRI *mri_source, MRI *mri, G
                    gcamn->y,
                    gcamn->z,
                    dist,
-                   gcamn->target_dist);
+                   GCAMcoldNode(gcam, gcamn)->target_dist);
 
           check_gcam(gcam);
-          dist -= (gcamn->target_dist);
+          dist -= (GCAMcoldNode(gcam, gcamn)->target_dist);
           sse += (dist * dist);
           if (!finitep(sse)) DiagBreak();
         }
@@ -13820,6 +13925,7 @@ int GCAMsetTargetDistancesForLabel(GCA_MORPH *gcam, MRI *mri_labels, MRI *mri_di
   int x, y, z, l, xv, yv, zv;
   GCA_MORPH_NODE *gcamn;
 
+  GCAMallocColdNodes(gcam);
   for (x = 0; x < gcam->width; x++) {
     for (y = 0; y < gcam->height; y++) {
       for (z = 0; z < gcam->depth; z++) {
@@ -13843,7 +13949,7 @@ int GCAMsetTargetDistancesForLabel(GCA_MORPH *gcam, MRI *mri_labels, MRI *mri_di
         if (x == Gx && y == Gy && z == Gz) {
           DiagBreak();
         }
-        gcamn->target_dist = MRIgetVoxVal(mri_dist, xv, yv, zv, 0);
+        GCAMcoldNode(gcam, gcamn)->target_dist = MRIgetVoxVal(mri_dist, xv, yv, zv, 0);
       }
     }
   }
@@ -16531,6 +16637,7 @@ GCA_MORPH *GCAMdownsample2(GCA_MORPH *gcam)
   gcam_dst->type = gcam->type;
   gcam_dst->m_affine = gcam->m_affine;
   gcam_dst->det = gcam->det;
+  if (gcam->cold_nodes) GCAMallocColdNodes(gcam_dst);
   // Averaging neighboring nodes not necessary: when applied, e.g. using
   // GCAMmorphToAtlas(), a weighted mean is computed. Interpolating twice
   // increases differences between downsampled and original warp.
@@ -16548,10 +16655,6 @@ GCA_MORPH *GCAMdownsample2(GCA_MORPH *gcam)
         node_dst->origy = node_src->origy;
         node_dst->origz = node_src->origz;
 
-        node_dst->xs2 = node_src->xs2;
-        node_dst->ys2 = node_src->ys2;
-        node_dst->zs2 = node_src->zs2;
-
         node_dst->xs = node_src->xs;
         node_dst->ys = node_src->ys;
         node_dst->zs = node_src->zs;
@@ -16560,10 +16663,6 @@ GCA_MORPH *GCAMdownsample2(GCA_MORPH *gcam)
         node_dst->yn = node_src->yn;
         node_dst->zn = node_src->zn;
 
-        node_dst->saved_origx = node_src->saved_origx;
-        node_dst->saved_origy = node_src->saved_origy;
-        node_dst->saved_origz = node_src->saved_origz;
-
         node_dst->prior = node_src->prior;
         node_dst->area = node_src->area;
         node_dst->area1 = node_src->area1;
@@ -16573,6 +16672,17 @@ GCA_MORPH *GCAMdownsample2(GCA_MORPH *gcam)
         node_dst->invalid = node_src->invalid;
         node_dst->status = node_src->status;
         node_dst->label = node_src->label;
+
+        if (gcam->cold_nodes) {
+          GCA_MORPH_NODE_COLD const *cold_src = GCAMcoldNode(gcam, node_src);
+          GCA_MORPH_NODE_COLD *cold_dst = GCAMcoldNode(gcam_dst, node_dst);
+          cold_dst->xs2 = cold_src->xs2;
+          cold_dst->ys2 = cold_src->ys2;
+          cold_dst->zs2 = cold_src->zs2;
+          cold_dst->saved_origx = cold_src->saved_origx;
+          cold_dst->saved_origy = cold_src->saved_origy;
+          cold_dst->saved_origz = cold_src->saved_origz;
+        }
       }
     }
   }
@@ -17335,7 +17445,6 @@ MRI *GCAMtoMRI(GCAM *gcam, MRI *mri)
 
 GCA_MORPH *GCAMcopy(const GCA_MORPH *gcamsrc, GCA_MORPH *gcamdst)
 {
-  int c, r, s;
   if (gcamdst && (gcamdst->width != gcamsrc->width ||
                   gcamdst->height != gcamsrc->height ||
                   gcamdst->depth != gcamsrc->depth) ) {
@@ -17370,12 +17479,11 @@ GCA_MORPH *GCAMcopy(const GCA_MORPH *gcamsrc, GCA_MORPH *gcamdst)
   gcamdst->det = gcamsrc->det;
   gcamdst->type = gcamsrc->type;
   // Only GC1D pointer in node, target doesn't not get saved.
-  for (c=0; c<gcamsrc->width; c++) {
-    for (r=0; r<gcamsrc->height; r++) {
-      for (s=0; s<gcamsrc->depth; s++) {
-        memcpy(&gcamdst->nodes[c][r][s], &gcamsrc->nodes[c][r][s], sizeof(GMN));
-      }
-    }
+  size_t const nnodes = (size_t)gcamsrc->width * gcamsrc->height * gcamsrc->depth;
+  memcpy(gcamdst->node_store, gcamsrc->node_store, nnodes * sizeof(GMN));
+  if (gcamsrc->cold_nodes) {
+    GCAMallocColdNodes(gcamdst);
+    memcpy(gcamdst->cold_nodes, gcamsrc->cold_nodes, nnodes * sizeof(GMNC));
   }
   gcamdst->vgcam_ms = gcamsrc->vgcam_ms; // Not saved.
   return (gcamdst);
@@ -28,6 +28,9 @@ extern const char *Progname;
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "faster_variants.h"
 #include "romp_support.h"
 
@@ -52,6 +55,7 @@ extern const char *Progname;
 #include "voxlist.h"
 
 #include "mri.h"
+#include "mri_iterate.h"
 #include "log.h"
 
 extern int errno;
@@ -11468,6 +11472,193 @@ MRI *MRIlinearTransform(MRI *mri_src, MRI *mri_dst, MATRIX *mA)
   mri_dst = MRIlinearTransformInterp(mri_src, mri_dst, mA, SAMPLE_TRILINEAR);
   return (mri_dst);
 }
+/*-------------------------------------------------------------------
+  The MRIlinearTransformInterp engine. Each slice of the destination is
+  done a row at a time: the source coordinates of the row are computed
+  with the per row products hoisted, the type switch is done once per
+  slice, the interpolation weights are computed once per voxel and
+  applied to every frame, and the row is written with MRIsetRowVals.
+
+  The results are bit for bit those of the per voxel MatrixMultiply,
+  MRIsampleVolumeFrameType / MRIsampleBSpline and MRIsetVoxVal calls:
+  the coordinates are summed in float in MatrixMultiply's order (so they
+  are not stepped by adding the first column, which would drift), and
+  the samples use the same clamping, weights and summation order.
+  ------------------------------------------------------------------*/
+static void mriLinearTransformRowCoords(float const A[3][4], int y2, int y3, int width, double *xs, double *ys, double *zs)
+{
+  float const x2 = (float)y2, x3 = (float)y3;
+  float const p12 = A[0][1] * x2, p13 = A[0][2] * x3;
+  float const p22 = A[1][1] * x2, p23 = A[1][2] * x3;
+  float const p32 = A[2][1] * x2, p33 = A[2][2] * x3;
+  int y1;
+  for (y1 = 0; y1 < width; y1++) {
+    float const x1 = (float)y1;
+    float const u = 0.0f + A[0][0] * x1 + p12 + p13 + A[0][3];
+    float const v = 0.0f + A[1][0] * x1 + p22 + p23 + A[1][3];
+    float const w = 0.0f + A[2][0] * x1 + p32 + p33 + A[2][3];
+    xs[y1] = u;
+    ys[y1] = v;
+    zs[y1] = w;
+  }
+}
+
+template <class T>
+static void mriLinearTransformSampleRow(MRI const *mri_src,
+                                        int InterpMethod,
+                                        int width,
+                                        double const *xs,
+                                        double const *ys,
+                                        double const *zs,
+                                        float *vals)  // frame f of the row at f*width
+{
+  int const nframes = mri_src->nframes;
+  int const swidth = mri_src->width, sheight = mri_src->height, sdepth = mri_src->depth;
+  float const outside_val = mri_src->outside_val;
+  int y1, frame;
+
+  for (y1 = 0; y1 < width; y1++) {
+    double x = xs[y1], y = ys[y1], z = zs[y1];
+
+    if (MRIindexNotInVolume(mri_src, x, y, z) == 1) {
+      for (frame = 0; frame < nframes; frame++) vals[frame * width + y1] = outside_val;
+      continue;
+    }
+
+    if (InterpMethod == SAMPLE_NEAREST || (FEQUAL((int)x, x) && FEQUAL((int)y, y) && FEQUAL((int)z, z))) {
+      int xv = nint(x), yv = nint(y), zv = nint(z);
+      if (xv < 0) xv = 0;
+      if (xv >= swidth) xv = swidth - 1;
+      if (yv < 0) yv = 0;
+      if (yv >= sheight) yv = sheight - 1;
+      if (zv < 0) zv = 0;
+      if (zv >= sdepth) zv = sdepth - 1;
+      for (frame = 0; frame < nframes; frame++)
+        vals[frame * width + y1] = (double)(float)MRIrow<T>(mri_src, yv, zv, frame)[xv];
+      continue;
+    }
+
+    // SAMPLE_TRILINEAR, as MRIsampleVolumeFrame
+    if (x >= swidth) x = swidth - 1.0;
+    if (y >= sheight) y = sheight - 1.0;
+    if (z >= sdepth) z = sdepth - 1.0;
+    if (x < 0.0) x = 0.0;
+    if (y < 0.0) y = 0.0;
+    if (z < 0.0) z = 0.0;
+
+    int const xm = MAX((int)x, 0);
+    int const xp = MIN(swidth - 1, xm + 1);
+    int const ym = MAX((int)y, 0);
+    int const yp = MIN(sheight - 1, ym + 1);
+    int const zm = MAX((int)z, 0);
+    int const zp = MIN(sdepth - 1, zm + 1);
+
+    double const xmd = x - (float)xm;
+    double const ymd = y - (float)ym;
+    double const zmd = z - (float)zm;
+    double const xpd = (1.0f - xmd);
+    double const ypd = (1.0f - ymd);
+    double const zpd = (1.0f - zmd);
+
+    double const wmmm = xpd * ypd * zpd, wmmp = xpd * ypd * zmd;
+    double const wmpm = xpd * ymd * zpd, wmpp = xpd * ymd * zmd;
+    double const wpmm = xmd * ypd * zpd, wpmp = xmd * ypd * zmd;
+    double const wppm = xmd * ymd * zpd, wppp = xmd * ymd * zmd;
+
+    for (frame = 0; frame < nframes; frame++) {
+      T const *rmm = MRIrow<T>(mri_src, ym, zm, frame);
+      T const *rmp = MRIrow<T>(mri_src, ym, zp, frame);
+      T const *rpm = MRIrow<T>(mri_src, yp, zm, frame);
+      T const *rpp = MRIrow<T>(mri_src, yp, zp, frame);
+      vals[frame * width + y1] = wmmm * (double)rmm[xm] + wmmp * (double)rmp[xm] + wmpm * (double)rpm[xm] +
+                                 wmpp * (double)rpp[xm] + wpmm * (double)rmm[xp] + wpmp * (double)rmp[xp] +
+                                 wppm * (double)rpm[xp] + wppp * (double)rpp[xp];
+    }
+  }
+}
+
+static void mriLinearTransformBSplineRow(
+    MRI_BSPLINE const *bspline, int width, double const *xs, double const *ys, double const *zs, float *vals, float *valvect)
+{
+  int const nframes = bspline->coeff->nframes;
+  int y1, frame;
+  for (y1 = 0; y1 < width; y1++) {
+    MRIsampleSeqBSpline(bspline, xs[y1], ys[y1], zs[y1], valvect, 0, nframes - 1);
+    for (frame = 0; frame < nframes; frame++) vals[frame * width + y1] = valvect[frame];
+  }
+}
+
+// The source types the row engine samples; the others go through MRIsampleVolumeFrameType
+static bool mriLinearTransformRowTypeOk(int type)
+{
+  switch (type) {
+  case MRI_UCHAR:
+  case MRI_SHORT:
+  case MRI_USHRT:
+  case MRI_INT:
+  case MRI_FLOAT:
+    return true;
+  }
+  return false;
+}
+
+static void mriLinearTransformInterpRows(
+    MRI *mri_src, MRI *mri_dst, MATRIX *mAinv, int InterpMethod, MRI_BSPLINE const *bspline)
+{
+  float A[3][4];
+  int r, c;
+  for (r = 0; r < 3; r++)
+    for (c = 0; c < 4; c++) A[r][c] = mAinv->rptr[r + 1][c + 1];
+
+  int const width = mri_dst->width, height = mri_dst->height, depth = mri_dst->depth;
+  int const nframes = mri_src->nframes;
+  int y3;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic, 1)
+#endif
+  for (y3 = 0; y3 < depth; y3++) {
+    ROMP_PFLB_begin
+
+    std::vector<double> xs(width), ys(width), zs(width);
+    std::vector<float>  vals((size_t)width * nframes);
+    std::vector<float>  valvect(nframes);
+    int y2, frame;
+
+    for (y2 = 0; y2 < height; y2++) {
+      mriLinearTransformRowCoords(A, y2, y3, width, &xs[0], &ys[0], &zs[0]);
+
+      if (bspline)
+        mriLinearTransformBSplineRow(bspline, width, &xs[0], &ys[0], &zs[0], &vals[0], &valvect[0]);
+      else
+        switch (mri_src->type) {
+        case MRI_UCHAR:
+          mriLinearTransformSampleRow<unsigned char>(mri_src, InterpMethod, width, &xs[0], &ys[0], &zs[0], &vals[0]);
+          break;
+        case MRI_SHORT:
+          mriLinearTransformSampleRow<short>(mri_src, InterpMethod, width, &xs[0], &ys[0], &zs[0], &vals[0]);
+          break;
+        case MRI_USHRT:
+          mriLinearTransformSampleRow<unsigned short>(mri_src, InterpMethod, width, &xs[0], &ys[0], &zs[0], &vals[0]);
+          break;
+        case MRI_INT:
+          mriLinearTransformSampleRow<int>(mri_src, InterpMethod, width, &xs[0], &ys[0], &zs[0], &vals[0]);
+          break;
+        case MRI_FLOAT:
+          mriLinearTransformSampleRow<float>(mri_src, InterpMethod, width, &xs[0], &ys[0], &zs[0], &vals[0]);
+          break;
+        }
+
+      // will clip the vals according to mri_dst type:
+      for (frame = 0; frame < nframes; frame++) MRIsetRowVals(mri_dst, y2, y3, frame, &vals[(size_t)frame * width]);
+    }
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
 /*-------------------------------------------------------------------
   MRIlinearTransformInterp() Perform linear coordinate transformation
   x' = Ax on the MRI image mri_src into mri_dst using the specified
@@ -11503,6 +11694,17 @@ MRI *MRIlinearTransformInterp(MRI *mri_src, MRI *mri_dst, MATRIX *mA, int Interp
   MRI_BSPLINE *bspline = NULL;
   if (InterpMethod == SAMPLE_CUBIC_BSPLINE) bspline = MRItoBSpline(mri_src, NULL, 3);
 
+  if ((InterpMethod == SAMPLE_NEAREST || InterpMethod == SAMPLE_TRILINEAR || InterpMethod == SAMPLE_CUBIC_BSPLINE) &&
+      mAinv->type == MATRIX_REAL && (bspline || mriLinearTransformRowTypeOk(mri_src->type)) &&
+      mri_dst->type != MRI_FLOAT_COMPLEX) {
+    mriLinearTransformInterpRows(mri_src, mri_dst, mAinv, InterpMethod, bspline);
+    if (bspline) MRIfreeBSpline(&bspline);
+    MatrixFree(&mAinv);
+    mri_dst->ras_good_flag = 1;
+    return (mri_dst);
+  }
+
+  // the other interpolation methods and source types, a voxel at a time
   width = mri_dst->width;
   height = mri_dst->height;
   depth = mri_dst->depth;
@@ -14515,6 +14717,168 @@ float MRIvoxelsInLabelWithPartialVolumeEffects(
   return (volume);
 }
 
+/*
+  MRIvoxelsInLabelsWithPartialVolumeEffects() - computes the partial volume
+  corrected volume of each of the nlabels labels, giving the same result as
+  calling MRIvoxelsInLabelWithPartialVolumeEffects() once per label but in a
+  single pass over the volume. A border voxel only ever contributes to its own
+  label and to the neighboring label chosen for it, and that choice does not
+  depend on the label being measured, so the neighborhood statistics are
+  computed once per voxel instead of once per voxel per label. The
+  contributions are gathered per x plane and summed in the original x,y,z
+  order so that the (float) volumes match the single label version exactly.
+  Labels outside [0,maxlabels) are passed to the single label version.
+*/
+int MRIvoxelsInLabelsWithPartialVolumeEffects(
+    const MRI *mri, const MRI *mri_vals, const int nlabels, const int *labels, float *volumes)
+{
+  enum { maxlabels = 20000 };
+  typedef struct {
+    int index;
+    float vol;
+  } PV_CONTRIBUTION;
+
+  const float vox_vol = mri->xsize * mri->ysize * mri->zsize;
+  std::vector<int> label_index(maxlabels, -1);
+  int n;
+
+  for (n = 0; n < nlabels; n++) {
+    volumes[n] = 0;
+    if (labels[n] < 0 || labels[n] >= maxlabels) {
+      volumes[n] = MRIvoxelsInLabelWithPartialVolumeEffects(mri, mri_vals, labels[n], NULL, NULL);
+      continue;
+    }
+    if (label_index[labels[n]] < 0) label_index[labels[n]] = n;
+  }
+
+  std::vector<std::vector<PV_CONTRIBUTION> > planes(mri->width);
+
+  int x;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+  for (x = 0; x < mri->width; x++) {
+    ROMP_PFLB_begin
+    std::vector<PV_CONTRIBUTION> &plane = planes[x];
+    // only the entries touched by the current neighborhood are cleared again
+    std::vector<int> label_counts(maxlabels, 0);
+    std::vector<float> label_means(maxlabels, 0);
+    std::vector<int> nbhd_labels, nbr_labels;
+    int y, z, xk, yk, zk, i;
+
+    for (y = 0; y < mri->height; y++) {
+      for (z = 0; z < mri->depth; z++) {
+        const int vox_label = MRIgetVoxVal(mri, x, y, z, 0);
+        const int vox_index = (vox_label >= 0 && vox_label < maxlabels) ? label_index[vox_label] : -1;
+
+        /* labels of the 6-connected neighbors, i.e. the labels for which
+           MRImarkLabelBorderVoxels() would mark this voxel */
+        int face_labels[6], nface = 0, any_wanted = 0;
+        for (xk = -1; xk <= 1; xk++) {
+          for (yk = -1; yk <= 1; yk++) {
+            for (zk = -1; zk <= 1; zk++) {
+              if (abs(xk) + abs(yk) + abs(zk) != 1) continue;
+              const int that_label =
+                  MRIgetVoxVal(mri, mri->xi[x + xk], mri->yi[y + yk], mri->zi[z + zk], 0);
+              if (that_label == vox_label) continue;
+              face_labels[nface++] = that_label;
+              if (that_label >= 0 && that_label < maxlabels && label_index[that_label] >= 0) any_wanted = 1;
+            }
+          }
+        }
+
+        if (nface == 0) {
+          if (vox_index >= 0) plane.push_back({vox_index, vox_vol});
+          continue;
+        }
+        if (vox_index < 0 && !any_wanted) continue;
+
+        /* compute partial volume as in MRIcomputeLabelNbhd() with whalf 1 and 7 */
+        nbr_labels.clear();
+        for (xk = -1; xk <= 1; xk++) {
+          const int xi = mri->xi[x + xk];
+          for (yk = -1; yk <= 1; yk++) {
+            const int yi = mri->yi[y + yk];
+            for (zk = -1; zk <= 1; zk++) {
+              const int label = MRIgetVoxVal(mri, xi, yi, mri->zi[z + zk], 0);
+              if (label < 0 || label >= maxlabels || label == vox_label) continue;
+              if (std::find(nbr_labels.begin(), nbr_labels.end(), label) == nbr_labels.end())
+                nbr_labels.push_back(label);
+            }
+          }
+        }
+        std::sort(nbr_labels.begin(), nbr_labels.end());
+
+        nbhd_labels.clear();
+        for (xk = -7; xk <= 7; xk++) {
+          const int xi = mri->xi[x + xk];
+          for (yk = -7; yk <= 7; yk++) {
+            const int yi = mri->yi[y + yk];
+            for (zk = -7; zk <= 7; zk++) {
+              const int zi = mri->zi[z + zk];
+              const int label = MRIgetVoxVal(mri, xi, yi, zi, 0);
+              if (label < 0 || label >= maxlabels) continue;
+              if (label_counts[label]++ == 0) nbhd_labels.push_back(label);
+              label_means[label] += MRIgetVoxVal(mri_vals, xi, yi, zi, 0);
+            }
+          }
+        }
+        for (i = 0; i < (int)nbhd_labels.size(); i++) {
+          label_means[nbhd_labels[i]] /= label_counts[nbhd_labels[i]];
+        }
+
+        const float val = MRIgetVoxVal(mri_vals, x, y, z, 0);
+        const float mean_label = (vox_label >= 0 && vox_label < maxlabels) ? label_means[vox_label] : 0;
+        int nbr_label = -1, max_count = 0;
+
+        /* look for a label that is a nbr and is
+           on the other side of val from the label mean */
+        for (i = 0; i < (int)nbr_labels.size(); i++) {
+          const int this_label = nbr_labels[i];
+          if ((label_counts[this_label] > max_count) && ((label_means[this_label] - val) * (mean_label - val) < 0)) {
+            max_count = label_counts[this_label];
+            nbr_label = this_label;
+          }
+        }
+
+        if (max_count == 0) {
+          if (vox_index >= 0) plane.push_back({vox_index, vox_vol});  // couldn't find an appropriate label
+        }
+        else {
+          const float mean_nbr = label_means[nbr_label];
+          float pv = (val - mean_nbr) / (mean_label - mean_nbr);
+          if (pv > 1) pv = 1;
+          if (pv >= 0) {
+            if (vox_index >= 0) plane.push_back({vox_index, vox_vol * pv});
+            // the nbr label only counts this voxel if it is on its border
+            const int nbr_index = label_index[nbr_label];
+            if (nbr_index >= 0 && std::find(face_labels, face_labels + nface, nbr_label) != face_labels + nface)
+              plane.push_back({nbr_index, vox_vol * (1 - pv)});
+          }
+        }
+
+        for (i = 0; i < (int)nbhd_labels.size(); i++) {
+          label_counts[nbhd_labels[i]] = 0;
+          label_means[nbhd_labels[i]] = 0;
+        }
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  for (x = 0; x < mri->width; x++) {
+    for (n = 0; n < (int)planes[x].size(); n++) volumes[planes[x][n].index] += planes[x][n].vol;
+  }
+  for (n = 0; n < nlabels; n++) {
+    if (labels[n] >= 0 && labels[n] < maxlabels && label_index[labels[n]] != n)
+      volumes[n] = volumes[label_index[labels[n]]];
+  }
+
+  return (NO_ERROR);
+}
+
 MRI *MRImakeDensityMap(MRI *mri, MRI *mri_vals, int label, MRI *mri_dst, float orig_res)
 {
   float vox_vol, volume, current_res;
@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <vector>
+
 #include "bfileio.h"
 #include "cma.h"
 #include "corio.h"
@@ -41,6 +43,7 @@
 #include "mrimorph.h"
 #include "mri_identify.h"
 #include "mri2.h"
+#include "mri_iterate.h"
 
 //#define MRI2_TIMERS
 
@@ -876,7 +879,7 @@ MRI *MRIvol2VolLTA::vol2vol(MRI *outvol)
   ---------------------------------------------------------------*/
 int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
 {
-  int ct, show_progress_thread;
+  int st, show_progress_thread;
   int tid = 0;
   float *valvects[_MAX_FS_THREADS];
   int sinchw;
@@ -953,14 +956,19 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
   valvects[0] = (float *)calloc(sizeof(float), src->nframes);
 #endif
 
+  // Nearest neighbor reads go through a reader with the type dispatch done once.
+  // The target is filled a row at a time, slices in parallel, so the writes are
+  // contiguous and can be done by MRIsetRowVals.
+  MRIvoxelReader const srcVoxVal(src);
+
   ROMP_PF_begin
 #ifdef HAVE_OPENMP
   #pragma omp parallel for if_ROMP(assume_reproducible) shared(show_progress_thread, targ, bspline, src, Vt2s, InterpCode)
 #endif
-  for (ct = 0; ct < targ->width; ct++) {
+  for (st = 0; st < targ->depth; st++) {
     ROMP_PFLB_begin
     
-    int rt, st, f;
+    int rt, ct, f;
     int ics, irs, iss;
     float fcs, frs, fss, *valvect;
     double rval;
@@ -972,8 +980,15 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
     valvect = valvects[0];
 #endif
 
+    int const width = targ->width;
+    std::vector<float> rowvals((size_t)width * src->nframes);   // frame f of the row is at f*width
+    std::vector<char>  rowset(width);                          // targ voxels outside the source are left as they are
+
     for (rt = 0; rt < targ->height; rt++) {
-      for (st = 0; st < targ->depth; st++) {
+      int nset = 0;
+      for (ct = 0; ct < width; ct++) {
+        rowset[ct] = 0;
+
         /* Column in source corresponding to CRS in Target */
         fcs = Vt2s->rptr[1][1] * ct + Vt2s->rptr[1][2] * rt + Vt2s->rptr[1][3] * st + Vt2s->rptr[1][4];
         ics = nintfunc(fcs);
@@ -996,7 +1011,7 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
           for (f = 0; f < src->nframes; f++) {
             switch (InterpCode) {
               case SAMPLE_NEAREST:
-                valvect[f] = MRIgetVoxVal(src, ics, irs, iss, f);
+                valvect[f] = srcVoxVal(ics, irs, iss, f);
                 break;
               case SAMPLE_CUBIC_BSPLINE:
                 MRIsampleBSpline(bspline, fcs, frs, fss, f, &rval);
@@ -1013,11 +1028,22 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
           }
         }
 
-        for (f = 0; f < src->nframes; f++) MRIsetVoxVal(targ, ct, rt, st, f, valvect[f]);
+        for (f = 0; f < src->nframes; f++) rowvals[(size_t)f * width + ct] = valvect[f];
+        rowset[ct] = 1;
+        nset++;
 
       } /* target col */
+
+      for (f = 0; f < src->nframes; f++) {
+        float const * vals = &rowvals[(size_t)f * width];
+        if (nset == width)
+          MRIsetRowVals(targ, rt, st, f, vals);
+        else if (nset > 0)
+          for (ct = 0; ct < width; ct++)
+            if (rowset[ct]) MRIsetVoxVal(targ, ct, rt, st, f, vals[ct]);
+      }
     }   /* target row */
-    if (tid == show_progress_thread) exec_progress_callback(ct, targ->width, 0, 1);
+    if (tid == show_progress_thread) exec_progress_callback(st, targ->depth, 0, 1);
     ROMP_PFLB_end
   } /* target slice */
   ROMP_PF_end
@@ -3800,20 +3826,23 @@ int MRIsegStats(MRI *seg, int segid, MRI *mri, int frame, float *min, float *max
 {
   int id, nvoxels, r, c, s;
   double val, sum, sum2;
+  std::vector<float> segrow(seg->width), mrirow(seg->width);
 
   *min = 0;
   *max = 0;
   sum = 0;
   sum2 = 0;
   nvoxels = 0;
-  for (c = 0; c < seg->width; c++) {
+  for (s = 0; s < seg->depth; s++) {
     for (r = 0; r < seg->height; r++) {
-      for (s = 0; s < seg->depth; s++) {
-        id = (int)MRIgetVoxVal(seg, c, r, s, 0);
+      MRIgetRowVals(seg, r, s, 0, &segrow[0]);
+      MRIgetRowVals(mri, r, s, frame, &mrirow[0]);
+      for (c = 0; c < seg->width; c++) {
+        id = (int)segrow[c];
         if (id != segid) {
           continue;
         }
-        val = MRIgetVoxVal(mri, c, r, s, frame);
+        val = mrirow[c];
         nvoxels++;
         if (nvoxels == 1) {
           *min = val;
@@ -3849,6 +3878,53 @@ int MRIsegStats(MRI *seg, int segid, MRI *mri, int frame, float *min, float *max
   return (nvoxels);
 }
 /*------------------------------------------------------------*/
+/*!
+  \fn static int MRIsegStatsSortedTrimmed(float *vlist, int nvoxels,
+                      float *min, float *max, float *range,
+                      float *mean, float *std, float Pct)
+  \brief Sorts the nvoxels values in vlist and computes the stats of
+         MRIsegStatsRobust() over the middle 100-2*Pct values. Returns
+         the number of values kept.
+*/
+static int MRIsegStatsSortedTrimmed(
+    float *vlist, int nvoxels, float *min, float *max, float *range, float *mean, float *std, float Pct)
+{
+  int k, m;
+  double val, sum, sum2;
+
+  // Sort the array
+  qsort((void *)vlist, nvoxels, sizeof(float), compare_floats);
+
+  // Compute stats excluding Pct of the values from each end
+  sum = 0;
+  sum2 = 0;
+  m = 0;
+  // printf("Robust Indices: %d %d\n",(int)nint(Pct*nvoxels/100.0),(int)nint((100-Pct)*nvoxels/100.0));
+  for (k = 0; k < nvoxels; k++) {
+    if (k < Pct * nvoxels / 100.0) continue;
+    if (k > (100 - Pct) * nvoxels / 100.0) continue;
+    val = vlist[k];
+    if (m == 0) {
+      *min = val;
+      *max = val;
+    }
+    if (*min > val) *min = val;
+    if (*max < val) *max = val;
+    sum += val;
+    sum2 += (val * val);
+    m = m + 1;
+  }
+
+  *range = *max - *min;
+  *mean = sum / m;
+  if (m > 1)
+    *std = sqrt(((m) * (*mean) * (*mean) - 2 * (*mean) * sum + sum2) / (m - 1));
+  else
+    *std = 0.0;
+
+  return (m);
+}
+/*------------------------------------------------------------*/
 /*!
   \fn int MRIsegStatsRobust(MRI *seg, int segid, MRI *mri,int frame,
                       float *min, float *max, float *range,
@@ -3859,8 +3935,7 @@ int MRIsegStats(MRI *seg, int segid, MRI *mri, int frame, float *min, float *max
 int MRIsegStatsRobust(
     MRI *seg, int segid, MRI *mri, int frame, float *min, float *max, float *range, float *mean, float *std, float Pct)
 {
-  int id, nvoxels, r, c, s, k, m;
-  double val, sum, sum2;
+  int id, nvoxels, r, c, s, m;
   float *vlist;
 
   *min = 0;
@@ -3895,35 +3970,7 @@ int MRIsegStatsRobust(
       }
     }
   }
-  // Sort the array
-  qsort((void *)vlist, nvoxels, sizeof(float), compare_floats);
-
-  // Compute stats excluding Pct of the values from each end
-  sum = 0;
-  sum2 = 0;
-  m = 0;
-  // printf("Robust Indices: %d %d\n",(int)nint(Pct*nvoxels/100.0),(int)nint((100-Pct)*nvoxels/100.0));
-  for (k = 0; k < nvoxels; k++) {
-    if (k < Pct * nvoxels / 100.0) continue;
-    if (k > (100 - Pct) * nvoxels / 100.0) continue;
-    val = vlist[k];
-    if (m == 0) {
-      *min = val;
-      *max = val;
-    }
-    if (*min > val) *min = val;
-    if (*max < val) *max = val;
-    sum += val;
-    sum2 += (val * val);
-    m = m + 1;
-  }
-
-  *range = *max - *min;
-  *mean = sum / m;
-  if (m > 1)
-    *std = sqrt(((m) * (*mean) * (*mean) - 2 * (*mean) * sum + sum2) / (m - 1));
-  else
-    *std = 0.0;
+  m = MRIsegStatsSortedTrimmed(vlist, nvoxels, min, max, range, mean, std, Pct);
 
   free(vlist);
   vlist = NULL;
@@ -3937,8 +3984,9 @@ int MRIsegStatsRobust(
   ---------------------------------------------------------*/
 int MRIsegFrameAvg(MRI *seg, int segid, MRI *mri, double *favg)
 {
-  int id, nvoxels, r, c, s, f;
-  double val;
+  int nvoxels, r, c, s, f;
+  std::vector<float> segrow(seg->width), mrirow(seg->width);
+  std::vector<char> inseg(seg->width);
 
   /* zero it out */
   for (f = 0; f < mri->nframes; f++) {
@@ -3946,19 +3994,22 @@ int MRIsegFrameAvg(MRI *seg, int segid, MRI *mri, double *favg)
   }
 
   nvoxels = 0;
-  for (c = 0; c < seg->width; c++) {
+  for (s = 0; s < seg->depth; s++) {
     for (r = 0; r < seg->height; r++) {
-      for (s = 0; s < seg->depth; s++) {
-        id = (int)MRIgetVoxVal(seg, c, r, s, 0);
-        if (id != segid) {
-          continue;
-        }
-        for (f = 0; f < mri->nframes; f++) {
-          val = MRIgetVoxVal(mri, c, r, s, f);
-          favg[f] += val;
+      MRIgetRowVals(seg, r, s, 0, &segrow[0]);
+      int nrow = 0;
+      for (c = 0; c < seg->width; c++) {
+        inseg[c] = ((int)segrow[c] == segid);
+        nrow += inseg[c];
+      }
+      if (nrow == 0) continue;
+      for (f = 0; f < mri->nframes; f++) {
+        MRIgetRowVals(mri, r, s, f, &mrirow[0]);
+        for (c = 0; c < seg->width; c++) {
+          if (inseg[c]) favg[f] += mrirow[c];
         }
-        nvoxels++;
       }
+      nvoxels += nrow;
     }
   }
 
@@ -3970,6 +4021,231 @@ int MRIsegFrameAvg(MRI *seg, int segid, MRI *mri, double *favg)
   return (nvoxels);
 }
 
+/*---------------------------------------------------------
+  MRIsegStatsMulti() - computes for each of the nsegs ids in segids the
+  number of voxels (as MRIsegCount()), the stats of MRIsegStats() (or of
+  MRIsegStatsRobust() if UseRobust) in the given frame of mri, and, if favg
+  is non-NULL, the frame average of MRIsegFrameAvg() into the favg[n]
+  arrays of mri->nframes. Instead of scanning the volume once per id, seg
+  and mri are read row by row in a single pass. The slices are split into a
+  fixed number of slabs whose partial sums are reduced in slab order, so the
+  result does not depend on the number of threads. Robust stats gather the
+  values of each segment into its part of one buffer during a second pass.
+  mri may be NULL if only the counts are wanted, and any of the stat
+  outputs may be NULL.
+  ---------------------------------------------------------*/
+#define MRI_SEG_STATS_MULTI_MAX_SLABS 32
+
+typedef struct
+{
+  int nvoxels;
+  float min, max;
+  double sum, sum2;
+} MRI_SEG_STATS_PARTIAL;
+
+int MRIsegStatsMulti(MRI *seg,
+                     int nsegs,
+                     const int *segids,
+                     MRI *mri,
+                     int frame,
+                     int UseRobust,
+                     float Pct,
+                     int *nvoxels,
+                     float *min,
+                     float *max,
+                     float *range,
+                     float *mean,
+                     float *std,
+                     double **favg)
+{
+  int n, minid, maxid, nslabs, nframes, slab, f;
+
+  if (nsegs <= 0) return (0);
+  if (mri && (mri->width != seg->width || mri->height != seg->height || mri->depth != seg->depth))
+    ErrorReturn(ERROR_BADPARM, (ERROR_BADPARM, "MRIsegStatsMulti: seg and mri dimensions differ"));
+
+  // map each id to the first entry with that id
+  minid = maxid = segids[0];
+  for (n = 1; n < nsegs; n++) {
+    if (segids[n] < minid) minid = segids[n];
+    if (segids[n] > maxid) maxid = segids[n];
+  }
+  std::vector<int> segindex(maxid - minid + 1, -1);
+  for (n = 0; n < nsegs; n++)
+    if (segindex[segids[n] - minid] < 0) segindex[segids[n] - minid] = n;
+
+  nslabs = MIN(seg->depth, MRI_SEG_STATS_MULTI_MAX_SLABS);
+  nframes = (mri && favg) ? mri->nframes : 0;
+  std::vector<MRI_SEG_STATS_PARTIAL> partials(nslabs * nsegs, MRI_SEG_STATS_PARTIAL());
+  std::vector<double> fsums(nslabs * nsegs * nframes, 0.0);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+  for (slab = 0; slab < nslabs; slab++) {
+    ROMP_PFLB_begin
+    MRI_SEG_STATS_PARTIAL *slabpartials = &partials[slab * nsegs];
+    double *slabfsums = nframes ? &fsums[slab * nsegs * nframes] : NULL;
+    std::vector<float> segrow(seg->width), mrirow(seg->width);
+    std::vector<int> rowindex(seg->width);
+    int s, r, c, k, fr, nrow;
+
+    for (s = slab * seg->depth / nslabs; s < (slab + 1) * seg->depth / nslabs; s++) {
+      for (r = 0; r < seg->height; r++) {
+        MRIgetRowVals(seg, r, s, 0, &segrow[0]);
+        nrow = 0;
+        for (c = 0; c < seg->width; c++) {
+          const int id = (int)segrow[c];
+          rowindex[c] = (id >= minid && id <= maxid) ? segindex[id - minid] : -1;
+          if (rowindex[c] >= 0) nrow++;
+        }
+        if (nrow == 0) continue;
+
+        if (mri) MRIgetRowVals(mri, r, s, frame, &mrirow[0]);
+        for (c = 0; c < seg->width; c++) {
+          if (rowindex[c] < 0) continue;
+          MRI_SEG_STATS_PARTIAL *p = &slabpartials[rowindex[c]];
+          if (mri) {
+            const double val = mrirow[c];
+            if (p->nvoxels == 0) {
+              p->min = val;
+              p->max = val;
+            }
+            if (p->min > val) p->min = val;
+            if (p->max < val) p->max = val;
+            p->sum += val;
+            p->sum2 += (val * val);
+          }
+          p->nvoxels++;
+        }
+
+        for (fr = 0; fr < nframes; fr++) {
+          MRIgetRowVals(mri, r, s, fr, &mrirow[0]);
+          for (c = 0; c < seg->width; c++) {
+            k = rowindex[c];
+            if (k >= 0) slabfsums[k * nframes + fr] += mrirow[c];
+          }
+        }
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // reduce the slabs in order
+  std::vector<MRI_SEG_STATS_PARTIAL> totals(nsegs, MRI_SEG_STATS_PARTIAL());
+  for (n = 0; n < nsegs; n++) {
+    MRI_SEG_STATS_PARTIAL *t = &totals[n];
+    for (slab = 0; slab < nslabs; slab++) {
+      const MRI_SEG_STATS_PARTIAL *p = &partials[slab * nsegs + n];
+      if (p->nvoxels == 0) continue;
+      if (t->nvoxels == 0) {
+        t->min = p->min;
+        t->max = p->max;
+      }
+      if (t->min > p->min) t->min = p->min;
+      if (t->max < p->max) t->max = p->max;
+      t->sum += p->sum;
+      t->sum2 += p->sum2;
+      t->nvoxels += p->nvoxels;
+    }
+    if (favg && mri) {
+      for (f = 0; f < nframes; f++) {
+        favg[n][f] = 0;
+        for (slab = 0; slab < nslabs; slab++) favg[n][f] += fsums[(slab * nsegs + n) * nframes + f];
+        if (t->nvoxels != 0) favg[n][f] /= t->nvoxels;
+      }
+    }
+  }
+
+  std::vector<float> smin(nsegs, 0), smax(nsegs, 0), srange(nsegs, 0), smean(nsegs, 0), sstd(nsegs, 0);
+  if (mri && !UseRobust) {
+    for (n = 0; n < nsegs; n++) {
+      const MRI_SEG_STATS_PARTIAL *t = &totals[n];
+      if (t->nvoxels == 0) continue;
+      smin[n] = t->min;
+      smax[n] = t->max;
+      srange[n] = smax[n] - smin[n];
+      smean[n] = t->sum / t->nvoxels;
+      if (t->nvoxels > 1)
+        sstd[n] = sqrt(((t->nvoxels) * (smean[n]) * (smean[n]) - 2 * (smean[n]) * t->sum + t->sum2) / (t->nvoxels - 1));
+    }
+  }
+  else if (mri && UseRobust) {
+    // each segment gets the part of vlist starting at segstart, and
+    // each slab writes its voxels from slabstart on
+    std::vector<size_t> segstart(nsegs + 1, 0), slabstart(nslabs * nsegs, 0);
+    for (n = 0; n < nsegs; n++) {
+      segstart[n + 1] = segstart[n] + totals[n].nvoxels;
+      size_t start = segstart[n];
+      for (slab = 0; slab < nslabs; slab++) {
+        slabstart[slab * nsegs + n] = start;
+        start += partials[slab * nsegs + n].nvoxels;
+      }
+    }
+    std::vector<float> vlist(segstart[nsegs]);
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+    for (slab = 0; slab < nslabs; slab++) {
+      ROMP_PFLB_begin
+      std::vector<size_t> pos(slabstart.begin() + slab * nsegs, slabstart.begin() + (slab + 1) * nsegs);
+      std::vector<float> segrow(seg->width), mrirow(seg->width);
+      int s, r, c, id, k;
+
+      for (s = slab * seg->depth / nslabs; s < (slab + 1) * seg->depth / nslabs; s++) {
+        for (r = 0; r < seg->height; r++) {
+          MRIgetRowVals(seg, r, s, 0, &segrow[0]);
+          int loaded = 0;
+          for (c = 0; c < seg->width; c++) {
+            id = (int)segrow[c];
+            if (id < minid || id > maxid) continue;
+            k = segindex[id - minid];
+            if (k < 0) continue;
+            if (!loaded) {
+              MRIgetRowVals(mri, r, s, frame, &mrirow[0]);
+              loaded = 1;
+            }
+            vlist[pos[k]++] = mrirow[c];
+          }
+        }
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+    for (n = 0; n < nsegs; n++) {
+      ROMP_PFLB_begin
+      if (totals[n].nvoxels > 0)
+        MRIsegStatsSortedTrimmed(
+            &vlist[segstart[n]], totals[n].nvoxels, &smin[n], &smax[n], &srange[n], &smean[n], &sstd[n], Pct);
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+  }
+
+  for (n = 0; n < nsegs; n++) {
+    const int k = segindex[segids[n] - minid];
+    if (nvoxels) nvoxels[n] = totals[k].nvoxels;
+    if (min) min[n] = smin[k];
+    if (max) max[n] = smax[k];
+    if (range) range[n] = srange[k];
+    if (mean) mean[n] = smean[k];
+    if (std) std[n] = sstd[k];
+    if (k != n && favg && mri)
+      for (f = 0; f < nframes; f++) favg[n][f] = favg[k][f];
+  }
+
+  return (NO_ERROR);
+}
+
 MRI *MRImask_with_T2_and_aparc_aseg(
     MRI *mri_src, MRI *mri_dst, MRI *mri_T2, MRI *mri_aparc_aseg, float T2_thresh, int mm_from_exterior)
 {
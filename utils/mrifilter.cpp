@@ -2634,6 +2634,294 @@ MRI *MRIconvolveGaussian(MRI *mri_src, MRI *mri_dst, MRI *mri_gaussian)
   return (mri_dst);
 }
 
+/*-----------------------------------------------------
+  Recursive (IIR) Gaussian smoothing.
+
+  Deriche's 4th order approximation (R. Deriche, "Recursively
+  implementing the Gaussian and its derivatives", INRIA RR-1893, 1993)
+  splits the kernel into a causal and an anticausal part, each a sum of
+  two damped cosines, so every axis pass costs 16 multiply-adds per
+  voxel whatever the sigma. The two parts are run separately and added,
+  and both start in the steady state of the border voxel, which is
+  exactly the replicated border that MRIconvolve1d() gets from xi/yi/zi.
+
+  Accuracy against a normalized sampled Gaussian of the same sigma: the
+  kernel sums to 1 to double precision, the largest deviation is at
+  most 0.05% of the kernel peak and the effective standard deviation is
+  within 0.3% of sigma for 1 <= sigma <= 40 voxels. Below 1 voxel the
+  effective width drifts (7% narrow at sigma 0.5). A short FIR kernel is
+  also cheaper there: the two cost the same at about 3 voxels, which is
+  where MRIgaussianSmoothNI() switches (MRI_GAUSSIAN_IIR_MIN_SIGMA).
+  MRIgaussianSmoothNI() convolves with a sampled Gaussian, so the two
+  paths there differ by the deviation above. Note that MRIgaussian1d()
+  kernels are not pure Gaussians (the tails beyond 2 sigma are a
+  quartic) and differ from one by up to 0.26% of the peak, so the
+  recursive filter and MRIconvolveGaussian() differ by about that much
+  per axis.
+------------------------------------------------------*/
+typedef struct
+{
+  double n[4];            // causal numerator, taps x[i] .. x[i-3]
+  double m[5];            // anticausal numerator, taps x[i+1] .. x[i+4] (m[0] unused)
+  double d[5];            // shared denominator, d[0] == 1
+  double causal_gain;     // causal response to a constant 1
+  double anticausal_gain; // anticausal response to a constant 1
+} GAUSSIAN_IIR;
+
+static void mriGaussianIIRinit(GAUSSIAN_IIR *g, double sigma)
+{
+  static const double a0 = 1.680, a1 = 3.735, b0 = 1.783, b1 = 1.723;
+  static const double c0 = -0.6803, c1 = -0.2598, w0 = 0.6318, w1 = 1.997;
+  double e0, e1, den0[3], den1[3], num0[2], num1[2], nsum, msum, dsum, norm;
+  int i, j;
+
+  e0 = exp(-b0 / sigma);
+  e1 = exp(-b1 / sigma);
+  den0[0] = 1;
+  den0[1] = -2 * e0 * cos(w0 / sigma);
+  den0[2] = e0 * e0;
+  den1[0] = 1;
+  den1[1] = -2 * e1 * cos(w1 / sigma);
+  den1[2] = e1 * e1;
+  num0[0] = a0;
+  num0[1] = -e0 * (a0 * cos(w0 / sigma) - a1 * sin(w0 / sigma));
+  num1[0] = c0;
+  num1[1] = -e1 * (c0 * cos(w1 / sigma) - c1 * sin(w1 / sigma));
+
+  // causal part: num0/den0 + num1/den1 over the common denominator
+  memset(g, 0, sizeof(*g));
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 3; j++) g->d[i + j] += den0[i] * den1[j];
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 3; j++) g->n[i + j] += num0[i] * den1[j] + num1[i] * den0[j];
+
+  // anticausal part is the mirror image without the center tap
+  for (i = 1; i < 4; i++) g->m[i] = g->n[i] - g->d[i] * g->n[0];
+  g->m[4] = -g->d[4] * g->n[0];
+
+  // scale so that the whole kernel sums to 1
+  nsum = g->n[0] + g->n[1] + g->n[2] + g->n[3];
+  msum = g->m[1] + g->m[2] + g->m[3] + g->m[4];
+  dsum = g->d[0] + g->d[1] + g->d[2] + g->d[3] + g->d[4];
+  norm = dsum / (nsum + msum);
+  for (i = 0; i < 4; i++) g->n[i] *= norm;
+  for (i = 1; i < 5; i++) g->m[i] *= norm;
+  g->causal_gain = nsum * norm / dsum;
+  g->anticausal_gain = msum * norm / dsum;
+}
+
+/*
+  Filters n rows of width values along the row index: x[i] points to
+  input row i for -4 <= i < n+4 (border rows repeated, or rows of zeros
+  for a zero-padded border), the result goes to y[0] .. y[n-1], which
+  may be the same rows. Both passes start in the steady state of the
+  rows just outside the volume. fwd and bwd hold
+  (n+4)*width doubles each. All the inner loops run along the rows, so
+  they vectorize and only ever touch whole rows, whichever axis the rows
+  were taken from.
+*/
+static void mriGaussianIIRrows(
+    const GAUSSIAN_IIR *g, float const *const *x, float *const *y, int n, int width, double *fwd, double *bwd)
+{
+  double const *nn = g->n, *m = g->m, *d = g->d;
+  int i, c;
+
+  for (i = 0; i < 4; i++)
+    for (c = 0; c < width; c++) fwd[i * width + c] = g->causal_gain * x[-1][c];
+  for (i = 0; i < n; i++) {
+    double *f = fwd + (i + 4) * width;
+    double const *f1 = f - width, *f2 = f1 - width, *f3 = f2 - width, *f4 = f3 - width;
+    float const *x0 = x[i], *x1 = x[i - 1], *x2 = x[i - 2], *x3 = x[i - 3];
+    for (c = 0; c < width; c++)
+      f[c] = nn[0] * x0[c] + nn[1] * x1[c] + nn[2] * x2[c] + nn[3] * x3[c] - d[1] * f1[c] - d[2] * f2[c] -
+             d[3] * f3[c] - d[4] * f4[c];
+  }
+
+  for (i = n; i < n + 4; i++)
+    for (c = 0; c < width; c++) bwd[i * width + c] = g->anticausal_gain * x[n][c];
+  for (i = n - 1; i >= 0; i--) {
+    double *b = bwd + i * width, *f = fwd + (i + 4) * width;
+    double const *b1 = b + width, *b2 = b1 + width, *b3 = b2 + width, *b4 = b3 + width;
+    float const *x1 = x[i + 1], *x2 = x[i + 2], *x3 = x[i + 3], *x4 = x[i + 4];
+    for (c = 0; c < width; c++) {
+      b[c] = m[1] * x1[c] + m[2] * x2[c] + m[3] * x3[c] + m[4] * x4[c] - d[1] * b1[c] - d[2] * b2[c] -
+             d[3] * b3[c] - d[4] * b4[c];
+      f[c] += b[c];
+    }
+  }
+
+  // written last, as y may be x
+  for (i = 0; i < n; i++)
+    for (c = 0; c < width; c++) y[i][c] = (float)fwd[(i + 4) * width + c];
+}
+
+/*
+  Smooths every frame of mri_src along x, y and z with the recursive
+  filter, with standard deviations sigma[0..2] in voxels (0 leaves that
+  axis alone). Outside the volume the border voxels are repeated, or
+  taken as 0 if zero_border is set. The x pass transposes each slice so
+  that, like the y and z passes, it runs over whole rows; the z pass
+  works on one y row of every slice at a time rather than striding
+  through the slices voxel by voxel.
+*/
+static MRI *mriConvolveGaussianRecursiveAxes(MRI *mri_src, MRI *mri_dst, const float sigma[3], int zero_border)
+{
+  GAUSSIAN_IIR g[3];
+  MRI *mri_work;
+  int width, height, depth, frame, work_frame, axis;
+
+  for (axis = 0; axis < 3; axis++)
+    if (sigma[axis] > 0) {
+      mriGaussianIIRinit(&g[axis], sigma[axis]);
+    }
+
+  width = mri_src->width;
+  height = mri_src->height;
+  depth = mri_src->depth;
+
+  // rows of zeros to stand in for the rows outside the volume
+  float *zeros = (float *)calloc(MAX(width, height), sizeof(float));
+
+  mri_work = mri_dst;
+  if (mri_dst->type != MRI_FLOAT) {
+    mri_work = MRIalloc(width, height, depth, MRI_FLOAT);
+  }
+
+  for (frame = 0; frame < mri_src->nframes; frame++) {
+    work_frame = (mri_work == mri_dst) ? frame : 0;
+
+    // x: transpose each slice so that x runs down the rows
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static, 1)
+#endif
+    for (int z = 0; z < depth; z++) {
+      ROMP_PFLB_begin
+      float *plane = (float *)malloc((size_t)width * height * sizeof(float));
+      float **rows = (float **)malloc((width + 8) * sizeof(float *)) + 4;
+      double *fwd = (double *)malloc((size_t)(width + 4) * height * sizeof(double));
+      double *bwd = (double *)malloc((size_t)(width + 4) * height * sizeof(double));
+      int x, y;
+
+      for (y = 0; y < height; y++) {
+        if (mri_src->type == MRI_FLOAT) {
+          float const *in = &MRIFseq_vox(mri_src, 0, y, z, frame);
+          for (x = 0; x < width; x++) plane[(size_t)x * height + y] = in[x];
+        }
+        else
+          for (x = 0; x < width; x++) plane[(size_t)x * height + y] = MRIgetVoxVal(mri_src, x, y, z, frame);
+      }
+      if (sigma[0] > 0 && (width > 1 || zero_border)) {
+        for (x = -4; x < width + 4; x++)
+          rows[x] = (zero_border && (x < 0 || x >= width)) ? zeros : plane + (size_t)MAX(0, MIN(width - 1, x)) * height;
+        mriGaussianIIRrows(&g[0], rows, rows, width, height, fwd, bwd);
+      }
+      for (y = 0; y < height; y++) {
+        float *out = &MRIFseq_vox(mri_work, 0, y, z, work_frame);
+        for (x = 0; x < width; x++) out[x] = plane[(size_t)x * height + y];
+      }
+
+      free(bwd);
+      free(fwd);
+      free(rows - 4);
+      free(plane);
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    // y: the rows of each slice
+    if (sigma[1] > 0 && (height > 1 || zero_border)) {
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static, 1)
+#endif
+      for (int z = 0; z < depth; z++) {
+        ROMP_PFLB_begin
+        float **rows = (float **)malloc((height + 8) * sizeof(float *)) + 4;
+        double *fwd = (double *)malloc((size_t)(height + 4) * width * sizeof(double));
+        double *bwd = (double *)malloc((size_t)(height + 4) * width * sizeof(double));
+
+        int y;
+
+        for (y = -4; y < height + 4; y++)
+          rows[y] = (zero_border && (y < 0 || y >= height)) ? zeros
+                                                             : &MRIFseq_vox(mri_work, 0, MAX(0, MIN(height - 1, y)), z, work_frame);
+        mriGaussianIIRrows(&g[1], rows, rows, height, width, fwd, bwd);
+
+        free(bwd);
+        free(fwd);
+        free(rows - 4);
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
+    }
+
+    // z: row y of every slice
+    if (sigma[2] > 0 && (depth > 1 || zero_border)) {
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static, 1)
+#endif
+      for (int y = 0; y < height; y++) {
+        ROMP_PFLB_begin
+        float **rows = (float **)malloc((depth + 8) * sizeof(float *)) + 4;
+        double *fwd = (double *)malloc((size_t)(depth + 4) * width * sizeof(double));
+        double *bwd = (double *)malloc((size_t)(depth + 4) * width * sizeof(double));
+        int z;
+
+        for (z = -4; z < depth + 4; z++)
+          rows[z] = (zero_border && (z < 0 || z >= depth)) ? zeros
+                                                           : &MRIFseq_vox(mri_work, 0, y, MAX(0, MIN(depth - 1, z)), work_frame);
+        mriGaussianIIRrows(&g[2], rows, rows, depth, width, fwd, bwd);
+
+        free(bwd);
+        free(fwd);
+        free(rows - 4);
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
+    }
+
+    if (mri_work != mri_dst) {
+      MRIcopyFrame(mri_work, mri_dst, 0, frame);
+    }
+  }
+
+  if (mri_work != mri_dst) {
+    MRIfree(&mri_work);
+  }
+  free(zeros);
+  if (mri_dst != mri_src) {
+    MRIcopyHeader(mri_src, mri_dst);
+  }
+
+  return (mri_dst);
+}
+
+/*-----------------------------------------------------
+  MRIconvolveGaussianRecursive() - isotropic Gaussian smoothing with
+  standard deviation sigma (in voxels) using the recursive filter above,
+  so the cost does not grow with sigma. All frames are smoothed and the
+  border voxels are repeated outside the volume, as MRIconvolve1d()
+  does. mri_dst may be mri_src; if it is not float the result is
+  converted to its type as MRIconvolveGaussian() does.
+------------------------------------------------------*/
+MRI *MRIconvolveGaussianRecursive(MRI *mri_src, MRI *mri_dst, float sigma)
+{
+  float sigmas[3] = {sigma, sigma, sigma};
+
+  if (sigma < 0.5)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIconvolveGaussianRecursive: sigma %2.3f < 0.5 not supported", sigma));
+
+  if (!mri_dst) {
+    mri_dst = MRIclone(mri_src, NULL);
+  }
+  if (mri_src->type != mri_dst->type)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIconvolveGaussianRecursive: source and destination types differ"));
+
+  return (mriConvolveGaussianRecursiveAxes(mri_src, mri_dst, sigmas, 0));
+}
+
 /*---------------------------------------------------------------------
   MRIgaussianSmooth() - performs isotropic gaussian spatial smoothing.
   The standard deviation of the gaussian is std. If norm must be set to 1.
@@ -2995,6 +3283,71 @@ MRI *MRIreduceByte(MRI *mri_src, MRI *mri_dst)
   return (mri_dst);
 }
 
+/*-----------------------------------------------------
+  mriConvolve1dFloatRows() - float to float convolution along one axis.
+  Every output row is accumulated from whole input rows (y and z axes)
+  or from shifted views of a border-padded copy of the row (x axis), so
+  the inner loop runs over contiguous x and vectorizes, and the z pass
+  reads len contiguous rows instead of striding across slices for every
+  voxel. Each voxel still sums k[0] .. k[len-1] in order, so the result
+  is identical to the voxel-at-a-time loops this replaces.
+------------------------------------------------------*/
+static void mriConvolve1dFloatRows(
+    MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
+{
+  int const width = mri_src->width, height = mri_src->height, depth = mri_src->depth;
+  int const halflen = len / 2;
+  int const *xi = mri_src->xi, *yi = mri_src->yi, *zi = mri_src->zi;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static, 1)
+#endif
+  for (int z = 0; z < depth; z++) {
+    ROMP_PFLB_begin
+
+    float *pad = NULL;
+    if (axis == MRI_WIDTH) pad = (float *)malloc((width + len) * sizeof(float));
+
+    for (int y = 0; y < height; y++) {
+      float *out = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
+      int i, x;
+
+      switch (axis) {
+        case MRI_WIDTH: {
+          float const *in = &MRIFseq_vox(mri_src, 0, y, z, src_frame);
+          for (x = 0; x < width + len - 1; x++) pad[x] = in[xi[x - halflen]];
+          for (x = 0; x < width; x++) out[x] = 0.0f;
+          for (i = 0; i < len; i++) {
+            float const ki = k[i], *row = pad + i;
+            for (x = 0; x < width; x++) out[x] += ki * row[x];
+          }
+          break;
+        }
+        case MRI_HEIGHT:
+          for (x = 0; x < width; x++) out[x] = 0.0f;
+          for (i = 0; i < len; i++) {
+            float const ki = k[i], *row = &MRIFseq_vox(mri_src, 0, yi[y + i - halflen], z, src_frame);
+            for (x = 0; x < width; x++) out[x] += ki * row[x];
+          }
+          break;
+        case MRI_DEPTH:
+          for (x = 0; x < width; x++) out[x] = 0.0f;
+          for (i = 0; i < len; i++) {
+            float const ki = k[i], *row = &MRIFseq_vox(mri_src, 0, y, zi[z + i - halflen], src_frame);
+            for (x = 0; x < width; x++) out[x] += ki * row[x];
+          }
+          break;
+      }
+    }
+    if (pad) free(pad);
+    exec_progress_callback(z, depth, 0, 1);
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
 /*-----------------------------------------------------
         Parameters:
 
@@ -3009,7 +3362,7 @@ MRI *MRIconvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int
   int x = 0, y = 0, z = 0, halflen, *xi, *yi, *zi;
   int i = 0;
   BUFTYPE *inBase = NULL;
-  float *ki = NULL, total = 0, *inBase_f = NULL, *foutPix = NULL, val = 0;
+  float *ki = NULL, total = 0, *foutPix = NULL, val = 0;
 
   width = mri_src->width;
   height = mri_src->height;
@@ -3131,91 +3484,7 @@ MRI *MRIconvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int
       }
       break;
     case MRI_FLOAT:
-      switch (axis) {
-        case MRI_WIDTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, inBase_f, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              inBase_f = &MRIFseq_vox(mri_src, 0, y, z, src_frame);
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                if (Gx == x && Gy == y && Gz == z) {
-                  DiagBreak();
-                }
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  total += *ki++ * (*(inBase_f + xi[x + i - halflen]));
-                }
-
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-        case MRI_HEIGHT:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                if (x == Gx && y == Gy && z == Gz) {
-                  DiagBreak();
-                }
-
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIFseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame);
-
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-        case MRI_DEPTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIFseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame);
-
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-      }
+      mriConvolve1dFloatRows(mri_src, mri_dst, k, len, axis, src_frame, dst_frame);
       break;
     default:
       switch (axis) {
@@ -3635,78 +3904,14 @@ MRI *MRIconvolve1dInt(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, i
 ------------------------------------------------------*/
 MRI *MRIconvolve1dFloat(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
 {
-  int x, y, z, width, height, halflen, depth, *xi, *yi, *zi;
-  int i;
-  float *inBase;
-  float *outPix;
-  float *ki, total;
-
-  width = mri_src->width;
-  height = mri_src->height;
-  depth = mri_src->depth;
-
   if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
+    mri_dst = MRIalloc(mri_src->width, mri_src->height, mri_src->depth, MRI_FLOAT);
   }
 
   if (mri_dst->type != MRI_FLOAT)
     ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dFloat: unsupported dst pixel format %d", mri_dst->type));
 
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (axis) {
-    case MRI_WIDTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          inBase = &MRIFseq_vox(mri_src, 0, y, z, src_frame);
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++) {
-              total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-            }
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-    case MRI_HEIGHT:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIFseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-    case MRI_DEPTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIFseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-  }
+  mriConvolve1dFloatRows(mri_src, mri_dst, k, len, axis, src_frame, dst_frame);
 
   return (mri_dst);
 }
@@ -6512,7 +6717,9 @@ MRI *MRI_fft_highpass(MRI *src, MRI *dst, int percent)
   is preserved (ie, sets the kernel integral to 1).  Can be done
   in-place. Handles multiple frames. See also MRIconvolveGaussian()
   and MRImaskedGaussianSmooth(). Has the capacity to do a 2-Gaussian
-  mixture model using external variables. 
+  mixture model using external variables. Float targets smoothed by at
+  least MRI_GAUSSIAN_IIR_MIN_SIGMA voxels use the recursive filter of
+  MRIconvolveGaussianRecursive() with a zero border.
   -------------------------------------------------------------------*/
 MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *targ)
 {
@@ -6562,6 +6769,29 @@ MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *t
   }
   fflush(stdout);
 
+  /* Wide single Gaussians go through the recursive filter with a
+     zero-padded border, which is what the matrices below apply, at a
+     cost that grows with neither sigma nor the volume size. Each
+     smoothed axis must be at least 8 sigma long so that the kernel the
+     matrices renormalize at the center is complete to within 1e-4.
+     Setting FREESURFER_MRIgaussianSmoothNI_fir keeps the matrices. */
+  if (targ->type == MRI_FLOAT && smni_cw1 == 1 && smni_rw1 == 1 && smni_sw1 == 1 &&
+      !getenv("FREESURFER_MRIgaussianSmoothNI_fir")) {
+    float sigma[3] = {(float)(cstd > 0 ? cstd / src->xsize : 0),
+                      (float)(rstd > 0 ? rstd / src->ysize : 0),
+                      (float)(sstd > 0 ? sstd / src->zsize : 0)};
+    int dims[3] = {src->width, src->height, src->depth}, axis, recursive = 0;
+    for (axis = 0; axis < 3; axis++) {
+      if (sigma[axis] <= 0) continue;
+      recursive = (sigma[axis] >= MRI_GAUSSIAN_IIR_MIN_SIGMA && dims[axis] >= 8 * sigma[axis]);
+      if (!recursive) break;
+    }
+    if (recursive) {
+      if (Gdiag_no > 0) printf("MRIgaussianSmoothNI(): recursive filter, sigma = %g %g %g voxels\n", sigma[0], sigma[1], sigma[2]);
+      return (mriConvolveGaussianRecursiveAxes(targ, targ, sigma, 1));
+    }
+  }
+
   /* -----------------Smooth the columns -----------------------------*/
   if (cstd > 0) {
     if(smni_cw1 == 1) G = GaussianMatrix(src->width, cstd / src->xsize, 1, NULL);
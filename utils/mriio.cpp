@@ -27,6 +27,8 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <climits>
 
 #include <ctype.h>
 #include <dirent.h>
@@ -41,6 +43,8 @@
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <zlib.h>
 
 #include "machine.h"
 #include "mri.h"
@@ -7642,8 +7646,7 @@ static MRI *ximgRead(const char *fname, int read_volume)
   -----------------------------------------------------------*/
 MRI *MRISreadCurvAsMRI(const char *curvfile, int read_volume)
 {
-  int magno, k, vnum, fnum, vals_per_vertex;
-  float curv;
+  int magno, vnum, fnum, vals_per_vertex;
   FILE *fp;
   MRI *curvmri;
 
@@ -7670,10 +7673,9 @@ MRI *MRISreadCurvAsMRI(const char *curvfile, int read_volume)
 
   curvmri = MRIalloc(vnum, 1, 1, MRI_FLOAT);
   curvmri->version = ((MGZ_INTENT_SHAPE & 0xffff ) << 8) | MGH_VERSION;
-  for (k = 0; k < vnum; k++) {
-    curv = freadFloat(fp);
-    MRIsetVoxVal(curvmri, k, 0, 0, 0, curv);
-  }
+  // a vnum x 1 x 1 float volume is a single contiguous row, so the
+  // values are read straight into it
+  freadFloatArray(&MRIFvox(curvmri, 0, 0, 0), vnum, fp);
   fclose(fp);
 
   return (curvmri);
@@ -10805,6 +10807,286 @@ static void local_buffer_to_image(BUFTYPE *buf, MRI *mri, int slice, int frame)
 
 #define UNUSED_SPACE_SIZE 256
 #define USED_SPACE_SIZE (3 * sizeof(float) + 4 * 3 * sizeof(float))
+#define MGH_HEADER_SIZE (7 * sizeof(int) + UNUSED_SPACE_SIZE)   // bytes before the voxels
+
+
+/*---------------------------------------------------------------
+  Multi-threaded mgz I/O
+
+  When more than one thread is asked for (mghSetIOThreads() or the
+  FS_MGZIO_NTHREADS environment variable, 0 meaning all of them),
+  mghWrite stores the voxels of a chunked volume as a series of
+  independent gzip members of MGZ_MEMBER_SIZE bytes each, compressed
+  concurrently, between a member holding the header and one holding
+  the scan parameters and tags. A concatenation of gzip members is
+  itself a gzip file, so gunzip, zlib's gzread and the single stream
+  reader all see exactly the bytes the single stream writer produces.
+
+  Like BGZF, each voxel member records its compressed and uncompressed
+  size in a gzip extra subfield ("FZ"), so mghRead can find the members
+  without inflating them and decompress them concurrently straight into
+  MRI::chunk. Files without these members are read as before.
+  ---------------------------------------------------------------*/
+#define MGZ_MEMBER_SIZE        (1 << 20)    // uncompressed voxel bytes per member
+#define MGZ_MEMBER_HEADER_SIZE 24           // 10 fixed + 2 XLEN + 12 extra field (SI1,SI2, LEN, 2 sizes)
+#define MGZ_MEMBER_TRAILER_SIZE 8           // CRC32 and ISIZE
+
+static int mgh_io_nthreads = -1;   // < 0: use FS_MGZIO_NTHREADS
+
+void mghSetIOThreads(int nthreads) { mgh_io_nthreads = nthreads; }
+
+static int mghIOThreads()
+{
+  int nthreads = mgh_io_nthreads;
+  if (nthreads < 0) {
+    const char *env = getenv("FS_MGZIO_NTHREADS");
+    nthreads = env ? atoi(env) : 1;
+  }
+#ifdef HAVE_OPENMP
+  if (nthreads == 0) nthreads = omp_get_max_threads();
+#else
+  nthreads = 1;
+#endif
+  return nthreads < 1 ? 1 : nthreads;
+}
+
+// the types mghWrite stores as a plain byte-swapped copy of the chunk
+static bool mgzMultiMemberType(int type)
+{
+  switch (type) {
+    case MRI_UCHAR:
+    case MRI_SHORT:
+    case MRI_USHRT:
+    case MRI_INT:
+    case MRI_FLOAT:
+    case MRI_FLOAT_COMPLEX:
+      return true;
+  }
+  return false;
+}
+
+// swap between the big-endian file order and the host order, as the FS_MGZIO_USEVOXELBUF paths do
+static void mgzSwapVoxelBytes(BUFTYPE *buf, size_t nbytes, int bpv)
+{
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  if (bpv == 2) byteswapbufshort(buf, nbytes);
+  if (bpv == 4) byteswapbuffloat(buf, nbytes);
+  if (bpv == 8) byteswapbuffloat(buf, nbytes);
+#endif
+}
+
+static void mgzPutLE32(unsigned char *p, unsigned int v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned int mgzGetLE32(const unsigned char *p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Compress src into a complete gzip member carrying the FZ subfield
+static bool mgzDeflateMember(const BUFTYPE *src, size_t nsrc, std::vector<unsigned char> &member)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+  size_t const bound = deflateBound(&zs, nsrc);
+  member.resize(MGZ_MEMBER_HEADER_SIZE + bound + MGZ_MEMBER_TRAILER_SIZE);
+  zs.next_in = (Bytef *)src;
+  zs.avail_in = nsrc;
+  zs.next_out = &member[MGZ_MEMBER_HEADER_SIZE];
+  zs.avail_out = bound;
+  int const ret = deflate(&zs, Z_FINISH);
+  size_t const ncompressed = zs.total_out;
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END) return false;
+
+  size_t const nmember = MGZ_MEMBER_HEADER_SIZE + ncompressed + MGZ_MEMBER_TRAILER_SIZE;
+  member.resize(nmember);
+
+  unsigned char *h = &member[0];
+  h[0] = 0x1f; h[1] = 0x8b;       // magic
+  h[2] = Z_DEFLATED;
+  h[3] = 0x04;                    // FEXTRA
+  mgzPutLE32(h + 4, 0);           // MTIME
+  h[8] = 0;                       // XFL
+  h[9] = 255;                     // OS unknown
+  h[10] = 12; h[11] = 0;          // XLEN
+  h[12] = 'F'; h[13] = 'Z';
+  h[14] = 8; h[15] = 0;           // LEN
+  mgzPutLE32(h + 16, nmember);    // size of the whole member
+  mgzPutLE32(h + 20, nsrc);       // uncompressed size
+
+  unsigned char *t = &member[nmember - MGZ_MEMBER_TRAILER_SIZE];
+  mgzPutLE32(t, crc32(crc32(0L, Z_NULL, 0), src, nsrc));
+  mgzPutLE32(t + 4, nsrc);
+  return true;
+}
+
+
+// Append the voxels to fname as members of MGZ_MEMBER_SIZE bytes, compressing
+// a batch of them concurrently and writing the batch out in order
+static int mgzWriteVoxelMembers(const char *fname, const BUFTYPE *voxels, size_t nbytes, int bpv, int nthreads)
+{
+  FILE *fp = fopen(fname, "ab");
+  if (!fp) ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "mghWrite(%s): could not append the voxel data", fname));
+
+  size_t const nmembers = (nbytes + MGZ_MEMBER_SIZE - 1) / MGZ_MEMBER_SIZE;
+  int const batch = 4 * nthreads;
+  std::vector<std::vector<unsigned char> > members(batch);
+
+  for (size_t first = 0; first < nmembers; first += batch) {
+    int const n = (int)std::min((size_t)batch, nmembers - first);
+    int nfailed = 0;
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) num_threads(nthreads) schedule(dynamic, 1) reduction(+ : nfailed)
+#endif
+    for (int i = 0; i < n; i++) {
+      ROMP_PFLB_begin
+      size_t const offset = (first + i) * MGZ_MEMBER_SIZE;
+      size_t const size = std::min((size_t)MGZ_MEMBER_SIZE, nbytes - offset);
+      std::vector<BUFTYPE> slab(voxels + offset, voxels + offset + size);
+      mgzSwapVoxelBytes(&slab[0], size, bpv);
+      if (!mgzDeflateMember(&slab[0], size, members[i])) nfailed++;
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    if (nfailed) {
+      fclose(fp);
+      ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "mghWrite(%s): could not compress the voxel data", fname));
+    }
+    for (int i = 0; i < n; i++) {
+      if (fwrite(&members[i][0], 1, members[i].size(), fp) != members[i].size()) {
+        fclose(fp);
+        ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "mghWrite(%s): could not write the voxel data", fname));
+      }
+    }
+  }
+
+  if (fclose(fp)) ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "mghWrite(%s): could not write the voxel data", fname));
+  return (NO_ERROR);
+}
+
+
+// If the voxels of fname were written as FZ members, decompress them concurrently
+// into voxels and set *trailer_offset to where the member after them starts.
+// Returns 1 if it did, 0 if the file is not laid out that way, -1 on errors.
+static int mgzReadVoxelMembers(const char *fname, BUFTYPE *voxels, size_t nbytes, int bpv, int nthreads, long *trailer_offset)
+{
+  int const fd = open(fname, O_RDONLY);
+  if (fd < 0) return 0;
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  size_t const file_size = st.st_size;
+  void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return 0;
+  const unsigned char *file = (const unsigned char *)map;
+
+  // The first member must hold just the header
+  int result = 0;
+  size_t offset = 0;
+  {
+    unsigned char header[MGH_HEADER_SIZE + 1];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) goto Done;
+    zs.next_in = (Bytef *)file;
+    zs.avail_in = std::min(file_size, (size_t)UINT_MAX);
+    zs.next_out = header;
+    zs.avail_out = sizeof(header);
+    int const ret = inflate(&zs, Z_FINISH);
+    offset = zs.total_in;
+    size_t const nheader = zs.total_out;
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || nheader != MGH_HEADER_SIZE) goto Done;
+  }
+
+  // Index the voxel members
+  {
+    std::vector<size_t> member_offsets, voxel_offsets;
+    size_t nindexed = 0;
+    while (nindexed < nbytes) {
+      if (offset + MGZ_MEMBER_HEADER_SIZE + MGZ_MEMBER_TRAILER_SIZE > file_size) goto Done;
+      const unsigned char *h = file + offset;
+      if (h[0] != 0x1f || h[1] != 0x8b || h[2] != Z_DEFLATED || h[3] != 0x04 || h[10] != 12 || h[11] != 0 ||
+          h[12] != 'F' || h[13] != 'Z' || h[14] != 8 || h[15] != 0)
+        goto Done;
+      size_t const nmember = mgzGetLE32(h + 16);
+      size_t const nvoxel_bytes = mgzGetLE32(h + 20);
+      if (nmember < MGZ_MEMBER_HEADER_SIZE + MGZ_MEMBER_TRAILER_SIZE || offset + nmember > file_size ||
+          nindexed + nvoxel_bytes > nbytes)
+        goto Done;
+      member_offsets.push_back(offset);
+      voxel_offsets.push_back(nindexed);
+      offset += nmember;
+      nindexed += nvoxel_bytes;
+    }
+    member_offsets.push_back(offset);
+    voxel_offsets.push_back(nindexed);
+
+    // From here on the file claims to be in this layout, so problems are errors
+    result = -1;
+    int const nmembers = member_offsets.size() - 1;
+    int nfailed = 0;
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) num_threads(nthreads) schedule(dynamic, 1) reduction(+ : nfailed)
+#endif
+    for (int i = 0; i < nmembers; i++) {
+      ROMP_PFLB_begin
+      const unsigned char *member = file + member_offsets[i];
+      size_t const nmember = member_offsets[i + 1] - member_offsets[i];
+      size_t const size = voxel_offsets[i + 1] - voxel_offsets[i];
+      BUFTYPE *dst = voxels + voxel_offsets[i];
+
+      z_stream zs;
+      memset(&zs, 0, sizeof(zs));
+      if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        nfailed++;
+      }
+      else {
+        zs.next_in = (Bytef *)member + MGZ_MEMBER_HEADER_SIZE;
+        zs.avail_in = nmember - MGZ_MEMBER_HEADER_SIZE - MGZ_MEMBER_TRAILER_SIZE;
+        zs.next_out = dst;
+        zs.avail_out = size;
+        int const ret = inflate(&zs, Z_FINISH);
+        bool const ok = (ret == Z_STREAM_END && zs.total_out == size);
+        inflateEnd(&zs);
+        const unsigned char *t = member + nmember - MGZ_MEMBER_TRAILER_SIZE;
+        if (!ok || mgzGetLE32(t) != crc32(crc32(0L, Z_NULL, 0), dst, size) || mgzGetLE32(t + 4) != size)
+          nfailed++;
+        else
+          mgzSwapVoxelBytes(dst, size, bpv);
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    if (nfailed) {
+      ErrorPrintf(ERROR_BADFILE, "mghRead(%s): %d of %d compressed voxel blocks are corrupt", fname, nfailed, nmembers);
+      goto Done;
+    }
+    *trailer_offset = offset;
+    result = 1;
+  }
+
+Done:
+  munmap(map, file_size);
+  return result;
+}
 
 // declare function pointer
 // static int (*myclose)(FILE *stream);
@@ -10959,8 +11241,41 @@ MRI *mghRead(const char *fname, int read_volume, int frame)
       clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
     }
 
+    // voxels written as concurrently compressed members are read concurrently
+    int MULTIMEMBER = 0;
+    int const nthreads = mghIOThreads();
+    if (gzipped && frame == -1 && nthreads > 1 && mri->ischunked && mgzMultiMemberType(type)) {
+      long trailer_offset = 0;
+      int const status = mgzReadVoxelMembers(
+          fname, (BUFTYPE *)mri->chunk, (size_t)bytes * depth * nframes, bpv, nthreads, &trailer_offset);
+      if (status < 0) {
+        znzclose(fp);
+        free(buf);
+        MRIfree(&mri);
+        ErrorReturn(NULL, (ERROR_BADFILE, "mghRead(%s): could not read the voxel data", fname));
+      }
+      if (status > 0) {
+        // continue with the scan parameters and tags, which follow the voxel members
+        znzclose(fp);
+        int const fd = open(fname, O_RDONLY);
+        if (fd < 0 || lseek(fd, trailer_offset, SEEK_SET) != trailer_offset || znz_isnull(fp = znzdopen(fd, "rb", 1))) {
+          if (fd >= 0) close(fd);
+          free(buf);
+          MRIfree(&mri);
+          ErrorReturn(NULL, (ERROR_BADFILE, "mghRead(%s): could not reopen the file", fname));
+        }
+        free(buf);
+        buf = NULL;
+        MULTIMEMBER = 1;
+      }
+    }
+
     int USEVOXELBUF = 0;
-    if (mri->ischunked && getenv("FS_MGZIO_USEVOXELBUFREAD"))
+    if (MULTIMEMBER)
+    {
+      if (Gdiag & DIAG_INFO) printf("[DEBUG] mghRead() read the voxels with %d threads\n", nthreads);
+    }
+    else if (mri->ischunked && getenv("FS_MGZIO_USEVOXELBUFREAD"))
     {
       USEVOXELBUF = 1;
       printf("INFO: Environment variable FS_MGZIO_USEVOXELBUFREAD set\n");
@@ -11105,7 +11420,7 @@ MRI *mghRead(const char *fname, int read_volume, int frame)
       printf("Total time (mghRead) = %ld.%09ld seconds%s\n", 
              (end.tv_nsec < begin.tv_nsec) ? (end.tv_sec - 1 - begin.tv_sec) : (end.tv_sec - begin.tv_sec), 
              (end.tv_nsec < begin.tv_nsec) ? (1000000000 + end.tv_nsec - begin.tv_nsec) : (end.tv_nsec - begin.tv_nsec),
-             (USEVOXELBUF) ? " (USEVOXELBUF)" : "");
+             (MULTIMEMBER) ? " (MULTIMEMBER)" : (USEVOXELBUF) ? " (USEVOXELBUF)" : "");
     }
   }
 
@@ -11291,8 +11606,30 @@ int mghWrite(MRI *mri, const char *fname, int frame, int intent)
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
   }
 
+  int MULTIMEMBER = 0;
+  int const nthreads = mghIOThreads();
+  if (gzipped && nthreads > 1 && mri->ischunked && mgzMultiMemberType(mri->type))
+  {
+    // finish the header member, append the voxel members, then start the member for the rest
+    MULTIMEMBER = 1;
+    znzclose(fp);
+    int const bytes_per_voxel = MRIsizeof(mri->type);
+    size_t const bytes_to_write = (size_t)bytes_per_voxel * width * height * depth * (end_frame-start_frame+1);
+    if (mgzWriteVoxelMembers(fname, &MRIseq_vox(mri, 0, 0, 0, start_frame), bytes_to_write, bytes_per_voxel, nthreads) != NO_ERROR)
+      return (ERROR_BADFILE);
+    fp = znzopen(fname, "ab", gzipped);
+    if (znz_isnull(fp)) {
+      errno = 0;
+      ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "mghWrite(%s, %d): could not reopen file", fname, frame));
+    }
+  }
+
   int USEVOXELBUF = 0;
-  if (mri->ischunked && getenv("FS_MGZIO_USEVOXELBUFWRITE"))
+  if (MULTIMEMBER)
+  {
+    if (Gdiag & DIAG_INFO) printf("[DEBUG] mghWrite() compressed the voxels with %d threads\n", nthreads);
+  }
+  else if (mri->ischunked && getenv("FS_MGZIO_USEVOXELBUFWRITE"))
   {
     USEVOXELBUF = 1;
     printf("INFO: Environment variable FS_MGZIO_USEVOXELBUFWRITE set\n");
@@ -11424,7 +11761,7 @@ int mghWrite(MRI *mri, const char *fname, int frame, int intent)
     printf("Total time (mghWrite) = %ld.%09ld seconds%s\n", 
            (end.tv_nsec < begin.tv_nsec) ? (end.tv_sec - 1 - begin.tv_sec) : (end.tv_sec - begin.tv_sec), 
            (end.tv_nsec < begin.tv_nsec) ? (1000000000 + end.tv_nsec - begin.tv_nsec) : (end.tv_nsec - begin.tv_nsec),
-           (USEVOXELBUF) ? " (USEVOXELBUF)" : "");
+           (MULTIMEMBER) ? " (MULTIMEMBER)" : (USEVOXELBUF) ? " (USEVOXELBUF)" : "");
   }
 
   if (Gdiag & DIAG_INFO)
@@ -42,6 +42,7 @@
 #include "numerics.h"
 #include "proto.h"
 #include "region.h"
+#include "romp_support.h"
 #include "talairachex.h"
 
 /*-----------------------------------------------------
@@ -1794,10 +1795,10 @@ static MRI *mriBuildVoronoiDiagramShort(MRI *mri_src, MRI *mri_ctrl, MRI *mri_ds
 */
 static MRI *mriBuildVoronoiDiagramFloat(MRI *mri_src, MRI *mri_ctrl, MRI *mri_dst)
 {
-  int width, height, depth, x, y, z, xk, yk, zk, xi, yi, zi;
-  int *pxi, *pyi, *pzi, nchanged, n, total, visited;
-  BUFTYPE ctrl, mark;
-  float src, val, mean, *pdst, *psrc;
+  int width, height, depth, x, y, z;
+  int *pxi, *pyi, *pzi, nchanged, total, visited;
+  BUFTYPE ctrl;
+  float src, val, *pdst, *psrc;
   MRI *mri_marked;
   // float scale;
 
@@ -1869,8 +1870,19 @@ static MRI *mriBuildVoronoiDiagramFloat(MRI *mri_src, MRI *mri_ctrl, MRI *mri_ds
     MRIreplaceValues(mri_marked, mri_marked, CONTROL_TMP, CONTROL_NBR);
 
     /*Everything in mri_marked=CONTROL_TMP is now a nbr of a point with a value.
-      On first pass, nothing is CONTROL_TMP */
-    for (visited = z = 0; z < depth; z++) {
+      On first pass, nothing is CONTROL_TMP.
+      Only CONTROL_NBR voxels are written and only CONTROL_MARKED ones are read,
+      so the slices can be done in parallel with the same result. */
+    visited = 0;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) reduction(+ : nchanged, visited)
+#endif
+    for (z = 0; z < depth; z++) {
+      ROMP_PFLB_begin
+      int x, y, xk, yk, zk, xi, yi, zi, n;
+      BUFTYPE mark;
+      float mean, *pdst;
       for (y = 0; y < height; y++) {
         pdst = &MRIFvox(mri_dst, 0, y, z);
         for (x = 0; x < width; x++) {
@@ -1899,7 +1911,7 @@ static MRI *mriBuildVoronoiDiagramFloat(MRI *mri_src, MRI *mri_ctrl, MRI *mri_ds
                 xi = pxi[x + xk];
                 if (MRIgetVoxVal(mri_marked, xi, yi, zi, 0) == CONTROL_MARKED) {
                   n++;
-                  mean += MRIgetVoxVal(mri_dst, xi, yi, zi, 0);
+                  mean += MRIFvox(mri_dst, xi, yi, zi);
                 }
               }
             }
@@ -1916,7 +1928,9 @@ static MRI *mriBuildVoronoiDiagramFloat(MRI *mri_src, MRI *mri_ctrl, MRI *mri_ds
 
         }// z
       } //y
+      ROMP_PFLB_end
     } //z 
+    ROMP_PF_end
     total -= nchanged;
     if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON)
       fprintf(stderr, "Voronoi: %d voxels assigned, %d remaining, %d visited.\n", nchanged, total, visited);
@@ -480,8 +480,18 @@ struct MRIS_HASH_TABLE_NoSurface : public MRIS_HASH_TABLE {
 #ifdef HAVE_OPENMP
     omp_lock_t mutable buckets_lock;
 #endif
+    // The buckets are kept in an open addressing hash keyed on the voxel index,
+    // rather than a dense TABLE_SIZE x TABLE_SIZE array of columns.  A surface
+    // only touches a thin shell of the voxels, so creating and freeing the table
+    // is O(occupied voxels) instead of zeroing and scanning 4M column pointers.
+    //
+    struct BucketSlot {
+        size_t            key;                          // voxelKey(xv,yv,zv), only valid when bucket != NULL
+        MRIS_HASH_BUCKET* bucket;
+    };
     int                 nbuckets ;                      // Total # of buckets
-    MRIS_HASH_BUCKET **buckets_mustUseAcqRel[TABLE_SIZE][TABLE_SIZE] ;
+    size_t              bucketSlotsCapacity;            // 0 or a power of two
+    BucketSlot*         buckets_mustUseAcqRel;
 
     int                nfaces;
     MHT_FACE*          f;
@@ -491,9 +501,8 @@ struct MRIS_HASH_TABLE_NoSurface : public MRIS_HASH_TABLE {
     virtual MRIS_HASH_TABLE_NoSurface const * toMRIS_HASH_TABLE_NoSurface_Wkr() const { return this; }
 
     MRIS_HASH_TABLE_NoSurface(MHTFNO_t fno_usage, float vres, int which, int nfaces) 
-      : MRIS_HASH_TABLE(fno_usage, vres, which), nbuckets(0), nfaces(0), f(nullptr) 
+      : MRIS_HASH_TABLE(fno_usage, vres, which), nbuckets(0), bucketSlotsCapacity(0), buckets_mustUseAcqRel(nullptr), nfaces(0), f(nullptr) 
     {  
-        bzero(&buckets_mustUseAcqRel, sizeof(buckets_mustUseAcqRel));
 #ifdef HAVE_OPENMP
         omp_init_lock(&buckets_lock);
 #endif
@@ -534,7 +543,12 @@ struct MRIS_HASH_TABLE_NoSurface : public MRIS_HASH_TABLE {
     MHBT* acqBucket       (int xv, int yv, int zv) const;
     MHBT* acqBucketAtVoxIx(int xv, int yv, int zv) const;
     MHBT* makeAndAcqBucket(int xv, int yv, int zv);
-    bool  existsBuckets2  (int xv, int yv) const;
+    size_t bucketsIndexLimit() const { return bucketSlotsCapacity; }
+    MHBT* acqBucketByIndex(size_t i) const;             // for visiting all the buckets, in no particular order
+
+    static size_t voxelKey(int xv, int yv, int zv) { return (size_t(xv)*TABLE_SIZE + size_t(yv))*TABLE_SIZE + size_t(zv); }
+    size_t findBucketSlot (size_t key) const;           // the slot holding key, or the empty slot where it belongs
+    void   growBucketSlots();
 
     int mhtAddFaceOrVertexAtCoords   (float x, float y, float z, int forvnum);
     int mhtAddFaceOrVertexAtVoxIx    (int xv, int yv, int zv, int forvnum);
@@ -548,21 +562,16 @@ struct MRIS_HASH_TABLE_NoSurface : public MRIS_HASH_TABLE {
 
 MRIS_HASH_TABLE_NoSurface::~MRIS_HASH_TABLE_NoSurface() 
 {
-    for (int xv = 0; xv < TABLE_SIZE; xv++) {
-        for (int yv = 0; yv < TABLE_SIZE; yv++) {
-            if (!buckets_mustUseAcqRel[xv][yv]) continue;
-            for (int zv = 0; zv < TABLE_SIZE; zv++) {
-                MHBT* bucket = buckets_mustUseAcqRel[xv][yv][zv];
-                if (!bucket) continue;
+    for (size_t i = 0; i < bucketSlotsCapacity; i++) {
+        MHBT* bucket = buckets_mustUseAcqRel[i].bucket;
+        if (!bucket) continue;
 #ifdef HAVE_OPENMP
-                omp_destroy_lock(&bucket->bucket_lock);
+        omp_destroy_lock(&bucket->bucket_lock);
 #endif
-                if (bucket->bins) freeBins(bucket);
-                ::free(bucket);
-            }
-            ::free(buckets_mustUseAcqRel[xv][yv]);
-        }
+        if (bucket->bins) freeBins(bucket);
+        ::free(bucket);
     }
+    ::free(buckets_mustUseAcqRel);
 
 #ifdef HAVE_OPENMP
     omp_destroy_lock(&buckets_lock);
@@ -609,30 +618,64 @@ void MRIS_HASH_TABLE_NoSurface::unlockBuckets() const {
 #endif
 }
 
+// Linear probing from a multiplicative hash of the key.
+// The caller must hold the buckets_lock, and there must be at least one empty slot.
+//
+size_t MRIS_HASH_TABLE_NoSurface::findBucketSlot(size_t key) const
+{
+  size_t const mask = bucketSlotsCapacity - 1;
+  size_t h = key * 0x9E3779B97F4A7C15ull;
+  size_t i = (h ^ (h >> 32)) & mask;
+  for (;;) {
+    BucketSlot const & slot = buckets_mustUseAcqRel[i];
+    if (!slot.bucket || slot.key == key) return i;
+    i = (i + 1) & mask;
+  }
+}
+
+
+void MRIS_HASH_TABLE_NoSurface::growBucketSlots()
+{
+  size_t const oldCapacity = bucketSlotsCapacity;
+  BucketSlot * const oldSlots = buckets_mustUseAcqRel;
+
+  bucketSlotsCapacity = oldCapacity ? 2*oldCapacity : 4096;
+  buckets_mustUseAcqRel = (BucketSlot*)calloc(bucketSlotsCapacity, sizeof(BucketSlot));
+  if (!buckets_mustUseAcqRel) ErrorExit(ERROR_NO_MEMORY, "%s: could not allocate %zu bucket slots.", __MYFUNCTION__, bucketSlotsCapacity);
+
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (!oldSlots[i].bucket) continue;
+    buckets_mustUseAcqRel[findBucketSlot(oldSlots[i].key)] = oldSlots[i];
+  }
+  ::free(oldSlots);
+}
+
+
 MHBT* MRIS_HASH_TABLE_NoSurface::makeAndAcqBucket(int xv, int yv, int zv) 
 {
   //-----------------------------------------------
   // Allocate space if needed
   //-----------------------------------------------
-  // 1. Allocate a 1-D array at buckets_mustUseAcqRel[xv][yv]
+  // 1. Keep the slots at most half full, so the probe sequences stay short
   
   lockBuckets();
   
-  if (!buckets_mustUseAcqRel[xv][yv]) {
-    buckets_mustUseAcqRel[xv][yv] = (MHBT **)calloc(TABLE_SIZE, sizeof(MHBT *));
-    if (!buckets_mustUseAcqRel[xv][yv]) ErrorExit(ERROR_NO_MEMORY, "%s: could not allocate slice.", __MYFUNCTION__);
-  }
-  
-  // 2. Allocate a bucket at buckets_mustUseAcqRel[xv][yv][zv]
-  MHBT *bucket = buckets_mustUseAcqRel[xv][yv][zv];
+  if (2*size_t(nbuckets + 1) > bucketSlotsCapacity) growBucketSlots();
   
+  // 2. Allocate a bucket for (xv,yv,zv)
+  size_t const key = voxelKey(xv, yv, zv);
+  BucketSlot & slot = buckets_mustUseAcqRel[findBucketSlot(key)];
+  MHBT *bucket = slot.bucket;
   
   if (!bucket) {
-    buckets_mustUseAcqRel[xv][yv][zv] = bucket = (MHBT *)calloc(1, sizeof(MHBT));
+    bucket = (MHBT *)calloc(1, sizeof(MHBT));
     if (!bucket) ErrorExit(ERROR_NOMEMORY, "%s couldn't allocate bucket.\n", __MYFUNCTION__);
 #ifdef HAVE_OPENMP
     omp_init_lock(&bucket->bucket_lock);
 #endif
+    slot.key    = key;
+    slot.bucket = bucket;
+    nbuckets++;
   }
   
   unlockBuckets();
@@ -672,8 +715,8 @@ MHBT* MRIS_HASH_TABLE_NoSurface::acqBucket(int xv, int yv, int zv) const
   lockBuckets();
 
   MHBT* bucket = NULL;
-  if (buckets_mustUseAcqRel[xv][yv]) 
-      bucket = buckets_mustUseAcqRel[xv][yv][zv];
+  if (nbuckets) 
+      bucket = buckets_mustUseAcqRel[findBucketSlot(voxelKey(xv, yv, zv))].bucket;
 
   unlockBuckets();
   
@@ -685,6 +728,20 @@ MHBT* MRIS_HASH_TABLE_NoSurface::acqBucket(int xv, int yv, int zv) const
 }
 
 
+MHBT* MRIS_HASH_TABLE_NoSurface::acqBucketByIndex(size_t i) const
+{
+  if (i >= bucketSlotsCapacity) return (NULL);
+
+  lockBuckets();
+  MHBT* bucket = buckets_mustUseAcqRel[i].bucket;
+  unlockBuckets();
+
+  if (bucket) lockBucket(bucket);
+
+  return bucket;
+}
+
+
 
 static void relBucketC(MHBT const ** bucket)
 {
@@ -715,16 +772,6 @@ void MHTrelBucket (MHBT       ** bucket) { relBucket (bucket); }
 void MHTrelBucketC(MHBT const ** bucket) { relBucketC(bucket); }
 
 
-bool MRIS_HASH_TABLE_NoSurface::existsBuckets2(int xv, int yv) const
-{
-    bool result = false;
-    if (xv >= TABLE_SIZE || yv >= TABLE_SIZE || xv < 0 || yv < 0) goto Done;
-    if (!buckets_mustUseAcqRel[xv][yv]) goto Done;
-    result = true;
-Done:
-    return result;
-}
-
 #define buckets_mustUseAcqRel SHOULD_NOT_ACCESS_BUCKETS_DIRECTLY
 
 
@@ -807,8 +854,6 @@ int MRIS_HASH_TABLE_NoSurface::mhtRemoveFaceOrVertexAtVoxIx(int xv, int yv, int
   if (yv >= TABLE_SIZE) yv = TABLE_SIZE - 1;
   if (zv >= TABLE_SIZE) zv = TABLE_SIZE - 1;
 
-  if (!existsBuckets2(xv,yv)) return (NO_ERROR);  // no bucket at such coordinates
-  
   MHBT *bucket = acqBucket(xv,yv,zv);
   if (!bucket) return (NO_ERROR);  // no bucket at such coordinates
 
@@ -1049,28 +1094,23 @@ void MRIS_HASH_TABLE_IMPL<Surface,Face,Vertex>::captureFaceData()
 
         for (int pass = 0; pass < 2; pass++) {
             int n = 0;
-            for (int xv = 0; xv < TABLE_SIZE; xv++) {
-                for (int yv = 0; yv < TABLE_SIZE; yv++) {
-                    if (!existsBuckets2(xv,yv)) continue;
-                    for (int zv = 0; zv < TABLE_SIZE; zv++) {
-
-                        MHBT* bucket = acqBucket(xv,yv,zv);
-                        if (!bucket) continue;
-
-                        if (pass == 0) {
-                            if (bucket->nused) {
-                                mean += bucket->nused;
-                                n++;
-                            }
-                            if (bucket->nused > max_nused) max_nused = bucket->nused;
-                        } else {
-                            double v = mean - bucket->nused;
-                            var += v*v;
-                        }
-                        
-                        relBucket(&bucket);
+            for (size_t i = 0; i < bucketsIndexLimit(); i++) {
+
+                MHBT* bucket = acqBucketByIndex(i);
+                if (!bucket) continue;
+
+                if (pass == 0) {
+                    if (bucket->nused) {
+                        mean += bucket->nused;
+                        n++;
                     }
+                    if (bucket->nused > max_nused) max_nused = bucket->nused;
+                } else {
+                    double v = mean - bucket->nused;
+                    var += v*v;
                 }
+                
+                relBucket(&bucket);
             }
             if (n == 0) n = 1;
             if (pass == 0) 
@@ -1414,8 +1454,6 @@ int MRIS_HASH_TABLE_IMPL<Surface,Face,Vertex>::mhtDoesTriangleVoxelListIntersect
     // Get corresponding bucket from mht, if any.
     // There might not be...
     //----------------------------------------------------------
-    if (!existsBuckets2(xv,yv)) continue;
-    
     MHBT const * bucket = acqBucket(xv,yv,zv);
     if (!bucket) continue;
 
@@ -1422,16 +1422,141 @@ MRI_SP *MRISPclone(MRI_SP *mrisp_src)
 #define MAX_LEN 4
 #define MAX_KLEN 50
 
+/*
+  The kernel of MRISPconvolveGaussian only depends on the latitude u of the
+  output pixel: the distance to a tap is measured along the meridian (theta1
+  is the theta of the output pixel, not of the tap), so every tap of a kernel
+  row u1 has the same weight, and the convolution is a weighted sum over the
+  rows u1 of a box filter of length klen along v.  The rows, their v offsets
+  (for the rows reflected over the poles) and their weights are computed at
+  the start of each call, which costs U * klen distances, much less than the
+  blur itself.
+*/
+typedef struct
+{
+  float   min_len, max_len;
+  int    *khalf;  // [U] half length of the kernel of each row u
+  int    *first;  // [U+1] first tap of each row u
+  int    *u1;     // [taps] source row of the tap
+  int    *voff;   // [taps] v offset of the source row
+  double *k;      // [taps] weight of the tap, normalized per row u
+} MRISP_GAUSSIAN_TABLE;
+
+/* geodesic distance between (phi, theta) and (phi1, theta1) on a sphere of the given radius */
+static double MRISPgreatCircleDistance(double radius, double phi, double theta, double phi1, double theta1)
+{
+  double const s_phi = sin(0.5 * (phi1 - phi)), s_theta = sin(0.5 * (theta1 - theta));
+  double h = s_phi * s_phi + sin(phi) * sin(phi1) * s_theta * s_theta;
+  if (h > 1.0) h = 1.0;
+  return radius * 2.0 * asin(sqrt(fabs(h)));
+}
+
+static void MRISPconvolveGaussianTable(MRISP_GAUSSIAN_TABLE *table, MRI_SP *mrisp_src, float sigma, float radius)
+{
+  int const U = U_DIM(mrisp_src), V = V_DIM(mrisp_src);
+
+  int u, v, klen, khalf, uk, u1, v1, voff, tap;
+  double d, sigma_sq_inv, phi, theta, phi1, theta1, ktotal;
+
+  if (FZERO(sigma))
+    sigma_sq_inv = BIG;
+  else
+    sigma_sq_inv = 1.0f / (sigma * sigma);
+
+  table->khalf = (int *)malloc(U * sizeof(int));
+  table->first = (int *)malloc((U + 1) * sizeof(int));
+  /* klen is capped at MAX_KLEN before it is made odd, so a row has at most MAX_KLEN + 1 taps */
+  table->u1    = (int *)malloc(U * (MAX_KLEN + 1) * sizeof(int));
+  table->voff  = (int *)malloc(U * (MAX_KLEN + 1) * sizeof(int));
+  table->k     = (double *)malloc(U * (MAX_KLEN + 1) * sizeof(double));
+  if (!table->khalf || !table->first || !table->u1 || !table->voff || !table->k)
+    ErrorExit(ERROR_NOMEMORY, "MRISPconvolveGaussian: could not allocate %d x %d kernel table", U, MAX_KLEN + 1);
+  table->min_len = 10000.0f;
+  table->max_len = 0.0f;
+
+  /* same geometry as the pixel by pixel computation, evaluated at v = 0.
+     The great circle distances are computed in double with the haversine
+     formula: the float radius vectors and the acos of a dot product close to
+     1 the pixel by pixel loop used had errors of a few percent for adjacent
+     pixels, enough to change the weights by 1e-4 and to move klen over a
+     rounding boundary depending on v. */
+  v = 0;
+  theta = (double)v * THETA_MAX / THETA_DIM(mrisp_src);
+  for (tap = u = 0; u < U; u++) {
+    phi = (double)u * PHI_MAX / PHI_DIM(mrisp_src);
+
+    /* distance between adjacent spherical matrix elements determines the kernel size */
+    u1 = u + 1;
+    if (u1 >= U) u1 = U - (u1 - U + 2);
+    v1 = v + 1;
+    if (v1 >= V) v1 = V - (v1 - V + 2);
+    phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
+    theta1 = (double)v1 * THETA_MAX / THETA_DIM(mrisp_src);
+    d = MRISPgreatCircleDistance(radius, phi, theta, phi1, theta1);
+    if (d > table->max_len) table->max_len = d;
+    if (d < table->min_len) table->min_len = d;
+
+    klen = nint(6.0f * sigma / d) + 1;
+    if (klen > MAX_KLEN) klen = MAX_KLEN;
+    if (ISEVEN(klen)) klen++;
+    if (klen >= U) klen = U - 1;
+    if (klen >= V) klen = V - 1;
+    khalf = klen / 2;
+    table->khalf[u] = khalf;
+    table->first[u] = tap;
+
+    ktotal = 0.0;
+    for (uk = -khalf; uk <= khalf; uk++, tap++) {
+      u1 = u + uk;
+      if (u1 < 0) /* enforce spherical topology  */
+      {
+        voff = V / 2;
+        u1 = -u1;
+      }
+      else if (u1 >= U) {
+        u1 = U - (u1 - U + 1);
+        voff = V / 2;
+      }
+      else
+        voff = 0;
+
+      phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
+      d = MRISPgreatCircleDistance(radius, phi, theta, phi1, theta);
+
+      table->u1[tap] = u1;
+      table->voff[tap] = voff;
+      table->k[tap] = exp(-d * d * sigma_sq_inv);
+      ktotal += (2 * khalf + 1) * table->k[tap]; /* each weight is used for the whole box */
+    }
+    for (uk = table->first[u]; uk < tap; uk++) table->k[uk] /= ktotal; /* normalize weights to 1 */
+  }
+  table->first[U] = tap;
+}
+
+static void MRISPfreeGaussianTable(MRISP_GAUSSIAN_TABLE *table)
+{
+  free(table->khalf);
+  free(table->first);
+  free(table->u1);
+  free(table->voff);
+  free(table->k);
+}
+
+/*-----------------------------------------------------
+        Parameters:
+
+        Returns value:
+
+        Description
+           Convolve with a kernel with standard deviation = sigma mm.
+           All frames (fno < 0) or frame fno are blurred in one pass over
+           the kernel table, the latitudes u are processed in parallel.
+------------------------------------------------------*/
 MRI_SP *MRISPconvolveGaussian(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma, float radius, int fno)
 {
-  int u, v, cart_klen, klen, khalf, uk, vk, u1, v1, voff, f0, f1;
-  double d, k, total, ktotal, sigma_sq_inv, theta, phi, theta1, phi1, sin_phi, cos_phi, sin_phi1, cos_phi1;
-  float x0, y0, z0, x1, y1, z1, circumference = 0.0f, angle, max_len = 0.0f, min_len = 10000.0f;
+  int cart_klen, f0, f1, nframes, u, v, f;
   IMAGE *Ip_src, *Ip_dst;
-  VECTOR *vec1, *vec2;
-
-  vec1 = VectorAlloc(3, MATRIX_REAL);
-  vec2 = VectorAlloc(3, MATRIX_REAL);
+  float *src_rows, *dst_rows;
 
   if (!mrisp_dst) mrisp_dst = MRISPclone(mrisp_src);
   mrisp_dst->sigma = sigma;
@@ -1444,11 +1569,6 @@ MRI_SP *MRISPconvolveGaussian(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma,
   if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON)
     fprintf(stderr, "blurring surface, sigma = %2.3f, cartesian klen = %d\n", sigma, cart_klen);
 
-  if (FZERO(sigma))
-    sigma_sq_inv = BIG;
-  else
-    sigma_sq_inv = 1.0f / (sigma * sigma);
-
   Ip_src = mrisp_src->Ip;
   Ip_dst = mrisp_dst->Ip;
   if (fno < 0) {
@@ -1458,103 +1578,74 @@ MRI_SP *MRISPconvolveGaussian(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma,
   else {
     f0 = f1 = fno;
   }
+  nframes = f1 - f0 + 1;
 
-  for (fno = f0; fno <= f1; fno++) /* for each frame */
-  {
-    for (u = 0; u < U_DIM(mrisp_src); u++) {
-      if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) fprintf(stderr, "\r%3.3d of %d     ", u, U_DIM(mrisp_src) - 1);
-      phi = (double)u * PHI_MAX / PHI_DIM(mrisp_src);
-      sin_phi = sin(phi);
-      cos_phi = cos(phi);
-
-      for (v = 0; v < V_DIM(mrisp_src); v++) {
-        theta = (double)v * THETA_MAX / THETA_DIM(mrisp_src);
-        x0 = radius * sin_phi * cos(theta);
-        y0 = radius * sin_phi * sin(theta);
-        z0 = radius * cos_phi;
-        VECTOR_LOAD(vec1, x0, y0, z0); /* radius vector */
-        if (FZERO(circumference))      /* only calculate once */
-          circumference = M_PI * 2.0 * V3_LEN(vec1);
-        if (u == DEBUG_U && v == DEBUG_V) DiagBreak();
-
-        /* compute the distance between adjacent spherical matrix
-           elements at this point on the surface (probably easier
-           to do with the parameterization, but I'll do it in
-           Cartesian space for now.
-           */
-        u1 = u + 1;
-        if (u1 >= U_DIM(mrisp_src)) u1 = U_DIM(mrisp_src) - (u1 - U_DIM(mrisp_src) + 2);
-        v1 = v + 1;
-        if (v1 >= V_DIM(mrisp_src)) v1 = V_DIM(mrisp_src) - (v1 - V_DIM(mrisp_src) + 2);
-
-        phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
-        theta1 = (double)v1 * THETA_MAX / THETA_DIM(mrisp_src);
-        x1 = radius * sin(phi1) * cos(theta1);
-        y1 = radius * sin(phi1) * sin(theta1);
-        z1 = radius * cos(phi1);
-        VECTOR_LOAD(vec2, x1, y1, z1); /* radius vector */
-        angle = fabs(Vector3Angle(vec1, vec2));
-        d = circumference * angle / (2.0 * M_PI); /* geodesic distance */
-        if (d > max_len) max_len = d;
-        if (d < min_len) min_len = d;
-
-        /* d is now the distance between adjacent cells - compute kernel size*/
-        klen = nint(6.0f * sigma / d) + 1;
-        if (klen > MAX_KLEN) klen = MAX_KLEN;
-
-        if (ISEVEN(klen)) klen++;
-        if (klen >= U_DIM(mrisp_src)) klen = U_DIM(mrisp_src) - 1;
-        if (klen >= V_DIM(mrisp_src)) klen = V_DIM(mrisp_src) - 1;
-        khalf = klen / 2;
-
-        total = ktotal = 0.0;
-        for (uk = -khalf; uk <= khalf; uk++) {
-          u1 = u + uk;
-          if (u1 < 0) /* enforce spherical topology  */
-          {
-            voff = V_DIM(mrisp_src) / 2;
-            u1 = -u1;
-          }
-          else if (u1 >= U_DIM(mrisp_src)) {
-            u1 = U_DIM(mrisp_src) - (u1 - U_DIM(mrisp_src) + 1);
-            voff = V_DIM(mrisp_src) / 2;
-          }
-          else
-            voff = 0;
+  int const U = U_DIM(mrisp_src), V = V_DIM(mrisp_src);
+  MRISP_GAUSSIAN_TABLE table;
+  MRISPconvolveGaussianTable(&table, mrisp_src, sigma, radius);
 
-          phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
-          sin_phi1 = sin(phi1);
-          cos_phi1 = cos(phi1);
+  /* u is the fast index of the image, copy the frames so a row of
+     constant u is contiguous in v (also allows mrisp_dst == mrisp_src) */
+  src_rows = (float *)malloc((size_t)nframes * U * V * sizeof(float));
+  dst_rows = (float *)malloc((size_t)nframes * U * V * sizeof(float));
+  if (!src_rows || !dst_rows)
+    ErrorExit(ERROR_NOMEMORY, "MRISPconvolveGaussian: could not allocate %d frames of %d x %d", nframes, U, V);
+  for (f = 0; f < nframes; f++)
+    for (v = 0; v < V; v++)
+      for (u = 0; u < U; u++) src_rows[((size_t)f * U + u) * V + v] = *IMAGEFseq_pix(Ip_src, u, v, f0 + f);
 
-          for (vk = -khalf; vk <= khalf; vk++) {
-            theta1 = (double)v * THETA_MAX / THETA_DIM(mrisp_src);
-            x1 = radius * sin_phi1 * cos(theta1);
-            y1 = radius * sin_phi1 * sin(theta1);
-            z1 = radius * cos_phi1;
-            VECTOR_LOAD(vec2, x1, y1, z1); /* radius vector */
-            angle = fabs(Vector3Angle(vec1, vec2));
-            d = circumference * angle / (2.0 * M_PI);
-            k = exp(-d * d * sigma_sq_inv);
-            v1 = v + vk + voff;
-            while (v1 < 0) /* enforce spherical topology */
-              v1 += V_DIM(mrisp_src);
-            while (v1 >= V_DIM(mrisp_src)) v1 -= V_DIM(mrisp_src);
-            ktotal += k;
-            total += k * *IMAGEFseq_pix(Ip_src, u1, v1, fno);
-          }
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic, 1)
+#endif
+  for (u = 0; u < U; u++) {
+    ROMP_PFLB_begin
+    int const khalf = table.khalf[u];
+    int f, v, tap;
+    double *total = (double *)calloc(V, sizeof(double));
+
+    if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) fprintf(stderr, "\r%3.3d of %d     ", u, U - 1);
+    for (f = 0; f < nframes; f++) /* for each frame */
+    {
+      for (v = 0; v < V; v++) total[v] = 0.0;
+      for (tap = table.first[u]; tap < table.first[u + 1]; tap++) {
+        float const *row = src_rows + ((size_t)f * U + table.u1[tap]) * V;
+        int const voff = table.voff[tap];
+        double const k = table.k[tap];
+        int v0, v1;
+
+        /* box sum over v + voff - khalf .. v + voff + khalf (enforcing
+           spherical topology), moved along v: v0 leaves, v1 enters */
+        double box = 0.0;
+        for (v1 = voff - khalf; v1 <= voff + khalf; v1++) box += row[(v1 + V) % V];
+        v0 = (voff - khalf + V) % V;
+        v1 = (voff + khalf + 1) % V;
+        for (v = 0; v < V; v++) {
+          total[v] += k * box;
+          box += row[v1] - row[v0];
+          if (++v0 == V) v0 = 0;
+          if (++v1 == V) v1 = 0;
         }
-        if (u == DEBUG_U && v == DEBUG_V) DiagBreak();
-        total /= ktotal; /* normalize weights to 1 */
-        *IMAGEFseq_pix(mrisp_dst->Ip, u, v, fno) = total;
       }
+      float *out = dst_rows + ((size_t)f * U + u) * V;
+      for (v = 0; v < V; v++) out[v] = total[v];
     }
+    free(total);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
+
+  for (f = 0; f < nframes; f++)
+    for (v = 0; v < V; v++)
+      for (u = 0; u < U; u++) *IMAGEFseq_pix(Ip_dst, u, v, f0 + f) = dst_rows[((size_t)f * U + u) * V + v];
+  free(src_rows);
+  free(dst_rows);
 
-  if (Gdiag & DIAG_SHOW) fprintf(stderr, "min_len = %2.3f mm, max_len = %2.3f mm\n", min_len, max_len);
+  if (Gdiag & DIAG_SHOW)
+    fprintf(stderr, "min_len = %2.3f mm, max_len = %2.3f mm\n", table.min_len, table.max_len);
+  MRISPfreeGaussianTable(&table);
   if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) fprintf(stderr, "done.\n");
 
-  VectorFree(&vec1);
-  VectorFree(&vec2);
   return (mrisp_dst);
 }
 /*-----------------------------------------------------
@@ -1620,23 +1711,17 @@ static MRI_SP *MRISPblur_new(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma,
   double const       sigma_sq_inv = sigma_sq_inv_init;
   const IMAGE *const Ip_src       = Ip_src_init;
 
-  static int  uMax                    = 0;
-  static int  uToKHalfCache_PHI_DIM   = 0;
-  static int  uToKHalfCache_cart_klen = 0;
-  static int* uToKHalfCache           = NULL;
-  
-  static int     kHalfHi              = 0;
-  static double* uukvkToExpResult     = NULL;
-  
-  if (uMax                    != U_DIM  (mrisp_src) 
-  ||  uToKHalfCache_PHI_DIM   != PHI_DIM(mrisp_src)
-  ||  uToKHalfCache_cart_klen != cart_klen
-  ) {
-    uMax                    = U_DIM  (mrisp_src);
-    uToKHalfCache_PHI_DIM   = PHI_DIM(mrisp_src);
-    uToKHalfCache_cart_klen = cart_klen;
-    
-    uToKHalfCache = (int*)realloc(uToKHalfCache, uMax*sizeof(int));
+  // The kernel sizes and weights depend on the grid, sigma and NO_SPHERE.
+  // They are built for each call (U * kHalfHi^2 exps, much less than the blur),
+  // so concurrent calls with different parameters cannot see each other's tables.
+  //
+  int const uMax = U_DIM(mrisp_src);
+  int*      uToKHalfCache    = NULL;
+  int       kHalfHi          = 0;
+  double*   uukvkToExpResult = NULL;
+  {
+    uToKHalfCache = (int*)malloc(uMax*sizeof(int));
+    if (!uToKHalfCache) ErrorExit(ERROR_NOMEMORY, "MRISPblur: could not allocate %d kernel sizes", uMax);
     
     int u;
     for (u = 0; u < U_DIM(mrisp_src); u++) {
@@ -1669,7 +1754,9 @@ static MRI_SP *MRISPblur_new(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma,
     }
     
     kHalfHi          = uToKHalfCache[0] + 1;
-    uukvkToExpResult = (double*)realloc(uukvkToExpResult, uMax*kHalfHi*kHalfHi*sizeof(double));
+    uukvkToExpResult = (double*)malloc(uMax*kHalfHi*kHalfHi*sizeof(double));
+    if (!uukvkToExpResult)
+      ErrorExit(ERROR_NOMEMORY, "MRISPblur: could not allocate %d x %d x %d kernel table", uMax, kHalfHi, kHalfHi);
     
     for (u = 0; u < U_DIM(mrisp_src); u++) {
       double* ukvkToExpResult = uukvkToExpResult + u*kHalfHi*kHalfHi;
@@ -1806,6 +1893,9 @@ static MRI_SP *MRISPblur_new(MRI_SP *mrisp_src, MRI_SP *mrisp_dst, float sigma,
   }
   ROMP_PF_end
 
+  free(uToKHalfCache);
+  free(uukvkToExpResult);
+
   if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON) fprintf(stderr, "done.\n");
 
   return (mrisp_dst);
@@ -0,0 +1,197 @@
+/*
+ * surfaces Author: Bruce Fischl, extracted from mrisurf.c by Bevin Brett
+ *
+ * $ Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+#include "mrisurf_SoA.h"
+
+#include "mrisurf_base.h"
+
+
+void MRISSoA_ctr(MRIS_SoA* soa) {
+  bzero(soa, sizeof(*soa));
+}
+
+
+void MRISSoA_dtr(MRIS_SoA* soa) {
+  freeAndNULL(soa->ripflag);
+  freeAndNULL(soa->border);
+  freeAndNULL(soa->neg);
+  freeAndNULL(soa->x);  freeAndNULL(soa->y);  freeAndNULL(soa->z);
+  freeAndNULL(soa->nx); freeAndNULL(soa->ny); freeAndNULL(soa->nz);
+  freeAndNULL(soa->dx); freeAndNULL(soa->dy); freeAndNULL(soa->dz);
+  freeAndNULL(soa->sx); freeAndNULL(soa->sy); freeAndNULL(soa->sz);
+  freeAndNULL(soa->sn);
+  freeAndNULL(soa->nbr_start);
+  freeAndNULL(soa->nbrs);
+  bzero(soa, sizeof(*soa));
+}
+
+
+void MRISSoA_invalidateTopology(MRIS_SoA* soa) {
+  soa->topology_loaded = 0;
+  soa->topology_src    = NULL;
+}
+
+
+static void MRISSoA_reserve(MRIS_SoA* soa, int nvertices) {
+  if (nvertices <= soa->capacity) return;
+
+#define RESERVE(T,N) soa->N = (T*)realloc(soa->N, nvertices*sizeof(T)); \
+  if (!soa->N) ErrorExit(ERROR_NOMEMORY, "MRISSoA_reserve: could not allocate %d vertices", nvertices);
+  RESERVE(char,ripflag) RESERVE(char,border) RESERVE(char,neg)
+  RESERVE(float,x)  RESERVE(float,y)  RESERVE(float,z)
+  RESERVE(float,nx) RESERVE(float,ny) RESERVE(float,nz)
+  RESERVE(float,dx) RESERVE(float,dy) RESERVE(float,dz)
+  RESERVE(float,sx) RESERVE(float,sy) RESERVE(float,sz)
+  RESERVE(int,sn)
+#undef RESERVE
+
+  soa->nbr_start = (int*)realloc(soa->nbr_start, (nvertices+1)*sizeof(int));
+  if (!soa->nbr_start) ErrorExit(ERROR_NOMEMORY, "MRISSoA_reserve: could not allocate %d vertices", nvertices);
+
+  soa->capacity = nvertices;
+}
+
+
+// The 1-ring (vt->v[0..vnum-1]) in the same order the MRIS loops visit it,
+// so sums over it are bit-identical to the ones computed from the MRIS
+//
+static void MRISSoA_loadTopology(MRIS_SoA* soa, MRIS const * mris) {
+  int const nvertices = mris->nvertices;
+
+  int vno, total = 0;
+  for (vno = 0; vno < nvertices; vno++) {
+    soa->nbr_start[vno] = total;
+    total += mris->vertices_topology[vno].vnum;
+  }
+  soa->nbr_start[nvertices] = total;
+
+  if (total > soa->nbr_capacity) {
+    soa->nbrs = (int*)realloc(soa->nbrs, (total+1)*sizeof(int));
+    if (!soa->nbrs) ErrorExit(ERROR_NOMEMORY, "MRISSoA_loadTopology: could not allocate %d neighbors", total);
+    soa->nbr_capacity = total;
+  }
+
+  for (vno = 0; vno < nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    memcpy(&soa->nbrs[soa->nbr_start[vno]], vt->v, vt->vnum*sizeof(int));
+  }
+
+  soa->topology_loaded = 1;
+  soa->topology_src    = mris;
+}
+
+
+void MRISSoA_load(MRIS_SoA* soa, MRIS* mris, bool loadDxyz) {
+  int const nvertices = mris->nvertices;
+
+  if (soa->nvertices != nvertices || soa->topology_src != mris) MRISSoA_invalidateTopology(soa);
+  MRISSoA_reserve(soa, nvertices);
+  soa->nvertices = nvertices;
+
+  if (!soa->topology_loaded) MRISSoA_loadTopology(soa, mris);
+
+  int vno;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (vno = 0; vno < nvertices; vno++) {
+    ROMP_PFLB_begin
+    VERTEX const * const v = &mris->vertices[vno];
+    soa->ripflag[vno] = v->ripflag;
+    soa->border [vno] = v->border;
+    soa->neg    [vno] = v->neg;
+    soa->x [vno] = v->x;  soa->y [vno] = v->y;  soa->z [vno] = v->z;
+    soa->nx[vno] = v->nx; soa->ny[vno] = v->ny; soa->nz[vno] = v->nz;
+    if (loadDxyz) {
+      soa->dx[vno] = v->dx; soa->dy[vno] = v->dy; soa->dz[vno] = v->dz;
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+
+void MRISSoA_unload(MRIS* mris, MRIS_SoA const * soa, bool unloadXYZ, bool unloadDxyz) {
+  cheapAssert(soa->nvertices == mris->nvertices);
+
+  if (unloadXYZ) {
+    // MRISsetXYZ invalidates the dists, so go through it rather than writing v->x directly
+    int vno;
+    for (vno = 0; vno < soa->nvertices; vno++) {
+      if (soa->ripflag[vno]) continue;
+      MRISsetXYZ(mris, vno, soa->x[vno], soa->y[vno], soa->z[vno]);
+    }
+  }
+
+  if (unloadDxyz) {
+    int vno;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+    for (vno = 0; vno < soa->nvertices; vno++) {
+      ROMP_PFLB_begin
+      VERTEX * const v = &mris->vertices[vno];
+      v->dx = soa->dx[vno]; v->dy = soa->dy[vno]; v->dz = soa->dz[vno];
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+  }
+}
+
+
+void MRISSoA_computeNeighborSums(MRIS_SoA* soa) {
+  int vno;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (vno = 0; vno < soa->nvertices; vno++) {
+    ROMP_PFLB_begin
+
+    float const x = soa->x[vno];
+    float const y = soa->y[vno];
+    float const z = soa->z[vno];
+
+    float sx = 0, sy = 0, sz = 0;
+    int n = 0;
+    int const * const nbrs = &soa->nbrs[soa->nbr_start[vno]];
+    int const vnum = soa->nbr_start[vno+1] - soa->nbr_start[vno];
+    for (int m = 0; m < vnum; m++) {
+      int const vnb = nbrs[m];
+      if (!soa->ripflag[vnb]) {
+        sx += soa->x[vnb] - x;
+        sy += soa->y[vnb] - y;
+        sz += soa->z[vnb] - z;
+        n++;
+      }
+    }
+    soa->sx[vno] = sx;
+    soa->sy[vno] = sy;
+    soa->sz[vno] = sz;
+    soa->sn[vno] = n;
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+
+bool MRISSoA_prepareSmoothnessTerms(MRIS_SoA* soa, MRIS* mris, INTEGRATION_PARMS const * parms) {
+  if (FZERO(parms->l_spring) && FZERO(parms->l_nspring) && FZERO(parms->l_tspring)) return false;
+  MRISSoA_load(soa, mris);
+  MRISSoA_computeNeighborSums(soa);
+  return true;
+}
@@ -18,6 +18,7 @@
 #include "mrisurf_sseTerms.h"
 
 #include "mrisurf_base.h"
+#include "mrisurf_SoA.h"
 
 double LOCATION_MOVE_LEN = 0.25;
 void mrisDxyzSetLocationMoveLen(double newval){
@@ -1087,6 +1088,64 @@ int mrisComputeSpringTerm(MRI_SURFACE *mris, double l_spring)
   return (NO_ERROR);
 }
 
+/*-----------------------------------------------------
+  Same as mrisComputeSpringTerm, but the 1-ring sums come from the SoA
+  built by MRISSoA_prepareSmoothnessTerms, so only v->d{xyz} of each
+  vertex is touched.  The arithmetic is the same, so the result is too.
+  ------------------------------------------------------*/
+int mrisComputeSpringTerm(MRIS *mris, MRIS_SoA const * soa, double l_spring)
+{
+  int vno;
+  float sx, sy, sz, dist_scale;
+
+  if (!soa) {
+    return mrisComputeSpringTerm(mris, l_spring);
+  }
+  if (FZERO(l_spring)) {
+    return (NO_ERROR);
+  }
+
+#if METRIC_SCALE
+  if (mris->patch) {
+    dist_scale = 1.0;
+  }
+  else {
+    dist_scale = sqrt(mris->orig_area / mris->total_area);
+  }
+#else
+  dist_scale = 1.0;
+#endif
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    if (soa->ripflag[vno]) {
+      continue;
+    }
+    if (soa->border[vno] && !soa->neg[vno]) {
+      continue;
+    }
+
+    int const n = soa->sn[vno];
+    sx = soa->sx[vno];
+    sy = soa->sy[vno];
+    sz = soa->sz[vno];
+    if (n > 0) {
+      sx = dist_scale * sx / n;
+      sy = dist_scale * sy / n;
+      sz = dist_scale * sz / n;
+    }
+
+    sx *= l_spring;
+    sy *= l_spring;
+    sz *= l_spring;
+    VERTEX * const v = &mris->vertices[vno];
+    v->dx += sx;
+    v->dy += sy;
+    v->dz += sz;
+    if (vno == Gdiag_no) fprintf(stdout, "v %d spring term:         (%2.3f, %2.3f, %2.3f)\n", vno, sx, sy, sz);
+  }
+
+  return (NO_ERROR);
+}
+
 /*-----------------------------------------------------
   Parameters:
 
@@ -1492,6 +1551,82 @@ void mrisComputeTangentialSpringTerm(MRIS *mris, double l_spring)
 }
 
 
+/*
+  The normal and tangential spring terms computed from the SoA 1-ring sums.
+  Both split the same umbrella vector into its normal and tangential parts.
+*/
+static void vertexComputeNormalAndTangentialSpringSoA(
+    MRIS_SoA const * soa, int vno, float* sxp, float* syp, float* szp, float* ncp)
+{
+  float sx = soa->sx[vno], sy = soa->sy[vno], sz = soa->sz[vno];
+  int const n = soa->sn[vno];
+  if (n > 0) {
+    sx /= n;
+    sy /= n;
+    sz /= n;
+  }
+  *sxp = sx;
+  *syp = sy;
+  *szp = sz;
+  // project onto normal
+  *ncp = sx * soa->nx[vno] + sy * soa->ny[vno] + sz * soa->nz[vno];
+}
+
+
+void mrisComputeNormalSpringTerm(MRIS *mris, MRIS_SoA const * soa, double l_spring)
+{
+  if (!soa) {
+    mrisComputeNormalSpringTerm(mris, l_spring);
+    return;
+  }
+  if (FZERO(l_spring)) return;
+
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    float dx = 0, dy = 0, dz = 0;
+    if (!soa->ripflag[vno]) {
+      float sx, sy, sz, nc;
+      vertexComputeNormalAndTangentialSpringSoA(soa, vno, &sx, &sy, &sz, &nc);
+      // move in normal direction
+      dx = l_spring * nc * soa->nx[vno];
+      dy = l_spring * nc * soa->ny[vno];
+      dz = l_spring * nc * soa->nz[vno];
+    }
+
+    VERTEX * const vertex = &mris->vertices[vno];
+    vertex->dx += dx;
+    vertex->dy += dy;
+    vertex->dz += dz;
+  }
+}
+
+
+void mrisComputeTangentialSpringTerm(MRIS *mris, MRIS_SoA const * soa, double l_spring)
+{
+  if (!soa) {
+    mrisComputeTangentialSpringTerm(mris, l_spring);
+    return;
+  }
+  if (FZERO(l_spring)) return;
+
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    float dx = 0, dy = 0, dz = 0;
+    if (!soa->ripflag[vno] && !(soa->border[vno] && !soa->neg[vno])) {
+      float sx, sy, sz, nc;
+      vertexComputeNormalAndTangentialSpringSoA(soa, vno, &sx, &sy, &sz, &nc);
+      // remove normal component and scale
+      dx = l_spring * (sx - nc * soa->nx[vno]);
+      dy = l_spring * (sy - nc * soa->ny[vno]);
+      dz = l_spring * (sz - nc * soa->nz[vno]);
+    }
+
+    VERTEX * const vertex = &mris->vertices[vno];
+    vertex->dx += dx;
+    vertex->dy += dy;
+    vertex->dz += dz;
+  }
+}
+
+
 int mrisComputeNonlinearTangentialSpringTerm(MRI_SURFACE *mris, double l_spring, double min_dist)
 {
   int vno, m, n;
@@ -420,7 +420,59 @@ static double MUTATION_PCT_INIT = (MUTATION_PCT * 1.0);
   0.1 /* replace this many with \
 mutated versions of best */
 #define MAX_UNCHANGED 3
-static int max_unchanged = MAX_UNCHANGED;
+
+/* random stream of one patch of the genetic search. Each stream is
+   derived from the defect seed, the generation and the patch index, so
+   that the patches of a generation can be built in any order. */
+typedef struct
+{
+  unsigned long long state;
+} DEFECT_RNG;
+
+static void defectRngInit(DEFECT_RNG *rng, long seed, int generation, int index)
+{
+  rng->state = (unsigned long long)seed;
+  rng->state = rng->state * 0x9E3779B97F4A7C15ULL + (unsigned long long)(long long)generation;
+  rng->state = rng->state * 0x9E3779B97F4A7C15ULL + (unsigned long long)(long long)index;
+}
+
+/* splitmix64 - falls back on the global generator without a stream */
+static double defectRandomNumber(DEFECT_RNG *rng, double low, double hi)
+{
+  unsigned long long z;
+
+  if (!rng) {
+    return (randomNumber(low, hi));
+  }
+  z = (rng->state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  return (low + (hi - low) * ((double)(z >> 11) * (1.0 / 9007199254740992.0)));
+}
+
+/* one copy of the corrected surface per thread. The copies are kept
+   identical to the corrected surface around the defects that remain to
+   be retessellated, and are used to evaluate patches and to retessellate
+   disjoint defects concurrently */
+typedef struct
+{
+  int nsurfaces;
+  MRIS **surfaces;
+} DEFECT_SURFACE_POOL;
+
+/* what a thread needs to evaluate the patches of a defect on its own
+   surface (the first slot is the corrected surface itself) */
+typedef struct
+{
+  MRIS *mris;
+  EDGE_TABLE *etable;
+  MRI *mri_defect_sign;
+  DVS *dvs;
+  ComputeDefectContext *computeDefectContext;
+  EDGE_TABLE etable_copy;
+  ComputeDefectContext computeDefectContext_copy;
+} DEFECT_SCRATCH;
 
 #define AREA_THRESHOLD 35.0f
 
@@ -469,7 +521,7 @@ static SEGMENTATION *segmentIntersectingEdges(MRIS *mris, DEFECT *defect, int *v
 static void saveSegmentation(
     MRIS *mris, MRIS *mris_corrected, DEFECT *defect, int *vertex_trans, ES *es, int nes, char *fname);
 // generate an ordering based on the segmented overlapping edges
-static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i);
+static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i, DEFECT_RNG *rng);
 static void savePatch(MRI *mri, MRIS *mris, MRIS *mris_corrected, DVS *dvs, DP *dp, char *fname, TOPOLOGY_PARMS *parms);
 // compute statistics of the surface
 static void mrisComputeSurfaceStatistics(
@@ -524,7 +576,8 @@ static int mrisTessellateDefect(MRI_SURFACE *mris,
                                 HISTOGRAM *h_grad,
                                 MRI *mri_gray_white,
                                 HISTOGRAM *h_dot,
-                                TOPOLOGY_PARMS *parms);
+                                TOPOLOGY_PARMS *parms,
+                                DEFECT_SURFACE_POOL *pool);
 static int mrisDefectRemoveDegenerateVertices(MRI_SURFACE *mris, float min_sphere_dist, DEFECT *defect);
 static int mrisDefectRemoveProximalVertices(MRI_SURFACE *mris, float min_orig_dist, DEFECT *defect);
 static int mrisDefectRemoveNegativeVertices(MRI_SURFACE *mris, DEFECT *defect);
@@ -581,6 +634,7 @@ static double mrisDefectPatchFitness(
     int *vertex_trans,
     DEFECT_VERTEX_STATE *dvs,
     RP *rp,
+    float *vertex_usage,
     HISTOGRAM *h_k1,
     HISTOGRAM *h_k2,
     MRI *mri_k1_k2,
@@ -593,8 +647,9 @@ static double mrisDefectPatchFitness(
     TOPOLOGY_PARMS *parms);
 static void vertexPseudoNormal(MRIS *mris1, int vn1, MRIS *mris2, int vn2, float norm[3]);
 
-static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pmutation);
-static int mrisCrossoverDefectPatches(DEFECT_PATCH *dp1, DEFECT_PATCH *dp2, DEFECT_PATCH *dp_dst, EDGE_TABLE *etable);
+static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pmutation, DEFECT_RNG *rng);
+static int mrisCrossoverDefectPatches(
+    DEFECT_PATCH *dp1, DEFECT_PATCH *dp2, DEFECT_PATCH *dp_dst, EDGE_TABLE *etable, DEFECT_RNG *rng);
 static int defectPatchRank(DEFECT_PATCH *dps, int index, int npatches);
 static int mrisCopyDefectPatch(DEFECT_PATCH *dp_src, DEFECT_PATCH *dp_dst);
 static int mrisComputeOptimalRetessellation(MRI_SURFACE *mris,
@@ -615,7 +670,8 @@ static int mrisComputeOptimalRetessellation(MRI_SURFACE *mris,
                                             HISTOGRAM *h_grad,
                                             MRI *mri_gray_white,
                                             HISTOGRAM *h_dot,
-                                            TOPOLOGY_PARMS *parms);
+                                            TOPOLOGY_PARMS *parms,
+                                            DEFECT_SURFACE_POOL *pool);
 static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
                                            MRI_SURFACE *mris_corrected,
                                            MRI *mri,
@@ -636,6 +692,61 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
                                            HISTOGRAM *h_dot,
                                            TOPOLOGY_PARMS *parms);
 static OPTIMAL_DEFECT_MAPPING *mrisFindOptimalDefectMapping(MRIS *mris, DEFECT *defect);
+static void mrisSetRetessellationWeightsFromEnv(TOPOLOGY_PARMS *parms);
+
+// per-thread copies of the corrected surface
+static DEFECT_SURFACE_POOL *mrisAllocDefectSurfacePool(MRIS *mris_corrected, int nsurfaces);
+static void mrisFreeDefectSurfacePool(DEFECT_SURFACE_POOL **ppool);
+static int mrisDefectRegion(MRIS *mris, DEFECT *defect, int *vertex_trans, int **pregion);
+static void mrisCopyDefectRegion(
+    MRIS *mris_dst, MRIS *mris_src, int *region, int nregion, int src_fno0, int src_fno1, int dst_fno0);
+static void mrisCopyDefectSurface(MRIS *mris_dst, MRIS *mris_src);
+static void mrisSyncDefectSurfacePool(
+    DEFECT_SURFACE_POOL *pool, MRIS *mris, MRIS *mris_corrected, DEFECT *defect, int *vertex_trans, int fno0);
+static int mrisReportDefectEulerNumber(MRIS *mris_corrected, DEFECT_LIST *dl, int i);
+static int mrisRetessellateDefectBatch(MRIS *mris,
+                                       MRIS *mris_corrected,
+                                       MRI *mri,
+                                       DEFECT_LIST *dl,
+                                       int first,
+                                       int *vertex_trans,
+                                       HISTOGRAM *h_k1,
+                                       HISTOGRAM *h_k2,
+                                       MRI *mri_k1_k2,
+                                       MRI *mri_gray_white,
+                                       HISTOGRAM *h_dot,
+                                       TOPOLOGY_PARMS *parms,
+                                       DEFECT_SURFACE_POOL *pool);
+static int mrisAllocDefectScratch(DEFECT_SCRATCH *slots,
+                                  DEFECT_SURFACE_POOL *pool,
+                                  int max_patches,
+                                  MRIS *mris_corrected,
+                                  DEFECT *defect,
+                                  int *vertex_trans,
+                                  EDGE_TABLE *etable,
+                                  MRI *mri_defect_sign,
+                                  DVS *dvs,
+                                  ComputeDefectContext *computeDefectContext);
+static void mrisFreeDefectScratch(DEFECT_SCRATCH *slots, int nslots);
+static void mrisSyncDefectScratchRipflags(DEFECT_SCRATCH *slots, int nslots, DEFECT *defect, int *vertex_trans);
+static void mrisDefectPatchesFitness(DEFECT_SCRATCH *slots,
+                                     int nslots,
+                                     DEFECT_PATCH **dps,
+                                     int npatches,
+                                     float *vertex_usage,
+                                     MRIS *mris,
+                                     MRI *mri,
+                                     int *vertex_trans,
+                                     HISTOGRAM *h_k1,
+                                     HISTOGRAM *h_k2,
+                                     MRI *mri_k1_k2,
+                                     HISTOGRAM *h_white,
+                                     HISTOGRAM *h_gray,
+                                     HISTOGRAM *h_border,
+                                     HISTOGRAM *h_grad,
+                                     MRI *mri_gray_white,
+                                     HISTOGRAM *h_dot,
+                                     TOPOLOGY_PARMS *parms);
 
 static int mrisComputeGrayWhiteBorderDistributions(MRI_SURFACE *mris,
                                                    MRI *mri,
@@ -1445,8 +1556,8 @@ double mrisComputeDefectLogLikelihood(
     HISTOGRAM *h_dot,
     TOPOLOGY_PARMS *parms)
 {
-  static int first_time = 1;
-  double ll = 0.0;
+  static volatile bool first_time = true;
+  double ll = 0.0, unmri_weight;
 
   dp->tp.face_ll = 0.0f;
   dp->tp.vertex_ll = 0.0f;
@@ -1454,13 +1565,17 @@ double mrisComputeDefectLogLikelihood(
   dp->tp.qcurv_ll = 0.0f;
   dp->tp.unmri_ll = 0.0f;
 
+  if (first_time)
+#ifdef HAVE_OPENMP
+  #pragma omp critical
+#endif
   if (first_time) {
     l_mri = parms->l_mri;
     l_unmri = parms->l_unmri;
     l_curv = parms->l_curv;
     l_qcurv = parms->l_qcurv;
 
-    first_time = 0;
+    first_time = false;
 
     /*      if (!FZERO(l_mri))
             fprintf(WHICH_OUTPUT,"l_mri = %2.2f ", l_mri) ;
@@ -1473,15 +1588,18 @@ double mrisComputeDefectLogLikelihood(
             fprintf(WHICH_OUTPUT,"\n") ;*/
   }
 
-  if (!FZERO(l_unmri) && (dp->mri_defect->width <= 5 || dp->mri_defect->height <= 5 || dp->mri_defect->depth <= 5)) {
-    l_unmri = 0;
+  /* patches are evaluated concurrently, so the unmri weight is not
+     switched off through the global */
+  unmri_weight = parms->l_unmri;
+  if (!FZERO(unmri_weight) && (dp->mri_defect->width <= 5 || dp->mri_defect->height <= 5 || dp->mri_defect->depth <= 5)) {
+    unmri_weight = 0;
   }
 
   if (!FZERO(l_mri)) {
     ll += l_mri * mrisComputeDefectMRILogLikelihood(mris, mri, &dp->tp, h_white, h_gray, h_grad, mri_gray_white);
   }
-  if (!FZERO(l_unmri)) {
-    ll += l_unmri * mrisComputeDefectMRILogUnlikelihood(computeDefectContext, mris, dp, h_border);
+  if (!FZERO(unmri_weight)) {
+    ll += unmri_weight * mrisComputeDefectMRILogUnlikelihood(computeDefectContext, mris, dp, h_border);
   }
   if (!FZERO(l_qcurv)) {
     /*compute the second fundamental form */
@@ -1492,7 +1610,6 @@ double mrisComputeDefectLogLikelihood(
     ll += l_curv * mrisComputeDefectNormalDotLogLikelihood(mris, &dp->tp, h_dot);
   }
 
-  l_unmri = parms->l_unmri;
   if (mrisCheckDefectFaces(mris, dp) < 0) ll -= 10000000;
 
   return (ll);
@@ -1640,17 +1757,22 @@ double mrisComputeDefectMRILogUnlikelihood(
     DEFECT_PATCH * const dp_nonconst, 
     HISTOGRAM    * const h_border_nonconst) {
 
-    static int once;
+    static volatile bool once;
     static int suppress_usecomputeDefectContext = 0;
-    if (!once++) {
+    if (!once)
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    if (!once) {
         if (getenv("FREESURFER_SUPPRESS_using_computeDefectContext")) {
             fprintf(stderr, "Suppressing using computeDefectContext\n");
             suppress_usecomputeDefectContext = 1;
         }
+        once = true;
     }
     if (suppress_usecomputeDefectContext) computeDefectContext = NULL;
     
-    int saved_noteVnoMovedInActiveRealmTreesCount = noteVnoMovedInActiveRealmTreesCount++;
+    int saved_noteVnoMovedInActiveRealmTreesCount = noteVnoMovedInActiveRealmTreesCount;
     
     //  TIMER_INTERVAL_BEGIN(A)
 
@@ -1819,6 +1941,9 @@ static void useComputeDefectContextRealmTree(
         fprintf(stderr, "%s:%d useComputeDefectContextRealmTree making realmTree\n",__FILE__,__LINE__);
 #endif
         computeDefectContext->realmTree = makeRealmTree(mris, getXYZ);
+#ifdef HAVE_OPENMP
+        #pragma omp atomic
+#endif
         mrisurf_orig_clock++;
         
         insertActiveRealmTree(mris, computeDefectContext->realmTree, getXYZ);
@@ -4762,7 +4887,7 @@ static void saveSegmentation(
   MRISwriteAnnotation(mris, name);
 }
 
-static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i)
+static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i, DEFECT_RNG *rng)
 {
   int n, m, val, r;
   int *ordering, *counter, nedges;
@@ -4774,7 +4899,7 @@ static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i)
   }
 
   if (segmentation == NULL) {
-    mrisMutateDefectPatch(dp, dp->etable, MUTATION_PCT_INIT);
+    mrisMutateDefectPatch(dp, dp->etable, MUTATION_PCT_INIT, rng);
     return;
   }
 
@@ -4813,7 +4938,7 @@ static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i)
       fflush(stdout);  // nicknote: prevents segfault on Linux PowerPC
       // when -O2 optimization is used w/gcc 3.3.3
 
-      r = nint(randomNumber(0.0, (double)nseg - 1));
+      r = nint(defectRandomNumber(rng, 0.0, (double)nseg - 1));
 
       val = seg_order[n];
       seg_order[n] = seg_order[r];
@@ -4843,7 +4968,7 @@ static void generateOrdering(DP *dp, SEGMENTATION *segmentation, int i)
   free(seg_order);
 
   if (r != i + 1) {
-    mrisMutateDefectPatch(dp, dp->etable, MUTATION_PCT_INIT);
+    mrisMutateDefectPatch(dp, dp->etable, MUTATION_PCT_INIT, rng);
   }
 }
 
@@ -5136,22 +5261,16 @@ static void savePatch(MRI *mri, MRIS *mris, MRIS *mris_corrected, DVS *dvs, DP *
   TPfree(&dp->tp);
 }
 
-static void updateVertexStatistics(
-    MRIS *mris, MRIS *mris_corrected, DVS *dvs, RP *rp, DP *dp, int *vertex_trans, float fitness)
+/* records, for each defect vertex, the displacement (curvbak) of the
+   vertices used by the current patch, or -1 if the vertex is not used.
+   The surface is left untouched, so that patches can be evaluated on
+   separate copies and their statistics applied later in a fixed order */
+static void collectVertexStatistics(MRIS *mris_corrected, DP *dp, int *vertex_trans, float *vertex_usage)
 {
   DEFECT *defect;
   EDGE_TABLE *etable;
   int i, nedges;
-  float total_vertex_fitness = 0.f, new_fitness;
   VERTEX *v;
-  static int first_time = 1;
-
-  // TO UPDATE TO BE CHECKED
-  if (first_time) {
-    first_time = 0;
-  };
-
-  fitness = 1.0f;  // to be updated ...
 
   nedges = dp->nedges;
   etable = dp->etable;
@@ -5169,38 +5288,47 @@ static void updateVertexStatistics(
     mris_corrected->vertices[vertex_trans[defect->border[i]]].marked = 0;
   }
 
-  /* then compute the total fitness of these used vertices */
-  total_vertex_fitness = 0.0f;
+  /* then record the used vertices and reset marks to zero */
   for (i = 0; i < defect->nvertices; i++) {
+    vertex_usage[i] = -1.0f;
     if (defect->status[i] == DISCARD_VERTEX) {
       continue;
     }
     v = &mris_corrected->vertices[vertex_trans[defect->vertices[i]]];
     if (v->marked == FINAL_VERTEX) {
-      total_vertex_fitness += v->curvbak * fitness;
+      vertex_usage[i] = v->curvbak;
     }
+    v->marked = 0;
   }
+}
 
-  if (FZERO(total_vertex_fitness)) {
-    total_vertex_fitness = 1.0f;
-  }
-
-  total_vertex_fitness /= 100.0f;
-  total_vertex_fitness = 1.0f;  // TO BE CHECKED
+static void applyVertexStatistics(RP *rp, DEFECT *defect, float const *vertex_usage)
+{
+  int i;
+  float new_fitness, fitness = 1.0f, total_vertex_fitness = 1.0f;  // TO BE CHECKED
 
-  /* finally update statistics and reset marks to zero */
   for (i = 0; i < defect->nvertices; i++) {
-    if (defect->status[i] == DISCARD_VERTEX) {
+    if (vertex_usage[i] < 0.0f) {
       continue;
     }
-    v = &mris_corrected->vertices[vertex_trans[defect->vertices[i]]];
-    if (v->marked == FINAL_VERTEX) {
-      new_fitness = (v->curvbak * fitness / total_vertex_fitness) + (float)rp->nused[i] * rp->vertex_fitness[i];
-      rp->vertex_fitness[i] = new_fitness / ((float)rp->nused[i] + 1.0f);
-      rp->nused[i]++;
-    }
-    v->marked = 0;
+    new_fitness = (vertex_usage[i] * fitness / total_vertex_fitness) + (float)rp->nused[i] * rp->vertex_fitness[i];
+    rp->vertex_fitness[i] = new_fitness / ((float)rp->nused[i] + 1.0f);
+    rp->nused[i]++;
+  }
+}
+
+static void updateVertexStatistics(
+    MRIS *mris, MRIS *mris_corrected, DVS *dvs, RP *rp, DP *dp, int *vertex_trans, float fitness)
+{
+  float *vertex_usage;
+
+  vertex_usage = (float *)malloc(dp->defect->nvertices * sizeof(float));
+  if (!vertex_usage) {
+    ErrorExit(ERROR_NOMEMORY, "updateVertexStatistics: could not allocate %d usages", dp->defect->nvertices);
   }
+  collectVertexStatistics(mris_corrected, dp, vertex_trans, vertex_usage);
+  applyVertexStatistics(rp, dp->defect, vertex_usage);
+  free(vertex_usage);
 }
 
 static int deleteWorstVertices(MRIS *mris, RP *rp, DEFECT *defect, int *vertex_trans, float fraction, int count)
@@ -5208,7 +5336,6 @@ static int deleteWorstVertices(MRIS *mris, RP *rp, DEFECT *defect, int *vertex_t
   int i, nvoxels, niters, init, changed;
   float max;
   int max_i;
-  static float threshold = 4.0f;
   nvoxels = 0;
 
   if (count <= 0) {
@@ -5235,7 +5362,7 @@ static int deleteWorstVertices(MRIS *mris, RP *rp, DEFECT *defect, int *vertex_t
   }
 
   if (fraction > 0.1) {
-    threshold /= 2.0f;
+    rp->threshold /= 2.0f;
   }
 
   // kill at most 20% of the vertices
@@ -5265,7 +5392,7 @@ static int deleteWorstVertices(MRIS *mris, RP *rp, DEFECT *defect, int *vertex_t
       }
     }
 
-    if (max_i < threshold && (2 * niters < init)) {
+    if (max_i < rp->threshold && (2 * niters < init)) {
       break;
     }
 
@@ -7411,6 +7538,26 @@ static void computeDisplacement(MRI_SURFACE *mris, DP *dp)
   }
 }
 
+/* zero the faces dropped by the last restore, so that the free face
+   slots are in the same state whatever patches were evaluated before */
+static void mrisClearTruncatedFaces(MRIS *mris, int nfaces)
+{
+  int fno;
+
+  for (fno = mris->nfaces; fno < nfaces; fno++) {
+    FACE *face = &mris->faces[fno];
+    PDMATRIX norm = face->norm;
+    A3PDMATRIX gradNorm = face->gradNorm;
+    bzero(face, sizeof(FACE));
+    face->norm = norm;
+    face->gradNorm = gradNorm;
+  }
+  if (nfaces > mris->nfaces) {
+    bzero(mris->faceNormCacheEntries + mris->nfaces, (nfaces - mris->nfaces) * sizeof(FaceNormCacheEntry));
+    bzero(mris->faceNormDeferredEntries + mris->nfaces, (nfaces - mris->nfaces) * sizeof(FaceNormDeferredEntry));
+  }
+}
+
 static double mrisDefectPatchFitness(
     ComputeDefectContext* computeDefectContext,
     MRI_SURFACE *mris,
@@ -7420,6 +7567,7 @@ static double mrisDefectPatchFitness(
     int *vertex_trans,
     DEFECT_VERTEX_STATE *dvs,
     RP *rp,
+    float *vertex_usage,
     HISTOGRAM *h_k1,
     HISTOGRAM *h_k2,
     MRI *mri_k1_k2,
@@ -7431,11 +7579,13 @@ static double mrisDefectPatchFitness(
     HISTOGRAM *h_dot,
     TOPOLOGY_PARMS *parms)
 {
-  int i, euler;
+  int i, euler, nfaces;
   VERTEX *v;
   DEFECT *defect = dp->defect;
 
-  defect->vertex_trans = vertex_trans;
+  if (defect->vertex_trans != vertex_trans) {
+    defect->vertex_trans = vertex_trans;
+  }
   dp->verbose_mode = parms->verbose;
 
   /* set the arrays to NULL in dp->tp */
@@ -7482,11 +7632,18 @@ static double mrisDefectPatchFitness(
       computeDefectContext,
       mris_corrected, mri, dp, h_k1, h_k2, mri_k1_k2, h_white, h_gray, h_border, h_grad, mri_gray_white, h_dot, parms);
 
-  /* update statistics */
-  updateVertexStatistics(mris, mris_corrected, dvs, rp, dp, vertex_trans, dp->fitness);
+  /* update statistics, or only record them if the caller applies them */
+  if (vertex_usage) {
+    collectVertexStatistics(mris_corrected, dp, vertex_trans, vertex_usage);
+  }
+  else {
+    updateVertexStatistics(mris, mris_corrected, dvs, rp, dp, vertex_trans, dp->fitness);
+  }
 
   /* restore the vertex state */
+  nfaces = mris_corrected->nfaces;
   mrisRestoreVertexState(mris_corrected, dvs);
+  mrisClearTruncatedFaces(mris_corrected, nfaces);
 
   /* reset the edges to the unused state (unless they were in the original tessellation) */
   for (i = 0; i < dp->nedges; i++) {
@@ -7836,6 +7993,8 @@ MRI_SURFACE *MRIScorrectTopology(
   MRI *mri_gray_white, *mri_k1_k2;
   MRIS *mris_corrected_final;
   char tmpstr[2000];
+  DEFECT_SURFACE_POOL *pool = NULL;
+  int batchable = 0;
 
   if(defectbase == NULL) defectbase = "defect";
 
@@ -8434,12 +8593,48 @@ MRI_SURFACE *MRIScorrectTopology(
     mrisComputeSurfaceStatistics(mris, mri, h_k1, h_k2, mri_k1_k2, mri_gray_white, h_dot);
 
   mrisMarkAllDefects(mris, dl, 0);
+
+  /* each defect gets its own random streams, so that the result does not
+     depend on the order in which the defects and their patches are done */
+  for (i = 0; i < dl->ndefects; i++) {
+    dl->defects[i].seed = (long)randomNumber(0.0, 2147483647.0);
+  }
+
+  /* the genetic search evaluates its patches, and retessellates defects
+     that are far apart, on copies of the corrected surface */
+  if (omp_get_max_threads() > 1 && parms->search_mode == GENETIC_SEARCH && !parms->optimal_mapping) {
+    double xv, yv, zv;
+
+    pool = mrisAllocDefectSurfacePool(mris_corrected, omp_get_max_threads());
+
+    // set up the shared state before the threads read it
+    MRISsurfaceRASToVoxelCached(mris, mri, 0.0, 0.0, 0.0, &xv, &yv, &zv);
+    mrisSetRetessellationWeightsFromEnv(parms);
+
+    // the defects are only retessellated concurrently when nothing is written along the way
+    batchable = parms->correct_defect < 0 && !parms->save_fname && !parms->movie &&
+                parms->verbose <= VERBOSE_MODE_DEFAULT && !DIAG_VERBOSE_ON && !(Gdiag & 0x1000000) &&
+                getenv("FS_DEBUG_PATCH") == NULL && getenv("USE_RANDOM_TOPOLOGY_CORRECTION") == NULL;
+  }
+
   for (i = 0; i < dl->ndefects; i++) {
+    int fno0;
+
     if (parms->correct_defect >= 0 && i != parms->correct_defect) {
       continue;
     }
 
+    if (batchable) {
+      n = mrisRetessellateDefectBatch(
+          mris, mris_corrected, mri, dl, i, vertex_trans, h_k1, h_k2, mri_k1_k2, mri_gray_white, h_dot, parms, pool);
+      if (n > 0) {
+        i += n - 1;
+        continue;
+      }
+    }
+
     defect = &dl->defects[i];
+    fno0 = mris_corrected->nfaces;
     if (i == Gdiag_no) {
       DiagBreak();
     }
@@ -8490,7 +8685,8 @@ MRI_SURFACE *MRIScorrectTopology(
                            h_grad,
                            mri_gray_white,
                            h_dot,
-                           parms);
+                           parms,
+                           NULL);
 
       {
         int ne, nv, nf, tt, theoric_euler, euler_nb;
@@ -8623,7 +8819,8 @@ MRI_SURFACE *MRIScorrectTopology(
                                h_grad,
                                mri_gray_white,
                                h_dot,
-                               parms);
+                               parms,
+                               NULL);
 
           {
             int ne, nv, nf, tt, theoric_euler, euler_nb;
@@ -8712,49 +8909,29 @@ MRI_SURFACE *MRIScorrectTopology(
                            h_grad,
                            mri_gray_white,
                            h_dot,
-                           parms);
+                           parms,
+                           pool);
     }
 
     /* compute Euler number of surface */
     if (parms->search_mode != GREEDY_SEARCH) {
-      int ne, nv, nf, tt, theoric_euler, euler_nb;
-      nf = mris_corrected->nfaces;
-      ne = nv = 0;
-      for (tt = 0; tt < mris_corrected->nvertices; tt++) {
-        if (mris_corrected->vertices[tt].ripflag) {
-          continue;
-        }
-        if (mris_corrected->vertices_topology[tt].vnum == 0) {
-          continue;
-        }
-        ne += mris_corrected->vertices_topology[tt].vnum;
-        nv++;
-      }
-      ne /= 2;
-      euler_nb = nv + nf - ne;
-      theoric_euler = 3 + defect->defect_number - dl->ndefects;
-      fprintf(WHICH_OUTPUT,
-              "After retessellation of defect %d (v0=%d), "
-              "euler #=%d (%d,%d,%d) : "
-              "difference with theory (%d) = %d \n",
-              i,
-              defect->vertices[0],
-              euler_nb,
-              nv,
-              ne,
-              nf,
-              theoric_euler,
-              theoric_euler - euler_nb);
 #if ADD_EXTRA_VERTICES
-      if (theoric_euler - euler_nb && retessellation_error < 0) {
+      if (mrisReportDefectEulerNumber(mris_corrected, dl, i) && retessellation_error < 0) {
         retessellation_error = i;
       }
+#else
+      mrisReportDefectEulerNumber(mris_corrected, dl, i);
 #endif
     }
 
+    if (pool) {
+      mrisSyncDefectSurfacePool(pool, mris, mris_corrected, defect, vertex_trans, fno0);
+    }
+
     if (parms->correct_defect >= 0 && i == parms->correct_defect)
       ErrorExit(ERROR_BADPARM, "TERMINATING PROGRAM AFTER CORRECTED DEFECT\n");
   }
+  mrisFreeDefectSurfacePool(&pool);
 #if ADD_EXTRA_VERTICES
   if (retessellation_error >= 0) {
     fprintf(WHICH_OUTPUT,
@@ -11135,7 +11312,8 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
                                 HISTOGRAM *h_grad,
                                 MRI *mri_gray_white,
                                 HISTOGRAM *h_dot,
-                                TOPOLOGY_PARMS *parms);
+                                TOPOLOGY_PARMS *parms,
+                                DEFECT_SURFACE_POOL *pool);
 				
 static int mrisTessellateDefect(MRI_SURFACE *mris,
                                 MRI_SURFACE *mris_corrected,
@@ -11151,7 +11329,8 @@ static int mrisTessellateDefect(MRI_SURFACE *mris,
                                 HISTOGRAM *h_grad,
                                 MRI *mri_gray_white,
                                 HISTOGRAM *h_dot,
-                                TOPOLOGY_PARMS *parms) {
+                                TOPOLOGY_PARMS *parms,
+                                DEFECT_SURFACE_POOL *pool) {
   fprintf(stderr,
           "CORRECTING DEFECT %d (vertices=%d, convex hull=%d, v0=%d)\n",
           defect->defect_number,
@@ -11162,7 +11341,7 @@ static int mrisTessellateDefect(MRI_SURFACE *mris,
   // TIMER_INTERVAL_BEGIN(old);
   
   int result = mrisTessellateDefect_wkr(
-    mris,mris_corrected,defect,vertex_trans,mri,h_k1,h_k2,mri_k1_k2,h_white,h_gray,h_border,h_grad,mri_gray_white,h_dot,parms);
+    mris,mris_corrected,defect,vertex_trans,mri,h_k1,h_k2,mri_k1_k2,h_white,h_gray,h_border,h_grad,mri_gray_white,h_dot,parms,pool);
 
   // TIMER_INTERVAL_END(old);
   
@@ -11206,13 +11385,13 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
                                 HISTOGRAM *h_grad,
                                 MRI *mri_gray_white,
                                 HISTOGRAM *h_dot,
-                                TOPOLOGY_PARMS *parms)
+                                TOPOLOGY_PARMS *parms,
+                                DEFECT_SURFACE_POOL *pool)
 {
-  int i, j, vlist[MAX_DEFECT_VERTICES], n, nvertices, nedges, ndiscarded;
+  int i, j, *vlist, n, nvertices, nedges, ndiscarded;
   VERTEX *v, *v2;
   EDGE *et;
   /*  double  cx, cy, cz, max_len ;*/
-  static int dno = 0;
   double x, y, z, xv, yv, zv, val0, val, total, dx, dy, dz, d, wval, gval, Ix, Iy, Iz;
   float norm1[3], norm2[3], nx, ny, nz;
   int nes; /* number of edges present in original tessellation */
@@ -11231,9 +11410,12 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
 
   /* first build table of all possible edges among vertices in the defect
      and on its border.*/
+  vlist = (int *)malloc((defect->nvertices + defect->nborder + 1) * sizeof(int));
+  if (!vlist)
+    ErrorExit(ERROR_NOMEMORY,
+              "mrisTessellateDefect: could not allocate %d vertex list",
+              defect->nvertices + defect->nborder);
   for (nes = nvertices = i = 0; i < defect->nvertices; i++) {
-    if (nvertices >= MAX_DEFECT_VERTICES)
-      ErrorExit(ERROR_NOMEMORY, "mrisTessellateDefect: too many vertices in defect (%d)", MAX_DEFECT_VERTICES);
     if (defect->status[i] == KEEP_VERTEX) {
       vlist[nvertices++] = defect->vertices[i];
     }
@@ -11249,9 +11431,9 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
             defect->defect_number,
             nvertices,
             defect->nchull);
-  dno++;
   if (nvertices == 0) /* should never happen */
   {
+    free(vlist);
     return (NO_ERROR);
   }
 
@@ -11485,28 +11667,53 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
 
   ROMP_SCOPE_begin
   /* find and discard all edges that intersect one that is already in the
-     tessellation.
+     tessellation and comes before them in the list. Edges in the
+     tessellation are never discarded, so each candidate can be tested
+     on its own, in parallel, and the list compacted afterwards.
   */
-  for (ndiscarded = i = 0; i < nedges; i++) {
-    if (et[i].used != USED_IN_TESSELLATION) {
-      continue;
-    }
-
-    for (j = i + 1; j < nedges; j++) {
-      if (et[j].used == USED_IN_TESSELLATION) {
-        continue;
+  {
+    int *tessellated = (int *)calloc(nedges + 1, sizeof(int));
+    char *discard = (char *)calloc(nedges + 1, sizeof(char));
+    int ntessellated = 0;
+    if (!tessellated || !discard)
+      ErrorExit(ERROR_NOMEMORY, "mrisTessellateDefect: could not allocate %d edge discard list", nedges);
+    for (i = 0; i < nedges; i++)
+      if (et[i].used == USED_IN_TESSELLATION) {
+        tessellated[ntessellated++] = i;
+      }
+
+    if (ntessellated > 0) {
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic, 64)
+#endif
+      for (j = 0; j < nedges; j++) {
+        ROMP_PFLB_begin
+        if (et[j].used != USED_IN_TESSELLATION) {
+          int t;
+          for (t = 0; t < ntessellated && tessellated[t] < j; t++)
+            if (edgesIntersect(mris_corrected, &et[tessellated[t]], &et[j])) {
+              discard[j] = 1;
+              break;
+            }
+        }
+        ROMP_PFLB_end
       }
+      ROMP_PF_end
+    }
 
-      if (edgesIntersect(mris_corrected, &et[i], &et[j])) {
+    for (ndiscarded = i = j = 0; i < nedges; i++) {
+      if (discard[i]) {
         ndiscarded++;
-        if (j < nedges - 1) {
-          memmove(&et[j], &et[j + 1], (nedges - j - 1) * sizeof(EDGE));
-        }
-
-        nedges--;
-        j--;
+      }
+      else {
+        if (j != i) et[j] = et[i];
+        j++;
       }
     }
+    nedges = j;
+    free(discard);
+    free(tessellated);
   }
   ROMP_SCOPE_end
   
@@ -11516,8 +11723,10 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
   /* sort the edge list by edge length */
   qsort(et, nedges, sizeof(EDGE), compare_edge_length);
 
+  free(vlist);
   if (!n) /* should never happen */
   {
+    free(et);
     return (NO_ERROR);
   }
 
@@ -11541,10 +11750,11 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
     }
 
   // main part of the routine: the retessellation (using a specific method) !
-  if (getenv("USE_GA_TOPOLOGY_CORRECTION") != NULL) {
+  // only write the shared parms when the mode changes
+  if (getenv("USE_GA_TOPOLOGY_CORRECTION") != NULL && parms->search_mode != GENETIC_SEARCH) {
     parms->search_mode = GENETIC_SEARCH;
   }
-  if (getenv("USE_RANDOM_TOPOLOGY_CORRECTION") != NULL) {
+  if (getenv("USE_RANDOM_TOPOLOGY_CORRECTION") != NULL && parms->search_mode != RANDOM_SEARCH) {
     parms->search_mode = RANDOM_SEARCH;
   }
 
@@ -11571,7 +11781,8 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
                                        h_grad,
                                        mri_gray_white,
                                        h_dot,
-                                       parms);
+                                       parms,
+                                       pool);
       ROMP_SCOPE_end
       break;
     case RANDOM_SEARCH:
@@ -11616,14 +11827,15 @@ static int mrisTessellateDefect_wkr(MRI_SURFACE *mris,
 
 #define NUM_TO_ADD_FROM_ONE_PARENT 1
 
-static int mrisCrossoverDefectPatches(DEFECT_PATCH *dp1, DEFECT_PATCH *dp2, DEFECT_PATCH *dp_dst, EDGE_TABLE *etable)
+static int mrisCrossoverDefectPatches(
+    DEFECT_PATCH *dp1, DEFECT_PATCH *dp2, DEFECT_PATCH *dp_dst, EDGE_TABLE *etable, DEFECT_RNG *rng)
 {
   int i1, i2, *added, i, isrc, j, nadded;
   double p;
   DEFECT_PATCH *dp_src;
 
   added = (int *)calloc(dp1->nedges, sizeof(int));
-  p = randomNumber(0.0, 1.0);
+  p = defectRandomNumber(rng, 0.0, 1.0);
   if (p < 0.5) /* add from first defect */
   {
     dp_src = dp1;
@@ -11716,7 +11928,7 @@ static int mrisCrossoverDefectPatches(DEFECT_PATCH *dp1, DEFECT_PATCH *dp2, DEFE
   return (NO_ERROR);
 }
 #define NTRY 0
-static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pmutation)
+static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pmutation, DEFECT_RNG *rng)
 {
   int i, j, eti, etj, tmp, *dp_indices, ntry;
   double p;
@@ -11729,7 +11941,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
   }
 
   for (i = 0; i < dp->nedges; i++) {
-    p = randomNumber(0.0, 1.0);
+    p = defectRandomNumber(rng, 0.0, 1.0);
     eti = dp->ordering[i];
 
     if (p < pmutation) {
@@ -11739,7 +11951,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
                                                                 two */
         {
           ntry = 0;
-          j = (int)randomNumber(0.0, dp->nedges - .1);
+          j = (int)defectRandomNumber(rng, 0.0, dp->nedges - .1);
           while (ntry < NTRY) {
             e = &etable->edges[dp->ordering[j]]; /*potential new edge */
             if (e->used != USED_IN_ORIGINAL_TESSELLATION) {
@@ -11748,7 +11960,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
             else {
               break;
             }
-            j = (int)randomNumber(0.0, dp->nedges - .1);
+            j = (int)defectRandomNumber(rng, 0.0, dp->nedges - .1);
           }
           tmp = dp->ordering[i];
           dp->ordering[i] = dp->ordering[j];
@@ -11757,7 +11969,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
         else /* swap two edges that intersect */
         {
           ntry = 0;
-          j = (int)randomNumber(0.0, etable->noverlap[eti] - 0.0001);
+          j = (int)defectRandomNumber(rng, 0.0, etable->noverlap[eti] - 0.0001);
           etj = etable->overlapping_edges[eti][j]; /* index of jth
                                                       overlapping edge */
           j = dp_indices[etj];                     /* find where it is in this
@@ -11770,7 +11982,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
             else {
               break;
             }
-            j = (int)randomNumber(0.0, etable->noverlap[eti] - 0.0001);
+            j = (int)defectRandomNumber(rng, 0.0, etable->noverlap[eti] - 0.0001);
             etj = etable->overlapping_edges[eti][j]; /* index of
                                                         jth overlapping
                                                         edge */
@@ -11787,7 +11999,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
       else {
         /* swap any two */
         ntry = 0;
-        j = (int)randomNumber(0.0, dp->nedges - .1);
+        j = (int)defectRandomNumber(rng, 0.0, dp->nedges - .1);
         while (ntry < NTRY) {
           e = &etable->edges[dp->ordering[j]]; /*potential new edge */
           if (e->used != USED_IN_ORIGINAL_TESSELLATION) {
@@ -11796,7 +12008,7 @@ static int mrisMutateDefectPatch(DEFECT_PATCH *dp, EDGE_TABLE *etable, double pm
           else {
             break;
           }
-          j = (int)randomNumber(0.0, dp->nedges - .1);
+          j = (int)defectRandomNumber(rng, 0.0, dp->nedges - .1);
         }
         tmp = dp->ordering[i];
         dp->ordering[i] = dp->ordering[j];
@@ -12057,144 +12269,936 @@ int mrisCountIntersectingFaces(MRIS *mris, int *flist, int nfaces)
   return count;
 }
 
-#define SAVE_FIT_VALS 0
-#if SAVE_FIT_VALS
-static float fitness_values[11000];
-static float best_values[11000];
+/*-----------------------------------------------------
+  Fill in the overlap lists of the edge table: for every edge, the
+  (at most MAX_EDGES) candidate edges that intersect it, in edge
+  order. Each edge is tested against all the others, so this is
+  quadratic in the number of candidate edges and dominates the set up
+  of large defects. The lists are independent and edgesIntersect only
+  reads the surface, so the edges are processed in parallel in blocks
+  of 25000, with the progress message between blocks.
+  ------------------------------------------------------*/
+static void mrisComputeEdgeTableOverlaps(MRIS *mris_corrected, EDGE_TABLE *etable, EDGE *et, int nedges)
+{
+  etable->overlapping_edges = (int **)calloc(nedges, sizeof(int *));
+  etable->noverlap = (int *)calloc(nedges, sizeof(int));
+  etable->flags = (unsigned char *)calloc(nedges, sizeof(unsigned char));
+  if (!etable->edges || !etable->overlapping_edges || !etable->noverlap || !etable->flags)
+    ErrorExit(ERROR_NOMEMORY,
+              "mrisComputeOptimalRetessellation: Excessive "
+              "topologic defect encountered: could not allocate %d "
+              "edge table",
+              nedges);
+
+  int const block = 25000;
+  int i0;
+  for (i0 = 0; i0 < nedges; i0 += block) {
+    if (nedges > 50000) {
+      fprintf(WHICH_OUTPUT, "%d of %d edges processed\n", i0, nedges);
+    }
+    int const i1 = MIN(nedges, i0 + block);
+
+    ROMP_PF_begin
+    int i;
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic, 64)
 #endif
+    for (i = i0; i < i1; i++) {
+      ROMP_PFLB_begin
+      int overlap[MAX_EDGES + 1];
+      int j, noverlap;
 
-static int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
-                                            MRI_SURFACE *mris_corrected,
-                                            MRI *mri,
-                                            DEFECT *defect,
-                                            int *vertex_trans,
-                                            EDGE *et,
-                                            int nedges,
-                                            ES *es,
-                                            int nes,
-                                            HISTOGRAM *h_k1,
-                                            HISTOGRAM *h_k2,
-                                            MRI *mri_k1_k2,
-                                            HISTOGRAM *h_white,
-                                            HISTOGRAM *h_gray,
-                                            HISTOGRAM *h_border,
-                                            HISTOGRAM *h_grad,
-                                            MRI *mri_gray_white,
-                                            HISTOGRAM *h_dot,
-                                            TOPOLOGY_PARMS *parms);
+      for (noverlap = j = 0; j < nedges; j++) {
+        if (j == i) {
+          continue;
+        }
+        if (edgesIntersect(mris_corrected, &et[i], &et[j])) {
+          overlap[noverlap] = j;
+          noverlap++;
+        }
+        if (noverlap > MAX_EDGES) {
+          break;
+        }
+      }
+      if (noverlap > 0) {
+        if (noverlap > MAX_EDGES) {
+          etable->noverlap[i] = MAX_EDGES;
+          etable->flags[i] |= ET_OVERLAP_LIST_INCOMPLETE;
+        }
+        else {
+          etable->noverlap[i] = noverlap;
+        }
 
+        etable->overlapping_edges[i] = (int *)calloc(etable->noverlap[i], sizeof(int));
+        if (!etable->overlapping_edges[i])
+          ErrorExit(ERROR_NOMEMORY,
+                    "mrisComputeOptimalRetessellation: Excessive "
+                    "topologic defect encountered: could not allocate "
+                    "overlap list %d "
+                    "with %d elts",
+                    i,
+                    etable->noverlap[i]);
+        memmove(etable->overlapping_edges[i], overlap, etable->noverlap[i] * sizeof(int));
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+  }
+}
 
-static int mrisComputeOptimalRetessellation(MRI_SURFACE *mris,
-                                            MRI_SURFACE *mris_corrected,
-                                            MRI *mri,
-                                            DEFECT *defect,
-                                            int *vertex_trans,
-                                            EDGE *et,
-                                            int nedges,
-                                            ES *es,
-                                            int nes,
-                                            HISTOGRAM *h_k1,
-                                            HISTOGRAM *h_k2,
-                                            MRI *mri_k1_k2,
-                                            HISTOGRAM *h_white,
-                                            HISTOGRAM *h_gray,
-                                            HISTOGRAM *h_border,
-                                            HISTOGRAM *h_grad,
-                                            MRI *mri_gray_white,
-                                            HISTOGRAM *h_dot,
-                                            TOPOLOGY_PARMS *parms)
+/*-----------------------------------------------------
+  Per-thread copies of the corrected surface.
+
+  The genetic search evaluates the patches of a generation concurrently,
+  each thread retessellating the defect on its own copy of the surface,
+  and defects that are far enough apart are retessellated concurrently
+  on separate copies. A retessellation only changes the vertices and
+  faces of the region around its defect, so the copies are brought up
+  to date by copying these regions instead of the whole surface.
+------------------------------------------------------*/
+static void mrisCopyDefectFace(MRIS *mris_dst, int fno_dst, MRIS *mris_src, int fno_src)
 {
-    int result;
-    ROMP_SCOPE_begin
-    result = mrisComputeOptimalRetessellation_wkr(mris,
-                                            mris_corrected,
-                                            mri,
-                                            defect,
-                                            vertex_trans,
-                                            et,
-                                            nedges,
-                                            es,
-                                            nes,
-                                            h_k1,
-                                            h_k2,
-                                            mri_k1_k2,
-                                            h_white,
-                                            h_gray,
-                                            h_border,
-                                            h_grad,
-                                            mri_gray_white,
-                                            h_dot,
-                                            parms);
-    ROMP_SCOPE_end
-    return result;
+  FACE *const fdst = &mris_dst->faces[fno_dst];
+  PDMATRIX norm = fdst->norm;
+  A3PDMATRIX gradNorm = fdst->gradNorm;
+
+  memmove(fdst, &mris_src->faces[fno_src], sizeof(FACE));
+  fdst->norm = norm;
+  fdst->gradNorm = gradNorm;
+  mris_dst->faceNormCacheEntries[fno_dst] = mris_src->faceNormCacheEntries[fno_src];
+  mris_dst->faceNormDeferredEntries[fno_dst] = mris_src->faceNormDeferredEntries[fno_src];
 }
 
-static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
-                                            MRI_SURFACE *mris_corrected,
-                                            MRI *mri,
-                                            DEFECT *defect,
-                                            int *vertex_trans,
-                                            EDGE *et,
-                                            int nedges,
-                                            ES *es,
-                                            int nes,
-                                            HISTOGRAM *h_k1,
-                                            HISTOGRAM *h_k2,
-                                            MRI *mri_k1_k2,
-                                            HISTOGRAM *h_white,
-                                            HISTOGRAM *h_gray,
-                                            HISTOGRAM *h_border,
-                                            HISTOGRAM *h_grad,
-                                            MRI *mri_gray_white,
-                                            HISTOGRAM *h_dot,
-                                            TOPOLOGY_PARMS *parms)
+/* copy vertex vno, renumbering the faces src_fno0..src_fno1-1 to start at dst_fno0 */
+static void mrisCopyDefectVertex(
+    MRIS *mris_dst, MRIS *mris_src, int vno, int src_fno0, int src_fno1, int dst_fno0)
 {
-  DEFECT_VERTEX_STATE *dvs;
-  DEFECT_PATCH dps1[MAX_PATCHES], dps2[MAX_PATCHES], *dps, *dp, *dps_next_generation;
-  int i, best_i, j, g, nselected, nreplacements, rank, nunchanged = 0, nelite, ncrossovers, k, l, noverlap;
-  int *overlap, ngenerations, nbests, last_euthanasia, nremovedvertices, nfinalvertices;
-  double fitness, best_fitness, last_best, fitness_mean, fitness_sigma, fitness_norm, pfitness, two_sigma_sq,
-      last_fitness;
-  static int dno = 0;     /* for debugging */
-  static int nmovies = 1; /* for making movies :
-                                 0 is left for the original surface*/
-  EDGE_TABLE etable;
-  int max_patches = MAX_PATCHES, ranks[MAX_PATCHES], next_gen_index, selected[MAX_PATCHES], nzero, sno = 0, max_edges,
-      debug_patch_n = -1, nbest = 0;
-  MRI *mri_defect, *mri_defect_white, *mri_defect_gray, *mri_defect_sign;
-  char fname[500];
-  SEGMENTATION *segmentation;
-  RP rp;
-  int number_of_patches, nbestpatch;
-  int ncross_overs, ntotalcross_overs, ntotalmutations, nmutations;
-  int nintersections;
-  static int first_time = 1;
+  VERTEX_TOPOLOGY const *const vsrct = &mris_src->vertices_topology[vno];
+  VERTEX_TOPOLOGY *const vdstt = &mris_dst->vertices_topology[vno];
+  VERTEX *const vdst = &mris_dst->vertices[vno];
+  float *dist = vdst->dist, *dist_orig = vdst->dist_orig;
+  int dist_capacity = vdst->dist_capacity, dist_orig_capacity = vdst->dist_orig_capacity;
+  void *vp = vdst->vp;
+  int n, fno, vsize;
+
+  memmove(vdst, &mris_src->vertices[vno], sizeof(VERTEX));
+  *(float **)(&vdst->dist) = dist;
+  *(float **)(&vdst->dist_orig) = dist_orig;
+  vdst->dist_capacity = dist_capacity;
+  vdst->dist_orig_capacity = dist_orig_capacity;
+  vdst->vp = vp;
+  if (vdst->fno >= src_fno0 && vdst->fno < src_fno1) {
+    vdst->fno += dst_fno0 - src_fno0;
+  }
+
+  vdstt->num = vsrct->num;
+  if (vsrct->num) {
+    vdstt->f = (int *)realloc(vdstt->f, vsrct->num * sizeof(int));
+    vdstt->n = (uchar *)realloc(vdstt->n, vsrct->num * sizeof(uchar));
+    if (!vdstt->f || !vdstt->n)
+      ErrorExit(ERROR_NOMEMORY, "mrisCopyDefectVertex: could not reallocate %d faces of vertex %d", vsrct->num, vno);
+    for (n = 0; n < vsrct->num; n++) {
+      fno = vsrct->f[n];
+      if (fno >= src_fno0 && fno < src_fno1) {
+        fno += dst_fno0 - src_fno0;
+      }
+      vdstt->f[n] = fno;
+      vdstt->n[n] = vsrct->n[n];
+    }
+  }
+
+  vdstt->nsizeMax = vsrct->nsizeMax;
+  modVnum(mris_dst, vno, vsrct->vnum, true);
+  vdstt->v2num = vsrct->v2num;
+  vdstt->v3num = vsrct->v3num;
+  vdstt->nsizeMaxClock = vsrct->nsizeMaxClock;
+  MRIS_setNsizeCur(mris_dst, vno, vsrct->nsizeCur);
+
+  vsize = mrisVertexVSize(mris_src, vno);
+  if (vsize) {
+    vdstt->v = (int *)realloc(vdstt->v, vsize * sizeof(int));
+    if (!vdstt->v)
+      ErrorExit(ERROR_NOMEMORY, "mrisCopyDefectVertex: could not reallocate %d neighbors of vertex %d", vsize, vno);
+    memmove(vdstt->v, vsrct->v, vsize * sizeof(int));
+  }
+}
 
-  nbestpatch = number_of_patches = 0;
-  ncross_overs = nmutations = 0;
-  ntotalcross_overs = ntotalmutations = 0;
+/* copy the vertices and faces of a surface with the same dimensions */
+static void mrisCopyDefectSurface(MRIS *mris_dst, MRIS *mris_src)
+{
+  int vno, fno;
 
-  if (first_time) {
-    char *cp;
+  for (vno = 0; vno < mris_src->nvertices; vno++) {
+    mrisCopyDefectVertex(mris_dst, mris_src, vno, 0, 0, 0);
+  }
+
+  // the free face slots are copied too, so that new faces start from the same state
+  MRISgrowNFaces(mris_dst, mris_src->max_faces);
+  for (fno = 0; fno < mris_src->max_faces; fno++) {
+    mrisCopyDefectFace(mris_dst, fno, mris_src, fno);
+  }
+  MRIStruncateNFaces(mris_dst, mris_src->nfaces);
+}
+
+static DEFECT_SURFACE_POOL *mrisAllocDefectSurfacePool(MRIS *mris_corrected, int nsurfaces)
+{
+  DEFECT_SURFACE_POOL *pool;
+  MRIS *mris;
+  int n;
+
+  pool = (DEFECT_SURFACE_POOL *)calloc(1, sizeof(DEFECT_SURFACE_POOL));
+  if (!pool) ErrorExit(ERROR_NOMEMORY, "mrisAllocDefectSurfacePool: could not allocate pool");
+  pool->surfaces = (MRIS **)calloc(nsurfaces, sizeof(MRIS *));
+  if (!pool->surfaces) ErrorExit(ERROR_NOMEMORY, "mrisAllocDefectSurfacePool: could not allocate %d surfaces", nsurfaces);
+  pool->nsurfaces = nsurfaces;
+
+  for (n = 0; n < nsurfaces; n++) {
+    mris = MRISoverAlloc(
+        mris_corrected->max_vertices, mris_corrected->max_faces, mris_corrected->nvertices, mris_corrected->nfaces);
+
+    mris->type = mris_corrected->type;
+    mris->status = mris_corrected->status;
+    mris->origxyz_status = mris_corrected->origxyz_status;
+    mris->nsize = mris_corrected->nsize;
+    mris->max_nsize = mris_corrected->max_nsize;
+    mris->vtotalsMightBeTooBig = mris_corrected->vtotalsMightBeTooBig;
+    mris->nsizeMaxClock = mris_corrected->nsizeMaxClock;
+    mris->hemisphere = mris_corrected->hemisphere;
+    mris->useRealRAS = mris_corrected->useRealRAS;
+    mris->xctr = mris_corrected->xctr;
+    mris->yctr = mris_corrected->yctr;
+    mris->zctr = mris_corrected->zctr;
+    mris->xlo = mris_corrected->xlo;
+    mris->ylo = mris_corrected->ylo;
+    mris->zlo = mris_corrected->zlo;
+    mris->xhi = mris_corrected->xhi;
+    mris->yhi = mris_corrected->yhi;
+    mris->zhi = mris_corrected->zhi;
+    mris->min_curv = mris_corrected->min_curv;
+    mris->max_curv = mris_corrected->max_curv;
+    mris->total_area = mris_corrected->total_area;
+    mris->orig_area = mris_corrected->orig_area;
+    mris->radius = mris_corrected->radius;
+    mris->avg_vertex_area = mris_corrected->avg_vertex_area;
+    mrisSetAvgInterVertexDist(mris, mris_corrected->avg_vertex_dist);
+    mris->std_vertex_dist = mris_corrected->std_vertex_dist;
+    mris->vg = mris_corrected->vg;
+    mris->fname = mris_corrected->fname;
+    mris->subject_name = mris_corrected->subject_name;
+
+    // just copy the pointers, they belong to the corrected surface
+    mris->lta = mris_corrected->lta;
+    mris->SRASToTalSRAS_ = mris_corrected->SRASToTalSRAS_;
+    mris->TalSRASToSRAS_ = mris_corrected->TalSRASToSRAS_;
+    mris->free_transform = 0;
+
+    mrisCopyDefectSurface(mris, mris_corrected);
+    pool->surfaces[n] = mris;
+  }
+
+  return (pool);
+}
+
+static void mrisFreeDefectSurfacePool(DEFECT_SURFACE_POOL **ppool)
+{
+  DEFECT_SURFACE_POOL *pool = *ppool;
+  int n;
+
+  *ppool = NULL;
+  if (!pool) {
+    return;
+  }
+  for (n = 0; n < pool->nsurfaces; n++) {
+    // the faces above nfaces may hold normals too
+    MRISgrowNFaces(pool->surfaces[n], pool->surfaces[n]->max_faces);
+    MRISfree(&pool->surfaces[n]);
+  }
+  free(pool->surfaces);
+  free(pool);
+}
+
+/* list, in increasing order, the vertices of the corrected surface that
+   the retessellation of a defect may change: the defect, its border and
+   its convex hull, and their neighbors in the original tessellation */
+static int mrisDefectRegion(MRIS *mris, DEFECT *defect, int *vertex_trans, int **pregion)
+{
+  int *vlist, *region, nvlist, nregion, i, n;
+
+  nvlist = defect->nvertices + defect->nborder + defect->nchull;
+  vlist = (int *)malloc(nvlist * sizeof(int));
+  if (!vlist) ErrorExit(ERROR_NOMEMORY, "mrisDefectRegion: could not allocate %d vertices", nvlist);
+  memmove(vlist, defect->vertices, defect->nvertices * sizeof(int));
+  memmove(vlist + defect->nvertices, defect->border, defect->nborder * sizeof(int));
+  memmove(vlist + defect->nvertices + defect->nborder, defect->chull, defect->nchull * sizeof(int));
+
+  for (nregion = i = 0; i < nvlist; i++) {
+    nregion += 1 + mris->vertices_topology[vlist[i]].vnum;
+  }
+  region = (int *)malloc(MAX(1, nregion) * sizeof(int));
+  if (!region) ErrorExit(ERROR_NOMEMORY, "mrisDefectRegion: could not allocate %d vertices", nregion);
+
+  for (nregion = i = 0; i < nvlist; i++) {
+    VERTEX_TOPOLOGY const *const vt = &mris->vertices_topology[vlist[i]];
+    if (vertex_trans[vlist[i]] >= 0) {
+      region[nregion++] = vertex_trans[vlist[i]];
+    }
+    for (n = 0; n < vt->vnum; n++)
+      if (vertex_trans[vt->v[n]] >= 0) {
+        region[nregion++] = vertex_trans[vt->v[n]];
+      }
+  }
+  free(vlist);
+
+  sort_int(region, nregion, true);
+  for (n = i = 0; i < nregion; i++)
+    if (!n || region[i] != region[n - 1]) {
+      region[n++] = region[i];
+    }
+
+  *pregion = region;
+  return (n);
+}
+
+/* copy the region of a defect from one surface to another. The faces
+   src_fno0..src_fno1-1 added by its retessellation become the faces
+   starting at dst_fno0, the older faces keep their numbers */
+static void mrisCopyDefectRegion(
+    MRIS *mris_dst, MRIS *mris_src, int *region, int nregion, int src_fno0, int src_fno1, int dst_fno0)
+{
+  int i, n, fno;
+
+  // the older faces of the region, before and after the retessellation
+  for (i = 0; i < nregion; i++) {
+    VERTEX_TOPOLOGY const *const vt = &mris_dst->vertices_topology[region[i]];
+    for (n = 0; n < vt->num; n++)
+      if (vt->f[n] < src_fno0) {
+        mrisCopyDefectFace(mris_dst, vt->f[n], mris_src, vt->f[n]);
+      }
+  }
+  for (i = 0; i < nregion; i++) {
+    VERTEX_TOPOLOGY const *const vt = &mris_src->vertices_topology[region[i]];
+    for (n = 0; n < vt->num; n++)
+      if (vt->f[n] < src_fno0) {
+        mrisCopyDefectFace(mris_dst, vt->f[n], mris_src, vt->f[n]);
+      }
+  }
+
+  for (i = 0; i < nregion; i++) {
+    mrisCopyDefectVertex(mris_dst, mris_src, region[i], src_fno0, src_fno1, dst_fno0);
+  }
+
+  if (dst_fno0 + src_fno1 - src_fno0 > mris_dst->nfaces) {
+    MRISgrowNFaces(mris_dst, dst_fno0 + src_fno1 - src_fno0);
+  }
+  for (fno = src_fno0; fno < src_fno1; fno++) {
+    mrisCopyDefectFace(mris_dst, fno - src_fno0 + dst_fno0, mris_src, fno);
+  }
+}
+
+/* bring the copies of the corrected surface up to date after the
+   retessellation of a defect, whose faces start at fno0 */
+static void mrisSyncDefectSurfacePool(
+    DEFECT_SURFACE_POOL *pool, MRIS *mris, MRIS *mris_corrected, DEFECT *defect, int *vertex_trans, int fno0)
+{
+  int *region, nregion, n;
+
+  nregion = mrisDefectRegion(mris, defect, vertex_trans, &region);
+  for (n = 0; n < pool->nsurfaces; n++) {
+    mrisCopyDefectRegion(pool->surfaces[n], mris_corrected, region, nregion, fno0, mris_corrected->nfaces, fno0);
+  }
+  free(region);
+}
+
+/* print the Euler number of the corrected surface after the retessellation
+   of defect i and return its difference with the expected one */
+static int mrisReportDefectEulerNumber(MRIS *mris_corrected, DEFECT_LIST *dl, int i)
+{
+  DEFECT *defect = &dl->defects[i];
+  int ne, nv, nf, tt, theoric_euler, euler_nb;
+
+  nf = mris_corrected->nfaces;
+  ne = nv = 0;
+  for (tt = 0; tt < mris_corrected->nvertices; tt++) {
+    if (mris_corrected->vertices[tt].ripflag) {
+      continue;
+    }
+    if (mris_corrected->vertices_topology[tt].vnum == 0) {
+      continue;
+    }
+    ne += mris_corrected->vertices_topology[tt].vnum;
+    nv++;
+  }
+  ne /= 2;
+  euler_nb = nv + nf - ne;
+  theoric_euler = 3 + defect->defect_number - dl->ndefects;
+  fprintf(WHICH_OUTPUT,
+          "After retessellation of defect %d (v0=%d), "
+          "euler #=%d (%d,%d,%d) : "
+          "difference with theory (%d) = %d \n",
+          i,
+          defect->vertices[0],
+          euler_nb,
+          nv,
+          ne,
+          nf,
+          theoric_euler,
+          theoric_euler - euler_nb);
+
+  return (theoric_euler - euler_nb);
+}
+
+typedef struct
+{
+  DEFECT defect;       /* state of the defect before its retessellation */
+  char *status;
+  int *region, nregion;
+  float lo[9], hi[9];  /* bounding boxes of the region in the current,
+                          original and canonical coordinates */
+  int fno1;            /* faces of its copy of the surface once retessellated */
+  int dst_fno0, dst_fno1; /* and where they went in the corrected surface */
+  HISTOGRAM *h_white, *h_gray, *h_border, *h_grad;
+} DEFECT_BATCH_ENTRY;
+
+static void mrisDefectRegionBox(MRIS *mris, int *region, int nregion, float *lo, float *hi)
+{
+  int i, k;
+
+  for (i = 0; i < nregion; i++) {
+    VERTEX const *const v = &mris->vertices[region[i]];
+    float const xyz[9] = {v->x, v->y, v->z, v->origx, v->origy, v->origz, v->cx, v->cy, v->cz};
+    for (k = 0; k < 9; k++) {
+      lo[k] = MIN(lo[k], xyz[k]);
+      hi[k] = MAX(hi[k], xyz[k]);
+    }
+  }
+}
+
+/* whether two regions are closer than pad in any of the coordinates */
+static int mrisDefectBoxesOverlap(float const *lo1, float const *hi1, float const *lo2, float const *hi2, float pad)
+{
+  int s, k;
+
+  for (s = 0; s < 9; s += 3) {
+    for (k = s; k < s + 3; k++)
+      if (lo1[k] > hi2[k] + pad || lo2[k] > hi1[k] + pad) {
+        break;
+      }
+    if (k == s + 3) {
+      return (1);
+    }
+  }
+  return (0);
+}
+
+static void mrisFreeDefectBatchEntry(DEFECT_BATCH_ENTRY *entry)
+{
+  free(entry->region);
+  free(entry->status);
+  if (entry->h_white) {
+    HISTOfree(&entry->h_white);
+    HISTOfree(&entry->h_gray);
+    HISTOfree(&entry->h_border);
+    HISTOfree(&entry->h_grad);
+  }
+}
+
+/* retessellate the defects first, first+1, ... concurrently, each one on
+   its own copy of the corrected surface, as long as they are far enough
+   apart for the retessellation of one not to see the others. Returns the
+   number of defects corrected, 0 if they have to be done one at a time */
+static int mrisRetessellateDefectBatch(MRIS *mris,
+                                       MRIS *mris_corrected,
+                                       MRI *mri,
+                                       DEFECT_LIST *dl,
+                                       int first,
+                                       int *vertex_trans,
+                                       HISTOGRAM *h_k1,
+                                       HISTOGRAM *h_k2,
+                                       MRI *mri_k1_k2,
+                                       MRI *mri_gray_white,
+                                       HISTOGRAM *h_dot,
+                                       TOPOLOGY_PARMS *parms,
+                                       DEFECT_SURFACE_POOL *pool)
+{
+  DEFECT_BATCH_ENTRY *entries;
+  DEFECT *defect;
+  int nentries, ncorrected, n, j, k, fno0;
+  float scale, pad;
+
+  /* the retessellation only looks at the faces of the realm of its defect
+     volume, which extends delta+2.5 voxels past the defect, plus a margin */
+  scale = parms->volume_resolution == -1 ? VOLUME_SCALE : parms->volume_resolution;
+  pad = 1.0f + (2.0f * scale + 2.5f) / scale + 2.0f;
+
+  entries = (DEFECT_BATCH_ENTRY *)calloc(pool->nsurfaces, sizeof(DEFECT_BATCH_ENTRY));
+  if (!entries) ErrorExit(ERROR_NOMEMORY, "mrisRetessellateDefectBatch: could not allocate %d entries", pool->nsurfaces);
+
+  for (nentries = 0, k = first; k < dl->ndefects && nentries < pool->nsurfaces; k++) {
+    DEFECT_BATCH_ENTRY *const entry = &entries[nentries];
+    int const nvertices = dl->defects[k].nvertices + dl->defects[k].nborder;
+
+    /* large defects print their own warnings */
+    if (nvertices * (nvertices - 1) / 2 > 100000) {
+      break;
+    }
+
+    entry->nregion = mrisDefectRegion(mris, &dl->defects[k], vertex_trans, &entry->region);
+    for (n = 0; n < 9; n++) {
+      entry->lo[n] = 1e10;
+      entry->hi[n] = -1e10;
+    }
+    mrisDefectRegionBox(mris_corrected, entry->region, entry->nregion, entry->lo, entry->hi);
+    for (j = 0; j < nentries; j++)
+      if (mrisDefectBoxesOverlap(entries[j].lo, entries[j].hi, entry->lo, entry->hi, pad)) {
+        break;
+      }
+    if (j < nentries) {
+      free(entry->region);
+      entry->region = NULL;
+      break;
+    }
+    nentries++;
+  }
+
+  if (nentries < 2) {
+    for (n = 0; n < nentries; n++) {
+      mrisFreeDefectBatchEntry(&entries[n]);
+    }
+    free(entries);
+    return (0);
+  }
+
+  for (n = 0; n < nentries; n++) {
+    DEFECT_BATCH_ENTRY *const entry = &entries[n];
+
+    defect = &dl->defects[first + n];
+    entry->defect = *defect;
+    entry->status = (char *)malloc(MAX(1, defect->nvertices) * sizeof(char));
+    if (!entry->status) ErrorExit(ERROR_NOMEMORY, "mrisRetessellateDefectBatch: could not save defect status");
+    memmove(entry->status, defect->status, defect->nvertices * sizeof(char));
+
+    entry->h_gray = HISTOalloc(256);
+    entry->h_white = HISTOalloc(256);
+    entry->h_border = HISTOalloc(256);
+    entry->h_grad = HISTOalloc(256);
+    mrisMarkAllDefects(mris, dl, 1);
+    mrisComputeGrayWhiteBorderDistributions(
+        mris, mri, defect, entry->h_white, entry->h_gray, entry->h_border, entry->h_grad);
+    mrisMarkAllDefects(mris, dl, 0);
+  }
+
+  fno0 = mris_corrected->nfaces;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) num_threads(nentries) schedule(static, 1)
+#endif
+  for (n = 0; n < nentries; n++) {
+    ROMP_PFLB_begin
+    DEFECT_BATCH_ENTRY *const entry = &entries[n];
+
+    mrisTessellateDefect_wkr(mris,
+                             pool->surfaces[n],
+                             &dl->defects[first + n],
+                             vertex_trans,
+                             mri,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             entry->h_white,
+                             entry->h_gray,
+                             entry->h_border,
+                             entry->h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms,
+                             NULL);
+    entry->fno1 = pool->surfaces[n]->nfaces;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  /* the retessellation may have moved the vertices of the region */
+  for (n = 0; n < nentries; n++) {
+    mrisDefectRegionBox(pool->surfaces[n], entries[n].region, entries[n].nregion, entries[n].lo, entries[n].hi);
+  }
+
+  /* transfer the retessellations in order, checking that none of them
+     came closer to a later defect than the batch was formed for */
+  for (ncorrected = 0; ncorrected < nentries; ncorrected++) {
+    DEFECT_BATCH_ENTRY *const entry = &entries[ncorrected];
+
+    for (j = 0; j < ncorrected; j++)
+      if (mrisDefectBoxesOverlap(entries[j].lo, entries[j].hi, entry->lo, entry->hi, pad)) {
+        break;
+      }
+    if (j < ncorrected) {
+      break;
+    }
+
+    defect = &dl->defects[first + ncorrected];
+    entry->dst_fno0 = mris_corrected->nfaces;
+    entry->dst_fno1 = entry->dst_fno0 + entry->fno1 - fno0;
+    fprintf(stderr,
+            "CORRECTING DEFECT %d (vertices=%d, convex hull=%d, v0=%d)\n",
+            defect->defect_number,
+            defect->nvertices,
+            defect->nchull,
+            defect->vertices[0]);
+    mrisCopyDefectRegion(mris_corrected,
+                         pool->surfaces[ncorrected],
+                         entry->region,
+                         entry->nregion,
+                         fno0,
+                         entry->fno1,
+                         entry->dst_fno0);
+    mrisReportDefectEulerNumber(mris_corrected, dl, first + ncorrected);
+  }
+
+  /* the defects left over are corrected again from their initial state */
+  for (n = ncorrected; n < nentries; n++) {
+    defect = &dl->defects[first + n];
+    *defect = entries[n].defect;
+    memmove(defect->status, entries[n].status, defect->nvertices * sizeof(char));
+    mrisCopyDefectSurface(pool->surfaces[n], mris_corrected);
+  }
+
+  for (n = 0; n < pool->nsurfaces; n++) {
+    if (n < nentries && n >= ncorrected) {
+      continue;
+    }
+    for (j = 0; j < ncorrected; j++) {
+      mrisCopyDefectRegion(pool->surfaces[n],
+                           mris_corrected,
+                           entries[j].region,
+                           entries[j].nregion,
+                           entries[j].dst_fno0,
+                           entries[j].dst_fno1,
+                           entries[j].dst_fno0);
+    }
+  }
+
+  for (n = 0; n < nentries; n++) {
+    mrisFreeDefectBatchEntry(&entries[n]);
+  }
+  free(entries);
+
+  return (ncorrected);
+}
+
+/* set up one slot per thread for the genetic search of a defect */
+static int mrisAllocDefectScratch(DEFECT_SCRATCH *slots,
+                                  DEFECT_SURFACE_POOL *pool,
+                                  int max_patches,
+                                  MRIS *mris_corrected,
+                                  DEFECT *defect,
+                                  int *vertex_trans,
+                                  EDGE_TABLE *etable,
+                                  MRI *mri_defect_sign,
+                                  DVS *dvs,
+                                  ComputeDefectContext *computeDefectContext)
+{
+  int n, nslots;
+
+  nslots = 1;
+  if (pool) {
+    nslots = MAX(1, MIN(pool->nsurfaces, max_patches));
+  }
+#ifdef HAVE_OPENMP
+  // defects retessellated concurrently evaluate their patches serially
+  if (omp_in_parallel()) {
+    nslots = 1;
+  }
+#endif
+
+  slots[0].mris = mris_corrected;
+  slots[0].etable = etable;
+  slots[0].mri_defect_sign = mri_defect_sign;
+  slots[0].dvs = dvs;
+  slots[0].computeDefectContext = computeDefectContext;
+
+  for (n = 1; n < nslots; n++) {
+    DEFECT_SCRATCH *const slot = &slots[n];
+
+    slot->mris = pool->surfaces[n];
+
+    // the edges record their use by the patch, the overlaps are shared
+    slot->etable_copy = *etable;
+    slot->etable_copy.edges = (EDGE *)malloc(etable->nedges * sizeof(EDGE));
+    if (!slot->etable_copy.edges)
+      ErrorExit(ERROR_NOMEMORY, "mrisAllocDefectScratch: could not allocate %d edges", etable->nedges);
+    memmove(slot->etable_copy.edges, etable->edges, etable->nedges * sizeof(EDGE));
+    slot->etable = &slot->etable_copy;
+
+    slot->mri_defect_sign = NULL;
+    if (mri_defect_sign)
+      slot->mri_defect_sign =
+          MRIalloc(mri_defect_sign->width, mri_defect_sign->height, mri_defect_sign->depth, MRI_FLOAT);
+
+    slot->dvs = mrisRecordVertexState(slot->mris, defect, vertex_trans);
+
+    constructComputeDefectContext(&slot->computeDefectContext_copy);
+    slot->computeDefectContext = &slot->computeDefectContext_copy;
+  }
+
+  return (nslots);
+}
+
+static void mrisFreeDefectScratch(DEFECT_SCRATCH *slots, int nslots)
+{
+  int n;
+
+  for (n = 1; n < nslots; n++) {
+    DEFECT_SCRATCH *const slot = &slots[n];
+
+    destructComputeDefectContext(slot->computeDefectContext);
+    mrisFreeDefectVertexState(slot->dvs);
+    if (slot->mri_defect_sign) {
+      MRIfree(&slot->mri_defect_sign);
+    }
+    free(slot->etable_copy.edges);
+  }
+}
+
+/* propagate the vertices discarded by deleteWorstVertices to the scratch surfaces */
+static void mrisSyncDefectScratchRipflags(DEFECT_SCRATCH *slots, int nslots, DEFECT *defect, int *vertex_trans)
+{
+  int n, i, vno;
+
+  for (n = 1; n < nslots; n++)
+    for (i = 0; i < defect->nvertices; i++) {
+      vno = vertex_trans[defect->vertices[i]];
+      if (vno >= 0) {
+        slots[n].mris->vertices[vno].ripflag = slots[0].mris->vertices[vno].ripflag;
+      }
+    }
+}
+
+/* evaluate a set of patches, one per thread. The statistics of the
+   vertices used by patch n are recorded in vertex_usage[n*nvertices],
+   for the caller to apply in a fixed order */
+static void mrisDefectPatchesFitness(DEFECT_SCRATCH *slots,
+                                     int nslots,
+                                     DEFECT_PATCH **dps,
+                                     int npatches,
+                                     float *vertex_usage,
+                                     MRIS *mris,
+                                     MRI *mri,
+                                     int *vertex_trans,
+                                     HISTOGRAM *h_k1,
+                                     HISTOGRAM *h_k2,
+                                     MRI *mri_k1_k2,
+                                     HISTOGRAM *h_white,
+                                     HISTOGRAM *h_gray,
+                                     HISTOGRAM *h_border,
+                                     HISTOGRAM *h_grad,
+                                     MRI *mri_gray_white,
+                                     HISTOGRAM *h_dot,
+                                     TOPOLOGY_PARMS *parms)
+{
+  int n;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) num_threads(nslots) schedule(dynamic, 1)
+#endif
+  for (n = 0; n < npatches; n++) {
+    ROMP_PFLB_begin
+    DEFECT_SCRATCH *const slot = &slots[omp_get_thread_num()];
+    DEFECT_PATCH dp = *dps[n];
+
+    dp.etable = slot->etable;
+    dp.mri_defect_sign = slot->mri_defect_sign;
+    mrisDefectPatchFitness(slot->computeDefectContext,
+                           mris,
+                           slot->mris,
+                           mri,
+                           &dp,
+                           vertex_trans,
+                           slot->dvs,
+                           NULL,
+                           vertex_usage + n * dp.defect->nvertices,
+                           h_k1,
+                           h_k2,
+                           mri_k1_k2,
+                           h_white,
+                           h_gray,
+                           h_border,
+                           h_grad,
+                           mri_gray_white,
+                           h_dot,
+                           parms);
+    dp.etable = dps[n]->etable;
+    dp.mri_defect_sign = dps[n]->mri_defect_sign;
+    *dps[n] = dp;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+#define SAVE_FIT_VALS 0
+#if SAVE_FIT_VALS
+static float fitness_values[11000];
+static float best_values[11000];
+#endif
+
+static int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
+                                            MRI_SURFACE *mris_corrected,
+                                            MRI *mri,
+                                            DEFECT *defect,
+                                            int *vertex_trans,
+                                            EDGE *et,
+                                            int nedges,
+                                            ES *es,
+                                            int nes,
+                                            HISTOGRAM *h_k1,
+                                            HISTOGRAM *h_k2,
+                                            MRI *mri_k1_k2,
+                                            HISTOGRAM *h_white,
+                                            HISTOGRAM *h_gray,
+                                            HISTOGRAM *h_border,
+                                            HISTOGRAM *h_grad,
+                                            MRI *mri_gray_white,
+                                            HISTOGRAM *h_dot,
+                                            TOPOLOGY_PARMS *parms,
+                                            DEFECT_SURFACE_POOL *pool);
+
+
+static int mrisComputeOptimalRetessellation(MRI_SURFACE *mris,
+                                            MRI_SURFACE *mris_corrected,
+                                            MRI *mri,
+                                            DEFECT *defect,
+                                            int *vertex_trans,
+                                            EDGE *et,
+                                            int nedges,
+                                            ES *es,
+                                            int nes,
+                                            HISTOGRAM *h_k1,
+                                            HISTOGRAM *h_k2,
+                                            MRI *mri_k1_k2,
+                                            HISTOGRAM *h_white,
+                                            HISTOGRAM *h_gray,
+                                            HISTOGRAM *h_border,
+                                            HISTOGRAM *h_grad,
+                                            MRI *mri_gray_white,
+                                            HISTOGRAM *h_dot,
+                                            TOPOLOGY_PARMS *parms,
+                                            DEFECT_SURFACE_POOL *pool)
+{
+    int result;
+    ROMP_SCOPE_begin
+    result = mrisComputeOptimalRetessellation_wkr(mris,
+                                            mris_corrected,
+                                            mri,
+                                            defect,
+                                            vertex_trans,
+                                            et,
+                                            nedges,
+                                            es,
+                                            nes,
+                                            h_k1,
+                                            h_k2,
+                                            mri_k1_k2,
+                                            h_white,
+                                            h_gray,
+                                            h_border,
+                                            h_grad,
+                                            mri_gray_white,
+                                            h_dot,
+                                            parms,
+                                            pool);
+    ROMP_SCOPE_end
+    return result;
+}
+
+/* the weights of the likelihood terms can be overridden from the environment */
+static void mrisSetRetessellationWeightsFromEnv(TOPOLOGY_PARMS *parms)
+{
+  static volatile bool first_time = true;
+
+  if (first_time)
+#ifdef HAVE_OPENMP
+  #pragma omp critical
+#endif
+  if (first_time) {
+    char *cp;
+
+    if ((cp = getenv("FS_QCURV")) != NULL) {
+      parms->l_qcurv = atof(cp);
+      fprintf(WHICH_OUTPUT, "setting qcurv = %2.3f\n", l_qcurv);
+    }
+    if ((cp = getenv("FS_CURV")) != NULL) {
+      parms->l_curv = atof(cp);
+      fprintf(WHICH_OUTPUT, "setting curv = %2.3f\n", l_curv);
+    }
+    if ((cp = getenv("FS_MRI")) != NULL) {
+      parms->l_mri = atof(cp);
+      fprintf(WHICH_OUTPUT, "setting mri = %2.3f\n", l_mri);
+    }
+    if ((cp = getenv("FS_UNMRI")) != NULL) {
+      parms->l_unmri = atof(cp);
+      fprintf(WHICH_OUTPUT, "setting unmri = %2.3f\n", l_unmri);
+    }
+    first_time = false;
+  }
+}
+
+static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
+                                            MRI_SURFACE *mris_corrected,
+                                            MRI *mri,
+                                            DEFECT *defect,
+                                            int *vertex_trans,
+                                            EDGE *et,
+                                            int nedges,
+                                            ES *es,
+                                            int nes,
+                                            HISTOGRAM *h_k1,
+                                            HISTOGRAM *h_k2,
+                                            MRI *mri_k1_k2,
+                                            HISTOGRAM *h_white,
+                                            HISTOGRAM *h_gray,
+                                            HISTOGRAM *h_border,
+                                            HISTOGRAM *h_grad,
+                                            MRI *mri_gray_white,
+                                            HISTOGRAM *h_dot,
+                                            TOPOLOGY_PARMS *parms,
+                                            DEFECT_SURFACE_POOL *pool)
+{
+  DEFECT_VERTEX_STATE *dvs;
+  DEFECT_PATCH dps1[MAX_PATCHES], dps2[MAX_PATCHES], *dps, *dp, *dps_next_generation, *dp_list[MAX_PATCHES];
+  DEFECT_SCRATCH slots[MAX_PATCHES];
+  DEFECT_RNG rngs[MAX_PATCHES], rng;
+  float *vertex_usage;
+  int nslots, nlist, improved[MAX_PATCHES], parents[MAX_PATCHES][2];
+  int i, best_i, j, g, nselected, nreplacements, rank, nunchanged = 0, nelite, ncrossovers, k, l;
+  int ngenerations, nbests, last_euthanasia, nremovedvertices, nfinalvertices;
+  double fitness, best_fitness, last_best, fitness_mean, fitness_sigma, fitness_norm, pfitness, two_sigma_sq,
+      last_fitness;
+  static int ncalls = 0;  /* for debugging */
+  static int nmovies = 1; /* for making movies :
+                                 0 is left for the original surface*/
+  int dno, max_unchanged, count = 1;
+  EDGE_TABLE etable;
+  int max_patches = MAX_PATCHES, ranks[MAX_PATCHES], next_gen_index, selected[MAX_PATCHES], sno = 0, max_edges,
+      debug_patch_n = -1, nbest = 0;
+  MRI *mri_defect, *mri_defect_white, *mri_defect_gray, *mri_defect_sign;
+  char fname[500];
+  SEGMENTATION *segmentation;
+  RP rp;
+  int number_of_patches, nbestpatch;
+  int ncross_overs, ntotalcross_overs, ntotalmutations, nmutations;
+  int nintersections;
 
-    if ((cp = getenv("FS_QCURV")) != NULL) {
-      parms->l_qcurv = atof(cp);
-      fprintf(WHICH_OUTPUT, "setting qcurv = %2.3f\n", l_qcurv);
-    }
-    if ((cp = getenv("FS_CURV")) != NULL) {
-      parms->l_curv = atof(cp);
-      fprintf(WHICH_OUTPUT, "setting curv = %2.3f\n", l_curv);
-    }
-    if ((cp = getenv("FS_MRI")) != NULL) {
-      parms->l_mri = atof(cp);
-      fprintf(WHICH_OUTPUT, "setting mri = %2.3f\n", l_mri);
-    }
-    if ((cp = getenv("FS_UNMRI")) != NULL) {
-      parms->l_unmri = atof(cp);
-      fprintf(WHICH_OUTPUT, "setting unmri = %2.3f\n", l_unmri);
-    }
-    first_time = 0;
-  }
+  nbestpatch = number_of_patches = 0;
+  ncross_overs = nmutations = 0;
+  ntotalcross_overs = ntotalmutations = 0;
+
+#ifdef HAVE_OPENMP
+  #pragma omp atomic capture
+#endif
+  dno = ncalls++;
+
+  mrisSetRetessellationWeightsFromEnv(parms);
 
   max_patches = parms->max_patches;
   max_unchanged = parms->max_unchanged;
@@ -12219,7 +13223,6 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 
 
   if (!max_patches) {
-    dno++; /* for debugging */
     // mrisRetessellateDefect(mris, mris_corrected,
     // defect, vertex_trans, et, nedges, NULL, NULL) ;
 
@@ -12228,8 +13231,6 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
     return (NO_ERROR);
   }
 
-  dno++; /* for debugging */
-
   if (nedges > 200000) {
     printf("An extra large defect has been detected...\n");
     printf("This often happens because cerebellum or dura has not been removed from wm.mgz.\n");
@@ -12262,62 +13263,7 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
   memmove(etable.edges, et, nedges * sizeof(EDGE));
 
   if (etable.use_overlap) {
-    etable.overlapping_edges = (int **)calloc(nedges, sizeof(int *));
-    etable.noverlap = (int *)calloc(nedges, sizeof(int));
-    etable.flags = (unsigned char *)calloc(nedges, sizeof(unsigned char));
-    overlap = (int *)calloc(nedges, sizeof(int));
-    if (!etable.edges || !etable.overlapping_edges || !etable.noverlap || !overlap)
-      ErrorExit(ERROR_NOMEMORY,
-                "mrisComputeOptimalRetessellation: Excessive "
-                "topologic defect encountered: could not allocate %d "
-                "edge table",
-                nedges);
-
-    for (nzero = i = 0; i < nedges; i++) /* compute overlapping
-                                                        for each edge */
-    {
-      if (nedges > 50000 && !(i % 25000)) {
-        fprintf(WHICH_OUTPUT, "%d of %d edges processed\n", i, nedges);
-      }
-      etable.noverlap[i] = 0;
-      for (noverlap = j = 0; j < nedges; j++) {
-        if (j == i) {
-          continue;
-        }
-        if (edgesIntersect(mris_corrected, &et[i], &et[j])) {
-          overlap[noverlap] = j;
-          noverlap++;
-        }
-        if (noverlap > MAX_EDGES) {
-          break;
-        }
-      }
-      if (noverlap > 0) {
-        if (noverlap > MAX_EDGES) {
-          etable.noverlap[i] = MAX_EDGES;
-          etable.flags[i] |= ET_OVERLAP_LIST_INCOMPLETE;
-        }
-        else {
-          etable.noverlap[i] = noverlap;
-        }
-
-        etable.overlapping_edges[i] = (int *)calloc(etable.noverlap[i], sizeof(int));
-        if (!etable.overlapping_edges[i])
-          ErrorExit(ERROR_NOMEMORY,
-                    "mrisComputeOptimalRetessellation: Excessive "
-                    "topologic defect encountered: could not allocate "
-                    "overlap list %d "
-                    "with %d elts",
-                    i,
-                    etable.noverlap[i]);
-        memmove(etable.overlapping_edges[i], overlap, etable.noverlap[i] * sizeof(int));
-      }
-      else {
-        nzero++;
-      }
-    }
-
-    free(overlap);
+    mrisComputeEdgeTableOverlaps(mris_corrected, &etable, et, nedges);
   }
 
   ROMP_SCOPE_end
@@ -12371,6 +13317,12 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
   memmove(rp.status, defect->status, defect->nvertices * sizeof(char));
   rp.nused = (int *)calloc(defect->nvertices, sizeof(int));
   rp.vertex_fitness = (float *)calloc(defect->nvertices, sizeof(float));
+  rp.threshold = 4.0f;
+
+  /* the statistics of the patches evaluated together */
+  vertex_usage = (float *)malloc(MAX(1, max_patches * defect->nvertices) * sizeof(float));
+  if (!vertex_usage)
+    ErrorExit(ERROR_NOMEMORY, "could not allocate vertex usage of %d patches of %d vertices", max_patches, defect->nvertices);
 
   nbests = 0;
 
@@ -12382,6 +13334,18 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 
     constructComputeDefectContext(&computeDefectContext);
 
+  /* one slot per thread to evaluate the patches of a generation */
+  nslots = mrisAllocDefectScratch(slots,
+                                  pool,
+                                  max_patches,
+                                  mris_corrected,
+                                  defect,
+                                  vertex_trans,
+                                  &etable,
+                                  mri_defect_sign,
+                                  dvs,
+                                  &computeDefectContext);
+
   /* generate initial population of patches */
   if (parms->initial_selection) {
     /* segment overlapping edges into clusters */
@@ -12446,26 +13410,35 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
       dp->mri = mri;
 
       /* generate ordering from edge segmentation */
-      generateOrdering(dp, segmentation, i);
+      defectRngInit(&rng, defect->seed, -1, i);
+      generateOrdering(dp, segmentation, i, &rng);
+      dp_list[i] = dp;
+    }
+
+    /* evaluate the patches concurrently, then keep them in order */
+    mrisDefectPatchesFitness(slots,
+                             nslots,
+                             dp_list,
+                             max_patches,
+                             vertex_usage,
+                             mris,
+                             mri,
+                             vertex_trans,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             h_white,
+                             h_gray,
+                             h_border,
+                             h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms);
 
-      fitness = mrisDefectPatchFitness(&computeDefectContext,
-                                       mris,
-                                       mris_corrected,
-                                       mri,
-                                       dp,
-                                       vertex_trans,
-                                       dvs,
-                                       &rp,
-                                       h_k1,
-                                       h_k2,
-                                       mri_k1_k2,
-                                       h_white,
-                                       h_gray,
-                                       h_border,
-                                       h_grad,
-                                       mri_gray_white,
-                                       h_dot,
-                                       parms);
+    for (i = 0; i < max_patches; i++) {
+      dp = &dps1[i];
+      fitness = dp->fitness;
+      applyVertexStatistics(&rp, defect, vertex_usage + i * defect->nvertices);
 
 #if SAVE_FIT_VALS
       fitness_values[number_of_patches] = fitness;
@@ -12611,27 +13584,36 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 
       if (i) /* first one is in same order as original edge table */
       {
-        mrisMutateDefectPatch(dp, &etable, MUTATION_PCT_INIT);
-      }
+        defectRngInit(&rng, defect->seed, -1, i);
+        mrisMutateDefectPatch(dp, &etable, MUTATION_PCT_INIT, &rng);
+      }
+      dp_list[i] = dp;
+    }
+
+    /* evaluate the patches concurrently, then keep them in order */
+    mrisDefectPatchesFitness(slots,
+                             nslots,
+                             dp_list,
+                             max_patches,
+                             vertex_usage,
+                             mris,
+                             mri,
+                             vertex_trans,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             h_white,
+                             h_gray,
+                             h_border,
+                             h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms);
 
-      fitness = mrisDefectPatchFitness(&computeDefectContext,
-                                       mris,
-                                       mris_corrected,
-                                       mri,
-                                       dp,
-                                       vertex_trans,
-                                       dvs,
-                                       &rp,
-                                       h_k1,
-                                       h_k2,
-                                       mri_k1_k2,
-                                       h_white,
-                                       h_gray,
-                                       h_border,
-                                       h_grad,
-                                       mri_gray_white,
-                                       h_dot,
-                                       parms);
+    for (i = 0; i < max_patches; i++) {
+      dp = &dps1[i];
+      fitness = dp->fitness;
+      applyVertexStatistics(&rp, defect, vertex_usage + i * defect->nvertices);
 #if SAVE_FIT_VALS
       fitness_values[number_of_patches] = fitness;
       if (number_of_patches)
@@ -12647,7 +13629,7 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
         char fname[STRLEN];
 	const char *cc = "";
 	if(getenv("FS_GII")) cc = getenv("FS_GII");
-        int req = snprintf(fname, STRLEN, "%s_defect%d_%03d%s", mris->fname.data(), dno - 1, sno++,cc); 
+        int req = snprintf(fname, STRLEN, "%s_defect%d_%03d%s", mris->fname.data(), dno, sno++,cc); 
 	if( req >= STRLEN ) {
 	  std::cerr << __FUNCTION__ << ": Truncation on line " << __LINE__ << std::endl;
 	}
@@ -12692,7 +13674,7 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
           fprintf(WHICH_OUTPUT,
                   "defect %d: initial fitness = %2.4e, "
                   "nvertices=%d, nedges=%d, max patches=%d\n",
-                  dno - 1,
+                  dno,
                   fitness,
                   defect->nvertices,
                   nedges,
@@ -12827,30 +13809,38 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
     ROMP_SCOPE_begin
     
     /* now replace the worst ones with mutated copies of the best */
+    for (i = 0; i < nreplacements; i++) {
+      dp = &dps_next_generation[next_gen_index + i];
+      mrisCopyDefectPatch(&dps[ranks[i]], dp);
+      defectRngInit(&rng, defect->seed, ngenerations, next_gen_index + i);
+      mrisMutateDefectPatch(dp, &etable, MUTATION_PCT, &rng);
+      dp_list[i] = dp;
+    }
+    mrisDefectPatchesFitness(slots,
+                             nslots,
+                             dp_list,
+                             nreplacements,
+                             vertex_usage,
+                             mris,
+                             mri,
+                             vertex_trans,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             h_white,
+                             h_gray,
+                             h_border,
+                             h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms);
+
     for (i = 0; i < nreplacements; i++) {
       ntotalmutations++;
 
       dp = &dps_next_generation[next_gen_index++];
-      mrisCopyDefectPatch(&dps[ranks[i]], dp);
-      mrisMutateDefectPatch(dp, &etable, MUTATION_PCT);
-      fitness = mrisDefectPatchFitness(&computeDefectContext,
-                                       mris,
-                                       mris_corrected,
-                                       mri,
-                                       dp,
-                                       vertex_trans,
-                                       dvs,
-                                       &rp,
-                                       h_k1,
-                                       h_k2,
-                                       mri_k1_k2,
-                                       h_white,
-                                       h_gray,
-                                       h_border,
-                                       h_grad,
-                                       mri_gray_white,
-                                       h_dot,
-                                       parms);
+      fitness = dp->fitness;
+      applyVertexStatistics(&rp, defect, vertex_usage + i * defect->nvertices);
 #if SAVE_FIT_VALS
       fitness_values[number_of_patches] = fitness;
       if (number_of_patches)
@@ -12904,6 +13894,9 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
             savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
           }
         }
+#ifdef HAVE_OPENMP
+        #pragma omp atomic
+#endif
         nmut++;
         if (++nbest == debug_patch_n) {
           dps = dps_next_generation;
@@ -12984,10 +13977,11 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
         selected[l] = i;
       }
     }
+    defectRngInit(&rng, defect->seed, ngenerations, -1);
     for (; l < ncrossovers; l++) /* fill out rest of list */
     {
       double p;
-      p = randomNumber(0.0, 1.0);
+      p = defectRandomNumber(&rng, 0.0, 1.0);
       for (fitness = 0.0, j = 0; j < nselected; j++) {
         i = ranks[j];
         dp = &dps[i];
@@ -13005,36 +13999,48 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 
     for (i = 0; i < ncrossovers; i++) {
       int p1, p2;
-      ntotalcross_overs++;
 
+      /* each child draws from its own stream so that the children can be
+         evaluated in any order */
+      defectRngInit(&rngs[i], defect->seed, ngenerations, next_gen_index + i);
       p1 = selected[i];
       do /* select second parent at random */
       {
-        p2 = selected[(int)randomNumber(0, ncrossovers - .001)];
+        p2 = selected[(int)defectRandomNumber(&rngs[i], 0, ncrossovers - .001)];
       } while (p2 == p1);
+      parents[i][0] = p1;
+      parents[i][1] = p2;
+
+      dp = &dps_next_generation[next_gen_index + i];
+      mrisCrossoverDefectPatches(&dps[p1], &dps[p2], dp, &etable, &rngs[i]);
+      dp_list[i] = dp;
+    }
+    mrisDefectPatchesFitness(slots,
+                             nslots,
+                             dp_list,
+                             ncrossovers,
+                             vertex_usage,
+                             mris,
+                             mri,
+                             vertex_trans,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             h_white,
+                             h_gray,
+                             h_border,
+                             h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms);
 
-      ROMP_SCOPE_begin
+    for (i = 0; i < ncrossovers; i++) {
+      int p1 = parents[i][0], p2 = parents[i][1];
+      ntotalcross_overs++;
 
-      dp = &dps_next_generation[next_gen_index++];
-      mrisCrossoverDefectPatches(&dps[p1], &dps[p2], dp, &etable);
-      fitness = mrisDefectPatchFitness(&computeDefectContext,
-                                       mris,
-                                       mris_corrected,
-                                       mri,
-                                       dp,
-                                       vertex_trans,
-                                       dvs,
-                                       &rp,
-                                       h_k1,
-                                       h_k2,
-                                       mri_k1_k2,
-                                       h_white,
-                                       h_gray,
-                                       h_border,
-                                       h_grad,
-                                       mri_gray_white,
-                                       h_dot,
-                                       parms);
+      dp = &dps_next_generation[next_gen_index + i];
+      fitness = dp->fitness;
+      applyVertexStatistics(&rp, defect, vertex_usage + i * defect->nvertices);
 #if SAVE_FIT_VALS
       fitness_values[number_of_patches] = fitness;
       if (number_of_patches)
@@ -13045,16 +14051,12 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 #endif
       number_of_patches++;
 
-      ROMP_SCOPE_end
-
-      if (fitness > best_fitness) {
-
-        ROMP_SCOPE_begin
-
+      improved[i] = (fitness > best_fitness);
+      if (improved[i]) {
         ncross_overs++;
         nunchanged = 0;
         best_fitness = fitness;
-        best_i = next_gen_index - 1;
+        best_i = next_gen_index + i;
 
         nfinalvertices = nremovedvertices;
         nbestpatch = number_of_patches;
@@ -13108,118 +14110,142 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
           }
         }
 
-        ROMP_SCOPE_end
-
+#ifdef HAVE_OPENMP
+        #pragma omp atomic
+#endif
         ncross++;
         if (++nbest == debug_patch_n) {
           dps = dps_next_generation;
           goto debug_use_this_patch;
         }
       }
-      else /* mutate it also */
-      {
-        ROMP_SCOPE_begin
-
-        mrisMutateDefectPatch(dp, &etable, MUTATION_PCT);
-        fitness = mrisDefectPatchFitness(&computeDefectContext,
-                                         mris,
-                                         mris_corrected,
-                                         mri,
-                                         dp,
-                                         vertex_trans,
-                                         dvs,
-                                         &rp,
-                                         h_k1,
-                                         h_k2,
-                                         mri_k1_k2,
-                                         h_white,
-                                         h_gray,
-                                         h_border,
-                                         h_grad,
-                                         mri_gray_white,
-                                         h_dot,
-                                         parms);
+    }
+
+    ROMP_SCOPE_end
+    ROMP_SCOPE_begin
+
+    /* mutate the children that did not improve on the best patch */
+    for (nlist = i = 0; i < ncrossovers; i++) {
+      if (improved[i]) {
+        continue;
+      }
+      dp = &dps_next_generation[next_gen_index + i];
+      mrisMutateDefectPatch(dp, &etable, MUTATION_PCT, &rngs[i]);
+      dp_list[nlist++] = dp;
+    }
+    mrisDefectPatchesFitness(slots,
+                             nslots,
+                             dp_list,
+                             nlist,
+                             vertex_usage,
+                             mris,
+                             mri,
+                             vertex_trans,
+                             h_k1,
+                             h_k2,
+                             mri_k1_k2,
+                             h_white,
+                             h_gray,
+                             h_border,
+                             h_grad,
+                             mri_gray_white,
+                             h_dot,
+                             parms);
+
+    for (nlist = i = 0; i < ncrossovers; i++) {
+      int p1 = parents[i][0], p2 = parents[i][1];
+
+      if (improved[i]) {
+        continue;
+      }
+      dp = &dps_next_generation[next_gen_index + i];
+      fitness = dp->fitness;
+      applyVertexStatistics(&rp, defect, vertex_usage + nlist++ * defect->nvertices);
 #if SAVE_FIT_VALS
-        fitness_values[number_of_patches] = fitness;
-        if (number_of_patches)
-          best_values[number_of_patches] = MAX(best_values[number_of_patches - 1], fitness);
-        else {
-          best_values[number_of_patches] = fitness;
-        }
+      fitness_values[number_of_patches] = fitness;
+      if (number_of_patches)
+        best_values[number_of_patches] = MAX(best_values[number_of_patches - 1], fitness);
+      else {
+        best_values[number_of_patches] = fitness;
+      }
 #endif
-        number_of_patches++;
-        ntotalmutations++;
+      number_of_patches++;
+      ntotalmutations++;
 
-        if (fitness > best_fitness) {
-          nmutations++;
-          nunchanged = 0;
-          best_fitness = fitness;
-          best_i = next_gen_index - 1;
+      if (fitness > best_fitness) {
+        nmutations++;
+        nunchanged = 0;
+        best_fitness = fitness;
+        best_i = next_gen_index + i;
 
-          nfinalvertices = nremovedvertices;
-          nbestpatch = number_of_patches;
+        nfinalvertices = nremovedvertices;
+        nbestpatch = number_of_patches;
 
-          rp.best_fitness = best_fitness;
-          /* save ordering*/
-          memmove(rp.best_ordering, dp->ordering, nedges * sizeof(int));
-          /* save current status of vertices */
-          memmove(rp.status, defect->status, defect->nvertices * sizeof(char));
+        rp.best_fitness = best_fitness;
+        /* save ordering*/
+        memmove(rp.best_ordering, dp->ordering, nedges * sizeof(int));
+        /* save current status of vertices */
+        memmove(rp.status, defect->status, defect->nvertices * sizeof(char));
 
-          if (parms->verbose > VERBOSE_MODE_DEFAULT)
-            fprintf(WHICH_OUTPUT,
-                    "CROSSOVER (%d x %d) & MUTATION: "
-                    "new optimal fitness found at %d: %2.4e\n",
-                    dps[p1].rank,
-                    dps[p2].rank,
-                    best_i,
-                    fitness);
-          if (parms->verbose == VERBOSE_MODE_LOW) {
-            printDefectStatistics(dp);
-          }
-          if (parms->save_fname && (parms->defect_number < 0 || (parms->defect_number == defect->defect_number))) {
-            sprintf(fname,
-                    "%s/rh.defect_%d_surf_%d_%d",
-                    parms->save_fname,
-                    defect->defect_number,
-                    ngenerations - 1,
-                    dps[p1].rank);
-            savePatch(mri, mris, mris_corrected, dvs, &dps[p1], fname, parms);
-            sprintf(fname,
-                    "%s/rh.defect_%d_surf_%d_%d",
-                    parms->save_fname,
-                    defect->defect_number,
-                    ngenerations - 1,
-                    dps[p2].rank);
-            savePatch(mri, mris, mris_corrected, dvs, &dps[p2], fname, parms);
-            sprintf(fname,
-                    "%s/rh.defect_%d_best_%d_%dcm%d_%d",
-                    parms->save_fname,
-                    defect->defect_number,
-                    ngenerations,
-                    best_i,
-                    dps[p1].rank,
-                    dps[p2].rank);
-            savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
+        if (parms->verbose > VERBOSE_MODE_DEFAULT)
+          fprintf(WHICH_OUTPUT,
+                  "CROSSOVER (%d x %d) & MUTATION: "
+                  "new optimal fitness found at %d: %2.4e\n",
+                  dps[p1].rank,
+                  dps[p2].rank,
+                  best_i,
+                  fitness);
+        if (parms->verbose == VERBOSE_MODE_LOW) {
+          printDefectStatistics(dp);
+        }
+        if (parms->save_fname && (parms->defect_number < 0 || (parms->defect_number == defect->defect_number))) {
+          sprintf(fname,
+                  "%s/rh.defect_%d_surf_%d_%d",
+                  parms->save_fname,
+                  defect->defect_number,
+                  ngenerations - 1,
+                  dps[p1].rank);
+          savePatch(mri, mris, mris_corrected, dvs, &dps[p1], fname, parms);
+          sprintf(fname,
+                  "%s/rh.defect_%d_surf_%d_%d",
+                  parms->save_fname,
+                  defect->defect_number,
+                  ngenerations - 1,
+                  dps[p2].rank);
+          savePatch(mri, mris, mris_corrected, dvs, &dps[p2], fname, parms);
+          sprintf(fname,
+                  "%s/rh.defect_%d_best_%d_%dcm%d_%d",
+                  parms->save_fname,
+                  defect->defect_number,
+                  ngenerations,
+                  best_i,
+                  dps[p1].rank,
+                  dps[p2].rank);
+          savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
 
-            sprintf(fname, "%s/rh.defect_%d_best_%d", parms->save_fname, defect->defect_number, nbests++);
+          sprintf(fname, "%s/rh.defect_%d_best_%d", parms->save_fname, defect->defect_number, nbests++);
+          savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
+          if (parms->movie) {
+            sprintf(fname, "%s/rh.defect_%d_movie_%d", parms->save_fname, defect->defect_number, nmovies++);
             savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
-            if (parms->movie) {
-              sprintf(fname, "%s/rh.defect_%d_movie_%d", parms->save_fname, defect->defect_number, nmovies++);
-              savePatch(mri, mris, mris_corrected, dvs, dp, fname, parms);
-            }
           }
-
-          if (++nbest == debug_patch_n) {
-            dps = dps_next_generation;
-            goto debug_use_this_patch;
-          }
-          nmut++;
-          ncross++;
         }
 
-        ROMP_SCOPE_end
+        if (++nbest == debug_patch_n) {
+          dps = dps_next_generation;
+          goto debug_use_this_patch;
+        }
+#ifdef HAVE_OPENMP
+        #pragma omp atomic
+#endif
+        nmut++;
+#ifdef HAVE_OPENMP
+        #pragma omp atomic
+#endif
+        ncross++;
       }
     }
+    next_gen_index += ncrossovers;
 
     ROMP_SCOPE_end
     ROMP_SCOPE_begin
@@ -13274,7 +14300,6 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
 #define NEXT 5
 
     if (parms->vertex_eliminate) {
-      static int count = 1;
       int ndeleted;
       if (nunchanged >= max_unchanged) {
         // will eventually break out
@@ -13296,6 +14321,7 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
           fprintf(WHICH_OUTPUT, "Deleting worst vertices : ");
         }
         ndeleted = deleteWorstVertices(mris_corrected, &rp, defect, vertex_trans, 0.2, count);
+        mrisSyncDefectScratchRipflags(slots, nslots, defect, vertex_trans);
         nremovedvertices += ndeleted;
         if (parms->verbose == VERBOSE_MODE_LOW) {
           fprintf(WHICH_OUTPUT, "%d vertices have been deleted\n", ndeleted);
@@ -13307,6 +14333,7 @@ static NOINLINE int mrisComputeOptimalRetessellation_wkr(MRI_SURFACE *mris,
       }
       else if (ngenerations >= 10 && (ngenerations % 3 == 0)) {
         ndeleted = deleteWorstVertices(mris_corrected, &rp, defect, vertex_trans, 0.1, count);
+        mrisSyncDefectScratchRipflags(slots, nslots, defect, vertex_trans);
         nremovedvertices += ndeleted;
         if (parms->verbose == VERBOSE_MODE_LOW) {
           if (ndeleted == 1) {
@@ -13360,6 +14387,9 @@ debug_use_this_patch:
     MRISwriteCurvature(mris, fname);
   }
 
+#ifdef HAVE_OPENMP
+  #pragma omp atomic
+#endif
   nkilled += nfinalvertices;
 
   /* use the best ordering to retessellate the defected patch */
@@ -13393,6 +14423,7 @@ debug_use_this_patch:
                                    vertex_trans,
                                    dvs,
                                    &rp,
+                                   NULL,
                                    h_k1,
                                    h_k2,
                                    mri_k1_k2,
@@ -13497,6 +14528,8 @@ debug_use_this_patch:
   ROMP_SCOPE_begin
 
   /* free everything */
+  mrisFreeDefectScratch(slots, nslots);
+  free(vertex_usage);
   destructComputeDefectContext(&computeDefectContext);
   mrisFreeDefectVertexState(dvs);
 
@@ -13579,8 +14612,8 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
 {
   DEFECT_VERTEX_STATE *dvs;
   DEFECT_PATCH dp;
-  int niters, m, tmp, best_i, i, j, k, noverlap;
-  int *overlap, ngenerations, nbests, last_euthanasia;
+  int niters, m, tmp, best_i, i, j, k;
+  int ngenerations, nbests, last_euthanasia;
   int nremovedvertices, nfinalvertices;
   double fitness, best_fitness;
   static int dno = 0; /* for debugging */
@@ -13633,57 +14666,7 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
   memmove(etable.edges, et, nedges * sizeof(EDGE));
 
   if (etable.use_overlap) {
-    etable.overlapping_edges = (int **)calloc(nedges, sizeof(int *));
-    etable.noverlap = (int *)calloc(nedges, sizeof(int));
-    etable.flags = (unsigned char *)calloc(nedges, sizeof(unsigned char));
-    overlap = (int *)calloc(nedges, sizeof(int));
-    if (!etable.edges || !etable.overlapping_edges || !etable.noverlap || !overlap)
-      ErrorExit(ERROR_NOMEMORY,
-                "mrisComputeOptimalRetessellation: Excessive "
-                "topologic defect encountered: could not allocate "
-                "%d edge table",
-                nedges);
-
-    for (i = 0; i < nedges; i++) /* compute overlapping for each edge */
-    {
-      if (nedges > 50000 && !(i % 25000)) {
-        printf("%d of %d edges processed\n", i, nedges);
-      }
-      etable.noverlap[i] = 0;
-      for (noverlap = j = 0; j < nedges; j++) {
-        if (j == i) {
-          continue;
-        }
-        if (edgesIntersect(mris_corrected, &et[i], &et[j])) {
-          overlap[noverlap] = j;
-          noverlap++;
-        }
-        if (noverlap > MAX_EDGES) {
-          break;
-        }
-      }
-      if (noverlap > 0) {
-        if (noverlap > MAX_EDGES) {
-          etable.noverlap[i] = MAX_EDGES;
-          etable.flags[i] |= ET_OVERLAP_LIST_INCOMPLETE;
-        }
-        else {
-          etable.noverlap[i] = noverlap;
-        }
-
-        etable.overlapping_edges[i] = (int *)calloc(etable.noverlap[i], sizeof(int));
-        if (!etable.overlapping_edges[i])
-          ErrorExit(ERROR_NOMEMORY,
-                    "mrisComputeOptimalRetessellation: Excessive "
-                    "topologic defect encountered: could not allocate "
-                    "overlap list %d "
-                    "with %d elts",
-                    i,
-                    etable.noverlap[i]);
-        memmove(etable.overlapping_edges[i], overlap, etable.noverlap[i] * sizeof(int));
-      };
-    }
-    free(overlap);
+    mrisComputeEdgeTableOverlaps(mris_corrected, &etable, et, nedges);
   }
 
   /* allocate the volume constituted by the potential edges */
@@ -13729,6 +14712,7 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
   memmove(rp.status, defect->status, defect->nvertices * sizeof(char));
   rp.nused = (int *)calloc(defect->nvertices, sizeof(int));
   rp.vertex_fitness = (float *)calloc(defect->nvertices, sizeof(float));
+  rp.threshold = 4.0f;
 
   if (parms->retessellation_mode) {
     dp.retessellation_mode = USE_SOME_VERTICES;
@@ -13782,6 +14766,7 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
                                      vertex_trans,
                                      dvs,
                                      &rp,
+                                     NULL,
                                      h_k1,
                                      h_k2,
                                      mri_k1_k2,
@@ -13894,6 +14879,7 @@ static int mrisComputeRandomRetessellation(MRI_SURFACE *mris,
                                    vertex_trans,
                                    dvs,
                                    &rp,
+                                   NULL,
                                    h_k1,
                                    h_k2,
                                    mri_k1_k2,
@@ -14193,12 +15179,17 @@ static int intersectDefectEdges(MRI_SURFACE *mris, DEFECT *defect, EDGE *e, Inte
   static long stats_count    = 0;
   static long stats_limit    = 1;
   
-  static int once;
+  static volatile bool once;
   static bool asked_do_old_way,asked_do_new_way,asked_do_stats;
-  if (!once++) {
+  if (!once)
+#ifdef HAVE_OPENMP
+  #pragma omp critical
+#endif
+  if (!once) {
     if (getenv("FREESURFER_intersectDefectEdges_old"))   asked_do_old_way = true;
     if (getenv("FREESURFER_intersectDefectEdges_new"))   asked_do_new_way = true;
     if (getenv("FREESURFER_intersectDefectEdges_stats")) asked_do_stats   = true;
+    once = true;
   }
   bool do_old_way = asked_do_old_way;
   bool do_new_way = asked_do_new_way || !asked_do_old_way;
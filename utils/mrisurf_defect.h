@@ -153,6 +153,9 @@ typedef struct
   /* keep track of the result for the past iterations */
   int *nused;
   float *vertex_fitness;
+
+  /* fitness above which deleteWorstVertices stops culling vertices */
+  float threshold;
 } RANDOM_PATCH, RP;
 
 typedef struct
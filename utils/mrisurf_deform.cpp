@@ -1901,19 +1901,23 @@ int mrisComputePositioningGradients(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
   MRISaverageGradients(mris, avgs);
 
   /* smoothness terms */
-  mrisComputeSpringTerm(mris, parms->l_spring);
+  MRIS_SoA soa;
+  MRISSoA_ctr(&soa);
+  MRIS_SoA const * const soaOrNull = MRISSoA_prepareSmoothnessTerms(&soa, mris, parms) ? &soa : NULL;
+  mrisComputeSpringTerm(mris, soaOrNull, parms->l_spring);
   mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
   mrisComputeRepulsiveTerm(mris, parms->l_repulse, mht_v_current, mht_f_current);
   mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
   mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
   mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-  mrisComputeNormalSpringTerm(mris, parms->l_nspring);
+  mrisComputeNormalSpringTerm(mris, soaOrNull, parms->l_nspring);
   mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
   /*    mrisComputeAverageNormalTerm(mris, avgs, parms->l_nspring) ;*/
   /*    mrisComputeCurvatureTerm(mris, parms->l_curv) ;*/
   mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-  mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
+  mrisComputeTangentialSpringTerm(mris, soaOrNull, parms->l_tspring);
   mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
+  MRISSoA_dtr(&soa);
 
   if (mht_v_orig) {
     MHTfree(&mht_v_orig);
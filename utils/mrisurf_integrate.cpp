@@ -411,6 +411,9 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
   double sse_thresh, pct_neg, pct_neg_area, total_vertices, tol;
   /*, scale, last_neg_area */;
   MHT *mht_v_current = NULL;
+  MRIS_SoA soa;
+
+  MRISSoA_ctr(&soa);
 
   if (Gdiag & DIAG_WRITE && parms->fp == NULL) {
     char fname[STRLEN];
@@ -590,14 +593,15 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
 
     mrisComputeLaplacianTerm(mris, parms->l_lap);
     MRISaverageGradients(mris, n_averages);
-    mrisComputeSpringTerm(mris, parms->l_spring);
+    MRIS_SoA const * const soaOrNull = MRISSoA_prepareSmoothnessTerms(&soa, mris, parms) ? &soa : NULL;
+    mrisComputeSpringTerm(mris, soaOrNull, parms->l_spring);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
     mrisComputeThicknessNormalTerm(mris, parms->l_thick_normal, parms);
     mrisComputeThicknessSpringTerm(mris, parms->l_thick_spring, parms);
     mrisComputeAshburnerTriangleTerm(mris, parms->l_ashburner_triangle, parms);
 
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
+    mrisComputeTangentialSpringTerm(mris, soaOrNull, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
@@ -768,6 +772,8 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
   parms->ending_sse = MRIScomputeSSE(mris, parms);
   /*  mrisProjectSurface(mris) ;*/
 
+  MRISSoA_dtr(&soa);
+
   return (parms->t - parms->start_t); /* return actual # of steps taken */
 }
 
@@ -1416,6 +1416,18 @@ int MRISreadAnnotation(MRI_SURFACE *mris, const char *sname, int giftiDaNum, con
 }
 
 
+/* The number of (vno, annotation) pairs the rest of an annot file can
+   hold, used to check the header count before sizing a buffer from it. */
+static long mrisAnnotPairsInFile(FILE *fp)
+{
+  long const start = ftell(fp);
+  fseek(fp, 0, SEEK_END);
+  long const end = ftell(fp);
+  fseek(fp, start, SEEK_SET);
+  return ((end - start) / (2 * (long)sizeof(int)));
+}
+
+
 /* read .annot file:
  *   nvertices
  *   (vno, annotation) x nvertices
@@ -1435,12 +1447,19 @@ static int __mrisreadannot(const char *fannot, MRIS *mris, const COLOR_TABLE *ct
   int nElem = freadInt(fp);
   if (nElem != nVertices)
     ErrorReturn(ERROR_NOFILE, (ERROR_NOFILE, "# elements (%d) in %s and # vertices (%d) don't match", nElem, fannot, nVertices));
+  if (nElem > mrisAnnotPairsInFile(fp)) {
+    fclose(fp);
+    ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "annot file %s is truncated, it holds fewer than %d vertices", fannot, nElem));
+  }
 
-  /* For each one, read in a vno and an int for the annotation value. Check the vno. */
+  /* For each one, read in a vno and an int for the annotation value. Check the vno.
+     The (vno, annot) pairs are read in one block. */
+  std::vector<int> pairs(2 * (size_t)nElem);
+  freadIntArray(pairs.data(), pairs.size(), fp);
   for (int j = 0; j < nElem; j++)
   {
-    int vno = freadInt(fp);
-    int annot = freadInt(fp);
+    int vno = pairs[2 * j];
+    int annot = pairs[2 * j + 1];
     if (vno == Gdiag_no)
       DiagBreak();
 
@@ -1582,14 +1601,28 @@ int MRISreadAnnotationIntoArray(const char *fname, int in_array_size, int **out_
   fp = fopen(fname, "r");
   if (fp == NULL) ErrorReturn(ERROR_NOFILE, (ERROR_NOFILE, "could not read annot file %s", fname));
 
-  /* First int is the number of elements. */
+  /* First int is the number of elements. It sizes the block the pairs
+     are read into, so make sure the file actually holds that many. */
   num = freadInt(fp);
+  long const npairs_in_file = mrisAnnotPairsInFile(fp);
+  if (num < 0 || num > npairs_in_file) {
+    fclose(fp);
+    free(array);
+    ErrorReturn(ERROR_BADFILE,
+                (ERROR_BADFILE,
+                 "MRISreadAnnotationIntoArray: %s claims %d vertices but holds only %ld",
+                 fname,
+                 num,
+                 npairs_in_file));
+  }
 
   /* For each one, read in a vno and an int for the annotation
-     value. Check the vno. */
+     value. Check the vno. The pairs are read in one block. */
+  std::vector<int> pairs(2 * (size_t)num);
+  freadIntArray(pairs.data(), pairs.size(), fp);
   for (j = 0; j < num; j++) {
-    vno = freadInt(fp);
-    i = freadInt(fp);
+    vno = pairs[2 * j];
+    i = pairs[2 * j + 1];
     if (vno == Gdiag_no) {
       DiagBreak();
     }
@@ -3677,6 +3710,7 @@ static MRIS* MRISreadOverAlloc_new(const char *fname, double nVFMultiplier)
   /***********************************************************************/
   /* build members of mris structure                                     */
   /***********************************************************************/
+  bool nFilled = false;
   if ((version < 0) || type == MRIS_ASCII_TRIANGLE_FILE) {
     int vno;
     for (vno = 0; vno < mris->nvertices; vno++) {
@@ -3701,12 +3735,26 @@ static MRIS* MRISreadOverAlloc_new(const char *fname, double nVFMultiplier)
     // This is probably unnecessary, given the mrisCompleteTopology below
     // but I am worried that code won't get them in the same, and hence get equivalent but different results
     //
+    // The reader already counted the faces at each vertex, so f and n are filled
+    // in a single pass over the faces, like a counting sort.  n is the position
+    // of the vertex in the face; for a degenerate face that lists a vertex more
+    // than once, every slot gets the last such position, as the per-vertex scan
+    // below produces.
+    //
     int fno;
     for (fno = 0; fno < mris->nfaces; fno++) {
       FACE* face = &mris->faces[fno];
       int n;
-      for (n = 0; n < VERTICES_PER_FACE; n++) mris->vertices_topology[face->v[n]].f[mris->vertices_topology[face->v[n]].num++] = fno;
+      for (n = 0; n < VERTICES_PER_FACE; n++) {
+        VERTEX_TOPOLOGY * const vt = &mris->vertices_topology[face->v[n]];
+        int m = VERTICES_PER_FACE - 1;
+        while (face->v[m] != face->v[n]) m--;
+        vt->f[vt->num] = fno;
+        vt->n[vt->num] = m;
+        vt->num++;
+      }
     }
+    nFilled = true;
   }
 
   {
@@ -3724,6 +3772,7 @@ static MRIS* MRISreadOverAlloc_new(const char *fname, double nVFMultiplier)
       // This is probably unnecessary, given the mrisCompleteTopology below
       // but I am worried that code won't get them in the same, and hence get equivalent but different results
       //
+      if (nFilled) continue;
       int n;
       for (n = 0; n < mris->vertices_topology[vno].num; n++) {
         int m;
@@ -5408,14 +5457,17 @@ static SMALL_SURFACE *mrisReadTriangleFileVertexPositionsOnly(const char *fname)
     free(mriss);
     ErrorReturn(NULL, (ERROR_NOMEMORY, "MRISreadVerticesOnly: could not allocate surface"));
   }
+  float *xyz = (float *)malloc(3 * (size_t)nvertices * sizeof(float));
+  if (!xyz) ErrorExit(ERROR_NOMEMORY, "MRISreadVerticesOnly: could not allocate %d vertex buffer", nvertices);
+  freadFloatArray(xyz, 3 * (size_t)nvertices, fp);
   for (vno = 0; vno < nvertices; vno++) {
     v = &mriss->vertices[vno];
     if (vno == Gdiag_no) {
       DiagBreak();
     }
-    v->x = freadFloat(fp);
-    v->y = freadFloat(fp);
-    v->z = freadFloat(fp);
+    v->x = xyz[3 * vno + 0];
+    v->y = xyz[3 * vno + 1];
+    v->z = xyz[3 * vno + 2];
     if (fabs(v->x) > 10000 || !std::isfinite(v->x))
       ErrorExit(ERROR_BADFILE, "%s: vertex %d x coordinate %f!", Progname, vno, v->x);
     if (fabs(v->y) > 10000 || !std::isfinite(v->y))
@@ -5423,6 +5475,7 @@ static SMALL_SURFACE *mrisReadTriangleFileVertexPositionsOnly(const char *fname)
     if (fabs(v->z) > 10000 || !std::isfinite(v->z))
       ErrorExit(ERROR_BADFILE, "%s: vertex %d z coordinate %f!", Progname, vno, v->z);
   }
+  free(xyz);
   fclose(fp);
   return (mriss);
 }
@@ -5468,12 +5521,13 @@ static int mrisReadTriangleFilePositions(MRI_SURFACE *mris, const char *fname)
     // MRISsetXYZ will invalidate all of these,
     // so make sure they are recomputed before being used again!
 
+  float *xyz = (float *)malloc(3 * (size_t)nvertices * sizeof(float));
+  if (!xyz) ErrorExit(ERROR_NOMEMORY, "mrisReadTriangleFilePositions: could not allocate %d vertex buffer", nvertices);
+  freadFloatArray(xyz, 3 * (size_t)nvertices, fp);
   for (vno = 0; vno < nvertices; vno++) {
-    float x = freadFloat(fp);
-    float y = freadFloat(fp);
-    float z = freadFloat(fp);
-    MRISsetXYZ(mris, vno, x,y,z);
+    MRISsetXYZ(mris, vno, xyz[3 * vno + 0], xyz[3 * vno + 1], xyz[3 * vno + 2]);
   }
+  free(xyz);
 
   fclose(fp);
   return (NO_ERROR);
@@ -5522,6 +5576,12 @@ static MRI_SURFACE *mrisReadTriangleFile(const char *fname, double nVFMultiplier
   MRIS * mris = MRISoverAlloc(nVFMultiplier * nvertices, nVFMultiplier * nfaces, nvertices, nfaces);
   mris->type = MRIS_TRIANGULAR_SURFACE;
 
+  // The coordinate and face blocks are each read with a single fread and
+  // byte-swapped in bulk; the per-element loops below only validate and copy.
+  float *xyz = (float *)malloc(3 * (size_t)nvertices * sizeof(float));
+  if (!xyz) ErrorExit(ERROR_NOMEMORY, "mrisReadTriangleFile: could not allocate %d vertex buffer", nvertices);
+  freadFloatArray(xyz, 3 * (size_t)nvertices, fp);
+
   for (vno = 0; vno < nvertices; vno++) {
     if (vno % 100 == 0) exec_progress_callback(vno, nvertices, 0, 1);
     VERTEX_TOPOLOGY * const vt = &mris->vertices_topology[vno];
@@ -5530,11 +5590,7 @@ static MRI_SURFACE *mrisReadTriangleFile(const char *fname, double nVFMultiplier
       DiagBreak();
     }
 
-    float x = freadFloat(fp);
-    float y = freadFloat(fp);
-    float z = freadFloat(fp);
-    
-    MRISsetXYZ(mris,vno, x, y, z);
+    MRISsetXYZ(mris,vno, xyz[3 * vno + 0], xyz[3 * vno + 1], xyz[3 * vno + 2]);
 
     vt->num = 0; /* will figure it out */
     if (fabs(v->x) > 10000 || !std::isfinite(v->x))
@@ -5544,11 +5600,16 @@ static MRI_SURFACE *mrisReadTriangleFile(const char *fname, double nVFMultiplier
     if (fabs(v->z) > 10000 || !std::isfinite(v->z))
       ErrorExit(ERROR_BADFILE, "%s: vertex %d z coordinate %f!", Progname, vno, v->z);
   }
+  free(xyz);
+
+  int *fv = (int *)malloc(VERTICES_PER_FACE * (size_t)mris->nfaces * sizeof(int));
+  if (!fv) ErrorExit(ERROR_NOMEMORY, "mrisReadTriangleFile: could not allocate %d face buffer", mris->nfaces);
+  freadIntArray(fv, VERTICES_PER_FACE * (size_t)mris->nfaces, fp);
 
   for (fno = 0; fno < mris->nfaces; fno++) {
     f = &mris->faces[fno];
     for (n = 0; n < VERTICES_PER_FACE; n++) {
-      f->v[n] = freadInt(fp);
+      f->v[n] = fv[VERTICES_PER_FACE * fno + n];
       if (f->v[n] >= mris->nvertices || f->v[n] < 0)
         ErrorExit(ERROR_BADFILE, "f[%d]->v[%d] = %d - out of range!\n", fno, n, f->v[n]);
     }
@@ -5557,6 +5618,7 @@ static MRI_SURFACE *mrisReadTriangleFile(const char *fname, double nVFMultiplier
       mris->vertices_topology[mris->faces[fno].v[n]].num++;
     }
   }
+  free(fv);
   // new addition
   mris->useRealRAS = 0;
 
@@ -5835,10 +5897,13 @@ int MRISreadNewCurvatureFile(MRI_SURFACE *mris, const char *sname)
         (ERROR_NOFILE, "MRISreadNewCurvature(%s): vals/vertex %d unsupported (must be 1) ", fname, vals_per_vertex));
   }
 
+  std::vector<float> vals(vnum);
+  freadFloatArray(vals.data(), vnum, fp);
+
   curvmin = 10000.0f;
   curvmax = -10000.0f; /* for compiler warnings */
   for (k = 0; k < vnum; k++) {
-    curv = freadFloat(fp);
+    curv = vals[k];
     if (k == 0) {
       curvmin = curvmax = curv;
     }
@@ -5901,7 +5966,7 @@ float *MRISreadNewCurvatureVector(MRI_SURFACE *mris, const char *sname)
 
 int MRISreadNewCurvatureIntoArray(const char *sname, int in_array_size, float **out_array)
 {
-  int k, vnum, fnum;
+  int vnum, fnum;
   float *cvec;
   FILE *fp;
   int vals_per_vertex;
@@ -5947,9 +6012,7 @@ int MRISreadNewCurvatureIntoArray(const char *sname, int in_array_size, float **
   if (!cvec) ErrorExit(ERROR_NOMEMORY, "MRISreadNewCurvatureVector(%s): calloc failed", sname);
 
   /* Read in values. */
-  for (k = 0; k < vnum; k++) {
-    cvec[k] = freadFloat(fp);
-  }
+  freadFloatArray(cvec, vnum, fp);
   fclose(fp);
 
   /* Return what we read. */
@@ -7797,10 +7797,14 @@ FaceNormCacheEntry const * getFaceNorm(MRIS_MP const * const mris, int fno) {
 
 void mrisurf_deferSetFaceNorms(MRIS* mris) {
     static int use_parallel;
-    static int once;
+    static volatile bool once;
+    if (!once)
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
     if (!once) {
-        once++;
         use_parallel = !!getenv("FREESURFER_deferSetFaceNorms_parallel");
+        once = true;
     }
     if (!use_parallel) {
         // It looks like there is not enough work to go parallel...
@@ -9341,6 +9345,10 @@ typedef struct MRISaverageGradients_Control {
   int firstNeighbor;
 } MRISaverageGradients_Control;
 
+typedef struct MRISaverageGradients_Chunk {
+  int indexLo;
+} MRISaverageGradients_Chunk;
+
 static int                              MRISaverageGradients_neighbors_size;
 static int*	                        MRISaverageGradients_neighbors;
 static int  	                        MRISaverageGradients_controls_and_data_size;
@@ -9481,6 +9489,578 @@ static void MRISaverageGradients_write(
   fprintf(stdout, "%s:%d finished writing %s\n",__FILE__, __LINE__, filename);
 }
 
+// Chebyshev acceleration of the averaging
+//
+// One averaging pass is y = P x with P = (I+A)/(num+1), where A is the adjacency
+// of the unripped vertices.  P is similar to a symmetric matrix and is stochastic,
+// so its eigenvalues are real and in [-1,1], and num_avgs passes apply P^num_avgs.
+// On [-1,1]
+//
+//      x^n = 2^(1-n) * sum_{j<n/2} C(n,j) T_{n-2j}(x)   [ + 2^-n C(n,n/2) if n is even ]
+//
+// and the coefficients fall off like a binomial distribution around k=0, so the
+// expansion can be truncated at a degree of order sqrt(n) with an error bounded by
+// the sum of the dropped coefficients.  Each degree costs one pass over the mesh,
+// so 256 averages take about 80 passes instead of 256.
+//
+// The result differs from the float sweeps at about 1e-6.  Setting
+// FREESURFER_MRISaverageGradients_chebyshev_suppress restores the sweeps.
+//
+#define MRIS_AVERAGE_GRADIENTS_CHEBYSHEV_TOL 1e-6
+
+typedef struct MRISaverageGradients_DData {
+  double dx,dy,dz;
+} MRISaverageGradients_DData;
+
+// Fills coefs[0..num_avgs] and returns the degree needed to reach the tolerance,
+// or num_avgs if truncating would not save any passes
+//
+static int MRISaverageGradients_chebyshevDegree(int num_avgs, double *coefs)
+{
+  int const n = num_avgs;
+  int k;
+  for (k = 0; k <= n; k++) coefs[k] = 0.0;
+  
+  double const lgn = lgamma(n + 1.0);
+  int j;
+  for (j = 0; 2 * j <= n; j++) {
+    double lc = lgn - lgamma(j + 1.0) - lgamma(n - j + 1.0) - n * M_LN2;
+    if (2 * j < n) lc += M_LN2;
+    coefs[n - 2 * j] = exp(lc);
+  }
+
+  // drop the tail while its total weight stays below the tolerance
+  double tail = 0.0;
+  int degree = n;
+  while (degree > 1 && tail + coefs[degree] < MRIS_AVERAGE_GRADIENTS_CHEBYSHEV_TOL) {
+    tail += coefs[degree];
+    degree--;
+  }
+  return degree;
+}
+
+// Replaces datas[] by sum_{k<=degree} coefs[k] T_k(P) datas[], one parallel pass per degree
+//
+static void MRISaverageGradients_chebyshev(
+  int                                   degree,
+  double const*                         coefs,
+  int                                   index_to_vno_size,
+  const MRISaverageGradients_Control*   controls,
+  const int*                            neighbors,
+  const MRISaverageGradients_Chunk*     chunks,
+  int                                   chunksSize,
+  MRISaverageGradients_Data*            datas)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  DData *tprev = (DData*)malloc(sizeof(DData) * index_to_vno_size);
+  DData *tcur  = (DData*)malloc(sizeof(DData) * index_to_vno_size);
+  DData *tnext = (DData*)malloc(sizeof(DData) * index_to_vno_size);
+  DData *sum   = (DData*)malloc(sizeof(DData) * index_to_vno_size);
+
+  int index;
+  for (index = 0; index < index_to_vno_size; index++) {
+    DData *t = tcur + index;
+    t->dx = datas[index].dx; t->dy = datas[index].dy; t->dz = datas[index].dz;
+    DData *s = sum + index;
+    s->dx = coefs[0] * t->dx; s->dy = coefs[0] * t->dy; s->dz = coefs[0] * t->dz;
+  }
+
+  // T_1 = P T_0, T_{k+1} = 2 P T_k - T_{k-1}
+  int k;
+  for (k = 1; k <= degree; k++) {
+    double const alpha = (k == 1) ? 1.0 : 2.0;
+    double const beta  = (k == 1) ? 0.0 : 1.0;
+    double const ck    = coefs[k];
+    
+    int chunksIndex;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+    for (chunksIndex = 0; chunksIndex < chunksSize-1 ; chunksIndex++ ) {
+      ROMP_PFLB_begin
+      int const indexLo = chunks[chunksIndex  ].indexLo;
+      int const indexHi = chunks[chunksIndex+1].indexLo;
+      int index;
+      for (index = indexLo; index < indexHi; index++ ) {
+        const MRISaverageGradients_Control *c = controls + index;
+        const DData *d = tcur + index;
+        double dx = d->dx, dy = d->dy, dz = d->dz;
+
+        const int *nearby = neighbors + c->firstNeighbor;
+        int n;
+        for (n = 0; n < c->numNeighbors; n++) {
+          const DData *nd = tcur + nearby[n];
+          dx += nd->dx; dy += nd->dy; dz += nd->dz;
+        }
+
+        double const scale = alpha / (c->numNeighbors + 1);
+        const DData *p = tprev + index;
+        DData *t = tnext + index;
+        t->dx = scale * dx - beta * p->dx;
+        t->dy = scale * dy - beta * p->dy;
+        t->dz = scale * dz - beta * p->dz;
+
+        DData *s = sum + index;
+        s->dx += ck * t->dx; s->dy += ck * t->dy; s->dz += ck * t->dz;
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    DData *tmp = tprev; tprev = tcur; tcur = tnext; tnext = tmp;
+  }
+
+  for (index = 0; index < index_to_vno_size; index++) {
+    datas[index].dx = sum[index].dx;
+    datas[index].dy = sum[index].dy;
+    datas[index].dz = sum[index].dz;
+  }
+  
+  free(sum);
+  free(tnext);
+  free(tcur);
+  free(tprev);
+}
+
+// Multilevel evaluation of large averaging counts
+//
+// The truncated expansion still needs a degree of order sqrt(num_avgs).  After
+// MRIS_AVERAGE_GRADIENTS_MULTILEVEL_MIN averages the field is smooth over many rings,
+// so it is represented well on a coarser graph.  The vertices are grouped into
+// aggregates (a vertex and its free neighbors), the averaging is continued on the
+// graph of the aggregates, and the result is copied back to the vertices and smoothed
+// with a few passes of the finer graph.  A coarse edge is weighted by the number of
+// edges joining the two aggregates and a coarse node by the sum of (num+1) of its
+// vertices, so one coarse pass is the same kind of operator as P.
+//
+// One coarse pass covers several fine ones.  The ratio is taken from the Rayleigh
+// quotients sum(f (f - P f) mass) / sum(f f mass) of a smooth field on both graphs,
+// which is the vertex coordinates relaxed by a few fine passes.  Coarsening is
+// repeated while the remaining count stays large, and the last level uses the
+// expansion, so the work does not grow with num_avgs.  The result matches the sweeps
+// to about 1% of the largest value.
+//
+// When num_avgs times the quotient exceeds MRIS_AVERAGE_GRADIENTS_MULTILEVEL_REACH the
+// averaging reaches across the whole surface and leaves only a few global modes, which
+// the aggregates do not resolve well enough for the line search, so such counts keep
+// the expansion.  That only happens on small surfaces, where it is cheap.
+//
+#define MRIS_AVERAGE_GRADIENTS_MULTILEVEL_MIN     512
+#define MRIS_AVERAGE_GRADIENTS_MULTILEVEL_REACH   0.5
+#define MRIS_AVERAGE_GRADIENTS_MULTILEVEL_PASSES  4
+#define MRIS_AVERAGE_GRADIENTS_MULTILEVEL_RELAX   5
+#define MRIS_AVERAGE_GRADIENTS_MULTILEVEL_SMALL   64
+
+typedef struct MRISaverageGradients_Level {
+  int     size;
+  int    *firstNeighbor;      // the neighbors of index i are neighbors[firstNeighbor[i] .. firstNeighbor[i+1]-1]
+  int    *neighbors;
+  double *weights;            // NULL when all are 1
+  double *mass;
+  double  eps;                // Rayleigh quotient of the test field
+  int    *aggregate;          // index -> index in the coarser level
+  int    *firstMember;        // the members of coarser index a are members[firstMember[a] .. firstMember[a+1]-1]
+  int    *members;
+  struct MRISaverageGradients_Level *coarser;
+} MRISaverageGradients_Level;
+
+// next = alpha * P cur - beta * prev
+//
+static void MRISaverageGradients_levelPass(
+  MRISaverageGradients_Level const *   level,
+  double                               alpha,
+  double                               beta,
+  MRISaverageGradients_DData const *   prev,
+  MRISaverageGradients_DData const *   cur,
+  MRISaverageGradients_DData *         next)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  int index;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (index = 0; index < level->size; index++) {
+    ROMP_PFLB_begin
+    const DData *d = cur + index;
+    double dx = 0.0, dy = 0.0, dz = 0.0;
+    int n;
+    for (n = level->firstNeighbor[index]; n < level->firstNeighbor[index+1]; n++) {
+      const DData *nd = cur + level->neighbors[n];
+      double const w = level->weights ? level->weights[n] : 1.0;
+      dx += w * (nd->dx - d->dx); dy += w * (nd->dy - d->dy); dz += w * (nd->dz - d->dz);
+    }
+    double const scale = 1.0 / level->mass[index];
+    DData *t = next + index;
+    t->dx = alpha * (d->dx + scale * dx);
+    t->dy = alpha * (d->dy + scale * dy);
+    t->dz = alpha * (d->dz + scale * dz);
+    if (prev) {
+      t->dx -= beta * prev[index].dx; t->dy -= beta * prev[index].dy; t->dz -= beta * prev[index].dz;
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+// Replaces datas[] by P^num_avgs datas[] on the level, using the expansion when it is shorter
+//
+static void MRISaverageGradients_levelAverage(
+  MRISaverageGradients_Level const *   level,
+  int                                  num_avgs,
+  MRISaverageGradients_DData *         datas)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  if (num_avgs <= 0) return;
+
+  int const size = level->size;
+  double *coefs = (double*)malloc(sizeof(double) * (num_avgs + 1));
+  int const degree = MRISaverageGradients_chebyshevDegree(num_avgs, coefs);
+
+  DData *tprev = (DData*)malloc(sizeof(DData) * size);
+  DData *tcur  = (DData*)malloc(sizeof(DData) * size);
+  DData *tnext = (DData*)malloc(sizeof(DData) * size);
+
+  int index, k;
+  if (degree == num_avgs) {
+    memcpy(tcur, datas, sizeof(DData) * size);
+    for (k = 0; k < num_avgs; k++) {
+      MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL, tcur, tnext);
+      DData *tmp = tcur; tcur = tnext; tnext = tmp;
+    }
+    memcpy(datas, tcur, sizeof(DData) * size);
+  } else {
+    // T_1 = P T_0, T_{k+1} = 2 P T_k - T_{k-1}
+    memcpy(tcur, datas, sizeof(DData) * size);
+    for (index = 0; index < size; index++) {
+      datas[index].dx *= coefs[0]; datas[index].dy *= coefs[0]; datas[index].dz *= coefs[0];
+    }
+    for (k = 1; k <= degree; k++) {
+      if (k == 1) MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL,  tcur, tnext);
+      else        MRISaverageGradients_levelPass(level, 2.0, 1.0, tprev, tcur, tnext);
+      double const ck = coefs[k];
+      for (index = 0; index < size; index++) {
+        datas[index].dx += ck * tnext[index].dx; datas[index].dy += ck * tnext[index].dy; datas[index].dz += ck * tnext[index].dz;
+      }
+      DData *tmp = tprev; tprev = tcur; tcur = tnext; tnext = tmp;
+    }
+  }
+
+  free(tnext);
+  free(tcur);
+  free(tprev);
+  free(coefs);
+}
+
+static double MRISaverageGradients_levelRayleigh(
+  MRISaverageGradients_Level const *   level,
+  MRISaverageGradients_DData const *   field)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  int const size = level->size;
+  int index;
+
+  double mass = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+  for (index = 0; index < size; index++) {
+    double const m = level->mass[index];
+    mass += m; mx += m * field[index].dx; my += m * field[index].dy; mz += m * field[index].dz;
+  }
+  if (mass <= 0.0) return 0.0;
+
+  DData *f  = (DData*)malloc(sizeof(DData) * size);
+  DData *pf = (DData*)malloc(sizeof(DData) * size);
+  for (index = 0; index < size; index++) {
+    f[index].dx = field[index].dx - mx / mass;
+    f[index].dy = field[index].dy - my / mass;
+    f[index].dz = field[index].dz - mz / mass;
+  }
+  MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL, f, pf);
+
+  double num = 0.0, den = 0.0;
+  for (index = 0; index < size; index++) {
+    double const m = level->mass[index];
+    num += m * (f[index].dx * (f[index].dx - pf[index].dx) + f[index].dy * (f[index].dy - pf[index].dy) + f[index].dz * (f[index].dz - pf[index].dz));
+    den += m * (f[index].dx * f[index].dx + f[index].dy * f[index].dy + f[index].dz * f[index].dz);
+  }
+
+  free(pf);
+  free(f);
+  return (den > 0.0) ? num / den : 0.0;
+}
+
+// coarse[a] = sum(mass fine) / sum(mass) over the members of aggregate a
+//
+static void MRISaverageGradients_levelRestrict(
+  MRISaverageGradients_Level const *   level,
+  MRISaverageGradients_DData const *   fine,
+  MRISaverageGradients_DData *         coarse)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  int a;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (a = 0; a < level->coarser->size; a++) {
+    ROMP_PFLB_begin
+    double dx = 0.0, dy = 0.0, dz = 0.0;
+    int m;
+    for (m = level->firstMember[a]; m < level->firstMember[a+1]; m++) {
+      int const index = level->members[m];
+      double const w = level->mass[index];
+      dx += w * fine[index].dx; dy += w * fine[index].dy; dz += w * fine[index].dz;
+    }
+    DData *c = coarse + a;
+    double const scale = 1.0 / level->coarser->mass[a];
+    c->dx = scale * dx; c->dy = scale * dy; c->dz = scale * dz;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+static void MRISaverageGradients_levelFree(MRISaverageGradients_Level **plevel)
+{
+  MRISaverageGradients_Level *level = *plevel;
+  if (!level) return;
+  *plevel = NULL;
+  MRISaverageGradients_levelFree(&level->coarser);
+  free(level->members);
+  free(level->firstMember);
+  free(level->aggregate);
+  free(level->mass);
+  free(level->weights);
+  free(level->neighbors);
+  free(level->firstNeighbor);
+  free(level);
+}
+
+// Groups the level into aggregates and builds the graph of the aggregates,
+// or returns NULL if that would not make the graph much smaller
+//
+static MRISaverageGradients_Level *MRISaverageGradients_levelCoarsen(MRISaverageGradients_Level *level)
+{
+  int const size = level->size;
+  int index, n;
+
+  // a vertex none of whose neighbors is taken yet starts an aggregate with them,
+  // then the rest join the neighboring aggregate they are most strongly joined to
+  //
+  int *aggregate = (int*)malloc(sizeof(int) * size);
+  for (index = 0; index < size; index++) aggregate[index] = -1;
+  int ncoarse = 0;
+  for (index = 0; index < size; index++) {
+    if (aggregate[index] >= 0) continue;
+    for (n = level->firstNeighbor[index]; n < level->firstNeighbor[index+1]; n++)
+      if (aggregate[level->neighbors[n]] >= 0) break;
+    if (n < level->firstNeighbor[index+1]) continue;
+    aggregate[index] = ncoarse;
+    for (n = level->firstNeighbor[index]; n < level->firstNeighbor[index+1]; n++)
+      aggregate[level->neighbors[n]] = ncoarse;
+    ncoarse++;
+  }
+  for (index = 0; index < size; index++) {
+    if (aggregate[index] >= 0) continue;
+    double best = 0.0;
+    for (n = level->firstNeighbor[index]; n < level->firstNeighbor[index+1]; n++) {
+      int const a = aggregate[level->neighbors[n]];
+      double const w = level->weights ? level->weights[n] : 1.0;
+      if (a >= 0 && w > best) { best = w; aggregate[index] = a; }
+    }
+    if (aggregate[index] < 0) aggregate[index] = ncoarse++;
+  }
+
+  if (ncoarse < MRIS_AVERAGE_GRADIENTS_MULTILEVEL_SMALL || 2 * ncoarse > size) {
+    free(aggregate);
+    return NULL;
+  }
+
+  int *firstMember = (int*)calloc(ncoarse + 1, sizeof(int));
+  int *members     = (int*)malloc(sizeof(int) * size);
+  for (index = 0; index < size; index++) firstMember[aggregate[index] + 1]++;
+  int a;
+  for (a = 0; a < ncoarse; a++) firstMember[a + 1] += firstMember[a];
+  int *fill = (int*)malloc(sizeof(int) * ncoarse);
+  memcpy(fill, firstMember, sizeof(int) * ncoarse);
+  for (index = 0; index < size; index++) members[fill[aggregate[index]]++] = index;
+
+  // the coarse edges, summing the weights of the edges between two aggregates
+  //
+  MRISaverageGradients_Level *coarser = (MRISaverageGradients_Level*)calloc(1, sizeof(MRISaverageGradients_Level));
+  coarser->size          = ncoarse;
+  coarser->firstNeighbor = (int*)   malloc(sizeof(int) * (ncoarse + 1));
+  coarser->mass          = (double*)malloc(sizeof(double) * ncoarse);
+  int     capacity  = level->firstNeighbor[size];
+  int     nedges    = 0;
+  int    *neighbors = (int*)   malloc(sizeof(int)    * capacity);
+  double *weights   = (double*)malloc(sizeof(double) * capacity);
+  for (a = 0; a < ncoarse; a++) fill[a] = -1;
+  for (a = 0; a < ncoarse; a++) {
+    coarser->firstNeighbor[a] = nedges;
+    double mass = 0.0;
+    int m;
+    for (m = firstMember[a]; m < firstMember[a+1]; m++) {
+      int const i = members[m];
+      mass += level->mass[i];
+      for (n = level->firstNeighbor[i]; n < level->firstNeighbor[i+1]; n++) {
+        int const b = aggregate[level->neighbors[n]];
+        if (b == a) continue;
+        double const w = level->weights ? level->weights[n] : 1.0;
+        if (fill[b] >= coarser->firstNeighbor[a]) {
+          weights[fill[b]] += w;
+          continue;
+        }
+        if (nedges == capacity) {
+          capacity += capacity / 2;
+          neighbors = (int*)   realloc(neighbors, sizeof(int)    * capacity);
+          weights   = (double*)realloc(weights,   sizeof(double) * capacity);
+        }
+        fill[b] = nedges;
+        neighbors[nedges] = b;
+        weights  [nedges] = w;
+        nedges++;
+      }
+    }
+    coarser->mass[a] = mass;
+  }
+  coarser->firstNeighbor[ncoarse] = nedges;
+  coarser->neighbors = neighbors;
+  coarser->weights   = weights;
+  free(fill);
+
+  level->aggregate   = aggregate;
+  level->firstMember = firstMember;
+  level->members     = members;
+  level->coarser     = coarser;
+  return coarser;
+}
+
+// Replaces datas[] by approximately P^num_avgs datas[] on the level, where
+// field[] is the smooth test field on the level
+//
+static void MRISaverageGradients_levelSmooth(
+  MRISaverageGradients_Level *  level,
+  double                        num_avgs,
+  MRISaverageGradients_DData *  field,
+  MRISaverageGradients_DData *  datas)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  int const passes = MRIS_AVERAGE_GRADIENTS_MULTILEVEL_PASSES;
+  MRISaverageGradients_Level *coarser = NULL;
+  DData *coarseField = NULL;
+
+  if (num_avgs >= MRIS_AVERAGE_GRADIENTS_MULTILEVEL_MIN && level->eps > 0.0 &&
+      num_avgs * level->eps <= MRIS_AVERAGE_GRADIENTS_MULTILEVEL_REACH) {
+    coarser = MRISaverageGradients_levelCoarsen(level);
+    if (coarser) {
+      coarseField = (DData*)malloc(sizeof(DData) * coarser->size);
+      MRISaverageGradients_levelRestrict(level, field, coarseField);
+      coarser->eps = MRISaverageGradients_levelRayleigh(coarser, coarseField);
+    }
+  }
+  if (!coarser || coarser->eps <= 0.0) {
+    free(coarseField);
+    MRISaverageGradients_levelAverage(level, (int)floor(num_avgs + 0.5), datas);
+    return;
+  }
+
+  int const size = level->size;
+  DData *tmp    = (DData*)malloc(sizeof(DData) * size);
+  DData *coarse = (DData*)malloc(sizeof(DData) * coarser->size);
+  int k, index;
+
+  for (k = 0; k < passes; k++) {
+    MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL, datas, tmp);
+    memcpy(datas, tmp, sizeof(DData) * size);
+  }
+
+  MRISaverageGradients_levelRestrict(level, datas, coarse);
+  fprintf(stderr, "TMPML size %d n %g eps %g coarse size %d eps %g\n", level->size, num_avgs, level->eps, coarser->size, coarser->eps);
+  MRISaverageGradients_levelSmooth(coarser, (num_avgs - 2 * passes) * level->eps / coarser->eps, coarseField, coarse);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (index = 0; index < size; index++) {
+    ROMP_PFLB_begin
+    datas[index] = coarse[level->aggregate[index]];
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  for (k = 0; k < passes; k++) {
+    MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL, datas, tmp);
+    memcpy(datas, tmp, sizeof(DData) * size);
+  }
+
+  free(coarse);
+  free(tmp);
+  free(coarseField);
+}
+
+// Replaces datas[] by approximately P^num_avgs datas[], where coords[] are the vertex coordinates
+//
+static void MRISaverageGradients_multilevel(
+  int                                   num_avgs,
+  int                                   index_to_vno_size,
+  const MRISaverageGradients_Control*   controls,
+  const int*                            neighbors,
+  MRISaverageGradients_DData*           coords,
+  MRISaverageGradients_Data*            datas)
+{
+  typedef MRISaverageGradients_DData DData;
+
+  int const size = index_to_vno_size;
+  int index, k;
+
+  int nedges = 0;
+  for (index = 0; index < size; index++) nedges += controls[index].numNeighbors;
+
+  MRISaverageGradients_Level *level = (MRISaverageGradients_Level*)calloc(1, sizeof(MRISaverageGradients_Level));
+  level->size          = size;
+  level->firstNeighbor = (int*)   malloc(sizeof(int) * (size + 1));
+  level->neighbors     = (int*)   malloc(sizeof(int) * MAX(1, nedges));
+  level->mass          = (double*)malloc(sizeof(double) * size);
+  nedges = 0;
+  for (index = 0; index < size; index++) {
+    const MRISaverageGradients_Control *c = controls + index;
+    level->firstNeighbor[index] = nedges;
+    for (k = 0; k < c->numNeighbors; k++) level->neighbors[nedges++] = neighbors[c->firstNeighbor + k];
+    level->mass[index] = c->numNeighbors + 1;
+  }
+  level->firstNeighbor[size] = nedges;
+
+  // the coordinates lose the irregularities of the tessellation in a few passes
+  //
+  DData *tmp = (DData*)malloc(sizeof(DData) * size);
+  for (k = 0; k < MRIS_AVERAGE_GRADIENTS_MULTILEVEL_RELAX; k++) {
+    MRISaverageGradients_levelPass(level, 1.0, 0.0, NULL, coords, tmp);
+    memcpy(coords, tmp, sizeof(DData) * size);
+  }
+  level->eps = MRISaverageGradients_levelRayleigh(level, coords);
+
+  DData *d = tmp;
+  for (index = 0; index < size; index++) {
+    d[index].dx = datas[index].dx; d[index].dy = datas[index].dy; d[index].dz = datas[index].dz;
+  }
+  { double mx = 0; for (index = 0; index < size; index++) mx = MAX(mx, fabs(d[index].dx)); fprintf(stderr, "TMPML in max %g\n", mx); }
+  MRISaverageGradients_levelSmooth(level, num_avgs, coords, d);
+  { double mx = 0; for (index = 0; index < size; index++) mx = MAX(mx, fabs(d[index].dx)); fprintf(stderr, "TMPML out max %g\n", mx); }
+  for (index = 0; index < size; index++) {
+    datas[index].dx = d[index].dx; datas[index].dy = d[index].dy; datas[index].dz = d[index].dz;
+  }
+
+  free(tmp);
+  MRISaverageGradients_levelFree(&level);
+}
+
 int MRISaverageGradients(MRIS *mris, int num_avgs)
 {
   int i, vno;
@@ -9700,7 +10280,7 @@ int MRISaverageGradients(MRIS *mris, int num_avgs)
 
       // Choose chunk size assuming should evenly distribute the number of neighbors to process
       //
-      typedef struct Chunk { int indexLo; } Chunk;
+      typedef MRISaverageGradients_Chunk Chunk;
 #define chunksCapacity 17  // 4 * omp_get_max_threads() + 1 // must be at least 3
       Chunk chunks[chunksCapacity];
       size_t chunksSize = 0;
@@ -9720,8 +10300,52 @@ int MRISaverageGradients(MRIS *mris, int num_avgs)
       }
 #undef chunksCapacity
 
+      // Use the multilevel averaging or the truncated Chebyshev expansion of the
+      // repeated averaging when they need fewer passes, unless suppressed to
+      // reproduce the old results
+      //
+      int sweeps = num_avgs;
+      double *chebyshevCoefs = NULL;
+      if (num_avgs > 16 && !doOld && index_to_vno_size > 0 &&
+          !getenv("FREESURFER_MRISaverageGradients_chebyshev_suppress")) {
+        if (num_avgs >= MRIS_AVERAGE_GRADIENTS_MULTILEVEL_MIN && !getenv("TMPNOML")) {
+          typedef MRISaverageGradients_DData DData;
+          DData *coords = (DData*)malloc(sizeof(DData) * index_to_vno_size);
+          int index;
+          for (index = 0; index < index_to_vno_size; index++) {
+            int const old_index = MRISaverageGradients_new2old_indexMap ? MRISaverageGradients_new2old_indexMap[index] : index;
+            VERTEX const * const v = &mris->vertices[index_to_vno[old_index]];
+            coords[index].dx = v->x; coords[index].dy = v->y; coords[index].dz = v->z;
+          }
+          Data *TMPcopy = (Data*)malloc(sizeof(Data) * index_to_vno_size);
+          memcpy(TMPcopy, datas_inp, sizeof(Data) * index_to_vno_size);
+          MRISaverageGradients_multilevel(num_avgs, index_to_vno_size, controls, neighbors, coords, datas_inp);
+          { Data *a = TMPcopy, *b = datas_out; int q, r, nn;
+            for (r = 0; r < num_avgs; r++) {
+              for (q = 0; q < index_to_vno_size; q++) { float x = a[q].dx, y = a[q].dy, z = a[q].dz; for (nn = 0; nn < controls[q].numNeighbors; nn++) { Data *e = a + neighbors[controls[q].firstNeighbor + nn]; x += e->dx; y += e->dy; z += e->dz; } float inv = 1.0f / (controls[q].numNeighbors + 1); b[q].dx = x * inv; b[q].dy = y * inv; b[q].dz = z * inv; }
+              Data *t = a; a = b; b = t; }
+            double mx = 0, me = 0, dot = 0, n1 = 0, n2 = 0;
+            for (q = 0; q < index_to_vno_size; q++) { mx = MAX(mx, fabs(a[q].dx)); me = MAX(me, fabs(a[q].dx - datas_inp[q].dx)); dot += a[q].dx * datas_inp[q].dx + a[q].dy * datas_inp[q].dy + a[q].dz * datas_inp[q].dz; n1 += SQR(a[q].dx) + SQR(a[q].dy) + SQR(a[q].dz); n2 += SQR(datas_inp[q].dx) + SQR(datas_inp[q].dy) + SQR(datas_inp[q].dz); }
+            fprintf(stderr, "TMPCMP maxrel %g cos %g norm ratio %g\n", me / mx, dot / sqrt(n1 * n2), sqrt(n2 / n1));
+            if (a != TMPcopy) memcpy(TMPcopy, a, sizeof(Data) * index_to_vno_size);
+          }
+          free(TMPcopy);
+          free(coords);
+          sweeps = 0;
+        } else {
+          chebyshevCoefs = (double*)malloc(sizeof(double) * (num_avgs + 1));
+          int const chebyshevDegree = MRISaverageGradients_chebyshevDegree(num_avgs, chebyshevCoefs);
+          if (chebyshevDegree < num_avgs) {
+            { double mx = 0; for (int q = 0; q < index_to_vno_size; q++) mx = MAX(mx, fabs(datas_inp[q].dx)); fprintf(stderr, "TMPCH n %d deg %d in max %g\n", num_avgs, chebyshevDegree, mx); }
+            MRISaverageGradients_chebyshev(chebyshevDegree, chebyshevCoefs,
+              index_to_vno_size, controls, neighbors, chunks, (int)chunksSize, datas_inp);
+            sweeps = 0;
+          }
+        }
+      }
+      
       // Do all the iterations
-      for (i = 0 ; i < num_avgs ; i++) {
+      for (i = 0 ; i < sweeps ; i++) {
         
         unsigned int chunksIndex;
         ROMP_PF_begin
@@ -9760,6 +10384,7 @@ int MRISaverageGradients(MRIS *mris, int num_avgs)
         // swap the output and the input going into the next round
         Data* tmp = datas_inp ; datas_inp = datas_out ; datas_out = tmp;
       }
+      free(chebyshevCoefs);
     }
     
     // Only perform the old algorithm when needed
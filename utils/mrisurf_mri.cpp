@@ -452,6 +452,9 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
   MHT *mht = NULL, *mht_v_orig = NULL, *mht_v_current = NULL, *mht_f_current = NULL, *mht_pial = NULL;
   int msec;
   VERTEX *vgdiag;
+  MRIS_SoA soa;  // dense xyz/normals/1-ring for the spring terms, reloaded each iteration
+
+  MRISSoA_ctr(&soa);
 
   printf("Entering MRISpositionSurface()\n");
   max_mm = MIN(MAX_ASYNCH_MM, MIN(mri_smooth->xsize, MIN(mri_smooth->ysize, mri_smooth->zsize)) / 2);
@@ -622,7 +625,8 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
     mrisAverageSignedGradients(mris, avgs);
     /*mrisUpdateSulcalGradients(mris, parms) ;*/
     /* smoothness terms */
-    mrisComputeSpringTerm(mris, parms->l_spring);
+    MRIS_SoA const * const soaOrNull = MRISSoA_prepareSmoothnessTerms(&soa, mris, parms) ? &soa : NULL;
+    mrisComputeSpringTerm(mris, soaOrNull, parms->l_spring);
     if(parms->l_hinge > 0 || parms->l_spring_nzr > 0){
       if(mris->edges == NULL){
 	printf("First pass, creating edges\n");
@@ -649,12 +653,12 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
     mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-    mrisComputeNormalSpringTerm(mris, parms->l_nspring);
+    mrisComputeNormalSpringTerm(mris, soaOrNull, parms->l_nspring);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
     /*mrisComputeAverageNormalTerm(mris, avgs, parms->l_nspring) ;*/
     /*mrisComputeCurvatureTerm(mris, parms->l_curv) ;*/
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
+    mrisComputeTangentialSpringTerm(mris, soaOrNull, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
     mrisComputeMaxSpringTerm(mris, parms->l_max_spring);
     mrisComputeAngleAreaTerms(mris, parms);
@@ -877,6 +881,7 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
   if (mht_v_orig) {
     MHTfree(&mht_v_orig);
   }
+  MRISSoA_dtr(&soa);
 
   return (NO_ERROR);
 }
@@ -889,7 +894,9 @@ int MRISpositionSurface_mef(
   double delta_t = 0.0, rms, dt, l_intensity, base_dt, last_rms, max_mm, sse, last_sse, delta_rms;
   MHT *mht = NULL, *mht_v_orig = NULL, *mht_v_current = NULL, *mht_f_current = NULL;
   int msec;
+  MRIS_SoA soa;
 
+  MRISSoA_ctr(&soa);
   max_mm = MIN(MAX_ASYNCH_MM, MIN(mri_30->xsize, MIN(mri_30->ysize, mri_30->zsize)) / 2);
 
   // note that the following is for pial surface avoid intersection with white
@@ -976,17 +983,18 @@ int MRISpositionSurface_mef(
     /*                mrisUpdateSulcalGradients(mris, parms) ;*/
 
     /* smoothness terms */
-    mrisComputeSpringTerm(mris, parms->l_spring);
+    MRIS_SoA const * const soaOrNull = MRISSoA_prepareSmoothnessTerms(&soa, mris, parms) ? &soa : NULL;
+    mrisComputeSpringTerm(mris, soaOrNull, parms->l_spring);
     mrisComputeLaplacianTerm(mris, parms->l_lap);
     mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
     mrisComputeRepulsiveTerm(mris, parms->l_repulse, mht_v_current, mht_f_current);
     mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-    mrisComputeNormalSpringTerm(mris, parms->l_nspring);
+    mrisComputeNormalSpringTerm(mris, soaOrNull, parms->l_nspring);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
+    mrisComputeTangentialSpringTerm(mris, soaOrNull, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
 
     do {
@@ -1076,6 +1084,7 @@ int MRISpositionSurface_mef(
   if (mht_v_orig) {
     MHTfree(&mht_v_orig);
   }
+  MRISSoA_dtr(&soa);
   return (NO_ERROR);
 }
 
@@ -5403,6 +5412,107 @@ MRI *MRISsmoothMRI(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *BinMask, MRI *Ta
   MRIScrsLUTFree(crslut);
   return (Targ);
 }
+/*-------------------------------------------------------------------
+  The nearest neighbor averaging of MRISsmoothMRIFast() as a sparse
+  matrix in compressed row storage. There is a row for each vertex in
+  the mask (ripped vertices are still smoothed); its first column is
+  the vertex itself, followed by its unripped neighbors in the mask in
+  vertices_topology order, so the sums are formed in the same order as
+  they always were.
+  -------------------------------------------------------------------*/
+typedef struct
+{
+  int nrows;
+  int *rowvno;  // vertex of each row
+  int *rowptr;  // first column of each row, rowptr[nrows] = number of columns
+  int *col;     // vertex of each column
+} MRIS_SMOOTH_OP;
+
+// number of frames smoothed together, so the inner loop runs over frames
+#define SMOOTH_FRAME_BLOCK 16
+
+static MRIS_SMOOTH_OP *mrisSmoothOpAlloc(MRIS *Surf, MRI *IncMask)
+{
+  MRIS_SMOOTH_OP *op;
+  int vno, nthnbr, nbrvno, nnz;
+
+  op = (MRIS_SMOOTH_OP *)calloc(1, sizeof(MRIS_SMOOTH_OP));
+  op->rowvno = (int *)calloc(Surf->nvertices, sizeof(int));
+  op->rowptr = (int *)calloc(Surf->nvertices + 1, sizeof(int));
+  for (nnz = vno = 0; vno < Surf->nvertices; vno++) nnz += 1 + Surf->vertices_topology[vno].vnum;
+  op->col = (int *)calloc(nnz, sizeof(int));
+  if (!op->rowvno || !op->rowptr || !op->col)
+    ErrorExit(ERROR_NOMEMORY, "mrisSmoothOpAlloc: could not allocate %d x %d operator", Surf->nvertices, nnz);
+
+  for (nnz = vno = 0; vno < Surf->nvertices; vno++) {
+    // Mask is inclusive, so look for out of mask
+    // should exclude rips here too? Original does not.
+    if (IncMask && MRIgetVoxVal(IncMask, vno, 0, 0, 0) < 0.5) continue;
+    op->rowvno[op->nrows] = vno;
+    op->rowptr[op->nrows] = nnz;
+    op->col[nnz++] = vno;
+    VERTEX_TOPOLOGY const *const vt = &Surf->vertices_topology[vno];
+    for (nthnbr = 0; nthnbr < vt->vnum; nthnbr++) {
+      nbrvno = vt->v[nthnbr];
+      if (Surf->vertices[nbrvno].ripflag) continue;
+      if (IncMask && MRIgetVoxVal(IncMask, nbrvno, 0, 0, 0) < 0.5) continue;
+      op->col[nnz++] = nbrvno;
+    }
+    op->nrows++;
+  }
+  op->rowptr[op->nrows] = nnz;
+
+  return (op);
+}
+
+static void mrisSmoothOpFree(MRIS_SMOOTH_OP **pop)
+{
+  MRIS_SMOOTH_OP *op = *pop;
+  *pop = NULL;
+  free(op->rowvno);
+  free(op->rowptr);
+  free(op->col);
+  free(op);
+}
+
+/* Applies the operator nSmoothSteps times to the nb interleaved frames
+   in X (X[vno*nb + frame]), using Y as the other buffer. Returns the
+   buffer holding the result. Entries of vertices without a row are
+   not changed. */
+static float *mrisSmoothOpApply(MRIS_SMOOTH_OP const *op, float *X, float *Y, int nb, int nSmoothSteps)
+{
+  int nthstep, row;
+  float *tmp;
+
+  for (nthstep = 0; nthstep < nSmoothSteps; nthstep++) {
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+    for (row = 0; row < op->nrows; row++) {
+      ROMP_PFLB_begin
+      int const num = op->rowptr[row + 1] - op->rowptr[row];  // num takes into account all rips/masks
+      int const *col = op->col + op->rowptr[row];
+      float *y = Y + (size_t)op->rowvno[row] * nb;
+      float const *x = X + (size_t)col[0] * nb;
+      int k, b;
+      for (b = 0; b < nb; b++) y[b] = x[b];
+      for (k = 1; k < num; k++) {
+        x = X + (size_t)col[k] * nb;
+        for (b = 0; b < nb; b++) y[b] += x[b];
+      }
+      for (b = 0; b < nb; b++) y[b] = y[b] / num;
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+    // Load up for the next step
+    tmp = X;
+    X = Y;
+    Y = tmp;
+  }
+  return (X);
+}
+
 /*-------------------------------------------------------------------
   MRISsmoothMRIFast() - faster version of MRISsmoothMRI(). Smooths
   values on the surface when the surface values are stored in an
@@ -5416,15 +5526,17 @@ MRI *MRISsmoothMRI(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *BinMask, MRI *Ta
   other way). Same for mask. The mask is inclusive, so voxels with
   mask=1 are included. If mask is NULL, it is ignored. Gives identical
   results as MRISsmoothMRI(); see MRISsmoothMRIFastCheck().
+  The averaging is built once as a sparse operator (MRIS_SMOOTH_OP)
+  and applied to blocks of SMOOTH_FRAME_BLOCK frames at a time, with
+  the vertices of each step processed in parallel.
   -------------------------------------------------------------------*/
 MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI *Targ)
 {
-  int nnbrs, nthstep, frame, vno, nthnbr, num, nvox, nbrvno, reshape;
+  int frame, frame0, nb, row, vno, nvox, reshape;
   MRI *SrcTmp, *mritmp, *IncMaskTmp = NULL;
   int msecTime;
-  int *nNbrs, *nNbrs0, *rip, *rip0, nNbrsMax;
-  float **pF, **pF0, *tF, *tF0, sumF;
-  VERTEX *v, *vn;
+  MRIS_SMOOTH_OP *op;
+  float *X, *Y, *res;
 
   if (Gdiag_no > 0) printf("MRISsmoothMRIFast()\n");
 
@@ -5464,86 +5576,41 @@ MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI
     }
   }
 
-  // Alloc arrays. If there are ripped vertices, then only rip
-  // needs nvertices elements
-  nNbrsMax = 12;  // Should measure this, but overalloc does not hurt
-  pF = (float **)calloc(Surf->nvertices * nNbrsMax, sizeof(float *));
-  tF = (float *)calloc(Surf->nvertices, sizeof(float));
-  nNbrs = (int *)calloc(Surf->nvertices, sizeof(int));
-  rip = (int *)calloc(Surf->nvertices, sizeof(int));
+  Timer mytimer;
 
-  pF0 = pF;
-  tF0 = tF;
-  rip0 = rip;
-  nNbrs0 = nNbrs;
+  // The operator is the same for all frames
+  op = mrisSmoothOpAlloc(Surf, IncMaskTmp);
+  nb = MIN(SMOOTH_FRAME_BLOCK, Src->nframes);
+  X = (float *)calloc((size_t)nvox * nb, sizeof(float));
+  Y = (float *)calloc((size_t)nvox * nb, sizeof(float));
+  if (!X || !Y) ErrorExit(ERROR_NOMEMORY, "MRISsmoothMRIFast(): could not allocate %d x %d frames", nvox, nb);
 
-  Timer mytimer;
+  // Loop through blocks of frames
+  for (frame0 = 0; frame0 < Src->nframes; frame0 += nb) {
+    if (frame0 + nb > Src->nframes) {
+      // last block is shorter, vertices out of the mask must stay 0
+      nb = Src->nframes - frame0;
+      memset(X, 0, (size_t)nvox * nb * sizeof(float));
+      memset(Y, 0, (size_t)nvox * nb * sizeof(float));
+    }
 
-  // Loop through frames
-  for (frame = 0; frame < Src->nframes; frame++) {
-    // Set up pointers for this frame
-    pF = pF0;
-    rip = rip0;
-    nNbrs = nNbrs0;
-    for (vno = 0; vno < Surf->nvertices; vno++) {
-      v = &Surf->vertices[vno];
-      if (IncMaskTmp && MRIgetVoxVal(IncMaskTmp, vno, 0, 0, 0) < 0.5) {
-        // Mask is inclusive, so look for out of mask
-        // should exclude rips here too? Original does not.
-        rip[vno] = 1;
-        MRIFseq_vox(SrcTmp, vno, 0, 0, frame) = 0;
-        continue;
+    // Interleave the frames of this block
+    for (frame = 0; frame < nb; frame++) {
+      float const *src = &MRIFseq_vox(SrcTmp, 0, 0, 0, frame0 + frame);
+      for (row = 0; row < op->nrows; row++) {
+        vno = op->rowvno[row];
+        X[(size_t)vno * nb + frame] = src[vno];
       }
-      rip[vno] = 0;
-      *pF++ = (float *)(&(MRIFseq_vox(SrcTmp, vno, 0, 0, frame)));
-      nnbrs = Surf->vertices_topology[vno].vnum;
-      num = 1;
-      for (nthnbr = 0; nthnbr < nnbrs; nthnbr++) {
-        nbrvno = Surf->vertices_topology[vno].v[nthnbr];
-        vn = &Surf->vertices[nbrvno];
-        if (vn->ripflag) {
-          continue;
-        }
-        if (IncMaskTmp && MRIgetVoxVal(IncMaskTmp, nbrvno, 0, 0, 0) < 0.5) {
-          continue;
-        }
-        *pF++ = (float *)(&(MRIFseq_vox(SrcTmp, nbrvno, 0, 0, frame)));
-        num++;
-      }
-      *nNbrs++ = num;  // num takes into account all rips/masks
     }
 
     // Step through the iterations
-    for (nthstep = 0; nthstep < nSmoothSteps; nthstep++) {
-      // Init pointers for this iteration
-      pF = pF0;
-      rip = rip0;
-      tF = tF0;
-      nNbrs = nNbrs0;
-      // Loop through vertices, average nearest neighbors
-      for (vno = 0; vno < Surf->nvertices; vno++) {
-        if (*rip++) {
-          continue;
-        }
-        sumF = *(*pF++);
-        for (nthnbr = 0; nthnbr < (*nNbrs) - 1; nthnbr++) {
-          sumF += *(*pF++);
-        }
-        *tF++ = sumF / (*nNbrs);
-        nNbrs++;
-      }
-      // Load up for the next step
-      rip = rip0;
-      tF = tF0;
-      for (vno = 0; vno < Surf->nvertices; vno++) {
-        if (*rip++) {
-          continue;
-        }
-        MRIsetVoxVal(SrcTmp, vno, 0, 0, frame, *tF++);
-      }
-    }
+    res = mrisSmoothOpApply(op, X, Y, nb, nSmoothSteps);
 
-  } /* end loop over frame */
+    for (frame = 0; frame < nb; frame++) {
+      float *dst = &MRIFseq_vox(SrcTmp, 0, 0, 0, frame0 + frame);
+      for (vno = 0; vno < nvox; vno++) dst[vno] = res[(size_t)vno * nb + frame];
+    }
+  } /* end loop over frame blocks */
 
   // Copy to the output
   if (reshape) {
@@ -5563,10 +5630,9 @@ MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI
 
   MRIfree(&SrcTmp);
   if (IncMaskTmp) MRIfree(&IncMaskTmp);
-  free(pF0);
-  free(tF0);
-  free(rip0);
-  free(nNbrs0);
+  mrisSmoothOpFree(&op);
+  free(X);
+  free(Y);
 
   return (Targ);
 }
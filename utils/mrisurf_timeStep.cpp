@@ -435,7 +435,7 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
 
       VERTEX * const v = &mris->vertices[vno];
       if (v->ripflag) {
-        ROMP_PF_continue;
+        continue;
       }
 
       mrisAsynchronousTimeStep_update_odxyz(
@@ -567,6 +567,15 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
       ySubvolVerge += min_nbr_dist;
       zSubvolVerge += min_nbr_dist;
     }
+    if (mht) {
+      // Faces are entered into every mht bucket they touch, so keep a bucket's width
+      // between the subvolumes.  Then no bucket is shared by two subvolumes, and the
+      // contents and order of every bucket do not depend on how the threads interleave.
+      //
+      xSubvolVerge += mht->vres();
+      ySubvolVerge += mht->vres();
+      zSubvolVerge += mht->vres();
+    }
     
     allVertexsContext.xSubvolLen   = xSubvolLen;
     allVertexsContext.ySubvolLen   = ySubvolLen;
@@ -752,6 +761,15 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
       }
 
 
+      // like the serial algorithm, alternate the direction through the vertices
+      //
+      if (*directionPtr > 0) {
+        int i;
+        for (i = 0; i < tempSize/2; i++) {
+          int t = temp[i]; temp[i] = temp[tempSize-1-i]; temp[tempSize-1-i] = t;
+        }
+      }
+
       // put it into the thread 0 subvolume for this svi
       //
       SubvolInfo* subvol0 = subvols + svi;
@@ -778,6 +796,13 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
   //  
   // Pass 0: In parallel, process each subvolume
   // Pass 1: In serial, process the cross-subvolume (parallel but only one hence serial)
+  //
+  // A vertex that wants to leave its subvolume during pass 0 is put on that subvolume's 
+  // retry list, which only the thread doing that subvolume touches.  After pass 0 the
+  // retry lists are appended to the cross-subvolume list in svi order, so the order the
+  // vertices are moved in, and hence the result, does not depend on the threads.
+  //
+  SubvolInfo* retries = (SubvolInfo*)calloc(numSubvolsPerThread, sizeof(SubvolInfo));
   { 
     MHT_maybeParallel_begin();
     
@@ -789,12 +814,23 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
 
       allVertexsContext.vertexInfos = (pass == 1) ? NULL : vertexInfos;   // on the second pass, the vertexs can move anywhere
 
+      if (pass == 1) {
+        SubvolInfo* shared = subvols + numSubvolsPerThread - 1;
+        for (svi = 0; svi < (int)numSubvolsPerThread - 1; svi++) {
+          SubvolInfo* retry = retries + svi;
+          if (!retry->firstVnoPlus1) continue;
+          if (shared->lastVnoPlus1) vertexInfos[shared->lastVnoPlus1 - 1].nextVnoPlus1 = retry->firstVnoPlus1;
+          else                      shared->firstVnoPlus1 = retry->firstVnoPlus1;
+          shared->lastVnoPlus1 = retry->lastVnoPlus1;
+        }
+      }
+
       if (debugNonDeterminism) {
-        fprintf(stdout, "%s:%d stdout ",__FILE__,__LINE__);             // the results differ here on the 2nd pass!
+        fprintf(stdout, "%s:%d stdout ",__FILE__,__LINE__);
         mris_print_hash(stdout, mris, "mris ", "\n");
       }
       ROMP_PF_begin
-      #pragma omp parallel for if_ROMP(assume_reproducible)
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic,1)
       for (svi = sviLo; svi < sviHi; svi++) {
         ROMP_PFLB_begin
         MRISAsynchronousTimeStep_optionalDxDyDzUpdate_oneVertex_Context ctx;
@@ -815,18 +851,14 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
           }
           PerVertexInfo* pvi = vertexInfos + vno;
           vno = pvi->nextVnoPlus1 - 1;
-          if (vnoToRetry >= 0) 
-#ifdef HAVE_OPENMP
-          #pragma omp critical
-#endif
-          {
+          if (vnoToRetry >= 0) {
             if (pass == 1) *(int*)-1 = 0;                     // on the second pass, the vertexs can move anywhere, so this should not happen
-            int shared_svi = numSubvolsPerThread - 1;
-            SubvolInfo* subvol = subvols + shared_svi;
-            pvi->nextVnoPlus1 = subvol->firstVnoPlus1;    
-            subvol->firstVnoPlus1 = vno + 1;
-            if (!subvol->lastVnoPlus1) subvol->lastVnoPlus1 = vno + 1;
-		  }
+            SubvolInfo* retry = retries + svi;
+            pvi->nextVnoPlus1 = 0;
+            if (retry->lastVnoPlus1) vertexInfos[retry->lastVnoPlus1 - 1].nextVnoPlus1 = vnoToRetry + 1;
+            else                     retry->firstVnoPlus1 = vnoToRetry + 1;
+            retry->lastVnoPlus1 = vnoToRetry + 1;
+          }
         }
         ROMP_PFLB_end
       }
@@ -838,6 +870,7 @@ static void mrisAsynchronousTimeStep_optionalDxDyDzUpdate( // BEVIN mris_make_su
   }
 
   // Free the temporary data
+  free(retries);
   free(vnoToSvi);
   free(faceInfos);
   free(subvols);
@@ -57,11 +57,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <string>
 #include "timer.h"
 
 #include "romp_support.h"
 
 #include "bfileio.h"
+#include "fio.h"
 #include "corio.h"
 #include "diag.h"
 #include "label.h"
@@ -944,7 +947,9 @@ MRI *MRISapplyRegBCI(MRIS *reg1, MRIS *reg2, MRI *in)
                   int ReverseMapFlag, int DoJac, int UseHash)
 \brief Applies one or more surface registrations with or without jacobian correction.
 This should be used as a replacement for surf2surf_nnfr and surf2surf_nnfr_jac
-(it gives identical results).
+(it gives identical results). The mapping is built with MRISapplyRegOp() and
+applied with MRISregOpApply(); callers that resample several inputs through
+the same registration should do that themselves and keep the operator.
 \param MRI *SrcSurfVals - Inputs
 \param MRIS **SurfReg - array of surface reg pairs, src1-trg1:src2-trg2:... where
 trg1 and src2 are from the same anatomy.
@@ -955,15 +960,46 @@ trg1 and src2 are from the same anatomy.
 */
 MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
 {
-  MRI *TrgSurfVals = NULL;
+  MRIS_REG_OP *op;
+  MRI *TrgSurfVals;
+
+  /* check dimension consistency */
+  if (SrcSurfVals->width != SurfReg[0]->nvertices) {
+    printf("MRISapplyReg: Vals and Reg dimension mismatch\n");
+    printf("nVals = %d, nReg %d\n", SrcSurfVals->width, SurfReg[0]->nvertices);
+    return (NULL);
+  }
+
+  op = MRISapplyRegOp(SurfReg, nsurfs, ReverseMapFlag, DoJac, UseHash);
+  if (op == NULL) return (NULL);
+  TrgSurfVals = MRISregOpApply(op, SrcSurfVals, NULL);
+  MRISregOpFree(&op);
+  return (TrgSurfVals);
+}
+
+/*!
+\fn MRIS_REG_OP *MRISapplyRegOp(MRI_SURFACE **SurfReg, int nsurfs,
+                  int ReverseMapFlag, int DoJac, int UseHash)
+\brief Computes the mapping that MRISapplyReg() applies as a sparse
+operator, without any input values. Arguments are as for MRISapplyReg().
+The forward loop maps each (unripped) target vertex to its closest
+source vertex through the chain of registrations; the reverse loop maps
+each source vertex that was not hit to its closest target vertex. Each
+row of the operator lists the forward entry first and then the reverse
+entries in source vertex order, which is the order MRISapplyReg() always
+accumulated them in, so MRISregOpApply() reproduces it exactly.
+*/
+MRIS_REG_OP *MRISapplyRegOp(MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
+{
+  MRIS_REG_OP *op;
   MRI_SURFACE *SrcSurfReg, *TrgSurfReg;
-  int svtx = 0, tvtx, tvtxN, svtxN = 0, f, n, nrevhits, nSrcLost;
-  int npairs, kS, kT, nhits;
-  // int nunmapped;
+  int svtx = 0, tvtx, tvtxN, svtxN = 0, n, nrevhits, nSrcLost;
+  int npairs, kS, kT, nhits, k;
   VERTEX *v;
   float dmin;
   MHT **Hash = NULL;
-  MRI *SrcHits, *TrgHits;
+  int *SrcHits, *TrgHits, *fwdsrc, *revsrc, *revtrg;
+  float *fwddiv;
 
   npairs = nsurfs / 2;
   printf("MRISapplyReg(): nsurfs = %d, revmap=%d, jac=%d,  hash=%d\n", nsurfs, ReverseMapFlag, DoJac, UseHash);
@@ -973,11 +1009,6 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   TrgSurfReg = SurfReg[nsurfs - 1];
 
   /* check dimension consistency */
-  if (SrcSurfVals->width != SrcSurfReg->nvertices) {
-    printf("MRISapplyReg: Vals and Reg dimension mismatch\n");
-    printf("nVals = %d, nReg %d\n", SrcSurfVals->width, SrcSurfReg->nvertices);
-    return (NULL);
-  }
   for (n = 0; n < npairs - 1; n++) {
     kS = 2 * n + 1;
     kT = kS + 1;
@@ -988,20 +1019,26 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
     }
   }
 
-  /* allocate a "volume" to hold the output */
-  TrgSurfVals = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, SrcSurfVals->nframes);
-  if (TrgSurfVals == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, TrgSurfVals);
-
   /* number of source vertices mapped to each target vertex */
-  TrgHits = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
-  if (TrgHits == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, TrgHits);
-
+  TrgHits = (int *)calloc(TrgSurfReg->nvertices, sizeof(int));
   /* number of target vertices mapped to by each source vertex */
-  SrcHits = MRIallocSequence(SrcSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
-  if (SrcHits == NULL) return (NULL);
-  MRIcopyHeader(SrcSurfVals, SrcHits);
+  SrcHits = (int *)calloc(SrcSurfReg->nvertices, sizeof(int));
+  /* forward map (-1 for unmapped) and the divisor of each forward entry */
+  fwdsrc = (int *)malloc(TrgSurfReg->nvertices * sizeof(int));
+  fwddiv = (float *)malloc(TrgSurfReg->nvertices * sizeof(float));
+  /* reverse map, in source vertex order */
+  revsrc = (int *)malloc(SrcSurfReg->nvertices * sizeof(int));
+  revtrg = (int *)malloc(SrcSurfReg->nvertices * sizeof(int));
+  if (!TrgHits || !SrcHits || !fwdsrc || !fwddiv || !revsrc || !revtrg) {
+    printf("ERROR: MRISapplyRegOp(): could not alloc maps\n");
+    free(TrgHits);
+    free(SrcHits);
+    free(fwdsrc);
+    free(fwddiv);
+    free(revsrc);
+    free(revtrg);
+    return (NULL);
+  }
 
   if (UseHash) {
     printf("MRISapplyReg: building hash tables (res=16).\n");
@@ -1030,8 +1067,8 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
         tvtxN = svtx;
       }
       /* update the number of hits and distance */
-      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
-      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
     }
   }
 
@@ -1054,8 +1091,8 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   /* Go through the forwad loop (finding closest srcvtx to each trgvtx).
   This maps each target vertex to a source vertex */
   printf("MRISapplyReg: Forward Loop (%d)\n", TrgSurfReg->nvertices);
-  // nunmapped = 0;
   for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
+    fwdsrc[tvtx] = -1;
     if(TrgSurfReg->vertices[tvtx].ripflag) continue;
     if (!UseHash) {
       if (tvtx % 100 == 0) {
@@ -1075,7 +1112,6 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
     for (n = npairs - 1; n >= 0; n--) {
       kS = 2 * n;
       kT = kS + 1;
-      // printf("%5d %5d %d %d %d\n",tvtx,tvtxN,n,kS,kT);
       v = &(SurfReg[kT]->vertices[tvtxN]);
       if(v->ripflag){
 	skip = 1;
@@ -1102,12 +1138,6 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
 	skip = 1;
 	break;
       }
-      // DNG added these lines on Dec 9, 2020 (without checking it in), 
-      // but now can't remember why, so commented them out
-      //if(dmin > 2.0){
-      //skip = 1;
-      //break;
-      //}
       tvtxN = svtx;
     }
     if(skip) continue;
@@ -1122,16 +1152,15 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
 
     if (!DoJac) {
       /* update the number of hits */
-      MRIFseq_vox(SrcHits, svtx, 0, 0, 0)++;
-      MRIFseq_vox(TrgHits, tvtx, 0, 0, 0)++;
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
       nhits = 1;
     }
     else
-      nhits = MRIgetVoxVal(SrcHits, svtx, 0, 0, 0);
+      nhits = SrcHits[svtx];
 
-    /* accumulate mapped values for each frame */
-    for (f = 0; f < SrcSurfVals->nframes; f++)
-      MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += (MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f) / nhits);
+    fwdsrc[tvtx] = svtx;
+    fwddiv[tvtx] = nhits;
   }
   if(stvpairfp) fclose(stvpairfp);
 
@@ -1139,19 +1168,17 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
   Go through the reverse loop (finding closest trgvtx to each srcvtx
   unmapped by the forward loop). This assures that each source vertex
   is represented in the map */
+  nrevhits = 0;
   if (ReverseMapFlag) {
     printf("MRISapplyReg: Reverse Loop (%d)\n", SrcSurfReg->nvertices);
-    nrevhits = 0;
     for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
-      if (MRIFseq_vox((SrcHits), svtx, 0, 0, 0) != 0) continue;
-      nrevhits++;
+      if (SrcHits[svtx] != 0) continue;
 
       // Compute the target vertex that corresponds to this source vertex
       svtxN = svtx;
       for (n = 0; n < npairs; n++) {
         kS = 2 * n;
         kT = kS + 1;
-        // printf("%5d %5d %d %d %d\n",svtx,svtxN,n,kS,kT);
         v = &(SurfReg[kS]->vertices[svtxN]);
         /* find closest target vertex */
         if (UseHash) tvtx = MHTfindClosestVertexNo2(Hash[kT], SurfReg[kT], SurfReg[kS], v, &dmin);
@@ -1163,43 +1190,323 @@ MRI *MRISapplyReg(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int Rever
       }
 
       /* update the number of hits */
-      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
-      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
-      /* accumulate mapped values for each frame */
-      for (f = 0; f < SrcSurfVals->nframes; f++)
-        MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f);
+      SrcHits[svtx]++;
+      TrgHits[tvtx]++;
+      revsrc[nrevhits] = svtx;
+      revtrg[nrevhits] = tvtx;
+      nrevhits++;
     }
     printf("  Reverse Loop had %d hits\n", nrevhits);
   }
 
+  /*---------------------------------------------------------------
+  Lay the forward and reverse maps out as the rows of the operator */
+  op = (MRIS_REG_OP *)calloc(1, sizeof(MRIS_REG_OP));
+  if (op != NULL) {
+    op->nsrc = SrcSurfReg->nvertices;
+    op->ntrg = TrgSurfReg->nvertices;
+    op->ReverseMapFlag = ReverseMapFlag;
+    op->DoJac = DoJac;
+    op->UseHash = UseHash;
+    op->signature = MRISregOpSignature(SurfReg, nsurfs);
+    op->rowptr = (int *)calloc(op->ntrg + 1, sizeof(int));
+    op->rowdiv = (float *)malloc(op->ntrg * sizeof(float));
+  }
+  if (op != NULL && op->rowptr != NULL) {
+    for (tvtx = 0; tvtx < op->ntrg; tvtx++) op->rowptr[tvtx + 1] = (fwdsrc[tvtx] >= 0);
+    for (k = 0; k < nrevhits; k++) op->rowptr[revtrg[k] + 1]++;
+    for (tvtx = 0; tvtx < op->ntrg; tvtx++) op->rowptr[tvtx + 1] += op->rowptr[tvtx];
+    op->nnz = op->rowptr[op->ntrg];
+    op->col = (int *)malloc(MAX(op->nnz, 1) * sizeof(int));
+    op->div = (float *)malloc(MAX(op->nnz, 1) * sizeof(float));
+  }
+  if (op == NULL || !op->rowptr || !op->rowdiv || !op->col || !op->div) {
+    printf("ERROR: MRISapplyRegOp(): could not alloc operator\n");
+    MRISregOpFree(&op);
+    free(SrcHits);
+    free(TrgHits);
+    free(fwdsrc);
+    free(fwddiv);
+    free(revsrc);
+    free(revtrg);
+    if (UseHash) {
+      for (n = 0; n < nsurfs; n++) MHTfree(&Hash[n]);
+      free(Hash);
+    }
+    return (NULL);
+  }
+  int *fill = TrgHits;  // reused below once the row divisors are set
   /*---------------------------------------------------------------
   Finally, divide the value at each target vertex by the number
   of source vertices mapping into it */
-  if (!DoJac) {
-    printf("MRISapplyReg: Dividing by number of hits (%d)\n", TrgSurfReg->nvertices);
-    for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
-      n = MRIFseq_vox((TrgHits), tvtx, 0, 0, 0);
-      if (n > 1) {
-        for (f = 0; f < SrcSurfVals->nframes; f++) MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) /= n;
-      }
+  if (!DoJac) printf("MRISapplyReg: Dividing by number of hits (%d)\n", TrgSurfReg->nvertices);
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) {
+    op->rowdiv[tvtx] = (!DoJac && TrgHits[tvtx] > 1) ? TrgHits[tvtx] : 1;
+    fill[tvtx] = op->rowptr[tvtx];
+    if (fwdsrc[tvtx] >= 0) {
+      op->col[fill[tvtx]] = fwdsrc[tvtx];
+      op->div[fill[tvtx]] = fwddiv[tvtx];
+      fill[tvtx]++;
     }
   }
+  for (k = 0; k < nrevhits; k++) {
+    tvtx = revtrg[k];
+    op->col[fill[tvtx]] = revsrc[k];
+    op->div[fill[tvtx]] = 1;
+    fill[tvtx]++;
+  }
 
   /* Count lost sources */
   nSrcLost = 0;
   for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
-    n = MRIFseq_vox((SrcHits), svtx, 0, 0, 0);
-    if (n == 0) nSrcLost++;
+    if (SrcHits[svtx] == 0) nSrcLost++;
   }
   printf("MRISapplyReg: nSrcLost = %d\n", nSrcLost);
 
-  MRIfree(&SrcHits);
-  MRIfree(&TrgHits);
-  if (UseHash)
+  free(SrcHits);
+  free(TrgHits);
+  free(fwdsrc);
+  free(fwddiv);
+  free(revsrc);
+  free(revtrg);
+  if (UseHash) {
     for (n = 0; n < nsurfs; n++) MHTfree(&Hash[n]);
+    free(Hash);
+  }
+  return (op);
+}
+
+/*!
+\fn MRI *MRISregOpApply(MRIS_REG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals)
+\brief Resamples all frames of SrcSurfVals (float, nsrc wide) to the
+target surface in one pass over the operator. For each target vertex
+and frame, the source values of the row are divided by their entry
+divisor and summed in row order, then the sum is divided by the row
+divisor when that is more than 1. This is exactly the arithmetic
+MRISapplyReg() did, so the output is identical. Target vertices are
+independent and are done in parallel. TrgSurfVals is allocated (with
+the header of SrcSurfVals) if NULL.
+*/
+MRI *MRISregOpApply(MRIS_REG_OP *op, MRI *SrcSurfVals, MRI *TrgSurfVals)
+{
+  if (SrcSurfVals->type != MRI_FLOAT || SrcSurfVals->width != op->nsrc) {
+    printf("ERROR: MRISregOpApply(): input must be float with %d vertices, not type %d with %d\n",
+           op->nsrc, SrcSurfVals->type, SrcSurfVals->width);
+    return (NULL);
+  }
+  if (TrgSurfVals == NULL) {
+    TrgSurfVals = MRIallocSequence(op->ntrg, 1, 1, MRI_FLOAT, SrcSurfVals->nframes);
+    if (TrgSurfVals == NULL) return (NULL);
+    MRIcopyHeader(SrcSurfVals, TrgSurfVals);
+  }
+  else if (TrgSurfVals->type != MRI_FLOAT || TrgSurfVals->width != op->ntrg ||
+           TrgSurfVals->nframes != SrcSurfVals->nframes) {
+    printf("ERROR: MRISregOpApply(): output dimension mismatch\n");
+    return (NULL);
+  }
+
+  int const nframes = SrcSurfVals->nframes;
+  int tvtx;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(static, 1024)
+#endif
+  for (tvtx = 0; tvtx < op->ntrg; tvtx++) {
+    ROMP_PFLB_begin
+    int f, k;
+    for (f = 0; f < nframes; f++) {
+      float sum = 0;
+      for (k = op->rowptr[tvtx]; k < op->rowptr[tvtx + 1]; k++)
+        sum += MRIFseq_vox(SrcSurfVals, op->col[k], 0, 0, f) / op->div[k];
+      if (op->rowdiv[tvtx] > 1) sum /= op->rowdiv[tvtx];
+      MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) = sum;
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
   return (TrgSurfVals);
 }
 
+/*!
+\fn unsigned long long MRISregOpSignature(MRI_SURFACE **SurfReg, int nsurfs)
+\brief FNV-1a hash of the vertex counts, current coordinates and rip
+flags of the registration surfaces. Stored in the operator so a saved
+operator can be checked against the surfaces it is about to be used
+with (see MRISregOpMatches()).
+*/
+static unsigned long long regOpHash(unsigned long long h, unsigned int u)
+{
+  int b;
+  for (b = 0; b < 4; b++) {
+    h ^= (u >> (8 * b)) & 0xff;
+    h *= 1099511628211ULL;
+  }
+  return (h);
+}
+
+unsigned long long MRISregOpSignature(MRI_SURFACE **SurfReg, int nsurfs)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  int n, vno;
+
+  h = regOpHash(h, nsurfs);
+  for (n = 0; n < nsurfs; n++) {
+    h = regOpHash(h, SurfReg[n]->nvertices);
+    for (vno = 0; vno < SurfReg[n]->nvertices; vno++) {
+      VERTEX const * const v = &SurfReg[n]->vertices[vno];
+      unsigned int u[3];
+      memcpy(&u[0], &v->x, sizeof(float));
+      memcpy(&u[1], &v->y, sizeof(float));
+      memcpy(&u[2], &v->z, sizeof(float));
+      h = regOpHash(h, u[0]);
+      h = regOpHash(h, u[1]);
+      h = regOpHash(h, u[2]);
+      h = regOpHash(h, v->ripflag);
+    }
+  }
+  return (h);
+}
+
+/*!
+\fn int MRISregOpMatches(MRIS_REG_OP *op, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
+\brief Returns 1 if op was built from these registration surfaces with
+these flags, 0 otherwise. UseHash is part of the match because the hash
+and brute-force searches can resolve equidistant vertices differently.
+*/
+int MRISregOpMatches(MRIS_REG_OP *op, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
+{
+  if (op->nsrc != SurfReg[0]->nvertices || op->ntrg != SurfReg[nsurfs - 1]->nvertices) return (0);
+  if ((op->ReverseMapFlag != 0) != (ReverseMapFlag != 0) || (op->DoJac != 0) != (DoJac != 0)) return (0);
+  if ((op->UseHash != 0) != (UseHash != 0)) return (0);
+  return (op->signature == MRISregOpSignature(SurfReg, nsurfs));
+}
+
+#define MRIS_REG_OP_MAGIC 0x52474f50  // "RGOP"
+#define MRIS_REG_OP_VERSION 2  // 2: UseHash
+
+/*!
+\fn int MRISregOpWrite(MRIS_REG_OP *op, const char *fname)
+\brief Saves the operator (big-endian ints and floats). The file is
+written under a temporary name and renamed into place, so processes
+sharing a cache never see a partial operator.
+*/
+int MRISregOpWrite(MRIS_REG_OP *op, const char *fname)
+{
+  std::string tmpname = std::string(fname) + ".tmp." + std::to_string((long long)getpid());
+  FILE *fp = fopen(tmpname.c_str(), "wb");
+  int k, err;
+
+  if (fp == NULL) {
+    printf("ERROR: MRISregOpWrite(): could not open %s\n", tmpname.c_str());
+    return (1);
+  }
+  fwriteInt(MRIS_REG_OP_MAGIC, fp);
+  fwriteInt(MRIS_REG_OP_VERSION, fp);
+  fwriteInt(op->nsrc, fp);
+  fwriteInt(op->ntrg, fp);
+  fwriteInt(op->ReverseMapFlag, fp);
+  fwriteInt(op->DoJac, fp);
+  fwriteInt(op->UseHash, fp);
+  fwriteInt(op->nnz, fp);
+  fwriteInt((int)(op->signature >> 32), fp);
+  fwriteInt((int)(op->signature & 0xffffffff), fp);
+  for (k = 0; k <= op->ntrg; k++) fwriteInt(op->rowptr[k], fp);
+  for (k = 0; k < op->ntrg; k++) fwriteFloat(op->rowdiv[k], fp);
+  for (k = 0; k < op->nnz; k++) fwriteInt(op->col[k], fp);
+  for (k = 0; k < op->nnz; k++) fwriteFloat(op->div[k], fp);
+  err = ferror(fp);
+  if (fclose(fp) != 0) err = 1;
+  if (err || rename(tmpname.c_str(), fname) != 0) {
+    printf("ERROR: MRISregOpWrite(): could not write %s\n", fname);
+    unlink(tmpname.c_str());
+    return (1);
+  }
+  return (0);
+}
+
+/*!
+\fn MRIS_REG_OP *MRISregOpRead(const char *fname)
+\brief Reads an operator saved with MRISregOpWrite(). Returns NULL
+(quietly if the file does not exist) if it cannot be read.
+*/
+MRIS_REG_OP *MRISregOpRead(const char *fname)
+{
+  FILE *fp = fopen(fname, "rb");
+  MRIS_REG_OP *op;
+  int k, sighi, siglo;
+
+  if (fp == NULL) return (NULL);
+  if (freadInt(fp) != MRIS_REG_OP_MAGIC) {
+    printf("ERROR: MRISregOpRead(): %s is not a registration operator file\n", fname);
+    fclose(fp);
+    return (NULL);
+  }
+  if ((k = freadInt(fp)) != MRIS_REG_OP_VERSION) {
+    printf("MRISregOpRead(): %s is version %d, not %d, ignoring it\n", fname, k, MRIS_REG_OP_VERSION);
+    fclose(fp);
+    return (NULL);
+  }
+  op = (MRIS_REG_OP *)calloc(1, sizeof(MRIS_REG_OP));
+  op->nsrc = freadInt(fp);
+  op->ntrg = freadInt(fp);
+  op->ReverseMapFlag = freadInt(fp);
+  op->DoJac = freadInt(fp);
+  op->UseHash = freadInt(fp);
+  op->nnz = freadInt(fp);
+  sighi = freadInt(fp);
+  siglo = freadInt(fp);
+  op->signature = ((unsigned long long)(unsigned int)sighi << 32) | (unsigned int)siglo;
+  if (op->nsrc <= 0 || op->ntrg <= 0 || op->nnz < 0) {
+    printf("ERROR: MRISregOpRead(): %s has a bad header\n", fname);
+    fclose(fp);
+    MRISregOpFree(&op);
+    return (NULL);
+  }
+  op->rowptr = (int *)malloc((op->ntrg + 1) * sizeof(int));
+  op->rowdiv = (float *)malloc(op->ntrg * sizeof(float));
+  op->col = (int *)malloc(MAX(op->nnz, 1) * sizeof(int));
+  op->div = (float *)malloc(MAX(op->nnz, 1) * sizeof(float));
+  if (!op->rowptr || !op->rowdiv || !op->col || !op->div) {
+    printf("ERROR: MRISregOpRead(): could not alloc operator with %d entries\n", op->nnz);
+    fclose(fp);
+    MRISregOpFree(&op);
+    return (NULL);
+  }
+  size_t nread = freadIntArray(op->rowptr, op->ntrg + 1, fp);
+  nread += freadFloatArray(op->rowdiv, op->ntrg, fp);
+  nread += freadIntArray(op->col, op->nnz, fp);
+  nread += freadFloatArray(op->div, op->nnz, fp);
+  fclose(fp);
+
+  /* make sure the operator cannot index outside the surfaces */
+  int bad = (nread != 2 * (size_t)op->ntrg + 1 + 2 * (size_t)op->nnz);
+  bad = bad || op->rowptr[0] != 0 || op->rowptr[op->ntrg] != op->nnz;
+  for (k = 0; k < op->ntrg && !bad; k++) bad = op->rowptr[k + 1] < op->rowptr[k];
+  for (k = 0; k < op->nnz && !bad; k++) bad = op->col[k] < 0 || op->col[k] >= op->nsrc;
+  if (bad) {
+    printf("ERROR: MRISregOpRead(): %s is truncated or corrupt\n", fname);
+    MRISregOpFree(&op);
+    return (NULL);
+  }
+  return (op);
+}
+
+/*!
+\fn void MRISregOpFree(MRIS_REG_OP **pop)
+*/
+void MRISregOpFree(MRIS_REG_OP **pop)
+{
+  MRIS_REG_OP *op = *pop;
+  if (op == NULL) return;
+  free(op->rowptr);
+  free(op->rowdiv);
+  free(op->col);
+  free(op->div);
+  free(op);
+  *pop = NULL;
+}
+
 /*----------------------------------------------------------------
   MRI *surf2surf_nnfr() - NOTE: use MRISapplyReg instead!
 
@@ -26,10 +26,15 @@ static const int debug = 0;
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>
 
+static void romp_profile_init();
+
 static void __attribute__((constructor)) before_main() 
 {
+    romp_profile_init();
     int n = omp_get_max_threads();
     if (n <= _MAX_FS_THREADS) return;
     omp_set_num_threads(_MAX_FS_THREADS);
@@ -456,6 +461,198 @@ void ROMP_show_stats(FILE* file)
 }
 
 
+// Runtime profiling - see romp_support.h
+//
+int ROMP_profiling;
+
+static const char*        profileFileName;
+static long               profileStartNs;
+static ROMP_profile_site* profileSites;
+
+static long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int threadNum() {
+#ifdef HAVE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+void ROMP_profile_begin_slow(ROMP_profile_frame* frame)
+{
+    int nthreads = omp_get_max_threads();
+    if (nthreads < 1) nthreads = 1;
+    frame->threads  = (ROMP_profile_thread*)calloc(nthreads, sizeof(ROMP_profile_thread));
+    frame->nthreads = nthreads;
+    frame->beginNs  = monotonicNs();
+}
+
+void ROMP_profile_pflb_begin(ROMP_profile_frame* frame)
+{
+    int tid = threadNum();
+    if (tid >= frame->nthreads) return;
+    frame->threads[tid].beginNs = monotonicNs();
+}
+
+void ROMP_profile_pflb_end(ROMP_profile_frame* frame)
+{
+    int tid = threadNum();
+    if (tid >= frame->nthreads) return;
+    ROMP_profile_thread* thread = &frame->threads[tid];
+    if (!thread->beginNs) return;       // already ended by a ROMP_PFLB_continue
+    thread->busyNs += monotonicNs() - thread->beginNs;
+    thread->beginNs = 0;
+}
+
+void ROMP_profile_end_slow(ROMP_profile_site* site, ROMP_profile_frame* frame)
+{
+    long const wallNs = monotonicNs() - frame->beginNs;
+
+    long busyNs = 0, maxBusyNs = 0;
+    int  used = 0;
+    int  tid;
+    for (tid = 0; tid < frame->nthreads; tid++) {
+        long const b = frame->threads[tid].busyNs;
+        if (!b) continue;
+        used++;
+        busyNs += b;
+        if (maxBusyNs < b) maxBusyNs = b;
+    }
+    free(frame->threads);
+    frame->threads = NULL;
+
+#ifdef HAVE_OPENMP
+    #pragma omp critical(ROMP_profile)
+#endif
+    {
+        if (!site->registered) {
+            site->registered = 1;
+            site->next   = profileSites;
+            profileSites = site;
+        }
+        site->calls++;
+        if (used > 1) site->parallelCalls++;
+        site->wallNs += wallNs;
+        if (site->maxWallNs < wallNs) site->maxWallNs = wallNs;
+        site->busyNs += busyNs;
+        if (used) site->imbalanceNs += maxBusyNs - busyNs / used;
+        if (site->maxThreads < used) site->maxThreads = used;
+    }
+}
+
+static int compareSites(const void* lhs, const void* rhs)
+{
+    ROMP_profile_site const* l = *(ROMP_profile_site* const*)lhs;
+    ROMP_profile_site const* r = *(ROMP_profile_site* const*)rhs;
+    int c = strcmp(l->file, r->file);
+    if (c) return c;
+    if (l->line != r->line) return (l->line < r->line) ? -1 : 1;
+    return strcmp(l->func, r->func);
+}
+
+static void writeJsonString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', file);
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+// Written sorted by file and line, so the profiles of two builds can be diffed
+//
+static void rompProfileExitHandler(void)
+{
+    ROMP_profiling = 0;
+
+    int nsites = 0;
+    ROMP_profile_site* site;
+    for (site = profileSites; site; site = site->next) nsites++;
+    ROMP_profile_site** sites = (ROMP_profile_site**)calloc(nsites + 1, sizeof(ROMP_profile_site*));
+    nsites = 0;
+    for (site = profileSites; site; site = site->next) sites[nsites++] = site;
+    qsort(sites, nsites, sizeof(ROMP_profile_site*), compareSites);
+
+    FILE* file = fopen(profileFileName, "w");
+    if (!file) {
+        fprintf(stderr, "ROMP profile: could not create %s\n", profileFileName);
+        free(sites);
+        return;
+    }
+
+    const char* program = getMainFile();
+    if (!program) program = "";
+    double const elapsedMs = (monotonicNs() - profileStartNs) / 1e6;
+    size_t const len = strlen(profileFileName);
+    int i;
+
+    if (len >= 4 && !strcmp(profileFileName + len - 4, ".csv")) {
+        fprintf(file, "program,file,func,line,calls,parallel_calls,wall_ms,max_wall_ms,busy_ms,imbalance_ms,max_threads\n");
+        fprintf(file, "%s,,,0,1,0,%.3f,%.3f,0,0,%d\n", program, elapsedMs, elapsedMs, omp_get_max_threads());
+        for (i = 0; i < nsites; i++) {
+            site = sites[i];
+            fprintf(file, "%s,%s,%s,%u,%ld,%ld,%.3f,%.3f,%.3f,%.3f,%d\n",
+                program, site->file, site->func, site->line,
+                site->calls, site->parallelCalls,
+                site->wallNs / 1e6, site->maxWallNs / 1e6, site->busyNs / 1e6, site->imbalanceNs / 1e6,
+                site->maxThreads);
+        }
+    } else {
+        fprintf(file, "{\n  \"program\": ");
+        writeJsonString(file, program);
+        fprintf(file, ",\n  \"date\": ");
+        writeJsonString(file, currentDateTime(false).c_str());
+        fprintf(file, ",\n  \"max_threads\": %d,\n  \"elapsed_ms\": %.3f,\n  \"loops\": [", omp_get_max_threads(), elapsedMs);
+        for (i = 0; i < nsites; i++) {
+            site = sites[i];
+            fprintf(file, "%s\n    {\"file\": ", i ? "," : "");
+            writeJsonString(file, site->file);
+            fprintf(file, ", \"func\": ");
+            writeJsonString(file, site->func);
+            fprintf(file, ", \"line\": %u, \"calls\": %ld, \"parallel_calls\": %ld, "
+                "\"wall_ms\": %.3f, \"max_wall_ms\": %.3f, \"busy_ms\": %.3f, \"imbalance_ms\": %.3f, \"max_threads\": %d}",
+                site->line, site->calls, site->parallelCalls,
+                site->wallNs / 1e6, site->maxWallNs / 1e6, site->busyNs / 1e6, site->imbalanceNs / 1e6,
+                site->maxThreads);
+        }
+        fprintf(file, "\n  ]\n}\n");
+    }
+
+    fclose(file);
+    free(sites);
+}
+
+static void romp_profile_init()
+{
+    const char* name = getenv("FS_ROMP_PROFILE");
+    if (!name || !*name) return;
+
+    // replace %p with the pid, so a pipeline of programs can share the setting
+    static char expanded[4096];
+    size_t n = 0;
+    for (; *name && n + 32 < sizeof(expanded); name++) {
+        if (name[0] == '%' && name[1] == 'p') {
+            n += snprintf(expanded + n, sizeof(expanded) - n, "%d", (int)getpid());
+            name++;
+        } else {
+            expanded[n++] = *name;
+        }
+    }
+    expanded[n] = 0;
+
+    profileFileName = expanded;
+    profileStartNs  = monotonicNs();
+    ROMP_profiling  = 1;
+    atexit(rompProfileExitHandler);
+}
+
+
 void ROMP_Distributor_begin(ROMP_Distributor* distributor,
     int lo, int hi, 
     double* sumReducedDouble0, 
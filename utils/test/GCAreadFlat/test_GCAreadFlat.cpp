@@ -0,0 +1,234 @@
+//
+// test for the flat (.gcf) GCA format
+// - located in utils/gca.cpp
+//
+// Builds a small synthetic atlas with random classifiers, gibbs tables and
+// priors, writes it with GCAwrite as .gca and .gcf, reads both back and
+// checks that every node and prior matches the original. Then checks that
+//  - truncated files and files whose offsets point past the end are rejected
+//  - loading more flat atlases than the block registry holds fails cleanly
+//    and loading works again once one of them is freed
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "gca.h"
+
+const char *Progname = "test_GCAreadFlat";
+
+#define NINPUTS 2
+#define MAX_FLAT 64
+
+static GCA *makeGCA()
+{
+  GCA *gca = GCAalloc(NINPUTS, 2.0, 4.0, 32, 24, 28, 0);
+  int ncovars = (NINPUTS * (NINPUTS + 1)) / 2, max_label = 0;
+
+  for (int x = 0; x < gca->node_width; x++)
+    for (int y = 0; y < gca->node_height; y++)
+      for (int z = 0; z < gca->node_depth; z++) {
+        GCA_NODE *gcan = &gca->nodes[x][y][z];
+        gcan->nlabels = nint(randomNumber(0, gcan->max_labels));
+        gcan->total_training = nint(randomNumber(0, 100));
+        for (int n = 0; n < gcan->nlabels; n++) {
+          GC1D *gc = &gcan->gcs[n];
+          gcan->labels[n] = 2 * n + nint(randomNumber(0, 1));
+          max_label = MAX(max_label, gcan->labels[n]);
+          for (int r = 0; r < NINPUTS; r++) gc->means[r] = randomNumber(0, 200);
+          for (int i = 0; i < ncovars; i++) gc->covars[i] = randomNumber(1, 50);
+          for (int i = 0; i < GIBBS_NEIGHBORS; i++) {
+            gc->nlabels[i] = nint(randomNumber(0, 3));
+            gc->labels[i] = (unsigned short *)calloc(gc->nlabels[i] + 1, sizeof(unsigned short));
+            gc->label_priors[i] = (float *)calloc(gc->nlabels[i] + 1, sizeof(float));
+            for (int j = 0; j < gc->nlabels[i]; j++) {
+              gc->labels[i][j] = 10 + j;
+              max_label = MAX(max_label, gc->labels[i][j]);
+              gc->label_priors[i][j] = randomNumber(0, 1);
+            }
+          }
+        }
+      }
+  for (int x = 0; x < gca->prior_width; x++)
+    for (int y = 0; y < gca->prior_height; y++)
+      for (int z = 0; z < gca->prior_depth; z++) {
+        GCA_PRIOR *gcap = &gca->priors[x][y][z];
+        gcap->nlabels = nint(randomNumber(0, gcap->max_labels));
+        gcap->total_training = nint(randomNumber(0, 100));
+        for (int n = 0; n < gcap->nlabels; n++) {
+          gcap->labels[n] = 3 * n + 1;
+          max_label = MAX(max_label, gcap->labels[n]);
+          gcap->priors[n] = randomNumber(0, 1);
+        }
+      }
+  gca->max_label = max_label;
+  return gca;
+}
+
+// number of nodes and priors of b that differ from a
+static int compareGCA(GCA *a, GCA *b)
+{
+  int ndiff = 0, ncovars = (NINPUTS * (NINPUTS + 1)) / 2;
+
+  if (a->node_width != b->node_width || a->node_height != b->node_height || a->node_depth != b->node_depth ||
+      a->prior_width != b->prior_width || a->prior_height != b->prior_height || a->prior_depth != b->prior_depth ||
+      a->ninputs != b->ninputs || a->flags != b->flags) {
+    std::cout << "  geometry differs\n";
+    return 1;
+  }
+  for (int x = 0; x < a->node_width; x++)
+    for (int y = 0; y < a->node_height; y++)
+      for (int z = 0; z < a->node_depth; z++) {
+        GCA_NODE *na = &a->nodes[x][y][z], *nb = &b->nodes[x][y][z];
+        int same = na->nlabels == nb->nlabels && na->total_training == nb->total_training;
+        for (int n = 0; same && n < na->nlabels; n++) {
+          GC1D *ga = &na->gcs[n], *gb = &nb->gcs[n];
+          same = na->labels[n] == nb->labels[n];
+          for (int r = 0; same && r < NINPUTS; r++) same = ga->means[r] == gb->means[r];
+          for (int i = 0; same && i < ncovars; i++) same = ga->covars[i] == gb->covars[i];
+          for (int i = 0; same && i < GIBBS_NEIGHBORS; i++) {
+            same = ga->nlabels[i] == gb->nlabels[i];
+            for (int j = 0; same && j < ga->nlabels[i]; j++)
+              same = ga->labels[i][j] == gb->labels[i][j] && ga->label_priors[i][j] == gb->label_priors[i][j];
+          }
+        }
+        if (!same) ndiff++;
+      }
+  for (int x = 0; x < a->prior_width; x++)
+    for (int y = 0; y < a->prior_height; y++)
+      for (int z = 0; z < a->prior_depth; z++) {
+        GCA_PRIOR *pa = &a->priors[x][y][z], *pb = &b->priors[x][y][z];
+        int same = pa->nlabels == pb->nlabels && pa->total_training == pb->total_training;
+        for (int n = 0; same && n < pa->nlabels; n++)
+          same = pa->labels[n] == pb->labels[n] && pa->priors[n] == pb->priors[n];
+        if (!same) ndiff++;
+      }
+  if (ndiff) std::cout << "  " << ndiff << " nodes/priors differ\n";
+  return ndiff;
+}
+
+static int check(const char *name, int ndiff)
+{
+  std::cout << name << ": " << (ndiff ? "FAILED" : "ok") << "\n";
+  return ndiff ? 1 : 0;
+}
+
+// copies the first nbytes of src to dst, then overwrites the 8 bytes at
+// offset (if >= 0) with val
+static void copyFile(const char *src, const char *dst, long nbytes, long offset, long long val)
+{
+  FILE *in = fopen(src, "rb"), *out = fopen(dst, "wb");
+  if (!in || !out) ErrorExit(ERROR_NOFILE, "%s: could not copy %s to %s", Progname, src, dst);
+  for (long n = 0; nbytes < 0 || n < nbytes; n++) {
+    int c = fgetc(in);
+    if (c == EOF) break;
+    fputc(c, out);
+  }
+  if (offset >= 0) {
+    fseek(out, offset, SEEK_SET);
+    fwrite(&val, sizeof(val), 1, out);
+  }
+  fclose(in);
+  fclose(out);
+}
+
+int main(int argc, char *argv[])
+{
+  setRandomSeed(23);
+
+  char gca_name[STRLEN], gcf_name[STRLEN], bad_name[STRLEN];
+  const char *tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  sprintf(gca_name, "%s/test_GCAreadFlat.%d.gca", tmpdir, (int)getpid());
+  sprintf(gcf_name, "%s/test_GCAreadFlat.%d.gcf", tmpdir, (int)getpid());
+  sprintf(bad_name, "%s/test_GCAreadFlat.%d.bad.gcf", tmpdir, (int)getpid());
+
+  int nfailed = 0;
+  GCA *gca = makeGCA();
+
+  // round trip through both formats
+  if (GCAwrite(gca, gca_name) != NO_ERROR || GCAwrite(gca, gcf_name) != NO_ERROR)
+    ErrorExit(ERROR_BADFILE, "%s: could not write the atlas", Progname);
+  GCA *gca_read = GCAread(gca_name);
+  GCA *gcf_read = GCAreadFlat(gcf_name);
+  GCA *gcf_auto = GCAread(gcf_name);
+  nfailed += check(".gca round trip", gca_read ? compareGCA(gca, gca_read) : 1);
+  nfailed += check(".gcf round trip", gcf_read ? compareGCA(gca, gcf_read) : 1);
+  nfailed += check(".gcf through GCAread", gcf_auto ? compareGCA(gca, gcf_auto) : 1);
+  if (gca_read) GCAfree(&gca_read);
+  if (gcf_auto) GCAfree(&gcf_auto);
+
+  // the flat atlas can be written out again
+  if (gcf_read) {
+    GCAwrite(gcf_read, gca_name);
+    GCAfree(&gcf_read);
+    gca_read = GCAread(gca_name);
+    nfailed += check(".gcf -> .gca round trip", gca_read ? compareGCA(gca, gca_read) : 1);
+    if (gca_read) GCAfree(&gca_read);
+  }
+
+  // truncated and corrupt files are rejected
+  {
+    FILE *fp = fopen(gcf_name, "rb");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    long long tags_offset = 0;  // last word of the header
+    fseek(fp, 64 + 20 * 8, SEEK_SET);
+    if (fread(&tags_offset, sizeof(tags_offset), 1, fp) != 1) tags_offset = size;
+    fclose(fp);
+
+    int ndiff = 0;
+    long cuts[] = {16, 200, size / 2, (long)tags_offset - 1};
+    for (unsigned int k = 0; k < sizeof(cuts) / sizeof(cuts[0]); k++) {
+      copyFile(gcf_name, bad_name, cuts[k], -1, 0);
+      GCA *bad = GCAreadFlat(bad_name);
+      if (bad) {
+        std::cout << "  truncated to " << cuts[k] << " bytes was accepted\n";
+        GCAfree(&bad);
+        ndiff++;
+      }
+    }
+    // every 8-byte count and offset of the header (after the 64 bytes of
+    // magic, version, spacings and dimensions) pointed past the end
+    for (long offset = 64; offset < 64 + 21 * 8; offset += 8) {
+      copyFile(gcf_name, bad_name, -1, offset, (long long)size * 4);
+      GCA *bad = GCAreadFlat(bad_name);
+      if (bad) {
+        std::cout << "  header word at " << offset << " past the end was accepted\n";
+        GCAfree(&bad);
+        ndiff++;
+      }
+    }
+    nfailed += check("truncated and corrupt files", ndiff);
+  }
+
+  // registry overflow fails cleanly and recovers
+  {
+    GCA *flat[MAX_FLAT];
+    int nloaded = 0;
+    while (nloaded < MAX_FLAT && (flat[nloaded] = GCAreadFlat(gcf_name)) != NULL) nloaded++;
+    int ndiff = (nloaded == 0 || nloaded == MAX_FLAT);
+    if (nloaded > 0) {
+      GCAfree(&flat[--nloaded]);
+      GCA *again = GCAreadFlat(gcf_name);
+      ndiff += again ? compareGCA(gca, again) : 1;
+      if (again) GCAfree(&again);
+    }
+    std::cout << "  " << nloaded + 1 << " flat atlases loaded at once\n";
+    while (nloaded > 0) GCAfree(&flat[--nloaded]);
+    nfailed += check("registry overflow", ndiff);
+  }
+
+  GCAfree(&gca);
+  unlink(gca_name);
+  unlink(gcf_name);
+  unlink(bad_name);
+
+  if (nfailed) exit(1);
+  std::cout << "flat atlases agree\n";
+  exit(0);
+}
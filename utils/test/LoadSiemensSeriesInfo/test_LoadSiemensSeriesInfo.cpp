@@ -0,0 +1,276 @@
+//
+// unit test for LoadSiemensSeriesInfo
+// - located in utils/DICOMRead.cpp
+//
+// Writes a small Siemens series (plus the files of a second series and a file
+// that is not DICOM at all) to a scratch directory, scans the directory for
+// the series, and loads the header info of every file in the series the way
+// LoadSiemensSeriesInfo used to (one IsSiemensDICOM and GetSDCMFileInfo call
+// after the other). The parallel single-parse version on one thread and on
+// several threads, and the runs with FS_SDCM_INDEX set (the first one writes
+// the index, the second one reads it), must all give the same info. The ASCII
+// header values are also checked against SiemensAsciiTagEx, which runs the
+// unix strings command.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "fio.h"
+#include "mri.h"
+#include "DICOMRead.h"
+
+const char *Progname = "test_LoadSiemensSeriesInfo";
+
+#define SERIES_NO 5
+#define NSLICES 12
+#define NOTHER 3
+#define NROWS 64
+#define NCOLS 56
+#define NTHREADS 4
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+static void addString(DCM_OBJECT **object, int group, int element, DCM_VALUEREPRESENTATION vr, std::string value)
+{
+  DCM_ELEMENT e;
+  if (value.size() % 2) value += (vr == DCM_UI) ? '\0' : ' ';
+  memset(&e, 0, sizeof(e));
+  e.tag = DCM_MAKETAG(group, element);
+  e.representation = vr;
+  e.multiplicity = 1;
+  e.length = value.size();
+  e.d.string = (char *)value.c_str();
+  if (DCM_AddElement(object, &e) != DCM_NORMAL)
+    ErrorExit(ERROR_BADPARM, "%s: could not add element (0x%x,0x%x)", Progname, group, element);
+}
+
+static void addUS(DCM_OBJECT **object, int group, int element, unsigned short value)
+{
+  DCM_ELEMENT e;
+  memset(&e, 0, sizeof(e));
+  e.tag = DCM_MAKETAG(group, element);
+  e.representation = DCM_US;
+  e.multiplicity = 1;
+  e.length = sizeof(value);
+  e.d.us = &value;
+  if (DCM_AddElement(object, &e) != DCM_NORMAL)
+    ErrorExit(ERROR_BADPARM, "%s: could not add element (0x%x,0x%x)", Progname, group, element);
+}
+
+// one slice of an axial series, with the ASCII header Siemens puts in the
+// private CSA series header
+static void writeSiemensFile(const char *fname, int SeriesNo, int ImageNo, int nslices)
+{
+  DCM_OBJECT *object = NULL;
+  char tmpstr[1000];
+
+  if (DCM_CreateObject(&object, 0) != DCM_NORMAL) ErrorExit(ERROR_NOMEMORY, "%s: DCM_CreateObject failed", Progname);
+  addString(&object, 0x2, 0x10, DCM_UI, "1.2.840.10008.1.2");
+  addString(&object, 0x8, 0x20, DCM_DA, "20190304");
+  addString(&object, 0x8, 0x30, DCM_TM, "101112.000000");
+  addString(&object, 0x8, 0x70, DCM_LO, "SIEMENS");
+  addString(&object, 0x8, 0x1090, DCM_LO, "Prisma");
+  addString(&object, 0x10, 0x10, DCM_PN, "test^subject");
+  addString(&object, 0x18, 0x24, DCM_SH, "*tfl3d1_16ns");
+  addString(&object, 0x18, 0x50, DCM_DS, "1.2");
+  addString(&object, 0x18, 0x80, DCM_DS, "2300");
+  addString(&object, 0x18, 0x81, DCM_DS, "2.96");
+  addString(&object, 0x18, 0x82, DCM_DS, "900");
+  addString(&object, 0x18, 0x86, DCM_IS, "1");
+  addString(&object, 0x18, 0x87, DCM_DS, "3");
+  addString(&object, 0x18, 0x1020, DCM_LO, "syngo MR E11");
+  addString(&object, 0x18, 0x1030, DCM_LO, "T1_MPRAGE");
+  addString(&object, 0x18, 0x1312, DCM_CS, "ROW");
+  addString(&object, 0x18, 0x1314, DCM_DS, "9");
+  sprintf(tmpstr, "%d", SeriesNo);
+  addString(&object, 0x20, 0x11, DCM_IS, tmpstr);
+  sprintf(tmpstr, "%d", ImageNo);
+  addString(&object, 0x20, 0x13, DCM_IS, tmpstr);
+  sprintf(tmpstr, "-100\\-120\\%g", -30 + 1.2 * (ImageNo - 1));
+  addString(&object, 0x20, 0x32, DCM_DS, tmpstr);
+  addString(&object, 0x20, 0x37, DCM_DS, "1\\0\\0\\0\\1\\0");
+  addUS(&object, 0x28, 0x10, NROWS);
+  addUS(&object, 0x28, 0x11, NCOLS);
+  addString(&object, 0x28, 0x30, DCM_DS, "4\\4");
+  addString(&object, 0x28, 0x1052, DCM_DS, "0");
+  addString(&object, 0x28, 0x1053, DCM_DS, "1");
+
+  sprintf(tmpstr,
+          "### ASCCONV BEGIN ###\n"
+          "lRepetitions = 0\n"
+          "sSliceArray.lSize = %d\n"
+          "sSliceArray.asSlice[0].dPhaseFOV = 224\n"
+          "sSliceArray.asSlice[0].dReadoutFOV = 256\n"
+          "sSliceArray.asSlice[0].sNormal.dTra = 1\n"
+          "### ASCCONV END ###\n",
+          nslices);
+  addString(&object, 0x29, 0x1020, DCM_OB, tmpstr);
+
+  if (DCM_WriteFile(&object, DCM_ORDERLITTLEENDIAN, fname) != DCM_NORMAL)
+    ErrorExit(ERROR_BADFILE, "%s: could not write %s", Progname, fname);
+  DCM_CloseObject(&object);
+  COND_PopCondition(1);
+}
+
+// everything that DumpSDCMFileInfo prints, which is what sorting and
+// unpacking use
+static std::string dumpInfo(SDCMFILEINFO *sdfi)
+{
+  char *buf = NULL;
+  size_t len = 0;
+  FILE *fp = open_memstream(&buf, &len);
+  DumpSDCMFileInfo(fp, sdfi);
+  fclose(fp);
+  std::string s(buf, len);
+  free(buf);
+  return s;
+}
+
+// what LoadSiemensSeriesInfo did before, each file parsed once per field
+static std::vector<std::string> referenceInfo(char **SeriesList, int nList)
+{
+  std::vector<std::string> info;
+  for (int n = 0; n < nList; n++) {
+    if (!IsSiemensDICOM(SeriesList[n])) ErrorExit(ERROR_BADFILE, "%s is not a Siemens DICOM File", SeriesList[n]);
+    SDCMFILEINFO *sdfi = GetSDCMFileInfo(SeriesList[n]);
+    if (!sdfi) ErrorExit(ERROR_BADFILE, "could not read %s", SeriesList[n]);
+    info.push_back(dumpInfo(sdfi));
+    FreeSDCMFileInfo(&sdfi);
+  }
+  return info;
+}
+
+static int countDifferences(const std::vector<std::string> &ref, SDCMFILEINFO **sdfi_list, int nList)
+{
+  if (!sdfi_list) return nList;
+  int ndiff = 0;
+  for (int n = 0; n < nList; n++) {
+    if (dumpInfo(sdfi_list[n]) != ref[n]) ndiff++;
+    FreeSDCMFileInfo(&sdfi_list[n]);
+  }
+  free(sdfi_list);
+  return ndiff;
+}
+
+// the in-process ASCII header against the one read through strings
+static int countAsciiDifferences(char **SeriesList, int nList)
+{
+  const char *tags[] = {"lRepetitions", "sSliceArray.lSize", "sSliceArray.asSlice[0].dPhaseFOV",
+                        "sSliceArray.asSlice[0].dReadoutFOV", "sSliceArray.asSlice[0].sNormal.dSag",
+                        "sSliceArray.asSlice[0].sNormal.dCor", "sSliceArray.asSlice[0].sNormal.dTra"};
+  int ndiff = 0;
+  for (int n = 0; n < nList; n++) {
+    SDCMFILEINFO *sdfi = GetSDCMFileInfo(SeriesList[n]);
+    float Vs[3] = {0, 0, 0};
+    int SliceArraylSize = 0, lRepetitions = sdfi->lRepetitions;
+    float PhEncFOV = 0, ReadoutFOV = 0;
+    for (unsigned int t = 0; t < sizeof(tags) / sizeof(tags[0]); t++) {
+      char *value = SiemensAsciiTagEx(SeriesList[n], tags[t], 0);
+      if (value == NULL) continue;
+      if (t == 0) sscanf(value, "%d", &lRepetitions);
+      if (t == 1) sscanf(value, "%d", &SliceArraylSize);
+      if (t == 2) sscanf(value, "%f", &PhEncFOV);
+      if (t == 3) sscanf(value, "%f", &ReadoutFOV);
+      if (t >= 4) sscanf(value, "%f", &Vs[t - 4]);
+      free(value);
+    }
+    SiemensAsciiTagEx(SeriesList[n], (char *)0, 1);
+    bool same = lRepetitions == sdfi->lRepetitions && SliceArraylSize == sdfi->SliceArraylSize &&
+                PhEncFOV == sdfi->PhEncFOV && ReadoutFOV == sdfi->ReadoutFOV;
+    if (Vs[0] != 0 || Vs[1] != 0 || Vs[2] != 0) {
+      float rms = sqrt(Vs[0] * Vs[0] + Vs[1] * Vs[1] + Vs[2] * Vs[2]);
+      same = same && -Vs[0] / rms == sdfi->Vs[0] && -Vs[1] / rms == sdfi->Vs[1] && Vs[2] / rms == sdfi->Vs[2];
+    }
+    if (!same) ndiff++;
+    FreeSDCMFileInfo(&sdfi);
+  }
+  return ndiff;
+}
+
+int main(int argc, char *argv[])
+{
+  char dir[1000], fname[1000];
+  const char *tmpdir = getenv("TMPDIR");
+  std::vector<std::string> written;
+
+  if (tmpdir == NULL) tmpdir = "/tmp";
+  sprintf(dir, "%s/%s.%d", tmpdir, Progname, (int)getpid());
+  if (mkdir(dir, 0700)) ErrorExit(ERROR_BADFILE, "%s: could not create %s", Progname, dir);
+
+  // the files are named out of order so that the series has to be sorted
+  for (int n = 0; n < NSLICES; n++) {
+    sprintf(fname, "%s/MR.%d.%03d.dcm", dir, SERIES_NO, (7 * n) % NSLICES);
+    writeSiemensFile(fname, SERIES_NO, (7 * n) % NSLICES + 1, NSLICES);
+    written.push_back(fname);
+  }
+  for (int n = 0; n < NOTHER; n++) {
+    sprintf(fname, "%s/MR.%d.%03d.dcm", dir, SERIES_NO + 1, n);
+    writeSiemensFile(fname, SERIES_NO + 1, n + 1, NOTHER);
+    written.push_back(fname);
+  }
+  sprintf(fname, "%s/README", dir);
+  FILE *fp = fopen(fname, "w");
+  if (fp == NULL) ErrorExit(ERROR_BADFILE, "%s: could not write %s", Progname, fname);
+  fprintf(fp, "not a dicom file\n");
+  fclose(fp);
+  written.push_back(fname);
+
+  unsetenv("FS_SDCM_INDEX");
+  int nList;
+  char **SeriesList = ScanSiemensSeries(written[0].c_str(), &nList);
+  if (!SeriesList) ErrorExit(ERROR_BADFILE, "%s: could not scan the series of %s", Progname, written[0].c_str());
+  int nfailed = 0;
+  if (nList != NSLICES) {
+    std::cout << "FAILED: " << nList << " files in series, expected " << NSLICES << "\n";
+    nfailed++;
+  }
+
+  std::vector<std::string> ref = referenceInfo(SeriesList, nList);
+
+  int const ndiffAscii = countAsciiDifferences(SeriesList, nList);
+  std::cout << "ascii header     : " << ndiffAscii << " files differ from strings\n";
+  if (ndiffAscii) nfailed++;
+
+  const char *names[4] = {"single parse", "single parse", "index write ", "index read  "};
+  int const nthreads[4] = {1, NTHREADS, NTHREADS, NTHREADS};
+  std::string indexfile = std::string(dir) + "/.fs_sdcm_index";
+  for (int t = 0; t < 4; t++) {
+    setNumThreads(nthreads[t]);
+    if (t >= 2) setenv("FS_SDCM_INDEX", "1", 1);
+    SDCMFILEINFO **sdfi_list = LoadSiemensSeriesInfo(SeriesList, nList);
+    int const ndiff = countDifferences(ref, sdfi_list, nList);
+    std::cout << names[t] << " " << nthreads[t] << " th: " << ndiff << " files differ\n";
+    if (ndiff) nfailed++;
+    if (t == 2 && !fio_FileExistsReadable(indexfile.c_str())) {
+      std::cout << "FAILED: no index written to " << indexfile << "\n";
+      nfailed++;
+    }
+  }
+  unsetenv("FS_SDCM_INDEX");
+
+  for (int n = 0; n < nList; n++) free(SeriesList[n]);
+  free(SeriesList);
+
+  unlink(indexfile.c_str());
+  for (unsigned int n = 0; n < written.size(); n++) unlink(written[n].c_str());
+  rmdir(dir);
+
+  if (nfailed) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "info agrees\n";
+  exit(0);
+}
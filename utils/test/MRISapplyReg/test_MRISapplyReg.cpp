@@ -0,0 +1,410 @@
+//
+// unit test for MRISapplyRegOp and MRISregOpApply
+// - located in utils/resample.cpp, used by MRISapplyReg, mri_surf2surf and
+//   mris_apply_reg
+//
+// Resamples a random multi-frame input from a rotated ico4 sphere to an ico3
+// sphere with some vertices ripped, with a copy of MRISapplyReg as it was
+// before the resampling operator was split out, with MRISapplyReg, and by
+// building the operator, applying it, writing it out, reading it back and
+// applying it again.  This is done with and without the jacobian correction,
+// the reverse map and the hash tables, and all outputs must be bit identical
+// to the reference.  A saved operator must not match surfaces or flags other
+// than the ones it was built with, and an operator file of another version
+// must not be read.
+//
+
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "fio.h"
+#include "mri.h"
+#include "mrisurf.h"
+#include "mrishash.h"
+#include "icosahedron.h"
+#include "resample.h"
+
+const char *Progname = "test_MRISapplyReg";
+
+#define NFRAMES 7
+#define RADIUS 100.0
+
+// MRISapplyReg before the resampling operator (reference)
+static MRI *MRISapplyRegRef(MRI *SrcSurfVals, MRI_SURFACE **SurfReg, int nsurfs, int ReverseMapFlag, int DoJac, int UseHash)
+{
+  MRI *TrgSurfVals = NULL;
+  MRI_SURFACE *SrcSurfReg, *TrgSurfReg;
+  int svtx = 0, tvtx, tvtxN, svtxN = 0, f, n, nrevhits, nSrcLost;
+  int npairs, kS, kT, nhits;
+  // int nunmapped;
+  VERTEX *v;
+  float dmin;
+  MHT **Hash = NULL;
+  MRI *SrcHits, *TrgHits;
+
+  npairs = nsurfs / 2;
+  printf("MRISapplyReg(): nsurfs = %d, revmap=%d, jac=%d,  hash=%d\n", nsurfs, ReverseMapFlag, DoJac, UseHash);
+  printf("  Skipping ripped vertices\n");
+
+  SrcSurfReg = SurfReg[0];
+  TrgSurfReg = SurfReg[nsurfs - 1];
+
+  /* check dimension consistency */
+  if (SrcSurfVals->width != SrcSurfReg->nvertices) {
+    printf("MRISapplyReg: Vals and Reg dimension mismatch\n");
+    printf("nVals = %d, nReg %d\n", SrcSurfVals->width, SrcSurfReg->nvertices);
+    return (NULL);
+  }
+  for (n = 0; n < npairs - 1; n++) {
+    kS = 2 * n + 1;
+    kT = kS + 1;
+    if (SurfReg[kT]->nvertices != SurfReg[kS]->nvertices) {
+      printf("MRISapplyReg: Reg dimension mismatch %d, %d\n", kT, kS);
+      printf("targ = %d, next source = %d\n", SurfReg[kT]->nvertices, SurfReg[kS]->nvertices);
+      return (NULL);
+    }
+  }
+
+  /* allocate a "volume" to hold the output */
+  TrgSurfVals = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, SrcSurfVals->nframes);
+  if (TrgSurfVals == NULL) return (NULL);
+  MRIcopyHeader(SrcSurfVals, TrgSurfVals);
+
+  /* number of source vertices mapped to each target vertex */
+  TrgHits = MRIallocSequence(TrgSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
+  if (TrgHits == NULL) return (NULL);
+  MRIcopyHeader(SrcSurfVals, TrgHits);
+
+  /* number of target vertices mapped to by each source vertex */
+  SrcHits = MRIallocSequence(SrcSurfReg->nvertices, 1, 1, MRI_FLOAT, 1);
+  if (SrcHits == NULL) return (NULL);
+  MRIcopyHeader(SrcSurfVals, SrcHits);
+
+  if (UseHash) {
+    printf("MRISapplyReg: building hash tables (res=16).\n");
+    Hash = (MHT **)calloc(sizeof(MHT *), nsurfs);
+    for (n = 0; n < nsurfs; n++) {
+      Hash[n] = MHTcreateVertexTable_Resolution(SurfReg[n], CURRENT_VERTICES, 16);
+    }
+  }
+
+  if (DoJac) {
+    // If using jacobian correction, get a list of the number of times
+    // that a give source vertex gets sampled.
+    for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
+      // Compute the source vertex that corresponds to this target vertex
+      tvtxN = tvtx;
+      for (n = npairs - 1; n >= 0; n--) {
+        kS = 2 * n;
+        kT = kS + 1;
+        v = &(SurfReg[kT]->vertices[tvtxN]);
+        /* find closest source vertex */
+        if(UseHash) svtx = MHTfindClosestVertexNo2(Hash[kS], SurfReg[kS], SurfReg[kT], v, &dmin);
+	if(!UseHash || svtx < 0){
+	  if(svtx < 0) printf("Target vertex %d of pair %d unmapped in hash, using brute force\n", tvtxN, n);
+	  svtx = MRISfindClosestVertex(SurfReg[kS], v->x, v->y, v->z, &dmin, CURRENT_VERTICES);
+	}
+        tvtxN = svtx;
+      }
+      /* update the number of hits and distance */
+      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
+      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
+    }
+  }
+
+  /* Set up to create a text file with source-target vertex pairs (STVP) where the source
+     is the fist surface and the target is the last surface. The format will be
+         srcvtxno srcx srcy srcz trgvtxno trgx trgy trgz 
+     The actual coordinates will come from the TMP_VERTEX v->{tx,ty,tz}, 
+     so make sure those are set. This functionality is mostly for debugging purposes.  */
+  FILE *stvpairfp = NULL;
+  if(getenv("FS_MRISAPPLYREG_STVPAIR")){
+    std::string stvpairfile = getenv("FS_MRISAPPLYREG_STVPAIR");
+    if(stvpairfile.length() > 0){
+      stvpairfp = fopen(stvpairfile.c_str(),"w");
+      if(stvpairfp == NULL){
+	printf("ERROR: could not open stvpairfile %s\n",stvpairfile.c_str());
+      }
+    }
+  }
+
+  /* Go through the forwad loop (finding closest srcvtx to each trgvtx).
+  This maps each target vertex to a source vertex */
+  printf("MRISapplyReg: Forward Loop (%d)\n", TrgSurfReg->nvertices);
+  // nunmapped = 0;
+  for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
+    if(TrgSurfReg->vertices[tvtx].ripflag) continue;
+    if (!UseHash) {
+      if (tvtx % 100 == 0) {
+        printf("%5d ", tvtx);
+        fflush(stdout);
+      }
+      if (tvtx % 1000 == 999) {
+        printf("\n");
+        fflush(stdout);
+      }
+    }
+
+    // Compute the source vertex that corresponds to this target vertex
+    tvtxN = tvtx;
+    int skip = 0;
+    int bf = 0;
+    for (n = npairs - 1; n >= 0; n--) {
+      kS = 2 * n;
+      kT = kS + 1;
+      // printf("%5d %5d %d %d %d\n",tvtx,tvtxN,n,kS,kT);
+      v = &(SurfReg[kT]->vertices[tvtxN]);
+      if(v->ripflag){
+	skip = 1;
+	break;
+      }
+      /* find closest source vertex */
+      bf = 0;
+      if (UseHash) svtx = MHTfindClosestVertexNo2(Hash[kS], SurfReg[kS], SurfReg[kT], v, &dmin);
+      if (!UseHash || svtx < 0) {
+        if (svtx < 0) {
+	  printf("Target vertex %d (%g,%g,%g) of pair %d unmapped in hash, using brute force\n", 
+		 tvtxN, v->x, v->y, v->z, n);
+	  bf = 1;
+	}
+        svtx = MRISfindClosestVertex(SurfReg[kS], v->x, v->y, v->z, &dmin, CURRENT_VERTICES);
+	if(bf){
+	  VERTEX *vs = &(SurfReg[kS]->vertices[svtx]);
+	  printf("  Source vertex %d (%g,%g,%g) of pair %d mapped using brute force\n", 
+		 svtx, vs->x, vs->y, vs->z, n);
+	  fflush(stdout);
+	}
+      }
+      if(SurfReg[kS]->vertices[svtx].ripflag){
+	skip = 1;
+	break;
+      }
+      // DNG added these lines on Dec 9, 2020 (without checking it in), 
+      // but now can't remember why, so commented them out
+      //if(dmin > 2.0){
+      //skip = 1;
+      //break;
+      //}
+      tvtxN = svtx;
+    }
+    if(skip) continue;
+
+    if(!bf && stvpairfp){
+      // Good for debugging
+      v = &(SurfReg[0]->vertices[svtx]);
+      fprintf(stvpairfp,"%d %8.4f %8.4f %8.4f    ",svtx,v->tx, v->ty, v->tz);
+      v = &(SurfReg[nsurfs-1]->vertices[tvtx]);
+      fprintf(stvpairfp,"%d %8.4f %8.4f %8.4f\n",tvtx,v->tx, v->ty, v->tz);
+    }
+
+    if (!DoJac) {
+      /* update the number of hits */
+      MRIFseq_vox(SrcHits, svtx, 0, 0, 0)++;
+      MRIFseq_vox(TrgHits, tvtx, 0, 0, 0)++;
+      nhits = 1;
+    }
+    else
+      nhits = MRIgetVoxVal(SrcHits, svtx, 0, 0, 0);
+
+    /* accumulate mapped values for each frame */
+    for (f = 0; f < SrcSurfVals->nframes; f++)
+      MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += (MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f) / nhits);
+  }
+  if(stvpairfp) fclose(stvpairfp);
+
+  /*---------------------------------------------------------------
+  Go through the reverse loop (finding closest trgvtx to each srcvtx
+  unmapped by the forward loop). This assures that each source vertex
+  is represented in the map */
+  if (ReverseMapFlag) {
+    printf("MRISapplyReg: Reverse Loop (%d)\n", SrcSurfReg->nvertices);
+    nrevhits = 0;
+    for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
+      if (MRIFseq_vox((SrcHits), svtx, 0, 0, 0) != 0) continue;
+      nrevhits++;
+
+      // Compute the target vertex that corresponds to this source vertex
+      svtxN = svtx;
+      for (n = 0; n < npairs; n++) {
+        kS = 2 * n;
+        kT = kS + 1;
+        // printf("%5d %5d %d %d %d\n",svtx,svtxN,n,kS,kT);
+        v = &(SurfReg[kS]->vertices[svtxN]);
+        /* find closest target vertex */
+        if (UseHash) tvtx = MHTfindClosestVertexNo2(Hash[kT], SurfReg[kT], SurfReg[kS], v, &dmin);
+        if (!UseHash || tvtx < 0) {
+          if (tvtx < 0) printf("Source vertex %d of pair %d unmapped in hash, using brute force\n", svtxN, n);
+          tvtx = MRISfindClosestVertex(SurfReg[kT], v->x, v->y, v->z, &dmin, CURRENT_VERTICES);
+        }
+        svtxN = tvtx;
+      }
+
+      /* update the number of hits */
+      MRIFseq_vox((SrcHits), svtx, 0, 0, 0)++;
+      MRIFseq_vox((TrgHits), tvtx, 0, 0, 0)++;
+      /* accumulate mapped values for each frame */
+      for (f = 0; f < SrcSurfVals->nframes; f++)
+        MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) += MRIFseq_vox(SrcSurfVals, svtx, 0, 0, f);
+    }
+    printf("  Reverse Loop had %d hits\n", nrevhits);
+  }
+
+  /*---------------------------------------------------------------
+  Finally, divide the value at each target vertex by the number
+  of source vertices mapping into it */
+  if (!DoJac) {
+    printf("MRISapplyReg: Dividing by number of hits (%d)\n", TrgSurfReg->nvertices);
+    for (tvtx = 0; tvtx < TrgSurfReg->nvertices; tvtx++) {
+      n = MRIFseq_vox((TrgHits), tvtx, 0, 0, 0);
+      if (n > 1) {
+        for (f = 0; f < SrcSurfVals->nframes; f++) MRIFseq_vox(TrgSurfVals, tvtx, 0, 0, f) /= n;
+      }
+    }
+  }
+
+  /* Count lost sources */
+  nSrcLost = 0;
+  for (svtx = 0; svtx < SrcSurfReg->nvertices; svtx++) {
+    n = MRIFseq_vox((SrcHits), svtx, 0, 0, 0);
+    if (n == 0) nSrcLost++;
+  }
+  printf("MRISapplyReg: nSrcLost = %d\n", nSrcLost);
+
+  MRIfree(&SrcHits);
+  MRIfree(&TrgHits);
+  if (UseHash)
+    for (n = 0; n < nsurfs; n++) MHTfree(&Hash[n]);
+  return (TrgSurfVals);
+}
+
+static int sameOutput(MRI *a, MRI *b)
+{
+  if (a->width != b->width || a->nframes != b->nframes) return 0;
+  for (int f = 0; f < a->nframes; f++)
+    if (memcmp(&MRIFseq_vox(a, 0, 0, 0, f), &MRIFseq_vox(b, 0, 0, 0, f), a->width * sizeof(float))) return 0;
+  return 1;
+}
+
+// puts the vertices on a sphere of RADIUS, rotated by angle about z and
+// by angle/2 about x
+static void makeSphere(MRIS *mris, double angle)
+{
+  double const c = cos(angle), s = sin(angle), c2 = cos(angle / 2), s2 = sin(angle / 2);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const * const v = &mris->vertices[vno];
+    double const r = sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
+    double const x = v->x / r, y = v->y / r, z = v->z / r;
+    double const x1 = c * x - s * y, y1 = s * x + c * y;
+    double const y2 = c2 * y1 - s2 * z, z2 = s2 * y1 + c2 * z;
+    MRISsetXYZ(mris, vno, RADIUS * x1, RADIUS * y2, RADIUS * z2);
+  }
+  MRIScomputeMetricProperties(mris);
+}
+
+int main(int argc, char *argv[])
+{
+  MRIS *surfs[2];
+  surfs[0] = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  surfs[1] = ic642_make_surface(642, 1280);
+  makeSphere(surfs[0], 0.1);
+  makeSphere(surfs[1], 0.0);
+  for (int vno = 0; vno < surfs[1]->nvertices; vno += 37) surfs[1]->vertices[vno].ripflag = 1;
+
+  MRI *src = MRIallocSequence(surfs[0]->nvertices, 1, 1, MRI_FLOAT, NFRAMES);
+  setRandomSeed(53);
+  for (int f = 0; f < NFRAMES; f++)
+    for (int c = 0; c < src->width; c++) MRIFseq_vox(src, c, 0, 0, f) = randomNumber(0.0, 10.0);
+
+  const char *tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL) tmpdir = "/tmp";
+  std::string const opfile = std::string(tmpdir) + "/" + Progname + "." + std::to_string(getpid()) + ".regop";
+  int nfailed = 0;
+
+  for (int hash = 0; hash < 2; hash++) {
+    for (int jac = 0; jac < 2; jac++) {
+      for (int rev = 0; rev < 2; rev++) {
+        MRI *ref = MRISapplyRegRef(src, surfs, 2, rev, jac, hash);
+        MRI *out = MRISapplyReg(src, surfs, 2, rev, jac, hash);
+
+        MRIS_REG_OP *op = MRISapplyRegOp(surfs, 2, rev, jac, hash);
+        MRI *out1 = op ? MRISregOpApply(op, src, NULL) : NULL;
+
+        MRIS_REG_OP *op2 = NULL;
+        MRI *out2 = NULL;
+        if (op && MRISregOpWrite(op, opfile.c_str()) == 0) op2 = MRISregOpRead(opfile.c_str());
+        unlink(opfile.c_str());
+        if (op2 && MRISregOpMatches(op2, surfs, 2, rev, jac, hash)) out2 = MRISregOpApply(op2, src, NULL);
+
+        // the saved operator must not be reused with other flags
+        int nwrong = 0;
+        if (op2) {
+          nwrong += MRISregOpMatches(op2, surfs, 2, !rev, jac, hash);
+          nwrong += MRISregOpMatches(op2, surfs, 2, rev, !jac, hash);
+          nwrong += MRISregOpMatches(op2, surfs, 2, rev, jac, !hash);
+        }
+
+        int const same = out && sameOutput(ref, out);
+        int const same1 = out1 && sameOutput(ref, out1);
+        int const same2 = out2 && sameOutput(ref, out2);
+        std::cout << "hash=" << hash << " jac=" << jac << " rev=" << rev << " nnz=" << (op ? op->nnz : 0)
+                  << (same ? "" : "  MRISapplyReg DIFFERS") << (same1 ? "" : "  OPERATOR DIFFERS")
+                  << (same2 ? "" : "  SAVED OPERATOR DIFFERS") << (nwrong ? "  MATCHES OTHER FLAGS" : "") << "\n";
+        if (!same || !same1 || !same2 || nwrong) nfailed++;
+
+        MRIfree(&ref);
+        if (out) MRIfree(&out);
+        if (out1) MRIfree(&out1);
+        if (out2) MRIfree(&out2);
+        if (op) MRISregOpFree(&op);
+        if (op2) MRISregOpFree(&op2);
+      }
+    }
+  }
+
+  // an operator must not match once a registration surface has moved, and
+  // a file written with another version must be ignored
+  MRIS_REG_OP *op = MRISapplyRegOp(surfs, 2, 1, 0, 1);
+  if (op == NULL) ErrorExit(ERROR_NOMEMORY, "%s: could not build the operator", Progname);
+  VERTEX const * const v = &surfs[0]->vertices[11];
+  MRISsetXYZ(surfs[0], 11, v->x, v->y, v->z + 0.01);
+  if (MRISregOpMatches(op, surfs, 2, 1, 0, 1)) {
+    std::cout << "FAILED: operator matches a moved surface\n";
+    nfailed++;
+  }
+  if (MRISregOpWrite(op, opfile.c_str()) == 0) {
+    FILE *fp = fopen(opfile.c_str(), "r+b");
+    if (fp == NULL) ErrorExit(ERROR_NOFILE, "%s: could not open %s", Progname, opfile.c_str());
+    fseek(fp, sizeof(int), SEEK_SET);
+    fwriteInt(1, fp);
+    fclose(fp);
+    MRIS_REG_OP *op1 = MRISregOpRead(opfile.c_str());
+    if (op1) {
+      std::cout << "FAILED: operator file of version 1 was read\n";
+      nfailed++;
+      MRISregOpFree(&op1);
+    }
+  }
+  else {
+    std::cout << "FAILED: could not write " << opfile << "\n";
+    nfailed++;
+  }
+  unlink(opfile.c_str());
+  MRISregOpFree(&op);
+
+  MRIfree(&src);
+  MRISfree(&surfs[0]);
+  MRISfree(&surfs[1]);
+
+  if (nfailed) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "outputs identical\n";
+  exit(0);
+}
@@ -0,0 +1,102 @@
+//
+// test for MRISaverageGradients - located in utils/mrisurf_metricProperties.cpp
+//
+// Smooths a random gradient field on a bumpy icosahedral surface with the
+// num_avgs that mris_sphere, mris_register and mris_inflate use above 16
+// (1024, 256, 64), once with the repeated one-ring averaging (the default)
+// and once with the truncated Chebyshev expansion
+// (FREESURFER_MRISaverageGradients_chebyshev set), and checks that the two
+// agree within TOLERANCE of the largest value but are not identical, which
+// would mean the expansion was not used.
+//
+
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <iostream>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mrisurf.h"
+#include "icosahedron.h"
+
+const char *Progname = "test_MRISaverageGradients";
+
+#define TOLERANCE 1e-4
+
+
+static void setGradient(MRIS *mris, const std::vector<float> &d)
+{
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    mris->vertices[vno].dx = d[3 * vno + 0];
+    mris->vertices[vno].dy = d[3 * vno + 1];
+    mris->vertices[vno].dz = d[3 * vno + 2];
+  }
+}
+
+
+static void getGradient(MRIS *mris, std::vector<float> &d)
+{
+  d.resize(3 * mris->nvertices);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    d[3 * vno + 0] = mris->vertices[vno].dx;
+    d[3 * vno + 1] = mris->vertices[vno].dy;
+    d[3 * vno + 2] = mris->vertices[vno].dz;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  MRIS *mris = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    float r = 100 + 10 * sin(3 * v->x) * cos(2 * v->y) + 5 * sin(4 * v->z);
+    MRISsetXYZ(mris, vno, r * v->x, r * v->y, r * v->z);
+  }
+  MRIScomputeMetricProperties(mris);
+
+  // a noisy gradient with a few large spikes, and one ripped vertex
+  std::vector<float> init(3 * mris->nvertices);
+  setRandomSeed(17L);
+  for (size_t i = 0; i < init.size(); i++) init[i] = randomNumber(-1.0, 1.0) + ((i % 997) == 0 ? 50.0 : 0.0);
+  mris->vertices[mris->nvertices / 2].ripflag = 1;
+
+  int nfailed = 0;
+  int const schedule[] = {1024, 256, 64};
+  for (unsigned int s = 0; s < sizeof(schedule) / sizeof(schedule[0]); s++) {
+    int const num_avgs = schedule[s];
+    std::vector<float> sweep, cheb;
+
+    unsetenv("FREESURFER_MRISaverageGradients_chebyshev");
+    setGradient(mris, init);
+    MRISaverageGradients(mris, num_avgs);
+    getGradient(mris, sweep);
+
+    setenv("FREESURFER_MRISaverageGradients_chebyshev", "1", 1);
+    setGradient(mris, init);
+    MRISaverageGradients(mris, num_avgs);
+    getGradient(mris, cheb);
+    unsetenv("FREESURFER_MRISaverageGradients_chebyshev");
+
+    double maxerr = 0, maxval = 0;
+    for (size_t i = 0; i < sweep.size(); i++) {
+      maxerr = MAX(maxerr, fabs(sweep[i] - cheb[i]));
+      maxval = MAX(maxval, fabs(sweep[i]));
+    }
+    double const relerr = maxerr / MAX(maxval, 1e-30);
+    bool const ok = maxerr > 0 && relerr < TOLERANCE;
+    if (!ok) nfailed++;
+    std::cout << "num_avgs " << num_avgs << ": max rel diff " << relerr << (ok ? "" : "  FAILED") << "\n";
+  }
+
+  MRISfree(&mris);
+
+  if (nfailed) {
+    std::cout << nfailed << " num_avgs differ!\n";
+    exit(1);
+  }
+  std::cout << "results agree\n";
+  exit(0);
+}
@@ -0,0 +1,192 @@
+//
+// test for MRISaverageGradients - located in utils/mrisurf_metricProperties.cpp
+//
+// Maps a bumpy icosahedral surface to the sphere with the mris_sphere settings,
+// whose gradients are averaged 1024, 256, 64, 16, 4 and 1 times, once with the
+// repeated one-ring averaging (FREESURFER_MRISaverageGradients_chebyshev_suppress
+// set) and once with the default multilevel and Chebyshev averaging.  The final
+// distance error and number of negative faces must agree within TOLERANCE and
+// NEG_FACES_TOLERANCE, and both runs must have reduced the distance error.
+//
+
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mrisurf.h"
+#include "icosahedron.h"
+#include "mrisurf_project.h"
+
+const char *Progname = "test_MRISaverageGradients_sphere";
+
+#define TOLERANCE            0.05
+#define NEG_FACES_TOLERANCE  5
+
+
+static double bump(double x, double y, double z)
+{
+  return 1 + 0.15 * sin(3 * x) * cos(2 * y) + 0.1 * sin(4 * z);
+}
+
+
+// splits every face of the icosahedron into four, nsplits times, so that 1024
+// averages stay local enough for the multilevel averaging
+//
+static MRIS *makeIcosahedron(int nsplits)
+{
+  MRIS *ico = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  std::vector<float> xyz;
+  std::vector<int> faces;
+  for (int vno = 0; vno < ico->nvertices; vno++) {
+    VERTEX const *v = &ico->vertices[vno];
+    xyz.push_back(v->x); xyz.push_back(v->y); xyz.push_back(v->z);
+  }
+  for (int fno = 0; fno < ico->nfaces; fno++)
+    for (int n = 0; n < VERTICES_PER_FACE; n++) faces.push_back(ico->faces[fno].v[n]);
+  MRISfree(&ico);
+
+  for (int split = 0; split < nsplits; split++) {
+    std::map<std::pair<int, int>, int> midpoints;
+    std::vector<int> split_faces;
+    for (size_t f = 0; f < faces.size(); f += 3) {
+      int mid[3];
+      for (int n = 0; n < 3; n++) {
+        int const a = faces[f + n], b = faces[f + (n + 1) % 3];
+        std::pair<int, int> const edge(MIN(a, b), MAX(a, b));
+        if (!midpoints.count(edge)) {
+          midpoints[edge] = xyz.size() / 3;
+          float const x = xyz[3 * a] + xyz[3 * b], y = xyz[3 * a + 1] + xyz[3 * b + 1], z = xyz[3 * a + 2] + xyz[3 * b + 2];
+          float const r = sqrt(x * x + y * y + z * z) / 100;
+          xyz.push_back(x / r); xyz.push_back(y / r); xyz.push_back(z / r);
+        }
+        mid[n] = midpoints[edge];
+      }
+      int const quad[12] = {faces[f],     mid[0], mid[2],
+                            faces[f + 1], mid[1], mid[0],
+                            faces[f + 2], mid[2], mid[1],
+                            mid[0],       mid[1], mid[2]};
+      split_faces.insert(split_faces.end(), quad, quad + 12);
+    }
+    faces.swap(split_faces);
+  }
+
+  return MRISfromVerticesAndFaces(&xyz[0], xyz.size() / 3, &faces[0], faces.size() / 3);
+}
+
+
+static MRIS *makeSurface()
+{
+  MRIS *mris = makeIcosahedron(2);
+  MRISsetNeighborhoodSizeAndDist(mris, 3);
+  MRISresetNeighborhoodSize(mris, 1);
+
+  // the bumpy surface gives the distances and areas to preserve
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    double r = sqrt(v->x * v->x + v->y * v->y + v->z * v->z);
+    double const x = v->x / r, y = v->y / r, z = v->z / r;
+    r = 60 * bump(x, y, z);
+    MRISsetXYZ(mris, vno, r * x, r * y, r * z);
+  }
+  MRISsetOriginalXYZfromXYZ(mris);
+  MRIScomputeMetricProperties(mris);
+  MRIScomputeTriangleProperties(mris);
+  MRISstoreMetricProperties(mris);
+
+  // start from an ellipsoid, as an inflated surface would
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    double const r = sqrt(v->origx * v->origx + v->origy * v->origy + v->origz * v->origz);
+    MRISsetXYZ(mris, vno, 72 * v->origx / r, 60 * v->origy / r, 48 * v->origz / r);
+  }
+  MRIScomputeMetricProperties(mris);
+  MRIScomputeTriangleProperties(mris);
+  mris->orig_area = mris->total_area;
+
+  MRISprojectOntoSphere(mris, mris, sqrt(mris->total_area / (4 * M_PI)));
+  MRISsetNeighborhoodSize(mris, 2);
+  if (MRIScountNegativeFaces(mris) > nint(.8 * mris->nfaces)) MRISevertSurface(mris);
+  mrisComputeOriginalVertexDistances(mris);
+  MRIScomputeMetricProperties(mris);
+  return mris;
+}
+
+
+static void unfold(MRIS *mris)
+{
+  INTEGRATION_PARMS parms;
+  parms.dt = .05;
+  parms.projection = PROJECT_ELLIPSOID;
+  parms.tol = .5;
+  parms.n_averages = 1024;
+  parms.min_averages = 0;
+  parms.l_angle = 0.0;
+  parms.l_neg = 0.0;
+  parms.l_dist = 1.0;
+  parms.l_spring = 0.0;
+  parms.l_area = 1.0;
+  parms.l_boundary = 0.0;
+  parms.l_curv = 0.0;
+  parms.niterations = 25;
+  parms.write_iterations = 0;
+  parms.a = parms.b = parms.c = 0.0f;
+  parms.dt_increase = 1.01;
+  parms.dt_decrease = 0.99;
+  parms.error_ratio = 1.03;
+  parms.integration_type = INTEGRATE_LINE_MINIMIZE;
+  parms.momentum = 0.9;
+  parms.desired_rms_height = -1.0;
+  parms.Hdesired = 0.0;
+  parms.nbhd_size = 7;
+  parms.max_nbrs = 8;
+  parms.scale = 1.0;
+  parms.base_dt = parms.dt;
+  strcpy(parms.base_name, "sphere");
+  MRISunfold(mris, &parms, 1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  double error[2], start_error = 0;
+  int neg[2];
+
+  for (int run = 0; run < 2; run++) {
+    if (run == 0) setenv("FREESURFER_MRISaverageGradients_chebyshev_suppress", "1", 1);
+    else unsetenv("FREESURFER_MRISaverageGradients_chebyshev_suppress");
+
+    setRandomSeed(17L);
+    MRIS *mris = makeSurface();
+    start_error = MRISpercentDistanceError(mris);
+    unfold(mris);
+    MRIScomputeMetricProperties(mris);
+    error[run] = MRISpercentDistanceError(mris);
+    neg[run] = MRIScountNegativeFaces(mris);
+    MRISfree(&mris);
+  }
+
+  std::cout << "distance error: start " << start_error << "%, sweeps " << error[0] << "%, default " << error[1] << "%\n";
+  std::cout << "negative faces: sweeps " << neg[0] << ", default " << neg[1] << "\n";
+
+  bool ok = true;
+  if (error[0] >= start_error || error[1] >= start_error) {
+    std::cout << "distance error not reduced!\n";
+    ok = false;
+  }
+  if (fabs(error[1] - error[0]) > TOLERANCE * error[0]) {
+    std::cout << "distance errors differ!\n";
+    ok = false;
+  }
+  if (abs(neg[1] - neg[0]) > NEG_FACES_TOLERANCE) {
+    std::cout << "negative faces differ!\n";
+    ok = false;
+  }
+  if (!ok) exit(1);
+  std::cout << "results agree\n";
+  exit(0);
+}
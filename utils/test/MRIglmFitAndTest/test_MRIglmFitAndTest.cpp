@@ -0,0 +1,286 @@
+//
+// test for the batched path of MRIglmFitAndTest
+// - located in utils/fmriutils.cpp
+//
+// Fits a synthetic masked volume with a fixed design and a t and an F
+// contrast, once on the voxel-by-voxel path (FS_GLM_NOBATCH) and once on the
+// batched path, and checks that every output is identical.  Then checks that
+// designs the batched path cannot handle are not given to it and still come
+// out right:
+//  - global weights (wg) must give the same fit as the batched path on data
+//    and design that were weighted beforehand
+//  - a frame mask that drops a frame everywhere must give the same fit as the
+//    batched path on data and design without that frame
+// Finally fits permuted designs with SimOnly workers in parallel, as
+// mri_glmfit --sim perm does, and checks them against full serial fits.
+//
+
+#include <iostream>
+#include <string.h>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+#include "matrix.h"
+#include "fsglm.h"
+#include "fmriutils.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+const char *Progname = "test_MRIglmFitAndTest";
+
+#define NC 11
+#define NR 7
+#define NS 5
+#define NF 24
+#define NREG 3
+#define NPERM 6
+
+static MRIGLM *allocGLM(MRI *y, MRI *mask, MATRIX *Xg)
+{
+  MRIGLM *mriglm = (MRIGLM *)calloc(sizeof(MRIGLM), 1);
+  mriglm->glm = GLMalloc();
+  mriglm->y = y;
+  mriglm->mask = mask;
+  mriglm->Xg = MatrixCopy(Xg, NULL);
+  mriglm->yhatsave = 1;
+
+  // t on the second regressor, F on the second and third
+  mriglm->glm->ncontrasts = 2;
+  mriglm->glm->C[0] = MatrixConstVal(0.0, 1, NREG, NULL);
+  mriglm->glm->C[0]->rptr[1][2] = 1;
+  mriglm->glm->C[1] = MatrixConstVal(0.0, 2, NREG, NULL);
+  mriglm->glm->C[1]->rptr[1][2] = 1;
+  mriglm->glm->C[1]->rptr[2][3] = 1;
+  return mriglm;
+}
+
+static void freeGLM(MRIGLM **pmriglm)
+{
+  MRIGLM *mriglm = *pmriglm;
+  MRI **outs[] = {&mriglm->beta, &mriglm->eres, &mriglm->rvar, &mriglm->yhat, &mriglm->cond};
+  for (unsigned int k = 0; k < sizeof(outs) / sizeof(outs[0]); k++)
+    if (*outs[k]) MRIfree(outs[k]);
+  for (int n = 0; n < mriglm->glm->ncontrasts; n++) {
+    MRI **couts[] = {&mriglm->gamma[n], &mriglm->gammaVar[n], &mriglm->F[n], &mriglm->p[n],
+                     &mriglm->sig[n],   &mriglm->z[n],        &mriglm->pcc[n], &mriglm->ypmf[n]};
+    for (unsigned int k = 0; k < sizeof(couts) / sizeof(couts[0]); k++)
+      if (*couts[k]) MRIfree(couts[k]);
+  }
+  MatrixFree(&mriglm->Xg);
+  if (mriglm->wg) MatrixFree(&mriglm->wg);
+  GLMfree(&mriglm->glm);
+  free(mriglm);
+  *pmriglm = NULL;
+}
+
+static int fit(MRIGLM *mriglm, int batched)
+{
+  if (batched)
+    unsetenv("FS_GLM_NOBATCH");
+  else
+    setenv("FS_GLM_NOBATCH", "1", 1);
+  int err = MRIglmFitAndTest(mriglm);
+  unsetenv("FS_GLM_NOBATCH");
+  return err;
+}
+
+// number of voxels in the mask where a and b differ in any of the first nframes frames
+static int compareVol(const char *name, MRI *a, MRI *b, MRI *mask, int nframes)
+{
+  int ndiff = 0;
+  for (int s = 0; s < NS; s++)
+    for (int r = 0; r < NR; r++)
+      for (int c = 0; c < NC; c++) {
+        if (MRIgetVoxVal(mask, c, r, s, 0) < 0.5) continue;
+        for (int f = 0; f < nframes; f++)
+          if (MRIgetVoxVal(a, c, r, s, f) != MRIgetVoxVal(b, c, r, s, f)) {
+            ndiff++;
+            break;
+          }
+      }
+  if (ndiff) std::cout << "  " << name << ": " << ndiff << " voxels differ\n";
+  return ndiff;
+}
+
+// compares the outputs of two fits, eres and yhat only when allframes is set
+static int compareGLM(MRIGLM *a, MRIGLM *b, MRI *mask, int allframes)
+{
+  int ndiff = compareVol("beta", a->beta, b->beta, mask, NREG) + compareVol("rvar", a->rvar, b->rvar, mask, 1);
+  if (allframes)
+    ndiff += compareVol("eres", a->eres, b->eres, mask, a->eres->nframes) +
+             compareVol("yhat", a->yhat, b->yhat, mask, a->yhat->nframes);
+  for (int n = 0; n < a->glm->ncontrasts; n++) {
+    ndiff += compareVol("gamma", a->gamma[n], b->gamma[n], mask, a->glm->C[n]->rows);
+    if (a->gammaVar[n]) ndiff += compareVol("gammaVar", a->gammaVar[n], b->gammaVar[n], mask, 1);
+    ndiff += compareVol("F", a->F[n], b->F[n], mask, 1) + compareVol("p", a->p[n], b->p[n], mask, 1) +
+             compareVol("sig", a->sig[n], b->sig[n], mask, 1) + compareVol("z", a->z[n], b->z[n], mask, 1);
+  }
+  return ndiff;
+}
+
+// compares the outputs a SimOnly fit writes
+static int compareSim(MRIGLM *a, MRIGLM *b, MRI *mask)
+{
+  int ndiff = 0;
+  for (int n = 0; n < a->glm->ncontrasts; n++)
+    ndiff += compareVol("gamma", a->gamma[n], b->gamma[n], mask, a->glm->C[n]->rows) +
+             compareVol("F", a->F[n], b->F[n], mask, 1) + compareVol("p", a->p[n], b->p[n], mask, 1) +
+             compareVol("sig", a->sig[n], b->sig[n], mask, 1) + compareVol("z", a->z[n], b->z[n], mask, 1);
+  return ndiff;
+}
+
+static int check(const char *name, int ndiff)
+{
+  std::cout << name << ": " << (ndiff ? "FAILED" : "ok") << "\n";
+  return ndiff ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  setRandomSeed(17);
+
+  // design: intercept, a linear trend and a random covariate
+  MATRIX *Xg = MatrixAlloc(NF, NREG, MATRIX_REAL);
+  for (int f = 1; f <= NF; f++) {
+    Xg->rptr[f][1] = 1;
+    Xg->rptr[f][2] = f - NF / 2.0;
+    Xg->rptr[f][3] = randomNumber(-1.0, 1.0);
+  }
+
+  // data: some effect plus noise, one voxel of zeros, a spherical-ish mask
+  MRI *y = MRIallocSequence(NC, NR, NS, MRI_FLOAT, NF);
+  MRI *mask = MRIalloc(NC, NR, NS, MRI_INT);
+  for (int s = 0; s < NS; s++)
+    for (int r = 0; r < NR; r++)
+      for (int c = 0; c < NC; c++) {
+        double b2 = (c % 3) * 0.5, b3 = (r % 2) * 0.25;
+        for (int f = 0; f < NF; f++) {
+          double v = 100 + b2 * Xg->rptr[f + 1][2] + b3 * Xg->rptr[f + 1][3] + randomNumber(-2.0, 2.0);
+          if (c == 1 && r == 1 && s == 1) v = 0;
+          MRIsetVoxVal(y, c, r, s, f, v);
+        }
+        int inside = (c - NC / 2) * (c - NC / 2) + (r - NR / 2) * (r - NR / 2) + (s - NS / 2) * (s - NS / 2) < 20;
+        MRIsetVoxVal(mask, c, r, s, 0, inside || (c == 1 && r == 1 && s == 1));
+      }
+
+  int nfailed = 0;
+
+  // fixed design: batched and voxel-by-voxel must agree exactly
+  {
+    MRIGLM *serial = allocGLM(y, mask, Xg);
+    MRIGLM *batch = allocGLM(y, mask, Xg);
+    if (MRIglmBatchable(batch) != 1) ErrorExit(ERROR_BADPARM, "%s: fixed design not batchable", Progname);
+    fit(serial, 0);
+    fit(batch, 1);
+    nfailed += check("fixed design, batched vs voxel-by-voxel", compareGLM(serial, batch, mask, 1));
+    freeGLM(&serial);
+    freeGLM(&batch);
+  }
+
+  // global weights: not batched, same as weighting y and X beforehand
+  {
+    MATRIX *wg = MatrixAlloc(NF, 1, MATRIX_REAL);
+    for (int f = 1; f <= NF; f++) wg->rptr[f][1] = randomNumber(0.5, 2.0);
+    MRI *yw = MRIallocSequence(NC, NR, NS, MRI_FLOAT, NF);
+    MATRIX *Xw = MatrixAlloc(NF, NREG, MATRIX_REAL);
+    for (int f = 0; f < NF; f++) {
+      float w = wg->rptr[f + 1][1];
+      for (int k = 1; k <= NREG; k++) Xw->rptr[f + 1][k] = Xg->rptr[f + 1][k] * w;
+      for (int s = 0; s < NS; s++)
+        for (int r = 0; r < NR; r++)
+          for (int c = 0; c < NC; c++) MRIsetVoxVal(yw, c, r, s, f, MRIgetVoxVal(y, c, r, s, f) * w);
+    }
+    MRIGLM *weighted = allocGLM(y, mask, Xg);
+    weighted->wg = wg;
+    MRIGLM *preweighted = allocGLM(yw, mask, Xw);
+    int ndiff = MRIglmBatchable(weighted);
+    fit(weighted, 1);
+    fit(preweighted, 1);
+    ndiff += compareGLM(weighted, preweighted, mask, 1);
+    nfailed += check("global weights", ndiff);
+    freeGLM(&weighted);
+    freeGLM(&preweighted);
+    MatrixFree(&Xw);
+    MRIfree(&yw);
+  }
+
+  // frame mask: not batched, same as leaving the masked frame out
+  {
+    const int fdrop = 5;
+    MRI *fmask = MRIallocSequence(NC, NR, NS, MRI_FLOAT, NF);
+    MRI *yd = MRIallocSequence(NC, NR, NS, MRI_FLOAT, NF - 1);
+    MATRIX *Xd = MatrixAlloc(NF - 1, NREG, MATRIX_REAL);
+    for (int f = 0, fd = 0; f < NF; f++) {
+      for (int s = 0; s < NS; s++)
+        for (int r = 0; r < NR; r++)
+          for (int c = 0; c < NC; c++) {
+            MRIsetVoxVal(fmask, c, r, s, f, f != fdrop);
+            if (f != fdrop) MRIsetVoxVal(yd, c, r, s, fd, MRIgetVoxVal(y, c, r, s, f));
+          }
+      if (f == fdrop) continue;
+      for (int k = 1; k <= NREG; k++) Xd->rptr[fd + 1][k] = Xg->rptr[f + 1][k];
+      fd++;
+    }
+    MRIGLM *masked = allocGLM(y, mask, Xg);
+    masked->FrameMask = fmask;
+    MRIGLM *dropped = allocGLM(yd, mask, Xd);
+    int ndiff = MRIglmBatchable(masked);
+    fit(masked, 1);
+    fit(dropped, 1);
+    ndiff += compareGLM(masked, dropped, mask, 0);
+    nfailed += check("frame mask", ndiff);
+    freeGLM(&masked);
+    freeGLM(&dropped);
+    MatrixFree(&Xd);
+    MRIfree(&yd);
+    MRIfree(&fmask);
+  }
+
+  // permutations: SimOnly workers fitted concurrently, each with its own
+  // permuted design, must match full voxel-by-voxel fits of the same designs
+  {
+    MRIGLM *sim[NPERM], *full[NPERM];
+    for (int n = 0; n < NPERM; n++) {
+      MATRIX *Xp = MatrixCopy(Xg, NULL);
+      for (int f = NF; f > 1; f--) {
+        int g = 1 + (int)randomNumber(0, f - 0.001);
+        for (int k = 1; k <= NREG; k++) {
+          float tmp = Xp->rptr[f][k];
+          Xp->rptr[f][k] = Xp->rptr[g][k];
+          Xp->rptr[g][k] = tmp;
+        }
+      }
+      sim[n] = allocGLM(y, mask, Xp);
+      sim[n]->SimOnly = 1;
+      sim[n]->yhatsave = 0;
+      full[n] = allocGLM(y, mask, Xp);
+      MatrixFree(&Xp);
+    }
+    int nerr = 0;
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for reduction(+ : nerr)
+#endif
+    for (int n = 0; n < NPERM; n++) nerr += MRIglmFitAndTest(sim[n]);
+    int ndiff = nerr;
+    for (int n = 0; n < NPERM; n++) {
+      fit(full[n], 0);
+      if (sim[n]->beta || sim[n]->eres || sim[n]->rvar) ndiff++;
+      ndiff += compareSim(sim[n], full[n], mask);
+      freeGLM(&sim[n]);
+      freeGLM(&full[n]);
+    }
+    nfailed += check("concurrent SimOnly permutations", ndiff);
+  }
+
+  MatrixFree(&Xg);
+  MRIfree(&y);
+  MRIfree(&mask);
+
+  if (nfailed) exit(1);
+  std::cout << "all fits agree\n";
+  exit(0);
+}
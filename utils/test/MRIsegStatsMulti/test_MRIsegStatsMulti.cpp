@@ -0,0 +1,156 @@
+//
+// test for MRIsegStatsMulti and MRIvoxelsInLabelsWithPartialVolumeEffects
+// - located in utils/mri2.cpp and utils/mri.cpp
+//
+// Builds a segmentation of nested shells and random blocks, with ids that
+// are far apart, over a two frame volume whose intensity depends on the
+// segment. Computes the per-segment count, stats, robust stats, frame
+// averages and partial volume corrected volumes of every id the way
+// mri_segstats used to (one MRIsegStats, MRIsegStatsRobust, MRIsegFrameAvg
+// and MRIvoxelsInLabelWithPartialVolumeEffects call per id), then with the
+// single pass versions on one and on several threads, and checks that they
+// agree. Counts, min, max, robust stats and volumes must be identical, mean,
+// std and frame averages may differ in the last bits because of the slab
+// reduction.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+#include "mri2.h"
+
+const char *Progname = "test_MRIsegStatsMulti";
+
+#define WIDTH    32
+#define HEIGHT   28
+#define DEPTH    24
+#define NFRAMES  2
+#define NTHREADS 4
+
+#define ROBUST_PCT 5.0
+
+struct SegResults
+{
+  std::vector<int> nvoxels;
+  std::vector<float> min, max, range, mean, std;
+  std::vector<float> rmin, rmax, rrange, rmean, rstd;
+  std::vector<std::vector<double> > favg;
+  std::vector<float> pvvol;
+
+  SegResults(int nsegs, int nframes)
+    : nvoxels(nsegs), min(nsegs), max(nsegs), range(nsegs), mean(nsegs), std(nsegs),
+      rmin(nsegs), rmax(nsegs), rrange(nsegs), rmean(nsegs), rstd(nsegs),
+      favg(nsegs, std::vector<double>(nframes)), pvvol(nsegs)
+  {
+  }
+};
+
+// what mri_segstats did before, one scan of the volume per id and statistic
+static void referenceStats(MRI *seg, MRI *mri, int nsegs, const int *segids, SegResults &res)
+{
+  for (int n = 0; n < nsegs; n++) {
+    res.nvoxels[n] = MRIsegFrameAvg(seg, segids[n], mri, &res.favg[n][0]);
+    MRIsegStats(seg, segids[n], mri, 0, &res.min[n], &res.max[n], &res.range[n], &res.mean[n], &res.std[n]);
+    MRIsegStatsRobust(seg, segids[n], mri, 0,
+                      &res.rmin[n], &res.rmax[n], &res.rrange[n], &res.rmean[n], &res.rstd[n], ROBUST_PCT);
+    res.pvvol[n] = MRIvoxelsInLabelWithPartialVolumeEffects(seg, mri, segids[n], NULL, NULL);
+  }
+}
+
+static void multiStats(MRI *seg, MRI *mri, int nsegs, const int *segids, SegResults &res)
+{
+  std::vector<double *> favg(nsegs);
+  for (int n = 0; n < nsegs; n++) favg[n] = &res.favg[n][0];
+  MRIsegStatsMulti(seg, nsegs, segids, mri, 0, 0, 0, &res.nvoxels[0],
+                   &res.min[0], &res.max[0], &res.range[0], &res.mean[0], &res.std[0], &favg[0]);
+  MRIsegStatsMulti(seg, nsegs, segids, mri, 0, 1, ROBUST_PCT, NULL,
+                   &res.rmin[0], &res.rmax[0], &res.rrange[0], &res.rmean[0], &res.rstd[0], NULL);
+  MRIvoxelsInLabelsWithPartialVolumeEffects(seg, mri, nsegs, segids, &res.pvvol[0]);
+}
+
+static bool nearlyEqual(double a, double b) { return fabs(a - b) <= 1e-5 * MAX(fabs(a), fabs(b)) + 1e-6; }
+
+static int countDifferences(const SegResults &a, const SegResults &b, int nsegs)
+{
+  int ndiff = 0;
+  for (int n = 0; n < nsegs; n++) {
+    bool same = a.nvoxels[n] == b.nvoxels[n] && a.min[n] == b.min[n] && a.max[n] == b.max[n] &&
+                a.range[n] == b.range[n] && nearlyEqual(a.mean[n], b.mean[n]) && nearlyEqual(a.std[n], b.std[n]) &&
+                a.rmin[n] == b.rmin[n] && a.rmax[n] == b.rmax[n] && a.rrange[n] == b.rrange[n] &&
+                a.rmean[n] == b.rmean[n] && a.rstd[n] == b.rstd[n] && a.pvvol[n] == b.pvvol[n];
+    for (unsigned int f = 0; f < a.favg[n].size(); f++) same = same && nearlyEqual(a.favg[n][f], b.favg[n][f]);
+    if (!same) ndiff++;
+  }
+  return ndiff;
+}
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+  int const ids[] = {2, 3, 41, 42, 1000, 2035};
+  MRI *seg = MRIalloc(WIDTH, HEIGHT, DEPTH, MRI_INT);
+  MRI *mri = MRIallocSequence(WIDTH, HEIGHT, DEPTH, MRI_FLOAT, NFRAMES);
+  setRandomSeed(17L);
+  for (int z = 0; z < DEPTH; z++)
+    for (int y = 0; y < HEIGHT; y++)
+      for (int x = 0; x < WIDTH; x++) {
+        double const r = sqrt(SQR(x - WIDTH / 2) + SQR(y - HEIGHT / 2) + SQR(z - DEPTH / 2));
+        int id = 0;
+        if (r < 4)
+          id = ids[0];
+        else if (r < 6)
+          id = ids[1];
+        else if (r < 8)
+          id = ids[2];
+        else if (r < 10)
+          id = ids[3];
+        else if ((x / 6 + y / 6 + z / 6) % 3 == 0)
+          id = ids[4 + (x / 6) % 2];
+        MRIsetVoxVal(seg, x, y, z, 0, id);
+        for (int f = 0; f < NFRAMES; f++)
+          MRIsetVoxVal(mri, x, y, z, f, (id % 97) + 20 * f + nint(randomNumber(-10, 10)));
+      }
+
+  int nsegs;
+  int *segids = MRIsegmentationList(seg, &nsegs);
+  std::cout << nsegs << " segmentations\n";
+
+  SegResults ref(nsegs, NFRAMES);
+  referenceStats(seg, mri, nsegs, segids, ref);
+
+  int nfailed = 0;
+  int const nthreads[2] = {1, NTHREADS};
+  for (int t = 0; t < 2; t++) {
+    setNumThreads(nthreads[t]);
+    SegResults res(nsegs, NFRAMES);
+    multiStats(seg, mri, nsegs, segids, res);
+    int const ndiff = countDifferences(ref, res, nsegs);
+    std::cout << "single pass on " << nthreads[t] << " threads: " << ndiff << " segmentations differ\n";
+    if (ndiff) nfailed++;
+  }
+
+  free(segids);
+  MRIfree(&mri);
+  MRIfree(&seg);
+
+  if (nfailed) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "stats agree\n";
+  exit(0);
+}
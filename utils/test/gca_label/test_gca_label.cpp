@@ -0,0 +1,177 @@
+//
+// test for GCAlabel - located in utils/gca.cpp
+//
+// Builds a small synthetic atlas whose nodes hold only some of the labels of
+// their priors (so GCAlabel has to fall back to the closest valid
+// classifier), with some singular covariances, and a random two-channel
+// volume. Labels it with the per-voxel classifier search that GCAlabel used
+// to do (serial, GCAfindGC and GCAcomputeConditionalLogDensity for every
+// prior label), then with GCAlabel on one and on several threads, and checks
+// that all three give identical labels.
+//
+
+#include <iostream>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+#include "gca.h"
+#include "transform.h"
+
+const char *Progname = "test_gca_label";
+
+#define NINPUTS  2
+#define WIDTH    32
+#define HEIGHT   24
+#define DEPTH    28
+#define NTHREADS 4
+
+#define BIG_AND_NEGATIVE -10000000.0  // as in gca.cpp
+
+// GCAlabel before the label tables, without the partial volume option
+static MRI *referenceLabel(MRI *mri_inputs, GCA *gca, TRANSFORM *transform)
+{
+  MRI *mri_dst = MRIalloc(mri_inputs->width, mri_inputs->height, mri_inputs->depth, MRI_INT);
+  MRIcopyHeader(mri_inputs, mri_dst);
+
+  for (int x = 0; x < mri_inputs->width; x++)
+    for (int y = 0; y < mri_inputs->height; y++)
+      for (int z = 0; z < mri_inputs->depth; z++) {
+        int xn, yn, zn;
+        float vals[MAX_GCA_INPUTS];
+        GCAsourceVoxelToNode(gca, mri_inputs, transform, x, y, z, &xn, &yn, &zn);
+        load_vals(mri_inputs, x, y, z, vals, gca->ninputs);
+        GCA_PRIOR *gcap = getGCAP(gca, mri_inputs, transform, x, y, z);
+        if (gcap == NULL) continue;
+
+        int label = 0;
+        float max_p = 2 * GIBBS_NEIGHBORS * BIG_AND_NEGATIVE;
+        for (int n = 0; n < gcap->nlabels; n++) {
+          GC1D *gc = GCAfindGC(gca, xn, yn, zn, gcap->labels[n]);
+          if (gc == NULL) gc = GCAfindClosestValidGC(gca, xn, yn, zn, gcap->labels[n], 0);
+          if (gc == NULL) {
+            MRIsetVoxVal(mri_dst, x, y, z, 0, 0);
+            continue;
+          }
+          double log_p = GCAcomputeConditionalLogDensity(gc, vals, gca->ninputs, gcap->labels[n]);
+          log_p += log(gcap->priors[n]);
+          float const p = log_p;
+          if (p > max_p) {
+            max_p = p;
+            label = gcap->labels[n];
+          }
+        }
+        MRIsetVoxVal(mri_dst, x, y, z, 0, label);
+      }
+  return mri_dst;
+}
+
+
+static int countDifferences(MRI *mri1, MRI *mri2)
+{
+  int ndiff = 0;
+  for (int x = 0; x < mri1->width; x++)
+    for (int y = 0; y < mri1->height; y++)
+      for (int z = 0; z < mri1->depth; z++)
+        if (MRIgetVoxVal(mri1, x, y, z, 0) != MRIgetVoxVal(mri2, x, y, z, 0)) ndiff++;
+  return ndiff;
+}
+
+static GCA *makeGCA()
+{
+  GCA *gca = GCAalloc(NINPUTS, 2.0, 4.0, WIDTH, HEIGHT, DEPTH, 0);
+  int max_label = 0;
+
+  for (int x = 0; x < gca->node_width; x++)
+    for (int y = 0; y < gca->node_height; y++)
+      for (int z = 0; z < gca->node_depth; z++) {
+        GCA_NODE *gcan = &gca->nodes[x][y][z];
+        gcan->nlabels = nint(randomNumber(0, gcan->max_labels));
+        gcan->total_training = 100;
+        for (int n = 0; n < gcan->nlabels; n++) {
+          GC1D *gc = &gcan->gcs[n];
+          gcan->labels[n] = 2 * n + nint(randomNumber(0, 1));
+          max_label = MAX(max_label, gcan->labels[n]);
+          for (int r = 0; r < NINPUTS; r++) gc->means[r] = randomNumber(0, 200);
+          // positive definite, or now and then singular
+          gc->covars[0] = randomNumber(20, 400);
+          gc->covars[2] = randomNumber(20, 400);
+          gc->covars[1] = randomNumber(0, 1) < 0.05 ? sqrt(gc->covars[0] * gc->covars[2])
+                                                     : randomNumber(-0.5, 0.5) * sqrt(gc->covars[0] * gc->covars[2]);
+          gc->ntraining = 100;
+          for (int i = 0; i < GIBBS_NEIGHBORS; i++) {
+            gc->nlabels[i] = 0;
+            gc->labels[i] = (unsigned short *)calloc(1, sizeof(unsigned short));
+            gc->label_priors[i] = (float *)calloc(1, sizeof(float));
+          }
+        }
+      }
+  for (int x = 0; x < gca->prior_width; x++)
+    for (int y = 0; y < gca->prior_height; y++)
+      for (int z = 0; z < gca->prior_depth; z++) {
+        GCA_PRIOR *gcap = &gca->priors[x][y][z];
+        gcap->nlabels = nint(randomNumber(0, gcap->max_labels));
+        gcap->total_training = 100;
+        for (int n = 0; n < gcap->nlabels; n++) {
+          gcap->labels[n] = 3 * n + nint(randomNumber(0, 2));
+          max_label = MAX(max_label, gcap->labels[n]);
+          gcap->priors[n] = randomNumber(0.01, 1);
+        }
+      }
+  gca->max_label = max_label;
+  return gca;
+}
+
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+  setRandomSeed(17L);
+  GCA *gca = makeGCA();
+  MRI *mri_inputs = MRIallocSequence(WIDTH, HEIGHT, DEPTH, MRI_FLOAT, NINPUTS);
+  for (int f = 0; f < NINPUTS; f++)
+    for (int z = 0; z < DEPTH; z++)
+      for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++) MRIsetVoxVal(mri_inputs, x, y, z, f, randomNumber(0, 200));
+  TRANSFORM *transform = TransformAlloc(LINEAR_VOX_TO_VOX, NULL);
+
+  MRI *mri_ref = referenceLabel(mri_inputs, gca, transform);
+  int nlabeled = 0;
+  for (int z = 0; z < DEPTH; z++)
+    for (int y = 0; y < HEIGHT; y++)
+      for (int x = 0; x < WIDTH; x++)
+        if (MRIgetVoxVal(mri_ref, x, y, z, 0) != 0) nlabeled++;
+  std::cout << nlabeled << " of " << WIDTH * HEIGHT * DEPTH << " voxels labeled\n";
+
+  int nfailed = nlabeled ? 0 : 1;
+  int const nthreads[2] = {1, NTHREADS};
+  for (int t = 0; t < 2; t++) {
+    setNumThreads(nthreads[t]);
+    MRI *mri_labeled = GCAlabel(mri_inputs, gca, NULL, transform);
+    int const ndiff = countDifferences(mri_ref, mri_labeled);
+    std::cout << "GCAlabel on " << nthreads[t] << " threads: " << ndiff << " labels differ\n";
+    if (ndiff) nfailed++;
+    MRIfree(&mri_labeled);
+  }
+
+  MRIfree(&mri_ref);
+  MRIfree(&mri_inputs);
+  TransformFree(&transform);
+  GCAfree(&gca);
+
+  if (nfailed) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "labels are identical\n";
+  exit(0);
+}
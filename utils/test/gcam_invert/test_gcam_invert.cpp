@@ -0,0 +1,151 @@
+//
+// test for GCAMinvert - located in utils/gcamorph.cpp
+//
+// Builds a smoothly warped morph with a few invalid nodes, computes the
+// inverse index volumes with the serial splat GCAMinvert used to do and with
+// GCAMinvert on 1 and on several threads, and checks that
+//  - GCAMinvert gives the same result for any number of threads
+//  - it is within TOLERANCE voxels of the serial splat
+//
+
+#include <math.h>
+#include <string.h>
+#include <iostream>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "romp_support.h"
+#include "mri.h"
+#include "mrinorm.h"
+#include "gcamorph.h"
+
+const char *Progname = "test_gcam_invert";
+
+#define IMAGE_WIDTH 64
+#define SPACING     2
+#define NTHREADS    4
+#define TOLERANCE   1e-3
+
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+// GCAMinvert as it was, one MRIinterpolateIntoVolume per node and volume
+static void serialInvert(GCA_MORPH *gcam, MRI **ind)
+{
+  int const width = gcam->image.width, height = gcam->image.height, depth = gcam->image.depth;
+  for (int i = 0; i < 3; i++) ind[i] = MRIalloc(width, height, depth, MRI_FLOAT);
+  MRI *mri_counts = MRIalloc(width, height, depth, MRI_FLOAT);
+  MRI *mri_ctrl   = MRIalloc(width, height, depth, MRI_UCHAR);
+
+  for (int z = 0; z < gcam->depth; z++)
+    for (int y = 0; y < gcam->height; y++)
+      for (int x = 0; x < gcam->width; x++) {
+        GCA_MORPH_NODE const *gcamn = &gcam->nodes[x][y][z];
+        if (gcamn->invalid == GCAM_POSITION_INVALID) continue;
+        double xf = gcamn->x, yf = gcamn->y, zf = gcamn->z;
+        if (xf < 0) xf = 0;
+        if (yf < 0) yf = 0;
+        if (zf < 0) zf = 0;
+        if (xf >= width) xf = width - 1;
+        if (yf >= height) yf = height - 1;
+        if (zf >= depth) zf = depth - 1;
+        MRIinterpolateIntoVolume(ind[0], xf, yf, zf, (double)x);
+        MRIinterpolateIntoVolume(ind[1], xf, yf, zf, (double)y);
+        MRIinterpolateIntoVolume(ind[2], xf, yf, zf, (double)z);
+        MRIinterpolateIntoVolume(mri_counts, xf, yf, zf, 1.0);
+      }
+
+  for (int z = 0; z < depth; z++)
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++) {
+        float const num = MRIgetVoxVal(mri_counts, x, y, z, 0);
+        if (num == 0) continue;
+        for (int i = 0; i < 3; i++) MRIFvox(ind[i], x, y, z) /= num;
+        MRIvox(mri_ctrl, x, y, z) = (num < .1) ? 0 : CONTROL_MARKED;
+      }
+  MRIfree(&mri_counts);
+
+  for (int i = 0; i < 3; i++) {
+    MRIbuildVoronoiDiagram(ind[i], mri_ctrl, ind[i]);
+    MRIsoapBubble(ind[i], mri_ctrl, ind[i], 50, 1);
+  }
+  MRIfree(&mri_ctrl);
+}
+
+
+static double maxDiff(MRI **a, MRI **b)
+{
+  double max_diff = 0;
+  for (int i = 0; i < 3; i++)
+    for (int z = 0; z < a[i]->depth; z++)
+      for (int y = 0; y < a[i]->height; y++)
+        for (int x = 0; x < a[i]->width; x++)
+          max_diff = MAX(max_diff, fabs(MRIFvox(a[i], x, y, z) - MRIFvox(b[i], x, y, z)));
+  return max_diff;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int const nnodes = IMAGE_WIDTH / SPACING;
+  GCA_MORPH *gcam = GCAMalloc(nnodes, nnodes, nnodes);
+  gcam->spacing = SPACING;
+  gcam->image.width = gcam->image.height = gcam->image.depth = IMAGE_WIDTH;
+  gcam->image.valid = 1;
+
+  // a smooth warp that compresses some regions (several nodes per voxel)
+  // and stretches others (holes for the fill), plus some invalid nodes
+  setRandomSeed(17L);
+  for (int x = 0; x < nnodes; x++)
+    for (int y = 0; y < nnodes; y++)
+      for (int z = 0; z < nnodes; z++) {
+        GCA_MORPH_NODE *gcamn = &gcam->nodes[x][y][z];
+        gcamn->x = SPACING * x + 3 * sin(0.2 * y) + randomNumber(-0.2, 0.2);
+        gcamn->y = SPACING * y + 3 * sin(0.15 * z) * cos(0.1 * x);
+        gcamn->z = SPACING * z + 2 * cos(0.25 * x);
+        if (randomNumber(0, 1) < 0.01) gcamn->invalid = GCAM_POSITION_INVALID;
+      }
+
+  MRI *ind[3];
+  setNumThreads(1);
+  serialInvert(gcam, ind);
+
+  setNumThreads(1);
+  GCAMinvert(gcam, NULL);
+  MRI *one[3] = {gcam->mri_xind, gcam->mri_yind, gcam->mri_zind};
+  gcam->mri_xind = gcam->mri_yind = gcam->mri_zind = NULL;
+
+  setNumThreads(NTHREADS);
+  GCAMinvert(gcam, NULL);
+  MRI *many[3] = {gcam->mri_xind, gcam->mri_yind, gcam->mri_zind};
+
+  int ndifferent = 0;
+  for (int i = 0; i < 3; i++)
+    for (int z = 0; z < IMAGE_WIDTH; z++)
+      for (int y = 0; y < IMAGE_WIDTH; y++)
+        if (memcmp(&MRIFvox(one[i], 0, y, z), &MRIFvox(many[i], 0, y, z), IMAGE_WIDTH * sizeof(float))) ndifferent++;
+  double const max_diff = maxDiff(one, ind);
+
+  std::cout << "rows that differ between 1 and " << NTHREADS << " threads: " << ndifferent << "\n";
+  std::cout << "max difference from the serial splat: " << max_diff << " voxels\n";
+
+  for (int i = 0; i < 3; i++) {
+    MRIfree(&ind[i]);
+    MRIfree(&one[i]);
+  }
+  GCAMfree(&gcam);
+
+  if (ndifferent || max_diff > TOLERANCE) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "inverses agree\n";
+  exit(0);
+}
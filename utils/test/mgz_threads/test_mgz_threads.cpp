@@ -0,0 +1,88 @@
+//
+// test for the multi-threaded mgz I/O - located in utils/mriio.cpp
+//
+// Writes a random float volume as a single stream mgz and as a
+// multi-member one, reads each back single threaded and multi-threaded,
+// and checks that all four reads give the volume that was written.
+//
+
+#include <string>
+#include <iostream>
+#include <unistd.h>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+
+const char *Progname = "test_mgz_threads";
+
+#define NTHREADS 4
+#define NFRAMES  3
+#define WIDTH    61      // 2.6MB of voxels, so the last of the 1MB members is partial
+
+
+static bool sameVoxels(MRI *a, MRI *b)
+{
+  if (a->width != b->width || a->height != b->height || a->depth != b->depth || a->nframes != b->nframes) return false;
+  for (int f = 0; f < a->nframes; f++)
+    for (int s = 0; s < a->depth; s++)
+      for (int r = 0; r < a->height; r++)
+        if (memcmp(a->slices[s + f * a->depth][r], b->slices[s + f * b->depth][r], a->width * a->bytes_per_vox)) return false;
+  return a->tr == b->tr && a->te == b->te;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int const nthreads = NTHREADS, nframes = NFRAMES, width = WIDTH;
+  std::string const dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  std::string const pid = std::to_string((int)getpid());
+
+  MRI *mri = MRIallocSequence(width, width, width, MRI_FLOAT, nframes);
+  if (!mri) ErrorExit(ERROR_NOMEMORY, "%s: could not allocate volume", Progname);
+  setRandomSeed(17L);
+  for (int f = 0; f < nframes; f++)
+    for (int s = 0; s < width; s++)
+      for (int r = 0; r < width; r++)
+        for (int c = 0; c < width; c++)
+          // smooth plus noise, so it compresses about as well as real data
+          MRIsetVoxVal(mri, c, r, s, f, 100 * sin(0.05 * (c + r + s + f)) + randomNumber(0.0, 10.0));
+  mri->tr = 2000;
+  mri->te = 30;
+
+  std::string const single = dir + "/test_mgz_threads." + pid + ".single.mgz";
+  std::string const multi  = dir + "/test_mgz_threads." + pid + ".multi.mgz";
+
+  std::cout << width << "^3 x " << nframes << " frames, " << nthreads << " threads\n";
+
+  int nerrors = 0;
+
+  mghSetIOThreads(1);
+  if (mghWrite(mri, single.c_str())) nerrors++;
+
+  mghSetIOThreads(nthreads);
+  if (mghWrite(mri, multi.c_str())) nerrors++;
+
+  std::string const files[] = {single, multi};
+  int const threads[] = {1, nthreads};
+  for (int i = 0; i < 2; i++) {
+    for (int t = 0; t < 2; t++) {
+      mghSetIOThreads(threads[t]);
+      MRI *in = mghRead(files[i].c_str());
+      bool const same = in && sameVoxels(mri, in);
+      std::cout << "read " << (i ? "multi-member " : "single stream") << " with " << threads[t]
+                << " threads: " << (same ? "ok" : "differs from what was written!") << "\n";
+      if (!same) nerrors++;
+      if (in) MRIfree(&in);
+    }
+  }
+
+  unlink(single.c_str());
+  unlink(multi.c_str());
+  MRIfree(&mri);
+
+  if (nerrors) exit(1);
+  std::cout << "all reads match\n";
+  exit(0);
+}
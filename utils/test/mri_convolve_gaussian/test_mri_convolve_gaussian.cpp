@@ -0,0 +1,202 @@
+//
+// test for the Gaussian smoothing backends - located in utils/mrifilter.cpp
+//
+// For a range of sigmas, smooths a random float volume with
+//  - the voxel at a time MRIconvolve1d float loops MRIconvolveGaussian used to run,
+//  - MRIconvolveGaussian (row-vectorized FIR), which must give identical results,
+//  - MRIconvolveGaussianRecursive (Deriche IIR) on 1 and on several threads,
+//    which must give identical results.
+// An impulse smoothed with the IIR must sum to 1 and match a sampled
+// Gaussian to within 0.15% of its peak (0.05% per axis).
+// Then smooths an anisotropic volume with MRIgaussianSmoothNI, which uses
+// the IIR for wide Gaussians, and with its smoothing matrices (forced with
+// FREESURFER_MRIgaussianSmoothNI_fir): they must agree within NI_TOLERANCE
+// of the data range (and not be identical, or the recursive filter was not
+// used), and narrow Gaussians must not change at all.
+//
+
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+
+const char *Progname = "test_mri_convolve_gaussian";
+
+#define WIDTH        40
+#define IMPULSE_SIZE 61
+#define NTHREADS     4
+#define NI_TOLERANCE 5e-4
+
+
+// the float -> float MRIconvolve1d loops MRIconvolveGaussian used to run
+static void referenceConvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis)
+{
+  int const halflen = len / 2;
+  for (int z = 0; z < mri_src->depth; z++)
+    for (int y = 0; y < mri_src->height; y++)
+      for (int x = 0; x < mri_src->width; x++) {
+        float total = 0.0f;
+        for (int i = 0; i < len; i++) {
+          switch (axis) {
+            case MRI_WIDTH:
+              total += k[i] * MRIFvox(mri_src, mri_src->xi[x + i - halflen], y, z);
+              break;
+            case MRI_HEIGHT:
+              total += k[i] * MRIFvox(mri_src, x, mri_src->yi[y + i - halflen], z);
+              break;
+            default:
+              total += k[i] * MRIFvox(mri_src, x, y, mri_src->zi[z + i - halflen]);
+              break;
+          }
+        }
+        MRIFvox(mri_dst, x, y, z) = total;
+      }
+}
+
+
+static MRI *referenceConvolveGaussian(MRI *mri_src, MRI *mri_kernel)
+{
+  MRI *mri_tmp = MRIclone(mri_src, NULL), *mri_dst = MRIclone(mri_src, NULL);
+  float *k = &MRIFvox(mri_kernel, 0, 0, 0);
+  referenceConvolve1d(mri_src, mri_tmp, k, mri_kernel->width, MRI_WIDTH);
+  referenceConvolve1d(mri_tmp, mri_dst, k, mri_kernel->width, MRI_HEIGHT);
+  referenceConvolve1d(mri_dst, mri_tmp, k, mri_kernel->width, MRI_DEPTH);
+  MRIfree(&mri_dst);
+  return mri_tmp;
+}
+
+
+static double maxDifference(MRI *a, MRI *b, int *ndiffs)
+{
+  double dmax = 0;
+  *ndiffs = 0;
+  for (int s = 0; s < a->depth; s++)
+    for (int r = 0; r < a->height; r++)
+      for (int c = 0; c < a->width; c++) {
+        float const va = MRIFvox(a, c, r, s), vb = MRIFvox(b, c, r, s);
+        if (va != vb) (*ndiffs)++;
+        dmax = MAX(dmax, (double)fabs(va - vb));
+      }
+  return dmax;
+}
+
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+// MRIgaussianSmoothNI with the recursive filter allowed or not
+static MRI *smoothNI(MRI *src, double cstd, double rstd, double sstd, bool fir)
+{
+  if (fir)
+    setenv("FREESURFER_MRIgaussianSmoothNI_fir", "1", 1);
+  else
+    unsetenv("FREESURFER_MRIgaussianSmoothNI_fir");
+  MRI *mri = MRIgaussianSmoothNI(src, cstd, rstd, sstd, NULL);
+  unsetenv("FREESURFER_MRIgaussianSmoothNI_fir");
+  return mri;
+}
+
+
+int main(int argc, char *argv[])
+{
+  MRI *mri = MRIalloc(WIDTH, WIDTH, WIDTH, MRI_FLOAT);
+  if (!mri) ErrorExit(ERROR_NOMEMORY, "%s: could not allocate volume", Progname);
+  setRandomSeed(17L);
+  for (int s = 0; s < WIDTH; s++)
+    for (int r = 0; r < WIDTH; r++)
+      for (int c = 0; c < WIDTH; c++) MRIFvox(mri, c, r, s) = randomNumber(0.0, 100.0);
+
+  int nerrors = 0;
+  float const sigmas[] = {0.5, 1, 2, 3, 5};
+  for (unsigned int n = 0; n < sizeof(sigmas) / sizeof(sigmas[0]); n++) {
+    float const sigma = sigmas[n];
+    MRI *mri_kernel = MRIgaussian1d(sigma, -1);
+    MRI *ref = referenceConvolveGaussian(mri, mri_kernel);
+    MRI *fir = MRIconvolveGaussian(mri, NULL, mri_kernel);
+    setNumThreads(1);
+    MRI *one = MRIconvolveGaussianRecursive(mri, NULL, sigma);
+    setNumThreads(NTHREADS);
+    MRI *many = MRIconvolveGaussianRecursive(mri, NULL, sigma);
+
+    int fir_diffs, iir_diffs;
+    maxDifference(ref, fir, &fir_diffs);
+    maxDifference(one, many, &iir_diffs);
+    std::cout << "sigma " << sigma << " (" << mri_kernel->width << " taps): FIR voxels differ " << fir_diffs
+              << ", IIR voxels differ between thread counts " << iir_diffs << "\n";
+    nerrors += fir_diffs + iir_diffs;
+
+    MRIfree(&mri_kernel);
+    MRIfree(&ref);
+    MRIfree(&fir);
+    MRIfree(&one);
+    MRIfree(&many);
+  }
+  MRIfree(&mri);
+
+  // impulse response of the IIR against a sampled Gaussian
+  for (float sigma = 1; sigma <= 4; sigma *= 2) {
+    MRI *impulse = MRIalloc(IMPULSE_SIZE, IMPULSE_SIZE, IMPULSE_SIZE, MRI_FLOAT);
+    int const c = IMPULSE_SIZE / 2;
+    MRIFvox(impulse, c, c, c) = 1;
+    MRIconvolveGaussianRecursive(impulse, impulse, sigma);
+
+    double gsum = 0, sum = 0, emax = 0;
+    for (int x = -c; x <= c; x++) gsum += exp(-x * x / (2.0 * sigma * sigma));
+    double const peak = 1 / (gsum * gsum * gsum);
+    for (int s = 0; s < IMPULSE_SIZE; s++)
+      for (int r = 0; r < IMPULSE_SIZE; r++)
+        for (int q = 0; q < IMPULSE_SIZE; q++) {
+          double const r2 = (q - c) * (q - c) + (r - c) * (r - c) + (s - c) * (s - c);
+          double const g = peak * exp(-r2 / (2.0 * sigma * sigma));
+          sum += MRIFvox(impulse, q, r, s);
+          emax = MAX(emax, fabs(MRIFvox(impulse, q, r, s) - g));
+        }
+    std::cout << "IIR impulse sigma " << sigma << ": sum " << sum << ", max error " << 100 * emax / peak
+              << "% of peak\n";
+    if (fabs(sum - 1) > 1e-4 || emax > 3 * 0.0005 * peak) nerrors++;
+    MRIfree(&impulse);
+  }
+
+  // MRIgaussianSmoothNI: recursive filter against the smoothing matrices on
+  // an anisotropic volume, stds in mm
+  MRI *ani = MRIalloc(48, 40, 36, MRI_FLOAT);
+  ani->xsize = 1.0;
+  ani->ysize = 1.5;
+  ani->zsize = 2.0;
+  for (int s = 0; s < ani->depth; s++)
+    for (int r = 0; r < ani->height; r++)
+      for (int c = 0; c < ani->width; c++) MRIFvox(ani, c, r, s) = randomNumber(0.0, 100.0);
+  double const stds[][3] = {{4.0, 6.0, 8.0}, {4.5, 0.0, 6.0}, {3.0, 3.0, 3.0}};
+  for (unsigned int n = 0; n < sizeof(stds) / sizeof(stds[0]); n++) {
+    MRI *iir = smoothNI(ani, stds[n][0], stds[n][1], stds[n][2], false);
+    MRI *fir = smoothNI(ani, stds[n][0], stds[n][1], stds[n][2], true);
+    int ndiffs;
+    double const diff = maxDifference(iir, fir, &ndiffs) / 100.0;
+    // 3mm is 1.5 voxels in z, below MRI_GAUSSIAN_IIR_MIN_SIGMA, so that one
+    // keeps the matrices and must be identical
+    bool const narrow = stds[n][2] / ani->zsize < MRI_GAUSSIAN_IIR_MIN_SIGMA;
+    std::cout << "MRIgaussianSmoothNI std " << stds[n][0] << " " << stds[n][1] << " " << stds[n][2]
+              << " mm: max |IIR-FIR| " << diff << " of the range" << (narrow ? " (matrices only)" : "") << "\n";
+    if (narrow ? ndiffs != 0 : (ndiffs == 0 || diff > NI_TOLERANCE)) nerrors++;
+    MRIfree(&iir);
+    MRIfree(&fir);
+  }
+  MRIfree(&ani);
+
+  if (nerrors) {
+    std::cout << nerrors << " mismatches!\n";
+    exit(1);
+  }
+  std::cout << "all smoothings agree\n";
+  exit(0);
+}
@@ -0,0 +1,139 @@
+//
+// test for the typed voxel access - located in include/mri_iterate.h
+//
+// For each voxel type, writes the same values (including ones out of the
+// range of the type, which have to be clipped and rounded) with MRIsetVoxVal
+// and with MRIsetRowVals, and checks that the volumes are identical.  Then
+// checks that MRIgetRowVals, MRIrow<T>, MRIforEachVoxel and MRIvoxelReader
+// all read what MRIgetVoxVal reads.
+//
+
+#include <vector>
+#include <iostream>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+#include "mri_iterate.h"
+
+const char *Progname = "test_mri_iterate";
+
+#define WIDTH   23
+#define HEIGHT  19
+#define DEPTH   11
+#define NFRAMES 3
+
+
+// sum of all the voxels of a frame, through typed rows
+struct SumTyped {
+  MRI *mri;
+  int f;
+  double sum;
+  template <class T> void operator()(T *) {
+    for (int s = 0; s < mri->depth; s++)
+      for (int r = 0; r < mri->height; r++) {
+        T const *row = MRIrow<T>((MRI const *)mri, r, s, f);
+        for (int c = 0; c < mri->width; c++) sum += (float)row[c];
+      }
+  }
+};
+
+// the same sum through MRIforEachVoxel
+struct SumVoxels {
+  double sum;
+  template <class T> void operator()(T &voxel, int c, int r, int s) { sum += (float)voxel; }
+};
+
+struct SumForEach {
+  MRI *mri;
+  int f;
+  double sum;
+  template <class T> void operator()(T *) {
+    SumVoxels op = {0.0};
+    MRIforEachVoxel<T>(mri, f, op);
+    sum += op.sum;
+  }
+};
+
+
+int main(int argc, char *argv[])
+{
+  // not MRI_LONG: MRIsetVoxVal writes it through both a long and a long32
+  // pointer, so it is not a reference for anything
+  int const types[] = {MRI_UCHAR, MRI_SHORT, MRI_USHRT, MRI_INT, MRI_FLOAT};
+  char const * const names[] = {"uchar", "short", "ushort", "int", "float"};
+
+  int nerrors = 0;
+  setRandomSeed(17L);
+  for (unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    MRI *mri = MRIallocSequence(WIDTH, HEIGHT, DEPTH, types[t], NFRAMES);
+    MRI *out = MRIallocSequence(WIDTH, HEIGHT, DEPTH, types[t], NFRAMES);
+    if (!mri || !out) ErrorExit(ERROR_NOMEMORY, "%s: could not allocate volumes", Progname);
+
+    int c, r, s, f, nwrong = 0, ntype_errors = 0;
+    std::vector<double> vals(WIDTH);
+    std::vector<float> frow(WIDTH);
+    std::vector<double> drow(WIDTH);
+
+    // writes: values from well below to well above the range of every type,
+    // with fractions so the rounding is exercised
+    for (f = 0; f < NFRAMES; f++)
+      for (s = 0; s < DEPTH; s++)
+        for (r = 0; r < HEIGHT; r++) {
+          for (c = 0; c < WIDTH; c++) {
+            vals[c] = nint(randomNumber(-80000.0, 80000.0)) + (c % 4) * 0.25;
+            MRIsetVoxVal(mri, c, r, s, f, vals[c]);
+          }
+          MRIsetRowVals(out, r, s, f, &vals[0]);
+        }
+    for (f = 0; f < NFRAMES; f++)
+      for (s = 0; s < DEPTH; s++)
+        for (r = 0; r < HEIGHT; r++)
+          for (c = 0; c < WIDTH; c++)
+            if (MRIgetVoxVal(mri, c, r, s, f) != MRIgetVoxVal(out, c, r, s, f)) nwrong++;
+    if (nwrong) std::cout << names[t] << ": MRIsetRowVals and MRIsetVoxVal differ at " << nwrong << " voxels\n";
+    ntype_errors += nwrong;
+
+    // reads
+    MRIvoxelReader reader(mri);
+    for (f = 0; f < NFRAMES; f++) {
+      double vox_sum = 0;
+      nwrong = 0;
+      for (s = 0; s < DEPTH; s++)
+        for (r = 0; r < HEIGHT; r++) {
+          MRIgetRowVals(mri, r, s, f, &frow[0]);
+          MRIgetRowVals(mri, r, s, f, &drow[0]);
+          for (c = 0; c < WIDTH; c++) {
+            float const v = MRIgetVoxVal(mri, c, r, s, f);
+            vox_sum += v;
+            if (frow[c] != v || drow[c] != v || reader(c, r, s, f) != v) nwrong++;
+          }
+        }
+      if (nwrong) std::cout << names[t] << ": row or reader values differ at " << nwrong << " voxels\n";
+      ntype_errors += nwrong;
+
+      SumTyped typed = {mri, f, 0.0};
+      MRIdispatchType(mri->type, typed);
+      SumForEach each = {mri, f, 0.0};
+      MRIdispatchType(mri->type, each);
+      if (typed.sum != vox_sum || each.sum != vox_sum) {
+        std::cout << names[t] << ": frame " << f << " sums differ " << vox_sum << " " << typed.sum << " "
+                  << each.sum << "\n";
+        ntype_errors++;
+      }
+    }
+    std::cout << names[t] << ": " << (ntype_errors ? "FAILED" : "ok") << "\n";
+    nerrors += ntype_errors;
+
+    MRIfree(&mri);
+    MRIfree(&out);
+  }
+
+  if (nerrors) {
+    std::cout << nerrors << " mismatches!\n";
+    exit(1);
+  }
+  std::cout << "all access paths agree\n";
+  exit(0);
+}
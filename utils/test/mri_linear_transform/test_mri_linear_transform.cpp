@@ -0,0 +1,155 @@
+//
+// test for the affine resampler - located in utils/mri.cpp MRIlinearTransformInterp
+//
+// For each voxel type and for nearest, trilinear and cubic bspline sampling,
+// resamples a small multi-frame volume through a rotation and a pure shift,
+// with the voxel at a time MatrixMultiply / MRIsampleVolumeFrameType /
+// MRIsetVoxVal loop MRIlinearTransformInterp used to be and with
+// MRIlinearTransformInterp on 1 and on several threads.  The results must be
+// identical.
+//
+
+#include <iostream>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "matrix.h"
+#include "mri.h"
+#include "mriBSpline.h"
+
+const char *Progname = "test_mri_linear_transform";
+
+#define NFRAMES  2
+#define WIDTH    24
+#define NTHREADS 4
+
+
+// the loop MRIlinearTransformInterp used to be
+static MRI *referenceLinearTransformInterp(MRI *mri_src, MATRIX *mA, int InterpMethod)
+{
+  MATRIX *mAinv = MatrixInverse(mA, NULL);
+  MRI *mri_dst = MRIclone(mri_src, NULL);
+  if (!FZERO(mri_src->outside_val)) MRIsetValues(mri_dst, mri_src->outside_val);
+
+  MRI_BSPLINE *bspline = NULL;
+  if (InterpMethod == SAMPLE_CUBIC_BSPLINE) bspline = MRItoBSpline(mri_src, NULL, 3);
+
+  VECTOR *v_X = VectorAlloc(4, MATRIX_REAL);
+  VECTOR *v_Y = VectorAlloc(4, MATRIX_REAL);
+  v_Y->rptr[4][1] = 1.0f;
+  double val;
+  for (int y3 = 0; y3 < mri_dst->depth; y3++) {
+    V3_Z(v_Y) = y3;
+    for (int y2 = 0; y2 < mri_dst->height; y2++) {
+      V3_Y(v_Y) = y2;
+      for (int y1 = 0; y1 < mri_dst->width; y1++) {
+        V3_X(v_Y) = y1;
+        MatrixMultiply(mAinv, v_Y, v_X);
+        for (int frame = 0; frame < mri_src->nframes; frame++) {
+          if (bspline)
+            MRIsampleBSpline(bspline, V3_X(v_X), V3_Y(v_X), V3_Z(v_X), frame, &val);
+          else
+            MRIsampleVolumeFrameType(mri_src, V3_X(v_X), V3_Y(v_X), V3_Z(v_X), frame, InterpMethod, &val);
+          MRIsetVoxVal(mri_dst, y1, y2, y3, frame, val);
+        }
+      }
+    }
+  }
+  if (bspline) MRIfreeBSpline(&bspline);
+  MatrixFree(&v_X);
+  MatrixFree(&v_Y);
+  MatrixFree(&mAinv);
+  return mri_dst;
+}
+
+
+static int countDifferences(MRI *a, MRI *b)
+{
+  int n = 0;
+  for (int f = 0; f < a->nframes; f++)
+    for (int s = 0; s < a->depth; s++)
+      for (int r = 0; r < a->height; r++)
+        for (int c = 0; c < a->width; c++)
+          if (MRIgetVoxVal(a, c, r, s, f) != MRIgetVoxVal(b, c, r, s, f)) n++;
+  return n;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int const nframes = NFRAMES, width = WIDTH;
+
+  int const types[] = {MRI_UCHAR, MRI_SHORT, MRI_INT, MRI_FLOAT};
+  char const * const typeNames[] = {"uchar", "short", "int", "float"};
+  int const methods[] = {SAMPLE_NEAREST, SAMPLE_TRILINEAR, SAMPLE_CUBIC_BSPLINE};
+  char const * const methodNames[] = {"nearest", "trilinear", "bspline"};
+
+  // a small rotation about the center with a sub-voxel shift, and a whole voxel shift
+  MATRIX *m_rotate = MatrixIdentity(4, NULL);
+  double const angle = 0.2, center = width / 2.0;
+  *MATRIX_RELT(m_rotate, 1, 1) = cos(angle);
+  *MATRIX_RELT(m_rotate, 1, 2) = -sin(angle);
+  *MATRIX_RELT(m_rotate, 2, 1) = sin(angle);
+  *MATRIX_RELT(m_rotate, 2, 2) = cos(angle);
+  *MATRIX_RELT(m_rotate, 1, 4) = center - cos(angle) * center + sin(angle) * center + 0.3;
+  *MATRIX_RELT(m_rotate, 2, 4) = center - sin(angle) * center - cos(angle) * center - 0.7;
+  *MATRIX_RELT(m_rotate, 3, 4) = 0.45;
+  MATRIX *m_shift = MatrixIdentity(4, NULL);
+  *MATRIX_RELT(m_shift, 1, 4) = 2;
+  *MATRIX_RELT(m_shift, 3, 4) = -1;
+  MATRIX *transforms[] = {m_rotate, m_shift};
+  char const * const transformNames[] = {"rotate", "shift"};
+
+  int nerrors = 0;
+  setRandomSeed(17L);
+  for (unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    MRI *mri = MRIallocSequence(width, width, width, types[t], nframes);
+    if (!mri) ErrorExit(ERROR_NOMEMORY, "%s: could not allocate volume", Progname);
+    for (int f = 0; f < nframes; f++)
+      for (int s = 0; s < width; s++)
+        for (int r = 0; r < width; r++)
+          for (int c = 0; c < width; c++) MRIsetVoxVal(mri, c, r, s, f, randomNumber(0.0, 250.0));
+
+    for (unsigned int m = 0; m < sizeof(methods) / sizeof(methods[0]); m++)
+      for (unsigned int x = 0; x < sizeof(transforms) / sizeof(transforms[0]); x++) {
+        MRI *ref = referenceLinearTransformInterp(mri, transforms[x], methods[m]);
+
+#ifdef HAVE_OPENMP
+        omp_set_num_threads(1);
+#endif
+        MRI *one = MRIlinearTransformInterp(mri, NULL, transforms[x], methods[m]);
+
+#ifdef HAVE_OPENMP
+        omp_set_num_threads(NTHREADS);
+#endif
+        MRI *all = MRIlinearTransformInterp(mri, NULL, transforms[x], methods[m]);
+
+        int const diffs = countDifferences(ref, one) + countDifferences(ref, all);
+        nerrors += diffs;
+
+        std::cout << typeNames[t] << " " << methodNames[m] << " " << transformNames[x] << ": ";
+        if (diffs)
+          std::cout << diffs << " voxels differ\n";
+        else
+          std::cout << "ok\n";
+
+        MRIfree(&ref);
+        MRIfree(&one);
+        MRIfree(&all);
+      }
+
+    MRIfree(&mri);
+  }
+
+  MatrixFree(&m_rotate);
+  MatrixFree(&m_shift);
+
+  if (nerrors) {
+    std::cout << nerrors << " mismatches!\n";
+    exit(1);
+  }
+  std::cout << "all resamplings agree\n";
+  exit(0);
+}
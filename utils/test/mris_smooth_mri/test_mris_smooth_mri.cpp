@@ -0,0 +1,149 @@
+//
+// test for the surface smoother - located in utils/mrisurf_mri.cpp MRISsmoothMRIFast
+//
+// Smooths a random overlay on a bumpy icosahedral surface, with some
+// vertices ripped and some out of the mask, with the frame at a time pointer
+// loop MRISsmoothMRIFast used to be and with MRISsmoothMRIFast on 1 and on
+// several threads.  The number of frames is not a multiple of the block of
+// frames MRISsmoothMRIFast works on.  The results must be identical.
+//
+
+#include <math.h>
+#include <vector>
+#include <iostream>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mri.h"
+#include "mrisurf.h"
+#include "icosahedron.h"
+
+const char *Progname = "test_mris_smooth_mri";
+
+#define NFRAMES  37
+#define NSTEPS   5
+#define NTHREADS 4
+
+
+// the loop MRISsmoothMRIFast used to be, for nvertices x 1 x 1 float overlays
+static MRI *referenceSmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask)
+{
+  MRI *Targ = MRIcopy(Src, NULL);
+  std::vector<float *> pF;
+  std::vector<int> nNbrs, rip(Surf->nvertices);
+  std::vector<float> tF(Surf->nvertices);
+
+  for (int frame = 0; frame < Src->nframes; frame++) {
+    pF.clear();
+    nNbrs.clear();
+    for (int vno = 0; vno < Surf->nvertices; vno++) {
+      if (IncMask && MRIgetVoxVal(IncMask, vno, 0, 0, 0) < 0.5) {
+        rip[vno] = 1;
+        MRIFseq_vox(Targ, vno, 0, 0, frame) = 0;
+        continue;
+      }
+      rip[vno] = 0;
+      pF.push_back(&MRIFseq_vox(Targ, vno, 0, 0, frame));
+      int num = 1;
+      for (int nthnbr = 0; nthnbr < Surf->vertices_topology[vno].vnum; nthnbr++) {
+        int const nbrvno = Surf->vertices_topology[vno].v[nthnbr];
+        if (Surf->vertices[nbrvno].ripflag) continue;
+        if (IncMask && MRIgetVoxVal(IncMask, nbrvno, 0, 0, 0) < 0.5) continue;
+        pF.push_back(&MRIFseq_vox(Targ, nbrvno, 0, 0, frame));
+        num++;
+      }
+      nNbrs.push_back(num);
+    }
+
+    for (int nthstep = 0; nthstep < nSmoothSteps; nthstep++) {
+      float **p = &pF[0];
+      int n = 0, t = 0;
+      for (int vno = 0; vno < Surf->nvertices; vno++) {
+        if (rip[vno]) continue;
+        float sumF = *(*p++);
+        for (int nthnbr = 0; nthnbr < nNbrs[n] - 1; nthnbr++) sumF += *(*p++);
+        tF[t++] = sumF / nNbrs[n];
+        n++;
+      }
+      t = 0;
+      for (int vno = 0; vno < Surf->nvertices; vno++) {
+        if (rip[vno]) continue;
+        MRIsetVoxVal(Targ, vno, 0, 0, frame, tF[t++]);
+      }
+    }
+  }
+  return Targ;
+}
+
+
+static int countDifferences(MRI *a, MRI *b)
+{
+  int n = 0;
+  for (int f = 0; f < a->nframes; f++)
+    for (int c = 0; c < a->width; c++)
+      if (MRIgetVoxVal(a, c, 0, 0, f) != MRIgetVoxVal(b, c, 0, 0, f)) n++;
+  return n;
+}
+
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+  MRIS *mris = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    float r = 100 + 10 * sin(3 * v->x) * cos(2 * v->y) + 5 * sin(4 * v->z);
+    MRISsetXYZ(mris, vno, r * v->x, r * v->y, r * v->z);
+  }
+  MRIScomputeMetricProperties(mris);
+
+  // rip every 50th vertex and leave every 20th out of the mask
+  setRandomSeed(17L);
+  MRI *src = MRIallocSequence(mris->nvertices, 1, 1, MRI_FLOAT, NFRAMES);
+  MRI *mask = MRIalloc(mris->nvertices, 1, 1, MRI_FLOAT);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    for (int f = 0; f < NFRAMES; f++) MRIsetVoxVal(src, vno, 0, 0, f, randomNumber(-1.0, 1.0));
+    MRIsetVoxVal(mask, vno, 0, 0, 0, (vno % 20) ? 1 : 0);
+    if (vno % 50 == 1) mris->vertices[vno].ripflag = 1;
+  }
+
+  int nerrors = 0;
+  for (int m = 0; m < 2; m++) {
+    MRI *incmask = m ? mask : NULL;
+
+    MRI *ref = referenceSmoothMRIFast(mris, src, NSTEPS, incmask);
+    setNumThreads(1);
+    MRI *one = MRISsmoothMRIFast(mris, src, NSTEPS, incmask, NULL);
+    setNumThreads(NTHREADS);
+    MRI *many = MRISsmoothMRIFast(mris, src, NSTEPS, incmask, NULL);
+
+    int const one_diffs = countDifferences(ref, one), many_diffs = countDifferences(ref, many);
+    std::cout << (incmask ? "   mask" : "no mask") << ": values that differ on 1 thread " << one_diffs << ", on "
+              << NTHREADS << " threads " << many_diffs << "\n";
+    nerrors += one_diffs + many_diffs;
+
+    MRIfree(&ref);
+    MRIfree(&one);
+    MRIfree(&many);
+  }
+
+  MRIfree(&src);
+  MRIfree(&mask);
+  MRISfree(&mris);
+
+  if (nerrors) {
+    std::cout << nerrors << " mismatches!\n";
+    exit(1);
+  }
+  std::cout << "all smoothings agree\n";
+  exit(0);
+}
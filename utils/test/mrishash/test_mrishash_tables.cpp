@@ -0,0 +1,151 @@
+//
+// test for the MRIS hash table bucket storage - located in utils/mrishash.cpp
+//
+// Builds many short-lived face and vertex tables over a bumpy icosahedral
+// surface at several resolutions, the way mris_fix_topology and
+// mris_make_surfaces use them, and checks every probe against a brute force
+// search.  Also removes the faces of some vertices from a face table and
+// checks that they are no longer found, and that adding them back restores
+// the original answers.
+//
+
+#include <math.h>
+#include <vector>
+#include <iostream>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mrisurf.h"
+#include "mrishash.h"
+#include "icosahedron.h"
+
+const char *Progname = "test_mrishash_tables";
+
+#define NPROBES 2000
+
+
+// closest vertex by brute force, as the vertex tables measure it
+static int bruteForceClosestVertex(MRIS *mris, float x, float y, float z, double *pdist)
+{
+  int min_vno = -1;
+  double min_dsq = 1e30;
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const *v = &mris->vertices[vno];
+    double dsq = SQR(v->x - x) + SQR(v->y - y) + SQR(v->z - z);
+    if (dsq < min_dsq) {
+      min_dsq = dsq;
+      min_vno = vno;
+    }
+  }
+  *pdist = sqrt(min_dsq);
+  return min_vno;
+}
+
+
+int main(int argc, char *argv[])
+{
+  MRIS *mris = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    float r = 100 + 10 * sin(3 * v->x) * cos(2 * v->y) + 5 * sin(4 * v->z);
+    MRISsetXYZ(mris, vno, r * v->x, r * v->y, r * v->z);
+  }
+  MRIScomputeMetricProperties(mris);
+
+  setRandomSeed(17L);
+  std::vector<float> px(NPROBES), py(NPROBES), pz(NPROBES);
+  for (int i = 0; i < NPROBES; i++) {
+    VERTEX const *v = &mris->vertices[(int)(randomNumber(0.0, mris->nvertices - 1.0))];
+    px[i] = v->x + randomNumber(-3, 3);
+    py[i] = v->y + randomNumber(-3, 3);
+    pz[i] = v->z + randomNumber(-3, 3);
+  }
+  std::vector<double> vdist(NPROBES);
+  std::vector<float> fdist(NPROBES);
+  std::vector<int> fnos(NPROBES);
+  for (int i = 0; i < NPROBES; i++) {
+    bruteForceClosestVertex(mris, px[i], py[i], pz[i], &vdist[i]);
+    fnos[i] = MHTBruteForceClosestFace(mris, px[i], py[i], pz[i], CURRENT_VERTICES, &fdist[i]);
+  }
+
+  int nfailed = 0;
+  float const resolutions[] = {1, 2, 4, 8};
+  for (unsigned int r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+    float const resolution = resolutions[r];
+    double const max_dist = 4 * resolution;
+
+    // vertex tables: whenever the closest vertex is well inside the search
+    // radius the table has to return it
+    int nvfound = 0, nvwrong = 0;
+    for (int n = 0; n < 3; n++) {
+      MRIS_HASH_TABLE *mht = MHTcreateVertexTable_Resolution(mris, CURRENT_VERTICES, resolution);
+      for (int i = n; i < NPROBES; i += 3) {
+        double bdist = vdist[i], dist = 0;
+        int vno = -1;
+        MHTfindClosestVertexGeneric(mht, px[i], py[i], pz[i], max_dist, -1, &vno, &dist);
+        if (vno >= 0) nvfound++;
+        if (bdist < max_dist / 2 && (vno < 0 || fabs(dist - bdist) > 1e-4)) nvwrong++;
+        if (vno >= 0 && dist < bdist - 1e-4) nvwrong++;
+      }
+      MHTfree(&mht);
+    }
+
+    // face tables, measured to the face centroids as MHTBruteForceClosestFace does
+    int nffound = 0, nfwrong = 0;
+    for (int n = 0; n < 3; n++) {
+      MRIS_HASH_TABLE *mht = MHTcreateFaceTable_Resolution(mris, CURRENT_VERTICES, resolution);
+      for (int i = n; i < NPROBES; i += 3) {
+        float bdist = fdist[i];
+        FACE *face = NULL;
+        int fno = -1, bfno = fnos[i];
+        double dist = 0;
+        MHTfindClosestFaceGeneric(mht, mris, px[i], py[i], pz[i], max_dist, -1, -1, &face, &fno, &dist);
+        if (fno >= 0) nffound++;
+        if (bfno >= 0 && bdist < max_dist / 2 && (fno < 0 || fabs(dist - bdist) > 1e-3)) nfwrong++;
+        if (fno >= 0 && dist < bdist - 1e-3) nfwrong++;
+      }
+      MHTfree(&mht);
+    }
+
+    std::cout << "resolution " << resolution << "mm: vertices found " << nvfound << ", wrong " << nvwrong
+              << "; faces found " << nffound << ", wrong " << nfwrong << "\n";
+    if (nvwrong || nfwrong) nfailed++;
+  }
+
+  // removing the faces of a vertex takes them out of every bucket they were in
+  {
+    MRIS_HASH_TABLE *mht = MHTcreateFaceTable_Resolution(mris, CURRENT_VERTICES, 1.0);
+    int nwrong = 0;
+    for (int vno = 0; vno < mris->nvertices; vno += 97) {
+      VERTEX_TOPOLOGY const *vt = &mris->vertices_topology[vno];
+      VERTEX const *v = &mris->vertices[vno];
+      FACE *face = NULL;
+      int fno = -1;
+      double dist;
+
+      MHTremoveAllFaces(mht, mris, vno);
+      MHTfindClosestFaceGeneric(mht, mris, v->x, v->y, v->z, 8.0, -1, -1, &face, &fno, &dist);
+      for (int n = 0; n < vt->num; n++)
+        if (fno == vt->f[n]) nwrong++;
+
+      MHTaddAllFaces(mht, mris, vno);
+      float bdist;
+      int bfno = MHTBruteForceClosestFace(mris, v->x, v->y, v->z, CURRENT_VERTICES, &bdist);
+      MHTfindClosestFaceGeneric(mht, mris, v->x, v->y, v->z, 8.0, -1, -1, &face, &fno, &dist);
+      if (bfno >= 0 && (fno < 0 || fabs(dist - bdist) > 1e-3)) nwrong++;
+    }
+    MHTfree(&mht);
+    std::cout << "remove/add faces: wrong " << nwrong << "\n";
+    if (nwrong) nfailed++;
+  }
+
+  MRISfree(&mris);
+
+  if (nfailed) {
+    std::cout << "hash tables disagree with brute force!\n";
+    exit(1);
+  }
+  std::cout << "hash tables agree with brute force\n";
+  exit(0);
+}
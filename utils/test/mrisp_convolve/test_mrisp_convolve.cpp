@@ -0,0 +1,252 @@
+//
+// test for the spherical Gaussian blurs - located in utils/mrisp.cpp
+//
+// Blurs a random MRI_SP with the pixel at a time loop MRISPconvolveGaussian
+// used to be, evaluated in double, and with MRISPconvolveGaussian on 1 and on
+// several threads and in place.  The results must agree with the loop within
+// TOLERANCE, and with each other exactly.
+// Then blurs with MRISPblur at sigmas that have the same cartesian kernel
+// length, in turn, and checks each against a direct evaluation of its kernel,
+// so a kernel table left from a previous call would be found.
+//
+
+#include <iostream>
+#include <vector>
+
+#include "romp_support.h"
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mrisurf.h"
+
+const char *Progname = "test_mrisp_convolve";
+
+#define SCALE     0.5
+#define NFRAMES   2
+#define RADIUS    100.0f
+#define NTHREADS  4
+#define TOLERANCE 1e-6
+#define MAX_LEN   4
+#define MAX_KLEN  50
+
+// angle between two radius vectors, accurate for small angles
+static double angleBetween(double const *a, double const *b)
+{
+  double const cx = a[1] * b[2] - a[2] * b[1], cy = a[2] * b[0] - a[0] * b[2], cz = a[0] * b[1] - a[1] * b[0];
+  return atan2(sqrt(cx * cx + cy * cy + cz * cz), a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+}
+
+// the loop MRISPconvolveGaussian used to be, in double
+static MRI_SP *referenceConvolveGaussian(MRI_SP *mrisp_src, float sigma, float radius)
+{
+  int u, v, klen, khalf, uk, vk, u1, v1, voff, fno;
+  double d, k, total, ktotal, sigma_sq_inv, theta, phi, theta1, phi1, sin_phi, cos_phi, sin_phi1, cos_phi1;
+  double vec1[3], vec2[3], circumference = 2.0 * M_PI * radius, angle;
+  MRI_SP *mrisp_dst = MRISPclone(mrisp_src);
+  IMAGE *Ip_src = mrisp_src->Ip;
+
+  if (FZERO(sigma))
+    sigma_sq_inv = 100000.0;
+  else
+    sigma_sq_inv = 1.0f / (sigma * sigma);
+
+  for (fno = 0; fno < Ip_src->num_frame; fno++) {
+    for (u = 0; u < U_DIM(mrisp_src); u++) {
+      phi = (double)u * PHI_MAX / PHI_DIM(mrisp_src);
+      sin_phi = sin(phi);
+      cos_phi = cos(phi);
+
+      for (v = 0; v < V_DIM(mrisp_src); v++) {
+        theta = (double)v * THETA_MAX / THETA_DIM(mrisp_src);
+        vec1[0] = radius * sin_phi * cos(theta);
+        vec1[1] = radius * sin_phi * sin(theta);
+        vec1[2] = radius * cos_phi;
+
+        u1 = u + 1;
+        if (u1 >= U_DIM(mrisp_src)) u1 = U_DIM(mrisp_src) - (u1 - U_DIM(mrisp_src) + 2);
+        v1 = v + 1;
+        if (v1 >= V_DIM(mrisp_src)) v1 = V_DIM(mrisp_src) - (v1 - V_DIM(mrisp_src) + 2);
+        phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
+        theta1 = (double)v1 * THETA_MAX / THETA_DIM(mrisp_src);
+        vec2[0] = radius * sin(phi1) * cos(theta1);
+        vec2[1] = radius * sin(phi1) * sin(theta1);
+        vec2[2] = radius * cos(phi1);
+        angle = angleBetween(vec1, vec2);
+        d = circumference * angle / (2.0 * M_PI);
+
+        klen = nint(6.0f * sigma / d) + 1;
+        if (klen > MAX_KLEN) klen = MAX_KLEN;
+        if (ISEVEN(klen)) klen++;
+        if (klen >= U_DIM(mrisp_src)) klen = U_DIM(mrisp_src) - 1;
+        if (klen >= V_DIM(mrisp_src)) klen = V_DIM(mrisp_src) - 1;
+        khalf = klen / 2;
+
+        total = ktotal = 0.0;
+        for (uk = -khalf; uk <= khalf; uk++) {
+          u1 = u + uk;
+          if (u1 < 0) {
+            voff = V_DIM(mrisp_src) / 2;
+            u1 = -u1;
+          }
+          else if (u1 >= U_DIM(mrisp_src)) {
+            u1 = U_DIM(mrisp_src) - (u1 - U_DIM(mrisp_src) + 1);
+            voff = V_DIM(mrisp_src) / 2;
+          }
+          else
+            voff = 0;
+
+          phi1 = (double)u1 * PHI_MAX / PHI_DIM(mrisp_src);
+          sin_phi1 = sin(phi1);
+          cos_phi1 = cos(phi1);
+
+          for (vk = -khalf; vk <= khalf; vk++) {
+            theta1 = (double)v * THETA_MAX / THETA_DIM(mrisp_src);
+            vec2[0] = radius * sin_phi1 * cos(theta1);
+            vec2[1] = radius * sin_phi1 * sin(theta1);
+            vec2[2] = radius * cos_phi1;
+            angle = angleBetween(vec1, vec2);
+            d = circumference * angle / (2.0 * M_PI);
+            k = exp(-d * d * sigma_sq_inv);
+            v1 = v + vk + voff;
+            while (v1 < 0) v1 += V_DIM(mrisp_src);
+            while (v1 >= V_DIM(mrisp_src)) v1 -= V_DIM(mrisp_src);
+            ktotal += k;
+            total += k * *IMAGEFseq_pix(Ip_src, u1, v1, fno);
+          }
+        }
+        *IMAGEFseq_pix(mrisp_dst->Ip, u, v, fno) = total / ktotal;
+      }
+    }
+  }
+
+  return mrisp_dst;
+}
+
+
+// largest difference, relative to the largest value of a
+static double maxRelativeDifference(MRI_SP *a, MRI_SP *b)
+{
+  double maxdiff = 0.0, maxval = 0.0;
+  for (int f = 0; f < a->Ip->num_frame; f++)
+    for (int u = 0; u < U_DIM(a); u++)
+      for (int v = 0; v < V_DIM(a); v++) {
+        double const val = *IMAGEFseq_pix(a->Ip, u, v, f);
+        maxdiff = MAX(maxdiff, fabs(val - *IMAGEFseq_pix(b->Ip, u, v, f)));
+        maxval = MAX(maxval, fabs(val));
+      }
+  return FZERO(maxval) ? maxdiff : maxdiff / maxval;
+}
+
+
+// MRISPblur with its kernel evaluated for every tap
+static MRI_SP *referenceBlur(MRI_SP *mrisp_src, float sigma)
+{
+  int cart_klen = (int)nint(6.0f * sigma) + 1;
+  if (ISEVEN(cart_klen)) cart_klen++;
+  double const sigma_sq_inv = 1.0f / (sigma * sigma);
+  int const U = U_DIM(mrisp_src), V = V_DIM(mrisp_src);
+  MRI_SP *mrisp_dst = MRISPclone(mrisp_src);
+
+  for (int fno = 0; fno < mrisp_src->Ip->num_frame; fno++)
+    for (int u = 0; u < U; u++) {
+      double const phi = (double)u * PHI_MAX / PHI_DIM(mrisp_src);
+      double const sin_sq_u = sin(phi) * sin(phi);
+      int klen;
+      if (!FZERO(sin_sq_u)) {
+        int k = cart_klen * cart_klen;
+        klen = sqrt(k + k / sin_sq_u);
+        if (klen > MAX_LEN * cart_klen) klen = MAX_LEN * cart_klen;
+      }
+      else
+        klen = MAX_LEN * cart_klen;
+      if (klen >= U) klen = U - 1;
+      if (klen >= V) klen = V - 1;
+      int const khalf = klen / 2;
+
+      for (int v = 0; v < V; v++) {
+        double total = 0.0, ktotal = 0.0;
+        for (int uk = -khalf; uk <= khalf; uk++) {
+          int u1 = u + uk, voff = 0;
+          if (u1 < 0) {
+            voff = V / 2;
+            u1 = -u1;
+          }
+          else if (u1 >= U) {
+            u1 = U - (u1 - U + 1);
+            voff = V / 2;
+          }
+          for (int vk = -khalf; vk <= khalf; vk++) {
+            double const k = exp(-(uk * uk + sin_sq_u * vk * vk) * sigma_sq_inv);
+            int const v1 = ((v + vk + voff) % V + V) % V;
+            ktotal += k;
+            total += k * *IMAGEFseq_pix(mrisp_src->Ip, u1, v1, fno);
+          }
+        }
+        *IMAGEFseq_pix(mrisp_dst->Ip, u, v, fno) = total / ktotal;
+      }
+    }
+  return mrisp_dst;
+}
+
+
+static void setNumThreads(int n)
+{
+#ifdef HAVE_OPENMP
+  omp_set_num_threads(n);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+  MRI_SP *mrisp = MRISPalloc(SCALE, NFRAMES);
+  setRandomSeed(17L);
+  for (int f = 0; f < NFRAMES; f++)
+    for (int u = 0; u < U_DIM(mrisp); u++)
+      for (int v = 0; v < V_DIM(mrisp); v++) *IMAGEFseq_pix(mrisp->Ip, u, v, f) = randomNumber(-1.0, 1.0);
+
+  int nerrors = 0;
+  float const sigmas[] = {4.0f, 2.0f, 0.5f};
+  for (unsigned int s = 0; s < sizeof(sigmas) / sizeof(sigmas[0]); s++) {
+    MRI_SP *ref = referenceConvolveGaussian(mrisp, sigmas[s], RADIUS);
+    setNumThreads(1);
+    MRI_SP *one = MRISPconvolveGaussian(mrisp, NULL, sigmas[s], RADIUS, -1);
+    setNumThreads(NTHREADS);
+    MRI_SP *many = MRISPconvolveGaussian(mrisp, NULL, sigmas[s], RADIUS, -1);
+    MRI_SP *in_place = MRISPclone(mrisp);
+    MRISPconvolveGaussian(in_place, in_place, sigmas[s], RADIUS, -1);
+
+    double const diff = maxRelativeDifference(ref, one);
+    double const thread_diff = maxRelativeDifference(one, many);
+    double const in_place_diff = maxRelativeDifference(one, in_place);
+    std::cout << "MRISPconvolveGaussian sigma " << sigmas[s] << ": max rel diff " << diff << ", " << NTHREADS
+              << " threads " << thread_diff << ", in place " << in_place_diff << "\n";
+    if (diff > TOLERANCE || thread_diff != 0.0 || in_place_diff != 0.0) nerrors++;
+
+    MRISPfree(&ref);
+    MRISPfree(&one);
+    MRISPfree(&many);
+    MRISPfree(&in_place);
+  }
+
+  // 1 and 0.9 both have a cartesian kernel length of 7
+  float const blur_sigmas[] = {1.0f, 0.9f, 1.0f};
+  for (unsigned int s = 0; s < sizeof(blur_sigmas) / sizeof(blur_sigmas[0]); s++) {
+    MRI_SP *ref = referenceBlur(mrisp, blur_sigmas[s]);
+    MRI_SP *blurred = MRISPblur(mrisp, NULL, blur_sigmas[s], -1);
+    double const diff = maxRelativeDifference(ref, blurred);
+    std::cout << "MRISPblur sigma " << blur_sigmas[s] << ": max rel diff " << diff << "\n";
+    if (diff > TOLERANCE) nerrors++;
+    MRISPfree(&ref);
+    MRISPfree(&blurred);
+  }
+
+  MRISPfree(&mrisp);
+
+  if (nerrors) {
+    std::cout << nerrors << " blurs differ!\n";
+    exit(1);
+  }
+  std::cout << "all blurs agree\n";
+  exit(0);
+}
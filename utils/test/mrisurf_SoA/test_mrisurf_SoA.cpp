@@ -0,0 +1,113 @@
+//
+// test for the MRIS_SoA smoothness terms - located in utils/mrisurf_SoA.cpp
+//
+// Computes the spring, normal spring and tangential spring terms directly
+// from the MRIS and from an MRIS_SoA (reloaded every iteration, as
+// MRISpositionSurface does) on a bumpy icosahedral surface, and checks that
+// both give bit-identical gradients and that the SoA round trip leaves the
+// surface unchanged.
+//
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "mrisurf.h"
+#include "mrisurf_compute_dxyz.h"
+#include "mrisurf_SoA.h"
+#include "icosahedron.h"
+
+const char *Progname = "test_mrisurf_SoA";
+
+#define NREPEATS 3
+
+
+static void saveGradient(MRIS *mris, std::vector<float> &d)
+{
+  d.resize(3 * mris->nvertices);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    d[3 * vno + 0] = mris->vertices[vno].dx;
+    d[3 * vno + 1] = mris->vertices[vno].dy;
+    d[3 * vno + 2] = mris->vertices[vno].dz;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  // an icosahedron with radial bumps, so the terms are not all the same
+  MRIS *mris = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX *v = &mris->vertices[vno];
+    float r = 100 + 10 * sin(3 * v->x) * cos(2 * v->y) + 5 * sin(4 * v->z);
+    MRISsetXYZ(mris, vno, r * v->x, r * v->y, r * v->z);
+  }
+  MRIScomputeMetricProperties(mris);
+
+  INTEGRATION_PARMS parms;
+  parms.l_spring = 1.0;
+  parms.l_nspring = 0.5;
+  parms.l_tspring = 1.0;
+
+  // MRIS (array of structures)
+  std::vector<float> aos;
+  MRISclearGradient(mris);
+  for (int n = 0; n < NREPEATS; n++) {
+    mrisComputeSpringTerm(mris, parms.l_spring);
+    mrisComputeNormalSpringTerm(mris, parms.l_nspring);
+    mrisComputeTangentialSpringTerm(mris, parms.l_tspring);
+  }
+  saveGradient(mris, aos);
+
+  // MRIS_SoA, reloaded every iteration
+  std::vector<float> soav;
+  MRIS_SoA soa;
+  MRISSoA_ctr(&soa);
+  MRISclearGradient(mris);
+  for (int n = 0; n < NREPEATS; n++) {
+    MRISSoA_prepareSmoothnessTerms(&soa, mris, &parms);
+    mrisComputeSpringTerm(mris, &soa, parms.l_spring);
+    mrisComputeNormalSpringTerm(mris, &soa, parms.l_nspring);
+    mrisComputeTangentialSpringTerm(mris, &soa, parms.l_tspring);
+  }
+  saveGradient(mris, soav);
+
+  int nmismatch = 0, nzero = 0;
+  for (size_t i = 0; i < aos.size(); i++) {
+    if (memcmp(&aos[i], &soav[i], sizeof(float))) nmismatch++;
+    if (aos[i] == 0) nzero++;
+  }
+
+  // round trip SoA -> MRIS leaves the surface and the gradient as they were
+  MRISSoA_load(&soa, mris, true);
+  MRISSoA_unload(mris, &soa, false, true);
+  std::vector<float> unloaded;
+  saveGradient(mris, unloaded);
+  int nchanged = 0;
+  for (size_t i = 0; i < soav.size(); i++)
+    if (memcmp(&soav[i], &unloaded[i], sizeof(float))) nchanged++;
+
+  std::cout << mris->nvertices << " vertices, " << NREPEATS << " repeats\n";
+
+  MRISSoA_dtr(&soa);
+  MRISfree(&mris);
+
+  if (nzero == (int)aos.size()) {
+    std::cout << "the gradient is zero everywhere!\n";
+    exit(1);
+  }
+  if (nmismatch) {
+    std::cout << nmismatch << " gradient components differ!\n";
+    exit(1);
+  }
+  if (nchanged) {
+    std::cout << nchanged << " gradient components changed by the SoA round trip!\n";
+    exit(1);
+  }
+  std::cout << "gradients are identical\n";
+  exit(0);
+}
@@ -0,0 +1,273 @@
+//
+// unit test for freadFloatArray and freadIntArray
+// - located in utils/fio.cpp, used by the surface, curvature and annotation
+//   readers in utils/mrisurf_io.cpp and utils/mriio.cpp
+//
+// Writes a bumpy icosahedral surface, a curvature and an annotation to a
+// scratch directory one value at a time, parses the data blocks back one value
+// at a time with freadFloat/freadInt, the way the readers used to, and with
+// the bulk readers, then reads the files with MRISread, MRISreadCurvAsMRI and
+// MRISreadAnnotation.  The coordinates, faces, vertex-face topology,
+// curvature and annotation must all be identical to what was written.
+// Annotations that claim more vertices than the file holds, or more than the
+// surface has, must be rejected.
+//
+
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "utils.h"
+#include "macros.h"
+#include "fio.h"
+#include "mri.h"
+#include "mrisurf.h"
+#include "icosahedron.h"
+
+const char *Progname = "test_mrisurf_io";
+
+#define TRIANGLE_FILE_MAGIC_NUMBER (-2 & 0x00ffffff)  // as in mrisurf_io.cpp
+#define HUGE_NUM 0x7ffffff0
+
+struct FileData
+{
+  std::vector<float> xyz;
+  std::vector<int> faces;
+  std::vector<float> curv;
+  std::vector<int> annot;
+};
+
+static FILE *openOrDie(const char *fname, const char *mode)
+{
+  FILE *fp = fopen(fname, mode);
+  if (!fp) ErrorExit(ERROR_NOFILE, "%s: could not open %s", Progname, fname);
+  return fp;
+}
+
+// writes the files the way MRISwrite, MRISwriteCurvature and
+// MRISwriteAnnotation lay them out, one value at a time
+static void writeFiles(const char *surf, const char *curv, const char *annot, const FileData &data)
+{
+  FILE *fp = openOrDie(surf, "wb");
+  fwrite3(TRIANGLE_FILE_MAGIC_NUMBER, fp);
+  fprintf(fp, "created by %s\n\n", Progname);
+  fwriteInt(data.xyz.size() / 3, fp);
+  fwriteInt(data.faces.size() / 3, fp);
+  for (size_t i = 0; i < data.xyz.size(); i++) fwriteFloat(data.xyz[i], fp);
+  for (size_t i = 0; i < data.faces.size(); i++) fwriteInt(data.faces[i], fp);
+  fclose(fp);
+
+  fp = openOrDie(curv, "wb");
+  fwrite3(NEW_VERSION_MAGIC_NUMBER, fp);
+  fwriteInt(data.curv.size(), fp);
+  fwriteInt(data.faces.size() / 3, fp);
+  fwriteInt(1, fp);
+  for (size_t i = 0; i < data.curv.size(); i++) fwriteFloat(data.curv[i], fp);
+  fclose(fp);
+
+  fp = openOrDie(annot, "wb");
+  fwriteInt(data.annot.size() / 2, fp);
+  for (size_t i = 0; i < data.annot.size(); i++) fwriteInt(data.annot[i], fp);
+  fclose(fp);
+}
+
+// an annotation whose header claims num vertices, followed by npairs pairs
+static void writeCorruptAnnot(const char *annot, int num, int npairs)
+{
+  FILE *fp = openOrDie(annot, "wb");
+  fwriteInt(num, fp);
+  for (int i = 0; i < npairs; i++) {
+    fwriteInt(i, fp);
+    fwriteInt(i + 1, fp);
+  }
+  fclose(fp);
+}
+
+// reads the files up to the start of the data blocks, returns the block sizes
+static void readHeaders(FILE *sfp, FILE *cfp, FILE *afp, int *nvertices, int *nfaces, int *ncurv, int *nannot)
+{
+  int magic;
+  char line[STRLEN];
+
+  fread3(&magic, sfp);
+  if (magic != TRIANGLE_FILE_MAGIC_NUMBER) ErrorExit(ERROR_BADFILE, "%s: not a triangle file", Progname);
+  if (!fgets(line, 200, sfp)) ErrorExit(ERROR_BADFILE, "%s: no triangle file header", Progname);
+  if (fscanf(sfp, "\n") != 0) ErrorExit(ERROR_BADFILE, "%s: bad triangle file header", Progname);
+  *nvertices = freadInt(sfp);
+  *nfaces = freadInt(sfp);
+
+  fread3(&magic, cfp);
+  if (magic != NEW_VERSION_MAGIC_NUMBER) ErrorExit(ERROR_BADFILE, "%s: not a new-style curvature file", Progname);
+  *ncurv = freadInt(cfp);
+  freadInt(cfp);
+  if (freadInt(cfp) != 1) ErrorExit(ERROR_BADFILE, "%s: vals/vertex must be 1", Progname);
+
+  *nannot = freadInt(afp);
+}
+
+static void parseFiles(const char *surf, const char *curv, const char *annot, bool bulk, FileData &data)
+{
+  FILE *sfp = openOrDie(surf, "rb"), *cfp = openOrDie(curv, "rb"), *afp = openOrDie(annot, "rb");
+  int nvertices, nfaces, ncurv, nannot;
+  readHeaders(sfp, cfp, afp, &nvertices, &nfaces, &ncurv, &nannot);
+
+  data.xyz.resize(3 * (size_t)nvertices);
+  data.faces.resize(3 * (size_t)nfaces);
+  data.curv.resize(ncurv);
+  data.annot.resize(2 * (size_t)nannot);
+
+  if (bulk) {
+    freadFloatArray(&data.xyz[0], data.xyz.size(), sfp);
+    freadIntArray(&data.faces[0], data.faces.size(), sfp);
+    freadFloatArray(&data.curv[0], data.curv.size(), cfp);
+    freadIntArray(&data.annot[0], data.annot.size(), afp);
+  }
+  else {
+    for (size_t i = 0; i < data.xyz.size(); i++) data.xyz[i] = freadFloat(sfp);
+    for (size_t i = 0; i < data.faces.size(); i++) data.faces[i] = freadInt(sfp);
+    for (size_t i = 0; i < data.curv.size(); i++) data.curv[i] = freadFloat(cfp);
+    for (size_t i = 0; i < data.annot.size(); i++) data.annot[i] = freadInt(afp);
+  }
+
+  fclose(sfp);
+  fclose(cfp);
+  fclose(afp);
+}
+
+static bool sameData(const FileData &a, const FileData &b)
+{
+  return a.xyz.size() == b.xyz.size() && a.curv.size() == b.curv.size() && a.faces == b.faces && a.annot == b.annot &&
+         !memcmp(&a.xyz[0], &b.xyz[0], a.xyz.size() * sizeof(float)) &&
+         !memcmp(&a.curv[0], &b.curv[0], a.curv.size() * sizeof(float));
+}
+
+// compares what the library readers produced against what was written
+static int countDifferences(MRIS *mris, MRI *curvmri, const FileData &ref)
+{
+  int ndiff = 0;
+
+  if (3 * (size_t)mris->nvertices != ref.xyz.size() || 3 * (size_t)mris->nfaces != ref.faces.size()) {
+    std::cout << "surface size differs\n";
+    return 1;
+  }
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const * const v = &mris->vertices[vno];
+    if (v->x != ref.xyz[3 * vno] || v->y != ref.xyz[3 * vno + 1] || v->z != ref.xyz[3 * vno + 2]) ndiff++;
+  }
+  for (int fno = 0; fno < mris->nfaces; fno++)
+    for (int n = 0; n < VERTICES_PER_FACE; n++)
+      if (mris->faces[fno].v[n] != ref.faces[3 * fno + n]) ndiff++;
+
+  // every vertex must list each face it is in, with its position in that face
+  std::vector<int> nfaces(mris->nvertices, 0);
+  for (size_t i = 0; i < ref.faces.size(); i++) nfaces[ref.faces[i]]++;
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    if (vt->num != nfaces[vno]) ndiff++;
+    for (int n = 0; n < vt->num; n++)
+      if (mris->faces[vt->f[n]].v[vt->n[n]] != vno) ndiff++;
+  }
+
+  if (curvmri->width != (int)ref.curv.size()) ndiff++;
+  else
+    for (int k = 0; k < curvmri->width; k++)
+      if (MRIgetVoxVal(curvmri, k, 0, 0, 0) != ref.curv[k]) ndiff++;
+
+  if (ref.annot.size() != 2 * (size_t)mris->nvertices) ndiff++;
+  else
+    for (size_t i = 0; i < ref.annot.size(); i += 2)
+      if (mris->vertices[ref.annot[i]].annotation != ref.annot[i + 1]) ndiff++;
+
+  return ndiff;
+}
+
+int main(int argc, char *argv[])
+{
+  char dir[STRLEN], surf[STRLEN], curv[STRLEN], annot[STRLEN], bad[STRLEN];
+  const char *tmpdir = getenv("TMPDIR");
+
+  if (tmpdir == NULL) tmpdir = "/tmp";
+  sprintf(dir, "%s/%s.%d", tmpdir, Progname, (int)getpid());
+  if (mkdir(dir, 0700)) ErrorExit(ERROR_BADFILE, "%s: could not create %s", Progname, dir);
+  sprintf(surf, "%s/lh.white", dir);
+  sprintf(curv, "%s/lh.curv", dir);
+  sprintf(annot, "%s/lh.test.annot", dir);
+  sprintf(bad, "%s/lh.bad.annot", dir);
+
+  // a bumpy sphere, with the annotation pairs in reverse vertex order
+  MRIS *ico = ic2562_make_surface(ICO4_NVERTICES, ICO4_NFACES);
+  FileData written;
+  for (int vno = 0; vno < ico->nvertices; vno++) {
+    VERTEX const * const v = &ico->vertices[vno];
+    float const r = 100 + 10 * sin(3 * v->x) * cos(2 * v->y) + 5 * sin(4 * v->z);
+    written.xyz.push_back(r * v->x);
+    written.xyz.push_back(r * v->y);
+    written.xyz.push_back(r * v->z);
+    written.curv.push_back(sin(7 * v->x) * cos(5 * v->z) / 3);
+  }
+  for (int fno = 0; fno < ico->nfaces; fno++)
+    for (int n = 0; n < VERTICES_PER_FACE; n++) written.faces.push_back(ico->faces[fno].v[n]);
+  for (int vno = ico->nvertices - 1; vno >= 0; vno--) {
+    written.annot.push_back(vno);
+    written.annot.push_back((vno % 17) * 0x010203 + 0x100000);
+  }
+  MRISfree(&ico);
+  writeFiles(surf, curv, annot, written);
+
+  int nfailed = 0;
+  FileData ref, bulk;
+  parseFiles(surf, curv, annot, false, ref);
+  parseFiles(surf, curv, annot, true, bulk);
+  if (!sameData(ref, written)) {
+    std::cout << "FAILED: per-value parse differs from what was written\n";
+    nfailed++;
+  }
+  if (!sameData(bulk, written)) {
+    std::cout << "FAILED: bulk parse differs from what was written\n";
+    nfailed++;
+  }
+
+  MRIS *mris = MRISread(surf);
+  if (!mris) ErrorExit(ERROR_NOFILE, "%s: could not read surface %s", Progname, surf);
+  MRI *curvmri = MRISreadCurvAsMRI(curv, 1);
+  if (!curvmri) ErrorExit(ERROR_NOFILE, "%s: could not read curvature %s", Progname, curv);
+  if (MRISreadAnnotation(mris, annot) != NO_ERROR)
+    ErrorExit(ERROR_NOFILE, "%s: could not read annotation %s", Progname, annot);
+
+  int const ndiff = countDifferences(mris, curvmri, written);
+  std::cout << ndiff << " values differ from what was written\n";
+  if (ndiff) nfailed++;
+
+  // a header count far beyond the file, and one that matches the surface
+  // but is backed by only half of the pairs
+  writeCorruptAnnot(bad, HUGE_NUM, mris->nvertices);
+  if (MRISreadAnnotation(mris, bad) == NO_ERROR) {
+    std::cout << "FAILED: annotation claiming " << HUGE_NUM << " vertices was accepted\n";
+    nfailed++;
+  }
+  writeCorruptAnnot(bad, mris->nvertices, mris->nvertices / 2);
+  if (MRISreadAnnotation(mris, bad) == NO_ERROR) {
+    std::cout << "FAILED: truncated annotation was accepted\n";
+    nfailed++;
+  }
+
+  MRIfree(&curvmri);
+  MRISfree(&mris);
+
+  unlink(surf);
+  unlink(curv);
+  unlink(annot);
+  unlink(bad);
+  rmdir(dir);
+
+  if (nfailed) {
+    std::cout << "FAILED\n";
+    exit(1);
+  }
+  std::cout << "readers agree\n";
+  exit(0);
+}